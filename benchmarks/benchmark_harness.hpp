@@ -0,0 +1,134 @@
+#pragma once
+
+// Minimal micro-benchmark harness for `oc_new_benchmarks`.
+//
+// Benchmarks are plain functions that register results through `report_result`. Timing uses
+// `QueryPerformanceCounter`; each measurement runs a warmup pass followed by `trials` timed
+// batches of `iterations` calls, and reports min/median/max ns per operation.
+//
+// Results are printed as one JSON object per line on stdout so runs can be diffed or collected
+// by scripts without a parser for a bespoke format. Human-readable progress goes to stderr.
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace oc::benchmarks
+{
+    struct BenchmarkOptions final
+    {
+        size_t warmup_iterations{ 1'000 };
+        size_t iterations{ 20'000 };
+        size_t trials{ 7 };
+    };
+
+    struct BenchmarkStats final
+    {
+        size_t iterations{};
+        size_t trials{};
+        double min_ns_per_op{};
+        double median_ns_per_op{};
+        double max_ns_per_op{};
+    };
+
+    // Optional extra numeric fields appended to a result line (for example `bytes_per_op`).
+    struct BenchmarkMetric final
+    {
+        std::wstring_view name;
+        double value{};
+    };
+
+    [[nodiscard]] inline uint64_t now_ticks() noexcept
+    {
+        LARGE_INTEGER counter{};
+        (void)::QueryPerformanceCounter(&counter);
+        return static_cast<uint64_t>(counter.QuadPart);
+    }
+
+    [[nodiscard]] inline double ticks_to_ns(const uint64_t ticks) noexcept
+    {
+        static const double ns_per_tick = [] {
+            LARGE_INTEGER frequency{};
+            (void)::QueryPerformanceFrequency(&frequency);
+            return frequency.QuadPart > 0 ? 1'000'000'000.0 / static_cast<double>(frequency.QuadPart) : 0.0;
+        }();
+        return static_cast<double>(ticks) * ns_per_tick;
+    }
+
+    // Runs `operation` (a callable returning `bool`) under `options`. Returns `std::nullopt` as soon
+    // as an invocation reports failure so broken benchmarks never print misleading numbers.
+    template<typename Operation>
+    [[nodiscard]] std::optional<BenchmarkStats> measure(const BenchmarkOptions& options, Operation&& operation)
+    {
+        for (size_t i = 0; i < options.warmup_iterations; ++i)
+        {
+            if (!operation())
+            {
+                return std::nullopt;
+            }
+        }
+
+        const size_t iterations = std::max<size_t>(options.iterations, 1);
+        const size_t trials = std::max<size_t>(options.trials, 1);
+
+        std::vector<double> samples;
+        samples.reserve(trials);
+        for (size_t trial = 0; trial < trials; ++trial)
+        {
+            const uint64_t start = now_ticks();
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                if (!operation())
+                {
+                    return std::nullopt;
+                }
+            }
+            const uint64_t stop = now_ticks();
+            samples.push_back(ticks_to_ns(stop - start) / static_cast<double>(iterations));
+        }
+
+        std::sort(samples.begin(), samples.end());
+        return BenchmarkStats{
+            .iterations = iterations,
+            .trials = trials,
+            .min_ns_per_op = samples.front(),
+            .median_ns_per_op = samples[samples.size() / 2],
+            .max_ns_per_op = samples.back(),
+        };
+    }
+
+    inline void report_result(
+        const std::wstring_view name,
+        const BenchmarkStats& stats,
+        const std::span<const BenchmarkMetric> metrics = {}) noexcept
+    {
+        wprintf(
+            L"{\"benchmark\":\"%.*ls\",\"iterations\":%zu,\"trials\":%zu,"
+            L"\"min_ns_per_op\":%.2f,\"median_ns_per_op\":%.2f,\"max_ns_per_op\":%.2f",
+            static_cast<int>(name.size()),
+            name.data(),
+            stats.iterations,
+            stats.trials,
+            stats.min_ns_per_op,
+            stats.median_ns_per_op,
+            stats.max_ns_per_op);
+        for (const auto& metric : metrics)
+        {
+            wprintf(L",\"%.*ls\":%.3f", static_cast<int>(metric.name.size()), metric.name.data(), metric.value);
+        }
+        wprintf(L"}\n");
+        (void)fflush(stdout);
+    }
+
+    inline void report_failure(const std::wstring_view name) noexcept
+    {
+        fwprintf(stderr, L"[BENCH FAIL] %.*ls\n", static_cast<int>(name.size()), name.data());
+    }
+}
@@ -0,0 +1,50 @@
+#include <cstdio>
+#include <Windows.h>
+
+bool run_condrv_dispatch_benchmarks();
+bool run_condrv_write_console_benchmarks();
+bool run_condrv_pipeline_benchmarks();
+bool run_condrv_screen_buffer_benchmarks();
+bool run_condrv_vt_parser_benchmarks();
+
+int main()
+{
+    int failed = 0;
+
+    fwprintf(stderr, L"[BENCH] condrv dispatch\n");
+    if (!run_condrv_dispatch_benchmarks())
+    {
+        fwprintf(stderr, L"[FAIL] condrv dispatch benchmarks\n");
+        ++failed;
+    }
+
+    fwprintf(stderr, L"[BENCH] condrv write console\n");
+    if (!run_condrv_write_console_benchmarks())
+    {
+        fwprintf(stderr, L"[FAIL] condrv write console benchmarks\n");
+        ++failed;
+    }
+
+    fwprintf(stderr, L"[BENCH] condrv pipeline\n");
+    if (!run_condrv_pipeline_benchmarks())
+    {
+        fwprintf(stderr, L"[FAIL] condrv pipeline benchmarks\n");
+        ++failed;
+    }
+
+    fwprintf(stderr, L"[BENCH] condrv screen buffer\n");
+    if (!run_condrv_screen_buffer_benchmarks())
+    {
+        fwprintf(stderr, L"[FAIL] condrv screen buffer benchmarks\n");
+        ++failed;
+    }
+
+    fwprintf(stderr, L"[BENCH] condrv vt parser\n");
+    if (!run_condrv_vt_parser_benchmarks())
+    {
+        fwprintf(stderr, L"[FAIL] condrv vt parser benchmarks\n");
+        ++failed;
+    }
+
+    return failed == 0 ? 0 : 1;
+}
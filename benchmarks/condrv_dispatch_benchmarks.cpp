@@ -0,0 +1,292 @@
+#include "benchmark_harness.hpp"
+
+#include "condrv/condrv_server.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Per-API dispatch latency for `dispatch_message` on the USER_DEFINED path.
+//
+// Each iteration constructs a fresh `BasicApiMessage` from a prepared packet and dispatches it
+// against a connected in-memory server (`DummyComm` + `NullHostIo`), so the numbers include the
+// message setup and descriptor reply copy but no driver round-trips. APIs are picked from all
+// three layers, plus the deprecated and unknown-number reject paths, so lookup cost is visible
+// independently of the handler bodies.
+
+namespace
+{
+    struct DummyComm final
+    {
+        std::vector<std::byte> input;
+        std::vector<std::byte> output;
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_input(oc::condrv::IoOperation& operation) noexcept
+        {
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset + size > input.size())
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"DummyComm read_input out of range",
+                    .win32_error = ERROR_INVALID_DATA,
+                });
+            }
+
+            if (size != 0)
+            {
+                std::memcpy(operation.buffer.data, input.data() + offset, size);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write_output(oc::condrv::IoOperation& operation) noexcept
+        {
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset + size > output.size())
+            {
+                output.resize(offset + size);
+            }
+
+            if (size != 0)
+            {
+                std::memcpy(output.data() + offset, operation.buffer.data, size);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> complete_io(const oc::condrv::IoComplete& /*completion*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    enum class TargetObject
+    {
+        input,
+        output,
+    };
+
+    struct ApiCase final
+    {
+        std::wstring_view name;
+        ULONG api_number{};
+        ULONG api_size{};
+        TargetObject target{ TargetObject::output };
+        NTSTATUS expected_status{ oc::core::status_success };
+        void (*prepare)(oc::condrv::IoPacket& packet) noexcept { nullptr };
+        std::string_view payload{};
+    };
+
+    [[nodiscard]] oc::condrv::IoPacket make_connect_packet(const DWORD pid, const DWORD tid) noexcept
+    {
+        oc::condrv::IoPacket packet{};
+        packet.descriptor.identifier.LowPart = 1;
+        packet.descriptor.function = oc::condrv::console_io_connect;
+        packet.descriptor.process = pid;
+        packet.descriptor.object = tid;
+        return packet;
+    }
+
+    [[nodiscard]] oc::condrv::IoPacket make_user_defined_packet(
+        const oc::condrv::ConnectionInformation& info,
+        const ApiCase& api) noexcept
+    {
+        const ULONG read_offset = api.api_size + static_cast<ULONG>(sizeof(CONSOLE_MSG_HEADER));
+
+        oc::condrv::IoPacket packet{};
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = 100;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = info.process;
+        packet.descriptor.object = api.target == TargetObject::input ? info.input : info.output;
+        packet.descriptor.input_size = read_offset + static_cast<ULONG>(api.payload.size());
+        packet.descriptor.output_size = api.api_size;
+        packet.payload.user_defined.msg_header.ApiNumber = api.api_number;
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api.api_size;
+        if (api.prepare != nullptr)
+        {
+            api.prepare(packet);
+        }
+
+        return packet;
+    }
+
+    void prepare_get_output_cp(oc::condrv::IoPacket& packet) noexcept
+    {
+        packet.payload.user_defined.u.console_msg_l1.GetConsoleCP.Output = TRUE;
+    }
+
+    void prepare_set_input_mode(oc::condrv::IoPacket& packet) noexcept
+    {
+        packet.payload.user_defined.u.console_msg_l1.SetConsoleMode.Mode =
+            ENABLE_PROCESSED_INPUT | ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT | ENABLE_MOUSE_INPUT | ENABLE_EXTENDED_FLAGS;
+    }
+
+    void prepare_write_console_ansi(oc::condrv::IoPacket& packet) noexcept
+    {
+        packet.payload.user_defined.u.console_msg_l1.WriteConsole.Unicode = FALSE;
+    }
+
+    void prepare_set_cursor_position(oc::condrv::IoPacket& packet) noexcept
+    {
+        packet.payload.user_defined.u.console_msg_l2.SetConsoleCursorPosition.CursorPosition = COORD{ 4, 2 };
+    }
+
+    void prepare_set_text_attribute(oc::condrv::IoPacket& packet) noexcept
+    {
+        packet.payload.user_defined.u.console_msg_l2.SetConsoleTextAttribute.Attributes =
+            FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+    }
+
+    void prepare_fill_console_output(oc::condrv::IoPacket& packet) noexcept
+    {
+        auto& body = packet.payload.user_defined.u.console_msg_l2.FillConsoleOutput;
+        body.WriteCoord = COORD{ 0, 0 };
+        body.ElementType = CONSOLE_REAL_UNICODE;
+        body.Element = static_cast<USHORT>(L'x');
+        body.Length = 80;
+    }
+
+    [[nodiscard]] bool run_api_case(const ApiCase& api, const oc::benchmarks::BenchmarkOptions& options)
+    {
+        DummyComm comm{};
+        oc::condrv::ServerState state{};
+        oc::condrv::NullHostIo host_io{};
+
+        auto connect_packet = make_connect_packet(111, 222);
+        oc::condrv::BasicApiMessage<DummyComm> connect_message(comm, connect_packet);
+        auto connect_outcome = oc::condrv::dispatch_message(state, connect_message, host_io);
+        if (!connect_outcome || connect_message.completion().io_status.Status != oc::core::status_success)
+        {
+            return false;
+        }
+
+        oc::condrv::ConnectionInformation info{};
+        std::memcpy(&info, connect_message.completion().write.data, sizeof(info));
+
+        const auto packet = make_user_defined_packet(info, api);
+        comm.input.assign(packet.descriptor.input_size, std::byte{});
+        if (!api.payload.empty())
+        {
+            const size_t read_offset = api.api_size + sizeof(CONSOLE_MSG_HEADER);
+            std::memcpy(comm.input.data() + read_offset, api.payload.data(), api.payload.size());
+        }
+
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            oc::condrv::BasicApiMessage<DummyComm> message(comm, packet);
+            auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+            return outcome.has_value() && message.completion().io_status.Status == api.expected_status;
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"api_number", .value = static_cast<double>(api.api_number) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"payload_bytes", .value = static_cast<double>(api.payload.size()) },
+        };
+        oc::benchmarks::report_result(api.name, *stats, metrics);
+        return true;
+    }
+}
+
+bool run_condrv_dispatch_benchmarks()
+{
+    constexpr std::string_view write_console_line = "dispatch benchmark line 0123456789\r\n";
+
+    const std::array cases{
+        ApiCase{
+            .name = L"condrv.dispatch.l1.get_cp",
+            .api_number = static_cast<ULONG>(ConsolepGetCP),
+            .api_size = sizeof(CONSOLE_GETCP_MSG),
+            .prepare = &prepare_get_output_cp,
+        },
+        ApiCase{
+            .name = L"condrv.dispatch.l1.get_mode",
+            .api_number = static_cast<ULONG>(ConsolepGetMode),
+            .api_size = sizeof(CONSOLE_MODE_MSG),
+            .target = TargetObject::input,
+        },
+        ApiCase{
+            .name = L"condrv.dispatch.l1.set_mode",
+            .api_number = static_cast<ULONG>(ConsolepSetMode),
+            .api_size = sizeof(CONSOLE_MODE_MSG),
+            .target = TargetObject::input,
+            .prepare = &prepare_set_input_mode,
+        },
+        ApiCase{
+            .name = L"condrv.dispatch.l1.write_console_a",
+            .api_number = static_cast<ULONG>(ConsolepWriteConsole),
+            .api_size = sizeof(CONSOLE_WRITECONSOLE_MSG),
+            .prepare = &prepare_write_console_ansi,
+            .payload = write_console_line,
+        },
+        ApiCase{
+            .name = L"condrv.dispatch.l2.get_screen_buffer_info",
+            .api_number = static_cast<ULONG>(ConsolepGetScreenBufferInfo),
+            .api_size = sizeof(CONSOLE_SCREENBUFFERINFO_MSG),
+        },
+        ApiCase{
+            .name = L"condrv.dispatch.l2.set_cursor_position",
+            .api_number = static_cast<ULONG>(ConsolepSetCursorPosition),
+            .api_size = sizeof(CONSOLE_SETCURSORPOSITION_MSG),
+            .prepare = &prepare_set_cursor_position,
+        },
+        ApiCase{
+            .name = L"condrv.dispatch.l2.set_text_attribute",
+            .api_number = static_cast<ULONG>(ConsolepSetTextAttribute),
+            .api_size = sizeof(CONSOLE_SETTEXTATTRIBUTE_MSG),
+            .prepare = &prepare_set_text_attribute,
+        },
+        ApiCase{
+            .name = L"condrv.dispatch.l2.fill_console_output",
+            .api_number = static_cast<ULONG>(ConsolepFillConsoleOutput),
+            .api_size = sizeof(CONSOLE_FILLCONSOLEOUTPUT_MSG),
+            .prepare = &prepare_fill_console_output,
+        },
+        ApiCase{
+            .name = L"condrv.dispatch.l3.get_display_mode",
+            .api_number = static_cast<ULONG>(ConsolepGetDisplayMode),
+            .api_size = sizeof(CONSOLE_GETDISPLAYMODE_MSG),
+        },
+        ApiCase{
+            .name = L"condrv.dispatch.l3.get_console_window",
+            .api_number = static_cast<ULONG>(ConsolepGetConsoleWindow),
+            .api_size = sizeof(CONSOLE_GETCONSOLEWINDOW_MSG),
+        },
+        ApiCase{
+            .name = L"condrv.dispatch.l3.deprecated_set_icon",
+            .api_number = static_cast<ULONG>(ConsolepSetIcon),
+            .api_size = sizeof(CONSOLE_SETICON_MSG),
+            .expected_status = oc::core::status_not_implemented,
+        },
+        ApiCase{
+            .name = L"condrv.dispatch.unknown_api_number",
+            .api_number = static_cast<ULONG>(ConsolepSetCurrentFont) + 1,
+            .api_size = 0,
+            .expected_status = oc::core::status_not_implemented,
+        },
+    };
+
+    const oc::benchmarks::BenchmarkOptions options{};
+
+    bool ok = true;
+    for (const auto& api : cases)
+    {
+        if (!run_api_case(api, options))
+        {
+            oc::benchmarks::report_failure(api.name);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
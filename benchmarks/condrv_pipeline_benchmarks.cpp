@@ -0,0 +1,635 @@
+#include "benchmark_harness.hpp"
+
+#include "condrv/condrv_server.hpp"
+#include "condrv/condrv_server_pipeline.hpp"
+#include "condrv/host_output_buffer.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Serial vs pipelined ConDrv server loop throughput against a simulated driver.
+//
+// `SimulatedDriver` charges a fixed busy-wait latency for every driver call (`read_io`,
+// `complete_io`, `read_input`, `write_output`) and serves scripted WriteConsoleW requests from
+// several synchronous clients: a client's next request becomes readable only after its previous
+// one is completed. One iteration runs a whole session (every script to completion) either through
+// a copy of the serial loop's read/dispatch/stage cycle or through `BasicIoPipeline` +
+// `run_pipelined_dispatch`. `requests_per_s` is derived from the median trial; the pipelined
+// results also report `speedup` over the serial run of the same case.
+//
+// `condrv.host_output.*` runs the same sessions against a host that forwards output to a terminal
+// through `FakePipe`, which charges a fixed busy-wait latency per write like a pipe `WriteFile`.
+// `direct` writes every message's bytes as they are produced (the old `HostIo` behavior);
+// `combined` goes through `BasicHostOutputBuffer` and flushes where `run_loop` does: when
+// `BasicSerialOutputHold` stops holding it in the serial loop, and when a batch drains in the
+// pipelined one. Each case reports `pipe_writes_per_mb` and `mb_per_s` of terminal output.
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Request final
+    {
+        oc::condrv::IoPacket packet{};
+        std::vector<std::byte> input;
+    };
+
+    using Scripts = std::vector<std::vector<Request>>;
+
+    [[nodiscard]] constexpr ULONG request_id(const size_t client, const size_t index) noexcept
+    {
+        return static_cast<ULONG>((client << 16) | (index + 1));
+    }
+
+    class SimulatedDriver final
+    {
+    public:
+        SimulatedDriver(const Scripts& scripts, const std::chrono::nanoseconds latency) :
+            _scripts(&scripts),
+            _latency(latency),
+            _next(scripts.size(), 0)
+        {
+            for (size_t client = 0; client < scripts.size(); ++client)
+            {
+                issue_next_locked(client);
+            }
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_io(
+            const oc::condrv::IoComplete* const reply,
+            oc::condrv::IoPacket& packet) noexcept
+        {
+            simulate_latency();
+
+            std::unique_lock lock(_lock);
+            if (reply != nullptr)
+            {
+                complete_locked(*reply);
+            }
+
+            for (;;)
+            {
+                if (_wake_pending)
+                {
+                    _wake_pending = false;
+                    return std::unexpected(oc::condrv::DeviceCommError{
+                        .context = L"SimulatedDriver read_io canceled",
+                        .win32_error = ERROR_OPERATION_ABORTED,
+                    });
+                }
+
+                if (!_ready.empty())
+                {
+                    const auto [client, index] = _ready.front();
+                    _ready.pop_front();
+                    packet = (*_scripts)[client][index].packet;
+                    return {};
+                }
+
+                if (_finished_clients == _scripts->size())
+                {
+                    return std::unexpected(oc::condrv::DeviceCommError{
+                        .context = L"SimulatedDriver has no clients left",
+                        .win32_error = ERROR_PIPE_NOT_CONNECTED,
+                    });
+                }
+
+                _changed.wait(lock);
+            }
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> complete_io(const oc::condrv::IoComplete& completion) noexcept
+        {
+            simulate_latency();
+
+            std::lock_guard lock(_lock);
+            complete_locked(completion);
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_input(oc::condrv::IoOperation& operation) noexcept
+        {
+            simulate_latency();
+
+            const ULONG id = operation.identifier.LowPart;
+            const size_t client = id >> 16;
+            const size_t index = (id & 0xFFFF) - 1;
+            const auto& input = (*_scripts)[client][index].input;
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset + size > input.size())
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"SimulatedDriver read_input out of range",
+                    .win32_error = ERROR_INVALID_DATA,
+                });
+            }
+
+            if (size != 0)
+            {
+                std::memcpy(operation.buffer.data, input.data() + offset, size);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write_output(oc::condrv::IoOperation& /*operation*/) noexcept
+        {
+            simulate_latency();
+            return {};
+        }
+
+        void wake_read_io() noexcept
+        {
+            std::lock_guard lock(_lock);
+            _wake_pending = true;
+            _changed.notify_all();
+        }
+
+        [[nodiscard]] bool all_completed() const
+        {
+            std::lock_guard lock(_lock);
+            return _finished_clients == _scripts->size() && _failed_completions == 0;
+        }
+
+    private:
+        void simulate_latency() const noexcept
+        {
+            if (_latency.count() == 0)
+            {
+                return;
+            }
+
+            const auto deadline = Clock::now() + _latency;
+            while (Clock::now() < deadline)
+            {
+            }
+        }
+
+        void issue_next_locked(const size_t client)
+        {
+            if (_next[client] < (*_scripts)[client].size())
+            {
+                _ready.emplace_back(client, _next[client]);
+                ++_next[client];
+            }
+            else
+            {
+                ++_finished_clients;
+            }
+        }
+
+        void complete_locked(const oc::condrv::IoComplete& completion)
+        {
+            if (completion.io_status.Status != oc::core::status_success)
+            {
+                ++_failed_completions;
+            }
+
+            issue_next_locked(completion.identifier.LowPart >> 16);
+            _changed.notify_all();
+        }
+
+        const Scripts* _scripts{};
+        std::chrono::nanoseconds _latency{};
+        mutable std::mutex _lock;
+        std::condition_variable _changed;
+        std::vector<size_t> _next;
+        std::deque<std::pair<size_t, size_t>> _ready;
+        size_t _finished_clients{ 0 };
+        size_t _failed_completions{ 0 };
+        bool _wake_pending{ false };
+    };
+
+    struct ConnectComm final
+    {
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_input(oc::condrv::IoOperation& /*operation*/) noexcept
+        {
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write_output(oc::condrv::IoOperation& /*operation*/) noexcept
+        {
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> complete_io(const oc::condrv::IoComplete& /*completion*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    // Stands in for the host output pipe: charges `latency` per write and counts writes.
+    struct FakePipe final
+    {
+        std::chrono::nanoseconds latency{};
+        uint64_t writes{};
+        uint64_t bytes{};
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write(const std::span<const std::byte> data) noexcept
+        {
+            const auto deadline = Clock::now() + latency;
+            while (Clock::now() < deadline)
+            {
+            }
+
+            ++writes;
+            bytes += data.size();
+            return {};
+        }
+    };
+
+    // `NullHostIo`, but output goes to a `FakePipe` and VT queries are left to the terminal, as in
+    // a ConPTY session. With a capacity of 1 every write goes through at once.
+    struct FakePipeHostIo final
+    {
+        FakePipeHostIo(const std::chrono::nanoseconds pipe_latency, const bool combine) noexcept :
+            output(FakePipe{ .latency = pipe_latency }, combine ? oc::condrv::BasicHostOutputBuffer<FakePipe>::default_capacity : 1)
+        {
+        }
+
+        oc::condrv::NullHostIo sink;
+        oc::condrv::BasicHostOutputBuffer<FakePipe> output;
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> write_output_bytes(const std::span<const std::byte> bytes) noexcept
+        {
+            return output.write(bytes);
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> flush_output() noexcept
+        {
+            return output.flush();
+        }
+
+        [[nodiscard]] size_t pending_output_bytes() const noexcept
+        {
+            return output.pending_bytes();
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> read_input_bytes(const std::span<std::byte> dest) noexcept
+        {
+            return sink.read_input_bytes(dest);
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> peek_input_bytes(const std::span<std::byte> dest) noexcept
+        {
+            return sink.peek_input_bytes(dest);
+        }
+
+        [[nodiscard]] size_t input_bytes_available() const noexcept
+        {
+            return sink.input_bytes_available();
+        }
+
+        [[nodiscard]] bool input_disconnected() const noexcept
+        {
+            return sink.input_disconnected();
+        }
+
+        [[nodiscard]] bool inject_input_bytes(const std::span<const std::byte> bytes) noexcept
+        {
+            return sink.inject_input_bytes(bytes);
+        }
+
+        [[nodiscard]] bool vt_should_answer_queries() const noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> flush_input_buffer() noexcept
+        {
+            return sink.flush_input_buffer();
+        }
+
+        [[nodiscard]] std::expected<bool, oc::condrv::DeviceCommError> wait_for_input(const DWORD timeout_ms) noexcept
+        {
+            return sink.wait_for_input(timeout_ms);
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> send_end_task(
+            const DWORD process_id,
+            const DWORD event_type,
+            const DWORD ctrl_flags) noexcept
+        {
+            return sink.send_end_task(process_id, event_type, ctrl_flags);
+        }
+    };
+
+    [[nodiscard]] std::optional<Scripts> make_scripts(
+        oc::condrv::ServerState& state,
+        oc::condrv::NullHostIo& host_io,
+        const size_t client_count,
+        const size_t requests_per_client)
+    {
+        constexpr ULONG api_size = sizeof(CONSOLE_WRITECONSOLE_MSG);
+        constexpr ULONG read_offset = api_size + sizeof(CONSOLE_MSG_HEADER);
+        constexpr std::wstring_view line = L"[worker] processed request, status=ok, elapsed=12ms\r\n";
+        const auto payload = std::as_bytes(std::span(line.data(), line.size()));
+
+        Scripts scripts(client_count);
+        for (size_t client = 0; client < client_count; ++client)
+        {
+            ConnectComm comm{};
+            oc::condrv::IoPacket connect{};
+            connect.descriptor.identifier.LowPart = 1;
+            connect.descriptor.function = oc::condrv::console_io_connect;
+            connect.descriptor.process = 3000 + client;
+            connect.descriptor.object = 4000 + client;
+
+            oc::condrv::BasicApiMessage<ConnectComm> message(comm, connect);
+            auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+            if (!outcome || message.completion().io_status.Status != oc::core::status_success)
+            {
+                return std::nullopt;
+            }
+
+            oc::condrv::ConnectionInformation info{};
+            std::memcpy(&info, message.completion().write.data, sizeof(info));
+
+            for (size_t index = 0; index < requests_per_client; ++index)
+            {
+                Request request{};
+                auto& packet = request.packet;
+                packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+                packet.descriptor.identifier.LowPart = request_id(client, index);
+                packet.descriptor.function = oc::condrv::console_io_user_defined;
+                packet.descriptor.process = info.process;
+                packet.descriptor.object = info.output;
+                packet.descriptor.input_size = read_offset + static_cast<ULONG>(payload.size());
+                packet.descriptor.output_size = api_size;
+                packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepWriteConsole);
+                packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+                packet.payload.user_defined.u.console_msg_l1.WriteConsole.Unicode = TRUE;
+
+                request.input.assign(packet.descriptor.input_size, std::byte{});
+                std::memcpy(request.input.data() + read_offset, payload.data(), payload.size());
+                scripts[client].push_back(std::move(request));
+            }
+        }
+
+        return scripts;
+    }
+
+    // Writes out output a host combines across messages; `NullHostIo` writes nothing.
+    template<typename HostIo>
+    void flush_host_output(HostIo& host_io) noexcept
+    {
+        if constexpr (requires { host_io.flush_output(); })
+        {
+            (void)host_io.flush_output();
+        }
+    }
+
+    struct SteadyMicrosecondClock final
+    {
+        [[nodiscard]] uint64_t now_us() const noexcept
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count());
+        }
+    };
+
+    // `run_loop`'s `serial_output_hold_us`.
+    constexpr uint64_t serial_output_hold_us = 1'000;
+
+    // Mirrors the serial `run_loop` cycle: one thread reads, dispatches and stages each reply into
+    // the next `read_io`. The scripted clients always have a request ready once their previous one
+    // is completed, so a read never blocks on held output and the loop needs no output wake.
+    template<typename HostIo>
+    [[nodiscard]] bool run_serial_session(
+        oc::condrv::ServerState& state,
+        HostIo& host_io,
+        const Scripts& scripts,
+        const std::chrono::nanoseconds latency)
+    {
+        SimulatedDriver driver(scripts, latency);
+        std::optional<oc::condrv::BasicApiMessage<SimulatedDriver>> staged;
+        oc::condrv::BasicSerialOutputHold<SteadyMicrosecondClock> output_hold(serial_output_hold_us);
+        for (;;)
+        {
+            if constexpr (requires { host_io.pending_output_bytes(); })
+            {
+                if (!output_hold.before_read(host_io))
+                {
+                    return false;
+                }
+            }
+
+            oc::condrv::IoPacket packet{};
+            auto read = driver.read_io(staged.has_value() ? &staged->completion() : nullptr, packet);
+            output_hold.after_read(read.has_value());
+            staged.reset();
+            if (!read)
+            {
+                flush_host_output(host_io);
+                return read.error().win32_error == ERROR_PIPE_NOT_CONNECTED && driver.all_completed();
+            }
+
+            oc::condrv::BasicApiMessage<SimulatedDriver> message(driver, packet);
+            auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+            if (!outcome || outcome->reply_pending || !message.release_message_buffers())
+            {
+                return false;
+            }
+
+            staged.emplace(std::move(message));
+        }
+    }
+
+    template<typename HostIo>
+    [[nodiscard]] bool run_pipelined_session(
+        oc::condrv::ServerState& state,
+        HostIo& host_io,
+        const Scripts& scripts,
+        const std::chrono::nanoseconds latency)
+    {
+        SimulatedDriver driver(scripts, latency);
+        oc::condrv::BasicWaitQueueFor<SimulatedDriver> waiters;
+        const std::atomic_bool stop_requested{ false };
+
+        oc::condrv::BasicIoPipeline<SimulatedDriver> pipeline(driver);
+        if (!pipeline.start())
+        {
+            return false;
+        }
+
+        auto exit = oc::condrv::run_pipelined_dispatch(
+            pipeline,
+            state,
+            host_io,
+            waiters,
+            stop_requested,
+            []() noexcept {},
+            [&]() noexcept { flush_host_output(host_io); });
+
+        pipeline.request_stop();
+        pipeline.join();
+        return exit.has_value() &&
+               pipeline.io_exit() == oc::condrv::PipelineIoExit::pipe_disconnected &&
+               driver.all_completed();
+    }
+
+    [[nodiscard]] bool run_case(
+        const size_t client_count,
+        const std::chrono::microseconds latency,
+        const oc::benchmarks::BenchmarkOptions& options)
+    {
+        constexpr size_t requests_per_client = 128;
+        const double requests = static_cast<double>(client_count * requests_per_client);
+
+        oc::condrv::ServerState state{};
+        oc::condrv::NullHostIo host_io{};
+        auto scripts = make_scripts(state, host_io, client_count, requests_per_client);
+        if (!scripts)
+        {
+            return false;
+        }
+
+        const std::wstring suffix = L".clients_" + std::to_wstring(client_count) + L".latency_" + std::to_wstring(latency.count()) + L"us";
+        const std::wstring serial_name = L"condrv.pipeline.serial" + suffix;
+        const std::wstring pipelined_name = L"condrv.pipeline.pipelined" + suffix;
+
+        const auto serial = oc::benchmarks::measure(options, [&]() {
+            return run_serial_session(state, host_io, *scripts, latency);
+        });
+        if (!serial)
+        {
+            oc::benchmarks::report_failure(serial_name);
+            return false;
+        }
+
+        const auto pipelined = oc::benchmarks::measure(options, [&]() {
+            return run_pipelined_session(state, host_io, *scripts, latency);
+        });
+        if (!pipelined)
+        {
+            oc::benchmarks::report_failure(pipelined_name);
+            return false;
+        }
+
+        const auto requests_per_s = [&](const oc::benchmarks::BenchmarkStats& stats) {
+            return stats.median_ns_per_op > 0.0 ? requests / (stats.median_ns_per_op / 1'000'000'000.0) : 0.0;
+        };
+
+        const std::array serial_metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"requests_per_session", .value = requests },
+            oc::benchmarks::BenchmarkMetric{ .name = L"requests_per_s", .value = requests_per_s(*serial) },
+        };
+        oc::benchmarks::report_result(serial_name, *serial, serial_metrics);
+
+        const std::array pipelined_metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"requests_per_session", .value = requests },
+            oc::benchmarks::BenchmarkMetric{ .name = L"requests_per_s", .value = requests_per_s(*pipelined) },
+            oc::benchmarks::BenchmarkMetric{
+                .name = L"speedup",
+                .value = pipelined->median_ns_per_op > 0.0 ? serial->median_ns_per_op / pipelined->median_ns_per_op : 0.0,
+            },
+        };
+        oc::benchmarks::report_result(pipelined_name, *pipelined, pipelined_metrics);
+        return true;
+    }
+
+    [[nodiscard]] bool run_host_output_case(
+        const size_t client_count,
+        const bool pipelined,
+        const bool combine,
+        const std::chrono::microseconds driver_latency,
+        const std::chrono::microseconds pipe_latency,
+        const oc::benchmarks::BenchmarkOptions& options)
+    {
+        constexpr size_t requests_per_client = 128;
+
+        oc::condrv::ServerState state{};
+        oc::condrv::NullHostIo connect_io{};
+        auto scripts = make_scripts(state, connect_io, client_count, requests_per_client);
+        if (!scripts)
+        {
+            return false;
+        }
+
+        const std::wstring name = std::wstring(L"condrv.host_output.") + (pipelined ? L"pipelined" : L"serial") +
+                                  (combine ? L".combined" : L".direct") + L".clients_" + std::to_wstring(client_count) +
+                                  L".pipe_" + std::to_wstring(pipe_latency.count()) + L"us";
+
+        FakePipeHostIo host_io(pipe_latency, combine);
+        const auto stats = oc::benchmarks::measure(options, [&]() {
+            return pipelined ? run_pipelined_session(state, host_io, *scripts, driver_latency)
+                             : run_serial_session(state, host_io, *scripts, driver_latency);
+        });
+        if (!stats)
+        {
+            oc::benchmarks::report_failure(name);
+            return false;
+        }
+
+        // The pipe counts every session, warmup included; the ratio is what matters.
+        const auto& pipe = host_io.output.sink();
+        const double total_megabytes = static_cast<double>(pipe.bytes) / (1024.0 * 1024.0);
+        const double sessions = static_cast<double>(options.warmup_iterations + stats->iterations * stats->trials);
+        const double session_megabytes = total_megabytes / sessions;
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"requests_per_session", .value = static_cast<double>(client_count * requests_per_client) },
+            oc::benchmarks::BenchmarkMetric{
+                .name = L"pipe_writes_per_mb",
+                .value = total_megabytes > 0.0 ? static_cast<double>(pipe.writes) / total_megabytes : 0.0,
+            },
+            oc::benchmarks::BenchmarkMetric{
+                .name = L"mb_per_s",
+                .value = stats->median_ns_per_op > 0.0 ? session_megabytes / (stats->median_ns_per_op / 1'000'000'000.0) : 0.0,
+            },
+        };
+        oc::benchmarks::report_result(name, *stats, metrics);
+        return true;
+    }
+}
+
+bool run_condrv_pipeline_benchmarks()
+{
+    // Each iteration is a whole multi-client session, so keep the counts small.
+    const oc::benchmarks::BenchmarkOptions options{
+        .warmup_iterations = 2,
+        .iterations = 5,
+        .trials = 5,
+    };
+
+    constexpr std::array<size_t, 2> client_counts{ 1, 8 };
+    constexpr std::array<long long, 4> latencies_us{ 0, 5, 20, 50 };
+
+    bool ok = true;
+    for (const size_t clients : client_counts)
+    {
+        for (const long long latency : latencies_us)
+        {
+            ok = run_case(clients, std::chrono::microseconds(latency), options) && ok;
+        }
+    }
+
+    // Host output write combining against a pipe that costs 5us per write.
+    constexpr auto driver_latency = std::chrono::microseconds(5);
+    constexpr auto pipe_latency = std::chrono::microseconds(5);
+    for (const size_t clients : client_counts)
+    {
+        for (const bool pipelined : { false, true })
+        {
+            for (const bool combine : { false, true })
+            {
+                ok = run_host_output_case(clients, pipelined, combine, driver_latency, pipe_latency, options) && ok;
+            }
+        }
+    }
+
+    return ok;
+}
@@ -0,0 +1,891 @@
+#include "benchmark_harness.hpp"
+
+#include "condrv/condrv_server.hpp"
+#include "core/utf8_stream_decoder.hpp"
+
+#include <psapi.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Screen buffer creation cost for large scrollback buffers.
+//
+// `create` times `ScreenBuffer::create` + destruction of a 120x9001 buffer, the shape clients
+// request through `SetConsoleScreenBufferSize` and what `ConsolepCreateScreenBuffer` clones.
+// `resident` holds a batch of buffers alive and reports the private-bytes growth per buffer,
+// both as created and after every row has been written once (the worst case lazy rows converge
+// to), and after streaming a colored build log through `apply_text_to_screen_buffer` until the
+// scrollback is full. `materialized_rows` and `compact_rows` report how rows are stored in each
+// state.
+// `alternate_screen_toggle` times one DECSET/DECRST 1049 pair on that buffer with a 120x30
+// viewport, writing one row per visit the way a full-screen TUI launch and exit would.
+// `resize_reflow` times one 120 -> 100 -> 120 column round trip of that buffer with every row
+// holding 40-120 characters and every fourth row soft-wrapped, the work a window drag repeats.
+// `margin_scroll` times a one-line scroll-up of a partial region of a 120x30 buffer (the DECSTBM
+// line feed at the bottom margin, or an editor pane scrolled with `ScrollConsoleScreenBuffer`).
+// `truecolor_stream` applies one ~16 KiB chunk of `bat`-style highlighted source per op: a gray
+// line-number gutter, then tokens that each start with a 24-bit color SGR, italic comments. It
+// covers the VT parser, SGR handling and attribute interning; `interned_attributes` is the table
+// size at the end.
+// `plain_stream` applies one ~16 KiB chunk of uncolored build and service log lines per op, some
+// longer than a row, with VT processing; `plain_stream_classic` applies it without. Nearly every
+// character takes the plain-run path; `chars_per_second` is the throughput at the median.
+// `conpty_stream` feeds the same log, as UTF-8 with a CJK line in every eight, through the
+// pseudoconsole output path in 8 KiB reads: `conpty_stream_decoded` widens each read with
+// `Utf8StreamDecoder` first, as the worker used to, and `conpty_stream_utf8` passes the bytes to
+// `apply_utf8_to_screen_buffer`. `mb_per_s` is in UTF-8 bytes.
+// `cjk_stream` applies one ~16 KiB chunk of mostly Chinese, Japanese and Korean log text with ASCII,
+// fullwidth punctuation and emoji per op, the double-width path through the same parser;
+// `wide_glyphs` counts the double-width glyphs in the chunk. `code_point_width` looks up the width
+// of every code point of that chunk per op; `ns_per_code_unit` is the median cost per UTF-16 unit.
+// `emoji_stream` applies one ~16 KiB chunk of chat and CI log text per op whose glyphs are mostly
+// multi-unit: emoji with skin tones and variation selectors, ZWJ families, flags and accented
+// names written with combining marks. `cluster_churn` does the same with text whose clusters differ
+// from op to op (a letter and one of 112 combining marks, 2912 in all), so the cluster table fills
+// and collects. Both report the cluster table size, its heap bytes and the collections at the end.
+// `bulk_*` repaint or read a whole 120x30 screen per op through the CHAR_INFO rectangle and span
+// APIs, the way `WriteConsoleOutput`-driven TUIs redraw every frame; `cells_per_second` is the
+// throughput at the median.
+
+namespace
+{
+    constexpr COORD large_buffer_size{ 120, 9001 };
+    constexpr size_t resident_batch = 16;
+
+    [[nodiscard]] std::shared_ptr<oc::condrv::ScreenBuffer> make_buffer()
+    {
+        auto settings = oc::condrv::ScreenBuffer::default_settings();
+        settings.buffer_size = large_buffer_size;
+        settings.window_size = COORD{ 120, 30 };
+        settings.maximum_window_size = large_buffer_size;
+
+        auto created = oc::condrv::ScreenBuffer::create(settings);
+        if (!created)
+        {
+            return {};
+        }
+
+        return std::move(created.value());
+    }
+
+    [[nodiscard]] bool private_bytes(size_t& out) noexcept
+    {
+        PROCESS_MEMORY_COUNTERS_EX counters{};
+        counters.cb = sizeof(counters);
+        if (::GetProcessMemoryInfo(::GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters)) == FALSE)
+        {
+            return false;
+        }
+
+        out = counters.PrivateUsage;
+        return true;
+    }
+
+    [[nodiscard]] bool touch_every_row(oc::condrv::ScreenBuffer& buffer) noexcept
+    {
+        for (SHORT y = 0; y < large_buffer_size.Y; ++y)
+        {
+            if (!buffer.write_cell(COORD{ 0, y }, L'x', 0x07))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // One more line than the buffer holds, so the oldest line has scrolled off and every row has
+    // left the viewport at least once. Each line has a colored tag and a path of varying length.
+    [[nodiscard]] bool write_build_log(oc::condrv::ScreenBuffer& buffer) noexcept
+    {
+        constexpr std::wstring_view tags[] = { L"[build] ", L"[ warn] ", L"[ link] " };
+        constexpr USHORT tag_attributes[] = { 0x0A, 0x0E, 0x0B };
+        constexpr std::wstring_view path = L"src/condrv/condrv_server.cpp src/condrv/compact_row.cpp src/condrv/screen_cell_span.cpp";
+
+        oc::condrv::NullHostIo host_io{};
+        constexpr ULONG mode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT;
+        for (size_t line = 0; line <= static_cast<size_t>(large_buffer_size.Y); ++line)
+        {
+            buffer.set_text_attributes(tag_attributes[line % 3]);
+            oc::condrv::apply_text_to_screen_buffer(buffer, tags[line % 3], mode, nullptr, &host_io);
+            buffer.set_text_attributes(0x07);
+            oc::condrv::apply_text_to_screen_buffer(buffer, path.substr(0, 20 + line * 13 % 60), mode, nullptr, &host_io);
+            oc::condrv::apply_text_to_screen_buffer(buffer, L"\r\n", mode, nullptr, &host_io);
+        }
+
+        return buffer.compact_row_count() != 0;
+    }
+
+    enum class ResidentContents : uint8_t
+    {
+        untouched,
+        every_row_written,
+        build_log,
+    };
+
+    [[nodiscard]] bool run_create_case(const oc::benchmarks::BenchmarkOptions& options)
+    {
+        const auto stats = oc::benchmarks::measure(options, []() noexcept {
+            return make_buffer() != nullptr;
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const auto cells = static_cast<double>(large_buffer_size.X) * static_cast<double>(large_buffer_size.Y);
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"cells", .value = cells },
+        };
+        oc::benchmarks::report_result(L"condrv.screen_buffer.create_120x9001", *stats, metrics);
+        return true;
+    }
+
+    [[nodiscard]] bool run_alternate_screen_case(const oc::benchmarks::BenchmarkOptions& options)
+    {
+        auto buffer = make_buffer();
+        if (!buffer || !touch_every_row(*buffer))
+        {
+            return false;
+        }
+
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            return buffer->set_vt_using_alternate_screen_buffer(true, L' ', 0x07) &&
+                   buffer->write_cell(COORD{ 0, 0 }, L'x', 0x07) &&
+                   buffer->set_vt_using_alternate_screen_buffer(false, L' ', 0x07);
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"main_rows", .value = static_cast<double>(large_buffer_size.Y) },
+        };
+        oc::benchmarks::report_result(L"condrv.screen_buffer.alternate_screen_toggle_120x9001", *stats, metrics);
+        return true;
+    }
+
+    [[nodiscard]] bool run_resize_reflow_case(const oc::benchmarks::BenchmarkOptions& options)
+    {
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        const std::wstring text(static_cast<size_t>(large_buffer_size.X), L'x');
+        for (SHORT y = 0; y < large_buffer_size.Y; ++y)
+        {
+            const size_t length = 40 + static_cast<size_t>(y) * 37 % 81;
+            if (buffer->write_output_characters(COORD{ 0, y }, std::wstring_view(text).substr(0, length)) != length)
+            {
+                return false;
+            }
+            buffer->set_row_wrapped(y, y % 4 == 0);
+        }
+        buffer->set_cursor_position(COORD{ 0, static_cast<SHORT>(large_buffer_size.Y - 1) });
+
+        const COORD narrow{ 100, large_buffer_size.Y };
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            return buffer->set_screen_buffer_size(narrow) && buffer->set_screen_buffer_size(large_buffer_size);
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"rows", .value = static_cast<double>(large_buffer_size.Y) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"ns_per_resize", .value = stats->median_ns_per_op / 2.0 },
+            oc::benchmarks::BenchmarkMetric{ .name = L"materialized_rows", .value = static_cast<double>(buffer->materialized_row_count()) },
+        };
+        oc::benchmarks::report_result(L"condrv.screen_buffer.resize_reflow_120x9001", *stats, metrics);
+        return true;
+    }
+
+    // Colors from a typical dark syntax theme; `bat` and `lsd` emit one SGR per token like this.
+    [[nodiscard]] std::wstring make_truecolor_chunk(const size_t target_chars)
+    {
+        constexpr std::wstring_view tokens[] = {
+            L"\x1b[38;2;249;38;114mconst",
+            L"\x1b[38;2;102;217;239mauto",
+            L"\x1b[38;2;248;248;242mbuffer",
+            L"\x1b[38;2;249;38;114m=",
+            L"\x1b[38;2;166;226;46mmake_buffer",
+            L"\x1b[38;2;248;248;242m(",
+            L"\x1b[38;2;174;129;255m120",
+            L"\x1b[38;2;248;248;242m,",
+            L"\x1b[38;2;230;219;116m\"text\"",
+            L"\x1b[38;2;248;248;242m);",
+        };
+
+        std::wstring chunk;
+        chunk.reserve(target_chars + 256);
+        for (size_t line = 1; chunk.size() < target_chars; ++line)
+        {
+            chunk.append(L"\x1b[38;2;117;113;94m");
+            chunk.append(std::to_wstring(line + 1000));
+            chunk.append(L" \x1b[0m\u2502 ");
+            if (line % 5 == 0)
+            {
+                chunk.append(L"\x1b[3;38;2;117;113;94m// keep the viewport in sync with the cursor\x1b[0m\r\n");
+                continue;
+            }
+
+            for (size_t token = 0; token < 8; ++token)
+            {
+                chunk.append(tokens[(line + token) % std::size(tokens)]);
+                chunk.push_back(L' ');
+            }
+            chunk.append(L"\x1b[0m\r\n");
+        }
+
+        return chunk;
+    }
+
+    [[nodiscard]] bool run_truecolor_stream_case(const oc::benchmarks::BenchmarkOptions& options)
+    {
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        const std::wstring chunk = make_truecolor_chunk(16 * 1024);
+        oc::condrv::NullHostIo host_io{};
+        constexpr ULONG mode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            oc::condrv::apply_text_to_screen_buffer(*buffer, chunk, mode, nullptr, &host_io);
+            return true;
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const double bytes = static_cast<double>(chunk.size() * sizeof(wchar_t));
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"payload_bytes", .value = bytes },
+            oc::benchmarks::BenchmarkMetric{ .name = L"mb_per_s", .value = (bytes / (1024.0 * 1024.0)) / (stats->median_ns_per_op / 1'000'000'000.0) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"interned_attributes", .value = static_cast<double>(buffer->interned_attribute_count()) },
+        };
+        oc::benchmarks::report_result(L"condrv.screen_buffer.truecolor_stream_16k", *stats, metrics);
+        return true;
+    }
+
+    [[nodiscard]] std::wstring make_plain_chunk(const size_t target_chars)
+    {
+        constexpr std::wstring_view lines[] = {
+            L"Building CXX object src/condrv/CMakeFiles/oc_condrv.dir/condrv_server.cpp.obj",
+            L"  condrv_server.cpp",
+            L"Linking CXX static library src/condrv/oc_condrv.lib",
+            L"warning C4996: 'getenv': This function or variable may be unsafe. Consider using _dupenv_s instead. To disable "
+            L"deprecation, use _CRT_SECURE_NO_WARNINGS. See online help for details.",
+            L"[==========] 214 tests from 31 test suites ran. (1873 ms total)",
+            L"2024-05-17T09:41:07.318Z INFO  request completed method=GET path=/api/v1/items status=200 elapsed=3.2ms",
+        };
+
+        std::wstring chunk;
+        chunk.reserve(target_chars + 256);
+        for (size_t line = 0; chunk.size() < target_chars; ++line)
+        {
+            chunk.append(L"[");
+            chunk.append(std::to_wstring(line % 311 + 1));
+            chunk.append(L"/311] ");
+            chunk.append(lines[line % std::size(lines)]);
+            chunk.append(L"\r\n");
+        }
+
+        return chunk;
+    }
+
+    [[nodiscard]] bool run_plain_stream_case(const oc::benchmarks::BenchmarkOptions& options, const std::wstring_view name, const ULONG mode)
+    {
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        const std::wstring chunk = make_plain_chunk(16 * 1024);
+        oc::condrv::NullHostIo host_io{};
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            oc::condrv::apply_text_to_screen_buffer(*buffer, chunk, mode, nullptr, &host_io);
+            return true;
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const double bytes = static_cast<double>(chunk.size() * sizeof(wchar_t));
+        const double seconds = stats->median_ns_per_op / 1'000'000'000.0;
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"payload_bytes", .value = bytes },
+            oc::benchmarks::BenchmarkMetric{ .name = L"mb_per_s", .value = (bytes / (1024.0 * 1024.0)) / seconds },
+            oc::benchmarks::BenchmarkMetric{ .name = L"chars_per_second", .value = static_cast<double>(chunk.size()) / seconds },
+        };
+        oc::benchmarks::report_result(name, *stats, metrics);
+        return true;
+    }
+
+    [[nodiscard]] std::string make_conpty_chunk(const size_t target_bytes)
+    {
+        const std::wstring plain = make_plain_chunk(target_bytes);
+        std::wstring text;
+        text.reserve(plain.size() + target_bytes / 8);
+        size_t line = 0;
+        for (size_t start = 0; start < plain.size();)
+        {
+            const size_t end = plain.find(L'\n', start) + 1;
+            text.append(plain, start, end - start);
+            if (++line % 8 == 0)
+            {
+                text.append(L"[構建] 正在編譯 src/condrv/condrv_server.cpp（第 3 個，共 42 個）\r\n");
+            }
+            start = end;
+        }
+
+        const int length = ::WideCharToMultiByte(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), nullptr, 0, nullptr, nullptr);
+        std::string chunk(static_cast<size_t>(length), '\0');
+        (void)::WideCharToMultiByte(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), chunk.data(), length, nullptr, nullptr);
+        return chunk;
+    }
+
+    [[nodiscard]] bool run_conpty_stream_case(const oc::benchmarks::BenchmarkOptions& options, const std::wstring_view name, const bool decode_first)
+    {
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        const std::string chunk = make_conpty_chunk(64 * 1024);
+        constexpr size_t read_size = 8192;
+        constexpr ULONG mode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+        oc::core::Utf8StreamDecoder decoder;
+        const auto stats = oc::benchmarks::measure(options, [&]() {
+            for (size_t offset = 0; offset < chunk.size(); offset += read_size)
+            {
+                const std::string_view read = std::string_view(chunk).substr(offset, read_size);
+                if (decode_first)
+                {
+                    const std::wstring decoded = decoder.decode_append(std::as_bytes(std::span(read.data(), read.size())));
+                    oc::condrv::apply_text_to_screen_buffer<oc::condrv::NullHostIo>(*buffer, decoded, mode, nullptr, nullptr);
+                }
+                else
+                {
+                    oc::condrv::apply_utf8_to_screen_buffer<oc::condrv::NullHostIo>(*buffer, read, mode, nullptr, nullptr);
+                }
+            }
+            return true;
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const double bytes = static_cast<double>(chunk.size());
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"payload_bytes", .value = bytes },
+            oc::benchmarks::BenchmarkMetric{ .name = L"mb_per_s", .value = (bytes / (1024.0 * 1024.0)) / (stats->median_ns_per_op / 1'000'000'000.0) },
+        };
+        oc::benchmarks::report_result(name, *stats, metrics);
+        return true;
+    }
+
+    [[nodiscard]] std::wstring make_cjk_chunk(const size_t target_chars)
+    {
+        constexpr std::wstring_view lines[] = {
+            L"[構建] 正在編譯 src/condrv/condrv_server.cpp（第 3 個，共 42 個）",
+            L"警告：變數「buffer_size」已宣告但從未使用 ⚠️",
+            L"ビルドが完了しました。エラー 0 件、警告 2 件 ✅",
+            L"테스트 결과: 성공 128, 실패 0, 건너뜀 3",
+            L"下载进度：███████░░░ 70% 剩余时间约 12 秒",
+            L"ファイル「設定.json」を読み込んでいます… 🚀",
+            L"提交 3f2a9c1：修复滚动区域在宽字符下的换行问题",
+        };
+
+        std::wstring chunk;
+        chunk.reserve(target_chars + 256);
+        for (size_t line = 0; chunk.size() < target_chars; ++line)
+        {
+            chunk.append(lines[line % std::size(lines)]);
+            chunk.append(L"\r\n");
+        }
+
+        return chunk;
+    }
+
+    [[nodiscard]] size_t count_wide_glyphs(const std::wstring_view text) noexcept
+    {
+        size_t wide = 0;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            char32_t code_point = text[i];
+            if (code_point >= 0xD800 && code_point <= 0xDBFF && i + 1 < text.size())
+            {
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (static_cast<char32_t>(text[i + 1]) - 0xDC00);
+                ++i;
+            }
+            wide += oc::condrv::code_point_width(code_point) == 2 ? 1 : 0;
+        }
+        return wide;
+    }
+
+    [[nodiscard]] bool run_cjk_stream_case(const oc::benchmarks::BenchmarkOptions& options)
+    {
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        const std::wstring chunk = make_cjk_chunk(16 * 1024);
+        oc::condrv::NullHostIo host_io{};
+        constexpr ULONG mode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            oc::condrv::apply_text_to_screen_buffer(*buffer, chunk, mode, nullptr, &host_io);
+            return true;
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const double bytes = static_cast<double>(chunk.size() * sizeof(wchar_t));
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"payload_bytes", .value = bytes },
+            oc::benchmarks::BenchmarkMetric{ .name = L"mb_per_s", .value = (bytes / (1024.0 * 1024.0)) / (stats->median_ns_per_op / 1'000'000'000.0) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"wide_glyphs", .value = static_cast<double>(count_wide_glyphs(chunk)) },
+        };
+        oc::benchmarks::report_result(L"condrv.screen_buffer.cjk_stream_16k", *stats, metrics);
+        return true;
+    }
+
+    [[nodiscard]] std::wstring make_emoji_chunk(const size_t target_chars)
+    {
+        constexpr std::wstring_view lines[] = {
+            L"[ci] build \xD83D\xDFE2 passed in 4m12s \xD83C\xDF89\xD83C\xDF89 deploy \x2705\xFE0F staging \xD83D\xDE80",
+            L"Zo\x00EB: nice work \xD83D\xDC4D\xD83C\xDFFD\xD83D\xDC4D\xD83C\xDFFB see you in \xD83C\xDDE9\xD83C\xDDEA \xD83C\xDDEF\xD83C\xDDF5",
+            L"Rene\x0301" L"e: team \xD83D\xDC68\x200D\xD83D\xDC69\x200D\xD83D\xDC67\x200D\xD83D\xDC66 shipped \xD83D\xDCE6 \x2764\xFE0F\x200D\xD83D\xDD25",
+            L"[warn] flaky test \xD83E\xDD14 retrying \xD83D\xDD01 (2/3) \xD83E\xDDD1\xD83C\xDFFE\x200D\xD83D\xDCBB on call",
+            L"Bj\x006F\x0308rk: \xD83D\xDE02\xD83D\xDE02\xD83D\xDE02 \xD83C\xDFF3\xFE0F\x200D\xD83C\xDF08 \xD83C\xDDE7\xD83C\xDDF7 ok",
+        };
+
+        std::wstring chunk;
+        chunk.reserve(target_chars + 256);
+        for (size_t line = 0; chunk.size() < target_chars; ++line)
+        {
+            chunk.append(lines[line % std::size(lines)]);
+            chunk.append(L"\r\n");
+        }
+
+        return chunk;
+    }
+
+    // Lines of `name: text` where every name ends in a letter and combining mark that step through
+    // all 2912 pairs, continuing from `next` across calls.
+    [[nodiscard]] std::wstring make_cluster_churn_chunk(const size_t target_chars, size_t& next)
+    {
+        std::wstring chunk;
+        chunk.reserve(target_chars + 256);
+        while (chunk.size() < target_chars)
+        {
+            for (size_t name = 0; name < 8; ++name, next = (next + 1) % (26 * 0x70))
+            {
+                chunk.append(L"user_");
+                chunk.push_back(static_cast<wchar_t>(L'a' + next / 0x70));
+                chunk.push_back(static_cast<wchar_t>(0x0300 + next % 0x70));
+                chunk.push_back(L' ');
+            }
+            chunk.append(L"joined \xD83D\xDC4B\r\n");
+        }
+
+        return chunk;
+    }
+
+    [[nodiscard]] bool run_emoji_stream_case(const oc::benchmarks::BenchmarkOptions& options, const std::wstring_view name, const bool churn)
+    {
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        // The churn chunks are built up front so the timed loop only applies them.
+        std::vector<std::wstring> chunks;
+        size_t next = 0;
+        for (size_t i = 0; i < (churn ? 8 : 1); ++i)
+        {
+            chunks.push_back(churn ? make_cluster_churn_chunk(16 * 1024, next) : make_emoji_chunk(16 * 1024));
+        }
+
+        oc::condrv::NullHostIo host_io{};
+        constexpr ULONG mode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+        size_t op = 0;
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            oc::condrv::apply_text_to_screen_buffer(*buffer, chunks[op++ % chunks.size()], mode, nullptr, &host_io);
+            return true;
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const double bytes = static_cast<double>(chunks.front().size() * sizeof(wchar_t));
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"payload_bytes", .value = bytes },
+            oc::benchmarks::BenchmarkMetric{ .name = L"mb_per_s", .value = (bytes / (1024.0 * 1024.0)) / (stats->median_ns_per_op / 1'000'000'000.0) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"interned_clusters", .value = static_cast<double>(buffer->interned_cluster_count()) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"cluster_storage_bytes", .value = static_cast<double>(buffer->cluster_storage_bytes()) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"cluster_collections", .value = static_cast<double>(buffer->cluster_collections()) },
+        };
+        oc::benchmarks::report_result(name, *stats, metrics);
+        return true;
+    }
+
+    [[nodiscard]] bool run_code_point_width_case(const oc::benchmarks::BenchmarkOptions& options)
+    {
+        const std::wstring chunk = make_cjk_chunk(16 * 1024);
+        size_t sink = 0;
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            sink += count_wide_glyphs(chunk);
+            return true;
+        });
+        if (!stats || sink == 0)
+        {
+            return false;
+        }
+
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"code_units", .value = static_cast<double>(chunk.size()) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"ns_per_code_unit", .value = stats->median_ns_per_op / static_cast<double>(chunk.size()) },
+        };
+        oc::benchmarks::report_result(L"condrv.unicode_width.code_point_width_16k", *stats, metrics);
+        return true;
+    }
+
+    struct MarginScrollCase final
+    {
+        const wchar_t* name;
+        SMALL_RECT region;
+    };
+
+    [[nodiscard]] bool run_margin_scroll_case(const oc::benchmarks::BenchmarkOptions& options, const MarginScrollCase& test_case)
+    {
+        auto settings = oc::condrv::ScreenBuffer::default_settings();
+        settings.buffer_size = COORD{ 120, 30 };
+        settings.window_size = COORD{ 120, 30 };
+        settings.maximum_window_size = COORD{ 120, 30 };
+        auto created = oc::condrv::ScreenBuffer::create(settings);
+        if (!created)
+        {
+            return false;
+        }
+
+        // Leave the last column untouched so every row owns real cells rather than staying blank.
+        auto& buffer = *created.value();
+        for (SHORT y = 0; y < settings.buffer_size.Y; ++y)
+        {
+            if (buffer.fill_output_characters(COORD{ 0, y }, static_cast<wchar_t>(L'a' + y % 26), 119) != 119)
+            {
+                return false;
+            }
+        }
+
+        const SMALL_RECT region = test_case.region;
+        const SMALL_RECT source{ region.Left, static_cast<SHORT>(region.Top + 1), region.Right, region.Bottom };
+        const COORD destination{ region.Left, region.Top };
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            return buffer.scroll_screen_buffer(source, region, destination, L' ', 0x07);
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const double cells = static_cast<double>(region.Right - region.Left + 1) * static_cast<double>(region.Bottom - region.Top + 1);
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"cells", .value = cells },
+            oc::benchmarks::BenchmarkMetric{ .name = L"ns_per_cell", .value = stats->median_ns_per_op / cells },
+        };
+        oc::benchmarks::report_result(test_case.name, *stats, metrics);
+        return true;
+    }
+
+    enum class BulkOperation
+    {
+        write_char_info_unicode,
+        write_char_info_ascii,
+        read_char_info_unicode,
+        write_characters,
+        read_characters,
+        fill_attributes,
+    };
+
+    struct BulkCase final
+    {
+        const wchar_t* name;
+        BulkOperation operation;
+    };
+
+    [[nodiscard]] bool run_bulk_case(const oc::benchmarks::BenchmarkOptions& options, const BulkCase& test_case)
+    {
+        constexpr COORD size{ 120, 30 };
+        constexpr size_t cells = static_cast<size_t>(size.X) * static_cast<size_t>(size.Y);
+        constexpr SMALL_RECT screen{ 0, 0, size.X - 1, size.Y - 1 };
+
+        auto settings = oc::condrv::ScreenBuffer::default_settings();
+        settings.buffer_size = size;
+        settings.window_size = size;
+        settings.maximum_window_size = size;
+        auto created = oc::condrv::ScreenBuffer::create(settings);
+        if (!created)
+        {
+            return false;
+        }
+
+        auto& buffer = *created.value();
+        std::vector<CHAR_INFO> records(cells);
+        std::vector<wchar_t> text(cells);
+        for (size_t i = 0; i < cells; ++i)
+        {
+            records[i].Char.UnicodeChar = static_cast<wchar_t>(L'!' + i % 90);
+            records[i].Attributes = static_cast<WORD>(i % 0x100);
+            text[i] = static_cast<wchar_t>(L'a' + i % 26);
+        }
+
+        // Start from materialized rows so every case measures the cell path.
+        if (buffer.write_output_char_info_rect(screen, records, true) != cells)
+        {
+            return false;
+        }
+
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            switch (test_case.operation)
+            {
+            case BulkOperation::write_char_info_unicode:
+                return buffer.write_output_char_info_rect(screen, records, true) == cells;
+            case BulkOperation::write_char_info_ascii:
+                return buffer.write_output_char_info_rect(screen, records, false) == cells;
+            case BulkOperation::read_char_info_unicode:
+                return buffer.read_output_char_info_rect(screen, records, true) == cells;
+            case BulkOperation::write_characters:
+                return buffer.write_output_characters(COORD{ 0, 0 }, text) == cells;
+            case BulkOperation::read_characters:
+                return buffer.read_output_characters(COORD{ 0, 0 }, text) == cells;
+            case BulkOperation::fill_attributes:
+                return buffer.fill_output_attributes(COORD{ 1, 0 }, 0x1E, cells - 1) == cells - 1;
+            }
+            return false;
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"cells", .value = static_cast<double>(cells) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"cells_per_second", .value = static_cast<double>(cells) * 1'000'000'000.0 / stats->median_ns_per_op },
+        };
+        oc::benchmarks::report_result(test_case.name, *stats, metrics);
+        return true;
+    }
+
+    [[nodiscard]] bool run_resident_case(const std::wstring_view name, const ResidentContents contents)
+    {
+        std::vector<std::shared_ptr<oc::condrv::ScreenBuffer>> buffers;
+        buffers.reserve(resident_batch);
+
+        size_t before = 0;
+        if (!private_bytes(before))
+        {
+            return false;
+        }
+
+        const uint64_t start = oc::benchmarks::now_ticks();
+        for (size_t i = 0; i < resident_batch; ++i)
+        {
+            auto buffer = make_buffer();
+            if (!buffer || (contents == ResidentContents::every_row_written && !touch_every_row(*buffer)) ||
+                (contents == ResidentContents::build_log && !write_build_log(*buffer)))
+            {
+                return false;
+            }
+            buffers.push_back(std::move(buffer));
+        }
+        const uint64_t stop = oc::benchmarks::now_ticks();
+
+        size_t after = 0;
+        if (!private_bytes(after))
+        {
+            return false;
+        }
+
+        const double ns_per_buffer = oc::benchmarks::ticks_to_ns(stop - start) / static_cast<double>(resident_batch);
+        const oc::benchmarks::BenchmarkStats stats{
+            .iterations = resident_batch,
+            .trials = 1,
+            .min_ns_per_op = ns_per_buffer,
+            .median_ns_per_op = ns_per_buffer,
+            .max_ns_per_op = ns_per_buffer,
+        };
+
+        const double growth = after > before ? static_cast<double>(after - before) : 0.0;
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"private_bytes_per_buffer", .value = growth / static_cast<double>(resident_batch) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"materialized_rows", .value = static_cast<double>(buffers.front()->materialized_row_count()) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"compact_rows", .value = static_cast<double>(buffers.front()->compact_row_count()) },
+        };
+        oc::benchmarks::report_result(name, stats, metrics);
+        return true;
+    }
+}
+
+bool run_condrv_screen_buffer_benchmarks()
+{
+    const oc::benchmarks::BenchmarkOptions options{
+        .warmup_iterations = 10,
+        .iterations = 200,
+    };
+
+    bool ok = true;
+    if (!run_create_case(options))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.create_120x9001");
+        ok = false;
+    }
+
+    if (!run_alternate_screen_case(options))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.alternate_screen_toggle_120x9001");
+        ok = false;
+    }
+
+    if (!run_resize_reflow_case(options))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.resize_reflow_120x9001");
+        ok = false;
+    }
+
+    if (!run_truecolor_stream_case(oc::benchmarks::BenchmarkOptions{ .warmup_iterations = 50, .iterations = 500 }))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.truecolor_stream_16k");
+        ok = false;
+    }
+
+    constexpr ULONG vt_output_mode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+    if (!run_plain_stream_case(oc::benchmarks::BenchmarkOptions{ .warmup_iterations = 50, .iterations = 500 }, L"condrv.screen_buffer.plain_stream_16k", vt_output_mode))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.plain_stream_16k");
+        ok = false;
+    }
+
+    constexpr ULONG classic_output_mode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT;
+    if (!run_plain_stream_case(oc::benchmarks::BenchmarkOptions{ .warmup_iterations = 50, .iterations = 500 }, L"condrv.screen_buffer.plain_stream_classic_16k", classic_output_mode))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.plain_stream_classic_16k");
+        ok = false;
+    }
+
+    static constexpr struct
+    {
+        std::wstring_view name;
+        bool decode_first;
+    } conpty_cases[] = {
+        { L"condrv.screen_buffer.conpty_stream_decoded_64k", true },
+        { L"condrv.screen_buffer.conpty_stream_utf8_64k", false },
+    };
+    for (const auto& test_case : conpty_cases)
+    {
+        if (!run_conpty_stream_case(oc::benchmarks::BenchmarkOptions{ .warmup_iterations = 20, .iterations = 200 }, test_case.name, test_case.decode_first))
+        {
+            oc::benchmarks::report_failure(test_case.name);
+            ok = false;
+        }
+    }
+
+    if (!run_cjk_stream_case(oc::benchmarks::BenchmarkOptions{ .warmup_iterations = 50, .iterations = 500 }))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.cjk_stream_16k");
+        ok = false;
+    }
+
+    if (!run_emoji_stream_case(oc::benchmarks::BenchmarkOptions{ .warmup_iterations = 50, .iterations = 500 }, L"condrv.screen_buffer.emoji_stream_16k", false))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.emoji_stream_16k");
+        ok = false;
+    }
+
+    if (!run_emoji_stream_case(oc::benchmarks::BenchmarkOptions{ .warmup_iterations = 50, .iterations = 500 }, L"condrv.screen_buffer.cluster_churn_16k", true))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.cluster_churn_16k");
+        ok = false;
+    }
+
+    if (!run_code_point_width_case(oc::benchmarks::BenchmarkOptions{ .warmup_iterations = 50, .iterations = 500 }))
+    {
+        oc::benchmarks::report_failure(L"condrv.unicode_width.code_point_width_16k");
+        ok = false;
+    }
+
+    static constexpr MarginScrollCase margin_cases[] = {
+        { L"condrv.screen_buffer.margin_scroll_120x4", SMALL_RECT{ 0, 20, 119, 23 } },
+        { L"condrv.screen_buffer.margin_scroll_120x12", SMALL_RECT{ 0, 10, 119, 21 } },
+        { L"condrv.screen_buffer.margin_scroll_120x28", SMALL_RECT{ 0, 1, 119, 28 } },
+        { L"condrv.screen_buffer.margin_scroll_60x28", SMALL_RECT{ 60, 1, 119, 28 } },
+    };
+    for (const auto& test_case : margin_cases)
+    {
+        if (!run_margin_scroll_case(oc::benchmarks::BenchmarkOptions{}, test_case))
+        {
+            oc::benchmarks::report_failure(test_case.name);
+            ok = false;
+        }
+    }
+
+    static constexpr BulkCase bulk_cases[] = {
+        { L"condrv.screen_buffer.bulk_write_char_info_rect_120x30", BulkOperation::write_char_info_unicode },
+        { L"condrv.screen_buffer.bulk_write_char_info_rect_ascii_120x30", BulkOperation::write_char_info_ascii },
+        { L"condrv.screen_buffer.bulk_read_char_info_rect_120x30", BulkOperation::read_char_info_unicode },
+        { L"condrv.screen_buffer.bulk_write_characters_120x30", BulkOperation::write_characters },
+        { L"condrv.screen_buffer.bulk_read_characters_120x30", BulkOperation::read_characters },
+        { L"condrv.screen_buffer.bulk_fill_attributes_120x30", BulkOperation::fill_attributes },
+    };
+    for (const auto& test_case : bulk_cases)
+    {
+        if (!run_bulk_case(oc::benchmarks::BenchmarkOptions{}, test_case))
+        {
+            oc::benchmarks::report_failure(test_case.name);
+            ok = false;
+        }
+    }
+
+    if (!run_resident_case(L"condrv.screen_buffer.resident_untouched", ResidentContents::untouched))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.resident_untouched");
+        ok = false;
+    }
+
+    if (!run_resident_case(L"condrv.screen_buffer.resident_every_row_written", ResidentContents::every_row_written))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.resident_every_row_written");
+        ok = false;
+    }
+
+    if (!run_resident_case(L"condrv.screen_buffer.resident_build_log", ResidentContents::build_log))
+    {
+        oc::benchmarks::report_failure(L"condrv.screen_buffer.resident_build_log");
+        ok = false;
+    }
+
+    return ok;
+}
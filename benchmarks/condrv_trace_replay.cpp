@@ -0,0 +1,152 @@
+// Replays a captured ConDrv packet trace and reports per-API dispatch latency.
+//
+// Usage: `oc_new_condrv_trace_replay <trace.octrace> [iterations]`
+//
+// Each iteration replays the whole trace against a fresh server state (see
+// `condrv/condrv_packet_replay.hpp`). Results are printed as JSON lines on stdout, one per API
+// plus a `condrv.replay.total` summary, in the same shape as `oc_new_benchmarks` output.
+
+#include "benchmark_harness.hpp"
+
+#include "condrv/condrv_api_metrics.hpp"
+#include "condrv/condrv_packet_replay.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cwchar>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    using oc::benchmarks::ticks_to_ns;
+
+    [[nodiscard]] std::wstring sample_name(const oc::condrv::PacketReplaySample& sample)
+    {
+        if (const auto name = oc::condrv::condrv_api_name(sample.function, sample.api_number); !name.empty())
+        {
+            return std::wstring(name);
+        }
+
+        wchar_t buffer[40]{};
+        (void)swprintf(
+            buffer,
+            std::size(buffer),
+            L"function_%lu_api_0x%08lX",
+            static_cast<unsigned long>(sample.function),
+            static_cast<unsigned long>(sample.api_number));
+        return buffer;
+    }
+
+    [[nodiscard]] double percentile_ns(const std::vector<uint64_t>& sorted_ticks, const double fraction) noexcept
+    {
+        const size_t index = std::min(
+            sorted_ticks.size() - 1,
+            static_cast<size_t>(fraction * static_cast<double>(sorted_ticks.size())));
+        return ticks_to_ns(sorted_ticks[index]);
+    }
+
+    void report_api(const std::wstring& name, std::vector<uint64_t>& ticks) noexcept
+    {
+        std::sort(ticks.begin(), ticks.end());
+        uint64_t total = 0;
+        for (const auto value : ticks)
+        {
+            total += value;
+        }
+
+        const double total_ns = ticks_to_ns(total);
+        wprintf(
+            L"{\"benchmark\":\"condrv.replay.api.%ls\",\"count\":%zu,\"p50_ns\":%.2f,\"p90_ns\":%.2f,"
+            L"\"p99_ns\":%.2f,\"max_ns\":%.2f,\"ops_per_s\":%.1f}\n",
+            name.c_str(),
+            ticks.size(),
+            percentile_ns(ticks, 0.50),
+            percentile_ns(ticks, 0.90),
+            percentile_ns(ticks, 0.99),
+            ticks_to_ns(ticks.back()),
+            total_ns > 0.0 ? static_cast<double>(ticks.size()) * 1'000'000'000.0 / total_ns : 0.0);
+    }
+}
+
+int wmain(const int argc, wchar_t** const argv) noexcept
+{
+    if (argc < 2)
+    {
+        fwprintf(stderr, L"usage: oc_new_condrv_trace_replay <trace.octrace> [iterations]\n");
+        return 2;
+    }
+
+    size_t iterations = 5;
+    if (argc >= 3)
+    {
+        iterations = std::max<size_t>(std::wcstoul(argv[2], nullptr, 10), 1);
+    }
+
+    try
+    {
+        auto trace = oc::condrv::load_packet_trace(argv[1]);
+        if (!trace)
+        {
+            fwprintf(
+                stderr,
+                L"[REPLAY FAIL] %ls (error=%lu)\n",
+                trace.error().context.c_str(),
+                static_cast<unsigned long>(trace.error().win32_error));
+            return 1;
+        }
+
+        std::map<std::wstring, std::vector<uint64_t>> per_api;
+        oc::condrv::PacketReplayResult last{};
+        uint64_t dispatch_ticks = 0;
+        for (size_t iteration = 0; iteration < iterations; ++iteration)
+        {
+            auto result = oc::condrv::replay_packet_trace(trace.value());
+            if (!result)
+            {
+                fwprintf(
+                    stderr,
+                    L"[REPLAY FAIL] %ls (error=%lu)\n",
+                    result.error().context.c_str(),
+                    static_cast<unsigned long>(result.error().win32_error));
+                return 1;
+            }
+
+            for (const auto& sample : result->samples)
+            {
+                per_api[sample_name(sample)].push_back(sample.ticks);
+            }
+            dispatch_ticks += result->dispatch_ticks;
+            last = std::move(result.value());
+        }
+
+        for (auto& [name, ticks] : per_api)
+        {
+            report_api(name, ticks);
+        }
+
+        const double total_ns = ticks_to_ns(dispatch_ticks) / static_cast<double>(iterations);
+        wprintf(
+            L"{\"benchmark\":\"condrv.replay.total\",\"iterations\":%zu,\"packets\":%zu,\"reply_pending\":%zu,"
+            L"\"missing_input_payloads\":%zu,\"host_input_bytes\":%llu,\"host_output_bytes\":%llu,"
+            L"\"dispatch_ns_per_iteration\":%.2f,\"ns_per_packet\":%.2f}\n",
+            iterations,
+            last.packets,
+            last.reply_pending,
+            last.missing_input_payloads,
+            static_cast<unsigned long long>(last.host_input_bytes),
+            static_cast<unsigned long long>(last.host_output_bytes),
+            total_ns,
+            last.packets != 0 ? total_ns / static_cast<double>(last.packets) : 0.0);
+        (void)fflush(stdout);
+    }
+    catch (...)
+    {
+        fwprintf(stderr, L"[REPLAY FAIL] out of memory\n");
+        return 1;
+    }
+
+    return 0;
+}
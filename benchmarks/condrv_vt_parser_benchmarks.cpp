@@ -0,0 +1,177 @@
+#include "benchmark_harness.hpp"
+
+#include "condrv/vt_output_parser.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// VT output parser throughput, without a screen buffer.
+//
+// Each op walks one ~16 KiB chunk through `VtOutputParser` the way `apply_text_to_screen_buffer`
+// does, but the consumer only counts: printable text is skipped a run at a time and dispatched
+// sequences are tallied. This isolates the state machine from the cell writes the screen buffer
+// cases measure.
+// `plain` is uncolored build log lines (one dispatch-free run per line), `highlighted` is
+// `bat`-style source with a 24-bit color SGR per token, and `tui_redraw` is a full-screen
+// repaint: CUP to each row, SGR per field, EL, and an OSC title per frame.
+// `ns_per_code_unit` and `mb_per_s` are at the median; `dispatches` counts ESC, CSI and OSC
+// dispatches per op.
+
+namespace
+{
+    [[nodiscard]] std::wstring make_plain_chunk(const size_t target_chars)
+    {
+        constexpr std::wstring_view lines[] = {
+            L"Building CXX object src/condrv/CMakeFiles/oc_condrv.dir/condrv_server.cpp.obj",
+            L"  condrv_server.cpp",
+            L"Linking CXX static library src/condrv/oc_condrv.lib",
+            L"[==========] 214 tests from 31 test suites ran. (1873 ms total)",
+            L"2024-05-17T09:41:07.318Z INFO  request completed method=GET path=/api/v1/items status=200 elapsed=3.2ms",
+        };
+
+        std::wstring chunk;
+        chunk.reserve(target_chars + 256);
+        for (size_t line = 0; chunk.size() < target_chars; ++line)
+        {
+            chunk.append(lines[line % std::size(lines)]);
+            chunk.append(L"\r\n");
+        }
+        return chunk;
+    }
+
+    [[nodiscard]] std::wstring make_highlighted_chunk(const size_t target_chars)
+    {
+        constexpr std::wstring_view tokens[] = {
+            L"\x1b[38;2;249;38;114mconst",
+            L"\x1b[38;2;102;217;239mauto",
+            L"\x1b[38;2;248;248;242mbuffer",
+            L"\x1b[38;2;249;38;114m=",
+            L"\x1b[38;2;166;226;46mmake_buffer",
+            L"\x1b[38;2;174;129;255m120",
+            L"\x1b[38;2;230;219;116m\"text\"",
+            L"\x1b[38;2;248;248;242m);",
+        };
+
+        std::wstring chunk;
+        chunk.reserve(target_chars + 256);
+        for (size_t line = 1; chunk.size() < target_chars; ++line)
+        {
+            chunk.append(L"\x1b[38;2;117;113;94m");
+            chunk.append(std::to_wstring(line + 1000));
+            chunk.append(L" \x1b[0m\u2502 ");
+            for (size_t token = 0; token < 8; ++token)
+            {
+                chunk.append(tokens[(line + token) % std::size(tokens)]);
+                chunk.push_back(L' ');
+            }
+            chunk.append(L"\x1b[0m\r\n");
+        }
+        return chunk;
+    }
+
+    [[nodiscard]] std::wstring make_tui_redraw_chunk(const size_t target_chars)
+    {
+        std::wstring chunk;
+        chunk.reserve(target_chars + 256);
+        for (size_t frame = 0; chunk.size() < target_chars; ++frame)
+        {
+            chunk.append(L"\x1b[?25l\x1b]0;top - ");
+            chunk.append(std::to_wstring(frame));
+            chunk.append(L"\x07\x1b[H");
+            for (size_t row = 1; row <= 30 && chunk.size() < target_chars; ++row)
+            {
+                chunk.append(L"\x1b[");
+                chunk.append(std::to_wstring(row));
+                chunk.append(L";1H\x1b[1;37;44m");
+                chunk.append(std::to_wstring(1000 + row * 7));
+                chunk.append(L"\x1b[0m \x1b[32mroot\x1b[39m ");
+                chunk.append(row % 3 == 0 ? L"\x1b[7mR\x1b[27m" : L"S");
+                chunk.append(L" \x1b[38;5;208m");
+                chunk.append(std::to_wstring((frame * 13 + row) % 100));
+                chunk.append(L".0\x1b[0m conhost.exe\x1b[K");
+            }
+            chunk.append(L"\x1b[?25h");
+        }
+        return chunk;
+    }
+
+    [[nodiscard]] bool run_parse_case(const oc::benchmarks::BenchmarkOptions& options, const std::wstring_view name, const std::wstring& chunk)
+    {
+        oc::condrv::VtOutputParser parser;
+        uint64_t dispatches = 0;
+        uint64_t printed = 0;
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            dispatches = 0;
+            printed = 0;
+            const std::wstring_view text = chunk;
+            for (size_t offset = 0; offset < text.size();)
+            {
+                switch (parser.advance(text, offset))
+                {
+                case oc::condrv::VtAction::print:
+                {
+                    const size_t start = offset;
+                    do
+                    {
+                        ++offset;
+                    } while (offset < text.size() && oc::condrv::VtOutputParser::is_ground_printable(text[offset]));
+                    printed += offset - start;
+                    break;
+                }
+                case oc::condrv::VtAction::esc_dispatch:
+                case oc::condrv::VtAction::csi_dispatch:
+                case oc::condrv::VtAction::osc_dispatch:
+                    ++dispatches;
+                    break;
+                case oc::condrv::VtAction::execute:
+                case oc::condrv::VtAction::none:
+                    break;
+                }
+            }
+            return printed != 0 && parser.in_ground();
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const double bytes = static_cast<double>(chunk.size() * sizeof(wchar_t));
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"payload_bytes", .value = bytes },
+            oc::benchmarks::BenchmarkMetric{ .name = L"mb_per_s", .value = (bytes / (1024.0 * 1024.0)) / (stats->median_ns_per_op / 1'000'000'000.0) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"ns_per_code_unit", .value = stats->median_ns_per_op / static_cast<double>(chunk.size()) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"dispatches", .value = static_cast<double>(dispatches) },
+        };
+        oc::benchmarks::report_result(name, *stats, metrics);
+        return true;
+    }
+}
+
+bool run_condrv_vt_parser_benchmarks()
+{
+    bool ok = true;
+
+    const oc::benchmarks::BenchmarkOptions options{ .warmup_iterations = 100, .iterations = 2'000 };
+    const struct
+    {
+        std::wstring_view name;
+        std::wstring chunk;
+    } cases[] = {
+        { L"condrv.vt_parser.plain_16k", make_plain_chunk(16 * 1024) },
+        { L"condrv.vt_parser.highlighted_16k", make_highlighted_chunk(16 * 1024) },
+        { L"condrv.vt_parser.tui_redraw_16k", make_tui_redraw_chunk(16 * 1024) },
+    };
+    for (const auto& test_case : cases)
+    {
+        if (!run_parse_case(options, test_case.name, test_case.chunk))
+        {
+            oc::benchmarks::report_failure(test_case.name);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
@@ -0,0 +1,261 @@
+#include "benchmark_harness.hpp"
+
+#include "condrv/condrv_server.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Bulk WriteConsoleA/W throughput through `dispatch_message`.
+//
+// Each iteration dispatches one ~16 KiB chunk of log-like lines against a connected in-memory
+// server (`DummyComm` + `NullHostIo`). The numbers cover payload read, decode/transcode, the host
+// sink write and the screen-buffer model update, which is the steady-state cost of a client that
+// streams output. `mb_per_s` is derived from the median trial.
+// `w_16k_passthrough` uses a host that forwards output to a terminal, so writes go to the
+// deferred mirroring log and the model is updated in batches when the log fills; the batches are
+// inside the timed loop, so the result is the amortized cost.
+
+namespace
+{
+    struct DummyComm final
+    {
+        std::vector<std::byte> input;
+        std::vector<std::byte> output;
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_input(oc::condrv::IoOperation& operation) noexcept
+        {
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset + size > input.size())
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"DummyComm read_input out of range",
+                    .win32_error = ERROR_INVALID_DATA,
+                });
+            }
+
+            if (size != 0)
+            {
+                std::memcpy(operation.buffer.data, input.data() + offset, size);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write_output(oc::condrv::IoOperation& operation) noexcept
+        {
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset + size > output.size())
+            {
+                output.resize(offset + size);
+            }
+
+            if (size != 0)
+            {
+                std::memcpy(output.data() + offset, operation.buffer.data, size);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> complete_io(const oc::condrv::IoComplete& /*completion*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    [[nodiscard]] oc::condrv::IoPacket make_connect_packet(const DWORD pid, const DWORD tid) noexcept
+    {
+        oc::condrv::IoPacket packet{};
+        packet.descriptor.identifier.LowPart = 1;
+        packet.descriptor.function = oc::condrv::console_io_connect;
+        packet.descriptor.process = pid;
+        packet.descriptor.object = tid;
+        return packet;
+    }
+
+    // `NullHostIo`, but for a host that passes output through to a terminal, which answers VT
+    // queries itself: the ConPTY case.
+    struct PassthroughHostIo final
+    {
+        oc::condrv::NullHostIo sink;
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> write_output_bytes(const std::span<const std::byte> bytes) noexcept
+        {
+            return sink.write_output_bytes(bytes);
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> read_input_bytes(const std::span<std::byte> dest) noexcept
+        {
+            return sink.read_input_bytes(dest);
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> peek_input_bytes(const std::span<std::byte> dest) noexcept
+        {
+            return sink.peek_input_bytes(dest);
+        }
+
+        [[nodiscard]] size_t input_bytes_available() const noexcept
+        {
+            return sink.input_bytes_available();
+        }
+
+        [[nodiscard]] bool input_disconnected() const noexcept
+        {
+            return sink.input_disconnected();
+        }
+
+        [[nodiscard]] bool inject_input_bytes(const std::span<const std::byte> bytes) noexcept
+        {
+            return sink.inject_input_bytes(bytes);
+        }
+
+        [[nodiscard]] bool vt_should_answer_queries() const noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> flush_input_buffer() noexcept
+        {
+            return sink.flush_input_buffer();
+        }
+
+        [[nodiscard]] std::expected<bool, oc::condrv::DeviceCommError> wait_for_input(const DWORD timeout_ms) noexcept
+        {
+            return sink.wait_for_input(timeout_ms);
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> send_end_task(
+            const DWORD process_id,
+            const DWORD event_type,
+            const DWORD ctrl_flags) noexcept
+        {
+            return sink.send_end_task(process_id, event_type, ctrl_flags);
+        }
+    };
+
+    [[nodiscard]] std::wstring make_log_chunk(const size_t target_chars)
+    {
+        std::wstring chunk;
+        chunk.reserve(target_chars + 128);
+        for (size_t line = 0; chunk.size() < target_chars; ++line)
+        {
+            chunk.append(L"[2024-01-01 12:00:00.000] INFO worker-");
+            chunk.append(std::to_wstring(line % 16));
+            chunk.append(L": processed request id=");
+            chunk.append(std::to_wstring(line * 7919));
+            chunk.append(L" status=ok\r\n");
+        }
+
+        return chunk;
+    }
+
+    template<typename HostIo = oc::condrv::NullHostIo>
+    [[nodiscard]] bool run_write_case(
+        const std::wstring_view name,
+        const bool unicode,
+        const std::span<const std::byte> payload,
+        const oc::benchmarks::BenchmarkOptions& options)
+    {
+        DummyComm comm{};
+        oc::condrv::ServerState state{};
+        HostIo host_io{};
+
+        auto connect_packet = make_connect_packet(111, 222);
+        oc::condrv::BasicApiMessage<DummyComm> connect_message(comm, connect_packet);
+        auto connect_outcome = oc::condrv::dispatch_message(state, connect_message, host_io);
+        if (!connect_outcome || connect_message.completion().io_status.Status != oc::core::status_success)
+        {
+            return false;
+        }
+
+        oc::condrv::ConnectionInformation info{};
+        std::memcpy(&info, connect_message.completion().write.data, sizeof(info));
+
+        constexpr ULONG api_size = sizeof(CONSOLE_WRITECONSOLE_MSG);
+        const ULONG read_offset = api_size + static_cast<ULONG>(sizeof(CONSOLE_MSG_HEADER));
+
+        oc::condrv::IoPacket packet{};
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = 100;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = info.process;
+        packet.descriptor.object = info.output;
+        packet.descriptor.input_size = read_offset + static_cast<ULONG>(payload.size());
+        packet.descriptor.output_size = api_size;
+        packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepWriteConsole);
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+        packet.payload.user_defined.u.console_msg_l1.WriteConsole.Unicode = unicode ? TRUE : FALSE;
+
+        comm.input.assign(packet.descriptor.input_size, std::byte{});
+        std::memcpy(comm.input.data() + read_offset, payload.data(), payload.size());
+
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            oc::condrv::BasicApiMessage<DummyComm> message(comm, packet);
+            auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+            return outcome.has_value() && message.completion().io_status.Status == oc::core::status_success;
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const double bytes = static_cast<double>(payload.size());
+        const double mb_per_s = stats->median_ns_per_op > 0.0
+            ? (bytes / (1024.0 * 1024.0)) / (stats->median_ns_per_op / 1'000'000'000.0)
+            : 0.0;
+
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"payload_bytes", .value = bytes },
+            oc::benchmarks::BenchmarkMetric{ .name = L"mb_per_s", .value = mb_per_s },
+        };
+        oc::benchmarks::report_result(name, *stats, metrics);
+        return true;
+    }
+}
+
+bool run_condrv_write_console_benchmarks()
+{
+    constexpr size_t chunk_chars = 16 * 1024;
+
+    const std::wstring wide_chunk = make_log_chunk(chunk_chars);
+    std::string narrow_chunk;
+    narrow_chunk.reserve(wide_chunk.size());
+    for (const wchar_t ch : wide_chunk)
+    {
+        narrow_chunk.push_back(static_cast<char>(ch));
+    }
+
+    // 16 KiB chunks are ~1000x a single dispatch, so scale the iteration counts down accordingly.
+    const oc::benchmarks::BenchmarkOptions options{
+        .warmup_iterations = 50,
+        .iterations = 500,
+    };
+
+    bool ok = true;
+    if (!run_write_case(L"condrv.write_console.a_16k", false, std::as_bytes(std::span(narrow_chunk)), options))
+    {
+        oc::benchmarks::report_failure(L"condrv.write_console.a_16k");
+        ok = false;
+    }
+
+    if (!run_write_case(L"condrv.write_console.w_16k", true, std::as_bytes(std::span(wide_chunk)), options))
+    {
+        oc::benchmarks::report_failure(L"condrv.write_console.w_16k");
+        ok = false;
+    }
+
+    if (!run_write_case<PassthroughHostIo>(L"condrv.write_console.w_16k_passthrough", true, std::as_bytes(std::span(wide_chunk)), options))
+    {
+        oc::benchmarks::report_failure(L"condrv.write_console.w_16k_passthrough");
+        ok = false;
+    }
+
+    return ok;
+}
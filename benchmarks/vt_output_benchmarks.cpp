@@ -0,0 +1,250 @@
+// VT output throughput over a checked-in corpus of real-world terminal output.
+//
+// Usage: `oc_new_vt_output_benchmarks [corpus_dir] [iterations]`
+//
+// Each file in `corpus/vt_output` (see its README) is decoded from UTF-8 once, then replayed per op
+// through `apply_text_to_screen_buffer` with `NullHostIo` in 4096-unit writes, the size a client's
+// `WriteConsole` loop typically uses. Every file runs at three buffer shapes: 80x25 with no
+// scrollback, 120x30 over 9001 rows, and 240x70 over 2000 rows. The buffer is kept across ops, so
+// after the warmup the scrollback is full and every line feed scrolls.
+//
+// Results are JSON lines on stdout in the same shape as `oc_new_benchmarks`. `mb_per_s` counts
+// corpus (UTF-8) bytes at the median; `ns_per_char` is the median cost per UTF-16 unit;
+// `allocations_per_mb` counts global `operator new` calls during one extra replay, per MiB of
+// corpus.
+
+#include "benchmark_harness.hpp"
+
+#include "condrv/condrv_server.hpp"
+#include "core/unique_handle.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace
+{
+    std::atomic<uint64_t> g_allocations{ 0 };
+}
+
+// Counts every allocation in the process. Only the replay runs between the reads of the counter, so
+// the difference is what the output path allocated.
+void* operator new(const size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* const block = std::malloc(size == 0 ? 1 : size))
+    {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* const block) noexcept
+{
+    std::free(block);
+}
+
+void operator delete(void* const block, size_t) noexcept
+{
+    std::free(block);
+}
+
+namespace
+{
+    constexpr size_t write_units = 4096;
+    constexpr ULONG output_mode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+
+    constexpr std::wstring_view corpus_files[] = {
+        L"plain_log.txt",
+        L"ls_color.vt",
+        L"compiler_diagnostics.vt",
+        L"progress_bar.vt",
+        L"tui_redraw.vt",
+        L"scroll_margins.vt",
+        L"truecolor_art.vt",
+    };
+
+    struct BufferShape final
+    {
+        std::wstring_view name;
+        COORD window_size;
+        COORD buffer_size;
+    };
+
+    constexpr BufferShape buffer_shapes[] = {
+        { L"80x25", COORD{ 80, 25 }, COORD{ 80, 25 } },
+        { L"120x30", COORD{ 120, 30 }, COORD{ 120, 9001 } },
+        { L"240x70", COORD{ 240, 70 }, COORD{ 240, 2000 } },
+    };
+
+    struct CorpusFile final
+    {
+        size_t utf8_bytes{};
+        std::wstring text;
+    };
+
+    [[nodiscard]] std::optional<CorpusFile> load_corpus_file(const std::wstring& path)
+    {
+        oc::core::UniqueHandle file(::CreateFileW(
+            path.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr));
+        if (!file.valid())
+        {
+            fwprintf(stderr, L"[BENCH] cannot open %ls (error %lu)\n", path.c_str(), ::GetLastError());
+            return std::nullopt;
+        }
+
+        LARGE_INTEGER size{};
+        if (::GetFileSizeEx(file.get(), &size) == FALSE || size.QuadPart <= 0 || size.QuadPart > INT_MAX)
+        {
+            fwprintf(stderr, L"[BENCH] cannot size %ls\n", path.c_str());
+            return std::nullopt;
+        }
+
+        std::string bytes(static_cast<size_t>(size.QuadPart), '\0');
+        DWORD read = 0;
+        if (::ReadFile(file.get(), bytes.data(), static_cast<DWORD>(bytes.size()), &read, nullptr) == FALSE || read != bytes.size())
+        {
+            fwprintf(stderr, L"[BENCH] cannot read %ls (error %lu)\n", path.c_str(), ::GetLastError());
+            return std::nullopt;
+        }
+
+        const int length = ::MultiByteToWideChar(CP_UTF8, 0, bytes.data(), static_cast<int>(bytes.size()), nullptr, 0);
+        if (length <= 0)
+        {
+            fwprintf(stderr, L"[BENCH] %ls is not UTF-8\n", path.c_str());
+            return std::nullopt;
+        }
+
+        CorpusFile corpus{ .utf8_bytes = bytes.size() };
+        corpus.text.resize(static_cast<size_t>(length));
+        (void)::MultiByteToWideChar(CP_UTF8, 0, bytes.data(), static_cast<int>(bytes.size()), corpus.text.data(), length);
+        return corpus;
+    }
+
+    [[nodiscard]] std::shared_ptr<oc::condrv::ScreenBuffer> make_buffer(const BufferShape& shape)
+    {
+        auto settings = oc::condrv::ScreenBuffer::default_settings();
+        settings.buffer_size = shape.buffer_size;
+        settings.window_size = shape.window_size;
+        settings.maximum_window_size = shape.buffer_size;
+
+        auto created = oc::condrv::ScreenBuffer::create(settings);
+        if (!created)
+        {
+            return {};
+        }
+
+        return std::move(created.value());
+    }
+
+    // Writes `text` in `write_units` pieces, never between the halves of a surrogate pair.
+    void replay(oc::condrv::ScreenBuffer& buffer, const std::wstring_view text, oc::condrv::NullHostIo& host_io) noexcept
+    {
+        for (size_t offset = 0; offset < text.size();)
+        {
+            size_t length = std::min(write_units, text.size() - offset);
+            if (offset + length < text.size() && IS_HIGH_SURROGATE(text[offset + length - 1]))
+            {
+                --length;
+            }
+            oc::condrv::apply_text_to_screen_buffer(buffer, text.substr(offset, length), output_mode, nullptr, &host_io);
+            offset += length;
+        }
+    }
+
+    [[nodiscard]] bool run_case(
+        const oc::benchmarks::BenchmarkOptions& options,
+        const std::wstring_view file_name,
+        const CorpusFile& corpus,
+        const BufferShape& shape)
+    {
+        auto buffer = make_buffer(shape);
+        if (!buffer)
+        {
+            return false;
+        }
+
+        oc::condrv::NullHostIo host_io{};
+        const auto stats = oc::benchmarks::measure(options, [&]() noexcept {
+            replay(*buffer, corpus.text, host_io);
+            return true;
+        });
+        if (!stats)
+        {
+            return false;
+        }
+
+        const uint64_t allocations_before = g_allocations.load(std::memory_order_relaxed);
+        replay(*buffer, corpus.text, host_io);
+        const uint64_t allocations = g_allocations.load(std::memory_order_relaxed) - allocations_before;
+
+        const double bytes = static_cast<double>(corpus.utf8_bytes);
+        const double megabytes = bytes / (1024.0 * 1024.0);
+        const std::array metrics{
+            oc::benchmarks::BenchmarkMetric{ .name = L"payload_bytes", .value = bytes },
+            oc::benchmarks::BenchmarkMetric{ .name = L"code_units", .value = static_cast<double>(corpus.text.size()) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"mb_per_s", .value = megabytes / (stats->median_ns_per_op / 1'000'000'000.0) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"ns_per_char", .value = stats->median_ns_per_op / static_cast<double>(corpus.text.size()) },
+            oc::benchmarks::BenchmarkMetric{ .name = L"allocations_per_mb", .value = static_cast<double>(allocations) / megabytes },
+        };
+
+        // `vt_output.<file without extension>.<shape>`
+        std::wstring name = L"vt_output.";
+        name.append(file_name.substr(0, file_name.find(L'.')));
+        name.push_back(L'.');
+        name.append(shape.name);
+        oc::benchmarks::report_result(name, *stats, metrics);
+        return true;
+    }
+}
+
+int wmain(const int argc, wchar_t** const argv)
+{
+    std::wstring corpus_dir = argc >= 2 ? argv[1] : OC_VT_OUTPUT_CORPUS_DIR;
+    oc::benchmarks::BenchmarkOptions options{ .warmup_iterations = 5, .iterations = 50 };
+    if (argc >= 3)
+    {
+        options.iterations = std::max<size_t>(std::wcstoul(argv[2], nullptr, 10), 1);
+    }
+
+    int failed = 0;
+    for (const auto file_name : corpus_files)
+    {
+        const auto corpus = load_corpus_file(corpus_dir + L"\\" + std::wstring(file_name));
+        if (!corpus)
+        {
+            oc::benchmarks::report_failure(file_name);
+            ++failed;
+            continue;
+        }
+
+        fwprintf(stderr, L"[BENCH] %.*ls\n", static_cast<int>(file_name.size()), file_name.data());
+        for (const auto& shape : buffer_shapes)
+        {
+            if (!run_case(options, file_name, *corpus, shape))
+            {
+                oc::benchmarks::report_failure(file_name);
+                ++failed;
+            }
+        }
+    }
+
+    return failed == 0 ? 0 : 1;
+}
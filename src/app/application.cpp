@@ -228,6 +228,10 @@ namespace oc::app
         session_options.text_measurement = args.text_measurement();
         session_options.force_no_handoff = args.force_no_handoff();
         session_options.hold_window_on_exit = config.hold_window_on_exit;
+        session_options.condrv_pipelined_io = config.condrv_pipelined_io;
+        session_options.condrv_trace_directory = config.condrv_trace_directory;
+        session_options.condrv_api_metrics = config.condrv_api_metrics;
+        session_options.snapshot_max_fps = config.snapshot_max_fps;
 
         if (!session_options.host_input)
         {
@@ -0,0 +1,252 @@
+#include "condrv/attribute_table.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace oc::condrv
+{
+    namespace
+    {
+        constexpr uint32_t palette_cache_valid = 0x8000'0000u;
+        constexpr uint32_t color_mask = 0x00FF'FFFFu;
+        constexpr uint32_t no_free_entry = 0xFFFF'FFFFu;
+
+        [[nodiscard]] uint64_t hash(const TextAttribute& attribute) noexcept
+        {
+            const uint64_t low = attribute.legacy | (static_cast<uint64_t>(attribute.flags) << 16) |
+                                 (static_cast<uint64_t>(attribute.foreground & color_mask) << 24);
+            const uint64_t value = (low * 0x9E3779B97F4A7C15ULL) ^ ((attribute.background & color_mask) * 0xC2B2AE3D27D4EB4FULL);
+            return value ^ (value >> 29);
+        }
+    }
+
+    size_t AttributeTable::find_slot(const TextAttribute& attribute) const noexcept
+    {
+        const size_t mask = _slots.size() - 1;
+        for (size_t slot = hash(attribute) & mask;; slot = (slot + 1) & mask)
+        {
+            const uint16_t entry = _slots[slot];
+            if (entry == 0 || _entries[entry - 1] == attribute)
+            {
+                return slot;
+            }
+        }
+    }
+
+    bool AttributeTable::rebuild_slots(const size_t slot_count) noexcept
+    {
+        if (slot_count != _slots.size())
+        {
+            std::vector<uint16_t> slots;
+            try
+            {
+                slots.assign(slot_count, 0);
+            }
+            catch (...)
+            {
+                return false;
+            }
+            _slots.swap(slots);
+        }
+        else
+        {
+            std::fill(_slots.begin(), _slots.end(), uint16_t{ 0 });
+        }
+
+        for (size_t index = 0; index < _entries.size(); ++index)
+        {
+            if (_entries[index].flags != 0)
+            {
+                _slots[find_slot(_entries[index])] = static_cast<uint16_t>(index + 1);
+            }
+        }
+        return true;
+    }
+
+    USHORT AttributeTable::intern(const TextAttribute& attribute) noexcept
+    {
+        if (attribute.flags == 0)
+        {
+            return attribute_id_from_legacy(attribute.legacy);
+        }
+
+        // Colors the flags do not select are ignored, so they must not split entries.
+        TextAttribute key = attribute;
+        key.legacy = attribute_id_from_legacy(key.legacy);
+        key.foreground = (key.flags & TextAttribute::foreground_rgb) != 0 ? key.foreground & color_mask : 0;
+        key.background = (key.flags & TextAttribute::background_rgb) != 0 ? key.background & color_mask : 0;
+
+        if (!_slots.empty())
+        {
+            const uint16_t entry = _slots[find_slot(key)];
+            if (entry != 0)
+            {
+                return id_from_index(entry - 1u);
+            }
+        }
+
+        // Keep the load factor at or below one half so probes stay short.
+        if (full() || ((_live + 1) * 2 > _slots.size() && !rebuild_slots(std::max<size_t>(64, _slots.size() * 2))))
+        {
+            return key.legacy;
+        }
+
+        // Freed entries are reused first.
+        const bool reuse = _free_head != no_free_entry;
+        const size_t index = reuse ? _free_head : _entries.size();
+        if (reuse)
+        {
+            _free_head = static_cast<uint32_t>(_entries[index].foreground);
+            _entries[index] = key;
+        }
+        else
+        {
+            try
+            {
+                _entries.push_back(key);
+            }
+            catch (...)
+            {
+                return key.legacy;
+            }
+        }
+
+        _slots[find_slot(key)] = static_cast<uint16_t>(index + 1);
+        ++_live;
+        return id_from_index(index);
+    }
+
+    TextAttribute AttributeTable::lookup(const USHORT id) const noexcept
+    {
+        if ((id & extended_attribute_bit) == 0)
+        {
+            return TextAttribute{ .legacy = id };
+        }
+
+        const size_t index = index_from_id(id);
+        if (index < _entries.size() && _entries[index].flags != 0)
+        {
+            return _entries[index];
+        }
+
+        return TextAttribute{ .legacy = static_cast<USHORT>(attribute_id_from_legacy(id) & ~cell_width_bits) };
+    }
+
+    void AttributeTable::to_legacy(USHORT* const words, const size_t count) const noexcept
+    {
+        // Cells only hold interned IDs once something was interned.
+        if (_entries.empty())
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            words[i] = legacy(words[i]);
+        }
+    }
+
+    void AttributeTable::to_legacy(CHAR_INFO* const records, const size_t count) const noexcept
+    {
+        if (_entries.empty())
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            records[i].Attributes = legacy(records[i].Attributes);
+        }
+    }
+
+    void AttributeTable::begin_collection() noexcept
+    {
+        _marks.reset();
+    }
+
+    void AttributeTable::mark(const USHORT id) noexcept
+    {
+        if ((id & extended_attribute_bit) != 0)
+        {
+            const size_t index = index_from_id(id);
+            if (index < _entries.size())
+            {
+                _marks.set(index);
+            }
+        }
+    }
+
+    void AttributeTable::mark(const ScreenCell* const cells, const size_t count) noexcept
+    {
+        // Attributes come in runs; each run is marked once.
+        USHORT previous = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (cells[i].attributes != previous)
+            {
+                previous = cells[i].attributes;
+                mark(previous);
+            }
+        }
+    }
+
+    size_t AttributeTable::sweep() noexcept
+    {
+        size_t freed = 0;
+        for (size_t index = 0; index < _entries.size(); ++index)
+        {
+            TextAttribute& entry = _entries[index];
+            if (entry.flags != 0 && !_marks.test(index))
+            {
+                entry = TextAttribute{ .legacy = entry.legacy, .flags = 0, .foreground = _free_head };
+                _free_head = static_cast<uint32_t>(index);
+                ++freed;
+            }
+        }
+
+        _live -= freed;
+        ++_collections;
+        if (freed != 0)
+        {
+            // Same size, so this only clears and re-inserts.
+            (void)rebuild_slots(_slots.size());
+        }
+        return freed;
+    }
+
+    uint8_t AttributeTable::nearest_palette_index(const COLORREF color, const std::array<COLORREF, 16>& palette) noexcept
+    {
+        const uint32_t key = color & color_mask;
+        uint32_t& cached = _palette_cache[(key * 0x9E3779B1u) >> 26];
+        if ((cached & palette_cache_valid) != 0 && (cached & color_mask) == key)
+        {
+            return static_cast<uint8_t>((cached >> 24) & 0x0F);
+        }
+
+        const int red = static_cast<int>(key & 0xFF);
+        const int green = static_cast<int>((key >> 8) & 0xFF);
+        const int blue = static_cast<int>((key >> 16) & 0xFF);
+        uint8_t best_index = 0;
+        uint32_t best_distance = std::numeric_limits<uint32_t>::max();
+        for (size_t i = 0; i < palette.size(); ++i)
+        {
+            const int dr = static_cast<int>(palette[i] & 0xFF) - red;
+            const int dg = static_cast<int>((palette[i] >> 8) & 0xFF) - green;
+            const int db = static_cast<int>((palette[i] >> 16) & 0xFF) - blue;
+            const auto distance = static_cast<uint32_t>(dr * dr + dg * dg + db * db);
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best_index = static_cast<uint8_t>(i);
+            }
+        }
+
+        cached = palette_cache_valid | (static_cast<uint32_t>(best_index) << 24) | key;
+        return best_index;
+    }
+
+    void AttributeTable::palette_changed() noexcept
+    {
+        _palette_cache.fill(0);
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+// Interned text attributes for `ScreenBuffer` cells.
+//
+// Every cell keeps one 16-bit attribute word, which is an attribute ID. A classic `WORD` attribute
+// (colors and `COMMON_LVB_*` flags) is its own ID, so legacy output and the classic APIs never
+// touch the table. Attributes the classic word cannot express (RGB colors, italic, strikethrough,
+// ...) are interned once per buffer, and cells carry `extended_attribute_bit` plus the index. Each
+// entry also records the nearest classic word, which is what the classic read APIs report.
+//
+// The cell-half flags of double-width glyphs (`cell_width_bits`) are set next to either kind of
+// ID, so interned IDs keep the index out of those bits.
+//
+// Entries are not reference counted. When the table is full, `ScreenBuffer` marks the IDs its cells
+// and cursor state still hold and `sweep` frees the rest, as for `ClusterTable`.
+//
+// See `new/docs/design/condrv_screen_buffer_attribute_table.md`.
+
+#include "condrv/screen_cell_span.hpp"
+
+#include <Windows.h>
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace oc::condrv
+{
+    // Not used by the classic attribute word; upstream drops it from client attributes as well.
+    inline constexpr USHORT extended_attribute_bit = 0x2000;
+
+    // The ID for a classic attribute word supplied by a client.
+    [[nodiscard]] constexpr USHORT attribute_id_from_legacy(const USHORT legacy) noexcept
+    {
+        return static_cast<USHORT>(legacy & ~extended_attribute_bit);
+    }
+
+    // `COMMON_LVB_LEADING_BYTE` / `COMMON_LVB_TRAILING_BYTE` mark the two cells of a double-width
+    // glyph. They belong to the cell, not to the attribute, and the classic reads report them.
+    inline constexpr USHORT cell_width_bits = COMMON_LVB_LEADING_BYTE | COMMON_LVB_TRAILING_BYTE;
+
+    struct TextAttribute final
+    {
+        enum Flags : uint8_t
+        {
+            foreground_rgb = 0x01,
+            background_rgb = 0x02,
+            italic = 0x04,
+            strikethrough = 0x08,
+            faint = 0x10,
+            blink = 0x20,
+            invisible = 0x40,
+        };
+
+        // Classic colors and `COMMON_LVB_*` flags; RGB colors are mapped to the nearest palette index.
+        USHORT legacy{ 0x07 };
+        uint8_t flags{};
+        COLORREF foreground{}; // when `foreground_rgb` is set
+        COLORREF background{}; // when `background_rgb` is set
+
+        friend bool operator==(const TextAttribute&, const TextAttribute&) = default;
+    };
+
+    class AttributeTable final
+    {
+    public:
+        // Interned IDs keep the index in the bits below `extended_attribute_bit`, except
+        // `cell_width_bits`: 11 bits.
+        static constexpr size_t max_entries = 0x800;
+
+        // The ID for `attribute`. Attributes without flags are their classic word. When the table is
+        // full or cannot grow, the result is the classic word and the extra properties are lost.
+        [[nodiscard]] USHORT intern(const TextAttribute& attribute) noexcept;
+
+        [[nodiscard]] TextAttribute lookup(USHORT id) const noexcept;
+
+        [[nodiscard]] USHORT legacy(const USHORT id) const noexcept
+        {
+            return (id & extended_attribute_bit) == 0 ? id : static_cast<USHORT>(lookup(id).legacy | (id & cell_width_bits));
+        }
+
+        // Replace IDs with their classic words in place.
+        void to_legacy(USHORT* words, size_t count) const noexcept;
+        void to_legacy(CHAR_INFO* records, size_t count) const noexcept;
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            return _live;
+        }
+
+        [[nodiscard]] bool full() const noexcept
+        {
+            return _live == max_entries;
+        }
+
+        [[nodiscard]] uint64_t collections() const noexcept
+        {
+            return _collections;
+        }
+
+        // Reclamation: `begin_collection` clears the marks, `mark` records IDs still in use (classic
+        // words are ignored), and `sweep` frees every unmarked entry and returns the number freed.
+        // Freed IDs are handed out again by later interns. Nothing allocates.
+        void begin_collection() noexcept;
+        void mark(USHORT id) noexcept;
+        void mark(const ScreenCell* cells, size_t count) noexcept;
+        size_t sweep() noexcept;
+
+        // Nearest entry of `palette` to `color` by squared RGB distance. Recent colors are answered
+        // from a small cache, which `palette_changed` clears.
+        [[nodiscard]] uint8_t nearest_palette_index(COLORREF color, const std::array<COLORREF, 16>& palette) noexcept;
+        void palette_changed() noexcept;
+
+    private:
+        [[nodiscard]] static constexpr USHORT id_from_index(const size_t index) noexcept
+        {
+            return static_cast<USHORT>(extended_attribute_bit | (index & 0xFF) | ((index & 0x700) << 2));
+        }
+
+        [[nodiscard]] static constexpr size_t index_from_id(const USHORT id) noexcept
+        {
+            return (id & 0xFFu) | ((id >> 2) & 0x700u);
+        }
+
+        [[nodiscard]] size_t find_slot(const TextAttribute& attribute) const noexcept;
+        [[nodiscard]] bool rebuild_slots(size_t slot_count) noexcept;
+
+        // Interned attributes always have flags, so `flags` 0 marks a free entry, whose `foreground`
+        // links the next free one.
+        std::vector<TextAttribute> _entries;
+        uint32_t _free_head{ 0xFFFF'FFFFu };
+        // Open-addressed index into `_entries`: 0 is empty, otherwise entry index + 1.
+        std::vector<uint16_t> _slots;
+        std::bitset<max_entries> _marks;
+        size_t _live{};
+        uint64_t _collections{};
+        // Direct-mapped: valid bit, palette index in bits 24-27, color in the low 24 bits.
+        std::array<uint32_t, 64> _palette_cache{};
+    };
+}
@@ -0,0 +1,240 @@
+#include "condrv/cluster_table.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace oc::condrv
+{
+    namespace
+    {
+        constexpr wchar_t first_cluster_character = 0xD800;
+        constexpr uint32_t no_free_entry = std::numeric_limits<uint32_t>::max();
+
+        [[nodiscard]] uint64_t hash(const std::wstring_view text) noexcept
+        {
+            uint64_t value = 0xCBF2'9CE4'8422'2325ULL;
+            for (const wchar_t unit : text)
+            {
+                value = (value ^ static_cast<uint16_t>(unit)) * 0x0000'0100'0000'01B3ULL;
+            }
+            return value ^ (value >> 29);
+        }
+
+        [[nodiscard]] constexpr wchar_t cluster_character(const size_t index) noexcept
+        {
+            return static_cast<wchar_t>(first_cluster_character + index);
+        }
+
+        [[nodiscard]] constexpr bool is_low_surrogate(const wchar_t unit) noexcept
+        {
+            return unit >= 0xDC00 && unit <= 0xDFFF;
+        }
+    }
+
+    size_t ClusterTable::find_slot(const std::wstring_view text) const noexcept
+    {
+        const size_t mask = _slots.size() - 1;
+        for (size_t slot = hash(text) & mask;; slot = (slot + 1) & mask)
+        {
+            const uint16_t entry = _slots[slot];
+            if (entry == 0 || entry_text(_entries[entry - 1]) == text)
+            {
+                return slot;
+            }
+        }
+    }
+
+    bool ClusterTable::rebuild_slots(const size_t slot_count) noexcept
+    {
+        if (slot_count != _slots.size())
+        {
+            std::vector<uint16_t> slots;
+            try
+            {
+                slots.assign(slot_count, 0);
+            }
+            catch (...)
+            {
+                return false;
+            }
+            _slots.swap(slots);
+        }
+        else
+        {
+            std::fill(_slots.begin(), _slots.end(), uint16_t{ 0 });
+        }
+
+        for (size_t index = 0; index < _entries.size(); ++index)
+        {
+            if (_entries[index].length != 0)
+            {
+                _slots[find_slot(entry_text(_entries[index]))] = static_cast<uint16_t>(index + 1);
+            }
+        }
+        return true;
+    }
+
+    std::optional<wchar_t> ClusterTable::intern(std::wstring_view text) noexcept
+    {
+        if (text.empty())
+        {
+            return std::nullopt;
+        }
+        text = text.substr(0, max_length);
+
+        if (!_slots.empty())
+        {
+            const uint16_t entry = _slots[find_slot(text)];
+            if (entry != 0)
+            {
+                return cluster_character(entry - 1u);
+            }
+        }
+
+        // Keep the load factor at or below one half so probes stay short.
+        if (full() || ((_live + 1) * 2 > _slots.size() && !rebuild_slots(std::max<size_t>(64, _slots.size() * 2))))
+        {
+            return std::nullopt;
+        }
+
+        // Freed entries are reused first; they are linked through `offset`.
+        const bool reuse = _free_head != no_free_entry;
+        const size_t index = reuse ? _free_head : _entries.size();
+        const size_t needed = _pool.size() + 1 + text.size();
+        try
+        {
+            if (needed > _pool.capacity())
+            {
+                _pool.reserve(std::max(needed, _pool.capacity() * 2));
+            }
+            if (!reuse)
+            {
+                _entries.emplace_back();
+            }
+        }
+        catch (...)
+        {
+            return std::nullopt;
+        }
+
+        if (reuse)
+        {
+            _free_head = _entries[index].offset;
+        }
+
+        _pool.push_back(static_cast<wchar_t>(index));
+        _entries[index] = Entry{ .offset = static_cast<uint32_t>(_pool.size()), .length = static_cast<uint16_t>(text.size()) };
+        _pool.insert(_pool.end(), text.begin(), text.end());
+        _slots[find_slot(text)] = static_cast<uint16_t>(index + 1);
+        ++_live;
+        return cluster_character(index);
+    }
+
+    std::wstring_view ClusterTable::text(const wchar_t character) const noexcept
+    {
+        if (!is_cluster_character(character))
+        {
+            return {};
+        }
+
+        const size_t index = static_cast<size_t>(character - first_cluster_character);
+        return index < _entries.size() ? entry_text(_entries[index]) : std::wstring_view{};
+    }
+
+    wchar_t ClusterTable::classic_unit(const wchar_t character, const USHORT attributes) const noexcept
+    {
+        const std::wstring_view units = text(character);
+        if (units.empty())
+        {
+            return 0xFFFD;
+        }
+        if ((attributes & COMMON_LVB_TRAILING_BYTE) != 0 && units.size() > 1 && is_low_surrogate(units[1]))
+        {
+            return units[1];
+        }
+        return units[0];
+    }
+
+    void ClusterTable::to_classic(wchar_t* const characters, const ScreenCell* const cells, const size_t count) const noexcept
+    {
+        for (size_t i = find_surrogate_cell(cells, count); i < count; i += 1 + find_surrogate_cell(cells + i + 1, count - i - 1))
+        {
+            characters[i] = classic_unit(cells[i].character, cells[i].attributes);
+        }
+    }
+
+    void ClusterTable::to_classic(CHAR_INFO* const records, const ScreenCell* const cells, const size_t count) const noexcept
+    {
+        for (size_t i = find_surrogate_cell(cells, count); i < count; i += 1 + find_surrogate_cell(cells + i + 1, count - i - 1))
+        {
+            records[i].Char.UnicodeChar = classic_unit(cells[i].character, cells[i].attributes);
+        }
+    }
+
+    size_t ClusterTable::storage_bytes() const noexcept
+    {
+        return _pool.capacity() * sizeof(wchar_t) + _entries.capacity() * sizeof(Entry) + _slots.capacity() * sizeof(uint16_t);
+    }
+
+    void ClusterTable::begin_collection() noexcept
+    {
+        _marks.reset();
+    }
+
+    void ClusterTable::mark(const wchar_t character) noexcept
+    {
+        if (is_cluster_character(character))
+        {
+            const size_t index = static_cast<size_t>(character - first_cluster_character);
+            if (index < _entries.size())
+            {
+                _marks.set(index);
+            }
+        }
+    }
+
+    void ClusterTable::mark(const ScreenCell* const cells, const size_t count) noexcept
+    {
+        for (size_t i = find_surrogate_cell(cells, count); i < count; i += 1 + find_surrogate_cell(cells + i + 1, count - i - 1))
+        {
+            mark(cells[i].character);
+        }
+    }
+
+    size_t ClusterTable::sweep() noexcept
+    {
+        // The pool holds exactly the live entries, each after the unit naming it. Walking it in
+        // order moves every surviving text left over the freed ones.
+        size_t freed = 0;
+        size_t write = 0;
+        for (size_t read = 0; read < _pool.size();)
+        {
+            const size_t index = static_cast<size_t>(_pool[read]);
+            Entry& entry = _entries[index];
+            const size_t span = 1 + static_cast<size_t>(entry.length);
+            if (_marks.test(index))
+            {
+                std::copy_n(_pool.begin() + static_cast<ptrdiff_t>(read), span, _pool.begin() + static_cast<ptrdiff_t>(write));
+                entry.offset = static_cast<uint32_t>(write + 1);
+                write += span;
+            }
+            else
+            {
+                entry = Entry{ .offset = _free_head, .length = 0 };
+                _free_head = static_cast<uint32_t>(index);
+                ++freed;
+            }
+            read += span;
+        }
+
+        _pool.resize(write);
+        _live -= freed;
+        ++_collections;
+        if (freed != 0)
+        {
+            // Same size, so this only clears and re-inserts.
+            (void)rebuild_slots(_slots.size());
+        }
+        return freed;
+    }
+}
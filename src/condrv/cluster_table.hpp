@@ -0,0 +1,120 @@
+#pragma once
+
+// Out-of-line text for `ScreenBuffer` cells whose glyph is more than one UTF-16 code unit.
+//
+// A cell keeps one `wchar_t`. Surrogate pairs and base characters followed by combining marks,
+// variation selectors, emoji modifiers or ZWJ sequences are interned once per buffer instead, and
+// the cell holds a cluster character: a code unit in the surrogate range whose low 11 bits are the
+// entry index. Surrogates never stand for themselves in a cell, so every other character is stored
+// and read exactly as before, and code that only moves cells (scrolling, ICH / DCH, reflow) carries
+// clusters without knowing about them.
+//
+// Entries are not reference counted. When the table is full, `ScreenBuffer` marks the cluster
+// characters still present in its rows and `sweep` frees the rest and compacts the pool, so a long
+// session that prints many distinct emoji stays bounded by what is on screen and in scrollback.
+//
+// See `new/docs/design/condrv_cluster_table.md`.
+
+#include "condrv/screen_cell_span.hpp"
+
+#include <Windows.h>
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace oc::condrv
+{
+    [[nodiscard]] constexpr bool is_cluster_character(const wchar_t character) noexcept
+    {
+        return character >= 0xD800 && character <= 0xDFFF;
+    }
+
+    class ClusterTable final
+    {
+    public:
+        // One entry per value of the surrogate range.
+        static constexpr size_t max_entries = 0x800;
+        // Longer sequences keep their first `max_length` units, so one cell cannot hold unbounded
+        // text (stacked combining marks).
+        static constexpr size_t max_length = 32;
+
+        // The cluster character for `text`, which is 1 to `max_length` units. Equal text always
+        // gets the same character while its entry is live. nullopt when the table is full or
+        // cannot grow.
+        [[nodiscard]] std::optional<wchar_t> intern(std::wstring_view text) noexcept;
+
+        // The text of `character`; empty when it names no live entry.
+        [[nodiscard]] std::wstring_view text(wchar_t character) const noexcept;
+
+        // The one code unit the classic reads report for a cell holding cluster character
+        // `character`: the first unit, or in the trailing half of a double-width glyph the low
+        // surrogate that completes a pair, so a pair reads back as its two units. U+FFFD when the
+        // character names no live entry.
+        [[nodiscard]] wchar_t classic_unit(wchar_t character, USHORT attributes) const noexcept;
+
+        // Replace cluster characters with `classic_unit` in characters already loaded from `cells`.
+        void to_classic(wchar_t* characters, const ScreenCell* cells, size_t count) const noexcept;
+        void to_classic(CHAR_INFO* records, const ScreenCell* cells, size_t count) const noexcept;
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return _live == 0;
+        }
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            return _live;
+        }
+
+        [[nodiscard]] bool full() const noexcept
+        {
+            return _live == max_entries;
+        }
+
+        // Heap bytes held by the pool, the entries and the index.
+        [[nodiscard]] size_t storage_bytes() const noexcept;
+
+        [[nodiscard]] uint64_t collections() const noexcept
+        {
+            return _collections;
+        }
+
+        // Reclamation: `begin_collection` clears the marks, `mark` records cluster characters still
+        // in use (other characters are ignored), and `sweep` frees every unmarked entry, compacts the
+        // pool and returns the number freed. Nothing allocates.
+        void begin_collection() noexcept;
+        void mark(wchar_t character) noexcept;
+        void mark(const ScreenCell* cells, size_t count) noexcept;
+        size_t sweep() noexcept;
+
+    private:
+        // `length` 0 marks a free entry, whose `offset` links the next free one. Each live entry's
+        // text sits in `_pool` after one unit holding its index, which lets `sweep` walk the pool.
+        struct Entry final
+        {
+            uint32_t offset{};
+            uint16_t length{};
+        };
+
+        [[nodiscard]] std::wstring_view entry_text(const Entry& entry) const noexcept
+        {
+            return std::wstring_view(_pool.data() + entry.offset, entry.length);
+        }
+
+        [[nodiscard]] size_t find_slot(std::wstring_view text) const noexcept;
+        [[nodiscard]] bool rebuild_slots(size_t slot_count) noexcept;
+
+        std::vector<wchar_t> _pool;
+        std::vector<Entry> _entries;
+        uint32_t _free_head{ 0xFFFF'FFFFu };
+        // Open-addressed index into `_entries`: 0 is empty, otherwise entry index + 1.
+        std::vector<uint16_t> _slots;
+        std::bitset<max_entries> _marks;
+        size_t _live{};
+        uint64_t _collections{};
+    };
+}
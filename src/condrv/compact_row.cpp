@@ -0,0 +1,112 @@
+#include "condrv/compact_row.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <new>
+
+namespace oc::condrv
+{
+    bool CompactRow::encode(const ScreenCell* const cells, const size_t length) noexcept
+    {
+        _length = 0;
+        _run_count = 0;
+        if (length > std::numeric_limits<uint16_t>::max())
+        {
+            return false;
+        }
+
+        size_t runs = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (cells[i].character > 0xFF)
+            {
+                return false;
+            }
+            if (i == 0 || cells[i].attributes != cells[i - 1].attributes)
+            {
+                if (++runs > max_runs)
+                {
+                    return false;
+                }
+            }
+        }
+
+        // Round up so rows of similar length can trade storage.
+        const size_t needed = (runs * sizeof(AttributeRun) + length + 15) & ~size_t{ 15 };
+        if (_capacity < needed)
+        {
+            std::unique_ptr<std::byte[]> storage(new (std::nothrow) std::byte[needed]);
+            if (!storage)
+            {
+                return false;
+            }
+
+            _storage = std::move(storage);
+            _capacity = static_cast<uint32_t>(needed);
+        }
+
+        size_t index = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (i + 1 == length || cells[i + 1].attributes != cells[i].attributes)
+            {
+                const AttributeRun value{ .attributes = cells[i].attributes, .end = static_cast<USHORT>(i + 1) };
+                std::memcpy(_storage.get() + index * sizeof(AttributeRun), &value, sizeof(value));
+                ++index;
+            }
+        }
+
+        // Every character fits in a byte, so narrowing is exact.
+        load_cell_ascii(_storage.get() + runs * sizeof(AttributeRun), cells, length);
+        _length = static_cast<uint16_t>(length);
+        _run_count = static_cast<uint8_t>(runs);
+        return true;
+    }
+
+    CompactRow::AttributeRun CompactRow::run(const size_t index) const noexcept
+    {
+        AttributeRun value{};
+        std::memcpy(&value, _storage.get() + index * sizeof(AttributeRun), sizeof(value));
+        return value;
+    }
+
+    const std::byte* CompactRow::text() const noexcept
+    {
+        return _storage.get() + static_cast<size_t>(_run_count) * sizeof(AttributeRun);
+    }
+
+    void CompactRow::decode(size_t column, size_t count, ScreenCell* dest) const noexcept
+    {
+        store_cell_ascii(dest, text() + column, count);
+        for (size_t index = 0; index < _run_count && count != 0; ++index)
+        {
+            const auto current = run(index);
+            if (current.end <= column)
+            {
+                continue;
+            }
+
+            const size_t n = std::min(count, static_cast<size_t>(current.end) - column);
+            fill_cell_attributes(dest, n, current.attributes);
+            dest += n;
+            column += n;
+            count -= n;
+        }
+    }
+
+    ScreenCell CompactRow::cell(const size_t column) const noexcept
+    {
+        ScreenCell value{ .character = static_cast<wchar_t>(static_cast<unsigned char>(text()[column])) };
+        for (size_t index = 0; index < _run_count; ++index)
+        {
+            const auto current = run(index);
+            if (column < current.end)
+            {
+                value.attributes = current.attributes;
+                break;
+            }
+        }
+        return value;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+// Compact encoding for `ScreenBuffer` rows that scrolled out of the viewport.
+//
+// Scrollback is mostly 8-bit text with a few attribute runs per line (build logs, directory
+// listings). `CompactRow` stores such a row prefix as one byte per cell plus a short run-length
+// list of attributes: about a quarter of the `ScreenCell` storage, less once trailing blanks are
+// trimmed by the caller. Rows with wider characters or more attribute runs do not encode and stay
+// in the full format.
+//
+// See `new/docs/design/condrv_screen_buffer_compact_rows.md`.
+
+#include "condrv/screen_cell_span.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace oc::condrv
+{
+    class CompactRow final
+    {
+    public:
+        // More runs than this is treated as a complex attribute mix.
+        static constexpr size_t max_runs = 8;
+
+        // Encodes `cells[0, length)` when every character is at most U+00FF and the attributes
+        // change at most `max_runs - 1` times. Storage is reused when it is large enough. Returns
+        // false when the cells do not qualify or storage cannot be allocated; the previous encoding
+        // is lost either way.
+        [[nodiscard]] bool encode(const ScreenCell* cells, size_t length) noexcept;
+
+        // Cells currently encoded.
+        [[nodiscard]] size_t length() const noexcept
+        {
+            return _length;
+        }
+
+        // Bytes of storage owned, whether or not an encoding is current.
+        [[nodiscard]] size_t storage_bytes() const noexcept
+        {
+            return _capacity;
+        }
+
+        // Frees the storage; the row encodes nothing until the next `encode`.
+        void reset() noexcept
+        {
+            _storage.reset();
+            _capacity = 0;
+            _length = 0;
+            _run_count = 0;
+        }
+
+        // Writes cells `[column, column + count)` to `dest`; the range must lie within `length()`.
+        void decode(size_t column, size_t count, ScreenCell* dest) const noexcept;
+        [[nodiscard]] ScreenCell cell(size_t column) const noexcept;
+
+        // The attribute word of each run, in order; `ScreenBuffer` marks them when it reclaims
+        // attribute IDs.
+        [[nodiscard]] size_t run_count() const noexcept
+        {
+            return _run_count;
+        }
+        [[nodiscard]] USHORT run_attributes(const size_t index) const noexcept
+        {
+            return run(index).attributes;
+        }
+
+    private:
+        struct AttributeRun final
+        {
+            USHORT attributes{};
+            USHORT end{}; // exclusive
+        };
+
+        [[nodiscard]] AttributeRun run(size_t index) const noexcept;
+        [[nodiscard]] const std::byte* text() const noexcept;
+
+        // `_run_count` runs followed by `_length` bytes of text.
+        std::unique_ptr<std::byte[]> _storage;
+        uint32_t _capacity{};
+        uint16_t _length{};
+        uint8_t _run_count{};
+    };
+}
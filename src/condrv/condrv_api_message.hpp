@@ -5,7 +5,8 @@
 // The upstream conhost implementation uses a larger `CONSOLE_API_MSG` structure
 // with additional state, helpers, and integration with the full console object
 // model. The replacement begins with a minimal, deterministic wrapper that:
-// - owns per-message input/output buffers (as `std::vector<std::byte>`)
+// - owns per-message input/output buffers (`PooledBuffer`, optionally recycled through a
+//   server-owned `MessageBufferPool` so steady-state traffic does not hit the heap)
 // - reads input payload via `IOCTL_CONDRV_READ_INPUT`
 // - writes output payload via `IOCTL_CONDRV_WRITE_OUTPUT`
 // - exposes the completion structure for `IOCTL_CONDRV_COMPLETE_IO`
@@ -13,17 +14,21 @@
 // This is the foundation for a future server-mode dispatcher implementation.
 
 #include "condrv/condrv_device_comm.hpp"
+#include "condrv/condrv_message_buffer_pool.hpp"
 #include "condrv/condrv_packet.hpp"
 #include "core/assert.hpp"
 
 #include <Windows.h>
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <expected>
 #include <span>
 #include <type_traits>
-#include <vector>
+#include <utility>
 
 namespace oc::condrv
 {
@@ -36,13 +41,50 @@ namespace oc::condrv
     class BasicApiMessage final
     {
     public:
-        BasicApiMessage(Comm& comm, IoPacket packet) noexcept :
+        BasicApiMessage(Comm& comm, IoPacket packet, MessageBufferPool* const buffer_pool = nullptr) noexcept :
             _comm(&comm),
+            _buffer_pool(buffer_pool),
             _packet(packet)
         {
             _complete.identifier = _packet.descriptor.identifier;
         }
 
+        BasicApiMessage(const BasicApiMessage&) = delete;
+        BasicApiMessage& operator=(const BasicApiMessage&) = delete;
+
+        BasicApiMessage(BasicApiMessage&& other) noexcept :
+            _comm(other._comm),
+            _buffer_pool(other._buffer_pool),
+            _packet(other._packet),
+            _complete(other._complete),
+            _read_offset(other._read_offset),
+            _write_offset(other._write_offset),
+            _input_storage(std::move(other._input_storage)),
+            _output_storage(std::move(other._output_storage)),
+            _completion_write_storage(other._completion_write_storage)
+        {
+            rebase_completion_write(other);
+        }
+
+        BasicApiMessage& operator=(BasicApiMessage&& other) noexcept
+        {
+            if (this != &other)
+            {
+                _comm = other._comm;
+                _buffer_pool = other._buffer_pool;
+                _packet = other._packet;
+                _complete = other._complete;
+                _read_offset = other._read_offset;
+                _write_offset = other._write_offset;
+                _input_storage = std::move(other._input_storage);
+                _output_storage = std::move(other._output_storage);
+                _completion_write_storage = other._completion_write_storage;
+                rebase_completion_write(other);
+            }
+
+            return *this;
+        }
+
         [[nodiscard]] const IoDescriptor& descriptor() const noexcept
         {
             return _packet.descriptor;
@@ -77,12 +119,12 @@ namespace oc::condrv
         void set_completion_write_data(const T& value) noexcept
         {
             static_assert(std::is_trivially_copyable_v<T>, "Completion write data must be trivially copyable");
+            static_assert(sizeof(T) <= completion_write_capacity, "Completion write data exceeds inline storage");
 
-            _completion_write_storage.resize(sizeof(T));
             std::memcpy(_completion_write_storage.data(), &value, sizeof(T));
 
             _complete.write.data = _completion_write_storage.data();
-            _complete.write.size = static_cast<ULONG>(_completion_write_storage.size());
+            _complete.write.size = static_cast<ULONG>(sizeof(T));
             _complete.write.offset = 0;
         }
 
@@ -103,9 +145,9 @@ namespace oc::condrv
                 return std::unexpected(DeviceCommError{ .context = L"Message comm was null", .win32_error = ERROR_INVALID_STATE });
             }
 
-            if (_input_buffer.data() != nullptr)
+            if (_input_storage.data() != nullptr)
             {
-                return std::span<std::byte>(_input_buffer.data(), _input_buffer.size());
+                return _input_storage.span();
             }
 
             if (_read_offset > _packet.descriptor.input_size)
@@ -114,26 +156,31 @@ namespace oc::condrv
             }
 
             const ULONG remaining = _packet.descriptor.input_size - _read_offset;
-            _input_storage.resize(remaining);
-            _input_buffer = std::span<std::byte>(_input_storage.data(), _input_storage.size());
-
             if (remaining == 0)
             {
-                return _input_buffer;
+                return std::span<std::byte>{};
             }
 
+            auto storage = acquire_message_buffer(_buffer_pool, remaining);
+            if (!storage)
+            {
+                return std::unexpected(storage.error());
+            }
+            _input_storage = std::move(storage.value());
+
             IoOperation op{};
             op.identifier = _packet.descriptor.identifier;
             op.buffer.offset = _read_offset;
-            op.buffer.data = _input_buffer.data();
+            op.buffer.data = _input_storage.data();
             op.buffer.size = remaining;
 
             if (auto result = _comm->read_input(op); !result)
             {
+                _input_storage.reset();
                 return std::unexpected(result.error());
             }
 
-            return _input_buffer;
+            return _input_storage.span();
         }
 
         [[nodiscard]] std::expected<std::span<std::byte>, DeviceCommError> get_output_buffer() noexcept
@@ -143,9 +190,9 @@ namespace oc::condrv
                 return std::unexpected(DeviceCommError{ .context = L"Message comm was null", .win32_error = ERROR_INVALID_STATE });
             }
 
-            if (_output_buffer.data() != nullptr)
+            if (_output_storage.data() != nullptr)
             {
-                return std::span<std::byte>(_output_buffer.data(), _output_buffer.size());
+                return _output_storage.span();
             }
 
             if (_write_offset > _packet.descriptor.output_size)
@@ -154,9 +201,38 @@ namespace oc::condrv
             }
 
             const ULONG remaining = _packet.descriptor.output_size - _write_offset;
-            _output_storage.assign(remaining, std::byte{});
-            _output_buffer = std::span<std::byte>(_output_storage.data(), _output_storage.size());
-            return _output_buffer;
+            if (remaining == 0)
+            {
+                return std::span<std::byte>{};
+            }
+
+            auto storage = acquire_message_buffer(_buffer_pool, remaining);
+            if (!storage)
+            {
+                return std::unexpected(storage.error());
+            }
+            _output_storage = std::move(storage.value());
+
+            // Pooled storage is recycled; keep the zero-initialized contract callers rely on.
+            std::memset(_output_storage.data(), 0, _output_storage.size());
+            return _output_storage.span();
+        }
+
+        // Payload bytes fetched with READ_INPUT (zero until `get_input_buffer` runs).
+        [[nodiscard]] size_t input_bytes() const noexcept
+        {
+            return _input_storage.size();
+        }
+
+        // Payload bytes `release_message_buffers` will write back with WRITE_OUTPUT for the current reply.
+        [[nodiscard]] size_t output_bytes() const noexcept
+        {
+            if (_output_storage.data() == nullptr || !nt_success(_complete.io_status.Status))
+            {
+                return 0;
+            }
+
+            return static_cast<size_t>(std::min<ULONG_PTR>(_complete.io_status.Information, _output_storage.size()));
         }
 
         [[nodiscard]] std::expected<void, DeviceCommError> release_message_buffers() noexcept
@@ -166,10 +242,9 @@ namespace oc::condrv
                 return std::unexpected(DeviceCommError{ .context = L"Message comm was null", .win32_error = ERROR_INVALID_STATE });
             }
 
-            _input_storage.clear();
-            _input_buffer = {};
+            _input_storage.reset();
 
-            if (_output_buffer.data() == nullptr)
+            if (_output_storage.data() == nullptr)
             {
                 return {};
             }
@@ -177,7 +252,7 @@ namespace oc::condrv
             if (nt_success(_complete.io_status.Status))
             {
                 const ULONG_PTR info = _complete.io_status.Information;
-                if (info > static_cast<ULONG_PTR>(_output_buffer.size()))
+                if (info > static_cast<ULONG_PTR>(_output_storage.size()))
                 {
                     return std::unexpected(DeviceCommError{
                         .context = L"Completion information exceeds output buffer size",
@@ -188,7 +263,7 @@ namespace oc::condrv
                 IoOperation op{};
                 op.identifier = _packet.descriptor.identifier;
                 op.buffer.offset = _write_offset;
-                op.buffer.data = _output_buffer.data();
+                op.buffer.data = _output_storage.data();
                 op.buffer.size = static_cast<ULONG>(info);
 
                 if (auto result = _comm->write_output(op); !result)
@@ -197,8 +272,7 @@ namespace oc::condrv
                 }
             }
 
-            _output_storage.clear();
-            _output_buffer = {};
+            _output_storage.reset();
             return {};
         }
 
@@ -213,17 +287,46 @@ namespace oc::condrv
         }
 
     private:
+        static constexpr size_t completion_write_capacity = 64;
+
+        // `_complete.write.data` may point into this message (the packet's API descriptor or the
+        // inline completion storage). Re-point it at our own copy after a move so a staged
+        // completion never references the moved-from object.
+        void rebase_completion_write(const BasicApiMessage& other) noexcept
+        {
+            const auto rebase = [&](const void* const other_base, void* const own_base, const size_t size) noexcept {
+                const auto address = reinterpret_cast<std::uintptr_t>(_complete.write.data);
+                const auto begin = reinterpret_cast<std::uintptr_t>(other_base);
+                if (address < begin || address >= begin + size)
+                {
+                    return false;
+                }
+
+                _complete.write.data = static_cast<std::byte*>(own_base) + (address - begin);
+                return true;
+            };
+
+            if (_complete.write.data == nullptr)
+            {
+                return;
+            }
+
+            if (!rebase(&other._packet, &_packet, sizeof(_packet)))
+            {
+                (void)rebase(other._completion_write_storage.data(), _completion_write_storage.data(), _completion_write_storage.size());
+            }
+        }
+
         Comm* _comm{ nullptr };
+        MessageBufferPool* _buffer_pool{ nullptr };
         IoPacket _packet{};
         IoComplete _complete{};
         ULONG _read_offset{ 0 };
         ULONG _write_offset{ 0 };
 
-        std::vector<std::byte> _input_storage;
-        std::vector<std::byte> _output_storage;
-        std::vector<std::byte> _completion_write_storage;
-        std::span<std::byte> _input_buffer{};
-        std::span<std::byte> _output_buffer{};
+        PooledBuffer _input_storage;
+        PooledBuffer _output_storage;
+        alignas(std::max_align_t) std::array<std::byte, completion_write_capacity> _completion_write_storage{};
     };
 
     using ConDrvApiMessage = BasicApiMessage<ConDrvDeviceComm>;
@@ -0,0 +1,341 @@
+#include "condrv/condrv_api_metrics.hpp"
+
+#include "condrv/condrv_protocol.hpp"
+
+#include <conmsgl1.h>
+#include <conmsgl2.h>
+#include <conmsgl3.h>
+
+#include <charconv>
+#include <cmath>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace oc::condrv
+{
+    namespace
+    {
+        struct ApiNameEntry final
+        {
+            ULONG api_number;
+            std::wstring_view name;
+        };
+
+#define OC_API_NAME(api) ApiNameEntry{ static_cast<ULONG>(Consolep##api), L## #api }
+
+        constexpr ApiNameEntry api_names[] = {
+            // Layer 1.
+            OC_API_NAME(GetCP),
+            OC_API_NAME(GetMode),
+            OC_API_NAME(SetMode),
+            OC_API_NAME(GetNumberOfInputEvents),
+            OC_API_NAME(GetConsoleInput),
+            OC_API_NAME(ReadConsole),
+            OC_API_NAME(WriteConsole),
+            OC_API_NAME(NotifyLastClose),
+            OC_API_NAME(GetLangId),
+            OC_API_NAME(MapBitmap),
+            // Layer 2.
+            OC_API_NAME(FillConsoleOutput),
+            OC_API_NAME(GenerateCtrlEvent),
+            OC_API_NAME(SetActiveScreenBuffer),
+            OC_API_NAME(FlushInputBuffer),
+            OC_API_NAME(SetCP),
+            OC_API_NAME(GetCursorInfo),
+            OC_API_NAME(SetCursorInfo),
+            OC_API_NAME(GetScreenBufferInfo),
+            OC_API_NAME(SetScreenBufferInfo),
+            OC_API_NAME(SetScreenBufferSize),
+            OC_API_NAME(SetCursorPosition),
+            OC_API_NAME(GetLargestWindowSize),
+            OC_API_NAME(ScrollScreenBuffer),
+            OC_API_NAME(SetTextAttribute),
+            OC_API_NAME(SetWindowInfo),
+            OC_API_NAME(ReadConsoleOutputString),
+            OC_API_NAME(WriteConsoleInput),
+            OC_API_NAME(WriteConsoleOutput),
+            OC_API_NAME(WriteConsoleOutputString),
+            OC_API_NAME(ReadConsoleOutput),
+            OC_API_NAME(GetTitle),
+            OC_API_NAME(SetTitle),
+            // Layer 3.
+            OC_API_NAME(GetNumberOfFonts),
+            OC_API_NAME(GetMouseInfo),
+            OC_API_NAME(GetFontInfo),
+            OC_API_NAME(GetFontSize),
+            OC_API_NAME(GetCurrentFont),
+            OC_API_NAME(SetFont),
+            OC_API_NAME(SetIcon),
+            OC_API_NAME(InvalidateBitmapRect),
+            OC_API_NAME(VDMOperation),
+            OC_API_NAME(SetCursor),
+            OC_API_NAME(ShowCursor),
+            OC_API_NAME(MenuControl),
+            OC_API_NAME(SetPalette),
+            OC_API_NAME(SetDisplayMode),
+            OC_API_NAME(RegisterVDM),
+            OC_API_NAME(GetHardwareState),
+            OC_API_NAME(SetHardwareState),
+            OC_API_NAME(GetDisplayMode),
+            OC_API_NAME(AddAlias),
+            OC_API_NAME(GetAlias),
+            OC_API_NAME(GetAliasesLength),
+            OC_API_NAME(GetAliasExesLength),
+            OC_API_NAME(GetAliases),
+            OC_API_NAME(GetAliasExes),
+            OC_API_NAME(ExpungeCommandHistory),
+            OC_API_NAME(SetNumberOfCommands),
+            OC_API_NAME(GetCommandHistoryLength),
+            OC_API_NAME(GetCommandHistory),
+            OC_API_NAME(SetKeyShortcuts),
+            OC_API_NAME(SetMenuClose),
+            OC_API_NAME(GetKeyboardLayoutName),
+            OC_API_NAME(GetConsoleWindow),
+            OC_API_NAME(CharType),
+            OC_API_NAME(SetLocalEUDC),
+            OC_API_NAME(SetCursorMode),
+            OC_API_NAME(GetCursorMode),
+            OC_API_NAME(RegisterOS2),
+            OC_API_NAME(SetOS2OemFormat),
+            OC_API_NAME(GetNlsMode),
+            OC_API_NAME(SetNlsMode),
+            OC_API_NAME(GetSelectionInfo),
+            OC_API_NAME(GetConsoleProcessList),
+            OC_API_NAME(GetHistory),
+            OC_API_NAME(SetHistory),
+            OC_API_NAME(SetCurrentFont),
+        };
+
+#undef OC_API_NAME
+
+        static_assert(console_io_user_defined == 0x07, "ApiMetrics duplicates the USER_DEFINED function code");
+        static_assert(console_io_raw_flush < ApiMetrics::function_slot_count - 1, "IO function codes must fit the function slots");
+
+        // Smallest bucket whose cumulative count reaches `fraction` of all samples.
+        [[nodiscard]] size_t percentile_bucket(const ApiMetrics::Counters& counters, const double fraction) noexcept
+        {
+            uint64_t total = 0;
+            for (const auto count : counters.latency_buckets)
+            {
+                total += count;
+            }
+
+            const auto target = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(total)));
+            uint64_t cumulative = 0;
+            for (size_t bucket = 0; bucket < counters.latency_buckets.size(); ++bucket)
+            {
+                cumulative += counters.latency_buckets[bucket];
+                if (cumulative != 0 && cumulative >= target)
+                {
+                    return bucket;
+                }
+            }
+
+            return counters.latency_buckets.size() - 1;
+        }
+
+        [[nodiscard]] double ticks_to_ns(const uint64_t ticks, const uint64_t ticks_per_second) noexcept
+        {
+            return ticks_per_second == 0 ? 0.0 : static_cast<double>(ticks) * 1'000'000'000.0 / static_cast<double>(ticks_per_second);
+        }
+
+        [[nodiscard]] double bucket_limit_ns(const size_t bucket, const uint64_t ticks_per_second) noexcept
+        {
+            const uint64_t limit = ApiMetrics::latency_bucket_limit(bucket);
+            return limit == UINT64_MAX ? -1.0 : ticks_to_ns(limit, ticks_per_second);
+        }
+
+        // `std::format` stays confined to logging; numbers are rendered with `std::to_chars`.
+        template<typename T>
+        void append_number(std::wstring& out, const T value)
+        {
+            std::array<char, 32> buffer{};
+            std::to_chars_result result{};
+            if constexpr (std::is_floating_point_v<T>)
+            {
+                result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value, std::chars_format::fixed, 1);
+            }
+            else
+            {
+                result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+            }
+
+            for (const char* it = buffer.data(); it != result.ptr; ++it)
+            {
+                out.push_back(static_cast<wchar_t>(*it));
+            }
+        }
+
+        template<typename T>
+        void append_field(std::wstring& out, const std::wstring_view name, const T value)
+        {
+            out.append(L",\"");
+            out.append(name);
+            out.append(L"\":");
+            append_number(out, value);
+        }
+    }
+
+    std::expected<std::unique_ptr<ApiMetrics>, DeviceCommError> ApiMetrics::create() noexcept
+    {
+        std::unique_ptr<ApiMetrics> metrics(new (std::nothrow) ApiMetrics());
+        if (!metrics)
+        {
+            return std::unexpected(DeviceCommError{
+                .context = L"Failed to allocate ConDrv API metrics",
+                .win32_error = ERROR_OUTOFMEMORY,
+            });
+        }
+
+        return metrics;
+    }
+
+    ApiMetrics::Counters& ApiMetrics::slot(const ULONG function, const ULONG api_number) noexcept
+    {
+        return const_cast<Counters&>(std::as_const(*this).slot(function, api_number));
+    }
+
+    const ApiMetrics::Counters& ApiMetrics::slot(const ULONG function, const ULONG api_number) const noexcept
+    {
+        if (function != user_defined_function)
+        {
+            return _functions[function < function_slot_count ? function : function_slot_count - 1];
+        }
+
+        const size_t layer = static_cast<size_t>(api_number >> 24);
+        const size_t index = static_cast<size_t>(api_number & 0x00FF'FFFF);
+        if (layer >= user_defined_layer_count || index >= user_defined_layer_capacity)
+        {
+            return _unknown_api;
+        }
+
+        return _user_defined[layer][index];
+    }
+
+    void ApiMetrics::record_completed(
+        const ULONG function,
+        const ULONG api_number,
+        const uint64_t ticks,
+        const uint64_t bytes_in,
+        const uint64_t bytes_out) noexcept
+    {
+        auto& counters = slot(function, api_number);
+        ++counters.calls;
+        counters.bytes_in += bytes_in;
+        counters.bytes_out += bytes_out;
+        record_latency(counters, ticks);
+    }
+
+    void ApiMetrics::record_reply_pending(const ULONG function, const ULONG api_number, const uint64_t ticks) noexcept
+    {
+        auto& counters = slot(function, api_number);
+        ++counters.reply_pending;
+        record_latency(counters, ticks);
+    }
+
+    const ApiMetrics::Counters& ApiMetrics::find(const ULONG function, const ULONG api_number) const noexcept
+    {
+        return slot(function, api_number);
+    }
+
+    void ApiMetrics::reset() noexcept
+    {
+        _functions = {};
+        _user_defined = {};
+        _unknown_api = {};
+    }
+
+    std::wstring_view condrv_api_name(const ULONG function, const ULONG api_number) noexcept
+    {
+        switch (function)
+        {
+        case console_io_connect:
+            return L"connect";
+        case console_io_disconnect:
+            return L"disconnect";
+        case console_io_create_object:
+            return L"create_object";
+        case console_io_close_object:
+            return L"close_object";
+        case console_io_raw_write:
+            return L"raw_write";
+        case console_io_raw_read:
+            return L"raw_read";
+        case console_io_raw_flush:
+            return L"raw_flush";
+        case console_io_user_defined:
+            break;
+        default:
+            return {};
+        }
+
+        for (const auto& entry : api_names)
+        {
+            if (entry.api_number == api_number)
+            {
+                return entry.name;
+            }
+        }
+
+        return {};
+    }
+
+    std::expected<void, DeviceCommError> format_api_metrics_json(
+        const ApiMetrics& metrics,
+        const uint64_t ticks_per_second,
+        std::wstring& out) noexcept
+    {
+        try
+        {
+            metrics.for_each([&](const ULONG function, const ULONG api_number, const ApiMetrics::Counters& counters) {
+                const auto name = condrv_api_name(function, api_number);
+                const uint64_t samples = counters.calls + counters.reply_pending;
+
+                out.append(L"{\"api\":\"");
+                out.append(name.empty() ? std::wstring_view(L"unknown") : name);
+                out.append(L"\"");
+                append_field(out, L"function", function);
+                append_field(out, L"api_number", api_number);
+                append_field(out, L"calls", counters.calls);
+                append_field(out, L"reply_pending", counters.reply_pending);
+                append_field(out, L"bytes_in", counters.bytes_in);
+                append_field(out, L"bytes_out", counters.bytes_out);
+                append_field(out, L"mean_ns", samples == 0 ? 0.0 : ticks_to_ns(counters.total_ticks, ticks_per_second) / static_cast<double>(samples));
+                append_field(out, L"max_ns", ticks_to_ns(counters.max_ticks, ticks_per_second));
+                append_field(out, L"p50_ns", bucket_limit_ns(percentile_bucket(counters, 0.50), ticks_per_second));
+                append_field(out, L"p90_ns", bucket_limit_ns(percentile_bucket(counters, 0.90), ticks_per_second));
+                append_field(out, L"p99_ns", bucket_limit_ns(percentile_bucket(counters, 0.99), ticks_per_second));
+                out.append(L",\"buckets\":[");
+
+                // Only non-empty buckets, as `[upper_bound_ns, count]`; -1 marks the open-ended bucket.
+                bool first = true;
+                for (size_t bucket = 0; bucket < counters.latency_buckets.size(); ++bucket)
+                {
+                    if (counters.latency_buckets[bucket] == 0)
+                    {
+                        continue;
+                    }
+
+                    out.append(first ? L"[" : L",[");
+                    append_number(out, bucket_limit_ns(bucket, ticks_per_second));
+                    out.push_back(L',');
+                    append_number(out, counters.latency_buckets[bucket]);
+                    out.push_back(L']');
+                    first = false;
+                }
+
+                out.append(L"]}\n");
+            });
+        }
+        catch (...)
+        {
+            return std::unexpected(DeviceCommError{
+                .context = L"Failed to format ConDrv API metrics",
+                .win32_error = ERROR_OUTOFMEMORY,
+            });
+        }
+
+        return {};
+    }
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+// Per-API call counters and latency histograms for the ConDrv server.
+//
+// When a `ServerState` has an `ApiMetrics` attached, `dispatch_message(...)` times every
+// dispatch attempt with QPC and records it under its API:
+// - USER_DEFINED requests are keyed by `ApiNumber` (`(layer << 24) | index`);
+// - every other IO function (connect, create object, raw read/write, ...) has its own slot.
+//
+// Each slot counts completed calls, attempts that went reply-pending, READ_INPUT / WRITE_OUTPUT
+// payload bytes, and a log2-bucketed latency histogram in QPC ticks.
+//
+// Threading: metrics are written only by the thread that owns the `ServerState` (the server
+// loop, or the dispatch thread in pipelined mode), so counters are plain integers with no locks
+// or atomics. Read them from that thread, or after the loop has stopped.
+//
+// See `new/docs/design/condrv_api_metrics.md`.
+
+#include "condrv/condrv_device_comm.hpp"
+
+#include <Windows.h>
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace oc::condrv
+{
+    class ApiMetrics final
+    {
+    public:
+        // Bucket 0 holds zero-tick samples; bucket `b` holds `[2^(b-1), 2^b)` ticks. The last bucket
+        // is open-ended (at a 10 MHz QPC it starts at roughly 107 seconds).
+        static constexpr size_t latency_bucket_count = 32;
+
+        struct Counters final
+        {
+            uint64_t calls{};
+            uint64_t reply_pending{};
+            uint64_t bytes_in{};
+            uint64_t bytes_out{};
+            uint64_t total_ticks{};
+            uint64_t max_ticks{};
+            std::array<uint64_t, latency_bucket_count> latency_buckets{};
+        };
+
+        // Mirrors the USER_DEFINED dispatch table shape: layers 0..3, 64 entries each.
+        static constexpr size_t user_defined_layer_count = 4;
+        static constexpr size_t user_defined_layer_capacity = 64;
+
+        // IO function codes are small (`console_io_*`, 1..8); anything larger shares the last slot.
+        static constexpr size_t function_slot_count = 10;
+
+        [[nodiscard]] static std::expected<std::unique_ptr<ApiMetrics>, DeviceCommError> create() noexcept;
+
+        ApiMetrics(const ApiMetrics&) = delete;
+        ApiMetrics& operator=(const ApiMetrics&) = delete;
+
+        [[nodiscard]] static uint64_t now_ticks() noexcept
+        {
+            LARGE_INTEGER counter{};
+            (void)::QueryPerformanceCounter(&counter);
+            return static_cast<uint64_t>(counter.QuadPart);
+        }
+
+        [[nodiscard]] static constexpr size_t latency_bucket_for(const uint64_t ticks) noexcept
+        {
+            const auto bucket = static_cast<size_t>(std::bit_width(ticks));
+            return bucket < latency_bucket_count ? bucket : latency_bucket_count - 1;
+        }
+
+        // Exclusive upper bound of `bucket` in ticks (`UINT64_MAX` for the open-ended last bucket).
+        [[nodiscard]] static constexpr uint64_t latency_bucket_limit(const size_t bucket) noexcept
+        {
+            return bucket + 1 < latency_bucket_count ? (uint64_t{ 1 } << bucket) : UINT64_MAX;
+        }
+
+        // `api_number` is only meaningful for `console_io_user_defined`.
+        void record_completed(ULONG function, ULONG api_number, uint64_t ticks, uint64_t bytes_in, uint64_t bytes_out) noexcept;
+        void record_reply_pending(ULONG function, ULONG api_number, uint64_t ticks) noexcept;
+
+        // USER_DEFINED requests whose `ApiNumber` falls outside the table share one slot, reported
+        // under this key.
+        static constexpr ULONG unknown_api_number = 0xFFFF'FFFF;
+
+        [[nodiscard]] const Counters& find(ULONG function, ULONG api_number) const noexcept;
+
+        // Calls `fn(function, api_number, counters)` for every slot that saw at least one attempt.
+        template<typename Fn>
+        void for_each(Fn&& fn) const
+        {
+            for (size_t function = 0; function < _functions.size(); ++function)
+            {
+                if (is_used(_functions[function]))
+                {
+                    fn(static_cast<ULONG>(function), ULONG{ 0 }, _functions[function]);
+                }
+            }
+
+            for (size_t layer = 0; layer < user_defined_layer_count; ++layer)
+            {
+                for (size_t index = 0; index < user_defined_layer_capacity; ++index)
+                {
+                    const auto& counters = _user_defined[layer][index];
+                    if (is_used(counters))
+                    {
+                        fn(user_defined_function, static_cast<ULONG>((layer << 24) | index), counters);
+                    }
+                }
+            }
+
+            if (is_used(_unknown_api))
+            {
+                fn(user_defined_function, unknown_api_number, _unknown_api);
+            }
+        }
+
+        void reset() noexcept;
+
+    private:
+        ApiMetrics() noexcept = default;
+
+        // `console_io_user_defined`; duplicated so this header does not pull in the protocol header.
+        static constexpr ULONG user_defined_function = 0x07;
+
+        [[nodiscard]] static bool is_used(const Counters& counters) noexcept
+        {
+            return counters.calls != 0 || counters.reply_pending != 0;
+        }
+
+        [[nodiscard]] Counters& slot(ULONG function, ULONG api_number) noexcept;
+        [[nodiscard]] const Counters& slot(ULONG function, ULONG api_number) const noexcept;
+
+        static void record_latency(Counters& counters, const uint64_t ticks) noexcept
+        {
+            counters.total_ticks += ticks;
+            if (ticks > counters.max_ticks)
+            {
+                counters.max_ticks = ticks;
+            }
+            ++counters.latency_buckets[latency_bucket_for(ticks)];
+        }
+
+        std::array<Counters, function_slot_count> _functions{};
+        std::array<std::array<Counters, user_defined_layer_capacity>, user_defined_layer_count> _user_defined{};
+        Counters _unknown_api{};
+    };
+
+    // Short name for a request kind (`WriteConsole`, `connect`, ...); empty when unknown.
+    [[nodiscard]] std::wstring_view condrv_api_name(ULONG function, ULONG api_number) noexcept;
+
+    // Appends one JSON object per used slot to `out`, each terminated by `\n`:
+    // `{"api":"WriteConsole","function":7,"api_number":16777222,"calls":..,"reply_pending":..,
+    //   "bytes_in":..,"bytes_out":..,"mean_ns":..,"max_ns":..,"p50_ns":..,"p90_ns":..,"p99_ns":..,
+    //   "buckets":[[limit_ns,count],...]}`.
+    // Percentiles are bucket upper bounds. `ticks_per_second` converts ticks to nanoseconds.
+    [[nodiscard]] std::expected<void, DeviceCommError> format_api_metrics_json(
+        const ApiMetrics& metrics,
+        uint64_t ticks_per_second,
+        std::wstring& out) noexcept;
+}
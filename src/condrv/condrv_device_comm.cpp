@@ -1,6 +1,7 @@
 #include "condrv/condrv_device_comm.hpp"
 
 #include "condrv/condrv_packet.hpp"
+#include "condrv/condrv_packet_trace.hpp"
 #include "core/assert.hpp"
 #include "core/win32_handle.hpp"
 
@@ -118,6 +119,12 @@ namespace oc::condrv
         {
             completion = reply;
             completion_size = sizeof(*reply);
+
+            // The driver takes the completion even when the wait for the next packet is canceled.
+            if (_trace != nullptr)
+            {
+                _trace->record_completion(*reply);
+            }
         }
 
         auto result = call_ioctl(
@@ -150,27 +157,44 @@ namespace oc::condrv
             return result;
         }
 
+        if (_trace != nullptr)
+        {
+            _trace->record_packet(out_packet);
+        }
+
         return {};
     }
 
     std::expected<void, DeviceCommError> ConDrvDeviceComm::complete_io(const IoComplete& completion) const noexcept
     {
-        return call_ioctl(
+        auto result = call_ioctl(
             ioctl_complete_io,
             const_cast<IoComplete*>(&completion),
             sizeof(completion),
             nullptr,
             0);
+        if (result && _trace != nullptr)
+        {
+            _trace->record_completion(completion);
+        }
+
+        return result;
     }
 
     std::expected<void, DeviceCommError> ConDrvDeviceComm::read_input(IoOperation& operation) const noexcept
     {
-        return call_ioctl(
+        auto result = call_ioctl(
             ioctl_read_input,
             &operation,
             sizeof(operation),
             nullptr,
             0);
+        if (result && _trace != nullptr)
+        {
+            _trace->record_input_payload(operation);
+        }
+
+        return result;
     }
 
     std::expected<void, DeviceCommError> ConDrvDeviceComm::write_output(IoOperation& operation) const noexcept
@@ -182,4 +206,9 @@ namespace oc::condrv
             nullptr,
             0);
     }
+
+    void ConDrvDeviceComm::set_packet_trace(PacketTraceWriter* const trace) noexcept
+    {
+        _trace = trace;
+    }
 }
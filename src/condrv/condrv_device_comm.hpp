@@ -12,6 +12,7 @@
 namespace oc::condrv
 {
     struct IoPacket;
+    class PacketTraceWriter;
 
     struct DeviceCommError final
     {
@@ -53,6 +54,10 @@ namespace oc::condrv
         [[nodiscard]] std::expected<void, DeviceCommError> read_input(IoOperation& operation) const noexcept;
         [[nodiscard]] std::expected<void, DeviceCommError> write_output(IoOperation& operation) const noexcept;
 
+        // Records packets, input payloads and completions into `trace` (or stops recording when
+        // null). The writer must outlive every call made through this comm.
+        void set_packet_trace(PacketTraceWriter* trace) noexcept;
+
     private:
         explicit ConDrvDeviceComm(core::UniqueHandle server) noexcept;
 
@@ -64,5 +69,6 @@ namespace oc::condrv
             DWORD out_buffer_size) const noexcept;
 
         core::UniqueHandle _server;
+        PacketTraceWriter* _trace{ nullptr };
     };
 }
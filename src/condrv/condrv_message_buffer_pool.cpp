@@ -0,0 +1,212 @@
+#include "condrv/condrv_message_buffer_pool.hpp"
+
+#include <bit>
+#include <new>
+#include <utility>
+
+namespace oc::condrv
+{
+    namespace
+    {
+        // Marks storage that is not cached (oversize or unpooled) and is freed on release.
+        constexpr size_t uncached_size_class = MessageBufferPool::class_count;
+
+        [[nodiscard]] std::byte* allocate_bytes(const size_t capacity) noexcept
+        {
+            return new (std::nothrow) std::byte[capacity];
+        }
+
+        [[nodiscard]] DeviceCommError allocation_failure() noexcept
+        {
+            return DeviceCommError{
+                .context = L"Failed to allocate ConDrv message buffer",
+                .win32_error = ERROR_OUTOFMEMORY,
+            };
+        }
+    }
+
+    PooledBuffer::PooledBuffer(
+        MessageBufferPool* const pool,
+        std::byte* const data,
+        const size_t size,
+        const size_t capacity,
+        const size_t size_class) noexcept :
+        _pool(pool),
+        _data(data),
+        _size(size),
+        _capacity(capacity),
+        _size_class(size_class)
+    {
+    }
+
+    PooledBuffer::~PooledBuffer() noexcept
+    {
+        reset();
+    }
+
+    PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept :
+        _pool(std::exchange(other._pool, nullptr)),
+        _data(std::exchange(other._data, nullptr)),
+        _size(std::exchange(other._size, 0)),
+        _capacity(std::exchange(other._capacity, 0)),
+        _size_class(std::exchange(other._size_class, 0))
+    {
+    }
+
+    PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            _pool = std::exchange(other._pool, nullptr);
+            _data = std::exchange(other._data, nullptr);
+            _size = std::exchange(other._size, 0);
+            _capacity = std::exchange(other._capacity, 0);
+            _size_class = std::exchange(other._size_class, 0);
+        }
+
+        return *this;
+    }
+
+    void PooledBuffer::reset() noexcept
+    {
+        if (_data != nullptr)
+        {
+            if (_pool != nullptr)
+            {
+                _pool->recycle(_data, _size_class);
+            }
+            else
+            {
+                delete[] _data;
+            }
+        }
+
+        _pool = nullptr;
+        _data = nullptr;
+        _size = 0;
+        _capacity = 0;
+        _size_class = 0;
+    }
+
+    MessageBufferPool::~MessageBufferPool() noexcept
+    {
+        trim();
+    }
+
+    size_t MessageBufferPool::size_class_for(const size_t size) noexcept
+    {
+        if (size > max_class_bytes)
+        {
+            return uncached_size_class;
+        }
+
+        if (size <= min_class_bytes)
+        {
+            return 0;
+        }
+
+        // Round up to the next power of two, then index relative to `min_class_bytes`.
+        const size_t rounded = std::bit_ceil(size);
+        return static_cast<size_t>(std::countr_zero(rounded) - std::countr_zero(min_class_bytes));
+    }
+
+    std::expected<PooledBuffer, DeviceCommError> MessageBufferPool::acquire(const size_t size) noexcept
+    {
+        if (size == 0)
+        {
+            return PooledBuffer{};
+        }
+
+        ++_statistics.acquires;
+
+        const size_t size_class = size_class_for(size);
+        if (size_class == uncached_size_class)
+        {
+            auto* const data = allocate_bytes(size);
+            if (data == nullptr)
+            {
+                return std::unexpected(allocation_failure());
+            }
+
+            ++_statistics.heap_allocations;
+            ++_statistics.oversize_allocations;
+            return PooledBuffer(this, data, size, size, uncached_size_class);
+        }
+
+        const size_t capacity = min_class_bytes << size_class;
+        if (size_t& count = _free_count[size_class]; count != 0)
+        {
+            --count;
+            auto* const data = std::exchange(_free[size_class][count], nullptr);
+            ++_statistics.pool_hits;
+            return PooledBuffer(this, data, size, capacity, size_class);
+        }
+
+        auto* const data = allocate_bytes(capacity);
+        if (data == nullptr)
+        {
+            return std::unexpected(allocation_failure());
+        }
+
+        ++_statistics.heap_allocations;
+        return PooledBuffer(this, data, size, capacity, size_class);
+    }
+
+    std::expected<PooledBuffer, DeviceCommError> MessageBufferPool::acquire_unpooled(const size_t size) noexcept
+    {
+        if (size == 0)
+        {
+            return PooledBuffer{};
+        }
+
+        auto* const data = allocate_bytes(size);
+        if (data == nullptr)
+        {
+            return std::unexpected(allocation_failure());
+        }
+
+        return PooledBuffer(nullptr, data, size, size, uncached_size_class);
+    }
+
+    void MessageBufferPool::recycle(std::byte* const data, const size_t size_class) noexcept
+    {
+        if (size_class < class_count)
+        {
+            if (size_t& count = _free_count[size_class]; count < max_cached_per_class)
+            {
+                _free[size_class][count] = data;
+                ++count;
+                return;
+            }
+        }
+
+        delete[] data;
+        ++_statistics.heap_frees;
+    }
+
+    void MessageBufferPool::trim() noexcept
+    {
+        for (size_t size_class = 0; size_class < class_count; ++size_class)
+        {
+            for (size_t i = 0; i < _free_count[size_class]; ++i)
+            {
+                delete[] std::exchange(_free[size_class][i], nullptr);
+                ++_statistics.heap_frees;
+            }
+
+            _free_count[size_class] = 0;
+        }
+    }
+
+    size_t MessageBufferPool::cached_buffer_count() const noexcept
+    {
+        size_t total = 0;
+        for (const size_t count : _free_count)
+        {
+            total += count;
+        }
+
+        return total;
+    }
+}
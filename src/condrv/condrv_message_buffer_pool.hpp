@@ -0,0 +1,138 @@
+#pragma once
+
+// Size-classed byte buffer pool for ConDrv message payloads.
+//
+// `BasicApiMessage` needs a fresh input buffer (READ_INPUT payload) and output buffer
+// (WRITE_OUTPUT payload) for most USER_DEFINED and RAW packets. Allocating those from the
+// heap per packet makes chatty clients (one WriteConsole per line, ReadConsole per key)
+// pay several allocations per round-trip.
+//
+// The pool keeps a bounded free list per power-of-two size class. Buffers are handed out as
+// move-only `PooledBuffer` handles that return their storage when destroyed or reset, so a
+// reply-pending message keeps its buffers until it finally completes and then recycles them.
+//
+// Threading: a pool is owned by the server loop and is not thread-safe.
+// Lifetime: a pool must outlive every `PooledBuffer` it handed out.
+
+#include "condrv/condrv_device_comm.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+
+namespace oc::condrv
+{
+    class MessageBufferPool;
+
+    class PooledBuffer final
+    {
+    public:
+        PooledBuffer() noexcept = default;
+        ~PooledBuffer() noexcept;
+
+        PooledBuffer(const PooledBuffer&) = delete;
+        PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+        PooledBuffer(PooledBuffer&& other) noexcept;
+        PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+
+        [[nodiscard]] std::byte* data() const noexcept
+        {
+            return _data;
+        }
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            return _size;
+        }
+
+        [[nodiscard]] size_t capacity() const noexcept
+        {
+            return _capacity;
+        }
+
+        [[nodiscard]] std::span<std::byte> span() const noexcept
+        {
+            return std::span<std::byte>(_data, _size);
+        }
+
+        // Returns the storage to its pool (or frees it when unpooled) and leaves the handle empty.
+        void reset() noexcept;
+
+    private:
+        friend class MessageBufferPool;
+
+        PooledBuffer(MessageBufferPool* pool, std::byte* data, size_t size, size_t capacity, size_t size_class) noexcept;
+
+        MessageBufferPool* _pool{ nullptr };
+        std::byte* _data{ nullptr };
+        size_t _size{ 0 };
+        size_t _capacity{ 0 };
+        size_t _size_class{ 0 };
+    };
+
+    class MessageBufferPool final
+    {
+    public:
+        struct Statistics final
+        {
+            uint64_t acquires{};
+            uint64_t pool_hits{};
+            uint64_t heap_allocations{};
+            uint64_t heap_frees{};
+            uint64_t oversize_allocations{};
+        };
+
+        // Size classes are 256 B, 512 B, ..., 1 MiB. Larger requests are allocated exactly and freed on release.
+        static constexpr size_t min_class_bytes = 256;
+        static constexpr size_t class_count = 13;
+        static constexpr size_t max_class_bytes = min_class_bytes << (class_count - 1);
+        static constexpr size_t max_cached_per_class = 8;
+
+        MessageBufferPool() noexcept = default;
+        ~MessageBufferPool() noexcept;
+
+        MessageBufferPool(const MessageBufferPool&) = delete;
+        MessageBufferPool& operator=(const MessageBufferPool&) = delete;
+        MessageBufferPool(MessageBufferPool&&) = delete;
+        MessageBufferPool& operator=(MessageBufferPool&&) = delete;
+
+        // Returns a buffer of exactly `size` bytes with unspecified contents.
+        // A zero-sized request returns an empty handle without touching the heap.
+        [[nodiscard]] std::expected<PooledBuffer, DeviceCommError> acquire(size_t size) noexcept;
+
+        // Same contract as `acquire`, but the storage is freed on release instead of being cached.
+        [[nodiscard]] static std::expected<PooledBuffer, DeviceCommError> acquire_unpooled(size_t size) noexcept;
+
+        // Frees every cached buffer. Buffers currently handed out are unaffected.
+        void trim() noexcept;
+
+        [[nodiscard]] const Statistics& statistics() const noexcept
+        {
+            return _statistics;
+        }
+
+        [[nodiscard]] size_t cached_buffer_count() const noexcept;
+
+        [[nodiscard]] static size_t size_class_for(size_t size) noexcept;
+
+    private:
+        friend class PooledBuffer;
+
+        void recycle(std::byte* data, size_t size_class) noexcept;
+
+        std::array<std::array<std::byte*, max_cached_per_class>, class_count> _free{};
+        std::array<size_t, class_count> _free_count{};
+        Statistics _statistics{};
+    };
+
+    // Acquires from `pool` when provided, otherwise falls back to an unpooled heap buffer.
+    [[nodiscard]] inline std::expected<PooledBuffer, DeviceCommError> acquire_message_buffer(
+        MessageBufferPool* const pool,
+        const size_t size) noexcept
+    {
+        return pool != nullptr ? pool->acquire(size) : MessageBufferPool::acquire_unpooled(size);
+    }
+}
@@ -0,0 +1,451 @@
+#include "condrv/condrv_packet_replay.hpp"
+
+#include "condrv/condrv_server.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <unordered_map>
+#include <utility>
+
+namespace oc::condrv
+{
+    namespace
+    {
+        [[nodiscard]] uint64_t identifier_key(const LUID& identifier) noexcept
+        {
+            return (static_cast<uint64_t>(static_cast<uint32_t>(identifier.HighPart)) << 32) | identifier.LowPart;
+        }
+
+        [[nodiscard]] uint64_t query_ticks() noexcept
+        {
+            LARGE_INTEGER counter{};
+            (void)::QueryPerformanceCounter(&counter);
+            return static_cast<uint64_t>(counter.QuadPart);
+        }
+
+        // For each packet record: the input payload records read for it, and the completion
+        // the captured server replied with. Identifiers are only unique among in-flight IOs, so
+        // each payload/completion binds to the latest packet with the same identifier.
+        struct PacketLinks final
+        {
+            std::vector<const PacketTraceRecord*> inputs;
+            const PacketTraceRecord* completion{ nullptr };
+        };
+
+        [[nodiscard]] std::vector<PacketLinks> link_packet_records(const PacketTrace& trace)
+        {
+            std::vector<PacketLinks> links(trace.records.size());
+            std::unordered_map<uint64_t, size_t> in_flight;
+            for (size_t index = 0; index < trace.records.size(); ++index)
+            {
+                const auto& record = trace.records[index];
+                switch (record.kind)
+                {
+                case PacketTraceRecordKind::packet:
+                    in_flight[identifier_key(record.packet.descriptor.identifier)] = index;
+                    break;
+                case PacketTraceRecordKind::input_payload:
+                    if (const auto found = in_flight.find(identifier_key(record.identifier)); found != in_flight.end())
+                    {
+                        links[found->second].inputs.push_back(&record);
+                    }
+                    break;
+                case PacketTraceRecordKind::completion:
+                    if (const auto found = in_flight.find(identifier_key(record.identifier)); found != in_flight.end())
+                    {
+                        links[found->second].completion = &record;
+                        in_flight.erase(found);
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            return links;
+        }
+
+        class ReplayComm final
+        {
+        public:
+            void bind_inputs(const LUID& identifier, const std::vector<const PacketTraceRecord*>& inputs)
+            {
+                _inputs[identifier_key(identifier)] = &inputs;
+            }
+
+            [[nodiscard]] size_t missing_input_payloads() const noexcept
+            {
+                return _missing_input_payloads;
+            }
+
+            [[nodiscard]] std::expected<void, DeviceCommError> read_input(IoOperation& operation) noexcept
+            {
+                if (const auto found = _inputs.find(identifier_key(operation.identifier)); found != _inputs.end())
+                {
+                    for (const auto* const record : *found->second)
+                    {
+                        if (record->offset != operation.buffer.offset || record->bytes.size() < operation.buffer.size)
+                        {
+                            continue;
+                        }
+
+                        if (operation.buffer.size != 0)
+                        {
+                            std::memcpy(operation.buffer.data, record->bytes.data(), operation.buffer.size);
+                        }
+                        return {};
+                    }
+                }
+
+                ++_missing_input_payloads;
+                return std::unexpected(DeviceCommError{
+                    .context = L"Packet trace has no input payload for this read",
+                    .win32_error = ERROR_NOT_FOUND,
+                });
+            }
+
+            [[nodiscard]] std::expected<void, DeviceCommError> write_output(IoOperation& /*operation*/) noexcept
+            {
+                return {};
+            }
+
+            [[nodiscard]] std::expected<void, DeviceCommError> complete_io(const IoComplete& /*completion*/) noexcept
+            {
+                return {};
+            }
+
+        private:
+            std::unordered_map<uint64_t, const std::vector<const PacketTraceRecord*>*> _inputs;
+            size_t _missing_input_payloads{ 0 };
+        };
+
+        // Host side of the replay: an in-memory input queue filled from `host_input` records and
+        // an output sink that only counts bytes.
+        class ReplayHostIo final
+        {
+        public:
+            explicit ReplayHostIo(const bool answer_queries) noexcept :
+                _answer_queries(answer_queries)
+            {
+            }
+
+            void push_input(const std::span<const std::byte> bytes)
+            {
+                if (_read_offset == _input.size())
+                {
+                    _input.clear();
+                    _read_offset = 0;
+                }
+
+                _input.insert(_input.end(), bytes.begin(), bytes.end());
+            }
+
+            void mark_disconnected() noexcept
+            {
+                _disconnected = true;
+            }
+
+            [[nodiscard]] uint64_t output_bytes() const noexcept
+            {
+                return _output_bytes;
+            }
+
+            [[nodiscard]] std::expected<size_t, DeviceCommError> write_output_bytes(const std::span<const std::byte> bytes) noexcept
+            {
+                _output_bytes += bytes.size();
+                return bytes.size();
+            }
+
+            [[nodiscard]] std::expected<size_t, DeviceCommError> read_input_bytes(const std::span<std::byte> dest) noexcept
+            {
+                const size_t copied = copy_input(dest);
+                _read_offset += copied;
+                return copied;
+            }
+
+            [[nodiscard]] std::expected<size_t, DeviceCommError> peek_input_bytes(const std::span<std::byte> dest) noexcept
+            {
+                return copy_input(dest);
+            }
+
+            [[nodiscard]] size_t input_bytes_available() const noexcept
+            {
+                return _input.size() - _read_offset;
+            }
+
+            [[nodiscard]] bool input_disconnected() const noexcept
+            {
+                return _disconnected;
+            }
+
+            [[nodiscard]] bool inject_input_bytes(const std::span<const std::byte> bytes) noexcept
+            {
+                try
+                {
+                    push_input(bytes);
+                    return true;
+                }
+                catch (...)
+                {
+                    return false;
+                }
+            }
+
+            [[nodiscard]] bool vt_should_answer_queries() const noexcept
+            {
+                return _answer_queries;
+            }
+
+            [[nodiscard]] std::expected<void, DeviceCommError> flush_input_buffer() noexcept
+            {
+                _input.clear();
+                _read_offset = 0;
+                return {};
+            }
+
+            [[nodiscard]] std::expected<bool, DeviceCommError> wait_for_input(const DWORD /*timeout_ms*/) noexcept
+            {
+                return input_bytes_available() != 0;
+            }
+
+            [[nodiscard]] std::expected<void, DeviceCommError> send_end_task(
+                const DWORD /*process_id*/,
+                const DWORD /*event_type*/,
+                const DWORD /*ctrl_flags*/) noexcept
+            {
+                return {};
+            }
+
+        private:
+            [[nodiscard]] size_t copy_input(const std::span<std::byte> dest) const noexcept
+            {
+                const size_t count = std::min(dest.size(), input_bytes_available());
+                if (count != 0)
+                {
+                    std::memcpy(dest.data(), _input.data() + _read_offset, count);
+                }
+                return count;
+            }
+
+            std::vector<std::byte> _input;
+            size_t _read_offset{ 0 };
+            uint64_t _output_bytes{ 0 };
+            bool _disconnected{ false };
+            bool _answer_queries{ true };
+        };
+
+        using ReplayMessage = BasicApiMessage<ReplayComm>;
+
+        class HandleMap final
+        {
+        public:
+            void add(const ULONG_PTR captured, const ULONG_PTR replayed)
+            {
+                if (captured != 0)
+                {
+                    _handles[captured] = replayed;
+                }
+            }
+
+            [[nodiscard]] ULONG_PTR translate(const ULONG_PTR captured) const noexcept
+            {
+                const auto found = _handles.find(captured);
+                return found != _handles.end() ? found->second : captured;
+            }
+
+        private:
+            std::unordered_map<ULONG_PTR, ULONG_PTR> _handles;
+        };
+
+        [[nodiscard]] IoPacket translate_packet(const IoPacket& captured, const HandleMap& handles) noexcept
+        {
+            IoPacket packet = captured;
+            // Connect packets carry the client PID/TID, not handles.
+            if (packet.descriptor.function != console_io_connect)
+            {
+                packet.descriptor.process = handles.translate(packet.descriptor.process);
+                packet.descriptor.object = handles.translate(packet.descriptor.object);
+            }
+            return packet;
+        }
+
+        // Pairs the handles a connect/create-object completion returned in the capture with the
+        // ones the replay just created.
+        void learn_handles(HandleMap& handles, const IoPacket& packet, ReplayMessage& message, const PacketTraceRecord* const captured)
+        {
+            if (captured == nullptr || !nt_success(captured->status) || !nt_success(message.completion().io_status.Status))
+            {
+                return;
+            }
+
+            switch (packet.descriptor.function)
+            {
+            case console_io_connect:
+            {
+                const auto& write = message.completion().write;
+                if (write.data == nullptr || write.size != sizeof(ConnectionInformation) ||
+                    captured->bytes.size() != sizeof(ConnectionInformation))
+                {
+                    return;
+                }
+
+                ConnectionInformation captured_info{};
+                ConnectionInformation replayed_info{};
+                std::memcpy(&captured_info, captured->bytes.data(), sizeof(captured_info));
+                std::memcpy(&replayed_info, write.data, sizeof(replayed_info));
+                handles.add(captured_info.process, replayed_info.process);
+                handles.add(captured_info.input, replayed_info.input);
+                handles.add(captured_info.output, replayed_info.output);
+                return;
+            }
+            case console_io_create_object:
+                handles.add(
+                    static_cast<ULONG_PTR>(captured->information),
+                    static_cast<ULONG_PTR>(message.completion().io_status.Information));
+                return;
+            default:
+                return;
+            }
+        }
+
+        void add_sample(PacketReplayResult& result, ReplayMessage& message, const uint64_t ticks)
+        {
+            const auto& packet = message.packet();
+            PacketReplaySample sample{};
+            sample.function = packet.descriptor.function;
+            if (sample.function == console_io_user_defined)
+            {
+                sample.api_number = packet.payload.user_defined.msg_header.ApiNumber;
+            }
+            sample.status = message.completion().io_status.Status;
+            sample.ticks = ticks;
+            result.samples.push_back(sample);
+        }
+
+        [[nodiscard]] std::expected<void, DeviceCommError> replay(const PacketTrace& trace, PacketReplayResult& result)
+        {
+            const auto links = link_packet_records(trace);
+
+            ServerState state{};
+            ReplayComm comm{};
+            ReplayHostIo host_io((trace.flags & packet_trace_flag_host_output) == 0);
+            BasicWaitQueueFor<ReplayComm> waiters;
+            HandleMap handles;
+
+            // Mirrors `service_pending` in the server loop, minus the one-reply-per-READ_IO limit.
+            const auto service_waiters = [&]() -> std::expected<void, DeviceCommError> {
+                while (!waiters.empty())
+                {
+                    const uint64_t start = query_ticks();
+                    auto completed = service_wait_queue(state, waiters, host_io);
+                    const uint64_t elapsed = query_ticks() - start;
+                    result.dispatch_ticks += elapsed;
+                    if (!completed)
+                    {
+                        return std::unexpected(completed.error());
+                    }
+
+                    if (!completed->has_value())
+                    {
+                        return {};
+                    }
+
+                    add_sample(result, **completed, elapsed);
+                    (void)(*completed)->release_message_buffers();
+                }
+
+                return {};
+            };
+
+            result.samples.reserve(result.samples.size() + trace.records.size());
+            for (size_t index = 0; index < trace.records.size(); ++index)
+            {
+                const auto& record = trace.records[index];
+                if (record.kind == PacketTraceRecordKind::host_input)
+                {
+                    host_io.push_input(record.bytes);
+                    result.host_input_bytes += record.bytes.size();
+                    waiters.signal_input_available();
+                    if (auto serviced = service_waiters(); !serviced)
+                    {
+                        return serviced;
+                    }
+                    continue;
+                }
+
+                if (record.kind != PacketTraceRecordKind::packet)
+                {
+                    continue;
+                }
+
+                ++result.packets;
+                const IoPacket packet = translate_packet(record.packet, handles);
+                comm.bind_inputs(packet.descriptor.identifier, links[index].inputs);
+
+                ReplayMessage message(comm, packet);
+                const uint64_t start = query_ticks();
+                auto outcome = dispatch_message(state, message, host_io);
+                const uint64_t elapsed = query_ticks() - start;
+                result.dispatch_ticks += elapsed;
+                if (!outcome)
+                {
+                    return std::unexpected(outcome.error());
+                }
+
+                if (outcome->reply_pending)
+                {
+                    ++result.reply_pending;
+                    if (auto parked = park_reply_pending(waiters, std::move(message)); !parked)
+                    {
+                        return std::unexpected(parked.error());
+                    }
+                    continue;
+                }
+
+                add_sample(result, message, elapsed);
+                learn_handles(handles, packet, message, links[index].completion);
+                (void)message.release_message_buffers();
+
+                signal_waiters_after_dispatch(waiters, packet);
+                if (auto serviced = service_waiters(); !serviced)
+                {
+                    return serviced;
+                }
+            }
+
+            // The capture ended; let parked reads observe the disconnect like they would at shutdown.
+            host_io.mark_disconnected();
+            waiters.signal_input_disconnected();
+            if (auto serviced = service_waiters(); !serviced)
+            {
+                return serviced;
+            }
+            waiters.clear();
+
+            result.missing_input_payloads = comm.missing_input_payloads();
+            result.host_output_bytes = host_io.output_bytes();
+            return {};
+        }
+    }
+
+    std::expected<PacketReplayResult, DeviceCommError> replay_packet_trace(const PacketTrace& trace) noexcept
+    {
+        try
+        {
+            PacketReplayResult result{};
+            if (auto replayed = replay(trace, result); !replayed)
+            {
+                return std::unexpected(replayed.error());
+            }
+            return result;
+        }
+        catch (...)
+        {
+            return std::unexpected(DeviceCommError{
+                .context = L"Failed to allocate packet replay state",
+                .win32_error = ERROR_OUTOFMEMORY,
+            });
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// Deterministic replay of a captured packet trace (`condrv/condrv_packet_trace.hpp`).
+//
+// The replay feeds every captured packet through `dispatch_message` against a fresh
+// `ServerState`, using an in-memory comm that serves `READ_INPUT` from the captured input
+// payloads and discards replies, and an in-memory host whose input queue is filled from the
+// captured host input records in trace order. Reply-pending requests are parked in a
+// `BasicWaitQueue` and retried exactly as the server loop does.
+//
+// Process and object handles are heap addresses, so the ones the replay creates differ from
+// the captured ones. Connect and create-object completions in the trace pair the captured
+// handles with the replayed ones, and later packets are rewritten through that mapping.
+//
+// See `new/docs/design/condrv_packet_trace.md`.
+
+#include "condrv/condrv_packet_trace.hpp"
+
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <vector>
+
+namespace oc::condrv
+{
+    struct PacketReplaySample final
+    {
+        ULONG function{};
+        ULONG api_number{}; // `console_io_user_defined` packets only.
+        NTSTATUS status{};
+        uint64_t ticks{};   // QPC ticks spent dispatching the request until it completed.
+    };
+
+    struct PacketReplayResult final
+    {
+        size_t packets{};
+        size_t reply_pending{};
+        size_t missing_input_payloads{};
+        uint64_t host_input_bytes{};
+        uint64_t host_output_bytes{};
+
+        // All dispatch time, including wait-queue retries that pended again.
+        uint64_t dispatch_ticks{};
+
+        // One sample per completed request, in completion order.
+        std::vector<PacketReplaySample> samples;
+    };
+
+    [[nodiscard]] std::expected<PacketReplayResult, DeviceCommError> replay_packet_trace(const PacketTrace& trace) noexcept;
+}
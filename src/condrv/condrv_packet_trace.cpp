@@ -0,0 +1,442 @@
+#include "condrv/condrv_packet_trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace oc::condrv
+{
+    namespace
+    {
+        [[nodiscard]] DeviceCommError make_error(std::wstring context, const DWORD win32_error) noexcept
+        {
+            return DeviceCommError{
+                .context = std::move(context),
+                .win32_error = win32_error == 0 ? ERROR_GEN_FAILURE : win32_error,
+            };
+        }
+
+        [[nodiscard]] uint64_t query_ticks() noexcept
+        {
+            LARGE_INTEGER counter{};
+            (void)::QueryPerformanceCounter(&counter);
+            return static_cast<uint64_t>(counter.QuadPart);
+        }
+
+        [[nodiscard]] uint64_t query_ticks_per_second() noexcept
+        {
+            LARGE_INTEGER frequency{};
+            (void)::QueryPerformanceFrequency(&frequency);
+            return static_cast<uint64_t>(frequency.QuadPart);
+        }
+
+        template<typename T>
+        [[nodiscard]] std::span<const std::byte> as_bytes_of(const T& value) noexcept
+        {
+            return std::span<const std::byte>(reinterpret_cast<const std::byte*>(&value), sizeof(T));
+        }
+
+        [[nodiscard]] std::expected<void, DeviceCommError> write_all(const HANDLE file, const std::span<const std::byte> bytes) noexcept
+        {
+            size_t total_written = 0;
+            while (total_written < bytes.size())
+            {
+                const size_t remaining = bytes.size() - total_written;
+                const DWORD chunk = remaining > static_cast<size_t>(std::numeric_limits<DWORD>::max())
+                    ? std::numeric_limits<DWORD>::max()
+                    : static_cast<DWORD>(remaining);
+
+                DWORD written = 0;
+                if (::WriteFile(file, bytes.data() + total_written, chunk, &written, nullptr) == FALSE)
+                {
+                    return std::unexpected(make_error(L"WriteFile failed for packet trace", ::GetLastError()));
+                }
+
+                if (written == 0)
+                {
+                    return std::unexpected(make_error(L"WriteFile made no progress for packet trace", ERROR_WRITE_FAULT));
+                }
+
+                total_written += static_cast<size_t>(written);
+            }
+
+            return {};
+        }
+
+        template<typename T>
+        [[nodiscard]] T read_pod(const std::span<const std::byte> bytes) noexcept
+        {
+            T value{};
+            std::memcpy(&value, bytes.data(), sizeof(T));
+            return value;
+        }
+    }
+
+    size_t packet_trace_packet_size(const IoPacket& packet) noexcept
+    {
+        constexpr size_t descriptor_size = offsetof(IoPacket, payload);
+        switch (packet.descriptor.function)
+        {
+        case console_io_create_object:
+            return descriptor_size + sizeof(CreateObjectPacket);
+        case console_io_user_defined:
+        {
+            const size_t api_size = std::min<size_t>(
+                packet.payload.user_defined.msg_header.ApiDescriptorSize,
+                sizeof(packet.payload.user_defined.u));
+            return descriptor_size + offsetof(UserDefinedPacket, u) + api_size;
+        }
+        default:
+            return descriptor_size;
+        }
+    }
+
+    std::expected<std::wstring, DeviceCommError> resolve_packet_trace_path(const std::wstring_view directory) noexcept
+    {
+        if (directory.empty())
+        {
+            return std::unexpected(make_error(L"Packet trace directory was empty", ERROR_INVALID_PARAMETER));
+        }
+
+        try
+        {
+            std::wstring path(directory);
+            // Best-effort: an existing directory is the common case, and `CreateFileW` reports
+            // anything else.
+            (void)::CreateDirectoryW(path.c_str(), nullptr);
+
+            if (path.back() != L'\\' && path.back() != L'/')
+            {
+                path.push_back(L'\\');
+            }
+            path.append(L"condrv_");
+            path.append(std::to_wstring(::GetCurrentProcessId()));
+            path.append(L".octrace");
+            return path;
+        }
+        catch (...)
+        {
+            return std::unexpected(make_error(L"Failed to build packet trace path", ERROR_OUTOFMEMORY));
+        }
+    }
+
+    std::expected<std::unique_ptr<PacketTraceWriter>, DeviceCommError> PacketTraceWriter::create(
+        const std::wstring& path,
+        const uint32_t flags) noexcept
+    {
+        core::UniqueHandle file(::CreateFileW(
+            path.c_str(),
+            GENERIC_WRITE,
+            FILE_SHARE_READ,
+            nullptr,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr));
+        if (!file.valid())
+        {
+            return std::unexpected(make_error(L"CreateFileW failed for packet trace", ::GetLastError()));
+        }
+
+        PacketTraceFileHeader header{};
+        header.flags = flags;
+        header.ticks_per_second = query_ticks_per_second();
+        if (auto written = write_all(file.get(), as_bytes_of(header)); !written)
+        {
+            return std::unexpected(written.error());
+        }
+
+        try
+        {
+            return std::unique_ptr<PacketTraceWriter>(new PacketTraceWriter(std::move(file), query_ticks()));
+        }
+        catch (...)
+        {
+            return std::unexpected(make_error(L"Failed to allocate packet trace writer", ERROR_OUTOFMEMORY));
+        }
+    }
+
+    PacketTraceWriter::PacketTraceWriter(core::UniqueHandle file, const uint64_t start_ticks) noexcept :
+        _file(std::move(file)),
+        _start_ticks(start_ticks)
+    {
+    }
+
+    PacketTraceWriter::~PacketTraceWriter() noexcept
+    {
+        std::scoped_lock lock(_mutex);
+        (void)flush_locked();
+    }
+
+    void PacketTraceWriter::record_packet(const IoPacket& packet) noexcept
+    {
+        const auto bytes = as_bytes_of(packet).first(packet_trace_packet_size(packet));
+        append_record(PacketTraceRecordKind::packet, {}, bytes);
+    }
+
+    void PacketTraceWriter::record_input_payload(const IoOperation& operation) noexcept
+    {
+        PacketTraceInputPayload prefix{};
+        prefix.identifier = operation.identifier;
+        prefix.offset = operation.buffer.offset;
+
+        std::span<const std::byte> data;
+        if (operation.buffer.data != nullptr)
+        {
+            data = std::span<const std::byte>(static_cast<const std::byte*>(operation.buffer.data), operation.buffer.size);
+        }
+
+        append_record(PacketTraceRecordKind::input_payload, as_bytes_of(prefix), data);
+    }
+
+    void PacketTraceWriter::record_completion(const IoComplete& completion) noexcept
+    {
+        PacketTraceCompletion prefix{};
+        prefix.identifier = completion.identifier;
+        prefix.status = completion.io_status.Status;
+        prefix.information = static_cast<uint64_t>(completion.io_status.Information);
+
+        std::span<const std::byte> write;
+        if (completion.write.data != nullptr)
+        {
+            write = std::span<const std::byte>(static_cast<const std::byte*>(completion.write.data), completion.write.size);
+        }
+
+        append_record(PacketTraceRecordKind::completion, as_bytes_of(prefix), write);
+    }
+
+    void PacketTraceWriter::record_host_input(const std::span<const std::byte> bytes) noexcept
+    {
+        if (bytes.empty())
+        {
+            return;
+        }
+
+        append_record(PacketTraceRecordKind::host_input, {}, bytes);
+    }
+
+    std::expected<void, DeviceCommError> PacketTraceWriter::flush() noexcept
+    {
+        std::scoped_lock lock(_mutex);
+        return flush_locked();
+    }
+
+    PacketTraceStatistics PacketTraceWriter::statistics() const noexcept
+    {
+        std::scoped_lock lock(_mutex);
+        return _statistics;
+    }
+
+    void PacketTraceWriter::append_record(
+        const PacketTraceRecordKind kind,
+        const std::span<const std::byte> prefix,
+        const std::span<const std::byte> body) noexcept
+    {
+        const uint64_t now = query_ticks();
+
+        std::scoped_lock lock(_mutex);
+        const size_t size = prefix.size() + body.size();
+        if (_failed || size > std::numeric_limits<uint32_t>::max())
+        {
+            ++_statistics.dropped_records;
+            return;
+        }
+
+        PacketTraceRecordHeader header{};
+        header.kind = kind;
+        header.size = static_cast<uint32_t>(size);
+        header.ticks = now - _start_ticks;
+
+        const size_t previous_size = _buffer.size();
+        try
+        {
+            const auto header_bytes = as_bytes_of(header);
+            _buffer.insert(_buffer.end(), header_bytes.begin(), header_bytes.end());
+            _buffer.insert(_buffer.end(), prefix.begin(), prefix.end());
+            _buffer.insert(_buffer.end(), body.begin(), body.end());
+        }
+        catch (...)
+        {
+            _buffer.resize(previous_size);
+            ++_statistics.dropped_records;
+            return;
+        }
+
+        ++_statistics.records;
+        _statistics.bytes += sizeof(header) + size;
+
+        if (_buffer.size() >= flush_threshold)
+        {
+            (void)flush_locked();
+        }
+    }
+
+    std::expected<void, DeviceCommError> PacketTraceWriter::flush_locked() noexcept
+    {
+        if (_failed || _buffer.empty())
+        {
+            return {};
+        }
+
+        auto written = write_all(_file.get(), _buffer);
+        _buffer.clear();
+        if (!written)
+        {
+            _failed = true;
+        }
+
+        return written;
+    }
+
+    std::expected<PacketTrace, DeviceCommError> parse_packet_trace(const std::span<const std::byte> bytes) noexcept
+    {
+        if (bytes.size() < sizeof(PacketTraceFileHeader))
+        {
+            return std::unexpected(make_error(L"Packet trace is shorter than its header", ERROR_INVALID_DATA));
+        }
+
+        const auto header = read_pod<PacketTraceFileHeader>(bytes);
+        if (header.magic != packet_trace_magic)
+        {
+            return std::unexpected(make_error(L"Packet trace magic mismatch", ERROR_INVALID_DATA));
+        }
+        if (header.version != packet_trace_version)
+        {
+            return std::unexpected(make_error(L"Unsupported packet trace version", ERROR_NOT_SUPPORTED));
+        }
+        if (header.packet_size != sizeof(IoPacket))
+        {
+            return std::unexpected(make_error(L"Packet trace was captured with a different IoPacket layout", ERROR_NOT_SUPPORTED));
+        }
+
+        try
+        {
+            PacketTrace trace{};
+            trace.flags = header.flags;
+            trace.ticks_per_second = header.ticks_per_second;
+
+            auto remaining = bytes.subspan(sizeof(PacketTraceFileHeader));
+            while (!remaining.empty())
+            {
+                if (remaining.size() < sizeof(PacketTraceRecordHeader))
+                {
+                    return std::unexpected(make_error(L"Packet trace ends inside a record header", ERROR_INVALID_DATA));
+                }
+
+                const auto record_header = read_pod<PacketTraceRecordHeader>(remaining);
+                remaining = remaining.subspan(sizeof(PacketTraceRecordHeader));
+                if (remaining.size() < record_header.size)
+                {
+                    return std::unexpected(make_error(L"Packet trace ends inside a record body", ERROR_INVALID_DATA));
+                }
+
+                const auto body = remaining.first(record_header.size);
+                remaining = remaining.subspan(record_header.size);
+
+                PacketTraceRecord record{};
+                record.kind = record_header.kind;
+                record.ticks = record_header.ticks;
+                switch (record_header.kind)
+                {
+                case PacketTraceRecordKind::packet:
+                    if (body.size() < sizeof(IoDescriptor) || body.size() > sizeof(IoPacket))
+                    {
+                        return std::unexpected(make_error(L"Packet trace packet record has an invalid size", ERROR_INVALID_DATA));
+                    }
+                    std::memcpy(&record.packet, body.data(), body.size());
+                    break;
+                case PacketTraceRecordKind::input_payload:
+                {
+                    if (body.size() < sizeof(PacketTraceInputPayload))
+                    {
+                        return std::unexpected(make_error(L"Packet trace input record is truncated", ERROR_INVALID_DATA));
+                    }
+                    const auto prefix = read_pod<PacketTraceInputPayload>(body);
+                    record.identifier = prefix.identifier;
+                    record.offset = prefix.offset;
+                    const auto data = body.subspan(sizeof(PacketTraceInputPayload));
+                    record.bytes.assign(data.begin(), data.end());
+                    break;
+                }
+                case PacketTraceRecordKind::completion:
+                {
+                    if (body.size() < sizeof(PacketTraceCompletion))
+                    {
+                        return std::unexpected(make_error(L"Packet trace completion record is truncated", ERROR_INVALID_DATA));
+                    }
+                    const auto prefix = read_pod<PacketTraceCompletion>(body);
+                    record.identifier = prefix.identifier;
+                    record.status = prefix.status;
+                    record.information = prefix.information;
+                    const auto write = body.subspan(sizeof(PacketTraceCompletion));
+                    record.bytes.assign(write.begin(), write.end());
+                    break;
+                }
+                case PacketTraceRecordKind::host_input:
+                    record.bytes.assign(body.begin(), body.end());
+                    break;
+                default:
+                    // Unknown record kinds from newer writers are skipped.
+                    continue;
+                }
+
+                trace.records.push_back(std::move(record));
+            }
+
+            return trace;
+        }
+        catch (...)
+        {
+            return std::unexpected(make_error(L"Failed to allocate packet trace records", ERROR_OUTOFMEMORY));
+        }
+    }
+
+    std::expected<PacketTrace, DeviceCommError> load_packet_trace(const std::wstring& path) noexcept
+    {
+        core::UniqueHandle file(::CreateFileW(
+            path.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr));
+        if (!file.valid())
+        {
+            return std::unexpected(make_error(L"CreateFileW failed for packet trace", ::GetLastError()));
+        }
+
+        LARGE_INTEGER size{};
+        if (::GetFileSizeEx(file.get(), &size) == FALSE)
+        {
+            return std::unexpected(make_error(L"GetFileSizeEx failed for packet trace", ::GetLastError()));
+        }
+        if (size.QuadPart < 0 || static_cast<uint64_t>(size.QuadPart) > std::numeric_limits<DWORD>::max())
+        {
+            return std::unexpected(make_error(L"Packet trace is too large to load", ERROR_FILE_TOO_LARGE));
+        }
+
+        std::vector<std::byte> bytes;
+        try
+        {
+            bytes.resize(static_cast<size_t>(size.QuadPart));
+        }
+        catch (...)
+        {
+            return std::unexpected(make_error(L"Failed to allocate packet trace buffer", ERROR_OUTOFMEMORY));
+        }
+
+        DWORD read = 0;
+        if (!bytes.empty() &&
+            ::ReadFile(file.get(), bytes.data(), static_cast<DWORD>(bytes.size()), &read, nullptr) == FALSE)
+        {
+            return std::unexpected(make_error(L"ReadFile failed for packet trace", ::GetLastError()));
+        }
+        if (read != bytes.size())
+        {
+            return std::unexpected(make_error(L"ReadFile returned a short packet trace", ERROR_HANDLE_EOF));
+        }
+
+        return parse_packet_trace(bytes);
+    }
+}
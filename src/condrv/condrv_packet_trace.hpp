@@ -0,0 +1,178 @@
+#pragma once
+
+// Binary capture of ConDrv server traffic for offline replay.
+//
+// A trace file is a `PacketTraceFileHeader` followed by records, each a
+// `PacketTraceRecordHeader` plus `size` body bytes:
+// - `packet`: an `IoPacket` returned by `IOCTL_CONDRV_READ_IO`, truncated to the bytes its
+//   function uses (descriptor, create-object payload, or API header plus API descriptor).
+// - `input_payload`: bytes returned by `IOCTL_CONDRV_READ_INPUT` (identifier, offset, data).
+// - `completion`: the status, information and completion-write bytes the server replied with.
+//   Replay uses these to map captured process/object handles onto the ones it creates.
+// - `host_input`: bytes the input monitor read from the host input pipe, in arrival order.
+//
+// Records carry QPC ticks relative to the start of the capture. The layout is native
+// (little-endian, pointer-sized handles), so a trace only replays on the architecture that
+// captured it; the file header stores `sizeof(IoPacket)` to reject mismatches.
+//
+// See `new/docs/design/condrv_packet_trace.md`.
+
+#include "condrv/condrv_device_comm.hpp"
+#include "condrv/condrv_packet.hpp"
+#include "core/unique_handle.hpp"
+
+#include <Windows.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace oc::condrv
+{
+    inline constexpr uint32_t packet_trace_magic = 0x5450434F; // "OCPT"
+    inline constexpr uint16_t packet_trace_version = 1;
+
+    // `PacketTraceFileHeader::flags`: the captured server forwarded output to a host pipe
+    // (ConPTY), which changes how VT queries are answered.
+    inline constexpr uint32_t packet_trace_flag_host_output = 0x1;
+
+    enum class PacketTraceRecordKind : uint8_t
+    {
+        packet = 1,
+        input_payload = 2,
+        completion = 3,
+        host_input = 4,
+    };
+
+    struct PacketTraceFileHeader final
+    {
+        uint32_t magic{ packet_trace_magic };
+        uint16_t version{ packet_trace_version };
+        uint16_t packet_size{ static_cast<uint16_t>(sizeof(IoPacket)) };
+        uint32_t flags{};
+        uint32_t reserved{};
+        uint64_t ticks_per_second{};
+    };
+
+    struct PacketTraceRecordHeader final
+    {
+        PacketTraceRecordKind kind{};
+        std::array<uint8_t, 3> reserved{};
+        uint32_t size{};
+        uint64_t ticks{};
+    };
+
+    // Body prefix of `input_payload` records; the data bytes follow.
+    struct PacketTraceInputPayload final
+    {
+        LUID identifier{};
+        ULONG offset{};
+        ULONG reserved{};
+    };
+
+    // Body prefix of `completion` records; the completion-write bytes follow.
+    struct PacketTraceCompletion final
+    {
+        LUID identifier{};
+        NTSTATUS status{};
+        ULONG reserved{};
+        uint64_t information{};
+    };
+
+    static_assert(sizeof(PacketTraceFileHeader) == 24, "Trace file header layout is part of the file format");
+    static_assert(sizeof(PacketTraceRecordHeader) == 16, "Trace record header layout is part of the file format");
+
+    // Number of leading `IoPacket` bytes a `packet` record stores for `packet`.
+    [[nodiscard]] size_t packet_trace_packet_size(const IoPacket& packet) noexcept;
+
+    // Resolves `<directory>\condrv_<pid>.octrace` for a capture started by this process.
+    [[nodiscard]] std::expected<std::wstring, DeviceCommError> resolve_packet_trace_path(std::wstring_view directory) noexcept;
+
+    struct PacketTraceStatistics final
+    {
+        uint64_t records{};
+        uint64_t bytes{};
+        uint64_t dropped_records{};
+    };
+
+    // Thread-safe trace writer. The server thread(s) record packets, input payloads and
+    // completions through `ConDrvDeviceComm`; the input monitor thread records host input.
+    //
+    // Capture is best-effort: after the first write failure the writer drops further records
+    // (counted in `statistics().dropped_records`) instead of failing the server loop.
+    class PacketTraceWriter final
+    {
+    public:
+        [[nodiscard]] static std::expected<std::unique_ptr<PacketTraceWriter>, DeviceCommError> create(
+            const std::wstring& path,
+            uint32_t flags) noexcept;
+
+        ~PacketTraceWriter() noexcept;
+
+        PacketTraceWriter(const PacketTraceWriter&) = delete;
+        PacketTraceWriter& operator=(const PacketTraceWriter&) = delete;
+
+        void record_packet(const IoPacket& packet) noexcept;
+        void record_input_payload(const IoOperation& operation) noexcept;
+        void record_completion(const IoComplete& completion) noexcept;
+        void record_host_input(std::span<const std::byte> bytes) noexcept;
+
+        // Writes buffered records to the file.
+        [[nodiscard]] std::expected<void, DeviceCommError> flush() noexcept;
+
+        [[nodiscard]] PacketTraceStatistics statistics() const noexcept;
+
+    private:
+        PacketTraceWriter(core::UniqueHandle file, uint64_t start_ticks) noexcept;
+
+        void append_record(
+            PacketTraceRecordKind kind,
+            std::span<const std::byte> prefix,
+            std::span<const std::byte> body) noexcept;
+        [[nodiscard]] std::expected<void, DeviceCommError> flush_locked() noexcept;
+
+        static constexpr size_t flush_threshold = 64 * 1024;
+
+        core::UniqueHandle _file;
+        uint64_t _start_ticks{};
+        mutable std::mutex _mutex;
+        std::vector<std::byte> _buffer;
+        PacketTraceStatistics _statistics{};
+        bool _failed{ false };
+    };
+
+    struct PacketTraceRecord final
+    {
+        PacketTraceRecordKind kind{};
+        uint64_t ticks{};
+
+        // `packet` records: the packet, zero-filled past the captured bytes.
+        IoPacket packet{};
+
+        // `input_payload` and `completion` records.
+        LUID identifier{};
+        ULONG offset{};
+        NTSTATUS status{};
+        uint64_t information{};
+
+        // Input payload data, completion-write bytes, or host input bytes.
+        std::vector<std::byte> bytes;
+    };
+
+    struct PacketTrace final
+    {
+        uint32_t flags{};
+        uint64_t ticks_per_second{};
+        std::vector<PacketTraceRecord> records;
+    };
+
+    [[nodiscard]] std::expected<PacketTrace, DeviceCommError> parse_packet_trace(std::span<const std::byte> bytes) noexcept;
+    [[nodiscard]] std::expected<PacketTrace, DeviceCommError> load_packet_trace(const std::wstring& path) noexcept;
+}
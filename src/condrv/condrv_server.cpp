@@ -1,5 +1,9 @@
 #include "condrv/condrv_server.hpp"
 
+#include "condrv/condrv_packet_trace.hpp"
+#include "condrv/condrv_server_pipeline.hpp"
+#include "condrv/host_output_buffer.hpp"
+#include "condrv/snapshot_publisher.hpp"
 #include "core/unique_handle.hpp"
 #include "core/host_signals.hpp"
 #include "core/win32_handle.hpp"
@@ -12,11 +16,11 @@
 #include <array>
 #include <cstddef>
 #include <cstring>
-#include <deque>
 #include <limits>
 #include <mutex>
 #include <optional>
 #include <span>
+#include <type_traits>
 #include <vector>
 
 // `condrv/condrv_server.cpp` implements the classic ConDrv server loop used for
@@ -35,6 +39,24 @@
 //   `new/docs/design/condrv_reply_pending_wait_queue.md`).
 // - Shutdown signaling: the server may be asked to stop via a waitable event
 //   (or, in ConPTY startups, an event derived from a signal pipe monitor).
+// - Pipelined mode (`ServerRunOptions::pipelined_io`): driver IO moves to a
+//   dedicated thread and this thread only dispatches (see
+//   `new/docs/design/condrv_pipelined_io.md`).
+// - Packet capture (`ServerRunOptions::trace_directory`): driver traffic and host
+//   input are recorded for offline replay (see
+//   `new/docs/design/condrv_packet_trace.md`).
+// - API metrics (`ServerRunOptions::api_metrics`): per-API counters and latency
+//   histograms, logged as JSON lines when the loop exits (see
+//   `new/docs/design/condrv_api_metrics.md`).
+// - Snapshot publishing (windowed hosts): viewport snapshots are coalesced to
+//   `ServerRunOptions::snapshot_max_fps` frames per second (see
+//   `new/docs/design/renderer_snapshot_publisher.md`). Output deferred for the
+//   screen model is applied before each snapshot (see
+//   `new/docs/design/condrv_deferred_output_mirroring.md`).
+// - Host output (ConPTY): bytes for the terminal are combined across messages
+//   and written when the packet queue drains (pipelined), when held output is
+//   due (serial), before a request reads input, or when the buffer fills (see
+//   `new/docs/design/condrv_host_output_write_combining.md`).
 //
 // The implementation intentionally keeps raw HANDLE usage localized and relies
 // on move-only RAII wrappers (`core::UniqueHandle`) for ownership safety.
@@ -277,6 +299,13 @@ namespace oc::condrv
                 }
             }
 
+            // Bumped whenever bytes are appended, so the server loop can tell "new input since the last
+            // wake" apart from bytes that pending readers have already looked at.
+            [[nodiscard]] uint64_t push_generation() const noexcept
+            {
+                return _push_generation.load(std::memory_order_acquire);
+            }
+
             [[nodiscard]] size_t available() const noexcept
             {
                 std::scoped_lock lock(_mutex);
@@ -308,6 +337,7 @@ namespace oc::condrv
                     }
 
                     _storage.insert(_storage.end(), data.begin(), data.end());
+                    _push_generation.fetch_add(1, std::memory_order_release);
                     update_event_locked();
                 }
                 catch (...)
@@ -382,6 +412,7 @@ namespace oc::condrv
 
             core::HandleView _input_available_event{};
             std::atomic_bool _disconnected{ false };
+            std::atomic<uint64_t> _push_generation{ 0 };
             mutable std::mutex _mutex;
             std::vector<std::byte> _storage;
             size_t _read_offset{ 0 };
@@ -397,6 +428,8 @@ namespace oc::condrv
             std::atomic_bool stop_requested{ false };
             std::atomic_bool* has_pending_replies{};
             std::atomic_bool* in_driver_read_io{};
+            DispatchWakeSignal* dispatch_wake{};
+            PacketTraceWriter* packet_trace{};
         };
 
         DWORD WINAPI input_monitor_thread(void* param)
@@ -431,6 +464,19 @@ namespace oc::condrv
                 // thread's `IOCTL_CONDRV_READ_IO` call. Guard usage to the
                 // intended "pending replies exist and server is currently
                 // reading" case to avoid canceling unrelated synchronous IO.
+                if (context->dispatch_wake != nullptr)
+                {
+                    // Pipelined mode: the IO thread owns `READ_IO`; the dispatch thread sleeps on
+                    // its wake signal instead, so no cancellation is needed.
+                    if (context->has_pending_replies != nullptr &&
+                        context->has_pending_replies->load(std::memory_order_acquire))
+                    {
+                        context->dispatch_wake->notify();
+                    }
+
+                    return;
+                }
+
                 if (!context->target_thread ||
                     context->has_pending_replies == nullptr ||
                     context->in_driver_read_io == nullptr)
@@ -504,7 +550,12 @@ namespace oc::condrv
                     break;
                 }
 
-                context->queue->push(std::span<const std::byte>(buffer.data(), static_cast<size_t>(read)));
+                const auto bytes = std::span<const std::byte>(buffer.data(), static_cast<size_t>(read));
+                if (context->packet_trace != nullptr)
+                {
+                    context->packet_trace->record_host_input(bytes);
+                }
+                context->queue->push(bytes);
                 if (context->logger != nullptr)
                 {
                     context->logger->log(logging::LogLevel::trace, L"Input monitor read {} bytes from host input", read);
@@ -539,7 +590,9 @@ namespace oc::condrv
                 std::atomic_bool& has_pending_replies,
                 std::atomic_bool& in_driver_read_io,
                 const core::HandleView condrv_server,
-                logging::Logger* logger) noexcept
+                logging::Logger* logger,
+                DispatchWakeSignal* const dispatch_wake,
+                PacketTraceWriter* const packet_trace) noexcept
             {
                 if (!host_input)
                 {
@@ -564,6 +617,8 @@ namespace oc::condrv
                 context->logger = logger;
                 context->has_pending_replies = &has_pending_replies;
                 context->in_driver_read_io = &in_driver_read_io;
+                context->dispatch_wake = dispatch_wake;
+                context->packet_trace = packet_trace;
 
                 core::UniqueHandle thread(::CreateThread(
                     nullptr,
@@ -605,38 +660,131 @@ namespace oc::condrv
             std::unique_ptr<InputMonitorContext> _context;
         };
 
-        class HostIo final
+        // Wakes the server loop when a coalesced snapshot frame becomes due, so the last change of a
+        // burst is published even if no further request arrives (see
+        // `new/docs/design/renderer_snapshot_publisher.md`).
+        //
+        // Serial mode wakes the loop the same way the input monitor does: cancel `READ_IO` while the
+        // loop is blocked in it. If the timer fires while the loop is busy, the loop will observe the
+        // deadline itself unless it is about to block; the callback retries shortly in that case.
+        // Pipelined mode only needs to bump the dispatch wake signal.
+        //
+        // The serial loop also uses an instance to bound how long output is held across `read_io`
+        // (`BasicSerialOutputHold`).
+        class FrameDeadlineTimer final
         {
         public:
-            HostIo(
-                const core::HandleView host_input,
-                const core::HandleView host_output,
-                const core::HandleView host_signal_pipe,
-                const core::HandleView input_available_event,
-                const core::HandleView signal_handle,
-                InputQueue& input_queue) noexcept :
-                _host_input(host_input),
-                _host_output(host_output),
-                _host_signal_pipe(host_signal_pipe),
-                _input_available_event(input_available_event),
-                _signal_handle(signal_handle),
-                _input_queue(&input_queue)
+            [[nodiscard]] static std::expected<std::unique_ptr<FrameDeadlineTimer>, ServerError> create(
+                const core::HandleView target_thread,
+                const core::HandleView condrv_server,
+                const std::atomic_bool& in_driver_read_io,
+                DispatchWakeSignal* const dispatch_wake) noexcept
+            {
+                std::unique_ptr<FrameDeadlineTimer> timer(new (std::nothrow) FrameDeadlineTimer());
+                if (!timer)
+                {
+                    return std::unexpected(make_error(L"Failed to allocate snapshot frame timer", ERROR_OUTOFMEMORY));
+                }
+
+                timer->_target_thread = target_thread;
+                timer->_condrv_server = condrv_server;
+                timer->_in_driver_read_io = &in_driver_read_io;
+                timer->_dispatch_wake = dispatch_wake;
+                timer->_timer = ::CreateThreadpoolTimer(&FrameDeadlineTimer::callback, timer.get(), nullptr);
+                if (timer->_timer == nullptr)
+                {
+                    return std::unexpected(make_error(L"CreateThreadpoolTimer failed for snapshot frame timer", ::GetLastError()));
+                }
+
+                return timer;
+            }
+
+            ~FrameDeadlineTimer() noexcept
+            {
+                if (_timer != nullptr)
+                {
+                    _armed.store(false, std::memory_order_release);
+                    ::SetThreadpoolTimer(_timer, nullptr, 0, 0);
+                    ::WaitForThreadpoolTimerCallbacks(_timer, TRUE);
+                    ::CloseThreadpoolTimer(_timer);
+                }
+            }
+
+            FrameDeadlineTimer(const FrameDeadlineTimer&) = delete;
+            FrameDeadlineTimer& operator=(const FrameDeadlineTimer&) = delete;
+
+            // Fires once after `delay_us`, replacing any earlier schedule.
+            void arm(const uint64_t delay_us) noexcept
             {
+                _armed.store(true, std::memory_order_release);
+                schedule(delay_us);
             }
 
-            [[nodiscard]] std::expected<size_t, DeviceCommError> write_output_bytes(const std::span<const std::byte> bytes) noexcept
+            void disarm() noexcept
+            {
+                _armed.store(false, std::memory_order_release);
+                ::SetThreadpoolTimer(_timer, nullptr, 0, 0);
+            }
+
+        private:
+            FrameDeadlineTimer() noexcept = default;
+
+            // Delay before re-checking when the deadline lands while the loop is between requests.
+            static constexpr uint64_t busy_retry_us = 1'000;
+
+            void schedule(const uint64_t delay_us) noexcept
+            {
+                // Negative due times are relative, in 100ns units.
+                const auto due = static_cast<ULONGLONG>(-static_cast<LONGLONG>(delay_us == 0 ? 1 : delay_us * 10));
+                FILETIME due_time{
+                    .dwLowDateTime = static_cast<DWORD>(due & 0xFFFF'FFFF),
+                    .dwHighDateTime = static_cast<DWORD>(due >> 32),
+                };
+                ::SetThreadpoolTimer(_timer, &due_time, 0, 0);
+            }
+
+            static void CALLBACK callback(PTP_CALLBACK_INSTANCE, void* const param, PTP_TIMER) noexcept
             {
-                if (bytes.empty())
+                auto* self = static_cast<FrameDeadlineTimer*>(param);
+                if (!self->_armed.load(std::memory_order_acquire))
                 {
-                    return size_t{ 0 };
+                    return;
                 }
 
-                if (!_host_output)
+                if (self->_dispatch_wake != nullptr)
                 {
-                    // No output target: treat as success and discard.
-                    return bytes.size();
+                    self->_dispatch_wake->notify();
+                    return;
+                }
+
+                if (!self->_in_driver_read_io->load(std::memory_order_acquire))
+                {
+                    self->schedule(busy_retry_us);
+                    return;
                 }
 
+                (void)::CancelSynchronousIo(self->_target_thread.get());
+                if (self->_condrv_server)
+                {
+                    (void)::CancelIoEx(self->_condrv_server.get(), nullptr);
+                }
+            }
+
+            PTP_TIMER _timer{};
+            core::HandleView _target_thread{};
+            core::HandleView _condrv_server{};
+            const std::atomic_bool* _in_driver_read_io{};
+            DispatchWakeSignal* _dispatch_wake{};
+            std::atomic_bool _armed{ false };
+        };
+
+        // `WriteFile` sink for `HostIo`'s output buffer.
+        struct HostOutputPipe final
+        {
+            core::HandleView handle{};
+
+            [[nodiscard]] std::expected<void, DeviceCommError> write(const std::span<const std::byte> bytes) noexcept
+            {
                 size_t total_written = 0;
                 while (total_written < bytes.size())
                 {
@@ -647,7 +795,7 @@ namespace oc::condrv
 
                     DWORD written = 0;
                     if (::WriteFile(
-                            _host_output.get(),
+                            handle.get(),
                             bytes.data() + total_written,
                             chunk,
                             &written,
@@ -666,11 +814,63 @@ namespace oc::condrv
                     }
                 }
 
-                return total_written;
+                return {};
+            }
+        };
+
+        class HostIo final
+        {
+        public:
+            HostIo(
+                const core::HandleView host_input,
+                const core::HandleView host_output,
+                const core::HandleView host_signal_pipe,
+                const core::HandleView input_available_event,
+                const core::HandleView signal_handle,
+                InputQueue& input_queue) noexcept :
+                _host_input(host_input),
+                _host_output(host_output),
+                _host_signal_pipe(host_signal_pipe),
+                _input_available_event(input_available_event),
+                _signal_handle(signal_handle),
+                _input_queue(&input_queue),
+                _output(HostOutputPipe{ .handle = host_output })
+            {
+            }
+
+            // Output is combined in `_output` and reaches the pipe on `flush_output()`, before any
+            // wait or input read, or when the buffer fills.
+            [[nodiscard]] std::expected<size_t, DeviceCommError> write_output_bytes(const std::span<const std::byte> bytes) noexcept
+            {
+                if (!_host_output)
+                {
+                    // No output target: treat as success and discard.
+                    return bytes.size();
+                }
+
+                return _output.write(bytes);
+            }
+
+            // Writes any combined output to the host output pipe. The pipelined loop calls this
+            // when the packet queue drains; the serial loop through `BasicSerialOutputHold`.
+            [[nodiscard]] std::expected<void, DeviceCommError> flush_output() noexcept
+            {
+                return _output.flush();
+            }
+
+            [[nodiscard]] size_t pending_output_bytes() const noexcept
+            {
+                return _output.pending_bytes();
+            }
+
+            [[nodiscard]] const HostOutputBufferStatistics& output_statistics() const noexcept
+            {
+                return _output.statistics();
             }
 
             [[nodiscard]] std::expected<size_t, DeviceCommError> read_input_bytes(const std::span<std::byte> dest) noexcept
             {
+                flush_output_before_input();
                 if (_input_queue == nullptr)
                 {
                     return size_t{ 0 };
@@ -682,6 +882,7 @@ namespace oc::condrv
 
             [[nodiscard]] std::expected<size_t, DeviceCommError> peek_input_bytes(const std::span<std::byte> dest) noexcept
             {
+                flush_output_before_input();
                 if (_input_queue == nullptr)
                 {
                     return size_t{ 0 };
@@ -691,8 +892,9 @@ namespace oc::condrv
                 return _input_queue->peek(dest);
             }
 
-            [[nodiscard]] size_t input_bytes_available() const noexcept
+            [[nodiscard]] size_t input_bytes_available() noexcept
             {
+                flush_output_before_input();
                 if (_input_queue == nullptr)
                 {
                     return 0;
@@ -718,6 +920,8 @@ namespace oc::condrv
                     return true;
                 }
 
+                // A host-generated reply to a query must not overtake the output that precedes it.
+                flush_output_before_input();
                 (void)_host_input;
                 _input_queue->push(bytes);
                 return true;
@@ -744,6 +948,7 @@ namespace oc::condrv
 
             [[nodiscard]] std::expected<bool, DeviceCommError> wait_for_input(const DWORD timeout_ms) noexcept
             {
+                flush_output_before_input();
                 if (!_host_input || !_input_available_event || _input_queue == nullptr)
                 {
                     return false;
@@ -805,6 +1010,9 @@ namespace oc::condrv
                     return {};
                 }
 
+                // The terminal sees the process's output before it hears that the process ended.
+                (void)_output.flush();
+
                 core::HostSignalEndTaskData data{};
                 data.sizeInBytes = sizeof(data);
                 data.processId = process_id;
@@ -827,14 +1035,32 @@ namespace oc::condrv
             }
 
         private:
+            // A client that reads input may be waiting for the terminal's answer to a query it just
+            // wrote, so the query goes out first. A failed flush is kept by `_output` and returned by
+            // the next output write.
+            void flush_output_before_input() noexcept
+            {
+                if (_output.pending_bytes() != 0)
+                {
+                    (void)_output.flush();
+                }
+            }
+
             core::HandleView _host_input{};
             core::HandleView _host_output{};
             core::HandleView _host_signal_pipe{};
             core::HandleView _input_available_event{};
             core::HandleView _signal_handle{};
             InputQueue* _input_queue{};
+            BasicHostOutputBuffer<HostOutputPipe> _output;
         };
 
+        using SerialOutputHold = BasicSerialOutputHold<QpcFrameClock>;
+
+        // Longest the serial loop holds output across a `read_io` while requests keep arriving. The
+        // wake is a threadpool timer, so a held tail can land up to one timer tick later.
+        constexpr uint64_t serial_output_hold_us = 1'000;
+
         class AtomicFlagGuard final
         {
         public:
@@ -859,6 +1085,30 @@ namespace oc::condrv
             std::atomic_bool* _flag{};
         };
 
+        // Logs one JSON line per API that saw traffic, so the dump can be grepped out of the log
+        // (`ConDrv API metrics: {...}`) and compared across hosts and builds.
+        void log_api_metrics(logging::Logger& logger, const ApiMetrics& metrics) noexcept
+        {
+            LARGE_INTEGER frequency{};
+            (void)::QueryPerformanceFrequency(&frequency);
+
+            std::wstring text;
+            if (auto formatted = format_api_metrics_json(metrics, static_cast<uint64_t>(frequency.QuadPart), text); !formatted)
+            {
+                logger.log(logging::LogLevel::warning, L"{} (error {})", formatted.error().context, formatted.error().win32_error);
+                return;
+            }
+
+            std::wstring_view remaining(text);
+            while (!remaining.empty())
+            {
+                const size_t end = remaining.find(L'\n');
+                const auto line = remaining.substr(0, end);
+                logger.log(logging::LogLevel::info, L"ConDrv API metrics: {}", line);
+                remaining.remove_prefix(end == std::wstring_view::npos ? remaining.size() : end + 1);
+            }
+        }
+
         [[nodiscard]] std::expected<DWORD, ServerError> run_loop(
             const core::HandleView server_handle,
             const core::HandleView signal_handle,
@@ -869,18 +1119,44 @@ namespace oc::condrv
             const IoPacket* const initial_packet,
             std::shared_ptr<view::PublishedScreenBuffer> published_screen,
             const HWND paint_target,
-            logging::Logger& logger) noexcept
+            logging::Logger& logger,
+            const ServerRunOptions options) noexcept
         {
             if (!server_handle)
             {
                 return std::unexpected(make_error(L"ConDrv server handle was invalid", ERROR_INVALID_HANDLE));
             }
 
+            // Declared before the comm and the threads that record into it, so it is destroyed last.
+            std::unique_ptr<PacketTraceWriter> packet_trace;
+            if (!options.trace_directory.empty())
+            {
+                auto path = resolve_packet_trace_path(options.trace_directory);
+                auto created = path
+                    ? PacketTraceWriter::create(*path, host_output ? packet_trace_flag_host_output : 0)
+                    : std::unexpected(path.error());
+                if (created)
+                {
+                    packet_trace = std::move(created.value());
+                    logger.log(logging::LogLevel::info, L"Capturing ConDrv packet trace to {}", *path);
+                }
+                else
+                {
+                    // Capture is a diagnostic aid; never refuse to serve clients over it.
+                    logger.log(
+                        logging::LogLevel::warning,
+                        L"ConDrv packet trace disabled: {} (error {})",
+                        created.error().context,
+                        created.error().win32_error);
+                }
+            }
+
             auto comm = ConDrvDeviceComm::from_server_handle(server_handle);
             if (!comm)
             {
                 return std::unexpected(make_error(comm.error().context, comm.error().win32_error));
             }
+            comm->set_packet_trace(packet_trace.get());
 
             core::HandleView effective_input_event = input_available_event;
             core::UniqueHandle owned_input_event;
@@ -908,6 +1184,14 @@ namespace oc::condrv
                 server_thread = std::move(duplicated.value());
             }
 
+            // Constructed (but not started) before the input monitor, which holds its wake signal.
+            std::optional<BasicIoPipeline<ConDrvDeviceComm>> pipeline;
+            std::atomic_bool stop_requested{ false };
+            if (options.pipelined_io)
+            {
+                pipeline.emplace(*comm, &stop_requested);
+            }
+
             InputQueue input_queue(effective_input_event);
             auto input_monitor = InputMonitor::start(
                 host_input,
@@ -916,7 +1200,9 @@ namespace oc::condrv
                 has_pending_replies,
                 in_driver_read_io,
                 comm->server_handle(),
-                &logger);
+                &logger,
+                pipeline.has_value() ? &pipeline->dispatch_wake() : nullptr,
+                packet_trace.get());
             if (!input_monitor)
             {
                 return std::unexpected(input_monitor.error());
@@ -957,16 +1243,37 @@ namespace oc::condrv
                 }
             }
 
-            logger.log(logging::LogLevel::info, L"ConDrv server loop starting");
+            logger.log(
+                logging::LogLevel::info,
+                L"ConDrv server loop starting{}",
+                options.pipelined_io ? L" (pipelined IO)" : L"");
 
-            std::atomic_bool stop_requested{ false };
             auto signal_monitor = SignalMonitor::start(comm->server_handle(), signal_handle, stop_requested);
             if (!signal_monitor)
             {
                 return std::unexpected(signal_monitor.error());
             }
 
+            // Declared before the state that points at it.
+            std::unique_ptr<ApiMetrics> api_metrics;
             ServerState state{};
+            if (options.api_metrics)
+            {
+                if (auto created = ApiMetrics::create(); created)
+                {
+                    api_metrics = std::move(created.value());
+                    state.set_api_metrics(api_metrics.get());
+                }
+                else
+                {
+                    logger.log(
+                        logging::LogLevel::warning,
+                        L"ConDrv API metrics disabled: {} (error {})",
+                        created.error().context,
+                        created.error().win32_error);
+                }
+            }
+
             HostIo host_io(
                 host_input,
                 host_output,
@@ -975,46 +1282,102 @@ namespace oc::condrv
                 signal_handle,
                 input_queue);
 
-            std::deque<ConDrvApiMessage> pending_replies;
+            // Declared before any message container so pooled buffers are returned before the pool dies.
+            MessageBufferPool buffer_pool;
+            BasicWaitQueueFor<ConDrvDeviceComm> pending_replies;
             std::optional<ConDrvApiMessage> pending_completion;
-            std::weak_ptr<ScreenBuffer> last_buffer;
-            uint64_t last_revision = 0;
 
-            const auto maybe_publish_snapshot = [&]() noexcept {
-                if (!published_screen || paint_target == nullptr)
+            // Snapshot frames are coalesced to `options.snapshot_max_fps`; the frame timer publishes
+            // the last change of a burst once its frame is due.
+            const bool publish_snapshots = published_screen && paint_target != nullptr;
+            std::unique_ptr<FrameDeadlineTimer> frame_timer;
+            uint32_t max_snapshot_fps = options.snapshot_max_fps;
+            if (publish_snapshots && max_snapshot_fps != 0)
+            {
+                auto created = FrameDeadlineTimer::create(
+                    server_thread.view(),
+                    comm->server_handle(),
+                    in_driver_read_io,
+                    pipeline.has_value() ? &pipeline->dispatch_wake() : nullptr);
+                if (created)
                 {
-                    return;
+                    frame_timer = std::move(created.value());
+                }
+                else
+                {
+                    // Without a deadline wake a coalesced frame could be stranded; publish every change.
+                    logger.log(
+                        logging::LogLevel::warning,
+                        L"Snapshot frame coalescing disabled: {} (error {})",
+                        created.error().context,
+                        created.error().win32_error);
+                    max_snapshot_fps = 0;
                 }
+            }
 
-                auto buffer = state.active_screen_buffer();
-                if (!buffer)
+            // The serial loop holds output across a `read_io` while requests keep arriving, up to
+            // `serial_output_hold_us`; the output timer wakes a read still blocked then.
+            std::unique_ptr<FrameDeadlineTimer> output_timer;
+            uint64_t output_hold_us = 0;
+            if (!pipeline.has_value() && host_output)
+            {
+                auto created = FrameDeadlineTimer::create(server_thread.view(), comm->server_handle(), in_driver_read_io, nullptr);
+                if (created)
                 {
-                    return;
+                    output_timer = std::move(created.value());
+                    output_hold_us = serial_output_hold_us;
+                }
+                else
+                {
+                    // Without the wake, held output could wait on a read that never returns.
+                    logger.log(
+                        logging::LogLevel::warning,
+                        L"Host output holding disabled: {} (error {})",
+                        created.error().context,
+                        created.error().win32_error);
                 }
+            }
+
+            SerialOutputHold output_hold(output_hold_us);
+            std::optional<uint64_t> armed_output_deadline;
 
-                bool buffer_changed = false;
-                if (auto locked = last_buffer.lock(); !locked || locked.get() != buffer.get())
+            SnapshotPublisher snapshot_publisher(
+                publish_snapshots ? std::move(published_screen) : nullptr,
+                paint_target,
+                max_snapshot_fps);
+            std::optional<uint64_t> armed_deadline;
+
+            const auto maybe_publish_snapshot = [&]() noexcept {
+                if (!publish_snapshots)
                 {
-                    buffer_changed = true;
+                    return;
                 }
 
-                const uint64_t revision = buffer->revision();
-                if (!buffer_changed && revision == last_revision)
+                // A snapshot reads the model, so deferred output is applied first.
+                state.flush_deferred_output(host_io);
+                (void)snapshot_publisher.update(state.active_screen_buffer());
+                if (!frame_timer)
                 {
                     return;
                 }
 
-                auto snapshot = make_viewport_snapshot(*buffer);
-                if (!snapshot)
+                // A failed build moves the deadline to the next frame, so the timer is re-armed
+                // rather than left spent on the old one.
+                const auto deadline = snapshot_publisher.deadline();
+                if (deadline == armed_deadline)
                 {
                     return;
                 }
 
-                published_screen->publish(std::move(snapshot.value()));
-                (void)::PostMessageW(paint_target, WM_APP + 1, 0, 0);
+                armed_deadline = deadline;
+                if (!deadline)
+                {
+                    frame_timer->disarm();
+                    return;
+                }
 
-                last_buffer = buffer;
-                last_revision = revision;
+                const uint64_t now = snapshot_publisher.clock().now_us();
+                frame_timer->arm(*deadline > now ? *deadline - now : 0);
             };
 
             const auto release_message_buffers = [&](ConDrvApiMessage& message) noexcept -> std::expected<void, ServerError> {
@@ -1087,83 +1450,106 @@ namespace oc::condrv
                 has_pending_replies.store(!pending_replies.empty(), std::memory_order_release);
             };
 
-            const auto service_pending_once = [&]() noexcept -> std::expected<bool, ServerError> {
-                if (pending_replies.empty() || pending_completion.has_value())
+            uint64_t observed_input_generation = input_queue.push_generation();
+            bool observed_input_disconnected = input_queue.disconnected();
+
+            // Translates input-queue changes since the last wake into wait-queue signals.
+            const auto signal_input_changes = [&]() noexcept {
+                const uint64_t generation = input_queue.push_generation();
+                if (generation != observed_input_generation)
                 {
-                    update_pending_flag();
-                    return false;
+                    observed_input_generation = generation;
+                    pending_replies.signal_input_available();
                 }
 
-                bool progress = false;
-                const size_t count = pending_replies.size();
-                for (size_t i = 0; i < count; ++i)
+                if (!observed_input_disconnected && input_queue.disconnected())
                 {
-                    auto message = std::move(pending_replies.front());
-                    pending_replies.pop_front();
-
-                    auto outcome = dispatch_message(state, message, host_io);
-                    if (!outcome)
-                    {
-                        return std::unexpected(make_error(outcome.error().context, outcome.error().win32_error));
-                    }
-
-                    if (outcome->reply_pending)
-                    {
-                        pending_replies.push_back(std::move(message));
-                        continue;
-                    }
+                    observed_input_disconnected = true;
+                    pending_replies.signal_input_disconnected();
+                }
+            };
 
-                    if (auto finished = release_and_stage_completion(message); !finished)
-                    {
-                        return std::unexpected(finished.error());
-                    }
+            const auto park_pending = [&](ConDrvApiMessage& message) noexcept -> std::expected<void, ServerError> {
+                const auto& descriptor = message.descriptor();
+                if (descriptor.function == console_io_user_defined)
+                {
+                    logger.log(
+                        logging::LogLevel::trace,
+                        L"Reply-pending: function={} object={} api={}",
+                        descriptor.function,
+                        static_cast<unsigned long long>(descriptor.object),
+                        message.packet().payload.user_defined.msg_header.ApiNumber);
+                }
+                else
+                {
+                    logger.log(
+                        logging::LogLevel::trace,
+                        L"Reply-pending: function={} object={}",
+                        descriptor.function,
+                        static_cast<unsigned long long>(descriptor.object));
+                }
 
-                    progress = true;
-                    break;
+                if (auto parked = park_reply_pending(pending_replies, std::move(message)); !parked)
+                {
+                    // The message was not moved from; fail it instead of leaving the client hung.
+                    message.set_reply_status(core::status_no_memory);
+                    message.set_reply_information(0);
+                    return release_and_stage_completion(message);
                 }
 
                 update_pending_flag();
-                return progress;
+                return {};
             };
 
-            const auto service_pending_until_stalled = [&]() noexcept -> std::expected<void, ServerError> {
-                for (;;)
+            const auto service_pending = [&]() noexcept -> std::expected<void, ServerError> {
+                if (pending_replies.empty() || pending_completion.has_value())
                 {
-                    auto progress = service_pending_once();
-                    if (!progress)
-                    {
-                        return std::unexpected(progress.error());
-                    }
+                    update_pending_flag();
+                    return {};
+                }
 
-                    if (!progress.value())
-                    {
-                        break;
-                    }
+                signal_input_changes();
+                auto completed = service_wait_queue(state, pending_replies, host_io);
+                if (!completed)
+                {
+                    return std::unexpected(make_error(completed.error().context, completed.error().win32_error));
                 }
 
-                return {};
+                update_pending_flag();
+                if (!completed->has_value())
+                {
+                    return {};
+                }
+
+                return release_and_stage_completion(**completed);
             };
 
             const auto fail_all_pending = [&]() noexcept -> std::expected<void, ServerError> {
-                for (auto& message : pending_replies)
-                {
+                std::expected<void, ServerError> result{};
+                pending_replies.for_each([&](ConDrvApiMessage& message) noexcept {
+                    if (!result)
+                    {
+                        return;
+                    }
+
                     message.set_reply_status(core::status_unsuccessful);
                     message.set_reply_information(0);
 
                     if (auto released = release_message_buffers(message); !released)
                     {
-                        return std::unexpected(released.error());
+                        result = std::unexpected(released.error());
+                        return;
                     }
 
                     if (auto completed = complete_io_direct(message); !completed)
                     {
-                        return std::unexpected(completed.error());
+                        result = std::unexpected(completed.error());
                     }
-                }
+                });
 
                 pending_replies.clear();
                 update_pending_flag();
-                return {};
+                return result;
             };
 
             // Publish the initial empty screen so a windowed host can paint immediately.
@@ -1172,8 +1558,13 @@ namespace oc::condrv
             bool exit_no_clients_requested = false;
             if (initial_packet != nullptr)
             {
+                if (packet_trace)
+                {
+                    packet_trace->record_packet(*initial_packet);
+                }
+
                 IoPacket packet_copy = *initial_packet;
-                ConDrvApiMessage message(*comm, packet_copy);
+                ConDrvApiMessage message(*comm, packet_copy, &buffer_pool);
                 auto outcome = dispatch_message(state, message, host_io);
                 if (!outcome)
                 {
@@ -1182,25 +1573,10 @@ namespace oc::condrv
 
                 if (outcome->reply_pending)
                 {
-                    if (packet_copy.descriptor.function == console_io_user_defined)
+                    if (auto parked = park_pending(message); !parked)
                     {
-                        logger.log(
-                            logging::LogLevel::trace,
-                            L"Reply-pending: function={} object={} api={}",
-                            packet_copy.descriptor.function,
-                            static_cast<unsigned long long>(packet_copy.descriptor.object),
-                            packet_copy.payload.user_defined.msg_header.ApiNumber);
+                        return std::unexpected(parked.error());
                     }
-                    else
-                    {
-                        logger.log(
-                            logging::LogLevel::trace,
-                            L"Reply-pending: function={} object={}",
-                            packet_copy.descriptor.function,
-                            static_cast<unsigned long long>(packet_copy.descriptor.object));
-                    }
-                    pending_replies.push_back(std::move(message));
-                    update_pending_flag();
                 }
                 else
                 {
@@ -1221,44 +1597,140 @@ namespace oc::condrv
             bool exit_signal = false;
             bool exit_pipe = false;
 
-            while (!stop_requested.load(std::memory_order_acquire) || pending_completion.has_value())
+            if (pipeline.has_value())
             {
-                if (exit_no_clients_requested && !pending_completion.has_value())
+                // The handoff packet (if any) was dispatched above on this thread; complete it before
+                // the IO thread takes over the device.
+                if (pending_completion.has_value())
                 {
-                    exit_no_clients = true;
-                    break;
+                    (void)complete_io_direct(*pending_completion);
+                    pending_completion.reset();
                 }
 
-                if (auto drained = service_pending_until_stalled(); !drained)
+                if (auto started = pipeline->start(); !started)
                 {
-                    return std::unexpected(drained.error());
+                    (void)fail_all_pending();
+                    return std::unexpected(make_error(started.error().context, started.error().win32_error));
                 }
-                maybe_publish_snapshot();
 
-                IoPacket packet{};
-                std::expected<void, DeviceCommError> read;
+                auto dispatched = exit_no_clients_requested
+                    ? std::expected<PipelinedDispatchExit, DeviceCommError>(PipelinedDispatchExit::no_clients)
+                    : run_pipelined_dispatch(
+                          *pipeline,
+                          state,
+                          host_io,
+                          pending_replies,
+                          stop_requested,
+                          signal_input_changes,
+                          [&]() noexcept {
+                              // The packet queue drained: hand the batch's output to the terminal. A
+                              // failure is kept by `host_io` and fails the next write's dispatch.
+                              (void)host_io.flush_output();
+                              update_pending_flag();
+                              maybe_publish_snapshot();
+                          });
+
+                pipeline->request_stop();
+                pipeline->join();
+                (void)fail_all_pending();
+
                 {
-                    AtomicFlagGuard guard(in_driver_read_io);
-                    const IoComplete* reply = nullptr;
-                    if (pending_completion.has_value())
-                    {
-                        reply = &pending_completion->completion();
-                    }
-                    read = comm->read_io(reply, packet);
+                    const auto& stats = pipeline->statistics();
+                    logger.log(
+                        logging::LogLevel::debug,
+                        L"ConDrv IO pipeline: packets={}, piggybacked_replies={}, direct_replies={}, canceled_reads={}, backpressure_waits={}",
+                        stats.packets,
+                        stats.piggybacked_replies,
+                        stats.direct_replies,
+                        stats.canceled_reads,
+                        stats.backpressure_waits);
                 }
 
-                if (!read)
+                if (!dispatched)
                 {
-                    const DWORD error = read.error().win32_error;
-                    if (error == ERROR_PIPE_NOT_CONNECTED)
+                    return std::unexpected(make_error(dispatched.error().context, dispatched.error().win32_error));
+                }
+
+                switch (*dispatched)
+                {
+                case PipelinedDispatchExit::no_clients:
+                    exit_no_clients = true;
+                    break;
+                case PipelinedDispatchExit::stop_requested:
+                    exit_signal = true;
+                    break;
+                case PipelinedDispatchExit::io_stopped:
+                    if (pipeline->io_exit() == PipelineIoExit::failed)
                     {
-                        exit_pipe = true;
-                        break;
+                        return std::unexpected(make_error(pipeline->io_error().context, pipeline->io_error().win32_error));
                     }
 
-                    if (error == ERROR_OPERATION_ABORTED || error == ERROR_CANCELLED)
-                    {
-                        if (stop_requested.load(std::memory_order_acquire))
+                    exit_pipe = pipeline->io_exit() == PipelineIoExit::pipe_disconnected;
+                    exit_signal = !exit_pipe;
+                    break;
+                }
+            }
+
+            while (!pipeline.has_value() && (!stop_requested.load(std::memory_order_acquire) || pending_completion.has_value()))
+            {
+                if (exit_no_clients_requested && !pending_completion.has_value())
+                {
+                    exit_no_clients = true;
+                    break;
+                }
+
+                if (auto serviced = service_pending(); !serviced)
+                {
+                    return std::unexpected(serviced.error());
+                }
+                maybe_publish_snapshot();
+
+                // `read_io` may block until some client sends a request. Output waits on it only
+                // while the output timer bounds the wait.
+                if (auto flushed = output_hold.before_read(host_io); !flushed)
+                {
+                    return std::unexpected(make_error(flushed.error().context, flushed.error().win32_error));
+                }
+
+                if (output_timer && output_hold.deadline() != armed_output_deadline)
+                {
+                    armed_output_deadline = output_hold.deadline();
+                    if (armed_output_deadline)
+                    {
+                        const uint64_t now = output_hold.clock().now_us();
+                        output_timer->arm(*armed_output_deadline > now ? *armed_output_deadline - now : 0);
+                    }
+                    else
+                    {
+                        output_timer->disarm();
+                    }
+                }
+
+                IoPacket packet{};
+                std::expected<void, DeviceCommError> read;
+                {
+                    AtomicFlagGuard guard(in_driver_read_io);
+                    const IoComplete* reply = nullptr;
+                    if (pending_completion.has_value())
+                    {
+                        reply = &pending_completion->completion();
+                    }
+                    read = comm->read_io(reply, packet);
+                }
+                output_hold.after_read(read.has_value());
+
+                if (!read)
+                {
+                    const DWORD error = read.error().win32_error;
+                    if (error == ERROR_PIPE_NOT_CONNECTED)
+                    {
+                        exit_pipe = true;
+                        break;
+                    }
+
+                    if (error == ERROR_OPERATION_ABORTED || error == ERROR_CANCELLED)
+                    {
+                        if (stop_requested.load(std::memory_order_acquire))
                         {
                             logger.log(logging::LogLevel::trace, L"ConDrv read_io canceled (stop requested)");
                         }
@@ -1291,7 +1763,7 @@ namespace oc::condrv
 
                 pending_completion.reset();
 
-                ConDrvApiMessage message(*comm, packet);
+                ConDrvApiMessage message(*comm, packet, &buffer_pool);
                 auto outcome = dispatch_message(state, message, host_io);
                 if (!outcome)
                 {
@@ -1300,28 +1772,14 @@ namespace oc::condrv
 
                 if (outcome->reply_pending)
                 {
-                    if (packet.descriptor.function == console_io_user_defined)
-                    {
-                        logger.log(
-                            logging::LogLevel::trace,
-                            L"Reply-pending: function={} object={} api={}",
-                            packet.descriptor.function,
-                            static_cast<unsigned long long>(packet.descriptor.object),
-                            packet.payload.user_defined.msg_header.ApiNumber);
-                    }
-                    else
+                    if (auto parked = park_pending(message); !parked)
                     {
-                        logger.log(
-                            logging::LogLevel::trace,
-                            L"Reply-pending: function={} object={}",
-                            packet.descriptor.function,
-                            static_cast<unsigned long long>(packet.descriptor.object));
+                        return std::unexpected(parked.error());
                     }
-                    pending_replies.push_back(std::move(message));
-                    update_pending_flag();
                     continue;
                 }
 
+                signal_waiters_after_dispatch(pending_replies, packet);
                 if (auto finished = release_and_stage_completion(message); !finished)
                 {
                     return std::unexpected(finished.error());
@@ -1341,6 +1799,71 @@ namespace oc::condrv
             }
 
             (void)fail_all_pending();
+            if (output_timer)
+            {
+                output_timer->disarm();
+            }
+            (void)host_io.flush_output();
+
+            if (publish_snapshots)
+            {
+                if (frame_timer)
+                {
+                    frame_timer->disarm();
+                }
+                state.flush_deferred_output(host_io);
+                (void)snapshot_publisher.flush(state.active_screen_buffer());
+
+                const auto& snapshot_stats = snapshot_publisher.statistics();
+                logger.log(
+                    logging::LogLevel::debug,
+                    L"Snapshot publisher: changes={}, frames={}, incremental_frames={}, coalesced={}, snapshot_failures={}",
+                    snapshot_stats.changes,
+                    snapshot_stats.frames,
+                    snapshot_stats.incremental_frames,
+                    snapshot_stats.coalesced,
+                    snapshot_stats.snapshot_failures);
+            }
+
+            {
+                const auto& output_stats = host_io.output_statistics();
+                logger.log(
+                    logging::LogLevel::debug,
+                    L"Host output: writes={}, bytes={}, pipe_writes={}, capacity_flushes={}, write_throughs={}",
+                    output_stats.writes,
+                    output_stats.bytes,
+                    output_stats.sink_writes,
+                    output_stats.capacity_flushes,
+                    output_stats.write_throughs);
+            }
+
+            {
+                const auto& pool_stats = buffer_pool.statistics();
+                logger.log(
+                    logging::LogLevel::debug,
+                    L"ConDrv message buffer pool: acquires={}, pool_hits={}, heap_allocations={}, oversize_allocations={}",
+                    pool_stats.acquires,
+                    pool_stats.pool_hits,
+                    pool_stats.heap_allocations,
+                    pool_stats.oversize_allocations);
+            }
+
+            if (api_metrics)
+            {
+                log_api_metrics(logger, *api_metrics);
+            }
+
+            if (packet_trace)
+            {
+                (void)packet_trace->flush();
+                const auto trace_stats = packet_trace->statistics();
+                logger.log(
+                    logging::LogLevel::info,
+                    L"ConDrv packet trace: records={}, bytes={}, dropped_records={}",
+                    trace_stats.records,
+                    trace_stats.bytes,
+                    trace_stats.dropped_records);
+            }
 
             if (exit_pipe)
             {
@@ -1766,6 +2289,47 @@ namespace oc::condrv
         return _os2_oem_format;
     }
 
+    void ServerState::trim_output_scratch() noexcept
+    {
+        // Keep enough capacity for typical bulk writes (`type` pushes ~4-64 KiB per WriteConsole).
+        constexpr size_t retain_bytes = 1024 * 1024;
+
+        if (_output_text_scratch.capacity() * sizeof(wchar_t) > retain_bytes)
+        {
+            std::wstring{}.swap(_output_text_scratch);
+        }
+
+        if (_output_utf8_scratch.capacity() > retain_bytes)
+        {
+            std::string{}.swap(_output_utf8_scratch);
+        }
+    }
+
+    bool ServerState::defer_output(
+        const std::shared_ptr<ScreenBuffer>& screen_buffer,
+        const std::wstring_view text,
+        const ULONG output_mode) noexcept
+    {
+        try
+        {
+            // One entry per write, even for consecutive writes to one buffer: a write boundary
+            // ends the open glyph, so merging them could change the cells.
+            _deferred_output_text.append(text);
+            _deferred_output.push_back(DeferredOutput{
+                .screen_buffer = screen_buffer,
+                .output_mode = output_mode,
+                .end = _deferred_output_text.size(),
+            });
+            return true;
+        }
+        catch (...)
+        {
+            // Drop the partial append so the log still ends at its last entry.
+            _deferred_output_text.resize(_deferred_output.empty() ? 0 : _deferred_output.back().end);
+            return false;
+        }
+    }
+
     ULONG ServerState::history_buffer_size() const noexcept
     {
         return _history_buffer_size;
@@ -1918,7 +2482,8 @@ namespace oc::condrv
         settings.scroll_position = template_buffer.scroll_position();
         settings.window_size = template_buffer.window_size();
         settings.maximum_window_size = template_buffer.maximum_window_size();
-        settings.text_attributes = template_buffer.text_attributes();
+        // The new buffer has its own attribute table, so it starts from the classic view.
+        settings.text_attributes = template_buffer.legacy_attributes(template_buffer.text_attributes());
         settings.cursor_size = template_buffer.cursor_size();
         settings.cursor_visible = template_buffer.cursor_visible();
         settings.color_table = template_buffer.color_table();
@@ -2040,9 +2605,16 @@ namespace oc::condrv
         _window_rect.Right = static_cast<SHORT>(right);
         _window_rect.Bottom = static_cast<SHORT>(bottom);
 
-        const auto width = static_cast<size_t>(_buffer_size.X);
+        // Rows start blank and own no cells until they are written.
         const auto height = static_cast<size_t>(_buffer_size.Y);
-        _cells.assign(width * height, ScreenCell{ .character = L' ', .attributes = _text_attributes });
+        _rows.resize(height);
+        for (auto& row : _rows)
+        {
+            row.blank = ScreenCell{ .character = L' ', .attributes = _text_attributes };
+        }
+        _row_offset = 0;
+        _row_damage.assign(height, RowDamage{});
+        _spare_cells.reserve(spare_cells_limit);
     }
 
     COORD ScreenBuffer::screen_buffer_size() const noexcept
@@ -2052,7 +2624,7 @@ namespace oc::condrv
 
     bool ScreenBuffer::coord_in_range(const COORD coord) const noexcept
     {
-        if (_cells.empty())
+        if (_rows.empty())
         {
             return false;
         }
@@ -2070,842 +2642,1946 @@ namespace oc::condrv
         return coord.X < _buffer_size.X && coord.Y < _buffer_size.Y;
     }
 
-    size_t ScreenBuffer::linear_index(const COORD coord) const noexcept
+    size_t ScreenBuffer::physical_row(const SHORT row) const noexcept
     {
-        return static_cast<size_t>(coord.Y) * static_cast<size_t>(_buffer_size.X) + static_cast<size_t>(coord.X);
+        const size_t height = static_cast<size_t>(_buffer_size.Y);
+        const size_t physical = static_cast<size_t>(row) + _row_offset;
+        return physical >= height ? physical - height : physical;
     }
 
-    bool ScreenBuffer::set_screen_buffer_size(const COORD size) noexcept
+    ScreenBuffer::ScreenRow& ScreenBuffer::row_at(const SHORT row) noexcept
     {
-        if (size.X <= 0 || size.Y <= 0)
-        {
-            return false;
-        }
+        return _rows[physical_row(row)];
+    }
 
-        const size_t new_width = static_cast<size_t>(size.X);
-        const size_t new_height = static_cast<size_t>(size.Y);
+    const ScreenBuffer::ScreenRow& ScreenBuffer::row_at(const SHORT row) const noexcept
+    {
+        return _rows[physical_row(row)];
+    }
 
-        const size_t old_width = _buffer_size.X > 0 ? static_cast<size_t>(_buffer_size.X) : 0;
-        const size_t old_height = _buffer_size.Y > 0 ? static_cast<size_t>(_buffer_size.Y) : 0;
+    ScreenBuffer::ScreenCell ScreenBuffer::cell_at(const COORD coord) const noexcept
+    {
+        return row_cell(row_at(coord.Y), static_cast<size_t>(coord.X));
+    }
 
-        std::vector<ScreenCell> new_cells;
-        std::optional<std::vector<ScreenCell>> new_backup_cells;
-        try
+    ScreenBuffer::ScreenCell ScreenBuffer::row_cell(const ScreenRow& row, const size_t column) noexcept
+    {
+        if (row.is_blank)
         {
-            new_cells.assign(new_width * new_height, ScreenCell{ .character = L' ', .attributes = _text_attributes });
-
-            if (!_cells.empty() && old_width != 0 && old_height != 0)
-            {
-                const size_t copy_width = std::min(old_width, new_width);
-                const size_t copy_height = std::min(old_height, new_height);
-
-                for (size_t y = 0; y < copy_height; ++y)
-                {
-                    for (size_t x = 0; x < copy_width; ++x)
-                    {
-                        new_cells[y * new_width + x] = _cells[y * old_width + x];
-                    }
-                }
-            }
-
-            if (_vt_main_backup)
-            {
-                std::vector<ScreenCell> resized;
-                resized.assign(
-                    new_width * new_height,
-                    ScreenCell{ .character = L' ', .attributes = _vt_main_backup->text_attributes });
-
-                const auto& old_backup = _vt_main_backup->cells;
-                if (!old_backup.empty() && old_width != 0 && old_height != 0)
-                {
-                    const size_t copy_width = std::min(old_width, new_width);
-                    const size_t copy_height = std::min(old_height, new_height);
-
-                    for (size_t y = 0; y < copy_height; ++y)
-                    {
-                        for (size_t x = 0; x < copy_width; ++x)
-                        {
-                            resized[y * new_width + x] = old_backup[y * old_width + x];
-                        }
-                    }
-                }
-
-                new_backup_cells.emplace(std::move(resized));
-            }
+            return row.blank;
         }
-        catch (...)
+        if (row.is_compact)
         {
-            return false;
+            return column < row.compact.length() ? row.compact.cell(column) : row.blank;
         }
+        return row.cells[column];
+    }
 
-        _cells = std::move(new_cells);
-        if (_vt_main_backup && new_backup_cells)
+    void ScreenBuffer::copy_row_cells(const ScreenRow& row, const size_t column, const size_t count, ScreenCell* const dest) noexcept
+    {
+        if (row.is_blank)
+        {
+            fill_cells(dest, count, row.blank);
+            return;
+        }
+        if (!row.is_compact)
         {
-            _vt_main_backup->cells = std::move(*new_backup_cells);
+            std::copy_n(row.cells.get() + column, count, dest);
+            return;
         }
 
-        _buffer_size = size;
+        const size_t length = row.compact.length();
+        const size_t encoded = column < length ? std::min(count, length - column) : 0;
+        row.compact.decode(column, encoded, dest);
+        fill_cells(dest + encoded, count - encoded, row.blank);
+    }
 
-        if (_maximum_window_size.X < _buffer_size.X)
+    template<typename Visit>
+    void ScreenBuffer::visit_row_cells(const ScreenRow& row, const size_t column, const size_t count, Visit&& visit) noexcept
+    {
+        if (!row.is_compact)
         {
-            _maximum_window_size.X = _buffer_size.X;
+            visit(row.cells.get() + column, count, size_t{ 0 });
+            return;
         }
-        if (_maximum_window_size.Y < _buffer_size.Y)
+
+        std::array<ScreenCell, 128> chunk;
+        for (size_t done = 0; done < count;)
         {
-            _maximum_window_size.Y = _buffer_size.Y;
+            const size_t n = std::min(chunk.size(), count - done);
+            copy_row_cells(row, column + done, n, chunk.data());
+            visit(chunk.data(), n, done);
+            done += n;
         }
+    }
 
+    ScreenBuffer::ScreenCell* ScreenBuffer::materialize_row(const SHORT row) noexcept
+    {
+        auto& target = row_at(row);
+        if (!target.is_blank && !target.is_compact)
         {
-            const long buffer_w = static_cast<long>(_buffer_size.X);
-            const long buffer_h = static_cast<long>(_buffer_size.Y);
-
-            long window_w = static_cast<long>(_window_rect.Right) - static_cast<long>(_window_rect.Left) + 1;
-            long window_h = static_cast<long>(_window_rect.Bottom) - static_cast<long>(_window_rect.Top) + 1;
-            if (window_w <= 0 || window_h <= 0)
-            {
-                window_w = buffer_w;
-                window_h = buffer_h;
-            }
+            return target.cells.get();
+        }
 
-            if (window_w > buffer_w)
-            {
-                window_w = buffer_w;
-            }
-            if (window_h > buffer_h)
-            {
-                window_h = buffer_h;
-            }
-            if (window_w <= 0)
+        const auto width = static_cast<size_t>(_buffer_size.X);
+        if (target.capacity < width)
+        {
+            SpareCells storage{};
+            if (!_spare_cells.empty() && _spare_cells.back().capacity >= width)
             {
-                window_w = 1;
+                storage = std::move(_spare_cells.back());
+                _spare_cells.pop_back();
             }
-            if (window_h <= 0)
+            else
             {
-                window_h = 1;
+                storage.cells.reset(new (std::nothrow) ScreenCell[width]);
+                if (!storage.cells)
+                {
+                    return nullptr;
+                }
+                storage.capacity = width;
             }
 
-            long left = static_cast<long>(_window_rect.Left);
-            long top = static_cast<long>(_window_rect.Top);
+            target.cells = std::move(storage.cells);
+            target.capacity = storage.capacity;
+        }
 
-            if (left < 0)
-            {
-                left = 0;
-            }
-            if (top < 0)
+        copy_row_cells(target, 0, width, target.cells.get());
+        target.is_blank = false;
+        target.is_compact = false;
+        // The cells replace the encoding; keeping both would cost more than the row did before.
+        target.compact.reset();
+        return target.cells.get();
+    }
+
+    void ScreenBuffer::compact_rows(const long first_row, const long end_row) noexcept
+    {
+        const auto width = static_cast<size_t>(_buffer_size.X);
+        const long first = std::max(first_row, 0L);
+        const long end = std::min(end_row, static_cast<long>(_buffer_size.Y));
+        for (long y = first; y < end; ++y)
+        {
+            auto& row = row_at(static_cast<SHORT>(y));
+            if (row.is_blank || row.is_compact)
             {
-                top = 0;
+                continue;
             }
 
-            const long max_left = buffer_w - window_w;
-            const long max_top = buffer_h - window_h;
-
-            if (left > max_left)
+            // Trailing cells matching a final space become the row's `blank`, as in reflow.
+            const ScreenCell* const cells = row.cells.get();
+            ScreenCell tail = row.blank;
+            size_t length = width;
+            if (cells[width - 1].character == L' ')
             {
-                left = max_left;
+                tail = cells[width - 1];
+                while (length > 0 && cells[length - 1] == tail)
+                {
+                    --length;
+                }
             }
-            if (top > max_top)
+
+            if (length != 0 && !row.compact.encode(cells, length))
             {
-                top = max_top;
+                continue;
             }
-            if (left < 0)
+
+            row.blank = tail;
+            row.is_blank = length == 0;
+            row.is_compact = length != 0;
+            if (_spare_cells.size() < _spare_cells.capacity())
             {
-                left = 0;
+                _spare_cells.push_back(SpareCells{ .cells = std::move(row.cells), .capacity = row.capacity });
             }
-            if (top < 0)
+            row.cells.reset();
+            row.capacity = 0;
+        }
+    }
+
+    template<typename Visit>
+    size_t ScreenBuffer::walk_linear(const COORD origin, const size_t length, Visit&& visit) const noexcept
+    {
+        const auto width = static_cast<size_t>(_buffer_size.X);
+        const auto height = static_cast<size_t>(_buffer_size.Y);
+        size_t column = static_cast<size_t>(origin.X);
+        size_t visited = 0;
+        for (size_t row = static_cast<size_t>(origin.Y); row < height && visited < length; ++row)
+        {
+            const size_t count = std::min(width - column, length - visited);
+            if (!visit(static_cast<SHORT>(row), column, count, visited))
             {
-                top = 0;
+                break;
             }
 
-            const long right = left + window_w - 1;
-            const long bottom = top + window_h - 1;
+            visited += count;
+            column = 0;
+        }
 
-            _window_rect.Left = static_cast<SHORT>(left);
-            _window_rect.Top = static_cast<SHORT>(top);
-            _window_rect.Right = static_cast<SHORT>(right);
-            _window_rect.Bottom = static_cast<SHORT>(bottom);
+        return visited;
+    }
+
+    bool ScreenBuffer::row_wrapped(const SHORT row) const noexcept
+    {
+        if (row < 0 || row >= _buffer_size.Y || _rows.empty())
+        {
+            return false;
         }
 
-        if (_cursor_position.X >= _buffer_size.X)
+        return row_at(row).wrapped;
+    }
+
+    void ScreenBuffer::set_row_wrapped(const SHORT row, const bool wrapped) noexcept
+    {
+        if (row < 0 || row >= _buffer_size.Y || _rows.empty())
         {
-            _cursor_position.X = static_cast<SHORT>(_buffer_size.X > 0 ? _buffer_size.X - 1 : 0);
+            return;
         }
-        if (_cursor_position.Y >= _buffer_size.Y)
+
+        row_at(row).wrapped = wrapped;
+    }
+
+    size_t ScreenBuffer::materialized_row_count() const noexcept
+    {
+        size_t count = 0;
+        for (const auto& row : _rows)
         {
-            _cursor_position.Y = static_cast<SHORT>(_buffer_size.Y > 0 ? _buffer_size.Y - 1 : 0);
+            if (row.cells)
+            {
+                ++count;
+            }
         }
 
-        if (_vt_vertical_margins)
+        return count;
+    }
+
+    size_t ScreenBuffer::compact_row_count() const noexcept
+    {
+        size_t count = 0;
+        for (const auto& row : _rows)
         {
-            auto margins = *_vt_vertical_margins;
-            if (margins.top < 0)
+            if (row.is_compact)
             {
-                margins.top = 0;
+                ++count;
             }
-            if (margins.bottom < 0)
+        }
+
+        return count;
+    }
+
+    size_t ScreenBuffer::compact_storage_row_count() const noexcept
+    {
+        size_t count = 0;
+        for (const auto& row : _rows)
+        {
+            if (row.compact.storage_bytes() != 0)
             {
-                _vt_vertical_margins.reset();
+                ++count;
             }
-            else
-            {
-                if (margins.top >= _buffer_size.Y)
-                {
-                    margins.top = static_cast<SHORT>(_buffer_size.Y - 1);
-                }
-                if (margins.bottom >= _buffer_size.Y)
-                {
-                    margins.bottom = static_cast<SHORT>(_buffer_size.Y - 1);
-                }
+        }
 
-                if (margins.top >= margins.bottom)
-                {
-                    _vt_vertical_margins.reset();
-                }
-                else
-                {
-                    _vt_vertical_margins = margins;
-                }
-            }
+        return count;
+    }
+
+    bool ScreenBuffer::prepare_resized_rows(
+        const std::vector<ScreenRow>& rows,
+        const size_t row_offset,
+        const COORD old_size,
+        const COORD new_size,
+        const ScreenCell fill,
+        std::vector<ScreenRow>& out) noexcept
+    {
+        const size_t old_width = old_size.X > 0 ? static_cast<size_t>(old_size.X) : 0;
+        const size_t old_height = rows.empty() ? 0 : rows.size();
+        const auto new_width = static_cast<size_t>(new_size.X);
+        const auto new_height = static_cast<size_t>(new_size.Y);
+        try
+        {
+            out.resize(new_height);
+        }
+        catch (...)
+        {
+            return false;
         }
 
-        if (_vt_main_backup)
+        for (auto& row : out)
+        {
+            row.blank = fill;
+        }
+
+        // Same-width rows are moved later by `adopt_resized_rows`.
+        if (old_width == 0 || old_width == new_width)
+        {
+            return true;
+        }
+
+        const size_t copy_width = std::min(old_width, new_width);
+        const size_t copy_height = std::min(old_height, new_height);
+        for (size_t y = 0; y < copy_height; ++y)
         {
-            if (_vt_main_backup->cursor_position.X >= _buffer_size.X)
+            const auto& source = rows[(y + row_offset) % old_height];
+            auto& target = out[y];
+
+            // A blank row stays blank unless widening would expose `fill` next to a different blank.
+            if (source.is_blank && (new_width < old_width || source.blank == fill))
             {
-                _vt_main_backup->cursor_position.X = static_cast<SHORT>(_buffer_size.X > 0 ? _buffer_size.X - 1 : 0);
+                target.blank = source.blank;
+                continue;
             }
-            if (_vt_main_backup->cursor_position.Y >= _buffer_size.Y)
+
+            target.cells.reset(new (std::nothrow) ScreenCell[new_width]);
+            if (!target.cells)
             {
-                _vt_main_backup->cursor_position.Y = static_cast<SHORT>(_buffer_size.Y > 0 ? _buffer_size.Y - 1 : 0);
+                return false;
             }
 
-            if (_vt_main_backup->vt_vertical_margins)
-            {
-                auto margins = *_vt_main_backup->vt_vertical_margins;
-                if (margins.top < 0)
-                {
-                    margins.top = 0;
-                }
-                if (margins.bottom < 0)
-                {
-                    _vt_main_backup->vt_vertical_margins.reset();
-                }
-                else
-                {
-                    if (margins.top >= _buffer_size.Y)
-                    {
-                        margins.top = static_cast<SHORT>(_buffer_size.Y - 1);
-                    }
-                    if (margins.bottom >= _buffer_size.Y)
-                    {
-                        margins.bottom = static_cast<SHORT>(_buffer_size.Y - 1);
-                    }
+            target.capacity = new_width;
+            target.is_blank = false;
+            copy_row_cells(source, 0, copy_width, target.cells.get());
+            fill_cells(target.cells.get() + copy_width, new_width - copy_width, fill);
 
-                    if (margins.top >= margins.bottom)
-                    {
-                        _vt_main_backup->vt_vertical_margins.reset();
-                    }
-                    else
-                    {
-                        _vt_main_backup->vt_vertical_margins = margins;
-                    }
-                }
+            // A glyph whose trailing half was clipped off loses its leading half too.
+            ScreenCell& edge = target.cells[copy_width - 1];
+            if (new_width < old_width && (edge.attributes & COMMON_LVB_LEADING_BYTE) != 0 &&
+                (row_cell(source, copy_width).attributes & COMMON_LVB_TRAILING_BYTE) != 0)
+            {
+                edge = ScreenCell{ .character = L' ', .attributes = static_cast<USHORT>(edge.attributes & ~cell_width_bits) };
             }
         }
 
-        // Resizing changes the end-of-line location and invalidates any delayed wrap state.
-        _vt_delayed_wrap_position.reset();
-        if (_vt_main_backup)
-        {
-            _vt_main_backup->vt_delayed_wrap_position.reset();
-        }
-
-        touch();
-        snap_window_to_cursor();
         return true;
     }
 
-    COORD ScreenBuffer::cursor_position() const noexcept
+    void ScreenBuffer::adopt_resized_rows(
+        std::vector<ScreenRow>& rows,
+        const size_t row_offset,
+        const COORD old_size,
+        const COORD new_size,
+        std::vector<ScreenRow>& out) noexcept
     {
-        return _cursor_position;
-    }
+        if (rows.empty() || old_size.X != new_size.X)
+        {
+            return;
+        }
 
-    void ScreenBuffer::set_cursor_position(const COORD position) noexcept
-    {
-        _cursor_position = position;
-        touch();
+        const size_t copy_height = std::min(rows.size(), out.size());
+        for (size_t y = 0; y < copy_height; ++y)
+        {
+            out[y] = std::move(rows[(y + row_offset) % rows.size()]);
+        }
     }
 
-    SMALL_RECT ScreenBuffer::window_rect() const noexcept
+    bool ScreenBuffer::reflow_rows(const COORD new_size) noexcept
     {
-        return _window_rect;
-    }
+        const auto old_width = static_cast<size_t>(_buffer_size.X);
+        const auto old_height = static_cast<size_t>(_buffer_size.Y);
+        const auto new_width = static_cast<size_t>(new_size.X);
+        const auto new_height = static_cast<size_t>(new_size.Y);
+        const ScreenCell fill{ .character = L' ', .attributes = _text_attributes };
+
+        // A logical line is a run of wrapped rows plus the row that ends it. Its text runs through
+        // the wrapped rows and stops before the final row's trailing spaces that match its last
+        // cell; reflow pads with that cell (`tail`), so a background color still reaches the edge.
+        struct LineEnd final
+        {
+            size_t content{};
+            ScreenCell tail{};
+        };
 
-    COORD ScreenBuffer::scroll_position() const noexcept
-    {
-        return COORD{ _window_rect.Left, _window_rect.Top };
-    }
+        struct Line final
+        {
+            size_t first_row{};
+            size_t row_count{};
+            size_t content{};
+            ScreenCell tail{};
+            size_t out_first{};
+            size_t out_count{};
+            // The leading rows that hold the line's text; the rest are `tail`.
+            size_t text_rows{};
+            // A one-row compact line that still fits keeps its encoding; no cells are copied.
+            bool keeps_encoding{};
+        };
 
-    bool ScreenBuffer::set_window_rect(const SMALL_RECT rect) noexcept
-    {
-        if (_buffer_size.X <= 0 || _buffer_size.Y <= 0)
+        const auto line_end = [&](const ScreenRow& row) noexcept -> LineEnd {
+            const ScreenCell last = row_cell(row, old_width - 1);
+            if (last.character != L' ')
+            {
+                return LineEnd{ .content = old_width, .tail = fill };
+            }
+            if (row.is_blank)
+            {
+                return LineEnd{ .content = 0, .tail = last };
+            }
+
+            // Cells past a compact row's encoding all read as `last`.
+            size_t content = old_width - 1;
+            if (row.is_compact)
+            {
+                content = std::min(content, row.compact.length());
+            }
+            while (content > 0 && row_cell(row, content - 1) == last)
+            {
+                --content;
+            }
+            return LineEnd{ .content = content, .tail = last };
+        };
+
+        const auto old_row = [&](const size_t y) noexcept -> ScreenRow& {
+            return row_at(static_cast<SHORT>(y));
+        };
+
+        // A new row starting `start` cells into the line from old row `first_row` takes `new_width`
+        // cells, or one fewer where it would end between the halves of a glyph, which then starts
+        // the next row whole.
+        const auto row_length = [&](const size_t first_row, const size_t content, const size_t start) noexcept -> size_t {
+            const size_t end = start + new_width;
+            if (new_width < 2 || end >= content)
+            {
+                return new_width;
+            }
+
+            const ScreenCell last = row_cell(old_row(first_row + (end - 1) / old_width), (end - 1) % old_width);
+            const ScreenCell next = row_cell(old_row(first_row + end / old_width), end % old_width);
+            const bool splits = (last.attributes & COMMON_LVB_LEADING_BYTE) != 0 && (next.attributes & COMMON_LVB_TRAILING_BYTE) != 0;
+            return splits ? new_width - 1 : new_width;
+        };
+
+        // Rows below both the cursor and the last row with anything on it hold nothing to keep.
+        const auto cursor_row = static_cast<size_t>(std::clamp(static_cast<long>(_cursor_position.Y), 0L, static_cast<long>(old_height) - 1));
+        const auto cursor_column = static_cast<size_t>(std::clamp(static_cast<long>(_cursor_position.X), 0L, static_cast<long>(old_width) - 1));
+        size_t last_row = old_height - 1;
+        while (last_row > cursor_row)
         {
-            return false;
+            const auto end = line_end(old_row(last_row));
+            if (end.content != 0 || end.tail != fill)
+            {
+                break;
+            }
+            --last_row;
         }
 
-        if (rect.Left > rect.Right || rect.Top > rect.Bottom)
+        std::vector<Line> lines;
+        try
+        {
+            lines.reserve(last_row + 1);
+        }
+        catch (...)
         {
             return false;
         }
 
-        const long buffer_w = static_cast<long>(_buffer_size.X);
-        const long buffer_h = static_cast<long>(_buffer_size.Y);
+        // Lay the lines out at the new width. The cursor's line extends to just past the cursor, so
+        // a cursor after the text keeps its place.
+        size_t total = 0;
+        size_t cursor_out = 0;
+        size_t cursor_x = 0;
+        for (size_t y = 0; y <= last_row; ++y)
+        {
+            const size_t first_row = y;
+            while (y < last_row && old_row(y).wrapped)
+            {
+                ++y;
+            }
 
-        const long left = rect.Left;
-        const long top = rect.Top;
-        const long right = rect.Right;
-        const long bottom = rect.Bottom;
+            const auto end = line_end(old_row(y));
+            Line line{
+                .first_row = first_row,
+                .row_count = y - first_row + 1,
+                .content = (y - first_row) * old_width + end.content,
+                .tail = end.tail,
+                .out_first = total,
+            };
 
-        if (left < 0 || top < 0)
+            const bool has_cursor = cursor_row >= first_row && cursor_row <= y;
+            const size_t cursor_offset = has_cursor ? (cursor_row - first_row) * old_width + cursor_column : 0;
+            const size_t length = has_cursor ? std::max(line.content, cursor_offset + 1) : line.content;
+
+            // Rows of text, then full rows of padding out to `length`.
+            size_t text_end = 0;
+            while (text_end < line.content)
+            {
+                const size_t count = row_length(first_row, line.content, text_end);
+                if (has_cursor && cursor_offset >= text_end && cursor_offset < text_end + count)
+                {
+                    cursor_out = total + line.text_rows;
+                    cursor_x = cursor_offset - text_end;
+                }
+                text_end += count;
+                ++line.text_rows;
+            }
+            if (has_cursor && cursor_offset >= text_end)
+            {
+                cursor_out = total + line.text_rows + (cursor_offset - text_end) / new_width;
+                cursor_x = (cursor_offset - text_end) % new_width;
+            }
+
+            const size_t padding = length > text_end ? length - text_end : 0;
+            line.out_count = std::max<size_t>(1, line.text_rows + (padding + new_width - 1) / new_width);
+            const auto& last = old_row(y);
+            line.keeps_encoding = line.row_count == 1 && line.out_count == 1 && last.is_compact && last.compact.length() <= new_width;
+            total += line.out_count;
+            lines.push_back(line);
+        }
+
+        // Lines that no longer fit scroll off the top.
+        const size_t dropped = total > new_height ? total - new_height : 0;
+
+        // Count the cell storage the new rows need beyond what finished lines hand back. Rows only
+        // release their cells once their whole line is written, so nothing is read after reuse.
+        const auto reusable = [&](const ScreenRow& row) noexcept {
+            return row.cells && row.capacity >= new_width;
+        };
+
+        size_t available = 0;
+        for (size_t y = last_row + 1; y < old_height; ++y)
         {
-            return false;
+            available += reusable(old_row(y)) ? 1 : 0;
         }
-        if (right < 0 || bottom < 0)
+
+        size_t released = available;
+        size_t shortfall = 0;
+        for (const auto& line : lines)
         {
-            return false;
+            const size_t text_rows = line.keeps_encoding ? 0 : line.text_rows;
+            const size_t skipped = dropped > line.out_first ? std::min(text_rows, dropped - line.out_first) : 0;
+            const size_t needed = text_rows - skipped;
+            if (needed > available)
+            {
+                shortfall += needed - available;
+                available = 0;
+            }
+            else
+            {
+                available -= needed;
+            }
+
+            for (size_t y = line.first_row; y < line.first_row + line.row_count; ++y)
+            {
+                if (reusable(old_row(y)))
+                {
+                    ++available;
+                    ++released;
+                }
+            }
         }
-        if (right >= buffer_w || bottom >= buffer_h)
+
+        // New storage is sized for the wider of the two widths so dragging back and forth reuses it.
+        std::vector<ScreenRow> pool;
+        std::vector<ScreenRow> new_rows;
+        std::vector<RowDamage> new_row_damage;
+        try
+        {
+            pool.reserve(shortfall + released);
+            new_rows.resize(new_height);
+            new_row_damage.assign(new_height, RowDamage{});
+        }
+        catch (...)
         {
             return false;
         }
 
-        _window_rect = rect;
-        touch();
-        return true;
-    }
+        const size_t new_capacity = std::max(old_width, new_width);
+        for (size_t i = 0; i < shortfall; ++i)
+        {
+            ScreenRow spare{};
+            spare.cells.reset(new (std::nothrow) ScreenCell[new_capacity]);
+            if (!spare.cells)
+            {
+                return false;
+            }
+            spare.capacity = new_capacity;
+            pool.push_back(std::move(spare));
+        }
 
-    COORD ScreenBuffer::window_size() const noexcept
-    {
-        const long width = static_cast<long>(_window_rect.Right) - static_cast<long>(_window_rect.Left) + 1;
-        const long height = static_cast<long>(_window_rect.Bottom) - static_cast<long>(_window_rect.Top) + 1;
-        if (width <= 0 || height <= 0)
+        // Nothing below allocates or fails.
+        for (size_t y = last_row + 1; y < old_height; ++y)
         {
-            return {};
+            if (reusable(old_row(y)))
+            {
+                pool.push_back(std::move(old_row(y)));
+            }
         }
 
-        COORD size{};
-        size.X = width > std::numeric_limits<SHORT>::max() ? std::numeric_limits<SHORT>::max() : static_cast<SHORT>(width);
-        size.Y = height > std::numeric_limits<SHORT>::max() ? std::numeric_limits<SHORT>::max() : static_cast<SHORT>(height);
-        return size;
+        const auto copy_text = [&](const Line& line, size_t start, size_t count, ScreenCell* dest) noexcept {
+            while (count != 0)
+            {
+                const auto& source = old_row(line.first_row + start / old_width);
+                const size_t column = start % old_width;
+                const size_t n = std::min(count, old_width - column);
+                copy_row_cells(source, column, n, dest);
+                dest += n;
+                start += n;
+                count -= n;
+            }
+        };
+
+        for (auto& row : new_rows)
+        {
+            row.blank = fill;
+        }
+
+        for (const auto& line : lines)
+        {
+            size_t next_start = 0;
+            for (size_t j = 0; j < line.out_count; ++j)
+            {
+                const size_t start = next_start;
+                const size_t length = row_length(line.first_row, line.content, start);
+                next_start += length;
+                if (line.out_first + j < dropped)
+                {
+                    continue;
+                }
+
+                auto& target = new_rows[line.out_first + j - dropped];
+                target.wrapped = j + 1 < line.out_count;
+                if (line.keeps_encoding)
+                {
+                    // Past the encoding the row reads `blank`, which is exactly the line's padding.
+                    target.compact = std::move(old_row(line.first_row).compact);
+                    target.is_compact = true;
+                    target.is_blank = false;
+                    target.blank = line.tail;
+                    continue;
+                }
+
+                if (start >= line.content)
+                {
+                    target.blank = line.tail;
+                    continue;
+                }
+
+                target.cells = std::move(pool.back().cells);
+                target.capacity = pool.back().capacity;
+                pool.pop_back();
+                target.is_blank = false;
+
+                // A row ended early for a glyph is padded with `fill`, as when the glyph is written
+                // at the right margin.
+                const size_t count = std::min(length, line.content - start);
+                copy_text(line, start, count, target.cells.get());
+                fill_cells(target.cells.get() + count, new_width - count, length < new_width ? fill : line.tail);
+            }
+
+            for (size_t y = line.first_row; y < line.first_row + line.row_count; ++y)
+            {
+                if (reusable(old_row(y)))
+                {
+                    pool.push_back(std::move(old_row(y)));
+                }
+            }
+        }
+
+        // Leftover storage stays with blank rows for later writes and resizes.
+        for (auto& row : new_rows)
+        {
+            if (pool.empty())
+            {
+                break;
+            }
+            if (!row.cells)
+            {
+                row.cells = std::move(pool.back().cells);
+                row.capacity = pool.back().capacity;
+                pool.pop_back();
+            }
+        }
+
+        // The cursor keeps its offset into its line; the window keeps the text at its top row.
+        const auto remap = [&](const size_t out_row) noexcept -> long {
+            return static_cast<long>(out_row) - static_cast<long>(dropped);
+        };
+
+        _cursor_position.X = static_cast<SHORT>(cursor_x);
+        _cursor_position.Y = static_cast<SHORT>(std::max(remap(cursor_out), 0L));
+
+        const long window_top = static_cast<long>(_window_rect.Top);
+        const long window_height = static_cast<long>(_window_rect.Bottom) - window_top;
+        long new_top = 0;
+        if (window_top > static_cast<long>(last_row))
+        {
+            new_top = remap(total) + window_top - static_cast<long>(last_row) - 1;
+        }
+        else if (window_top >= 0)
+        {
+            const auto found = std::upper_bound(lines.begin(), lines.end(), static_cast<size_t>(window_top), [](const size_t row, const Line& line) noexcept {
+                return row < line.first_row;
+            });
+            const auto& top_line = *(found - 1);
+            new_top = remap(top_line.out_first + (static_cast<size_t>(window_top) - top_line.first_row) * old_width / new_width);
+        }
+        new_top = std::clamp(new_top, 0L, static_cast<long>(std::numeric_limits<SHORT>::max()));
+        _window_rect.Top = static_cast<SHORT>(new_top);
+        _window_rect.Bottom = static_cast<SHORT>(std::min(new_top + window_height, static_cast<long>(std::numeric_limits<SHORT>::max())));
+
+        _rows = std::move(new_rows);
+        _row_offset = 0;
+        _row_damage = std::move(new_row_damage);
+        return true;
     }
 
-    bool ScreenBuffer::set_window_size(const COORD size) noexcept
+    bool ScreenBuffer::set_screen_buffer_size(const COORD size) noexcept
     {
-        if (_buffer_size.X <= 0 || _buffer_size.Y <= 0)
+        if (size.X <= 0 || size.Y <= 0)
         {
             return false;
         }
 
-        if (size.X <= 0 || size.Y <= 0)
+        const COORD old_size = _buffer_size;
+        const auto new_height = static_cast<size_t>(size.Y);
+
+        // Like upstream, width changes reflow the main screen; the alternate screen is clipped and
+        // left for the application to redraw.
+        if (!vt_using_alternate_screen_buffer() && !_rows.empty() && old_size.X > 0 && old_size.Y > 0 && old_size.X != size.X)
         {
-            return false;
+            if (!reflow_rows(size))
+            {
+                return false;
+            }
         }
+        else
+        {
+            std::vector<ScreenRow> new_rows;
+            std::vector<RowDamage> new_row_damage;
+            if (!prepare_resized_rows(_rows, _row_offset, old_size, size, ScreenCell{ .character = L' ', .attributes = _text_attributes }, new_rows))
+            {
+                return false;
+            }
 
-        const long width = static_cast<long>(size.X);
-        const long height = static_cast<long>(size.Y);
-        const long buffer_w = static_cast<long>(_buffer_size.X);
-        const long buffer_h = static_cast<long>(_buffer_size.Y);
-        if (width > buffer_w || height > buffer_h)
+            try
+            {
+                new_row_damage.assign(new_height, RowDamage{});
+            }
+            catch (...)
+            {
+                return false;
+            }
+
+            adopt_resized_rows(_rows, _row_offset, old_size, size, new_rows);
+            _rows = std::move(new_rows);
+            _row_offset = 0;
+            _row_damage = std::move(new_row_damage);
+        }
+
+        _buffer_size = size;
+
+        if (_maximum_window_size.X < _buffer_size.X)
+        {
+            _maximum_window_size.X = _buffer_size.X;
+        }
+        if (_maximum_window_size.Y < _buffer_size.Y)
+        {
+            _maximum_window_size.Y = _buffer_size.Y;
+        }
+
+        {
+            const long buffer_w = static_cast<long>(_buffer_size.X);
+            const long buffer_h = static_cast<long>(_buffer_size.Y);
+
+            long window_w = static_cast<long>(_window_rect.Right) - static_cast<long>(_window_rect.Left) + 1;
+            long window_h = static_cast<long>(_window_rect.Bottom) - static_cast<long>(_window_rect.Top) + 1;
+            if (window_w <= 0 || window_h <= 0)
+            {
+                window_w = buffer_w;
+                window_h = buffer_h;
+            }
+
+            if (window_w > buffer_w)
+            {
+                window_w = buffer_w;
+            }
+            if (window_h > buffer_h)
+            {
+                window_h = buffer_h;
+            }
+            if (window_w <= 0)
+            {
+                window_w = 1;
+            }
+            if (window_h <= 0)
+            {
+                window_h = 1;
+            }
+
+            long left = static_cast<long>(_window_rect.Left);
+            long top = static_cast<long>(_window_rect.Top);
+
+            if (left < 0)
+            {
+                left = 0;
+            }
+            if (top < 0)
+            {
+                top = 0;
+            }
+
+            const long max_left = buffer_w - window_w;
+            const long max_top = buffer_h - window_h;
+
+            if (left > max_left)
+            {
+                left = max_left;
+            }
+            if (top > max_top)
+            {
+                top = max_top;
+            }
+            if (left < 0)
+            {
+                left = 0;
+            }
+            if (top < 0)
+            {
+                top = 0;
+            }
+
+            const long right = left + window_w - 1;
+            const long bottom = top + window_h - 1;
+
+            _window_rect.Left = static_cast<SHORT>(left);
+            _window_rect.Top = static_cast<SHORT>(top);
+            _window_rect.Right = static_cast<SHORT>(right);
+            _window_rect.Bottom = static_cast<SHORT>(bottom);
+        }
+
+        if (_cursor_position.X >= _buffer_size.X)
+        {
+            _cursor_position.X = static_cast<SHORT>(_buffer_size.X > 0 ? _buffer_size.X - 1 : 0);
+        }
+        if (_cursor_position.Y >= _buffer_size.Y)
+        {
+            _cursor_position.Y = static_cast<SHORT>(_buffer_size.Y > 0 ? _buffer_size.Y - 1 : 0);
+        }
+
+        if (_vt_vertical_margins)
+        {
+            auto margins = *_vt_vertical_margins;
+            if (margins.top < 0)
+            {
+                margins.top = 0;
+            }
+            if (margins.bottom < 0)
+            {
+                _vt_vertical_margins.reset();
+            }
+            else
+            {
+                if (margins.top >= _buffer_size.Y)
+                {
+                    margins.top = static_cast<SHORT>(_buffer_size.Y - 1);
+                }
+                if (margins.bottom >= _buffer_size.Y)
+                {
+                    margins.bottom = static_cast<SHORT>(_buffer_size.Y - 1);
+                }
+
+                if (margins.top >= margins.bottom)
+                {
+                    _vt_vertical_margins.reset();
+                }
+                else
+                {
+                    _vt_vertical_margins = margins;
+                }
+            }
+        }
+
+        // Resizing changes the end-of-line location and invalidates any delayed wrap state.
+        _vt_delayed_wrap_position.reset();
+
+        touch();
+        damage_all_rows();
+        damage_viewport();
+        damage_cursor();
+        snap_window_to_cursor();
+        compact_rows(0, _window_rect.Top);
+        return true;
+    }
+
+    COORD ScreenBuffer::cursor_position() const noexcept
+    {
+        return _cursor_position;
+    }
+
+    void ScreenBuffer::set_cursor_position(const COORD position) noexcept
+    {
+        _cursor_position = position;
+        touch();
+        damage_cursor();
+    }
+
+    SMALL_RECT ScreenBuffer::window_rect() const noexcept
+    {
+        return _window_rect;
+    }
+
+    COORD ScreenBuffer::scroll_position() const noexcept
+    {
+        return COORD{ _window_rect.Left, _window_rect.Top };
+    }
+
+    bool ScreenBuffer::set_window_rect(const SMALL_RECT rect) noexcept
+    {
+        if (_buffer_size.X <= 0 || _buffer_size.Y <= 0)
+        {
+            return false;
+        }
+
+        if (rect.Left > rect.Right || rect.Top > rect.Bottom)
+        {
+            return false;
+        }
+
+        const long buffer_w = static_cast<long>(_buffer_size.X);
+        const long buffer_h = static_cast<long>(_buffer_size.Y);
+
+        const long left = rect.Left;
+        const long top = rect.Top;
+        const long right = rect.Right;
+        const long bottom = rect.Bottom;
+
+        if (left < 0 || top < 0)
+        {
+            return false;
+        }
+        if (right < 0 || bottom < 0)
+        {
+            return false;
+        }
+        if (right >= buffer_w || bottom >= buffer_h)
+        {
+            return false;
+        }
+
+        const long old_top = _window_rect.Top;
+        _window_rect = rect;
+        touch();
+        damage_viewport();
+        compact_rows(old_top, top);
+        return true;
+    }
+
+    COORD ScreenBuffer::window_size() const noexcept
+    {
+        const long width = static_cast<long>(_window_rect.Right) - static_cast<long>(_window_rect.Left) + 1;
+        const long height = static_cast<long>(_window_rect.Bottom) - static_cast<long>(_window_rect.Top) + 1;
+        if (width <= 0 || height <= 0)
+        {
+            return {};
+        }
+
+        COORD size{};
+        size.X = width > std::numeric_limits<SHORT>::max() ? std::numeric_limits<SHORT>::max() : static_cast<SHORT>(width);
+        size.Y = height > std::numeric_limits<SHORT>::max() ? std::numeric_limits<SHORT>::max() : static_cast<SHORT>(height);
+        return size;
+    }
+
+    bool ScreenBuffer::set_window_size(const COORD size) noexcept
+    {
+        if (_buffer_size.X <= 0 || _buffer_size.Y <= 0)
+        {
+            return false;
+        }
+
+        if (size.X <= 0 || size.Y <= 0)
+        {
+            return false;
+        }
+
+        const long width = static_cast<long>(size.X);
+        const long height = static_cast<long>(size.Y);
+        const long buffer_w = static_cast<long>(_buffer_size.X);
+        const long buffer_h = static_cast<long>(_buffer_size.Y);
+        if (width > buffer_w || height > buffer_h)
+        {
+            return false;
+        }
+
+        const long left = static_cast<long>(_window_rect.Left);
+        const long top = static_cast<long>(_window_rect.Top);
+        const long right = left + width - 1;
+        const long bottom = top + height - 1;
+
+        if (left < 0 || top < 0)
+        {
+            return false;
+        }
+        if (right >= buffer_w || bottom >= buffer_h)
+        {
+            return false;
+        }
+
+        _window_rect.Left = static_cast<SHORT>(left);
+        _window_rect.Top = static_cast<SHORT>(top);
+        _window_rect.Right = static_cast<SHORT>(right);
+        _window_rect.Bottom = static_cast<SHORT>(bottom);
+        touch();
+        damage_viewport();
+        return true;
+    }
+
+    void ScreenBuffer::snap_window_to_cursor() noexcept
+    {
+        if (_buffer_size.X <= 0 || _buffer_size.Y <= 0)
+        {
+            return;
+        }
+
+        const auto size = window_size();
+        if (size.X <= 0 || size.Y <= 0)
+        {
+            return;
+        }
+
+        const long width = static_cast<long>(size.X);
+        const long height = static_cast<long>(size.Y);
+        const long buffer_w = static_cast<long>(_buffer_size.X);
+        const long buffer_h = static_cast<long>(_buffer_size.Y);
+
+        long left = static_cast<long>(_window_rect.Left);
+        long top = static_cast<long>(_window_rect.Top);
+        long right = static_cast<long>(_window_rect.Right);
+        long bottom = static_cast<long>(_window_rect.Bottom);
+
+        const long cursor_x = static_cast<long>(_cursor_position.X);
+        const long cursor_y = static_cast<long>(_cursor_position.Y);
+
+        if (cursor_x < left)
+        {
+            left = cursor_x;
+        }
+        else if (cursor_x > right)
+        {
+            left = cursor_x - (width - 1);
+        }
+
+        if (cursor_y < top)
+        {
+            top = cursor_y;
+        }
+        else if (cursor_y > bottom)
+        {
+            top = cursor_y - (height - 1);
+        }
+
+        if (left < 0)
+        {
+            left = 0;
+        }
+        if (top < 0)
+        {
+            top = 0;
+        }
+
+        const long max_left = buffer_w - width;
+        const long max_top = buffer_h - height;
+        if (left > max_left)
+        {
+            left = max_left;
+        }
+        if (top > max_top)
+        {
+            top = max_top;
+        }
+
+        right = left + width - 1;
+        bottom = top + height - 1;
+
+        const bool moved = _window_rect.Left != left || _window_rect.Top != top;
+        const long old_top = _window_rect.Top;
+        _window_rect.Left = static_cast<SHORT>(left);
+        _window_rect.Top = static_cast<SHORT>(top);
+        _window_rect.Right = static_cast<SHORT>(right);
+        _window_rect.Bottom = static_cast<SHORT>(bottom);
+        touch();
+        if (moved)
+        {
+            damage_viewport();
+            compact_rows(old_top, top);
+        }
+    }
+
+    COORD ScreenBuffer::maximum_window_size() const noexcept
+    {
+        return _maximum_window_size;
+    }
+
+    USHORT ScreenBuffer::text_attributes() const noexcept
+    {
+        return _text_attributes;
+    }
+
+    USHORT ScreenBuffer::default_text_attributes() const noexcept
+    {
+        return _default_text_attributes;
+    }
+
+    void ScreenBuffer::set_text_attributes(const USHORT attributes) noexcept
+    {
+        _text_attributes = attributes;
+        touch();
+    }
+
+    void ScreenBuffer::set_default_text_attributes(const USHORT attributes) noexcept
+    {
+        _default_text_attributes = attributes;
+        touch();
+        damage_palette();
+    }
+
+    ULONG ScreenBuffer::cursor_size() const noexcept
+    {
+        return _cursor_size;
+    }
+
+    bool ScreenBuffer::cursor_visible() const noexcept
+    {
+        return _cursor_visible;
+    }
+
+    void ScreenBuffer::set_cursor_info(const ULONG size, const bool visible) noexcept
+    {
+        _cursor_size = size;
+        _cursor_visible = visible;
+        touch();
+        damage_cursor();
+    }
+
+    void ScreenBuffer::save_cursor_state(
+        const COORD position,
+        const USHORT attributes,
+        const bool delayed_eol_wrap,
+        const bool origin_mode_enabled) noexcept
+    {
+        touch();
+        if (_buffer_size.X <= 0 || _buffer_size.Y <= 0)
+        {
+            _saved_cursor_state = SavedCursorState{
+                .position = COORD{ 0, 0 },
+                .attributes = attributes,
+                .delayed_eol_wrap = false,
+                .origin_mode_enabled = origin_mode_enabled,
+            };
+            return;
+        }
+
+        const auto clamp_component = [](const SHORT value, const SHORT max_value) noexcept -> SHORT {
+            if (value < 0)
+            {
+                return 0;
+            }
+            if (value > max_value)
+            {
+                return max_value;
+            }
+            return value;
+        };
+
+        const SHORT max_x = static_cast<SHORT>(_buffer_size.X - 1);
+        const SHORT max_y = static_cast<SHORT>(_buffer_size.Y - 1);
+        COORD clamped{};
+        clamped.X = clamp_component(position.X, max_x);
+        clamped.Y = clamp_component(position.Y, max_y);
+
+        _saved_cursor_state = SavedCursorState{
+            .position = clamped,
+            .attributes = attributes,
+            .delayed_eol_wrap = delayed_eol_wrap && clamped.X == position.X && clamped.Y == position.Y,
+            .origin_mode_enabled = origin_mode_enabled,
+        };
+    }
+
+    bool ScreenBuffer::restore_cursor_state(
+        COORD& position,
+        USHORT& attributes,
+        bool& delayed_eol_wrap,
+        bool& origin_mode_enabled) const noexcept
+    {
+        if (!_saved_cursor_state)
+        {
+            return false;
+        }
+
+        position = _saved_cursor_state->position;
+        attributes = _saved_cursor_state->attributes;
+        delayed_eol_wrap = _saved_cursor_state->delayed_eol_wrap;
+        origin_mode_enabled = _saved_cursor_state->origin_mode_enabled;
+
+        if (_buffer_size.X <= 0 || _buffer_size.Y <= 0)
+        {
+            position = COORD{ 0, 0 };
+            return true;
+        }
+
+        if (position.X < 0)
+        {
+            position.X = 0;
+        }
+        else if (position.X >= _buffer_size.X)
+        {
+            position.X = static_cast<SHORT>(_buffer_size.X - 1);
+        }
+
+        if (position.Y < 0)
+        {
+            position.Y = 0;
+        }
+        else if (position.Y >= _buffer_size.Y)
+        {
+            position.Y = static_cast<SHORT>(_buffer_size.Y - 1);
+        }
+
+        return true;
+    }
+
+    void ScreenBuffer::set_vt_autowrap_enabled(const bool enabled) noexcept
+    {
+        _vt_autowrap_enabled = enabled;
+        _vt_delayed_wrap_position.reset();
+        touch();
+    }
+
+    void ScreenBuffer::set_vt_delayed_wrap_position(std::optional<COORD> position) noexcept
+    {
+        _vt_delayed_wrap_position = position;
+    }
+
+    void ScreenBuffer::set_vt_origin_mode_enabled(const bool enabled) noexcept
+    {
+        _vt_origin_mode_enabled = enabled;
+        touch();
+    }
+
+    void ScreenBuffer::set_vt_insert_mode_enabled(const bool enabled) noexcept
+    {
+        if (_vt_insert_mode_enabled == enabled)
+        {
+            return;
+        }
+
+        _vt_insert_mode_enabled = enabled;
+        touch();
+    }
+
+    const std::array<COLORREF, 16>& ScreenBuffer::color_table() const noexcept
+    {
+        return _color_table;
+    }
+
+    void ScreenBuffer::set_color_table(const COLORREF (&table)[16]) noexcept
+    {
+        for (size_t i = 0; i < _color_table.size(); ++i)
+        {
+            _color_table[i] = table[i];
+        }
+        _attribute_table.palette_changed();
+        touch();
+        damage_palette();
+    }
+
+    std::optional<ScreenBuffer::VtVerticalMargins> ScreenBuffer::vt_vertical_margins() const noexcept
+    {
+        return _vt_vertical_margins;
+    }
+
+    void ScreenBuffer::set_vt_vertical_margins(std::optional<VtVerticalMargins> margins) noexcept
+    {
+        if (margins)
+        {
+            OC_ASSERT(margins->top >= 0);
+            OC_ASSERT(margins->bottom >= margins->top);
+            OC_ASSERT(_buffer_size.Y > 0);
+            OC_ASSERT(margins->bottom < _buffer_size.Y);
+        }
+
+        _vt_vertical_margins = margins;
+        touch();
+    }
+
+    bool ScreenBuffer::set_vt_using_alternate_screen_buffer(
+        const bool enable,
+        const wchar_t fill_character,
+        const USHORT fill_attributes) noexcept
+    {
+        if (enable)
+        {
+            if (_vt_main_backup)
+            {
+                return true;
+            }
+
+            // The alternate screen covers the viewport only (upstream sizes it the same way).
+            COORD alt_size = window_size();
+            if (alt_size.X <= 0 || alt_size.Y <= 0)
+            {
+                alt_size = _buffer_size;
+            }
+
+            const auto alt_height = static_cast<size_t>(alt_size.Y);
+            try
+            {
+                if (_vt_alternate_rows.size() != alt_height)
+                {
+                    _vt_alternate_rows.clear();
+                    _vt_alternate_rows.resize(alt_height);
+                }
+                _vt_alternate_row_damage.assign(alt_height, RowDamage{});
+            }
+            catch (...)
+            {
+                return false;
+            }
+
+            // Reused rows keep their storage; `materialize_row` replaces any that is too narrow.
+            for (auto& row : _vt_alternate_rows)
+            {
+                row.blank = ScreenCell{ .character = fill_character, .attributes = fill_attributes };
+                row.is_blank = true;
+                row.is_compact = false;
+                row.wrapped = false;
+            }
+
+            VtAlternateBufferBackup backup{};
+            backup.rows = std::move(_rows);
+            backup.row_offset = _row_offset;
+            backup.row_damage = std::move(_row_damage);
+            backup.buffer_size = _buffer_size;
+            backup.window_rect = _window_rect;
+            backup.cursor_position = _cursor_position;
+            backup.text_attributes = _text_attributes;
+            backup.default_text_attributes = _default_text_attributes;
+            backup.cursor_size = _cursor_size;
+            backup.cursor_visible = _cursor_visible;
+            backup.saved_cursor_state = _saved_cursor_state;
+            backup.vt_vertical_margins = _vt_vertical_margins;
+            backup.vt_delayed_wrap_position = _vt_delayed_wrap_position;
+            backup.vt_origin_mode_enabled = _vt_origin_mode_enabled;
+
+            _vt_main_backup = std::move(backup);
+
+            _rows = std::move(_vt_alternate_rows);
+            _row_offset = 0;
+            _row_damage = std::move(_vt_alternate_row_damage);
+            _buffer_size = alt_size;
+            _window_rect = SMALL_RECT{ 0, 0, static_cast<SHORT>(alt_size.X - 1), static_cast<SHORT>(alt_size.Y - 1) };
+            _vt_alternate_rows.clear();
+            _vt_alternate_row_damage.clear();
+            _cursor_position = COORD{ 0, 0 };
+            _saved_cursor_state.reset();
+            _vt_vertical_margins.reset();
+            _vt_delayed_wrap_position.reset();
+            touch();
+            damage_all_rows();
+            damage_viewport();
+            damage_cursor();
+            return true;
+        }
+
+        if (!_vt_main_backup)
+        {
+            return true;
+        }
+
+        auto backup = std::move(*_vt_main_backup);
+        _vt_main_backup.reset();
+
+        // Keep the alternate storage for the next DECSET 1049.
+        _vt_alternate_rows = std::move(_rows);
+        _vt_alternate_row_damage = std::move(_row_damage);
+
+        _rows = std::move(backup.rows);
+        _row_offset = backup.row_offset;
+        _row_damage = std::move(backup.row_damage);
+        _buffer_size = backup.buffer_size;
+        _window_rect = backup.window_rect;
+        _cursor_position = backup.cursor_position;
+        _text_attributes = backup.text_attributes;
+        _default_text_attributes = backup.default_text_attributes;
+        _cursor_size = backup.cursor_size;
+        _cursor_visible = backup.cursor_visible;
+        _saved_cursor_state = backup.saved_cursor_state;
+        _vt_vertical_margins = backup.vt_vertical_margins;
+        _vt_delayed_wrap_position = backup.vt_delayed_wrap_position;
+        _vt_origin_mode_enabled = backup.vt_origin_mode_enabled;
+        touch();
+        damage_all_rows();
+        damage_viewport();
+        damage_cursor();
+        damage_palette();
+        return true;
+    }
+
+    std::wstring_view ServerState::title(const bool original) const noexcept
+    {
+        if (original)
+        {
+            return _original_title;
+        }
+
+        return _title;
+    }
+
+    bool ServerState::set_title(std::wstring title) noexcept
+    {
+        try
+        {
+            if (_original_title.empty())
+            {
+                _original_title = title;
+            }
+            _title = std::move(title);
+            return true;
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    bool ServerState::set_title(const std::wstring_view title) noexcept
+    {
+        try
+        {
+            if (_original_title.empty())
+            {
+                _original_title.assign(title);
+            }
+            _title.assign(title);
+            return true;
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    std::expected<void, DeviceCommError> ServerState::set_alias(
+        std::wstring exe_name,
+        std::wstring source,
+        std::wstring target) noexcept
+    try
+    {
+        if (source.empty())
+        {
+            return std::unexpected(DeviceCommError{
+                .context = L"Console alias source was empty",
+                .win32_error = ERROR_INVALID_PARAMETER,
+            });
+        }
+
+        if (target.empty())
+        {
+            const auto exe_iter = _aliases.find(exe_name);
+            if (exe_iter == _aliases.end())
+            {
+                return {};
+            }
+
+            auto& table = exe_iter->second;
+            const auto source_iter = table.find(source);
+            if (source_iter != table.end())
+            {
+                table.erase(source_iter);
+                if (table.empty())
+                {
+                    _aliases.erase(exe_iter);
+                }
+            }
+
+            return {};
+        }
+
+        auto [exe_iter, inserted] = _aliases.try_emplace(std::move(exe_name));
+        (void)inserted;
+
+        auto& table = exe_iter->second;
+        table.insert_or_assign(std::move(source), std::move(target));
+        return {};
+    }
+    catch (...)
+    {
+        return std::unexpected(DeviceCommError{
+            .context = L"Failed to store console alias data",
+            .win32_error = ERROR_OUTOFMEMORY,
+        });
+    }
+
+    std::optional<std::wstring_view> ServerState::try_get_alias(
+        const std::wstring_view exe_name,
+        const std::wstring_view source) const noexcept
+    {
+        const auto exe_iter = _aliases.find(exe_name);
+        if (exe_iter == _aliases.end())
         {
-            return false;
+            return std::nullopt;
         }
 
-        const long left = static_cast<long>(_window_rect.Left);
-        const long top = static_cast<long>(_window_rect.Top);
-        const long right = left + width - 1;
-        const long bottom = top + height - 1;
-
-        if (left < 0 || top < 0)
+        const auto& table = exe_iter->second;
+        const auto source_iter = table.find(source);
+        if (source_iter == table.end())
         {
-            return false;
+            return std::nullopt;
         }
-        if (right >= buffer_w || bottom >= buffer_h)
+
+        if (source_iter->second.empty())
         {
-            return false;
+            return std::nullopt;
         }
 
-        _window_rect.Left = static_cast<SHORT>(left);
-        _window_rect.Top = static_cast<SHORT>(top);
-        _window_rect.Right = static_cast<SHORT>(right);
-        _window_rect.Bottom = static_cast<SHORT>(bottom);
-        touch();
-        return true;
+        return std::wstring_view(source_iter->second);
     }
 
-    void ScreenBuffer::snap_window_to_cursor() noexcept
+    void ScreenBuffer::break_wide_glyph(ScreenCell* const cells, const size_t width, const size_t column, size_t& first, size_t& last) noexcept
     {
-        if (_buffer_size.X <= 0 || _buffer_size.Y <= 0)
+        const USHORT half = cells[column].attributes & cell_width_bits;
+        if (half == COMMON_LVB_TRAILING_BYTE && column > 0 && (cells[column - 1].attributes & COMMON_LVB_LEADING_BYTE) != 0)
         {
-            return;
+            cells[column - 1] = ScreenCell{ .character = L' ', .attributes = static_cast<USHORT>(cells[column - 1].attributes & ~cell_width_bits) };
+            first = std::min(first, column - 1);
         }
-
-        const auto size = window_size();
-        if (size.X <= 0 || size.Y <= 0)
+        else if (half == COMMON_LVB_LEADING_BYTE && column + 1 < width && (cells[column + 1].attributes & COMMON_LVB_TRAILING_BYTE) != 0)
         {
-            return;
+            cells[column + 1] = ScreenCell{ .character = L' ', .attributes = static_cast<USHORT>(cells[column + 1].attributes & ~cell_width_bits) };
+            last = std::max(last, column + 1);
         }
+    }
 
-        const long width = static_cast<long>(size.X);
-        const long height = static_cast<long>(size.Y);
-        const long buffer_w = static_cast<long>(_buffer_size.X);
-        const long buffer_h = static_cast<long>(_buffer_size.Y);
-
-        long left = static_cast<long>(_window_rect.Left);
-        long top = static_cast<long>(_window_rect.Top);
-        long right = static_cast<long>(_window_rect.Right);
-        long bottom = static_cast<long>(_window_rect.Bottom);
-
-        const long cursor_x = static_cast<long>(_cursor_position.X);
-        const long cursor_y = static_cast<long>(_cursor_position.Y);
-
-        if (cursor_x < left)
+    void ScreenBuffer::clear_wide_span(
+        ScreenCell* const cells,
+        const size_t width,
+        const size_t column,
+        const size_t count,
+        size_t& before,
+        size_t& after) noexcept
+    {
+        const size_t end = column + count - 1;
+        size_t first = column;
+        size_t last = end;
+        if ((cells[column].attributes & cell_width_bits) != 0) [[unlikely]]
         {
-            left = cursor_x;
+            break_wide_glyph(cells, width, column, first, last);
         }
-        else if (cursor_x > right)
+        if ((cells[end].attributes & cell_width_bits) != 0) [[unlikely]]
         {
-            left = cursor_x - (width - 1);
+            break_wide_glyph(cells, width, end, first, last);
         }
 
-        if (cursor_y < top)
+        clear_cell_attribute_bits(cells + column, count, cell_width_bits);
+        if (first < column)
         {
-            top = cursor_y;
+            before = 1;
         }
-        else if (cursor_y > bottom)
+        if (last > end)
         {
-            top = cursor_y - (height - 1);
+            after = 1;
         }
+    }
 
-        if (left < 0)
-        {
-            left = 0;
-        }
-        if (top < 0)
+    bool ScreenBuffer::write_cell(const COORD coord, const wchar_t character, const USHORT attributes) noexcept
+    {
+        if (!coord_in_range(coord))
         {
-            top = 0;
+            return false;
         }
 
-        const long max_left = buffer_w - width;
-        const long max_top = buffer_h - height;
-        if (left > max_left)
+        ScreenCell* const cells = materialize_row(coord.Y);
+        if (cells == nullptr)
         {
-            left = max_left;
+            return false;
         }
-        if (top > max_top)
+
+        const size_t column = static_cast<size_t>(coord.X);
+        size_t first = column;
+        size_t last = column;
+        if ((cells[column].attributes & cell_width_bits) != 0) [[unlikely]]
         {
-            top = max_top;
+            break_wide_glyph(cells, static_cast<size_t>(_buffer_size.X), column, first, last);
         }
 
-        right = left + width - 1;
-        bottom = top + height - 1;
-
-        _window_rect.Left = static_cast<SHORT>(left);
-        _window_rect.Top = static_cast<SHORT>(top);
-        _window_rect.Right = static_cast<SHORT>(right);
-        _window_rect.Bottom = static_cast<SHORT>(bottom);
-        touch();
-    }
-
-    COORD ScreenBuffer::maximum_window_size() const noexcept
-    {
-        return _maximum_window_size;
-    }
-
-    USHORT ScreenBuffer::text_attributes() const noexcept
-    {
-        return _text_attributes;
-    }
-
-    USHORT ScreenBuffer::default_text_attributes() const noexcept
-    {
-        return _default_text_attributes;
-    }
-
-    void ScreenBuffer::set_text_attributes(const USHORT attributes) noexcept
-    {
-        _text_attributes = attributes;
-        touch();
-    }
-
-    void ScreenBuffer::set_default_text_attributes(const USHORT attributes) noexcept
-    {
-        _default_text_attributes = attributes;
-        touch();
-    }
-
-    ULONG ScreenBuffer::cursor_size() const noexcept
-    {
-        return _cursor_size;
-    }
-
-    bool ScreenBuffer::cursor_visible() const noexcept
-    {
-        return _cursor_visible;
-    }
-
-    void ScreenBuffer::set_cursor_info(const ULONG size, const bool visible) noexcept
-    {
-        _cursor_size = size;
-        _cursor_visible = visible;
+        cells[column] = ScreenCell{ .character = character, .attributes = attributes };
         touch();
+        damage_rows(coord.Y, coord.Y, static_cast<SHORT>(first), static_cast<SHORT>(last), true);
+        return true;
     }
 
-    void ScreenBuffer::save_cursor_state(
-        const COORD position,
-        const USHORT attributes,
-        const bool delayed_eol_wrap,
-        const bool origin_mode_enabled) noexcept
+    bool ScreenBuffer::write_cell_run(const COORD coord, const std::wstring_view text, const USHORT attributes, const bool insert) noexcept
     {
-        touch();
-        if (_buffer_size.X <= 0 || _buffer_size.Y <= 0)
+        if (!coord_in_range(coord) || text.empty() || text.size() > static_cast<size_t>(_buffer_size.X - coord.X))
         {
-            _saved_cursor_state = SavedCursorState{
-                .position = COORD{ 0, 0 },
-                .attributes = attributes,
-                .delayed_eol_wrap = false,
-                .origin_mode_enabled = origin_mode_enabled,
-            };
-            return;
+            return false;
         }
 
-        const auto clamp_component = [](const SHORT value, const SHORT max_value) noexcept -> SHORT {
-            if (value < 0)
-            {
-                return 0;
-            }
-            if (value > max_value)
-            {
-                return max_value;
-            }
-            return value;
-        };
-
-        const SHORT max_x = static_cast<SHORT>(_buffer_size.X - 1);
-        const SHORT max_y = static_cast<SHORT>(_buffer_size.Y - 1);
-        COORD clamped{};
-        clamped.X = clamp_component(position.X, max_x);
-        clamped.Y = clamp_component(position.Y, max_y);
-
-        _saved_cursor_state = SavedCursorState{
-            .position = clamped,
-            .attributes = attributes,
-            .delayed_eol_wrap = delayed_eol_wrap && clamped.X == position.X && clamped.Y == position.Y,
-            .origin_mode_enabled = origin_mode_enabled,
-        };
-    }
-
-    bool ScreenBuffer::restore_cursor_state(
-        COORD& position,
-        USHORT& attributes,
-        bool& delayed_eol_wrap,
-        bool& origin_mode_enabled) const noexcept
-    {
-        if (!_saved_cursor_state)
+        // Inserting one cell at a time shifts the row by the run's length in total, and the
+        // inserted cells are then overwritten, so one shift followed by the store is the same.
+        const bool shift = insert && _buffer_size.X > 1;
+        if (shift && !insert_cells(coord, text.size(), ScreenCell{ .character = L' ', .attributes = attributes }))
         {
             return false;
         }
 
-        position = _saved_cursor_state->position;
-        attributes = _saved_cursor_state->attributes;
-        delayed_eol_wrap = _saved_cursor_state->delayed_eol_wrap;
-        origin_mode_enabled = _saved_cursor_state->origin_mode_enabled;
-
-        if (_buffer_size.X <= 0 || _buffer_size.Y <= 0)
+        ScreenCell* const cells = materialize_row(coord.Y);
+        if (cells == nullptr)
         {
-            position = COORD{ 0, 0 };
-            return true;
+            return false;
         }
 
-        if (position.X < 0)
+        // Only the run's ends can split a glyph; one inside the run is overwritten whole. After a
+        // shift the run covers freshly inserted cells.
+        const size_t width = static_cast<size_t>(_buffer_size.X);
+        const size_t column = static_cast<size_t>(coord.X);
+        const size_t end = column + text.size() - 1;
+        size_t first = column;
+        size_t last = end;
+        if (!shift && (cells[column].attributes & cell_width_bits) != 0) [[unlikely]]
         {
-            position.X = 0;
+            break_wide_glyph(cells, width, column, first, last);
         }
-        else if (position.X >= _buffer_size.X)
+        if (!shift && (cells[end].attributes & cell_width_bits) != 0) [[unlikely]]
         {
-            position.X = static_cast<SHORT>(_buffer_size.X - 1);
+            break_wide_glyph(cells, width, end, first, last);
         }
 
-        if (position.Y < 0)
+        store_cell_run(cells + column, text.data(), text.size(), attributes);
+        touch();
+        damage_rows(coord.Y, coord.Y, static_cast<SHORT>(first), static_cast<SHORT>(last), true);
+        return true;
+    }
+
+    bool ScreenBuffer::write_wide_cell(const COORD coord, const wchar_t character, const USHORT attributes) noexcept
+    {
+        if (!coord_in_range(coord) || coord.X + 1 >= _buffer_size.X)
         {
-            position.Y = 0;
+            return false;
         }
-        else if (position.Y >= _buffer_size.Y)
+
+        ScreenCell* const cells = materialize_row(coord.Y);
+        if (cells == nullptr)
         {
-            position.Y = static_cast<SHORT>(_buffer_size.Y - 1);
+            return false;
         }
 
+        const size_t width = static_cast<size_t>(_buffer_size.X);
+        const size_t column = static_cast<size_t>(coord.X);
+        size_t first = column;
+        size_t last = column + 1;
+        break_wide_glyph(cells, width, column, first, last);
+        break_wide_glyph(cells, width, column + 1, first, last);
+
+        const USHORT base = static_cast<USHORT>(attributes & ~cell_width_bits);
+        cells[column] = ScreenCell{ .character = character, .attributes = static_cast<USHORT>(base | COMMON_LVB_LEADING_BYTE) };
+        cells[column + 1] = ScreenCell{ .character = character, .attributes = static_cast<USHORT>(base | COMMON_LVB_TRAILING_BYTE) };
+        touch();
+        damage_rows(coord.Y, coord.Y, static_cast<SHORT>(first), static_cast<SHORT>(last), true);
         return true;
     }
 
-    void ScreenBuffer::set_vt_autowrap_enabled(const bool enabled) noexcept
+    std::optional<wchar_t> ScreenBuffer::try_intern_cluster(const std::wstring_view text) noexcept
     {
-        _vt_autowrap_enabled = enabled;
-        _vt_delayed_wrap_position.reset();
-        touch();
+        if (const auto character = _cluster_table.intern(text))
+        {
+            return character;
+        }
+        if (!_cluster_table.full())
+        {
+            return std::nullopt;
+        }
+        if (_cluster_interns_until_collection != 0)
+        {
+            --_cluster_interns_until_collection;
+            return std::nullopt;
+        }
+
+        collect_clusters();
+        return _cluster_table.intern(text);
     }
 
-    void ScreenBuffer::set_vt_delayed_wrap_position(std::optional<COORD> position) noexcept
+    wchar_t ScreenBuffer::intern_cluster(const std::wstring_view text) noexcept
     {
-        _vt_delayed_wrap_position = position;
+        return try_intern_cluster(text).value_or(L'\xFFFD');
     }
 
-    void ScreenBuffer::set_vt_origin_mode_enabled(const bool enabled) noexcept
+    void ScreenBuffer::collect_clusters() noexcept
     {
-        _vt_origin_mode_enabled = enabled;
-        touch();
+        _cluster_table.begin_collection();
+        const auto mark_rows = [&](const std::vector<ScreenRow>& rows, const size_t width) noexcept {
+            for (const auto& row : rows)
+            {
+                // Compact rows hold nothing above U+00FF, so only their blank can be a cluster.
+                _cluster_table.mark(row.blank.character);
+                if (!row.is_blank && !row.is_compact)
+                {
+                    _cluster_table.mark(row.cells.get(), std::min(width, row.capacity));
+                }
+            }
+        };
+
+        mark_rows(_rows, static_cast<size_t>(_buffer_size.X));
+        if (_vt_main_backup)
+        {
+            mark_rows(_vt_main_backup->rows, static_cast<size_t>(_vt_main_backup->buffer_size.X));
+        }
+
+        const size_t freed = _cluster_table.sweep();
+        const size_t cells = _rows.size() * static_cast<size_t>(_buffer_size.X);
+        _cluster_interns_until_collection = freed < cluster_collection_backoff ? std::max(cluster_collection_backoff, cells / 16) : 0;
     }
 
-    void ScreenBuffer::set_vt_insert_mode_enabled(const bool enabled) noexcept
+    USHORT ScreenBuffer::intern_attribute(const TextAttribute& attribute) noexcept
     {
-        if (_vt_insert_mode_enabled == enabled)
+        // Anything but an interned ID for an attribute with flags is the classic fallback.
+        const USHORT id = _attribute_table.intern(attribute);
+        if (attribute.flags == 0 || (id & extended_attribute_bit) != 0 || !_attribute_table.full())
         {
-            return;
+            return id;
+        }
+        if (_attribute_interns_until_collection != 0)
+        {
+            --_attribute_interns_until_collection;
+            return id;
         }
 
-        _vt_insert_mode_enabled = enabled;
-        touch();
+        collect_attributes();
+        return _attribute_table.intern(attribute);
     }
 
-    const std::array<COLORREF, 16>& ScreenBuffer::color_table() const noexcept
+    void ScreenBuffer::collect_attributes() noexcept
     {
-        return _color_table;
-    }
+        _attribute_table.begin_collection();
+        const auto mark_rows = [&](const std::vector<ScreenRow>& rows, const size_t width) noexcept {
+            for (const auto& row : rows)
+            {
+                _attribute_table.mark(row.blank.attributes);
+                if (row.is_compact)
+                {
+                    for (size_t run = 0; run < row.compact.run_count(); ++run)
+                    {
+                        _attribute_table.mark(row.compact.run_attributes(run));
+                    }
+                }
+                else if (!row.is_blank)
+                {
+                    _attribute_table.mark(row.cells.get(), std::min(width, row.capacity));
+                }
+            }
+        };
+        const auto mark_saved_cursor = [&](const std::optional<SavedCursorState>& state) noexcept {
+            if (state)
+            {
+                _attribute_table.mark(state->attributes);
+            }
+        };
 
-    void ScreenBuffer::set_color_table(const COLORREF (&table)[16]) noexcept
-    {
-        for (size_t i = 0; i < _color_table.size(); ++i)
+        mark_rows(_rows, static_cast<size_t>(_buffer_size.X));
+        _attribute_table.mark(_text_attributes);
+        _attribute_table.mark(_default_text_attributes);
+        mark_saved_cursor(_saved_cursor_state);
+        if (_vt_main_backup)
         {
-            _color_table[i] = table[i];
+            mark_rows(_vt_main_backup->rows, static_cast<size_t>(_vt_main_backup->buffer_size.X));
+            _attribute_table.mark(_vt_main_backup->text_attributes);
+            _attribute_table.mark(_vt_main_backup->default_text_attributes);
+            mark_saved_cursor(_vt_main_backup->saved_cursor_state);
         }
-        touch();
+
+        const size_t freed = _attribute_table.sweep();
+        const size_t cells = _rows.size() * static_cast<size_t>(_buffer_size.X);
+        _attribute_interns_until_collection = freed < attribute_collection_backoff ? std::max(attribute_collection_backoff, cells / 16) : 0;
     }
 
-    std::optional<ScreenBuffer::VtVerticalMargins> ScreenBuffer::vt_vertical_margins() const noexcept
+    wchar_t ScreenBuffer::client_character(const wchar_t character) noexcept
     {
-        return _vt_vertical_margins;
+        return is_cluster_character(character) ? intern_cluster(std::wstring_view(&character, 1)) : character;
     }
 
-    void ScreenBuffer::set_vt_vertical_margins(std::optional<VtVerticalMargins> margins) noexcept
+    void ScreenBuffer::intern_client_surrogates(ScreenCell* const cells, const size_t count) noexcept
     {
-        if (margins)
+        // A collection while this runs may see the units not yet replaced as cluster characters.
+        // That only keeps their entries alive a little longer.
+        for (size_t i = find_surrogate_cell(cells, count); i < count; i += 1 + find_surrogate_cell(cells + i + 1, count - i - 1))
         {
-            OC_ASSERT(margins->top >= 0);
-            OC_ASSERT(margins->bottom >= margins->top);
-            OC_ASSERT(_buffer_size.Y > 0);
-            OC_ASSERT(margins->bottom < _buffer_size.Y);
+            cells[i].character = client_character(cells[i].character);
         }
-
-        _vt_vertical_margins = margins;
-        touch();
     }
 
-    bool ScreenBuffer::set_vt_using_alternate_screen_buffer(
-        const bool enable,
-        const wchar_t fill_character,
-        const USHORT fill_attributes) noexcept
+    bool ScreenBuffer::extend_cluster(const COORD coord, const std::wstring_view units) noexcept
     {
-        if (enable)
+        if (!coord_in_range(coord) || units.empty())
         {
-            if (_vt_main_backup)
-            {
-                return true;
-            }
-
-            std::vector<ScreenCell> alt_cells;
-            try
-            {
-                alt_cells.assign(_cells.size(), ScreenCell{ .character = fill_character, .attributes = fill_attributes });
-            }
-            catch (...)
-            {
-                return false;
-            }
-
-            VtAlternateBufferBackup backup{};
-            backup.cells = std::move(_cells);
-            backup.cursor_position = _cursor_position;
-            backup.text_attributes = _text_attributes;
-            backup.default_text_attributes = _default_text_attributes;
-            backup.cursor_size = _cursor_size;
-            backup.cursor_visible = _cursor_visible;
-            backup.saved_cursor_state = _saved_cursor_state;
-            backup.vt_vertical_margins = _vt_vertical_margins;
-            backup.vt_delayed_wrap_position = _vt_delayed_wrap_position;
-            backup.vt_origin_mode_enabled = _vt_origin_mode_enabled;
+            return false;
+        }
 
-            _vt_main_backup = std::move(backup);
+        // Copy the current text out first: interning may move the pool it lives in.
+        const ScreenCell cell = cell_at(coord);
+        const std::wstring_view current = is_cluster_character(cell.character)
+            ? _cluster_table.text(cell.character)
+            : std::wstring_view(&cell.character, 1);
+        std::array<wchar_t, ClusterTable::max_length> text{};
+        if (current.empty() || current.size() + units.size() > text.size())
+        {
+            return false;
+        }
+        std::copy(current.begin(), current.end(), text.begin());
+        std::copy(units.begin(), units.end(), text.begin() + static_cast<ptrdiff_t>(current.size()));
 
-            _cells = std::move(alt_cells);
-            _cursor_position = COORD{ 0, 0 };
-            _saved_cursor_state.reset();
-            _vt_vertical_margins.reset();
-            _vt_delayed_wrap_position.reset();
-            touch();
-            return true;
+        const auto character = try_intern_cluster(std::wstring_view(text.data(), current.size() + units.size()));
+        if (!character)
+        {
+            return false;
         }
 
-        if (!_vt_main_backup)
+        ScreenCell* const cells = materialize_row(coord.Y);
+        if (cells == nullptr)
         {
-            return true;
+            return false;
         }
 
-        auto backup = std::move(*_vt_main_backup);
-        _vt_main_backup.reset();
+        const size_t column = static_cast<size_t>(coord.X);
+        size_t last = column;
+        cells[column].character = *character;
+        if ((cells[column].attributes & COMMON_LVB_LEADING_BYTE) != 0 && column + 1 < static_cast<size_t>(_buffer_size.X) &&
+            (cells[column + 1].attributes & COMMON_LVB_TRAILING_BYTE) != 0)
+        {
+            cells[column + 1].character = *character;
+            last = column + 1;
+        }
 
-        _cells = std::move(backup.cells);
-        _cursor_position = backup.cursor_position;
-        _text_attributes = backup.text_attributes;
-        _default_text_attributes = backup.default_text_attributes;
-        _cursor_size = backup.cursor_size;
-        _cursor_visible = backup.cursor_visible;
-        _saved_cursor_state = backup.saved_cursor_state;
-        _vt_vertical_margins = backup.vt_vertical_margins;
-        _vt_delayed_wrap_position = backup.vt_delayed_wrap_position;
-        _vt_origin_mode_enabled = backup.vt_origin_mode_enabled;
         touch();
+        damage_rows(coord.Y, coord.Y, coord.X, static_cast<SHORT>(last), true);
         return true;
     }
 
-    std::wstring_view ServerState::title(const bool original) const noexcept
+    bool ScreenBuffer::read_output_clusters(const COORD origin, const size_t length, std::vector<OutputCluster>& out) const noexcept
     {
-        if (original)
+        if (_cluster_table.empty() || !coord_in_range(origin) || length == 0)
         {
-            return _original_title;
+            return true;
         }
 
-        return _title;
-    }
+        // Two passes, so the second cannot fail once `out` has room.
+        const auto visit_clusters = [&](auto&& report) noexcept {
+            (void)walk_linear(origin, length, [&](const SHORT row, const size_t column, const size_t count, const size_t offset) noexcept {
+                const auto& source = row_at(row);
+                if (source.is_blank)
+                {
+                    if (is_cluster_character(source.blank.character) && (source.blank.attributes & COMMON_LVB_TRAILING_BYTE) == 0)
+                    {
+                        for (size_t i = 0; i < count; ++i)
+                        {
+                            report(offset + i, source.blank.character);
+                        }
+                    }
+                    return true;
+                }
 
-    bool ServerState::set_title(std::wstring title) noexcept
-    {
-        try
+                visit_row_cells(source, column, count, [&](const ScreenCell* const cells, const size_t n, const size_t done) noexcept {
+                    for (size_t i = find_surrogate_cell(cells, n); i < n; i += 1 + find_surrogate_cell(cells + i + 1, n - i - 1))
+                    {
+                        if ((cells[i].attributes & COMMON_LVB_TRAILING_BYTE) == 0)
+                        {
+                            report(offset + done + i, cells[i].character);
+                        }
+                    }
+                });
+                return true;
+            });
+        };
+
+        size_t found = 0;
+        visit_clusters([&](size_t, wchar_t) noexcept { ++found; });
+        if (found == 0)
         {
-            if (_original_title.empty())
-            {
-                _original_title = title;
-            }
-            _title = std::move(title);
             return true;
         }
-        catch (...)
-        {
-            return false;
-        }
-    }
 
-    bool ServerState::set_title(const std::wstring_view title) noexcept
-    {
         try
         {
-            if (_original_title.empty())
-            {
-                _original_title.assign(title);
-            }
-            _title.assign(title);
-            return true;
+            out.reserve(out.size() + found);
         }
         catch (...)
         {
             return false;
         }
+
+        visit_clusters([&](const size_t offset, const wchar_t character) noexcept {
+            out.push_back(OutputCluster{ .offset = offset, .text = _cluster_table.text(character) });
+        });
+        return true;
     }
 
-    std::expected<void, DeviceCommError> ServerState::set_alias(
-        std::wstring exe_name,
-        std::wstring source,
-        std::wstring target) noexcept
-    try
+    bool ScreenBuffer::insert_cells(const COORD coord, size_t count, const ScreenCell fill) noexcept
     {
-        if (source.empty())
+        if (!coord_in_range(coord))
         {
-            return std::unexpected(DeviceCommError{
-                .context = L"Console alias source was empty",
-                .win32_error = ERROR_INVALID_PARAMETER,
-            });
+            return false;
         }
 
-        if (target.empty())
+        ScreenCell* const cells = materialize_row(coord.Y);
+        if (cells == nullptr)
         {
-            const auto exe_iter = _aliases.find(exe_name);
-            if (exe_iter == _aliases.end())
-            {
-                return {};
-            }
+            return false;
+        }
 
-            auto& table = exe_iter->second;
-            const auto source_iter = table.find(source);
-            if (source_iter != table.end())
-            {
-                table.erase(source_iter);
-                if (table.empty())
-                {
-                    _aliases.erase(exe_iter);
-                }
-            }
+        const size_t width = static_cast<size_t>(_buffer_size.X);
+        const size_t column = static_cast<size_t>(coord.X);
+        count = std::min(count, width - column);
+        size_t first = column;
+        size_t last = width - 1;
 
-            return {};
+        // A glyph whose trailing half is at `column` is split by the shift.
+        if ((cells[column].attributes & COMMON_LVB_TRAILING_BYTE) != 0)
+        {
+            break_wide_glyph(cells, width, column, first, last);
+            cells[column] = ScreenCell{ .character = L' ', .attributes = static_cast<USHORT>(cells[column].attributes & ~cell_width_bits) };
         }
 
-        auto [exe_iter, inserted] = _aliases.try_emplace(std::move(exe_name));
-        (void)inserted;
+        std::move_backward(cells + column, cells + width - count, cells + width);
+        std::fill_n(cells + column, count, fill);
 
-        auto& table = exe_iter->second;
-        table.insert_or_assign(std::move(source), std::move(target));
-        return {};
-    }
-    catch (...)
-    {
-        return std::unexpected(DeviceCommError{
-            .context = L"Failed to store console alias data",
-            .win32_error = ERROR_OUTOFMEMORY,
-        });
+        // A glyph whose trailing half was pushed off the end.
+        ScreenCell& final_cell = cells[width - 1];
+        if (column + count < width && (final_cell.attributes & COMMON_LVB_LEADING_BYTE) != 0)
+        {
+            final_cell = ScreenCell{ .character = L' ', .attributes = static_cast<USHORT>(final_cell.attributes & ~cell_width_bits) };
+        }
+
+        touch();
+        damage_rows(coord.Y, coord.Y, static_cast<SHORT>(first), static_cast<SHORT>(last), true);
+        return true;
     }
 
-    std::optional<std::wstring_view> ServerState::try_get_alias(
-        const std::wstring_view exe_name,
-        const std::wstring_view source) const noexcept
+    bool ScreenBuffer::delete_cells(const COORD coord, size_t count, const ScreenCell fill) noexcept
     {
-        const auto exe_iter = _aliases.find(exe_name);
-        if (exe_iter == _aliases.end())
+        if (!coord_in_range(coord))
         {
-            return std::nullopt;
+            return false;
         }
 
-        const auto& table = exe_iter->second;
-        const auto source_iter = table.find(source);
-        if (source_iter == table.end())
+        ScreenCell* const cells = materialize_row(coord.Y);
+        if (cells == nullptr)
         {
-            return std::nullopt;
+            return false;
         }
 
-        if (source_iter->second.empty())
+        const size_t width = static_cast<size_t>(_buffer_size.X);
+        const size_t column = static_cast<size_t>(coord.X);
+        count = std::min(count, width - column);
+        size_t first = column;
+        size_t last = width - 1;
+
+        // Glyphs with one half deleted: one ending inside the range, one starting inside it.
+        if ((cells[column].attributes & COMMON_LVB_TRAILING_BYTE) != 0)
         {
-            return std::nullopt;
+            break_wide_glyph(cells, width, column, first, last);
         }
-
-        return std::wstring_view(source_iter->second);
-    }
-
-    bool ScreenBuffer::write_cell(const COORD coord, const wchar_t character, const USHORT attributes) noexcept
-    {
-        if (!coord_in_range(coord))
+        if (column + count < width && (cells[column + count].attributes & COMMON_LVB_TRAILING_BYTE) != 0)
         {
-            return false;
+            ScreenCell& orphan = cells[column + count];
+            orphan = ScreenCell{ .character = L' ', .attributes = static_cast<USHORT>(orphan.attributes & ~cell_width_bits) };
         }
 
-        const size_t index = linear_index(coord);
-        _cells[index].character = character;
-        _cells[index].attributes = attributes;
+        std::move(cells + column + count, cells + width, cells + column);
+        std::fill_n(cells + width - count, count, fill);
+
         touch();
+        damage_rows(coord.Y, coord.Y, static_cast<SHORT>(first), static_cast<SHORT>(last), true);
         return true;
     }
 
@@ -2921,41 +4597,59 @@ namespace oc::condrv
             return write_cell(coord, character, attributes);
         }
 
-        const size_t width = static_cast<size_t>(_buffer_size.X);
-        const size_t row = static_cast<size_t>(coord.Y);
-        const size_t column = static_cast<size_t>(coord.X);
-        const size_t base = row * width;
-        const size_t start = base + column;
-
-        auto begin = _cells.begin();
+        return insert_cells(coord, 1, ScreenCell{ .character = character, .attributes = attributes });
+    }
 
-        // Shift the remainder of the current line right by one cell and drop the final cell.
-        std::move_backward(
-            begin + start,
-            begin + (base + width - 1),
-            begin + (base + width));
+    bool ScreenBuffer::insert_wide_cell(const COORD coord, const wchar_t character, const USHORT attributes) noexcept
+    {
+        if (!coord_in_range(coord) || coord.X + 1 >= _buffer_size.X)
+        {
+            return false;
+        }
 
-        _cells[start] = ScreenCell{ .character = character, .attributes = attributes };
-        touch();
-        return true;
+        return insert_cells(coord, 2, ScreenCell{ .character = L' ', .attributes = static_cast<USHORT>(attributes & ~cell_width_bits) }) &&
+               write_wide_cell(coord, character, attributes);
     }
 
-    size_t ScreenBuffer::fill_output_characters(const COORD origin, const wchar_t value, const size_t length) noexcept
+    size_t ScreenBuffer::fill_output_characters(const COORD origin, wchar_t value, const size_t length) noexcept
     {
         if (!coord_in_range(origin) || length == 0)
         {
             return 0;
         }
 
+        value = client_character(value);
+
+        const auto width = static_cast<size_t>(_buffer_size.X);
+        size_t before = 0;
+        size_t after = 0;
+        const size_t written = walk_linear(origin, length, [&](const SHORT row, const size_t column, const size_t count, size_t) noexcept {
+            // Whole blank rows stay blank. Overwriting a whole row's text also ends any wrap.
+            auto& target = row_at(row);
+            if (count == width)
+            {
+                target.wrapped = false;
+            }
+            if (target.is_blank && count == width)
+            {
+                target.blank.character = value;
+                target.blank.attributes = static_cast<USHORT>(target.blank.attributes & ~cell_width_bits);
+                return true;
+            }
+
+            ScreenCell* const cells = materialize_row(row);
+            if (cells == nullptr)
+            {
+                return false;
+            }
+
+            clear_wide_span(cells, width, column, count, before, after);
+            fill_cell_characters(cells + column, count, value);
+            return true;
+        });
+
         touch();
-        size_t index = linear_index(origin);
-        size_t written = 0;
-        while (written < length && index < _cells.size())
-        {
-            _cells[index].character = value;
-            ++index;
-            ++written;
-        }
+        damage_linear(COORD{ static_cast<SHORT>(origin.X - before), origin.Y }, before + written + after, true);
         return written;
     }
 
@@ -2966,15 +4660,27 @@ namespace oc::condrv
             return 0;
         }
 
+        const auto width = static_cast<size_t>(_buffer_size.X);
+        const size_t written = walk_linear(origin, length, [&](const SHORT row, const size_t column, const size_t count, size_t) noexcept {
+            auto& target = row_at(row);
+            if (target.is_blank && count == width)
+            {
+                target.blank.attributes = value;
+                return true;
+            }
+
+            ScreenCell* const cells = materialize_row(row);
+            if (cells == nullptr)
+            {
+                return false;
+            }
+
+            fill_cell_attributes(cells + column, count, value);
+            return true;
+        });
+
         touch();
-        size_t index = linear_index(origin);
-        size_t written = 0;
-        while (written < length && index < _cells.size())
-        {
-            _cells[index].attributes = value;
-            ++index;
-            ++written;
-        }
+        damage_linear(origin, written, false);
         return written;
     }
 
@@ -2985,15 +4691,27 @@ namespace oc::condrv
             return 0;
         }
 
+        const auto width = static_cast<size_t>(_buffer_size.X);
+        size_t before = 0;
+        size_t after = 0;
+        const size_t written = walk_linear(origin, text.size(), [&](const SHORT row, const size_t column, const size_t count, const size_t offset) noexcept {
+            ScreenCell* const cells = materialize_row(row);
+            if (cells == nullptr)
+            {
+                return false;
+            }
+
+            clear_wide_span(cells, width, column, count, before, after);
+            store_cell_characters(cells + column, text.data() + offset, count);
+            if (const size_t first = find_surrogate_cell(cells + column, count); first != count) [[unlikely]]
+            {
+                intern_client_surrogates(cells + column + first, count - first);
+            }
+            return true;
+        });
+
         touch();
-        size_t index = linear_index(origin);
-        size_t written = 0;
-        while (written < text.size() && index < _cells.size())
-        {
-            _cells[index].character = text[written];
-            ++index;
-            ++written;
-        }
+        damage_linear(COORD{ static_cast<SHORT>(origin.X - before), origin.Y }, before + written + after, true);
         return written;
     }
 
@@ -3004,15 +4722,20 @@ namespace oc::condrv
             return 0;
         }
 
+        const size_t written = walk_linear(origin, attributes.size(), [&](const SHORT row, const size_t column, const size_t count, const size_t offset) noexcept {
+            ScreenCell* const cells = materialize_row(row);
+            if (cells == nullptr)
+            {
+                return false;
+            }
+
+            store_cell_attributes(cells + column, attributes.data() + offset, count);
+            clear_cell_attribute_bits(cells + column, count, extended_attribute_bit);
+            return true;
+        });
+
         touch();
-        size_t index = linear_index(origin);
-        size_t written = 0;
-        while (written < attributes.size() && index < _cells.size())
-        {
-            _cells[index].attributes = attributes[written];
-            ++index;
-            ++written;
-        }
+        damage_linear(origin, written, false);
         return written;
     }
 
@@ -3023,16 +4746,23 @@ namespace oc::condrv
             return 0;
         }
 
+        const auto width = static_cast<size_t>(_buffer_size.X);
+        size_t before = 0;
+        size_t after = 0;
+        const size_t written = walk_linear(origin, bytes.size(), [&](const SHORT row, const size_t column, const size_t count, const size_t offset) noexcept {
+            ScreenCell* const cells = materialize_row(row);
+            if (cells == nullptr)
+            {
+                return false;
+            }
+
+            clear_wide_span(cells, width, column, count, before, after);
+            store_cell_ascii(cells + column, bytes.data() + offset, count);
+            return true;
+        });
+
         touch();
-        size_t index = linear_index(origin);
-        size_t written = 0;
-        while (written < bytes.size() && index < _cells.size())
-        {
-            const auto value = static_cast<unsigned char>(bytes[written]);
-            _cells[index].character = static_cast<wchar_t>(value);
-            ++index;
-            ++written;
-        }
+        damage_linear(COORD{ static_cast<SHORT>(origin.X - before), origin.Y }, before + written + after, true);
         return written;
     }
 
@@ -3043,15 +4773,77 @@ namespace oc::condrv
             return 0;
         }
 
-        size_t index = linear_index(origin);
-        size_t read = 0;
-        while (read < dest.size() && index < _cells.size())
+        return walk_linear(origin, dest.size(), [&](const SHORT row, const size_t column, const size_t count, const size_t offset) noexcept {
+            const auto& source = row_at(row);
+            if (source.is_blank)
+            {
+                wchar_t blank = source.blank.character;
+                _cluster_table.to_classic(&blank, &source.blank, 1);
+                std::fill_n(dest.begin() + static_cast<ptrdiff_t>(offset), count, blank);
+                return true;
+            }
+
+            visit_row_cells(source, column, count, [&](const ScreenCell* const cells, const size_t n, const size_t done) noexcept {
+                load_cell_characters(dest.data() + offset + done, cells, n);
+                if (!_cluster_table.empty())
+                {
+                    _cluster_table.to_classic(dest.data() + offset + done, cells, n);
+                }
+            });
+            return true;
+        });
+    }
+
+    size_t ScreenBuffer::read_console_output_characters(const COORD origin, const std::span<wchar_t> dest) const noexcept
+    {
+        if (!coord_in_range(origin) || dest.empty())
         {
-            dest[read] = _cells[index].character;
-            ++index;
-            ++read;
+            return 0;
         }
-        return read;
+
+        // A trailing half is kept only when it reads as a low surrogate, the second unit of a pair
+        // whose first unit the leading half gave.
+        const auto skipped = [](const wchar_t character, const USHORT attributes) noexcept {
+            return (attributes & COMMON_LVB_TRAILING_BYTE) != 0 && (character < 0xDC00 || character > 0xDFFF);
+        };
+
+        // Never more units than cells, so each piece is loaded in place at `stored` and compacted.
+        size_t stored = 0;
+        (void)walk_linear(origin, dest.size(), [&](const SHORT row, const size_t column, const size_t count, size_t) noexcept {
+            const auto& source = row_at(row);
+            if (source.is_blank)
+            {
+                wchar_t blank = source.blank.character;
+                _cluster_table.to_classic(&blank, &source.blank, 1);
+                if (!skipped(blank, source.blank.attributes))
+                {
+                    std::fill_n(dest.begin() + static_cast<ptrdiff_t>(stored), count, blank);
+                    stored += count;
+                }
+                return true;
+            }
+
+            visit_row_cells(source, column, count, [&](const ScreenCell* const cells, const size_t n, size_t) noexcept {
+                wchar_t* const units = dest.data() + stored;
+                load_cell_characters(units, cells, n);
+                if (!_cluster_table.empty())
+                {
+                    _cluster_table.to_classic(units, cells, n);
+                }
+
+                size_t kept = 0;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    if (!skipped(units[i], cells[i].attributes))
+                    {
+                        units[kept++] = units[i];
+                    }
+                }
+                stored += kept;
+            });
+            return true;
+        });
+        return stored;
     }
 
     size_t ScreenBuffer::read_output_attributes(const COORD origin, const std::span<USHORT> dest) const noexcept
@@ -3061,15 +4853,20 @@ namespace oc::condrv
             return 0;
         }
 
-        size_t index = linear_index(origin);
-        size_t read = 0;
-        while (read < dest.size() && index < _cells.size())
-        {
-            dest[read] = _cells[index].attributes;
-            ++index;
-            ++read;
-        }
-        return read;
+        return walk_linear(origin, dest.size(), [&](const SHORT row, const size_t column, const size_t count, const size_t offset) noexcept {
+            const auto& source = row_at(row);
+            if (source.is_blank)
+            {
+                std::fill_n(dest.begin() + static_cast<ptrdiff_t>(offset), count, _attribute_table.legacy(source.blank.attributes));
+                return true;
+            }
+
+            visit_row_cells(source, column, count, [&](const ScreenCell* const cells, const size_t n, const size_t done) noexcept {
+                load_cell_attributes(dest.data() + offset + done, cells, n);
+                _attribute_table.to_legacy(dest.data() + offset + done, n);
+            });
+            return true;
+        });
     }
 
     size_t ScreenBuffer::read_output_ascii(const COORD origin, const std::span<std::byte> dest) const noexcept
@@ -3079,17 +4876,21 @@ namespace oc::condrv
             return 0;
         }
 
-        size_t index = linear_index(origin);
-        size_t read = 0;
-        while (read < dest.size() && index < _cells.size())
-        {
-            const wchar_t value = _cells[index].character;
-            const unsigned char narrowed = value <= 0xFF ? static_cast<unsigned char>(value) : static_cast<unsigned char>('?');
-            dest[read] = static_cast<std::byte>(narrowed);
-            ++index;
-            ++read;
-        }
-        return read;
+        return walk_linear(origin, dest.size(), [&](const SHORT row, const size_t column, const size_t count, const size_t offset) noexcept {
+            const auto& source = row_at(row);
+            if (source.is_blank)
+            {
+                std::byte narrowed{};
+                load_cell_ascii(&narrowed, &source.blank, 1);
+                std::fill_n(dest.begin() + static_cast<ptrdiff_t>(offset), count, narrowed);
+                return true;
+            }
+
+            visit_row_cells(source, column, count, [&](const ScreenCell* const cells, const size_t n, const size_t done) noexcept {
+                load_cell_ascii(dest.data() + offset + done, cells, n);
+            });
+            return true;
+        });
     }
 
     size_t ScreenBuffer::write_output_char_info_rect(
@@ -3097,7 +4898,7 @@ namespace oc::condrv
         const std::span<const CHAR_INFO> records,
         const bool unicode) noexcept
     {
-        if (_cells.empty())
+        if (_rows.empty())
         {
             return 0;
         }
@@ -3128,24 +4929,29 @@ namespace oc::condrv
             return 0;
         }
 
-        touch();
-        size_t index = 0;
+        // Materializing is invisible, so doing it up front keeps an allocation failure from
+        // leaving a partially written rectangle.
         for (SHORT y = region.Top; y <= region.Bottom; ++y)
         {
-            for (SHORT x = region.Left; x <= region.Right; ++x)
+            if (materialize_row(y) == nullptr)
             {
-                const auto& info = records[index];
-                const wchar_t value = unicode
-                    ? info.Char.UnicodeChar
-                    : static_cast<wchar_t>(static_cast<unsigned char>(info.Char.AsciiChar));
+                return 0;
+            }
+        }
 
-                const size_t cell_index = linear_index(COORD{ x, y });
-                _cells[cell_index].character = value;
-                _cells[cell_index].attributes = info.Attributes;
-                ++index;
+        touch();
+        for (size_t y = 0; y < height; ++y)
+        {
+            ScreenCell* const cells = row_at(static_cast<SHORT>(region.Top + y)).cells.get();
+            store_cell_char_info(cells + region.Left, records.data() + y * width, width, unicode);
+            clear_cell_attribute_bits(cells + region.Left, width, extended_attribute_bit);
+            if (const size_t first = find_surrogate_cell(cells + region.Left, width); first != width) [[unlikely]]
+            {
+                intern_client_surrogates(cells + region.Left + first, width - first);
             }
         }
 
+        damage_rect(region, true);
         return needed;
     }
 
@@ -3154,7 +4960,7 @@ namespace oc::condrv
         const std::span<CHAR_INFO> records,
         const bool unicode) const noexcept
     {
-        if (_cells.empty())
+        if (_rows.empty())
         {
             return 0;
         }
@@ -3185,31 +4991,29 @@ namespace oc::condrv
             return 0;
         }
 
-        size_t index = 0;
-        for (SHORT y = region.Top; y <= region.Bottom; ++y)
+        for (size_t y = 0; y < height; ++y)
         {
-            for (SHORT x = region.Left; x <= region.Right; ++x)
+            const auto& source = row_at(static_cast<SHORT>(region.Top + y));
+            CHAR_INFO* const dest = records.data() + y * width;
+            if (source.is_blank)
             {
-                const size_t cell_index = linear_index(COORD{ x, y });
-                const auto& cell = _cells[cell_index];
-
-                CHAR_INFO info{};
-                info.Attributes = cell.attributes;
+                ScreenCell blank{ .character = source.blank.character, .attributes = _attribute_table.legacy(source.blank.attributes) };
                 if (unicode)
                 {
-                    info.Char.UnicodeChar = cell.character;
+                    _cluster_table.to_classic(&blank.character, &source.blank, 1);
                 }
-                else
+                std::fill_n(dest, width, to_char_info(blank, unicode));
+                continue;
+            }
+
+            visit_row_cells(source, static_cast<size_t>(region.Left), width, [&](const ScreenCell* const cells, const size_t n, const size_t done) noexcept {
+                load_cell_char_info(dest + done, cells, n, unicode);
+                _attribute_table.to_legacy(dest + done, n);
+                if (unicode && !_cluster_table.empty())
                 {
-                    const unsigned char narrowed = cell.character <= 0xFF
-                        ? static_cast<unsigned char>(cell.character)
-                        : static_cast<unsigned char>('?');
-                    info.Char.AsciiChar = static_cast<CHAR>(narrowed);
+                    _cluster_table.to_classic(dest + done, cells, n);
                 }
-
-                records[index] = info;
-                ++index;
-            }
+            });
         }
 
         return needed;
@@ -3219,10 +5023,10 @@ namespace oc::condrv
         const SMALL_RECT scroll_rectangle,
         const SMALL_RECT clip_rectangle,
         const COORD destination_origin,
-        const wchar_t fill_character,
+        wchar_t fill_character,
         const USHORT fill_attributes) noexcept
     {
-        if (_cells.empty())
+        if (_rows.empty())
         {
             return false;
         }
@@ -3232,6 +5036,8 @@ namespace oc::condrv
             return true;
         }
 
+        fill_character = client_character(fill_character);
+
         if (!coord_in_range(COORD{ scroll_rectangle.Left, scroll_rectangle.Top }) ||
             !coord_in_range(COORD{ scroll_rectangle.Right, scroll_rectangle.Bottom }))
         {
@@ -3247,87 +5053,388 @@ namespace oc::condrv
             return true;
         }
 
-        touch();
-        const size_t width = static_cast<size_t>(width_long);
-        const size_t height = static_cast<size_t>(height_long);
-        const size_t cell_count = width * height;
-
-        std::vector<ScreenCell> saved;
-        try
-        {
-            saved.resize(cell_count);
-        }
-        catch (...)
+        if (try_rotate_rows(scroll_rectangle, clip_rectangle, destination_origin, fill_character, fill_attributes))
         {
-            return false;
+            return true;
         }
 
-        const auto clip_contains = [&](const SHORT x, const SHORT y) noexcept -> bool {
-            return x >= clip_rectangle.Left &&
-                   x <= clip_rectangle.Right &&
-                   y >= clip_rectangle.Top &&
-                   y <= clip_rectangle.Bottom;
-        };
+        const long delta_x = static_cast<long>(destination_origin.X) - static_cast<long>(scroll_rectangle.Left);
+        const long delta_y = static_cast<long>(destination_origin.Y) - static_cast<long>(scroll_rectangle.Top);
 
-        size_t index = 0;
-        for (SHORT y = scroll_rectangle.Top; y <= scroll_rectangle.Bottom; ++y)
-        {
-            for (SHORT x = scroll_rectangle.Left; x <= scroll_rectangle.Right; ++x)
-            {
-                saved[index] = _cells[linear_index(COORD{ x, y })];
+        const long max_x = static_cast<long>(_buffer_size.X) - 1;
+        const long max_y = static_cast<long>(_buffer_size.Y) - 1;
 
-                if (clip_contains(x, y))
+        // Everything below works on rectangles intersected up front:
+        // - `moved`: destination cells that receive a source cell (the destination clipped to the clip rectangle and the buffer);
+        // - `vacated`: source cells inside the clip; those not in `moved` take the fill.
+        // A rectangle is empty when left > right or top > bottom.
+        const long moved_left = std::max({ static_cast<long>(scroll_rectangle.Left) + delta_x, static_cast<long>(clip_rectangle.Left), 0L });
+        const long moved_right = std::min({ static_cast<long>(scroll_rectangle.Right) + delta_x, static_cast<long>(clip_rectangle.Right), max_x });
+        const long moved_top = std::max({ static_cast<long>(scroll_rectangle.Top) + delta_y, static_cast<long>(clip_rectangle.Top), 0L });
+        const long moved_bottom = std::min({ static_cast<long>(scroll_rectangle.Bottom) + delta_y, static_cast<long>(clip_rectangle.Bottom), max_y });
+        const bool any_moved = moved_left <= moved_right && moved_top <= moved_bottom;
+
+        const long vacated_left = std::max(static_cast<long>(scroll_rectangle.Left), static_cast<long>(clip_rectangle.Left));
+        const long vacated_right = std::min(static_cast<long>(scroll_rectangle.Right), static_cast<long>(clip_rectangle.Right));
+        const long vacated_top = std::max(static_cast<long>(scroll_rectangle.Top), static_cast<long>(clip_rectangle.Top));
+        const long vacated_bottom = std::min(static_cast<long>(scroll_rectangle.Bottom), static_cast<long>(clip_rectangle.Bottom));
+        const bool any_vacated = vacated_left <= vacated_right && vacated_top <= vacated_bottom;
+
+        const ScreenCell fill{ .character = fill_character, .attributes = fill_attributes };
+        const bool vacated_whole_rows = vacated_left == 0 && vacated_right == max_x;
+
+        // Materialize every row this scroll writes cell by cell before changing anything, so an
+        // allocation failure leaves the buffer untouched. Rows whose vacated span is the whole row
+        // and that receive nothing just turn blank.
+        const auto materialize_rows = [&](const long top, const long bottom, const bool skip_whole_fill) noexcept -> bool {
+            for (long y = top; y <= bottom; ++y)
+            {
+                if (skip_whole_fill && !(any_moved && y >= moved_top && y <= moved_bottom))
                 {
-                    _cells[linear_index(COORD{ x, y })] = ScreenCell{ .character = fill_character, .attributes = fill_attributes };
+                    continue;
                 }
 
-                ++index;
+                if (materialize_row(static_cast<SHORT>(y)) == nullptr)
+                {
+                    return false;
+                }
             }
+            return true;
+        };
+
+        if ((any_moved && !materialize_rows(moved_top, moved_bottom, false)) ||
+            (any_vacated && !materialize_rows(vacated_top, vacated_bottom, vacated_whole_rows)))
+        {
+            return false;
         }
 
-        const long delta_x = static_cast<long>(destination_origin.X) - static_cast<long>(scroll_rectangle.Left);
-        const long delta_y = static_cast<long>(destination_origin.Y) - static_cast<long>(scroll_rectangle.Top);
+        touch();
 
-        const long max_x = static_cast<long>(_buffer_size.X) - 1;
-        const long max_y = static_cast<long>(_buffer_size.Y) - 1;
+        // Rows are separate allocations, so only rows moving onto themselves (`delta_y == 0`)
+        // overlap. Walking away from the direction of travel reads every source row before it
+        // is overwritten; `memmove` handles the horizontal overlap within a row.
+        static_assert(std::is_trivially_copyable_v<ScreenCell>);
+        if (any_moved)
+        {
+            const auto span = static_cast<size_t>(moved_right - moved_left + 1);
+            const auto source_left = static_cast<size_t>(moved_left - delta_x);
+            const bool whole_rows = span == static_cast<size_t>(_buffer_size.X);
+            const auto move_row = [&](const long y) noexcept {
+                auto& target_row = row_at(static_cast<SHORT>(y));
+                ScreenCell* const target = target_row.cells.get() + moved_left;
+                const auto& source = row_at(static_cast<SHORT>(y - delta_y));
+                if (whole_rows)
+                {
+                    target_row.wrapped = source.wrapped;
+                }
+                if (source.is_blank || source.is_compact)
+                {
+                    // Moved rows are all materialized, so a row in either format is not a destination.
+                    copy_row_cells(source, source_left, span, target);
+                }
+                else
+                {
+                    std::memmove(target, source.cells.get() + source_left, span * sizeof(ScreenCell));
+                }
+            };
 
-        index = 0;
-        for (SHORT y = scroll_rectangle.Top; y <= scroll_rectangle.Bottom; ++y)
-        {
-            for (SHORT x = scroll_rectangle.Left; x <= scroll_rectangle.Right; ++x)
+            if (delta_y > 0)
+            {
+                for (long y = moved_bottom; y >= moved_top; --y)
+                {
+                    move_row(y);
+                }
+            }
+            else
             {
-                const long dest_x = static_cast<long>(x) + delta_x;
-                const long dest_y = static_cast<long>(y) + delta_y;
+                for (long y = moved_top; y <= moved_bottom; ++y)
+                {
+                    move_row(y);
+                }
+            }
+        }
 
-                if (dest_x < 0 || dest_y < 0 || dest_x > max_x || dest_y > max_y)
+        // Fill the vacated cells that nothing moved onto: per row, the vacated span minus the
+        // moved span, which leaves at most one piece on each side.
+        if (any_vacated)
+        {
+            for (long y = vacated_top; y <= vacated_bottom; ++y)
+            {
+                const bool row_received = any_moved && y >= moved_top && y <= moved_bottom;
+                if (!row_received && vacated_whole_rows)
                 {
-                    ++index;
+                    auto& row = row_at(static_cast<SHORT>(y));
+                    row.blank = fill;
+                    row.is_blank = true;
+                    row.is_compact = false;
+                    row.compact.reset();
+                    row.wrapped = false;
                     continue;
                 }
 
-                const auto dx = static_cast<SHORT>(dest_x);
-                const auto dy = static_cast<SHORT>(dest_y);
-                if (!clip_contains(dx, dy))
+                ScreenCell* const cells = row_at(static_cast<SHORT>(y)).cells.get();
+                const auto fill_span = [&](const long left, const long right) noexcept {
+                    if (left <= right)
+                    {
+                        fill_cells(cells + left, static_cast<size_t>(right - left + 1), fill);
+                    }
+                };
+
+                if (!row_received)
                 {
-                    ++index;
+                    fill_span(vacated_left, vacated_right);
                     continue;
                 }
 
-                _cells[linear_index(COORD{ dx, dy })] = saved[index];
-                ++index;
+                fill_span(vacated_left, std::min(vacated_right, moved_left - 1));
+                fill_span(std::max(vacated_left, moved_right + 1), vacated_right);
+            }
+        }
+
+        // Both the vacated source and the destination may have changed, each only inside the clip.
+        const auto clipped = [&](const long left, const long top, const long right, const long bottom) noexcept -> SMALL_RECT {
+            return SMALL_RECT{
+                static_cast<SHORT>(std::clamp(std::max(left, static_cast<long>(clip_rectangle.Left)), -1L, max_x + 1)),
+                static_cast<SHORT>(std::clamp(std::max(top, static_cast<long>(clip_rectangle.Top)), -1L, max_y + 1)),
+                static_cast<SHORT>(std::clamp(std::min(right, static_cast<long>(clip_rectangle.Right)), -1L, max_x + 1)),
+                static_cast<SHORT>(std::clamp(std::min(bottom, static_cast<long>(clip_rectangle.Bottom)), -1L, max_y + 1)),
+            };
+        };
+
+        damage_rect(clipped(scroll_rectangle.Left, scroll_rectangle.Top, scroll_rectangle.Right, scroll_rectangle.Bottom), true);
+        damage_rect(
+            clipped(
+                destination_origin.X,
+                destination_origin.Y,
+                static_cast<long>(destination_origin.X) + width_long - 1,
+                static_cast<long>(destination_origin.Y) + height_long - 1),
+            true);
+        return true;
+    }
+
+    bool ScreenBuffer::try_rotate_rows(
+        const SMALL_RECT scroll_rectangle,
+        const SMALL_RECT clip_rectangle,
+        const COORD destination_origin,
+        const wchar_t fill_character,
+        const USHORT fill_attributes) noexcept
+    {
+        const long width = static_cast<long>(_buffer_size.X);
+        const long height = static_cast<long>(_buffer_size.Y);
+
+        // Whole rows only, moved vertically, with nothing clipped.
+        if (scroll_rectangle.Left != 0 || scroll_rectangle.Right != width - 1 || destination_origin.X != 0 ||
+            clip_rectangle.Left > 0 || clip_rectangle.Top > 0 || clip_rectangle.Right < width - 1 || clip_rectangle.Bottom < height - 1)
+        {
+            return false;
+        }
+
+        const long top = scroll_rectangle.Top;
+        const long bottom = scroll_rectangle.Bottom;
+        const long delta = static_cast<long>(destination_origin.Y) - top;
+        if (delta == 0 || delta <= -height || delta >= height)
+        {
+            return false;
+        }
+
+        const long shift = delta < 0 ? -delta : delta;
+        long exposed_first = 0;
+        if (delta < 0)
+        {
+            // Up: every surviving row must come from the source (it reaches row 0 and the buffer
+            // bottom), and the exposed bottom rows must lie inside it so the copy path would fill them.
+            if (bottom != height - 1 || destination_origin.Y > 0 || top > height - shift)
+            {
+                return false;
+            }
+
+            _row_offset = static_cast<size_t>((static_cast<long>(_row_offset) + shift) % height);
+            exposed_first = height - shift;
+        }
+        else
+        {
+            // Down: the mirror image, anchored at row 0.
+            if (top != 0 || bottom < std::max(height - 1 - shift, shift - 1))
+            {
+                return false;
+            }
+
+            _row_offset = static_cast<size_t>((static_cast<long>(_row_offset) + height - shift) % height);
+            exposed_first = 0;
+        }
+
+        touch();
+        damage_all_rows();
+        const ScreenCell fill{ .character = fill_character, .attributes = fill_attributes };
+        for (long row = exposed_first; row < exposed_first + shift; ++row)
+        {
+            auto& exposed = row_at(static_cast<SHORT>(row));
+            exposed.blank = fill;
+            exposed.is_blank = true;
+            exposed.is_compact = false;
+            exposed.compact.reset();
+            exposed.wrapped = false;
+        }
+
+        // Scrolling up pushes the rows at the top of the window into scrollback.
+        if (delta < 0)
+        {
+            compact_rows(static_cast<long>(_window_rect.Top) - shift, _window_rect.Top);
+        }
+
+        return true;
+    }
+
+    bool ScreenBuffer::collect_damage(const uint64_t since, ScreenDamage& out) noexcept
+    {
+        const size_t height = _row_damage.size();
+        const size_t words = (height + 63) / 64;
+        try
+        {
+            out.rows.assign(words, 0);
+            out.attribute_only_rows.assign(words, 0);
+            out.extents.resize(height);
+        }
+        catch (...)
+        {
+            return false;
+        }
+
+        out.revision = _revision;
+        out.all_rows = _all_rows_damage_revision > since;
+        out.viewport = _viewport_damage_revision > since;
+        out.cursor = _cursor_damage_revision > since;
+        out.palette = _palette_damage_revision > since;
+
+        const ColumnExtent full_row{ .left = 0, .right = static_cast<SHORT>(_buffer_size.X > 0 ? _buffer_size.X - 1 : 0) };
+        for (size_t row = 0; row < height; ++row)
+        {
+            const auto& damage = _row_damage[row];
+            if (!out.all_rows && damage.revision <= since)
+            {
+                continue;
+            }
+
+            const uint64_t bit = uint64_t{ 1 } << (row % 64);
+            out.rows[row / 64] |= bit;
+            if (out.all_rows)
+            {
+                out.extents[row] = full_row;
+                continue;
+            }
+
+            if (damage.text_revision <= since)
+            {
+                out.attribute_only_rows[row / 64] |= bit;
             }
+
+            // The stored extent only covers changes after `extent_base`; older consumers get the full row.
+            out.extents[row] = since >= damage.extent_base ? damage.extent : full_row;
         }
 
+        _damage_reported_revision = std::max(_damage_reported_revision, _revision);
         return true;
     }
 
+    void ScreenBuffer::damage_rows(
+        const SHORT first_row,
+        const SHORT last_row,
+        const SHORT left,
+        const SHORT right,
+        const bool text) noexcept
+    {
+        for (long row = first_row; row <= static_cast<long>(last_row); ++row)
+        {
+            auto& damage = _row_damage[static_cast<size_t>(row)];
+            if (damage.revision <= _damage_reported_revision)
+            {
+                // The previous extent has been handed out; start a new one from that generation.
+                damage.extent_base = _damage_reported_revision;
+                damage.extent = ColumnExtent{ .left = left, .right = right };
+            }
+            else
+            {
+                damage.extent.left = std::min(damage.extent.left, left);
+                damage.extent.right = std::max(damage.extent.right, right);
+            }
+
+            damage.revision = _revision;
+            if (text)
+            {
+                damage.text_revision = _revision;
+            }
+        }
+    }
+
+    void ScreenBuffer::damage_linear(const COORD origin, const size_t count, const bool text) noexcept
+    {
+        if (count == 0 || !coord_in_range(origin))
+        {
+            return;
+        }
+
+        const size_t width = static_cast<size_t>(_buffer_size.X);
+        const size_t start = static_cast<size_t>(origin.Y) * width + static_cast<size_t>(origin.X);
+        const size_t end = std::min(start + count, _rows.size() * width) - 1;
+        const auto first_row = static_cast<SHORT>(start / width);
+        const auto last_row = static_cast<SHORT>(end / width);
+        const auto last_column = static_cast<SHORT>(width - 1);
+        if (first_row == last_row)
+        {
+            damage_rows(first_row, first_row, origin.X, static_cast<SHORT>(end % width), text);
+            return;
+        }
+
+        damage_rows(first_row, first_row, origin.X, last_column, text);
+        if (last_row - first_row > 1)
+        {
+            damage_rows(static_cast<SHORT>(first_row + 1), static_cast<SHORT>(last_row - 1), 0, last_column, text);
+        }
+        damage_rows(last_row, last_row, 0, static_cast<SHORT>(end % width), text);
+    }
+
+    void ScreenBuffer::damage_rect(const SMALL_RECT rect, const bool text) noexcept
+    {
+        const SHORT left = std::max<SHORT>(rect.Left, 0);
+        const SHORT top = std::max<SHORT>(rect.Top, 0);
+        const SHORT right = std::min<SHORT>(rect.Right, static_cast<SHORT>(_buffer_size.X - 1));
+        const SHORT bottom = std::min<SHORT>(rect.Bottom, static_cast<SHORT>(_buffer_size.Y - 1));
+        if (_row_damage.empty() || left > right || top > bottom)
+        {
+            return;
+        }
+
+        damage_rows(top, bottom, left, right, text);
+    }
+
+    void ScreenBuffer::damage_all_rows() noexcept
+    {
+        _all_rows_damage_revision = _revision;
+    }
+
+    void ScreenBuffer::damage_cursor() noexcept
+    {
+        _cursor_damage_revision = _revision;
+    }
+
+    void ScreenBuffer::damage_viewport() noexcept
+    {
+        _viewport_damage_revision = _revision;
+    }
+
+    void ScreenBuffer::damage_palette() noexcept
+    {
+        _palette_damage_revision = _revision;
+    }
+
     std::expected<DWORD, ServerError> ConDrvServer::run(
         const core::HandleView server_handle,
         const core::HandleView signal_handle,
         const core::HandleView host_input,
         const core::HandleView host_output,
         const core::HandleView host_signal_pipe,
-        logging::Logger& logger) noexcept
+        logging::Logger& logger,
+        const ServerRunOptions options) noexcept
     try
     {
         return run_loop(
@@ -3340,7 +5447,8 @@ namespace oc::condrv
             nullptr,
             {},
             nullptr,
-            logger);
+            logger,
+            options);
     }
     catch (...)
     {
@@ -3355,7 +5463,8 @@ namespace oc::condrv
         const core::HandleView host_signal_pipe,
         logging::Logger& logger,
         std::shared_ptr<view::PublishedScreenBuffer> published,
-        const HWND paint_target) noexcept
+        const HWND paint_target,
+        const ServerRunOptions options) noexcept
     try
     {
         return run_loop(
@@ -3368,7 +5477,8 @@ namespace oc::condrv
             nullptr,
             std::move(published),
             paint_target,
-            logger);
+            logger,
+            options);
     }
     catch (...)
     {
@@ -3383,7 +5493,8 @@ namespace oc::condrv
         const core::HandleView host_output,
         const core::HandleView host_signal_pipe,
         const IoPacket& initial_packet,
-        logging::Logger& logger) noexcept
+        logging::Logger& logger,
+        const ServerRunOptions options) noexcept
     try
     {
         return run_loop(
@@ -3396,7 +5507,8 @@ namespace oc::condrv
             &initial_packet,
             {},
             nullptr,
-            logger);
+            logger,
+            options);
     }
     catch (...)
     {
@@ -3413,7 +5525,8 @@ namespace oc::condrv
         const IoPacket& initial_packet,
         logging::Logger& logger,
         std::shared_ptr<view::PublishedScreenBuffer> published,
-        const HWND paint_target) noexcept
+        const HWND paint_target,
+        const ServerRunOptions options) noexcept
     try
     {
         return run_loop(
@@ -3426,7 +5539,8 @@ namespace oc::condrv
             &initial_packet,
             std::move(published),
             paint_target,
-            logger);
+            logger,
+            options);
     }
     catch (...)
     {
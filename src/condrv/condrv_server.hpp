@@ -19,6 +19,8 @@
 // - Input-dependent requests must not block the server loop.
 // - When an operation cannot make progress yet and waiting is allowed, the
 //   request is retained and retried later when input arrives.
+// - Retained requests live in a `BasicWaitQueue` keyed by handle, process and wait
+//   reason; `service_wait_queue` retries only the waiters a wake may have unblocked.
 // - See `new/docs/design/condrv_reply_pending_wait_queue.md`.
 //
 // Current scope (incremental):
@@ -34,15 +36,34 @@
 //   - ScrollConsoleScreenBuffer and Get/SetTitle
 // - other operations are rejected with STATUS_NOT_IMPLEMENTED
 //
+// USER_DEFINED dispatch:
+// - Each API is a `detail::handle_*` function; `detail::user_defined_dispatch_table`
+//   maps `(layer, index)` from the API number to its handler at compile time.
+// - See `new/docs/design/condrv_user_defined_dispatch_table.md`.
+//
+// Deferred output mirroring:
+// - When output is passed through to a terminal, WriteConsole and RAW_WRITE only log the text
+//   for the screen buffer; the log is applied before any request that reads or changes the model.
+// - See `new/docs/design/condrv_deferred_output_mirroring.md`.
+//
 // See also:
 // - `new/docs/conhost_behavior_imitation_matrix.md`
 // - `new/docs/design/condrv_raw_io_parity.md`
 // - `new/tests/condrv_server_dispatch_tests.cpp` (large unit-test suite)
 
 #include "condrv/condrv_api_message.hpp"
+#include "condrv/condrv_api_metrics.hpp"
 #include "condrv/condrv_device_comm.hpp"
+#include "condrv/condrv_wait_queue.hpp"
 #include "condrv/command_history.hpp"
+#include "condrv/attribute_table.hpp"
+#include "condrv/cluster_table.hpp"
+#include "condrv/compact_row.hpp"
+#include "condrv/screen_cell_span.hpp"
+#include "condrv/screen_damage.hpp"
 #include "condrv/screen_buffer_snapshot.hpp"
+#include "condrv/unicode_width.hpp"
+#include "condrv/vt_output_parser.hpp"
 #include "view/screen_buffer_snapshot.hpp"
 #include "condrv/vt_input_decoder.hpp"
 #include "core/assert.hpp"
@@ -66,6 +87,8 @@
 #include <optional>
 #include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -79,56 +102,6 @@ namespace oc::logging
     class ScreenBuffer;
     class ServerState;
 
-    namespace detail
-    {
-        struct VtCsiSequence final
-        {
-            wchar_t final{};
-            bool private_marker{};
-            bool exclamation_marker{};
-            std::array<unsigned, 16> params{};
-            size_t param_count{};
-        };
-
-        struct VtOutputParseState final
-        {
-            enum class Phase : unsigned char
-            {
-                ground,
-                escape,
-                esc_dispatch,
-                csi,
-                osc,
-                osc_escape,
-                string,
-                string_escape,
-            };
-
-            Phase phase{ Phase::ground };
-
-            // ESC dispatch parsing state: intermediate bytes (0x20..0x2F) followed by a final byte (0x30..0x7E).
-            std::array<wchar_t, 8> esc_intermediates{};
-            size_t esc_intermediate_count{};
-            size_t esc_length{};
-
-            // CSI parsing state.
-            VtCsiSequence csi{};
-            unsigned csi_current{};
-            bool csi_have_digits{};
-            bool csi_last_was_separator{};
-            size_t csi_length{};
-
-            // OSC parsing state (only a small subset is dispatched; the rest is consumed).
-            unsigned osc_param{};
-            bool osc_param_have_digits{};
-            bool osc_in_param{ true };
-            unsigned osc_action{};
-            bool osc_capture_payload{};
-            std::array<wchar_t, 4096> osc_payload{};
-            size_t osc_payload_length{};
-        };
-    }
-
     template<typename HostIo>
     inline void apply_text_to_screen_buffer(
         ScreenBuffer& screen_buffer,
@@ -137,6 +110,25 @@ namespace oc::logging
         ServerState* title_state,
         HostIo* host_io) noexcept;
 
+    template<typename HostIo>
+    inline void apply_utf8_to_screen_buffer(
+        ScreenBuffer& screen_buffer,
+        std::string_view utf8,
+        ULONG output_mode,
+        ServerState* title_state,
+        HostIo* host_io) noexcept;
+
+    namespace detail
+    {
+        template<typename HostIo, typename Unit>
+        inline void apply_output_to_screen_buffer(
+            ScreenBuffer& screen_buffer,
+            std::basic_string_view<Unit> input,
+            ULONG output_mode,
+            ServerState* title_state,
+            HostIo* host_io) noexcept;
+    }
+
     class ScreenBuffer final
     {
     public:
@@ -160,6 +152,9 @@ namespace oc::logging
         explicit ScreenBuffer(Settings settings);
 
         [[nodiscard]] COORD screen_buffer_size() const noexcept;
+        // Resizes the active screen. A width change on the main screen reflows soft-wrapped lines
+        // to the new width (see `row_wrapped`). While the VT alternate screen is active only the
+        // alternate screen is resized, by clipping; the preserved main buffer keeps its own size.
         [[nodiscard]] bool set_screen_buffer_size(COORD size) noexcept;
 
         // Monotonically increasing revision counter used to detect visible changes.
@@ -169,6 +164,24 @@ namespace oc::logging
             return _revision;
         }
 
+        // Fills `out` with the row damage recorded after generation `since` (0 reports everything);
+        // see `condrv/screen_damage.hpp`. `out` is reused across calls so steady-state collection does
+        // not allocate. Returns false only when `out` cannot be grown.
+        [[nodiscard]] bool collect_damage(uint64_t since, ScreenDamage& out) noexcept;
+
+        // Rows that currently own cell storage (the rest are blank or compact and cost no cells).
+        [[nodiscard]] size_t materialized_row_count() const noexcept;
+        // Rows held in the compact encoding (see `CompactRow`).
+        [[nodiscard]] size_t compact_row_count() const noexcept;
+        // Rows that own compact storage, whether or not they are currently read from it.
+        [[nodiscard]] size_t compact_storage_row_count() const noexcept;
+
+        // Whether `row` soft-wrapped into the next row, i.e. output ran past its last column rather
+        // than ending it with a line feed. Resizing to a new width reflows runs of wrapped rows as
+        // one logical line. Out-of-range rows read as not wrapped and ignore updates.
+        [[nodiscard]] bool row_wrapped(SHORT row) const noexcept;
+        void set_row_wrapped(SHORT row, bool wrapped) noexcept;
+
         [[nodiscard]] COORD cursor_position() const noexcept;
         void set_cursor_position(COORD position) noexcept;
 
@@ -182,11 +195,100 @@ namespace oc::logging
 
         [[nodiscard]] COORD maximum_window_size() const noexcept;
 
+        // Attribute words in cells and in the calls below are attribute IDs: a classic `WORD`
+        // attribute is its own ID, and `intern_attribute` assigns IDs to attributes it cannot express
+        // (see `AttributeTable`). Clients' words go through `attribute_id_from_legacy`. The classic
+        // reads (`read_output_attributes`, `read_output_char_info_rect`) report `legacy_attributes`.
+        // When the table is full, IDs that no cell or cursor state holds any more are reclaimed
+        // first, so an ID is only valid while something in the buffer uses it.
         [[nodiscard]] USHORT text_attributes() const noexcept;
         [[nodiscard]] USHORT default_text_attributes() const noexcept;
         void set_text_attributes(USHORT attributes) noexcept;
         void set_default_text_attributes(USHORT attributes) noexcept;
 
+        [[nodiscard]] USHORT intern_attribute(const TextAttribute& attribute) noexcept;
+
+        [[nodiscard]] TextAttribute attribute(const USHORT id) const noexcept
+        {
+            return _attribute_table.lookup(id);
+        }
+
+        [[nodiscard]] USHORT legacy_attributes(const USHORT id) const noexcept
+        {
+            return _attribute_table.legacy(id);
+        }
+
+        // The attribute ID in the cell at `coord`, half flags included; 0 outside the buffer.
+        [[nodiscard]] USHORT cell_attribute_id(const COORD coord) const noexcept
+        {
+            return coord_in_range(coord) ? cell_at(coord).attributes : 0;
+        }
+
+        [[nodiscard]] size_t interned_attribute_count() const noexcept
+        {
+            return _attribute_table.size();
+        }
+
+        [[nodiscard]] uint64_t attribute_collections() const noexcept
+        {
+            return _attribute_table.collections();
+        }
+
+        // Nearest `color_table()` index to an RGB color (cached until the table changes).
+        [[nodiscard]] uint8_t nearest_palette_index(const COLORREF color) noexcept
+        {
+            return _attribute_table.nearest_palette_index(color, _color_table);
+        }
+
+        // Cells hold one UTF-16 code unit. Glyphs of more (surrogate pairs, combining sequences) are
+        // interned with `intern_cluster` and the cell holds the cluster character it returns; see
+        // `ClusterTable`. When the table is full, clusters no row refers to any more are reclaimed
+        // first. U+FFFD stands in for text that still does not fit.
+        //
+        // Client writes (`write_output_characters`, `fill_output_characters`, the
+        // `write_output_char_info_rect` and scroll fills) store each surrogate unit as a one-unit
+        // cluster, and the classic reads report `ClusterTable::classic_unit`, so lone surrogates
+        // and pairs written that way read back unchanged.
+        [[nodiscard]] wchar_t intern_cluster(std::wstring_view text) noexcept;
+
+        // The text of cluster character `character`, or empty for any other character.
+        [[nodiscard]] std::wstring_view cluster_text(const wchar_t character) const noexcept
+        {
+            return _cluster_table.text(character);
+        }
+
+        [[nodiscard]] size_t interned_cluster_count() const noexcept
+        {
+            return _cluster_table.size();
+        }
+
+        [[nodiscard]] size_t cluster_storage_bytes() const noexcept
+        {
+            return _cluster_table.storage_bytes();
+        }
+
+        [[nodiscard]] uint64_t cluster_collections() const noexcept
+        {
+            return _cluster_table.collections();
+        }
+
+        // Appends `units` to the glyph in the cell at `coord` (the leading half of a double-width
+        // glyph), making it a cluster. Attributes and width stay. Returns false, leaving the cell
+        // unchanged, when the result would exceed `ClusterTable::max_length` or cannot be interned.
+        [[nodiscard]] bool extend_cluster(COORD coord, std::wstring_view units) noexcept;
+
+        // A cell among those `read_output_characters` would read whose glyph is a cluster: its
+        // offset from `origin` and its full text. Trailing halves are not reported.
+        struct OutputCluster final
+        {
+            size_t offset{};
+            std::wstring_view text;
+        };
+
+        // Appends the clusters among `length` cells from `origin` to `out`, in order. The views stay
+        // valid until the buffer next changes. Returns false when `out` cannot grow.
+        [[nodiscard]] bool read_output_clusters(COORD origin, size_t length, std::vector<OutputCluster>& out) const noexcept;
+
         [[nodiscard]] ULONG cursor_size() const noexcept;
         [[nodiscard]] bool cursor_visible() const noexcept;
         void set_cursor_info(ULONG size, bool visible) noexcept;
@@ -261,14 +363,28 @@ namespace oc::logging
         }
 
         // Enable or disable the VT alternate screen buffer.
+        // The alternate screen is sized to the current viewport and has no scrollback; while it is
+        // active, `screen_buffer_size()` and `window_rect()` describe it. Leaving it restores the
+        // main buffer's size and window.
         // Returns false only when enabling fails due to allocation failure; the buffer remains unchanged.
         [[nodiscard]] bool set_vt_using_alternate_screen_buffer(
             bool enable,
             wchar_t fill_character,
             USHORT fill_attributes) noexcept;
 
+        // Single-cell writes of the text output path; `character` is stored as is, so multi-unit
+        // glyphs pass their `intern_cluster` character. Overwriting either half of a double-width
+        // glyph blanks its other half. The `wide` forms place a double-width glyph in `coord` and the
+        // next cell, both holding `character` and flagged `COMMON_LVB_LEADING_BYTE` and
+        // `COMMON_LVB_TRAILING_BYTE`; they fail when `coord` is the last column.
         [[nodiscard]] bool write_cell(COORD coord, wchar_t character, USHORT attributes) noexcept;
         [[nodiscard]] bool insert_cell(COORD coord, wchar_t character, USHORT attributes) noexcept;
+        [[nodiscard]] bool write_wide_cell(COORD coord, wchar_t character, USHORT attributes) noexcept;
+        [[nodiscard]] bool insert_wide_cell(COORD coord, wchar_t character, USHORT attributes) noexcept;
+        // `write_cell` (or with `insert`, `insert_cell`) for each of `text`'s characters in turn from
+        // `coord` along one row, as one change. `text` must fit in the row and hold only single-unit,
+        // single-width characters (`count_plain_characters`).
+        [[nodiscard]] bool write_cell_run(COORD coord, std::wstring_view text, USHORT attributes, bool insert) noexcept;
 
         [[nodiscard]] size_t fill_output_characters(COORD origin, wchar_t value, size_t length) noexcept;
         [[nodiscard]] size_t fill_output_attributes(COORD origin, USHORT value, size_t length) noexcept;
@@ -277,7 +393,12 @@ namespace oc::logging
         [[nodiscard]] size_t write_output_attributes(COORD origin, std::span<const USHORT> attributes) noexcept;
         [[nodiscard]] size_t write_output_ascii(COORD origin, std::span<const std::byte> bytes) noexcept;
 
+        // One unit per cell, so row reads line up with columns.
         [[nodiscard]] size_t read_output_characters(COORD origin, std::span<wchar_t> dest) const noexcept;
+        // `ReadConsoleOutputCharacter`: reads `dest.size()` cells like `read_output_characters` but
+        // skips the trailing halves of double-width glyphs, except for the low surrogate completing
+        // a pair. Returns the units stored, which can be fewer than the cells read.
+        [[nodiscard]] size_t read_console_output_characters(COORD origin, std::span<wchar_t> dest) const noexcept;
         [[nodiscard]] size_t read_output_attributes(COORD origin, std::span<USHORT> dest) const noexcept;
         [[nodiscard]] size_t read_output_ascii(COORD origin, std::span<std::byte> dest) const noexcept;
 
@@ -292,20 +413,45 @@ namespace oc::logging
             USHORT fill_attributes) noexcept;
 
     private:
-        template<typename HostIo>
-        friend void apply_text_to_screen_buffer(
+        template<typename HostIo, typename Unit>
+        friend void detail::apply_output_to_screen_buffer(
             ScreenBuffer& screen_buffer,
-            std::wstring_view text,
+            std::basic_string_view<Unit> input,
             ULONG output_mode,
             ServerState* title_state,
             HostIo* host_io) noexcept;
 
-        struct ScreenCell final
+        using ScreenCell = condrv::ScreenCell;
+
+        // One buffer row. A blank row reads as `blank` in every column. Rows allocate `cells` on their
+        // first partial write and keep them when a scroll or a full-row fill turns them blank again,
+        // so large buffers only pay for rows that were written and steady-state output reuses storage.
+        // `capacity` may exceed the buffer width after a resize narrowed the row; only the first
+        // width cells are meaningful.
+        //
+        // Rows that scroll out of the viewport are re-encoded as `compact` when they qualify and give
+        // up `cells`. A compact row reads its first `compact.length()` cells from the encoding and
+        // `blank` after that. The first write materializes it again.
+        struct ScreenRow final
+        {
+            std::unique_ptr<ScreenCell[]> cells;
+            size_t capacity{};
+            CompactRow compact;
+            ScreenCell blank{};
+            bool is_blank{ true };
+            bool is_compact{ false };
+            bool wrapped{ false };
+        };
+
+        // Cell storage released by compacted rows, handed to the next row that materializes.
+        struct SpareCells final
         {
-            wchar_t character{ L' ' };
-            USHORT attributes{ 0x07 };
+            std::unique_ptr<ScreenCell[]> cells;
+            size_t capacity{};
         };
 
+        static constexpr size_t spare_cells_limit = 32;
+
         struct SavedCursorState final
         {
             COORD position{};
@@ -314,10 +460,25 @@ namespace oc::logging
             bool origin_mode_enabled{ false };
         };
 
+        // Per logical row: the revision of the last cell change, of the last text change, and the
+        // union of columns changed since `extent_base` (a revision already handed to a consumer).
+        struct RowDamage final
+        {
+            uint64_t revision{};
+            uint64_t text_revision{};
+            uint64_t extent_base{};
+            ColumnExtent extent{};
+        };
+
         // When the VT alternate screen buffer is active, we preserve the main buffer state here.
+        // The main rows and their damage are moved in and out; nothing is copied.
         struct VtAlternateBufferBackup final
         {
-            std::vector<ScreenCell> cells;
+            std::vector<ScreenRow> rows;
+            size_t row_offset{};
+            std::vector<RowDamage> row_damage;
+            COORD buffer_size{};
+            SMALL_RECT window_rect{};
             COORD cursor_position{};
             USHORT text_attributes{};
             USHORT default_text_attributes{};
@@ -330,13 +491,116 @@ namespace oc::logging
         };
 
         [[nodiscard]] bool coord_in_range(COORD coord) const noexcept;
-        [[nodiscard]] size_t linear_index(COORD coord) const noexcept;
+        [[nodiscard]] size_t physical_row(SHORT row) const noexcept;
+        [[nodiscard]] ScreenRow& row_at(SHORT row) noexcept;
+        [[nodiscard]] const ScreenRow& row_at(SHORT row) const noexcept;
+        [[nodiscard]] ScreenCell cell_at(COORD coord) const noexcept;
+
+        // Reads from a row in any format. `visit_row_cells` hands a row that is not blank to
+        // `visit(cells, count, offset)` in contiguous pieces, decoding compact rows a chunk at a time.
+        [[nodiscard]] static ScreenCell row_cell(const ScreenRow& row, size_t column) noexcept;
+        static void copy_row_cells(const ScreenRow& row, size_t column, size_t count, ScreenCell* dest) noexcept;
+        template<typename Visit>
+        static void visit_row_cells(const ScreenRow& row, size_t column, size_t count, Visit&& visit) noexcept;
+
+        // Before the cell at `column` is overwritten: when it is half of a double-width glyph, blanks
+        // the other half and widens `[first, last]` to cover it.
+        static void break_wide_glyph(ScreenCell* cells, size_t width, size_t column, size_t& first, size_t& last) noexcept;
+        // Before the characters of `[column, column + count)` are replaced without their attributes:
+        // breaks the glyphs split at the span's ends and clears the width flags inside it, since
+        // the new characters are narrow. Sets `before` to 1 when that blanked `column - 1`, and
+        // `after` when it blanked `column + count`; neither is ever cleared.
+        static void clear_wide_span(ScreenCell* cells, size_t width, size_t column, size_t count, size_t& before, size_t& after) noexcept;
+
+        // ICH / DCH within row `coord.Y`: shift the cells from `coord.X` right, or those after the
+        // `count` deleted ones left, and fill the cells opened up with `fill`. `count` is clamped to
+        // the row. Cells move with their attribute IDs; glyphs split by the shift lose their other half.
+        [[nodiscard]] bool insert_cells(COORD coord, size_t count, ScreenCell fill) noexcept;
+        [[nodiscard]] bool delete_cells(COORD coord, size_t count, ScreenCell fill) noexcept;
+
+        // `intern_cluster` without the U+FFFD fallback. After a collection that freed little, a full
+        // table waits for `cluster_collection_backoff` failed interns, or one per 16 cells of the
+        // buffer if that is more, before collecting again. A collection walks every cell, so a
+        // buffer that really holds that many clusters does not rescan itself for every glyph.
+        [[nodiscard]] std::optional<wchar_t> try_intern_cluster(std::wstring_view text) noexcept;
+        // Marks the cluster characters in every row, including the preserved main screen, and
+        // frees the rest of the table.
+        void collect_clusters() noexcept;
+        // Replaces the surrogate units a client wrote into `cells` with one-unit clusters.
+        void intern_client_surrogates(ScreenCell* cells, size_t count) noexcept;
+        [[nodiscard]] wchar_t client_character(wchar_t character) noexcept;
+
+        static constexpr size_t cluster_collection_backoff = ClusterTable::max_entries / 8;
+
+        // Marks the attribute IDs in every row, including the preserved main screen, and in the
+        // text attributes and saved cursor states, and frees the rest of the table. Backs off like
+        // `collect_clusters`, counting interns that fell back to the classic word.
+        void collect_attributes() noexcept;
+
+        static constexpr size_t attribute_collection_backoff = AttributeTable::max_entries / 8;
+
+        // Gives row `row` writable cells holding its current contents. Returns nullptr when the
+        // storage cannot be allocated; the row is unchanged in that case.
+        [[nodiscard]] ScreenCell* materialize_row(SHORT row) noexcept;
+
+        // Re-encodes materialized rows in `[first_row, end_row)` compactly where they qualify,
+        // releasing their cells. Best effort: rows that do not encode stay as they are. Called for
+        // rows that just left the top of the viewport.
+        void compact_rows(long first_row, long end_row) noexcept;
+
+        // Visits up to `length` cells in logical row-major order from `origin`, clamped to the end
+        // of the buffer, one row segment at a time: `visit(row, column, count, offset)` where
+        // `offset` counts the cells visited before the segment. `visit` returns false to stop; the
+        // result is the number of cells in completed segments.
+        template<typename Visit>
+        size_t walk_linear(COORD origin, size_t length, Visit&& visit) const noexcept;
+
+        // Resizing builds the new row vector in two steps so a failed allocation leaves the buffer
+        // unchanged: `prepare_resized_rows` allocates everything that can fail without touching
+        // `rows`, then `adopt_resized_rows` moves the rows whose width is unchanged.
+        [[nodiscard]] static bool prepare_resized_rows(
+            const std::vector<ScreenRow>& rows,
+            size_t row_offset,
+            COORD old_size,
+            COORD new_size,
+            ScreenCell fill,
+            std::vector<ScreenRow>& out) noexcept;
+        static void adopt_resized_rows(
+            std::vector<ScreenRow>& rows,
+            size_t row_offset,
+            COORD old_size,
+            COORD new_size,
+            std::vector<ScreenRow>& out) noexcept;
+
+        // Width changes on the main screen rewrap logical lines (runs of wrapped rows) to the new
+        // width instead of clipping them, and remap the cursor and window top to the same text.
+        // Cell storage moves between rows wherever it is wide enough. All allocation happens before
+        // the first row moves, so a failure returns false with the buffer unchanged.
+        [[nodiscard]] bool reflow_rows(COORD new_size) noexcept;
+
+        // Full-buffer vertical scrolls rotate `_row_offset` and fill only the exposed rows.
+        // Returns false when the request is not such a scroll and the copy path must handle it.
+        [[nodiscard]] bool try_rotate_rows(
+            SMALL_RECT scroll_rectangle,
+            SMALL_RECT clip_rectangle,
+            COORD destination_origin,
+            wchar_t fill_character,
+            USHORT fill_attributes) noexcept;
 
         void touch() noexcept
         {
             ++_revision;
         }
 
+        // Damage recorders; call after `touch()` so the stamps carry the new revision.
+        void damage_rows(SHORT first_row, SHORT last_row, SHORT left, SHORT right, bool text) noexcept;
+        void damage_linear(COORD origin, size_t count, bool text) noexcept;
+        void damage_rect(SMALL_RECT rect, bool text) noexcept;
+        void damage_all_rows() noexcept;
+        void damage_cursor() noexcept;
+        void damage_viewport() noexcept;
+        void damage_palette() noexcept;
+
         COORD _buffer_size{};
         COORD _cursor_position{};
         SMALL_RECT _window_rect{};
@@ -346,16 +610,39 @@ namespace oc::logging
         ULONG _cursor_size{ 25 };
         bool _cursor_visible{ true };
         std::array<COLORREF, 16> _color_table{};
+        AttributeTable _attribute_table;
         std::optional<SavedCursorState> _saved_cursor_state{};
         std::optional<VtVerticalMargins> _vt_vertical_margins{};
         std::optional<VtAlternateBufferBackup> _vt_main_backup{};
+        // Alternate-screen storage kept across DECRST 1049, so re-entering at the same size reuses
+        // the rows (and any cells they materialized) instead of allocating.
+        std::vector<ScreenRow> _vt_alternate_rows;
+        std::vector<RowDamage> _vt_alternate_row_damage;
         bool _vt_autowrap_enabled{ true };
         std::optional<COORD> _vt_delayed_wrap_position{};
         bool _vt_origin_mode_enabled{ false };
         bool _vt_insert_mode_enabled{ false };
-        detail::VtOutputParseState _vt_output_parse_state{};
-        std::vector<ScreenCell> _cells;
-        uint64_t _revision{ 0 };
+        VtOutputParser _vt_output_parser;
+        // A ring of rows: logical row `y` is stored at `_rows[(y + _row_offset) % height]`, so
+        // scrolling the whole buffer only moves `_row_offset`.
+        std::vector<ScreenRow> _rows;
+        size_t _row_offset{ 0 };
+        std::vector<SpareCells> _spare_cells;
+        uint64_t _revision{ 1 };
+
+        // Damage bookkeeping, indexed by logical row (see `collect_damage`). The initial contents
+        // are stamped with revision 1, so generation 0 reports everything.
+        std::vector<RowDamage> _row_damage;
+        uint64_t _all_rows_damage_revision{ 1 };
+        uint64_t _viewport_damage_revision{ 1 };
+        uint64_t _cursor_damage_revision{ 1 };
+        uint64_t _palette_damage_revision{ 1 };
+        uint64_t _damage_reported_revision{ 0 };
+
+        // Text of multi-unit glyphs; last, so the fields every cell write reads share cache lines.
+        ClusterTable _cluster_table;
+        size_t _cluster_interns_until_collection{ 0 };
+        size_t _attribute_interns_until_collection{ 0 };
     };
 
     struct NullHostIo final
@@ -677,6 +964,70 @@ namespace oc::logging
         void set_os2_oem_format(bool enabled) noexcept;
         [[nodiscard]] bool os2_oem_format() const noexcept;
 
+        // Reusable transcoding buffers for the output path (WriteConsole / RAW_WRITE). Their capacity
+        // is retained across requests so steady-state writes do not allocate.
+        [[nodiscard]] std::wstring& output_text_scratch() noexcept
+        {
+            return _output_text_scratch;
+        }
+
+        [[nodiscard]] std::string& output_utf8_scratch() noexcept
+        {
+            return _output_utf8_scratch;
+        }
+
+        // Releases scratch capacity after an unusually large write so one `type hugefile` does not pin
+        // megabytes for the rest of the session.
+        void trim_output_scratch() noexcept;
+
+        // Deferred screen mirroring for passthrough hosts (see
+        // `new/docs/design/condrv_deferred_output_mirroring.md`). Output already forwarded to the
+        // terminal is logged here instead of being emulated, and applied to its screen buffers in
+        // one batch by `flush_deferred_output` when something may observe or change the model.
+        struct DeferredOutput final
+        {
+            std::shared_ptr<ScreenBuffer> screen_buffer;
+            ULONG output_mode{};
+            // End of this write's text in the log; it starts where the previous entry ends.
+            size_t end{};
+        };
+
+        // Log size, in UTF-16 units, past which a write applies the log instead of growing it.
+        static constexpr size_t deferred_output_limit = 256 * 1024;
+
+        // Appends `text` for `screen_buffer`, written under `output_mode`. Returns false when the
+        // log cannot grow; the caller then flushes and applies the text directly.
+        [[nodiscard]] bool defer_output(
+            const std::shared_ptr<ScreenBuffer>& screen_buffer,
+            std::wstring_view text,
+            ULONG output_mode) noexcept;
+
+        [[nodiscard]] bool has_deferred_output() const noexcept
+        {
+            return !_deferred_output.empty();
+        }
+
+        [[nodiscard]] bool deferred_output_full() const noexcept
+        {
+            return _deferred_output_text.size() >= deferred_output_limit;
+        }
+
+        // Applies and clears the log, oldest write first.
+        template<typename HostIo>
+        void flush_deferred_output(HostIo& host_io) noexcept;
+
+        // Optional per-API instrumentation read by `dispatch_message` (see
+        // `condrv/condrv_api_metrics.hpp`). Not owned; null disables it.
+        void set_api_metrics(ApiMetrics* const metrics) noexcept
+        {
+            _api_metrics = metrics;
+        }
+
+        [[nodiscard]] ApiMetrics* api_metrics() const noexcept
+        {
+            return _api_metrics;
+        }
+
         [[nodiscard]] std::expected<void, DeviceCommError> set_alias(
             std::wstring exe_name,
             std::wstring source,
@@ -752,6 +1103,14 @@ namespace oc::logging
         std::shared_ptr<ScreenBuffer> _main_screen_buffer;
         std::shared_ptr<ScreenBuffer> _active_screen_buffer;
         unsigned long long _next_connect_sequence{ 1 };
+
+        std::wstring _output_text_scratch;
+        std::string _output_utf8_scratch;
+
+        std::vector<DeferredOutput> _deferred_output;
+        std::wstring _deferred_output_text;
+
+        ApiMetrics* _api_metrics{ nullptr };
     };
 
     [[nodiscard]] inline std::expected<std::wstring, DeviceCommError> decode_console_string(
@@ -839,6 +1198,117 @@ namespace oc::logging
         return out;
     }
 
+    // Decodes client code-page bytes into `scratch` with one `MultiByteToWideChar` call and returns a
+    // view of the result. A code-page byte never yields more than one UTF-16 unit, so the input size
+    // is used as the output capacity; the sizing call is only a fallback.
+    [[nodiscard]] inline std::expected<std::wstring_view, DeviceCommError> decode_console_output_bytes(
+        const std::span<const std::byte> bytes,
+        const UINT code_page,
+        std::wstring& scratch,
+        const wchar_t* const context) noexcept
+    {
+        if (bytes.empty())
+        {
+            scratch.clear();
+            return std::wstring_view{};
+        }
+
+        if (bytes.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
+        {
+            return std::unexpected(DeviceCommError{ .context = context, .win32_error = ERROR_INVALID_DATA });
+        }
+
+        const auto* const source = reinterpret_cast<const char*>(bytes.data());
+        const int source_size = static_cast<int>(bytes.size());
+
+        size_t capacity = bytes.size();
+        for (int attempt = 0; attempt < 2; ++attempt)
+        {
+            int converted = 0;
+            DWORD error = ERROR_SUCCESS;
+            try
+            {
+                scratch.resize_and_overwrite(capacity, [&](wchar_t* const buffer, const size_t size) noexcept {
+                    converted = ::MultiByteToWideChar(code_page, 0, source, source_size, buffer, static_cast<int>(size));
+                    error = converted > 0 ? ERROR_SUCCESS : ::GetLastError();
+                    return converted > 0 ? static_cast<size_t>(converted) : size_t{ 0 };
+                });
+            }
+            catch (...)
+            {
+                return std::unexpected(DeviceCommError{ .context = context, .win32_error = ERROR_OUTOFMEMORY });
+            }
+
+            if (converted > 0)
+            {
+                return std::wstring_view(scratch);
+            }
+
+            if (error != ERROR_INSUFFICIENT_BUFFER)
+            {
+                return std::unexpected(DeviceCommError{ .context = context, .win32_error = error });
+            }
+
+            const int required = ::MultiByteToWideChar(code_page, 0, source, source_size, nullptr, 0);
+            if (required <= 0)
+            {
+                return std::unexpected(DeviceCommError{ .context = context, .win32_error = ::GetLastError() });
+            }
+            capacity = static_cast<size_t>(required);
+        }
+
+        return std::unexpected(DeviceCommError{ .context = context, .win32_error = ERROR_INSUFFICIENT_BUFFER });
+    }
+
+    // Transcodes UTF-16 into UTF-8 in `scratch` with one `WideCharToMultiByte` call. A UTF-16 unit
+    // never needs more than 3 UTF-8 bytes (a surrogate pair is 4 bytes for 2 units).
+    [[nodiscard]] inline std::expected<std::span<const std::byte>, DeviceCommError> encode_console_output_utf8(
+        const std::wstring_view text,
+        std::string& scratch,
+        const wchar_t* const context) noexcept
+    {
+        if (text.empty())
+        {
+            scratch.clear();
+            return std::span<const std::byte>{};
+        }
+
+        if (text.size() > static_cast<size_t>(std::numeric_limits<int>::max() / 3))
+        {
+            return std::unexpected(DeviceCommError{ .context = context, .win32_error = ERROR_INVALID_DATA });
+        }
+
+        int converted = 0;
+        DWORD error = ERROR_SUCCESS;
+        try
+        {
+            scratch.resize_and_overwrite(text.size() * 3, [&](char* const buffer, const size_t size) noexcept {
+                converted = ::WideCharToMultiByte(
+                    CP_UTF8,
+                    0,
+                    text.data(),
+                    static_cast<int>(text.size()),
+                    buffer,
+                    static_cast<int>(size),
+                    nullptr,
+                    nullptr);
+                error = converted > 0 ? ERROR_SUCCESS : ::GetLastError();
+                return converted > 0 ? static_cast<size_t>(converted) : size_t{ 0 };
+            });
+        }
+        catch (...)
+        {
+            return std::unexpected(DeviceCommError{ .context = context, .win32_error = ERROR_OUTOFMEMORY });
+        }
+
+        if (converted <= 0)
+        {
+            return std::unexpected(DeviceCommError{ .context = context, .win32_error = error });
+        }
+
+        return std::span<const std::byte>(reinterpret_cast<const std::byte*>(scratch.data()), scratch.size());
+    }
+
     [[nodiscard]] inline std::expected<std::wstring, DeviceCommError> fold_to_lower_invariant(
         const std::wstring_view value,
         const wchar_t* const context) noexcept
@@ -1244,16 +1714,22 @@ namespace oc::logging
         return count;
     }
 
-    template<typename HostIo>
-    inline void apply_text_to_screen_buffer(
+    // Applies console output, UTF-16 text or UTF-8 bytes, to `screen_buffer`. `Unit` only changes
+    // how the input is read; both forms share the handlers below.
+    template<typename HostIo, typename Unit>
+    inline void detail::apply_output_to_screen_buffer(
         ScreenBuffer& screen_buffer,
-        const std::wstring_view text,
+        const std::basic_string_view<Unit> input,
         const ULONG output_mode,
         ServerState* const title_state,
         HostIo* const host_io) noexcept
     {
+        // The UTF-16 text the print paths read: all of `input`, or one run decoded from it.
+        std::wstring_view text;
+
         COORD cursor = screen_buffer.cursor_position();
-        const COORD buffer_size = screen_buffer.screen_buffer_size();
+        // Not const: switching to or from the VT alternate screen changes the active size.
+        COORD buffer_size = screen_buffer.screen_buffer_size();
         if (buffer_size.X <= 0 || buffer_size.Y <= 0)
         {
             return;
@@ -1261,6 +1737,34 @@ namespace oc::logging
 
         USHORT attributes = screen_buffer.text_attributes();
         const USHORT default_attributes = screen_buffer.default_text_attributes();
+
+        // SGR leaves an attribute the classic word cannot express pending, and it is interned when
+        // something first uses it (or when the call ends), so the intermediate states of a run of
+        // SGR sequences never take table entries.
+        std::optional<TextAttribute> pending;
+        const auto current_attributes = [&]() noexcept -> USHORT {
+            if (pending)
+            {
+                attributes = screen_buffer.intern_attribute(*pending);
+                pending.reset();
+            }
+            return attributes;
+        };
+        const auto set_attributes = [&](const USHORT value) noexcept {
+            attributes = value;
+            pending.reset();
+        };
+        const auto current_attribute = [&]() noexcept -> TextAttribute {
+            return pending ? *pending : screen_buffer.attribute(attributes);
+        };
+        const auto set_current_attribute = [&](const TextAttribute& value) noexcept {
+            if (value.flags == 0)
+            {
+                set_attributes(screen_buffer.intern_attribute(value));
+                return;
+            }
+            pending = value;
+        };
         const bool processed_output = (output_mode & ENABLE_PROCESSED_OUTPUT) != 0;
         const bool wrap_at_eol_output_mode = (output_mode & ENABLE_WRAP_AT_EOL_OUTPUT) != 0;
         const bool vt_processing = (output_mode & ENABLE_VIRTUAL_TERMINAL_PROCESSING) != 0;
@@ -1278,7 +1782,7 @@ namespace oc::logging
         {
             // Delayed wrap is only meaningful while VT processing is active.
             vt_delayed_wrap_position.reset();
-            screen_buffer._vt_output_parse_state = {};
+            screen_buffer._vt_output_parser.reset();
         }
 
         // Resolve the active VT scrolling region (DECSTBM) as an inclusive [top,bottom] range.
@@ -1326,7 +1830,7 @@ namespace oc::logging
                 const size_t length = width * height;
                 const COORD origin{ 0, top };
                 (void)screen_buffer.fill_output_characters(origin, L' ', length);
-                (void)screen_buffer.fill_output_attributes(origin, attributes, length);
+                (void)screen_buffer.fill_output_attributes(origin, current_attributes(), length);
                 return;
             }
 
@@ -1350,7 +1854,7 @@ namespace oc::logging
                 clip_rect,
                 COORD{ 0, top },
                 L' ',
-                attributes);
+                current_attributes());
         };
 
         const auto scroll_region_down = [&](const SHORT top, const SHORT bottom, unsigned count) noexcept {
@@ -1382,7 +1886,7 @@ namespace oc::logging
                 const size_t length = width * height;
                 const COORD origin{ 0, top };
                 (void)screen_buffer.fill_output_characters(origin, L' ', length);
-                (void)screen_buffer.fill_output_attributes(origin, attributes, length);
+                (void)screen_buffer.fill_output_attributes(origin, current_attributes(), length);
                 return;
             }
 
@@ -1407,7 +1911,7 @@ namespace oc::logging
                 clip_rect,
                 COORD{ 0, dest_top },
                 L' ',
-                attributes);
+                current_attributes());
         };
 
         auto line_feed = [&]() noexcept {
@@ -1484,23 +1988,40 @@ namespace oc::logging
                 vt_delayed_wrap_position->X == cursor.X &&
                 vt_delayed_wrap_position->Y == cursor.Y)
             {
+                screen_buffer.set_row_wrapped(cursor.Y, true);
                 advance_line();
             }
 
             vt_delayed_wrap_position.reset();
         };
 
-        const auto write_printable = [&](const wchar_t value) noexcept {
-            maybe_apply_delayed_wrap();
+        // Where a write put its glyph, and the buffer revision once the cursor has moved past it.
+        // A line feed that scrolled the buffer moved the cell, so the revision is then the one from
+        // before the scroll, which no later check matches.
+        struct WrittenGlyph final
+        {
+            COORD cell{};
+            uint64_t revision{};
+        };
 
-            if (vt_processing && vt_insert_mode)
-            {
-                (void)screen_buffer.insert_cell(cursor, value, attributes);
-            }
-            else
-            {
-                (void)screen_buffer.write_cell(cursor, value, attributes);
-            }
+        // The glyph this call wrote last, while the code unit right after it in `text` may still
+        // extend it (combining marks, ZWJ sequences, flags). Anything in between (a control, an
+        // escape sequence) or any other change to the buffer closes it, so glyphs are not extended
+        // across calls either. The main loop keeps it in a local the writers never touch, which
+        // lets plain text carry it in registers.
+        struct OpenGlyph final
+        {
+            WrittenGlyph glyph{};
+            size_t end{ std::numeric_limits<size_t>::max() }; // offset in `text` right after it
+            bool joiner{ false };                              // ends in ZWJ, so the next code point joins it
+            bool regional_indicator{ false };                  // one regional indicator, which a second makes a flag
+        };
+
+        // Moves the cursor past a narrow glyph just written at the cursor, wrapping (or setting the
+        // VT delayed wrap) from the last column.
+        const auto advance_past_narrow_glyph = [&]() noexcept -> WrittenGlyph {
+            const COORD cell = cursor;
+            WrittenGlyph written{ .cell = cell, .revision = screen_buffer.revision() };
 
             if (vt_processing)
             {
@@ -1517,7 +2038,7 @@ namespace oc::logging
                 {
                     ++cursor.X;
                 }
-                return;
+                return written;
             }
 
             ++cursor.X;
@@ -1525,103 +2046,279 @@ namespace oc::logging
             {
                 if (wrap_at_eol_output_mode)
                 {
+                    screen_buffer.set_row_wrapped(cursor.Y, true);
                     advance_line();
+                    if (cursor.Y != cell.Y)
+                    {
+                        written.revision = screen_buffer.revision();
+                    }
                 }
                 else
                 {
                     cursor.X = static_cast<SHORT>(buffer_size.X - 1);
                 }
             }
+            return written;
         };
 
-        const auto apply_sgr = [&](const auto& csi) noexcept {
-            constexpr USHORT fg_color_mask = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
-            constexpr USHORT bg_color_mask = BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE;
-            constexpr USHORT fg_full_mask = fg_color_mask | FOREGROUND_INTENSITY;
-            constexpr USHORT bg_full_mask = bg_color_mask | BACKGROUND_INTENSITY;
+        const auto write_printable = [&](const wchar_t value) noexcept -> WrittenGlyph {
+            maybe_apply_delayed_wrap();
 
-            const auto set_foreground = [&](const unsigned color, const bool bright) noexcept {
-                attributes = static_cast<USHORT>(attributes & ~(fg_color_mask | FOREGROUND_INTENSITY));
-                if ((color & 0x01U) != 0)
-                {
-                    attributes |= FOREGROUND_RED;
-                }
-                if ((color & 0x02U) != 0)
-                {
-                    attributes |= FOREGROUND_GREEN;
-                }
-                if ((color & 0x04U) != 0)
-                {
-                    attributes |= FOREGROUND_BLUE;
-                }
-                if (bright)
-                {
-                    attributes |= FOREGROUND_INTENSITY;
-                }
-            };
+            if (vt_processing && vt_insert_mode)
+            {
+                (void)screen_buffer.insert_cell(cursor, value, current_attributes());
+            }
+            else
+            {
+                (void)screen_buffer.write_cell(cursor, value, current_attributes());
+            }
+            return advance_past_narrow_glyph();
+        };
 
-            const auto set_background = [&](const unsigned color, const bool bright) noexcept {
-                attributes = static_cast<USHORT>(attributes & ~(bg_color_mask | BACKGROUND_INTENSITY));
-                if ((color & 0x01U) != 0)
-                {
-                    attributes |= BACKGROUND_RED;
+        // `write_printable` for each character of a plain run (`count_plain_characters`), storing
+        // the part that fits before the end of the row with one `write_cell_run`. Returns the last
+        // glyph written.
+        const auto write_printable_run = [&](std::wstring_view run) noexcept -> WrittenGlyph {
+            const bool wraps = vt_processing ? vt_autowrap : wrap_at_eol_output_mode;
+            WrittenGlyph written{};
+            while (!run.empty())
+            {
+                maybe_apply_delayed_wrap();
+                const bool in_row = cursor.X >= 0 && cursor.X < buffer_size.X && cursor.Y >= 0 && cursor.Y < buffer_size.Y;
+                const size_t room = in_row ? static_cast<size_t>(buffer_size.X - cursor.X) : 0;
+                if (room < 2)
+                {
+                    written = write_printable(run.front());
+                    run.remove_prefix(1);
+                    continue;
                 }
-                if ((color & 0x02U) != 0)
+
+                // Without wrapping, every character past the row's end lands on the last column,
+                // where only the final one stays.
+                const bool clipped = !wraps && run.size() > room;
+                const size_t count = clipped ? room - 1 : std::min(run.size(), room);
+                (void)screen_buffer.write_cell_run(cursor, run.substr(0, count), current_attributes(), vt_processing && vt_insert_mode);
+                cursor.X = static_cast<SHORT>(cursor.X + count - 1);
+                written = advance_past_narrow_glyph();
+                if (clipped)
                 {
-                    attributes |= BACKGROUND_GREEN;
+                    return write_printable(run.back());
                 }
-                if ((color & 0x04U) != 0)
+                run.remove_prefix(count);
+            }
+            return written;
+        };
+
+        // A double-width glyph takes the cursor cell and the one after it, both holding `value`.
+        // When only the last column is left, the glyph wraps to the next line first, or without
+        // wrapping is drawn one column earlier.
+        const auto write_wide_printable = [&](const wchar_t value) noexcept -> WrittenGlyph {
+            maybe_apply_delayed_wrap();
+
+            const SHORT last_column = static_cast<SHORT>(buffer_size.X - 1);
+            if (last_column < 1)
+            {
+                return write_printable(value);
+            }
+
+            if (cursor.X >= last_column)
+            {
+                if (vt_processing ? vt_autowrap : wrap_at_eol_output_mode)
                 {
-                    attributes |= BACKGROUND_BLUE;
+                    screen_buffer.set_row_wrapped(cursor.Y, true);
+                    advance_line();
                 }
-                if (bright)
+                else
                 {
-                    attributes |= BACKGROUND_INTENSITY;
+                    cursor.X = static_cast<SHORT>(last_column - 1);
                 }
-            };
+            }
 
-            const auto set_palette_index = [&](const unsigned index, const bool foreground) noexcept {
-                if (foreground)
+            const COORD cell = cursor;
+            if (vt_processing && vt_insert_mode)
+            {
+                (void)screen_buffer.insert_wide_cell(cursor, value, current_attributes());
+            }
+            else
+            {
+                (void)screen_buffer.write_wide_cell(cursor, value, current_attributes());
+            }
+            WrittenGlyph written{ .cell = cell, .revision = screen_buffer.revision() };
+
+            if (vt_processing)
+            {
+                if (cursor.X + 1 >= last_column)
+                {
+                    cursor.X = last_column;
+                    if (vt_autowrap)
+                    {
+                        vt_delayed_wrap_position = cursor;
+                    }
+                }
+                else
+                {
+                    cursor.X = static_cast<SHORT>(cursor.X + 2);
+                }
+                return written;
+            }
+
+            cursor.X = static_cast<SHORT>(cursor.X + 2);
+            if (cursor.X >= buffer_size.X)
+            {
+                if (wrap_at_eol_output_mode)
                 {
-                    attributes = static_cast<USHORT>(attributes & ~fg_full_mask);
-                    attributes = static_cast<USHORT>(attributes | static_cast<USHORT>(index & 0x0FU));
+                    screen_buffer.set_row_wrapped(cursor.Y, true);
+                    advance_line();
+                    if (cursor.Y != cell.Y)
+                    {
+                        written.revision = screen_buffer.revision();
+                    }
                 }
                 else
                 {
-                    attributes = static_cast<USHORT>(attributes & ~bg_full_mask);
-                    attributes = static_cast<USHORT>(attributes | static_cast<USHORT>((index & 0x0FU) << 4));
+                    cursor.X = last_column;
+                }
+            }
+            return written;
+        };
+
+        // Whether `text[at]` can extend a glyph written by the plain paths: a width 0 code point or
+        // the high surrogate of one. Only then is the glyph recorded, so plain text pays one compare.
+        const auto may_extend = [&](const size_t at) noexcept {
+            if (at >= text.size() || text[at] < first_non_narrow_code_point)
+            {
+                return false;
+            }
+            const wchar_t next = text[at];
+            return is_cluster_character(next) ? next <= 0xDBFF : code_point_width(next) == 0;
+        };
+
+        // Output at or above U+0300, starting at `text[at]`; returns the code units consumed.
+        // Extenders (width 0), the code point after a ZWJ, and the second regional indicator of a
+        // flag join `open` when it is still open. Everything else starts a glyph of its own,
+        // interned as a cluster when it is more than one unit, and becomes `open`. An extender with
+        // no open glyph takes a cell of its own, as before; one that no longer fits its glyph is
+        // dropped.
+        const auto write_non_narrow = [&](const size_t at, OpenGlyph& open) noexcept -> size_t {
+            const wchar_t ch = text[at];
+            char32_t code_point = ch;
+            size_t units = 1;
+            if (ch >= 0xD800 && ch <= 0xDBFF && at + 1 < text.size() && text[at + 1] >= 0xDC00 && text[at + 1] <= 0xDFFF)
+            {
+                code_point = 0x10000 + ((static_cast<char32_t>(ch) - 0xD800) << 10) + (static_cast<char32_t>(text[at + 1]) - 0xDC00);
+                units = 2;
+            }
+
+            const std::wstring_view sequence = text.substr(at, units);
+            const int width = code_point_width(code_point);
+            const bool joiner = code_point == 0x200D;
+            const bool regional_indicator = code_point >= 0x1F1E6 && code_point <= 0x1F1FF;
+
+            const bool is_open = open.end == at && open.glyph.revision == screen_buffer.revision();
+            if (is_open && (width == 0 || open.joiner || (regional_indicator && open.regional_indicator)))
+            {
+                if (screen_buffer.extend_cluster(open.glyph.cell, sequence))
+                {
+                    open.glyph.revision = screen_buffer.revision();
+                    open.end = at + units;
+                    open.joiner = joiner;
+                    open.regional_indicator = false;
+                    return units;
+                }
+                if (width == 0)
+                {
+                    return units;
                 }
+            }
+
+            const wchar_t value = units == 1 && !is_cluster_character(ch) ? ch : screen_buffer.intern_cluster(sequence);
+            open = OpenGlyph{
+                .glyph = width == 2 ? write_wide_printable(value) : write_printable(value),
+                .end = at + units,
+                .joiner = joiner,
+                .regional_indicator = regional_indicator,
             };
+            return units;
+        };
 
-            const auto clamp_byte = [](const unsigned value) noexcept -> unsigned {
-                return value > 0xFFU ? 0xFFU : value;
+        const auto apply_sgr = [&](const auto& csi) noexcept {
+            // Classic colors and flags are edited in `current.legacy`. RGB colors and the renditions
+            // the classic word has no bit for are interned when text is first written with them.
+            TextAttribute current = current_attribute();
+
+            constexpr USHORT fg_color_mask = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+            constexpr USHORT bg_color_mask = BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE;
+            constexpr USHORT fg_full_mask = fg_color_mask | FOREGROUND_INTENSITY;
+            constexpr USHORT bg_full_mask = bg_color_mask | BACKGROUND_INTENSITY;
+
+            const auto set_foreground = [&](const unsigned color, const bool bright) noexcept {
+                current.flags = static_cast<uint8_t>(current.flags & ~TextAttribute::foreground_rgb);
+                current.legacy = static_cast<USHORT>(current.legacy & ~(fg_color_mask | FOREGROUND_INTENSITY));
+                if ((color & 0x01U) != 0)
+                {
+                    current.legacy |= FOREGROUND_RED;
+                }
+                if ((color & 0x02U) != 0)
+                {
+                    current.legacy |= FOREGROUND_GREEN;
+                }
+                if ((color & 0x04U) != 0)
+                {
+                    current.legacy |= FOREGROUND_BLUE;
+                }
+                if (bright)
+                {
+                    current.legacy |= FOREGROUND_INTENSITY;
+                }
             };
 
-            const auto nearest_palette_index = [&](const unsigned red, const unsigned green, const unsigned blue) noexcept -> unsigned {
-                const auto& table = screen_buffer.color_table();
-                unsigned best_index = 0;
-                std::uint32_t best_distance = std::numeric_limits<std::uint32_t>::max();
-                for (unsigned i = 0; i < table.size(); ++i)
+            const auto set_background = [&](const unsigned color, const bool bright) noexcept {
+                current.flags = static_cast<uint8_t>(current.flags & ~TextAttribute::background_rgb);
+                current.legacy = static_cast<USHORT>(current.legacy & ~(bg_color_mask | BACKGROUND_INTENSITY));
+                if ((color & 0x01U) != 0)
+                {
+                    current.legacy |= BACKGROUND_RED;
+                }
+                if ((color & 0x02U) != 0)
+                {
+                    current.legacy |= BACKGROUND_GREEN;
+                }
+                if ((color & 0x04U) != 0)
+                {
+                    current.legacy |= BACKGROUND_BLUE;
+                }
+                if (bright)
                 {
-                    const COLORREF color = table[i];
-                    const int pr = static_cast<int>(color & 0xFF);
-                    const int pg = static_cast<int>((color >> 8) & 0xFF);
-                    const int pb = static_cast<int>((color >> 16) & 0xFF);
+                    current.legacy |= BACKGROUND_INTENSITY;
+                }
+            };
 
-                    const int dr = pr - static_cast<int>(red);
-                    const int dg = pg - static_cast<int>(green);
-                    const int db = pb - static_cast<int>(blue);
-                    const std::uint32_t distance =
-                        static_cast<std::uint32_t>(dr * dr) +
-                        static_cast<std::uint32_t>(dg * dg) +
-                        static_cast<std::uint32_t>(db * db);
-                    if (distance < best_distance)
-                    {
-                        best_distance = distance;
-                        best_index = i;
-                    }
+            // The classic word gets the nearest palette entry; the interned attribute keeps the color.
+            const auto set_rgb = [&](const unsigned red, const unsigned green, const unsigned blue, const bool foreground) noexcept {
+                const auto color = static_cast<COLORREF>(red | (green << 8) | (blue << 16));
+                const unsigned index = screen_buffer.nearest_palette_index(color);
+                if (foreground)
+                {
+                    current.flags = static_cast<uint8_t>(current.flags | TextAttribute::foreground_rgb);
+                    current.foreground = color;
+                    current.legacy = static_cast<USHORT>(current.legacy & ~fg_full_mask);
+                    current.legacy = static_cast<USHORT>(current.legacy | static_cast<USHORT>(index & 0x0FU));
+                }
+                else
+                {
+                    current.flags = static_cast<uint8_t>(current.flags | TextAttribute::background_rgb);
+                    current.background = color;
+                    current.legacy = static_cast<USHORT>(current.legacy & ~bg_full_mask);
+                    current.legacy = static_cast<USHORT>(current.legacy | static_cast<USHORT>((index & 0x0FU) << 4));
                 }
-                return best_index;
+            };
+
+            const auto set_flag = [&](const uint8_t flag, const bool enabled) noexcept {
+                current.flags = static_cast<uint8_t>(enabled ? (current.flags | flag) : (current.flags & ~flag));
+            };
+
+            const auto clamp_byte = [](const unsigned value) noexcept -> unsigned {
+                return value > 0xFFU ? 0xFFU : value;
             };
 
             const auto xterm_256_index_to_rgb = [&](unsigned index, unsigned& red, unsigned& green, unsigned& blue) noexcept {
@@ -1664,7 +2361,7 @@ namespace oc::logging
                 const unsigned param = csi.params[i];
                 if (param == 0)
                 {
-                    attributes = default_attributes;
+                    current = TextAttribute{ .legacy = default_attributes };
                     ++i;
                     continue;
                 }
@@ -1672,7 +2369,7 @@ namespace oc::logging
                 if (param == 1)
                 {
                     // "Bold" is approximated by FOREGROUND_INTENSITY in the legacy attribute model.
-                    attributes |= FOREGROUND_INTENSITY;
+                    current.legacy |= FOREGROUND_INTENSITY;
                     ++i;
                     continue;
                 }
@@ -1680,7 +2377,8 @@ namespace oc::logging
                 if (param == 22)
                 {
                     // Normal intensity (clears bold/faint).
-                    attributes = static_cast<USHORT>(attributes & ~FOREGROUND_INTENSITY);
+                    current.legacy = static_cast<USHORT>(current.legacy & ~FOREGROUND_INTENSITY);
+                    set_flag(TextAttribute::faint, false);
                     ++i;
                     continue;
                 }
@@ -1688,7 +2386,7 @@ namespace oc::logging
                 if (param == 4)
                 {
                     // Underline is represented by the legacy COMMON_LVB_UNDERSCORE bit.
-                    attributes |= COMMON_LVB_UNDERSCORE;
+                    current.legacy |= COMMON_LVB_UNDERSCORE;
                     ++i;
                     continue;
                 }
@@ -1696,7 +2394,7 @@ namespace oc::logging
                 if (param == 24)
                 {
                     // Clear underline.
-                    attributes = static_cast<USHORT>(attributes & ~COMMON_LVB_UNDERSCORE);
+                    current.legacy = static_cast<USHORT>(current.legacy & ~COMMON_LVB_UNDERSCORE);
                     ++i;
                     continue;
                 }
@@ -1704,7 +2402,7 @@ namespace oc::logging
                 if (param == 7)
                 {
                     // "Negative" / reverse video.
-                    attributes |= COMMON_LVB_REVERSE_VIDEO;
+                    current.legacy |= COMMON_LVB_REVERSE_VIDEO;
                     ++i;
                     continue;
                 }
@@ -1712,7 +2410,7 @@ namespace oc::logging
                 if (param == 27)
                 {
                     // Clear reverse video.
-                    attributes = static_cast<USHORT>(attributes & ~COMMON_LVB_REVERSE_VIDEO);
+                    current.legacy = static_cast<USHORT>(current.legacy & ~COMMON_LVB_REVERSE_VIDEO);
                     ++i;
                     continue;
                 }
@@ -1720,7 +2418,8 @@ namespace oc::logging
                 if (param == 39)
                 {
                     // Default foreground color.
-                    attributes = static_cast<USHORT>((attributes & ~fg_full_mask) | (default_attributes & fg_full_mask));
+                    current.flags = static_cast<uint8_t>(current.flags & ~TextAttribute::foreground_rgb);
+                    current.legacy = static_cast<USHORT>((current.legacy & ~fg_full_mask) | (default_attributes & fg_full_mask));
                     ++i;
                     continue;
                 }
@@ -1728,7 +2427,8 @@ namespace oc::logging
                 if (param == 49)
                 {
                     // Default background color.
-                    attributes = static_cast<USHORT>((attributes & ~bg_full_mask) | (default_attributes & bg_full_mask));
+                    current.flags = static_cast<uint8_t>(current.flags & ~TextAttribute::background_rgb);
+                    current.legacy = static_cast<USHORT>((current.legacy & ~bg_full_mask) | (default_attributes & bg_full_mask));
                     ++i;
                     continue;
                 }
@@ -1790,8 +2490,7 @@ namespace oc::logging
                                 unsigned green{};
                                 unsigned blue{};
                                 xterm_256_index_to_rgb(index, red, green, blue);
-                                const unsigned nearest = nearest_palette_index(red, green, blue);
-                                set_palette_index(nearest, foreground);
+                                set_rgb(red, green, blue, foreground);
                             }
 
                             i += 3;
@@ -1803,17 +2502,47 @@ namespace oc::logging
                             const unsigned red = clamp_byte(csi.params[i + 2]);
                             const unsigned green = clamp_byte(csi.params[i + 3]);
                             const unsigned blue = clamp_byte(csi.params[i + 4]);
-                            const unsigned nearest = nearest_palette_index(red, green, blue);
-                            set_palette_index(nearest, foreground);
+                            set_rgb(red, green, blue, foreground);
                             i += 5;
                             continue;
                         }
                     }
                 }
 
+                // Renditions without a classic bit: faint, italic, blink, conceal and strikethrough,
+                // each with its reset (22 above also clears faint).
+                if (param == 2 || param == 3 || param == 5 || param == 6 || param == 8 || param == 9 ||
+                    param == 23 || param == 25 || param == 28 || param == 29)
+                {
+                    const bool enabled = param < 10;
+                    switch (enabled ? param : param - 20)
+                    {
+                    case 2:
+                        set_flag(TextAttribute::faint, enabled);
+                        break;
+                    case 3:
+                        set_flag(TextAttribute::italic, enabled);
+                        break;
+                    case 5:
+                    case 6:
+                        set_flag(TextAttribute::blink, enabled);
+                        break;
+                    case 8:
+                        set_flag(TextAttribute::invisible, enabled);
+                        break;
+                    default:
+                        set_flag(TextAttribute::strikethrough, enabled);
+                        break;
+                    }
+                    ++i;
+                    continue;
+                }
+
                 // Ignore unsupported SGR parameters.
                 ++i;
             }
+
+            set_current_attribute(current);
         };
 
 
@@ -1950,8 +2679,8 @@ namespace oc::logging
                         vt_vertical_margins.reset();
                         screen_buffer.set_vt_vertical_margins(std::nullopt);
 
-                        attributes = default_attributes;
-                        screen_buffer.save_cursor_state(COORD{ 0, 0 }, attributes, false, false);
+                        set_attributes(default_attributes);
+                        screen_buffer.save_cursor_state(COORD{ 0, 0 }, current_attributes(), false, false);
                     }
                     else if (csi.final == L'G' || csi.final == L'`')
                     {
@@ -2055,27 +2784,10 @@ namespace oc::logging
                                 count = remaining;
                             }
 
-                            wchar_t src_char{};
-                            USHORT src_attr{};
-                            for (long x = width_long - 1; x >= x0 + static_cast<long>(count); --x)
-                            {
-                                if (screen_buffer.read_output_characters(COORD{ static_cast<SHORT>(x - static_cast<long>(count)), static_cast<SHORT>(y) }, std::span<wchar_t>(&src_char, 1)) != 1 ||
-                                    screen_buffer.read_output_attributes(COORD{ static_cast<SHORT>(x - static_cast<long>(count)), static_cast<SHORT>(y) }, std::span<USHORT>(&src_attr, 1)) != 1)
-                                {
-                                    src_char = L' ';
-                                    src_attr = attributes;
-                                }
-
-                                (void)screen_buffer.write_cell(COORD{ static_cast<SHORT>(x), static_cast<SHORT>(y) }, src_char, src_attr);
-                            }
-
-                            for (unsigned i = 0; i < count; ++i)
-                            {
-                                (void)screen_buffer.write_cell(
-                                    COORD{ static_cast<SHORT>(x0 + static_cast<long>(i)), static_cast<SHORT>(y) },
-                                    L' ',
-                                    attributes);
-                            }
+                            (void)screen_buffer.insert_cells(
+                                COORD{ static_cast<SHORT>(x0), static_cast<SHORT>(y) },
+                                count,
+                                ScreenCell{ .character = L' ', .attributes = current_attributes() });
                         }
 
                         // ICH resets the delayed wrap flag (the "last column flag").
@@ -2101,25 +2813,10 @@ namespace oc::logging
                                 count = remaining;
                             }
 
-                            const long limit = width_long - static_cast<long>(count);
-                            wchar_t src_char{};
-                            USHORT src_attr{};
-                            for (long x = x0; x < limit; ++x)
-                            {
-                                if (screen_buffer.read_output_characters(COORD{ static_cast<SHORT>(x + static_cast<long>(count)), static_cast<SHORT>(y) }, std::span<wchar_t>(&src_char, 1)) != 1 ||
-                                    screen_buffer.read_output_attributes(COORD{ static_cast<SHORT>(x + static_cast<long>(count)), static_cast<SHORT>(y) }, std::span<USHORT>(&src_attr, 1)) != 1)
-                                {
-                                    src_char = L' ';
-                                    src_attr = attributes;
-                                }
-
-                                (void)screen_buffer.write_cell(COORD{ static_cast<SHORT>(x), static_cast<SHORT>(y) }, src_char, src_attr);
-                            }
-
-                            for (long x = limit; x < width_long; ++x)
-                            {
-                                (void)screen_buffer.write_cell(COORD{ static_cast<SHORT>(x), static_cast<SHORT>(y) }, L' ', attributes);
-                            }
+                            (void)screen_buffer.delete_cells(
+                                COORD{ static_cast<SHORT>(x0), static_cast<SHORT>(y) },
+                                count,
+                                ScreenCell{ .character = L' ', .attributes = current_attributes() });
                         }
 
                         // DCH resets the delayed wrap flag.
@@ -2150,7 +2847,7 @@ namespace oc::logging
                                 (void)screen_buffer.write_cell(
                                     COORD{ static_cast<SHORT>(x0 + static_cast<long>(i)), static_cast<SHORT>(y) },
                                     L' ',
-                                    attributes);
+                                    current_attributes());
                             }
                         }
 
@@ -2230,7 +2927,7 @@ namespace oc::logging
                                 const size_t length = width * height;
                                 const COORD origin{ 0, cursor.Y };
                                 (void)screen_buffer.fill_output_characters(origin, L' ', length);
-                                (void)screen_buffer.fill_output_attributes(origin, attributes, length);
+                                (void)screen_buffer.fill_output_attributes(origin, current_attributes(), length);
                             }
                             else
                             {
@@ -2256,7 +2953,7 @@ namespace oc::logging
                                     clip_rect,
                                     COORD{ 0, dest_top },
                                     L' ',
-                                    attributes);
+                                    current_attributes());
                             }
                         }
                     }
@@ -2281,7 +2978,7 @@ namespace oc::logging
                                 const size_t length = width * height;
                                 const COORD origin{ 0, cursor.Y };
                                 (void)screen_buffer.fill_output_characters(origin, L' ', length);
-                                (void)screen_buffer.fill_output_attributes(origin, attributes, length);
+                                (void)screen_buffer.fill_output_attributes(origin, current_attributes(), length);
                             }
                             else
                             {
@@ -2305,7 +3002,7 @@ namespace oc::logging
                                     clip_rect,
                                     COORD{ 0, cursor.Y },
                                     L' ',
-                                    attributes);
+                                    current_attributes());
                             }
                         }
                     }
@@ -2341,7 +3038,7 @@ namespace oc::logging
                         if (length != 0)
                         {
                             (void)screen_buffer.fill_output_characters(origin, L' ', length);
-                            (void)screen_buffer.fill_output_attributes(origin, attributes, length);
+                            (void)screen_buffer.fill_output_attributes(origin, current_attributes(), length);
                         }
 
                         // ED resets the delayed wrap flag.
@@ -2378,7 +3075,7 @@ namespace oc::logging
                             if (length != 0)
                             {
                                 (void)screen_buffer.fill_output_characters(origin, L' ', length);
-                                (void)screen_buffer.fill_output_attributes(origin, attributes, length);
+                                (void)screen_buffer.fill_output_attributes(origin, current_attributes(), length);
                             }
                         }
 
@@ -2396,7 +3093,7 @@ namespace oc::logging
                                 vt_delayed_wrap_position.has_value() &&
                                 vt_delayed_wrap_position->X == cursor.X &&
                                 vt_delayed_wrap_position->Y == cursor.Y;
-                            screen_buffer.save_cursor_state(cursor, attributes, delayed_eol_wrap, vt_origin_mode);
+                            screen_buffer.save_cursor_state(cursor, current_attributes(), delayed_eol_wrap, vt_origin_mode);
                         }
                     }
                     else if (csi.final == L'u')
@@ -2409,7 +3106,7 @@ namespace oc::logging
                         if (screen_buffer.restore_cursor_state(restored, restored_attributes, delayed_eol_wrap, origin_mode_enabled))
                         {
                             cursor = restored;
-                            attributes = restored_attributes;
+                            set_attributes(restored_attributes);
                             vt_origin_mode = origin_mode_enabled;
 
                             cursor.X = static_cast<SHORT>(std::clamp(static_cast<long>(cursor.X), 0L, static_cast<long>(buffer_size.X - 1)));
@@ -2461,10 +3158,11 @@ namespace oc::logging
                             }
                             else if (param == 1049U)
                             {
-                                if (screen_buffer.set_vt_using_alternate_screen_buffer(enable, L' ', attributes))
+                                if (screen_buffer.set_vt_using_alternate_screen_buffer(enable, L' ', current_attributes()))
                                 {
+                                    buffer_size = screen_buffer.screen_buffer_size();
                                     cursor = screen_buffer.cursor_position();
-                                    attributes = screen_buffer.text_attributes();
+                                    set_attributes(screen_buffer.text_attributes());
                                     vt_vertical_margins = screen_buffer.vt_vertical_margins();
                                     vt_origin_mode = screen_buffer.vt_origin_mode_enabled();
                                     vt_delayed_wrap_position.reset();
@@ -2474,571 +3172,379 @@ namespace oc::logging
                     }
 
         };
-        for (size_t offset = 0; offset < text.size();)
-        {
-            const wchar_t ch = text[offset];
-            if (vt_processing)
+        // ESC sequences without CSI/OSC/string introducers (those are parser states, not dispatches).
+        const auto apply_esc = [&](const VtEscSequence& esc) noexcept {
+            if (esc.intermediate_count != 0)
             {
-                auto& vt_state = screen_buffer._vt_output_parse_state;
-                using Phase = detail::VtOutputParseState::Phase;
-
-                switch (vt_state.phase)
+                // DECALN: Screen alignment pattern (ESC # 8). Other designations (charsets) are
+                // consumed as no-ops.
+                if (esc.intermediate_count == 1 && esc.intermediates[0] == L'#' && esc.final == L'8')
                 {
-                case Phase::escape:
-                {
-                    const wchar_t esc_final = ch;
-                    vt_state.phase = Phase::ground;
-                    vt_state.esc_intermediate_count = 0;
-                    vt_state.esc_length = 0;
-
-                    // CSI introducer.
-                    if (esc_final == L'[')
-                    {
-                        vt_state.phase = Phase::csi;
-                        vt_state.csi = {};
-                        vt_state.csi_current = 0;
-                        vt_state.csi_have_digits = false;
-                        vt_state.csi_last_was_separator = false;
-                        vt_state.csi_length = 0;
-                        ++offset;
-                        continue;
-                    }
-
-                    // OSC introducer.
-                    if (esc_final == L']')
-                    {
-                        vt_state.phase = Phase::osc;
-                        vt_state.osc_param = 0;
-                        vt_state.osc_param_have_digits = false;
-                        vt_state.osc_in_param = true;
-                        vt_state.osc_action = 0;
-                        vt_state.osc_capture_payload = false;
-                        vt_state.osc_payload_length = 0;
-                        ++offset;
-                        continue;
-                    }
-
-                    // DCS/PM/APC/SOS string introducers (payload is ignored until ST).
-                    if (esc_final == L'P' || esc_final == L'^' || esc_final == L'_' || esc_final == L'X')
-                    {
-                        vt_state.phase = Phase::string;
-                        ++offset;
-                        continue;
-                    }
-
-                    // DECSC/DECRC: ESC7 / ESC8.
-                    if (esc_final == L'7')
-                    {
-                        const bool delayed_eol_wrap =
-                            vt_delayed_wrap_position.has_value() &&
-                            vt_delayed_wrap_position->X == cursor.X &&
-                            vt_delayed_wrap_position->Y == cursor.Y;
-                        screen_buffer.save_cursor_state(cursor, attributes, delayed_eol_wrap, vt_origin_mode);
-                        ++offset;
-                        continue;
-                    }
+                    vt_delayed_wrap_position.reset();
 
-                    if (esc_final == L'8')
-                    {
-                        COORD restored{};
-                        USHORT restored_attributes{};
-                        bool delayed_eol_wrap = false;
-                        bool origin_mode_enabled = false;
-                        if (screen_buffer.restore_cursor_state(restored, restored_attributes, delayed_eol_wrap, origin_mode_enabled))
-                        {
-                            cursor = restored;
-                            attributes = restored_attributes;
-                            vt_origin_mode = origin_mode_enabled;
+                    const size_t length =
+                        static_cast<size_t>(buffer_size.X) *
+                        static_cast<size_t>(buffer_size.Y);
+                    (void)screen_buffer.fill_output_characters(COORD{ 0, 0 }, L'E', length);
+                    (void)screen_buffer.fill_output_attributes(COORD{ 0, 0 }, default_attributes, length);
 
-                            cursor.X = static_cast<SHORT>(std::clamp(static_cast<long>(cursor.X), 0L, static_cast<long>(buffer_size.X - 1)));
-                            const auto [top, bottom] = resolve_vertical_region();
-                            const long y_min = vt_origin_mode ? static_cast<long>(top) : 0;
-                            const long y_max = vt_origin_mode ? static_cast<long>(bottom) : static_cast<long>(buffer_size.Y - 1);
-                            cursor.Y = static_cast<SHORT>(std::clamp(static_cast<long>(cursor.Y), y_min, y_max));
+                    auto current = current_attribute();
+                    current.legacy = static_cast<USHORT>(current.legacy & ~(COMMON_LVB_REVERSE_VIDEO | COMMON_LVB_UNDERSCORE));
+                    set_current_attribute(current);
 
-                            vt_delayed_wrap_position = delayed_eol_wrap ? std::optional<COORD>(cursor) : std::nullopt;
-                        }
-                        ++offset;
-                        continue;
-                    }
+                    vt_origin_mode = false;
+                    vt_vertical_margins.reset();
+                    screen_buffer.set_vt_vertical_margins(std::nullopt);
+                    cursor = COORD{ 0, 0 };
+                }
+                return;
+            }
 
-                    // Index / Reverse Index: ESC D / ESC M.
-                    if (esc_final == L'D')
-                    {
-                        line_feed();
-                        ++offset;
-                        continue;
-                    }
+            switch (esc.final)
+            {
+            case L'7':
+            {
+                // DECSC: ESC 7.
+                const bool delayed_eol_wrap =
+                    vt_delayed_wrap_position.has_value() &&
+                    vt_delayed_wrap_position->X == cursor.X &&
+                    vt_delayed_wrap_position->Y == cursor.Y;
+                screen_buffer.save_cursor_state(cursor, current_attributes(), delayed_eol_wrap, vt_origin_mode);
+                break;
+            }
+            case L'8':
+            {
+                // DECRC: ESC 8.
+                COORD restored{};
+                USHORT restored_attributes{};
+                bool delayed_eol_wrap = false;
+                bool origin_mode_enabled = false;
+                if (screen_buffer.restore_cursor_state(restored, restored_attributes, delayed_eol_wrap, origin_mode_enabled))
+                {
+                    cursor = restored;
+                    set_attributes(restored_attributes);
+                    vt_origin_mode = origin_mode_enabled;
 
-                    if (esc_final == L'M')
-                    {
-                        reverse_line_feed();
-                        ++offset;
-                        continue;
-                    }
+                    cursor.X = static_cast<SHORT>(std::clamp(static_cast<long>(cursor.X), 0L, static_cast<long>(buffer_size.X - 1)));
+                    const auto [top, bottom] = resolve_vertical_region();
+                    const long y_min = vt_origin_mode ? static_cast<long>(top) : 0;
+                    const long y_max = vt_origin_mode ? static_cast<long>(bottom) : static_cast<long>(buffer_size.Y - 1);
+                    cursor.Y = static_cast<SHORT>(std::clamp(static_cast<long>(cursor.Y), y_min, y_max));
 
-                    // NEL: Next Line (ESC E).
-                    if (esc_final == L'E')
-                    {
-                        cursor.X = 0;
-                        line_feed();
-                        ++offset;
-                        continue;
-                    }
+                    vt_delayed_wrap_position = delayed_eol_wrap ? std::optional<COORD>(cursor) : std::nullopt;
+                }
+                break;
+            }
+            case L'D':
+                // IND: Index (ESC D).
+                line_feed();
+                break;
+            case L'M':
+                // RI: Reverse Index (ESC M).
+                reverse_line_feed();
+                break;
+            case L'E':
+                // NEL: Next Line (ESC E).
+                cursor.X = 0;
+                line_feed();
+                break;
+            case L'c':
+            {
+                // RIS: Hard reset (ESC c).
+                if (screen_buffer.vt_using_alternate_screen_buffer())
+                {
+                    (void)screen_buffer.set_vt_using_alternate_screen_buffer(false, L' ', current_attributes());
+                    buffer_size = screen_buffer.screen_buffer_size();
+                    cursor = screen_buffer.cursor_position();
+                    set_attributes(screen_buffer.text_attributes());
+                    vt_vertical_margins = screen_buffer.vt_vertical_margins();
+                    vt_origin_mode = screen_buffer.vt_origin_mode_enabled();
+                    vt_insert_mode = screen_buffer.vt_insert_mode_enabled();
+                    vt_delayed_wrap_position = screen_buffer.vt_delayed_wrap_position();
+                }
 
-                    if (esc_final == L'c')
-                    {
-                        // RIS: Hard reset (ESC c).
-                        if (screen_buffer.vt_using_alternate_screen_buffer())
-                        {
-                            (void)screen_buffer.set_vt_using_alternate_screen_buffer(false, L' ', attributes);
-                            cursor = screen_buffer.cursor_position();
-                            attributes = screen_buffer.text_attributes();
-                            vt_vertical_margins = screen_buffer.vt_vertical_margins();
-                            vt_origin_mode = screen_buffer.vt_origin_mode_enabled();
-                            vt_insert_mode = screen_buffer.vt_insert_mode_enabled();
-                            vt_delayed_wrap_position = screen_buffer.vt_delayed_wrap_position();
-                        }
+                const auto defaults = ScreenBuffer::default_settings();
+                COLORREF table[16]{};
+                for (size_t i = 0; i < defaults.color_table.size(); ++i)
+                {
+                    table[i] = defaults.color_table[i];
+                }
+                screen_buffer.set_color_table(table);
 
-                        const auto defaults = ScreenBuffer::default_settings();
-                        COLORREF table[16]{};
-                        for (size_t i = 0; i < defaults.color_table.size(); ++i)
-                        {
-                            table[i] = defaults.color_table[i];
-                        }
-                        screen_buffer.set_color_table(table);
+                screen_buffer.set_cursor_info(screen_buffer.cursor_size(), true);
+                screen_buffer.save_cursor_state(COORD{ 0, 0 }, default_attributes, false, false);
 
-                        screen_buffer.set_cursor_info(screen_buffer.cursor_size(), true);
-                        screen_buffer.save_cursor_state(COORD{ 0, 0 }, default_attributes, false, false);
+                vt_autowrap = true;
+                vt_origin_mode = false;
+                vt_insert_mode = false;
+                vt_delayed_wrap_position.reset();
 
-                        vt_autowrap = true;
-                        vt_origin_mode = false;
-                        vt_insert_mode = false;
-                        vt_delayed_wrap_position.reset();
+                vt_vertical_margins.reset();
+                screen_buffer.set_vt_vertical_margins(std::nullopt);
 
-                        vt_vertical_margins.reset();
-                        screen_buffer.set_vt_vertical_margins(std::nullopt);
+                set_attributes(default_attributes);
+                cursor = COORD{ 0, 0 };
 
-                        attributes = default_attributes;
-                        cursor = COORD{ 0, 0 };
+                const size_t length = static_cast<size_t>(buffer_size.X) * static_cast<size_t>(buffer_size.Y);
+                (void)screen_buffer.fill_output_characters(cursor, L' ', length);
+                (void)screen_buffer.fill_output_attributes(cursor, current_attributes(), length);
+                break;
+            }
+            default:
+                // ST (ESC \) written on its own and unsupported finals are consumed as no-ops to
+                // avoid escape-byte leakage.
+                break;
+            }
+        };
 
-                        const size_t length = static_cast<size_t>(buffer_size.X) * static_cast<size_t>(buffer_size.Y);
-                        (void)screen_buffer.fill_output_characters(cursor, L' ', length);
-                        (void)screen_buffer.fill_output_attributes(cursor, attributes, length);
+        // Processed-output controls. Returns false for a control this mode draws as a glyph.
+        const auto execute_control = [&](const wchar_t ch) noexcept -> bool {
+            if (!processed_output)
+            {
+                return false;
+            }
 
-                        ++offset;
-                        continue;
-                    }
+            switch (ch)
+            {
+            case L'\r':
+                cursor.X = 0;
+                return true;
+            case L'\n':
+                // An explicit line feed ends the logical line.
+                screen_buffer.set_row_wrapped(cursor.Y, false);
+                if (!disable_newline_auto_return)
+                {
+                    cursor.X = 0;
+                }
+                line_feed();
+                return true;
+            case L'\b':
+                if (cursor.X > 0)
+                {
+                    --cursor.X;
+                }
+                return true;
+            case L'\t':
+            {
+                constexpr int tab_width = 8;
+                const int tab_offset = cursor.X < 0 ? 0 : static_cast<int>(cursor.X) % tab_width;
+                const int spaces = tab_width - tab_offset;
+                for (int i = 0; i < spaces; ++i)
+                {
+                    write_printable(L' ');
+                }
+                return true;
+            }
+            default:
+                return false;
+            }
+        };
 
-                    // String terminator (ESC \\) is a no-op when written directly.
-                    if (esc_final == L'\\')
-                    {
-                        ++offset;
-                        continue;
-                    }
+        OpenGlyph open_glyph{};
 
-                    // ESC dispatch with intermediates (charset designation, DECALN, etc).
-                    if (esc_final >= 0x20 && esc_final <= 0x2f)
+        // Writes the text at `at`: one glyph, or a run of plain text. Returns the code units taken.
+        const auto print_at = [&](const size_t at) noexcept -> size_t {
+            const wchar_t ch = text[at];
+            if (ch >= first_non_narrow_code_point) [[unlikely]]
+            {
+                // A BMP glyph that cannot join the previous one (most CJK text) skips the cluster
+                // checks and is written like any other character.
+                if (!is_cluster_character(ch) && !open_glyph.joiner)
+                {
+                    const int width = code_point_width(ch);
+                    if (width != 0)
                     {
-                        vt_state.phase = Phase::esc_dispatch;
-                        vt_state.esc_intermediate_count = 0;
-                        vt_state.esc_length = 1;
-                        if (!vt_state.esc_intermediates.empty())
+                        const WrittenGlyph glyph = width == 2 ? write_wide_printable(ch) : write_printable(ch);
+                        if (may_extend(at + 1)) [[unlikely]]
                         {
-                            vt_state.esc_intermediates[0] = esc_final;
-                            vt_state.esc_intermediate_count = 1;
+                            open_glyph = OpenGlyph{ .glyph = glyph, .end = at + 1 };
                         }
-                        ++offset;
-                        continue;
+                        return 1;
                     }
+                }
 
-                    // Consume unsupported ESC dispatch finals as no-ops to avoid escape-byte leakage.
-                    ++offset;
-                    continue;
-                }
-                case Phase::esc_dispatch:
-                {
-                    constexpr size_t max_sequence_length = 16;
-                    const wchar_t candidate = ch;
-
-                    if (candidate >= 0x20 && candidate <= 0x2f)
-                    {
-                        if (vt_state.esc_intermediate_count < vt_state.esc_intermediates.size())
-                        {
-                            vt_state.esc_intermediates[vt_state.esc_intermediate_count++] = candidate;
-                        }
-
-                        if (++vt_state.esc_length >= max_sequence_length)
-                        {
-                            vt_state.phase = Phase::ground;
-                            vt_state.esc_intermediate_count = 0;
-                            vt_state.esc_length = 0;
-                        }
-
-                        ++offset;
-                        continue;
-                    }
-
-                    if (candidate >= 0x30 && candidate <= 0x7e)
-                    {
-                        // DECALN: Screen alignment pattern (ESC # 8).
-                        if (vt_state.esc_intermediate_count == 1 &&
-                            vt_state.esc_intermediates[0] == L'#' &&
-                            candidate == L'8')
-                        {
-                            vt_delayed_wrap_position.reset();
-
-                            const size_t length =
-                                static_cast<size_t>(buffer_size.X) *
-                                static_cast<size_t>(buffer_size.Y);
-                            (void)screen_buffer.fill_output_characters(COORD{ 0, 0 }, L'E', length);
-                            (void)screen_buffer.fill_output_attributes(COORD{ 0, 0 }, default_attributes, length);
-
-                            attributes = static_cast<USHORT>(attributes & ~(COMMON_LVB_REVERSE_VIDEO | COMMON_LVB_UNDERSCORE));
+                return write_non_narrow(at, open_glyph);
+            }
 
-                            vt_origin_mode = false;
-                            vt_vertical_margins.reset();
-                            screen_buffer.set_vt_vertical_margins(std::nullopt);
-                            cursor = COORD{ 0, 0 };
-                        }
+            // Plain text up to the next control, escape or non-narrow code unit is stored a row at a
+            // time instead of one cell per iteration.
+            const size_t run = count_plain_characters(text.data() + at, text.size() - at);
+            const WrittenGlyph glyph = run > 1 ? write_printable_run(text.substr(at, run)) : write_printable(ch);
+            const size_t end = at + (run > 1 ? run : 1);
+            if (may_extend(end)) [[unlikely]]
+            {
+                open_glyph = OpenGlyph{ .glyph = glyph, .end = end };
+            }
+            return end - at;
+        };
 
-                        vt_state.phase = Phase::ground;
-                        vt_state.esc_intermediate_count = 0;
-                        vt_state.esc_length = 0;
-                        ++offset;
-                        continue;
-                    }
+        auto& parser = screen_buffer._vt_output_parser;
 
-                    vt_state.phase = Phase::ground;
-                    vt_state.esc_intermediate_count = 0;
-                    vt_state.esc_length = 0;
-                    ++offset;
-                    continue;
-                }
-                case Phase::csi:
+        // Applies a control or sequence the parser dispatched. Returns false for a control that
+        // starts nothing, which the caller draws as a glyph, as without VT processing.
+        const auto apply_vt_action = [&](const VtAction action) noexcept -> bool {
+            switch (action)
+            {
+            case VtAction::execute:
+                return execute_control(parser.control());
+            case VtAction::esc_dispatch:
+                apply_esc(parser.esc());
+                break;
+            case VtAction::csi_dispatch:
+            {
+                // Only sequences without a leader other than `?`, and without intermediates
+                // other than DECSTR's `!`, are implemented.
+                const auto& csi = parser.csi();
+                if ((csi.leader != 0 && !csi.private_marker) || (csi.intermediate_count != 0 && !csi.exclamation_marker))
                 {
-                    constexpr size_t max_sequence_length = 128;
-                    if (vt_state.csi_length++ >= max_sequence_length)
-                    {
-                        vt_state.phase = Phase::ground;
-                        vt_state.csi = {};
-                        vt_state.csi_current = 0;
-                        vt_state.csi_have_digits = false;
-                        vt_state.csi_last_was_separator = false;
-                        vt_state.csi_length = 0;
-                        ++offset;
-                        continue;
-                    }
-
-                    if (ch >= L'0' && ch <= L'9')
-                    {
-                        vt_state.csi_have_digits = true;
-                        vt_state.csi_last_was_separator = false;
-                        const unsigned digit = static_cast<unsigned>(ch - L'0');
-                        if (vt_state.csi_current <= 1'000'000U)
-                        {
-                            vt_state.csi_current = vt_state.csi_current * 10U + digit;
-                        }
-                        ++offset;
-                        continue;
-                    }
-
-                    if (ch == L'?')
-                    {
-                        vt_state.csi.private_marker = true;
-                        ++offset;
-                        continue;
-                    }
+                    break;
+                }
 
-                    if (ch == L'!')
-                    {
-                        vt_state.csi.exclamation_marker = true;
-                        ++offset;
-                        continue;
-                    }
+                if (csi.final == L'm' && csi.param_count == 0)
+                {
+                    // CSI m is SGR 0.
+                    VtCsiSequence reset = csi;
+                    reset.params[0] = 0U;
+                    reset.param_count = 1;
+                    apply_csi(reset);
+                    break;
+                }
 
-                    if (ch == L';')
+                apply_csi(csi);
+                break;
+            }
+            case VtAction::osc_dispatch:
+                switch (parser.osc_command())
+                {
+                case 0U:
+                case 1U:
+                case 2U:
+                case 21U:
+                    if (title_state != nullptr)
                     {
-                        vt_state.csi_last_was_separator = true;
-                        if (vt_state.csi.param_count < vt_state.csi.params.size())
-                        {
-                            vt_state.csi.params[vt_state.csi.param_count++] = vt_state.csi_have_digits ? vt_state.csi_current : 0U;
-                        }
-                        vt_state.csi_current = 0;
-                        vt_state.csi_have_digits = false;
-                        ++offset;
-                        continue;
+                        (void)title_state->set_title(parser.osc_payload());
                     }
+                    break;
+                default:
+                    break;
+                }
+                break;
+            case VtAction::print:
+            case VtAction::none:
+                break;
+            }
+            return true;
+        };
 
-                    if (ch >= 0x40 && ch <= 0x7e)
+        // Writes `text` and applies the controls and sequences in it.
+        const auto apply_text = [&]() noexcept {
+            open_glyph = OpenGlyph{};
+            if (!vt_processing)
+            {
+                for (size_t offset = 0; offset < text.size();)
+                {
+                    if (text[offset] < L' ' && execute_control(text[offset]))
                     {
-                        if (vt_state.csi_have_digits || vt_state.csi_last_was_separator)
-                        {
-                            if (vt_state.csi.param_count < vt_state.csi.params.size())
-                            {
-                                vt_state.csi.params[vt_state.csi.param_count++] = vt_state.csi_have_digits ? vt_state.csi_current : 0U;
-                            }
-                        }
-
-                        vt_state.csi.final = ch;
-                        if (vt_state.csi.final == L'm' && vt_state.csi.param_count == 0)
-                        {
-                            vt_state.csi.params[vt_state.csi.param_count++] = 0U;
-                        }
-
-                        apply_csi(vt_state.csi);
-
-                        vt_state.phase = Phase::ground;
-                        vt_state.csi = {};
-                        vt_state.csi_current = 0;
-                        vt_state.csi_have_digits = false;
-                        vt_state.csi_last_was_separator = false;
-                        vt_state.csi_length = 0;
                         ++offset;
                         continue;
                     }
+                    offset += print_at(offset);
+                }
+                return;
+            }
 
-                    // Ignore intermediate/private parameter bytes while waiting for the final byte.
-                    ++offset;
-                    continue;
+            for (size_t offset = 0; offset < text.size();)
+            {
+                const VtAction action = parser.advance(text, offset);
+                if (action == VtAction::print)
+                {
+                    offset += print_at(offset);
                 }
-                case Phase::osc:
+                else if (!apply_vt_action(action))
                 {
-                    if (vt_state.osc_in_param)
-                    {
-                        if (ch >= L'0' && ch <= L'9')
-                        {
-                            vt_state.osc_param_have_digits = true;
-                            const unsigned digit = static_cast<unsigned>(ch - L'0');
-                            if (vt_state.osc_param <= 1'000'000U)
-                            {
-                                vt_state.osc_param = vt_state.osc_param * 10U + digit;
-                            }
-                            ++offset;
-                            continue;
-                        }
-
-                        if (ch == L';')
-                        {
-                            vt_state.osc_action = vt_state.osc_param_have_digits ? vt_state.osc_param : 0U;
-                            const unsigned action = vt_state.osc_action;
-                            vt_state.osc_capture_payload = (action == 0U || action == 1U || action == 2U || action == 21U);
-                            vt_state.osc_in_param = false;
-                            vt_state.osc_payload_length = 0;
-                            ++offset;
-                            continue;
-                        }
-
-                        // Invalid OSC parameter bytes: abort and return to ground.
-                        vt_state.phase = Phase::ground;
-                        vt_state.osc_param = 0;
-                        vt_state.osc_param_have_digits = false;
-                        vt_state.osc_in_param = true;
-                        vt_state.osc_action = 0;
-                        vt_state.osc_capture_payload = false;
-                        vt_state.osc_payload_length = 0;
-                        ++offset;
-                        continue;
-                    }
+                    (void)print_at(offset - 1);
+                }
+            }
+        };
 
-                    if (ch == L'\x07' || ch == L'\x9c')
+        if constexpr (std::is_same_v<Unit, wchar_t>)
+        {
+            text = input;
+            apply_text();
+        }
+        else
+        {
+            // UTF-8: controls and sequences are parsed on the bytes, and only text is decoded, a run
+            // at a time, into a buffer on the stack. A decoded run goes through `apply_text`, so a
+            // C1 control or OSC text written as UTF-8 reaches the parser as UTF-16.
+            std::array<wchar_t, 2048> decoded;
+
+            // Decodes and writes the text at `offset`. When a run fills `decoded`, everything from
+            // its last unit below U+0300 on is held back for the next run, so a combining mark
+            // after the cut still joins its glyph.
+            const auto print_utf8 = [&](size_t& offset) noexcept {
+                size_t held = 0;
+                for (;;)
+                {
+                    const size_t count = held + parser.decode_utf8(input, offset, std::span(decoded).subspan(held));
+                    size_t cut = count;
+                    if (count + 1 >= decoded.size())
                     {
-                        if (title_state != nullptr && vt_state.osc_capture_payload)
+                        cut = count - 1;
+                        while (cut != 0 && decoded[cut] >= first_non_narrow_code_point)
                         {
-                            switch (vt_state.osc_action)
-                            {
-                            case 0U:
-                            case 1U:
-                            case 2U:
-                            case 21U:
-                                (void)title_state->set_title(std::wstring_view(vt_state.osc_payload.data(), vt_state.osc_payload_length));
-                                break;
-                            default:
-                                break;
-                            }
+                            --cut;
                         }
-
-                        vt_state.phase = Phase::ground;
-                        vt_state.osc_param = 0;
-                        vt_state.osc_param_have_digits = false;
-                        vt_state.osc_in_param = true;
-                        vt_state.osc_action = 0;
-                        vt_state.osc_capture_payload = false;
-                        vt_state.osc_payload_length = 0;
-                        ++offset;
-                        continue;
-                    }
-
-                    if (ch == L'\x1b')
-                    {
-                        vt_state.phase = Phase::osc_escape;
-                        ++offset;
-                        continue;
-                    }
-
-                    if (vt_state.osc_capture_payload && vt_state.osc_payload_length < vt_state.osc_payload.size())
-                    {
-                        vt_state.osc_payload[vt_state.osc_payload_length++] = ch;
-                    }
-
-                    ++offset;
-                    continue;
-                }
-                case Phase::osc_escape:
-                {
-                    if (ch == L'\\')
-                    {
-                        if (title_state != nullptr && vt_state.osc_capture_payload)
+                        if (cut == 0)
                         {
-                            switch (vt_state.osc_action)
-                            {
-                            case 0U:
-                            case 1U:
-                            case 2U:
-                            case 21U:
-                                (void)title_state->set_title(std::wstring_view(vt_state.osc_payload.data(), vt_state.osc_payload_length));
-                                break;
-                            default:
-                                break;
-                            }
+                            cut = count;
                         }
-
-                        vt_state.phase = Phase::ground;
-                        vt_state.osc_param = 0;
-                        vt_state.osc_param_have_digits = false;
-                        vt_state.osc_in_param = true;
-                        vt_state.osc_action = 0;
-                        vt_state.osc_capture_payload = false;
-                        vt_state.osc_payload_length = 0;
-                        ++offset;
-                        continue;
                     }
 
-                    vt_state.phase = Phase::osc;
-                    continue;
-                }
-                case Phase::string:
-                {
-                    if (ch == L'\x9c')
+                    text = std::wstring_view(decoded.data(), cut);
+                    apply_text();
+                    if (cut == count)
                     {
-                        vt_state.phase = Phase::ground;
-                        ++offset;
-                        continue;
+                        return;
                     }
+                    held = count - cut;
+                    std::copy(decoded.begin() + cut, decoded.begin() + count, decoded.begin());
+                }
+            };
 
-                    if (ch == L'\x1b')
-                    {
-                        vt_state.phase = Phase::string_escape;
-                        ++offset;
-                        continue;
-                    }
+            // A control byte the parser hands back, or any control without VT processing.
+            const auto apply_control_unit = [&](const wchar_t unit) noexcept {
+                text = std::wstring_view(&unit, 1);
+                apply_text();
+            };
 
-                    ++offset;
-                    continue;
-                }
-                case Phase::string_escape:
+            for (size_t offset = 0; offset < input.size();)
+            {
+                if (!vt_processing)
                 {
-                    if (ch == L'\\')
+                    // Text up to the next control, or U+FFFD for a sequence the control cut short.
+                    const size_t start = offset;
+                    print_utf8(offset);
+                    if (offset == start)
                     {
-                        vt_state.phase = Phase::ground;
-                        ++offset;
-                        continue;
+                        apply_control_unit(static_cast<wchar_t>(static_cast<unsigned char>(input[offset++])));
                     }
-
-                    vt_state.phase = Phase::string;
-                    continue;
-                }
-                case Phase::ground:
-                    break;
-                }
-
-                if (ch == L'\x1b')
-                {
-                    vt_state.phase = Phase::escape;
-                    ++offset;
-                    continue;
-                }
-
-                if (ch == L'\x009b')
-                {
-                    vt_state.phase = Phase::csi;
-                    vt_state.csi = {};
-                    vt_state.csi_current = 0;
-                    vt_state.csi_have_digits = false;
-                    vt_state.csi_last_was_separator = false;
-                    vt_state.csi_length = 0;
-                    ++offset;
-                    continue;
-                }
-
-                if (ch == L'\x9d')
-                {
-                    vt_state.phase = Phase::osc;
-                    vt_state.osc_param = 0;
-                    vt_state.osc_param_have_digits = false;
-                    vt_state.osc_in_param = true;
-                    vt_state.osc_action = 0;
-                    vt_state.osc_capture_payload = false;
-                    vt_state.osc_payload_length = 0;
-                    ++offset;
                     continue;
                 }
 
-                if (ch == L'\x9c')
+                const VtAction action = parser.advance(input, offset);
+                if (action == VtAction::print)
                 {
-                    ++offset;
-                    continue;
-                }
-
-                if (ch == L'\x90' || ch == L'\x98' || ch == L'\x9e' || ch == L'\x9f')
-                {
-                    vt_state.phase = Phase::string;
-                    ++offset;
-                    continue;
+                    print_utf8(offset);
                 }
-            }
-            if (processed_output)
-            {
-                switch (ch)
-                {
-                case L'\r':
-                    cursor.X = 0;
-                    ++offset;
-                    continue;
-                case L'\n':
-                    if (!disable_newline_auto_return)
-                    {
-                        cursor.X = 0;
-                    }
-                    line_feed();
-                    ++offset;
-                    continue;
-                case L'\b':
-                    if (cursor.X > 0)
-                    {
-                        --cursor.X;
-                    }
-                    ++offset;
-                    continue;
-                case L'\t':
+                else if (!apply_vt_action(action))
                 {
-                    constexpr int tab_width = 8;
-                    const int tab_offset = cursor.X < 0 ? 0 : static_cast<int>(cursor.X) % tab_width;
-                    const int spaces = tab_width - tab_offset;
-                    for (int i = 0; i < spaces; ++i)
-                    {
-                        write_printable(L' ');
-                    }
-                    ++offset;
-                    continue;
-                }
-                default:
-                    break;
+                    const wchar_t unit = parser.control();
+                    text = std::wstring_view(&unit, 1);
+                    open_glyph = OpenGlyph{};
+                    (void)print_at(0);
                 }
             }
-
-            write_printable(ch);
-            ++offset;
         }
 
         if (vt_autowrap != original_vt_autowrap)
@@ -3058,10 +3564,60 @@ namespace oc::logging
 
         screen_buffer.set_vt_delayed_wrap_position(vt_delayed_wrap_position);
         screen_buffer.set_cursor_position(cursor);
-        screen_buffer.set_text_attributes(attributes);
+        screen_buffer.set_text_attributes(current_attributes());
         screen_buffer.snap_window_to_cursor();
     }
 
+    template<typename HostIo>
+    inline void apply_text_to_screen_buffer(
+        ScreenBuffer& screen_buffer,
+        const std::wstring_view text,
+        const ULONG output_mode,
+        ServerState* const title_state,
+        HostIo* const host_io) noexcept
+    {
+        detail::apply_output_to_screen_buffer(screen_buffer, text, output_mode, title_state, host_io);
+    }
+
+    // The same for UTF-8 output as read from a pseudoconsole, without widening it to UTF-16 first.
+    // A UTF-8 sequence split across writes is kept in the screen buffer's VT parser and finished by
+    // the next call.
+    template<typename HostIo>
+    inline void apply_utf8_to_screen_buffer(
+        ScreenBuffer& screen_buffer,
+        const std::string_view utf8,
+        const ULONG output_mode,
+        ServerState* const title_state,
+        HostIo* const host_io) noexcept
+    {
+        detail::apply_output_to_screen_buffer(screen_buffer, utf8, output_mode, title_state, host_io);
+    }
+
+    template<typename HostIo>
+    inline void ServerState::flush_deferred_output(HostIo& host_io) noexcept
+    {
+        if (_deferred_output.empty())
+        {
+            return;
+        }
+
+        // Applying a write can set the title, which does not touch the log, so it can be walked in place.
+        size_t start = 0;
+        for (const auto& entry : _deferred_output)
+        {
+            const auto text = std::wstring_view(_deferred_output_text).substr(start, entry.end - start);
+            apply_text_to_screen_buffer(*entry.screen_buffer, text, entry.output_mode, this, &host_io);
+            start = entry.end;
+        }
+
+        _deferred_output.clear();
+        _deferred_output_text.clear();
+        if (_deferred_output_text.capacity() > deferred_output_limit * 2)
+        {
+            std::wstring{}.swap(_deferred_output_text);
+        }
+    }
+
     [[nodiscard]] inline std::expected<size_t, DeviceCommError> wide_to_multibyte_length(
         const std::wstring_view value,
         const UINT code_page,
@@ -3099,3764 +3655,4579 @@ namespace oc::logging
         return static_cast<size_t>(required);
     }
 
-    template<typename Comm, typename HostIo = NullHostIo>
-    [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> dispatch_message(
-        ServerState& state,
-        BasicApiMessage<Comm>& message,
-        HostIo& host_io) noexcept
+    namespace detail
     {
-        DispatchOutcome outcome{};
+        // Per-request state shared by the USER_DEFINED API handlers. The dispatcher validates the
+        // message header and primes the completion/offsets before a handler sees the context.
+        template<typename Comm, typename HostIo>
+        struct UserDefinedDispatchContext final
+        {
+            ServerState& state;
+            BasicApiMessage<Comm>& message;
+            HostIo& host_io;
+            IoPacket& packet;
+            const IoDescriptor& descriptor;
+            ULONG api_number{};
+            ULONG api_size{};
+        };
 
-        const auto& descriptor = message.descriptor();
-        switch (descriptor.function)
+        template<typename Comm, typename HostIo>
+        void reject_user_defined_not_implemented(UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
         {
-        case console_io_user_defined:
+            // Even when the operation is rejected, conhost returns the API descriptor bytes.
+            // Zero-fill them to keep replies deterministic and avoid leaking meaningless client
+            // input for deprecated/unsupported operations.
+            std::memset(&context.packet.payload.user_defined.u, 0, context.api_size);
+            context.message.set_reply_status(core::status_not_implemented);
+            context.message.set_reply_information(0);
+        }
+
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_mode(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
         {
-            auto& packet = message.packet();
-            const auto api_number = packet.payload.user_defined.msg_header.ApiNumber;
-            const auto api_size = packet.payload.user_defined.msg_header.ApiDescriptorSize;
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-            if (api_size > sizeof(packet.payload.user_defined.u))
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr)
             {
-                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            // Mirror the upstream response behavior: always return the API descriptor bytes.
-            message.completion().write.data = &packet.payload.user_defined.u;
-            message.completion().write.size = api_size;
-            message.completion().write.offset = 0;
+            if (handle->kind == ObjectKind::input)
+            {
+                packet.payload.user_defined.u.console_msg_l1.GetConsoleMode.Mode = state.input_mode();
+            }
+            else
+            {
+                packet.payload.user_defined.u.console_msg_l1.GetConsoleMode.Mode = state.output_mode();
+            }
 
-            message.set_write_offset(api_size);
-            message.set_read_offset(api_size + sizeof(CONSOLE_MSG_HEADER));
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_mode(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-            const auto reject_user_defined_not_implemented = [&]() noexcept {
-                // Even when the operation is rejected, conhost returns the API descriptor bytes.
-                // Zero-fill them to keep replies deterministic and avoid leaking meaningless client
-                // input for deprecated/unsupported operations.
-                std::memset(&packet.payload.user_defined.u, 0, api_size);
-                message.set_reply_status(core::status_not_implemented);
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
-            };
+                return outcome;
+            }
 
-            // Minimal subset: layer 1 mode and code page APIs.
-            if (api_number == static_cast<ULONG>(ConsolepGetMode))
+            const ULONG requested = packet.payload.user_defined.u.console_msg_l1.SetConsoleMode.Mode;
+            if (handle->kind == ObjectKind::input)
+            {
+                state.set_input_mode(requested);
+
+                // Conhost compatibility: input modes are applied even if the call ultimately
+                // returns an error for an invalid combination/unknown bits.
+                constexpr ULONG input_modes =
+                    ENABLE_LINE_INPUT |
+                    ENABLE_PROCESSED_INPUT |
+                    ENABLE_ECHO_INPUT |
+                    ENABLE_WINDOW_INPUT |
+                    ENABLE_MOUSE_INPUT |
+                    ENABLE_VIRTUAL_TERMINAL_INPUT;
+                constexpr ULONG private_modes =
+                    ENABLE_INSERT_MODE |
+                    ENABLE_QUICK_EDIT_MODE |
+                    ENABLE_AUTO_POSITION |
+                    ENABLE_EXTENDED_FLAGS;
+                constexpr ULONG valid_bits = input_modes | private_modes;
+
+                const bool has_invalid_bits = (requested & ~valid_bits) != 0;
+                const bool echo_without_line = (requested & ENABLE_ECHO_INPUT) != 0 &&
+                                               (requested & ENABLE_LINE_INPUT) == 0;
+                const auto status = (has_invalid_bits || echo_without_line)
+                    ? core::status_invalid_parameter
+                    : core::status_success;
+                message.set_reply_status(status);
+            }
+            else
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr)
+                constexpr ULONG valid_bits =
+                    ENABLE_PROCESSED_OUTPUT |
+                    ENABLE_WRAP_AT_EOL_OUTPUT |
+                    ENABLE_VIRTUAL_TERMINAL_PROCESSING |
+                    DISABLE_NEWLINE_AUTO_RETURN |
+                    ENABLE_LVB_GRID_WORLDWIDE;
+
+                if ((requested & ~valid_bits) != 0)
                 {
-                    message.set_reply_status(core::status_invalid_handle);
+                    message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                if (handle->kind == ObjectKind::input)
-                {
-                    packet.payload.user_defined.u.console_msg_l1.GetConsoleMode.Mode = state.input_mode();
-                }
-                else
-                {
-                    packet.payload.user_defined.u.console_msg_l1.GetConsoleMode.Mode = state.output_mode();
-                }
-
+                state.set_output_mode(requested);
                 message.set_reply_status(core::status_success);
+            }
+
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_cp(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto& body = packet.payload.user_defined.u.console_msg_l1.GetConsoleCP;
+            body.CodePage = body.Output ? state.output_code_page() : state.input_code_page();
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_cp(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            const auto& body = packet.payload.user_defined.u.console_msg_l2.SetConsoleCP;
+            if (body.Output)
+            {
+                state.set_output_code_page(body.CodePage);
+            }
+            else
+            {
+                state.set_input_code_page(body.CodePage);
+            }
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_cursor_info(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetMode))
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                const ULONG requested = packet.payload.user_defined.u.console_msg_l1.SetConsoleMode.Mode;
-                if (handle->kind == ObjectKind::input)
-                {
-                    state.set_input_mode(requested);
-
-                    // Conhost compatibility: input modes are applied even if the call ultimately
-                    // returns an error for an invalid combination/unknown bits.
-                    constexpr ULONG input_modes =
-                        ENABLE_LINE_INPUT |
-                        ENABLE_PROCESSED_INPUT |
-                        ENABLE_ECHO_INPUT |
-                        ENABLE_WINDOW_INPUT |
-                        ENABLE_MOUSE_INPUT |
-                        ENABLE_VIRTUAL_TERMINAL_INPUT;
-                    constexpr ULONG private_modes =
-                        ENABLE_INSERT_MODE |
-                        ENABLE_QUICK_EDIT_MODE |
-                        ENABLE_AUTO_POSITION |
-                        ENABLE_EXTENDED_FLAGS;
-                    constexpr ULONG valid_bits = input_modes | private_modes;
-
-                    const bool has_invalid_bits = (requested & ~valid_bits) != 0;
-                    const bool echo_without_line = (requested & ENABLE_ECHO_INPUT) != 0 &&
-                                                   (requested & ENABLE_LINE_INPUT) == 0;
-                    const auto status = (has_invalid_bits || echo_without_line)
-                        ? core::status_invalid_parameter
-                        : core::status_success;
-                    message.set_reply_status(status);
-                }
-                else
-                {
-                    constexpr ULONG valid_bits =
-                        ENABLE_PROCESSED_OUTPUT |
-                        ENABLE_WRAP_AT_EOL_OUTPUT |
-                        ENABLE_VIRTUAL_TERMINAL_PROCESSING |
-                        DISABLE_NEWLINE_AUTO_RETURN |
-                        ENABLE_LVB_GRID_WORLDWIDE;
+            auto& body = packet.payload.user_defined.u.console_msg_l2.GetConsoleCursorInfo;
+            body.CursorSize = screen_buffer->cursor_size();
+            body.Visible = screen_buffer->cursor_visible() ? TRUE : FALSE;
 
-                    if ((requested & ~valid_bits) != 0)
-                    {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                    state.set_output_mode(requested);
-                    message.set_reply_status(core::status_success);
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_cursor_info(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetCP))
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
             {
-                auto& body = packet.payload.user_defined.u.console_msg_l1.GetConsoleCP;
-                body.CodePage = body.Output ? state.output_code_page() : state.input_code_page();
-
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetCP))
+            const auto& body = packet.payload.user_defined.u.console_msg_l2.SetConsoleCursorInfo;
+            if (body.CursorSize < 1 || body.CursorSize > 100)
             {
-                const auto& body = packet.payload.user_defined.u.console_msg_l2.SetConsoleCP;
-                if (body.Output)
-                {
-                    state.set_output_code_page(body.CodePage);
-                }
-                else
-                {
-                    state.set_input_code_page(body.CodePage);
-                }
-
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetCursorInfo))
-            {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            screen_buffer->set_cursor_info(body.CursorSize, body.Visible != FALSE);
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_screen_buffer_info(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                auto& body = packet.payload.user_defined.u.console_msg_l2.GetConsoleCursorInfo;
-                body.CursorSize = screen_buffer->cursor_size();
-                body.Visible = screen_buffer->cursor_visible() ? TRUE : FALSE;
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                message.set_reply_status(core::status_success);
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetCursorInfo))
+            auto& body = packet.payload.user_defined.u.console_msg_l2.GetConsoleScreenBufferInfo;
+            body.Size = screen_buffer->screen_buffer_size();
+            body.CursorPosition = screen_buffer->cursor_position();
+            const auto window_rect = screen_buffer->window_rect();
+            body.ScrollPosition = screen_buffer->scroll_position();
+            body.Attributes = screen_buffer->legacy_attributes(screen_buffer->text_attributes());
+            // ConDrv's `CurrentWindowSize` is expressed as an inclusive delta (Right-Left, Bottom-Top),
+            // matching how the inbox conhost populates `CONSOLE_SCREENBUFFERINFO_MSG`.
+            body.CurrentWindowSize.X = static_cast<SHORT>(window_rect.Right - window_rect.Left);
+            body.CurrentWindowSize.Y = static_cast<SHORT>(window_rect.Bottom - window_rect.Top);
+            body.MaximumWindowSize = screen_buffer->maximum_window_size();
+            body.PopupAttributes = screen_buffer->legacy_attributes(screen_buffer->text_attributes());
+            body.FullscreenSupported = FALSE;
+
+            const auto& table = screen_buffer->color_table();
+            for (size_t i = 0; i < table.size(); ++i)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                body.ColorTable[i] = table[i];
+            }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                const auto& body = packet.payload.user_defined.u.console_msg_l2.SetConsoleCursorInfo;
-                if (body.CursorSize < 1 || body.CursorSize > 100)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_screen_buffer_info(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                screen_buffer->set_cursor_info(body.CursorSize, body.Visible != FALSE);
-                message.set_reply_status(core::status_success);
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetScreenBufferInfo))
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto& body = packet.payload.user_defined.u.console_msg_l2.GetConsoleScreenBufferInfo;
-                body.Size = screen_buffer->screen_buffer_size();
-                body.CursorPosition = screen_buffer->cursor_position();
-                const auto window_rect = screen_buffer->window_rect();
-                body.ScrollPosition = screen_buffer->scroll_position();
-                body.Attributes = screen_buffer->text_attributes();
-                // ConDrv's `CurrentWindowSize` is expressed as an inclusive delta (Right-Left, Bottom-Top),
-                // matching how the inbox conhost populates `CONSOLE_SCREENBUFFERINFO_MSG`.
-                body.CurrentWindowSize.X = static_cast<SHORT>(window_rect.Right - window_rect.Left);
-                body.CurrentWindowSize.Y = static_cast<SHORT>(window_rect.Bottom - window_rect.Top);
-                body.MaximumWindowSize = screen_buffer->maximum_window_size();
-                body.PopupAttributes = screen_buffer->text_attributes();
-                body.FullscreenSupported = FALSE;
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                const auto& table = screen_buffer->color_table();
-                for (size_t i = 0; i < table.size(); ++i)
-                {
-                    body.ColorTable[i] = table[i];
-                }
+            auto& body = packet.payload.user_defined.u.console_msg_l2.SetConsoleScreenBufferInfo;
+            if (body.Size.X <= 0 || body.Size.Y <= 0)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                message.set_reply_status(core::status_success);
+            if (!screen_buffer->set_screen_buffer_size(body.Size))
+            {
+                message.set_reply_status(core::status_no_memory);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetScreenBufferInfo))
+            if (body.CursorPosition.X < 0 ||
+                body.CursorPosition.Y < 0 ||
+                body.CursorPosition.X >= body.Size.X ||
+                body.CursorPosition.Y >= body.Size.Y)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            screen_buffer->set_cursor_position(body.CursorPosition);
+            screen_buffer->set_text_attributes(attribute_id_from_legacy(body.Attributes));
+            screen_buffer->set_default_text_attributes(attribute_id_from_legacy(body.Attributes));
+            screen_buffer->set_color_table(body.ColorTable);
 
-                auto& body = packet.payload.user_defined.u.console_msg_l2.SetConsoleScreenBufferInfo;
-                if (body.Size.X <= 0 || body.Size.Y <= 0)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            if (body.ScrollPosition.X < 0 || body.ScrollPosition.Y < 0 ||
+                body.CurrentWindowSize.X < 0 || body.CurrentWindowSize.Y < 0)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                if (!screen_buffer->set_screen_buffer_size(body.Size))
+            {
+                const long left = body.ScrollPosition.X;
+                const long top = body.ScrollPosition.Y;
+                const long right = left + body.CurrentWindowSize.X;
+                const long bottom = top + body.CurrentWindowSize.Y;
+                if (right < left || bottom < top)
                 {
-                    message.set_reply_status(core::status_no_memory);
+                    message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                if (body.CursorPosition.X < 0 ||
-                    body.CursorPosition.Y < 0 ||
-                    body.CursorPosition.X >= body.Size.X ||
-                    body.CursorPosition.Y >= body.Size.Y)
+                const auto size = screen_buffer->screen_buffer_size();
+                if (left >= size.X || top >= size.Y || right >= size.X || bottom >= size.Y)
                 {
                     message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                screen_buffer->set_cursor_position(body.CursorPosition);
-                screen_buffer->set_text_attributes(body.Attributes);
-                screen_buffer->set_default_text_attributes(body.Attributes);
-                screen_buffer->set_color_table(body.ColorTable);
-
-                if (body.ScrollPosition.X < 0 || body.ScrollPosition.Y < 0 ||
-                    body.CurrentWindowSize.X < 0 || body.CurrentWindowSize.Y < 0)
+                SMALL_RECT window{};
+                window.Left = static_cast<SHORT>(left);
+                window.Top = static_cast<SHORT>(top);
+                window.Right = static_cast<SHORT>(right);
+                window.Bottom = static_cast<SHORT>(bottom);
+                if (!screen_buffer->set_window_rect(window))
                 {
                     message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
+            }
 
-                {
-                    const long left = body.ScrollPosition.X;
-                    const long top = body.ScrollPosition.Y;
-                    const long right = left + body.CurrentWindowSize.X;
-                    const long bottom = top + body.CurrentWindowSize.Y;
-                    if (right < left || bottom < top)
-                    {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
-
-                    const auto size = screen_buffer->screen_buffer_size();
-                    if (left >= size.X || top >= size.Y || right >= size.X || bottom >= size.Y)
-                    {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                    SMALL_RECT window{};
-                    window.Left = static_cast<SHORT>(left);
-                    window.Top = static_cast<SHORT>(top);
-                    window.Right = static_cast<SHORT>(right);
-                    window.Bottom = static_cast<SHORT>(bottom);
-                    if (!screen_buffer->set_window_rect(window))
-                    {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_screen_buffer_size(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                message.set_reply_status(core::status_success);
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetScreenBufferSize))
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                const auto requested = packet.payload.user_defined.u.console_msg_l2.SetConsoleScreenBufferSize.Size;
-                if (requested.X <= 0 || requested.Y <= 0)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                if (!screen_buffer->set_screen_buffer_size(requested))
-                {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                message.set_reply_status(core::status_success);
+            const auto requested = packet.payload.user_defined.u.console_msg_l2.SetConsoleScreenBufferSize.Size;
+            if (requested.X <= 0 || requested.Y <= 0)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetCursorPosition))
+            if (!screen_buffer->set_screen_buffer_size(requested))
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                message.set_reply_status(core::status_no_memory);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                const auto position = packet.payload.user_defined.u.console_msg_l2.SetConsoleCursorPosition.CursorPosition;
-                const auto size = screen_buffer->screen_buffer_size();
-                if (position.X < 0 || position.Y < 0 || position.X >= size.X || position.Y >= size.Y)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_cursor_position(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                screen_buffer->set_cursor_position(position);
-                screen_buffer->snap_window_to_cursor();
-                message.set_reply_status(core::status_success);
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetLargestWindowSize))
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                packet.payload.user_defined.u.console_msg_l2.GetLargestConsoleWindowSize.Size = screen_buffer->maximum_window_size();
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepScrollScreenBuffer))
+            const auto position = packet.payload.user_defined.u.console_msg_l2.SetConsoleCursorPosition.CursorPosition;
+            const auto size = screen_buffer->screen_buffer_size();
+            if (position.X < 0 || position.Y < 0 || position.X >= size.X || position.Y >= size.Y)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto& body = packet.payload.user_defined.u.console_msg_l2.ScrollConsoleScreenBuffer;
-                const auto size = screen_buffer->screen_buffer_size();
-                if (size.X <= 0 || size.Y <= 0)
-                {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto scroll = body.ScrollRectangle;
-                if (scroll.Left > scroll.Right || scroll.Top > scroll.Bottom)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                const SHORT max_x = static_cast<SHORT>(size.X - 1);
-                const SHORT max_y = static_cast<SHORT>(size.Y - 1);
+            screen_buffer->set_cursor_position(position);
+            screen_buffer->snap_window_to_cursor();
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                scroll.Left = scroll.Left < 0 ? 0 : scroll.Left;
-                scroll.Top = scroll.Top < 0 ? 0 : scroll.Top;
-                scroll.Right = scroll.Right > max_x ? max_x : scroll.Right;
-                scroll.Bottom = scroll.Bottom > max_y ? max_y : scroll.Bottom;
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_largest_window_size(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                if (scroll.Left > scroll.Right || scroll.Top > scroll.Bottom)
-                {
-                    message.set_reply_status(core::status_success);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                SMALL_RECT clip{ 0, 0, max_x, max_y };
-                if (body.Clip != FALSE)
-                {
-                    clip = body.ClipRectangle;
-                    if (clip.Left > clip.Right || clip.Top > clip.Bottom)
-                    {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                    clip.Left = clip.Left < 0 ? 0 : clip.Left;
-                    clip.Top = clip.Top < 0 ? 0 : clip.Top;
-                    clip.Right = clip.Right > max_x ? max_x : clip.Right;
-                    clip.Bottom = clip.Bottom > max_y ? max_y : clip.Bottom;
+            packet.payload.user_defined.u.console_msg_l2.GetLargestConsoleWindowSize.Size = screen_buffer->maximum_window_size();
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                    if (clip.Left > clip.Right || clip.Top > clip.Bottom)
-                    {
-                        message.set_reply_status(core::status_success);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_scroll_screen_buffer(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                const wchar_t fill_char = body.Unicode != FALSE
-                    ? body.Fill.Char.UnicodeChar
-                    : static_cast<wchar_t>(static_cast<unsigned char>(body.Fill.Char.AsciiChar));
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                if (!screen_buffer->scroll_screen_buffer(scroll, clip, body.DestinationOrigin, fill_char, body.Fill.Attributes))
-                {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                message.set_reply_status(core::status_success);
+            auto& body = packet.payload.user_defined.u.console_msg_l2.ScrollConsoleScreenBuffer;
+            const auto size = screen_buffer->screen_buffer_size();
+            if (size.X <= 0 || size.Y <= 0)
+            {
+                message.set_reply_status(core::status_no_memory);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetTextAttribute))
+            auto scroll = body.ScrollRectangle;
+            if (scroll.Left > scroll.Right || scroll.Top > scroll.Bottom)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            const SHORT max_x = static_cast<SHORT>(size.X - 1);
+            const SHORT max_y = static_cast<SHORT>(size.Y - 1);
+
+            scroll.Left = scroll.Left < 0 ? 0 : scroll.Left;
+            scroll.Top = scroll.Top < 0 ? 0 : scroll.Top;
+            scroll.Right = scroll.Right > max_x ? max_x : scroll.Right;
+            scroll.Bottom = scroll.Bottom > max_y ? max_y : scroll.Bottom;
 
-                screen_buffer->set_text_attributes(packet.payload.user_defined.u.console_msg_l2.SetConsoleTextAttribute.Attributes);
+            if (scroll.Left > scroll.Right || scroll.Top > scroll.Bottom)
+            {
                 message.set_reply_status(core::status_success);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetWindowInfo))
+            SMALL_RECT clip{ 0, 0, max_x, max_y };
+            if (body.Clip != FALSE)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
+                clip = body.ClipRectangle;
+                if (clip.Left > clip.Right || clip.Top > clip.Bottom)
                 {
-                    message.set_reply_status(core::status_invalid_handle);
+                    message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
+                clip.Left = clip.Left < 0 ? 0 : clip.Left;
+                clip.Top = clip.Top < 0 ? 0 : clip.Top;
+                clip.Right = clip.Right > max_x ? max_x : clip.Right;
+                clip.Bottom = clip.Bottom > max_y ? max_y : clip.Bottom;
+
+                if (clip.Left > clip.Right || clip.Top > clip.Bottom)
                 {
-                    message.set_reply_status(core::status_invalid_handle);
+                    message.set_reply_status(core::status_success);
                     message.set_reply_information(0);
                     return outcome;
                 }
+            }
 
-                const auto& body = packet.payload.user_defined.u.console_msg_l2.SetConsoleWindowInfo;
-                SMALL_RECT desired_window{};
-                if (body.Absolute == FALSE)
-                {
-                    // Relative mode: apply deltas to the current viewport edges.
-                    const auto current = screen_buffer->window_rect();
-                    const auto& delta = body.Window;
-
-                    const long left = static_cast<long>(current.Left) + static_cast<long>(delta.Left);
-                    const long top = static_cast<long>(current.Top) + static_cast<long>(delta.Top);
-                    const long right = static_cast<long>(current.Right) + static_cast<long>(delta.Right);
-                    const long bottom = static_cast<long>(current.Bottom) + static_cast<long>(delta.Bottom);
-
-                    if (right < left || bottom < top)
-                    {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
+            const wchar_t fill_char = body.Unicode != FALSE
+                ? body.Fill.Char.UnicodeChar
+                : static_cast<wchar_t>(static_cast<unsigned char>(body.Fill.Char.AsciiChar));
 
-                    const auto buffer_size = screen_buffer->screen_buffer_size();
-                    if (left < 0 || top < 0 || right < 0 || bottom < 0 ||
-                        left >= buffer_size.X || top >= buffer_size.Y ||
-                        right >= buffer_size.X || bottom >= buffer_size.Y)
-                    {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
+            if (!screen_buffer->scroll_screen_buffer(scroll, clip, body.DestinationOrigin, fill_char, attribute_id_from_legacy(body.Fill.Attributes)))
+            {
+                message.set_reply_status(core::status_no_memory);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                    desired_window.Left = static_cast<SHORT>(left);
-                    desired_window.Top = static_cast<SHORT>(top);
-                    desired_window.Right = static_cast<SHORT>(right);
-                    desired_window.Bottom = static_cast<SHORT>(bottom);
-                }
-                else
-                {
-                    desired_window = body.Window;
-                }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                if (!screen_buffer->set_window_rect(desired_window))
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_text_attribute(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                message.set_reply_status(core::status_success);
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGenerateCtrlEvent))
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
             {
-                const auto& body = packet.payload.user_defined.u.console_msg_l2.GenerateConsoleCtrlEvent;
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                DWORD ctrl_flags = 0;
-                switch (body.CtrlEvent)
-                {
-                case CTRL_C_EVENT:
-                    ctrl_flags = static_cast<DWORD>(core::console_ctrl_c_flag);
-                    break;
-                case CTRL_BREAK_EVENT:
-                    ctrl_flags = static_cast<DWORD>(core::console_ctrl_break_flag);
-                    break;
-                default:
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            screen_buffer->set_text_attributes(attribute_id_from_legacy(packet.payload.user_defined.u.console_msg_l2.SetConsoleTextAttribute.Attributes));
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                state.for_each_process([&](const ProcessState& process) noexcept {
-                    if (body.ProcessGroupId != 0 && process.pid != body.ProcessGroupId)
-                    {
-                        return;
-                    }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_window_info(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                    (void)host_io.send_end_task(process.pid, body.CtrlEvent, ctrl_flags);
-                });
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                message.set_reply_status(core::status_success);
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetActiveScreenBuffer))
+            const auto& body = packet.payload.user_defined.u.console_msg_l2.SetConsoleWindowInfo;
+            SMALL_RECT desired_window{};
+            if (body.Absolute == FALSE)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
+                // Relative mode: apply deltas to the current viewport edges.
+                const auto current = screen_buffer->window_rect();
+                const auto& delta = body.Window;
+
+                const long left = static_cast<long>(current.Left) + static_cast<long>(delta.Left);
+                const long top = static_cast<long>(current.Top) + static_cast<long>(delta.Top);
+                const long right = static_cast<long>(current.Right) + static_cast<long>(delta.Right);
+                const long bottom = static_cast<long>(current.Bottom) + static_cast<long>(delta.Bottom);
+
+                if (right < left || bottom < top)
                 {
-                    message.set_reply_status(core::status_invalid_handle);
+                    message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                if (!state.set_active_screen_buffer(handle->screen_buffer))
+                const auto buffer_size = screen_buffer->screen_buffer_size();
+                if (left < 0 || top < 0 || right < 0 || bottom < 0 ||
+                    left >= buffer_size.X || top >= buffer_size.Y ||
+                    right >= buffer_size.X || bottom >= buffer_size.Y)
                 {
-                    message.set_reply_status(core::status_invalid_handle);
+                    message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(0);
-                return outcome;
+                desired_window.Left = static_cast<SHORT>(left);
+                desired_window.Top = static_cast<SHORT>(top);
+                desired_window.Right = static_cast<SHORT>(right);
+                desired_window.Bottom = static_cast<SHORT>(bottom);
+            }
+            else
+            {
+                desired_window = body.Window;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepFlushInputBuffer))
+            if (!screen_buffer->set_window_rect(desired_window))
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::input)
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_generate_ctrl_event(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& host_io = context.host_io;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            const auto& body = packet.payload.user_defined.u.console_msg_l2.GenerateConsoleCtrlEvent;
+
+            DWORD ctrl_flags = 0;
+            switch (body.CtrlEvent)
+            {
+            case CTRL_C_EVENT:
+                ctrl_flags = static_cast<DWORD>(core::console_ctrl_c_flag);
+                break;
+            case CTRL_BREAK_EVENT:
+                ctrl_flags = static_cast<DWORD>(core::console_ctrl_break_flag);
+                break;
+            default:
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            state.for_each_process([&](const ProcessState& process) noexcept {
+                if (body.ProcessGroupId != 0 && process.pid != body.ProcessGroupId)
                 {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
+                    return;
                 }
 
+                (void)host_io.send_end_task(process.pid, body.CtrlEvent, ctrl_flags);
+            });
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_active_screen_buffer(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            if (!state.set_active_screen_buffer(handle->screen_buffer))
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_flush_input_buffer(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& host_io = context.host_io;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::input)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            if (auto flushed = host_io.flush_input_buffer(); !flushed)
+            {
+                return std::unexpected(flushed.error());
+            }
+
+            // Flushing input drops any pending decoded units that were held back due to a small
+            // output buffer (e.g. the second code unit of a surrogate pair).
+            handle->decoded_input_pending.reset();
+            handle->pending_input_bytes.clear();
+            handle->cooked_read_pending.clear();
+            handle->cooked_line_in_progress.clear();
+            handle->cooked_line_cursor = 0;
+            handle->cooked_insert_mode = true;
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_write_console_input(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& host_io = context.host_io;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::input)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
+            }
+
+            auto& body = packet.payload.user_defined.u.console_msg_l2.WriteConsoleInput;
+            body.NumRecords = 0;
+
+            if ((input->size() % sizeof(INPUT_RECORD)) != 0)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            const size_t record_count = input->size() / sizeof(INPUT_RECORD);
+            const auto* records = reinterpret_cast<const INPUT_RECORD*>(input->data());
+
+            if (body.Append == FALSE)
+            {
                 if (auto flushed = host_io.flush_input_buffer(); !flushed)
                 {
                     return std::unexpected(flushed.error());
                 }
 
-                // Flushing input drops any pending decoded units that were held back due to a small
-                // output buffer (e.g. the second code unit of a surrogate pair).
+                // Replacing the input queue must also reset per-handle decode/cooked state so
+                // subsequent reads do not observe stale partial-sequence or cooked-line state.
                 handle->decoded_input_pending.reset();
                 handle->pending_input_bytes.clear();
                 handle->cooked_read_pending.clear();
                 handle->cooked_line_in_progress.clear();
                 handle->cooked_line_cursor = 0;
                 handle->cooked_insert_mode = true;
+            }
 
-                message.set_reply_status(core::status_success);
+            std::vector<std::byte> bytes;
+            try
+            {
+                // Worst case: UTF-8 may take up to 4 bytes per UTF-16 code unit.
+                constexpr size_t max_bytes_per_unit = 4;
+                const size_t reserve_hint = record_count > (std::numeric_limits<size_t>::max() / max_bytes_per_unit)
+                    ? std::numeric_limits<size_t>::max()
+                    : record_count * max_bytes_per_unit;
+                bytes.reserve(reserve_hint);
+            }
+            catch (...)
+            {
+                message.set_reply_status(core::status_no_memory);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepWriteConsoleInput))
+            const UINT code_page = state.input_code_page() == 0 ? ::GetOEMCP() : static_cast<UINT>(state.input_code_page());
+            try
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::input)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto input = message.get_input_buffer();
-                if (!input)
-                {
-                    return std::unexpected(input.error());
-                }
-
-                auto& body = packet.payload.user_defined.u.console_msg_l2.WriteConsoleInput;
-                body.NumRecords = 0;
-
-                if ((input->size() % sizeof(INPUT_RECORD)) != 0)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                const size_t record_count = input->size() / sizeof(INPUT_RECORD);
-                const auto* records = reinterpret_cast<const INPUT_RECORD*>(input->data());
-
-                if (body.Append == FALSE)
+                for (size_t i = 0; i < record_count; ++i)
                 {
-                    if (auto flushed = host_io.flush_input_buffer(); !flushed)
+                    const auto& record = records[i];
+                    if (record.EventType != KEY_EVENT)
                     {
-                        return std::unexpected(flushed.error());
+                        continue;
                     }
 
-                    // Replacing the input queue must also reset per-handle decode/cooked state so
-                    // subsequent reads do not observe stale partial-sequence or cooked-line state.
-                    handle->decoded_input_pending.reset();
-                    handle->pending_input_bytes.clear();
-                    handle->cooked_read_pending.clear();
-                    handle->cooked_line_in_progress.clear();
-                    handle->cooked_line_cursor = 0;
-                    handle->cooked_insert_mode = true;
-                }
-
-                std::vector<std::byte> bytes;
-                try
-                {
-                    // Worst case: UTF-8 may take up to 4 bytes per UTF-16 code unit.
-                    constexpr size_t max_bytes_per_unit = 4;
-                    const size_t reserve_hint = record_count > (std::numeric_limits<size_t>::max() / max_bytes_per_unit)
-                        ? std::numeric_limits<size_t>::max()
-                        : record_count * max_bytes_per_unit;
-                    bytes.reserve(reserve_hint);
-                }
-                catch (...)
-                {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                const UINT code_page = state.input_code_page() == 0 ? ::GetOEMCP() : static_cast<UINT>(state.input_code_page());
-                try
-                {
-                    for (size_t i = 0; i < record_count; ++i)
+                    const auto& key = record.Event.KeyEvent;
+                    if (key.bKeyDown == FALSE)
                     {
-                        const auto& record = records[i];
-                        if (record.EventType != KEY_EVENT)
-                        {
-                            continue;
-                        }
+                        continue;
+                    }
 
-                        const auto& key = record.Event.KeyEvent;
-                        if (key.bKeyDown == FALSE)
+                    std::array<char, 8> encoded{};
+                    int encoded_bytes = 0;
+                    if (body.Unicode != FALSE)
+                    {
+                        const wchar_t ch = key.uChar.UnicodeChar;
+                        if (ch == L'\0')
                         {
                             continue;
                         }
 
-                        std::array<char, 8> encoded{};
-                        int encoded_bytes = 0;
-                        if (body.Unicode != FALSE)
-                        {
-                            const wchar_t ch = key.uChar.UnicodeChar;
-                            if (ch == L'\0')
-                            {
-                                continue;
-                            }
-
-                            encoded_bytes = ::WideCharToMultiByte(
-                                code_page,
-                                0,
-                                &ch,
-                                1,
-                                encoded.data(),
-                                static_cast<int>(encoded.size()),
-                                nullptr,
-                                nullptr);
-                            if (encoded_bytes <= 0)
-                            {
-                                encoded[0] = '?';
-                                encoded_bytes = 1;
-                            }
-                        }
-                        else
+                        encoded_bytes = ::WideCharToMultiByte(
+                            code_page,
+                            0,
+                            &ch,
+                            1,
+                            encoded.data(),
+                            static_cast<int>(encoded.size()),
+                            nullptr,
+                            nullptr);
+                        if (encoded_bytes <= 0)
                         {
-                            const char ch = key.uChar.AsciiChar;
-                            if (ch == '\0')
-                            {
-                                continue;
-                            }
-
-                            encoded[0] = ch;
+                            encoded[0] = '?';
                             encoded_bytes = 1;
                         }
-
-                        const WORD repeat = key.wRepeatCount == 0 ? 1 : key.wRepeatCount;
-                        for (WORD r = 0; r < repeat; ++r)
+                    }
+                    else
+                    {
+                        const char ch = key.uChar.AsciiChar;
+                        if (ch == '\0')
                         {
-                            bytes.insert(
-                                bytes.end(),
-                                reinterpret_cast<const std::byte*>(encoded.data()),
-                                reinterpret_cast<const std::byte*>(encoded.data()) + static_cast<size_t>(encoded_bytes));
+                            continue;
                         }
+
+                        encoded[0] = ch;
+                        encoded_bytes = 1;
                     }
-                }
-                catch (...)
-                {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
 
-                if (!host_io.inject_input_bytes(std::span<const std::byte>(bytes.data(), bytes.size())))
-                {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
+                    const WORD repeat = key.wRepeatCount == 0 ? 1 : key.wRepeatCount;
+                    for (WORD r = 0; r < repeat; ++r)
+                    {
+                        bytes.insert(
+                            bytes.end(),
+                            reinterpret_cast<const std::byte*>(encoded.data()),
+                            reinterpret_cast<const std::byte*>(encoded.data()) + static_cast<size_t>(encoded_bytes));
+                    }
                 }
-
-                body.NumRecords = record_count > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                    ? std::numeric_limits<ULONG>::max()
-                    : static_cast<ULONG>(record_count);
-
-                message.set_reply_status(core::status_success);
+            }
+            catch (...)
+            {
+                message.set_reply_status(core::status_no_memory);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepFillConsoleOutput))
+            if (!host_io.inject_input_bytes(std::span<const std::byte>(bytes.data(), bytes.size())))
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto& body = packet.payload.user_defined.u.console_msg_l2.FillConsoleOutput;
-                const ULONG requested = body.Length;
-                body.Length = 0;
+                message.set_reply_status(core::status_no_memory);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                const auto size = screen_buffer->screen_buffer_size();
-                if (size.X <= 0 || size.Y <= 0)
-                {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            body.NumRecords = record_count > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                ? std::numeric_limits<ULONG>::max()
+                : static_cast<ULONG>(record_count);
 
-                const auto origin = body.WriteCoord;
-                if (origin.X < 0 || origin.Y < 0 || origin.X >= size.X || origin.Y >= size.Y)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                size_t written = 0;
-                switch (body.ElementType)
-                {
-                case CONSOLE_ATTRIBUTE:
-                    written = screen_buffer->fill_output_attributes(origin, body.Element, requested);
-                    break;
-                case CONSOLE_REAL_UNICODE:
-                case CONSOLE_FALSE_UNICODE:
-                    written = screen_buffer->fill_output_characters(origin, static_cast<wchar_t>(body.Element), requested);
-                    break;
-                case CONSOLE_ASCII:
-                    written = screen_buffer->fill_output_characters(
-                        origin,
-                        static_cast<wchar_t>(static_cast<unsigned char>(body.Element)),
-                        requested);
-                    break;
-                default:
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_fill_console_output(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                body.Length = static_cast<ULONG>(written);
-                message.set_reply_status(core::status_success);
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepReadConsoleOutputString))
-            {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto& body = packet.payload.user_defined.u.console_msg_l2.FillConsoleOutput;
+            const ULONG requested = body.Length;
+            body.Length = 0;
 
-                auto output = message.get_output_buffer();
-                if (!output)
-                {
-                    return std::unexpected(output.error());
-                }
+            const auto size = screen_buffer->screen_buffer_size();
+            if (size.X <= 0 || size.Y <= 0)
+            {
+                message.set_reply_status(core::status_no_memory);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto& body = packet.payload.user_defined.u.console_msg_l2.ReadConsoleOutputString;
-                body.NumRecords = 0;
+            const auto origin = body.WriteCoord;
+            if (origin.X < 0 || origin.Y < 0 || origin.X >= size.X || origin.Y >= size.Y)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                const auto size = screen_buffer->screen_buffer_size();
-                if (size.X <= 0 || size.Y <= 0)
-                {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            size_t written = 0;
+            switch (body.ElementType)
+            {
+            case CONSOLE_ATTRIBUTE:
+                written = screen_buffer->fill_output_attributes(origin, attribute_id_from_legacy(body.Element), requested);
+                break;
+            case CONSOLE_REAL_UNICODE:
+            case CONSOLE_FALSE_UNICODE:
+                written = screen_buffer->fill_output_characters(origin, static_cast<wchar_t>(body.Element), requested);
+                break;
+            case CONSOLE_ASCII:
+                written = screen_buffer->fill_output_characters(
+                    origin,
+                    static_cast<wchar_t>(static_cast<unsigned char>(body.Element)),
+                    requested);
+                break;
+            default:
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                const auto origin = body.ReadCoord;
-                if (origin.X < 0 || origin.Y < 0 || origin.X >= size.X || origin.Y >= size.Y)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            body.Length = static_cast<ULONG>(written);
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                size_t records_read = 0;
-                switch (body.StringType)
-                {
-                case CONSOLE_ATTRIBUTE:
-                {
-                    const size_t max_records = output->size() / sizeof(USHORT);
-                    auto* words = reinterpret_cast<USHORT*>(output->data());
-                    records_read = screen_buffer->read_output_attributes(origin, std::span<USHORT>(words, max_records));
-                    break;
-                }
-                case CONSOLE_REAL_UNICODE:
-                case CONSOLE_FALSE_UNICODE:
-                {
-                    const size_t max_records = output->size() / sizeof(wchar_t);
-                    auto* chars = reinterpret_cast<wchar_t*>(output->data());
-                    records_read = screen_buffer->read_output_characters(origin, std::span<wchar_t>(chars, max_records));
-                    break;
-                }
-                case CONSOLE_ASCII:
-                    records_read = screen_buffer->read_output_ascii(origin, *output);
-                    break;
-                default:
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_read_console_output_string(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                body.NumRecords = static_cast<ULONG>(records_read);
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(static_cast<ULONG_PTR>(output->size()));
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepWriteConsoleOutput))
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto output = message.get_output_buffer();
+            if (!output)
+            {
+                return std::unexpected(output.error());
+            }
 
-                auto input = message.get_input_buffer();
-                if (!input)
-                {
-                    return std::unexpected(input.error());
-                }
+            auto& body = packet.payload.user_defined.u.console_msg_l2.ReadConsoleOutputString;
+            body.NumRecords = 0;
+
+            const auto size = screen_buffer->screen_buffer_size();
+            if (size.X <= 0 || size.Y <= 0)
+            {
+                message.set_reply_status(core::status_no_memory);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            const auto origin = body.ReadCoord;
+            if (origin.X < 0 || origin.Y < 0 || origin.X >= size.X || origin.Y >= size.Y)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            size_t records_read = 0;
+            switch (body.StringType)
+            {
+            case CONSOLE_ATTRIBUTE:
+            {
+                const size_t max_records = output->size() / sizeof(USHORT);
+                auto* words = reinterpret_cast<USHORT*>(output->data());
+                records_read = screen_buffer->read_output_attributes(origin, std::span<USHORT>(words, max_records));
+                break;
+            }
+            case CONSOLE_REAL_UNICODE:
+            case CONSOLE_FALSE_UNICODE:
+            {
+                const size_t max_records = output->size() / sizeof(wchar_t);
+                auto* chars = reinterpret_cast<wchar_t*>(output->data());
+                records_read = screen_buffer->read_console_output_characters(origin, std::span<wchar_t>(chars, max_records));
+                break;
+            }
+            case CONSOLE_ASCII:
+                records_read = screen_buffer->read_output_ascii(origin, *output);
+                break;
+            default:
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            body.NumRecords = static_cast<ULONG>(records_read);
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(static_cast<ULONG_PTR>(output->size()));
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_write_console_output(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
+            }
+
+            auto& body = packet.payload.user_defined.u.console_msg_l2.WriteConsoleOutput;
+            auto region = body.CharRegion;
+            if (region.Left > region.Right || region.Top > region.Bottom)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            const auto size = screen_buffer->screen_buffer_size();
+            if (size.X <= 0 || size.Y <= 0)
+            {
+                message.set_reply_status(core::status_no_memory);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            if (region.Left < 0 ||
+                region.Top < 0 ||
+                region.Right >= size.X ||
+                region.Bottom >= size.Y)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            if ((input->size() % sizeof(CHAR_INFO)) != 0)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            const size_t width = static_cast<size_t>(region.Right - region.Left + 1);
+            const size_t height = static_cast<size_t>(region.Bottom - region.Top + 1);
+            const size_t record_count = width * height;
+
+            const size_t available = input->size() / sizeof(CHAR_INFO);
+            if (available < record_count)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            const auto* records = reinterpret_cast<const CHAR_INFO*>(input->data());
+            const size_t written = screen_buffer->write_output_char_info_rect(region, std::span<const CHAR_INFO>(records, record_count), body.Unicode != FALSE);
+            if (written != record_count)
+            {
+                message.set_reply_status(core::status_no_memory);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_write_console_output_string(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                auto& body = packet.payload.user_defined.u.console_msg_l2.WriteConsoleOutput;
-                auto region = body.CharRegion;
-                if (region.Left > region.Right || region.Top > region.Bottom)
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
+            }
+
+            auto& body = packet.payload.user_defined.u.console_msg_l2.WriteConsoleOutputString;
+            body.NumRecords = 0;
+
+            const auto size = screen_buffer->screen_buffer_size();
+            if (size.X <= 0 || size.Y <= 0)
+            {
+                message.set_reply_status(core::status_no_memory);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            const auto origin = body.WriteCoord;
+            if (origin.X < 0 || origin.Y < 0 || origin.X >= size.X || origin.Y >= size.Y)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            size_t used = 0;
+            switch (body.StringType)
+            {
+            case CONSOLE_ATTRIBUTE:
+            {
+                if ((input->size() % sizeof(USHORT)) != 0)
                 {
                     message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                const auto size = screen_buffer->screen_buffer_size();
-                if (size.X <= 0 || size.Y <= 0)
+                const size_t record_count = input->size() / sizeof(USHORT);
+                std::vector<USHORT> attributes;
+                try
                 {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
+                    attributes.resize(record_count);
+                    std::memcpy(attributes.data(), input->data(), input->size());
                 }
-
-                if (region.Left < 0 ||
-                    region.Top < 0 ||
-                    region.Right >= size.X ||
-                    region.Bottom >= size.Y)
+                catch (...)
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
+                    message.set_reply_status(core::status_no_memory);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                if ((input->size() % sizeof(CHAR_INFO)) != 0)
+                used = screen_buffer->write_output_attributes(origin, attributes);
+                break;
+            }
+            case CONSOLE_REAL_UNICODE:
+            case CONSOLE_FALSE_UNICODE:
+            {
+                if ((input->size() % sizeof(wchar_t)) != 0)
                 {
                     message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                const size_t width = static_cast<size_t>(region.Right - region.Left + 1);
-                const size_t height = static_cast<size_t>(region.Bottom - region.Top + 1);
-                const size_t record_count = width * height;
-
-                const size_t available = input->size() / sizeof(CHAR_INFO);
-                if (available < record_count)
+                const size_t wchar_count = input->size() / sizeof(wchar_t);
+                std::wstring text;
+                try
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    text.resize(wchar_count);
+                    std::memcpy(text.data(), input->data(), input->size());
                 }
-
-                const auto* records = reinterpret_cast<const CHAR_INFO*>(input->data());
-                const size_t written = screen_buffer->write_output_char_info_rect(region, std::span<const CHAR_INFO>(records, record_count), body.Unicode != FALSE);
-                if (written != record_count)
+                catch (...)
                 {
                     message.set_reply_status(core::status_no_memory);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                message.set_reply_status(core::status_success);
+                used = screen_buffer->write_output_characters(origin, text);
+                break;
+            }
+            case CONSOLE_ASCII:
+                used = screen_buffer->write_output_ascii(origin, *input);
+                break;
+            default:
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepWriteConsoleOutputString))
-            {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            body.NumRecords = static_cast<ULONG>(used);
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_read_console_output(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                auto input = message.get_input_buffer();
-                if (!input)
-                {
-                    return std::unexpected(input.error());
-                }
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto& body = packet.payload.user_defined.u.console_msg_l2.WriteConsoleOutputString;
-                body.NumRecords = 0;
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                const auto size = screen_buffer->screen_buffer_size();
-                if (size.X <= 0 || size.Y <= 0)
-                {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto output = message.get_output_buffer();
+            if (!output)
+            {
+                return std::unexpected(output.error());
+            }
 
-                const auto origin = body.WriteCoord;
-                if (origin.X < 0 || origin.Y < 0 || origin.X >= size.X || origin.Y >= size.Y)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto& body = packet.payload.user_defined.u.console_msg_l2.ReadConsoleOutput;
+            auto region = body.CharRegion;
+            if (region.Left > region.Right || region.Top > region.Bottom)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                size_t used = 0;
-                switch (body.StringType)
-                {
-                case CONSOLE_ATTRIBUTE:
-                {
-                    if ((input->size() % sizeof(USHORT)) != 0)
-                    {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
+            const auto size = screen_buffer->screen_buffer_size();
+            if (size.X <= 0 || size.Y <= 0)
+            {
+                message.set_reply_status(core::status_no_memory);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                    const size_t record_count = input->size() / sizeof(USHORT);
-                    std::vector<USHORT> attributes;
-                    try
-                    {
-                        attributes.resize(record_count);
-                        std::memcpy(attributes.data(), input->data(), input->size());
-                    }
-                    catch (...)
-                    {
-                        message.set_reply_status(core::status_no_memory);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
+            if (region.Left < 0 ||
+                region.Top < 0 ||
+                region.Right >= size.X ||
+                region.Bottom >= size.Y)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                    used = screen_buffer->write_output_attributes(origin, attributes);
-                    break;
-                }
-                case CONSOLE_REAL_UNICODE:
-                case CONSOLE_FALSE_UNICODE:
-                {
-                    if ((input->size() % sizeof(wchar_t)) != 0)
-                    {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
+            if ((output->size() % sizeof(CHAR_INFO)) != 0)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                    const size_t wchar_count = input->size() / sizeof(wchar_t);
-                    std::wstring text;
-                    try
-                    {
-                        text.resize(wchar_count);
-                        std::memcpy(text.data(), input->data(), input->size());
-                    }
-                    catch (...)
-                    {
-                        message.set_reply_status(core::status_no_memory);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
+            const size_t width = static_cast<size_t>(region.Right - region.Left + 1);
+            const size_t height = static_cast<size_t>(region.Bottom - region.Top + 1);
+            const size_t record_count = width * height;
+            const size_t capacity = output->size() / sizeof(CHAR_INFO);
 
-                    used = screen_buffer->write_output_characters(origin, text);
-                    break;
-                }
-                case CONSOLE_ASCII:
-                    used = screen_buffer->write_output_ascii(origin, *input);
-                    break;
-                default:
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            if (capacity < record_count)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                body.NumRecords = static_cast<ULONG>(used);
-                message.set_reply_status(core::status_success);
+            auto* records = reinterpret_cast<CHAR_INFO*>(output->data());
+            const size_t copied = screen_buffer->read_output_char_info_rect(region, std::span<CHAR_INFO>(records, record_count), body.Unicode != FALSE);
+            if (copied != record_count)
+            {
+                message.set_reply_status(core::status_no_memory);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepReadConsoleOutput))
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(static_cast<ULONG_PTR>(copied * sizeof(CHAR_INFO)));
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_title(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto output = message.get_output_buffer();
+            if (!output)
+            {
+                return std::unexpected(output.error());
+            }
 
-                auto output = message.get_output_buffer();
-                if (!output)
-                {
-                    return std::unexpected(output.error());
-                }
+            auto& body = packet.payload.user_defined.u.console_msg_l2.GetConsoleTitle;
+            const std::wstring_view stored_title = state.title(body.Original != FALSE);
 
-                auto& body = packet.payload.user_defined.u.console_msg_l2.ReadConsoleOutput;
-                auto region = body.CharRegion;
-                if (region.Left > region.Right || region.Top > region.Bottom)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            const size_t needed = stored_title.size();
+            body.TitleLength = needed > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                ? std::numeric_limits<ULONG>::max()
+                : static_cast<ULONG>(needed);
 
-                const auto size = screen_buffer->screen_buffer_size();
-                if (size.X <= 0 || size.Y <= 0)
+            if (body.Unicode)
+            {
+                const size_t capacity = output->size() / sizeof(wchar_t);
+                const size_t copy_count = capacity == 0 ? 0 : (stored_title.size() >= capacity ? capacity - 1 : stored_title.size());
+                const size_t written = capacity == 0 ? 0 : std::min(capacity, stored_title.size());
+
+                auto* out_chars = reinterpret_cast<wchar_t*>(output->data());
+                if (capacity != 0)
                 {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
+                    out_chars[0] = L'\0';
                 }
-
-                if (region.Left < 0 ||
-                    region.Top < 0 ||
-                    region.Right >= size.X ||
-                    region.Bottom >= size.Y)
+                if (copy_count != 0)
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    std::memcpy(out_chars, stored_title.data(), copy_count * sizeof(wchar_t));
                 }
-
-                if ((output->size() % sizeof(CHAR_INFO)) != 0)
+                if (capacity != 0)
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    out_chars[copy_count < capacity ? copy_count : (capacity - 1)] = L'\0';
                 }
 
-                const size_t width = static_cast<size_t>(region.Right - region.Left + 1);
-                const size_t height = static_cast<size_t>(region.Bottom - region.Top + 1);
-                const size_t record_count = width * height;
-                const size_t capacity = output->size() / sizeof(CHAR_INFO);
+                message.set_reply_status(core::status_success);
+                message.set_reply_information(static_cast<ULONG_PTR>(written * sizeof(wchar_t)));
+                return outcome;
+            }
+
+            // A variant: legacy behavior is "all or nothing" when the buffer
+            // can't hold the non-null-terminated string.
+            const UINT cp = state.output_code_page() == 0 ? ::GetOEMCP() : static_cast<UINT>(state.output_code_page());
+            const int required = stored_title.empty()
+                ? 0
+                : ::WideCharToMultiByte(
+                    cp,
+                    0,
+                    stored_title.data(),
+                    static_cast<int>(stored_title.size()),
+                    nullptr,
+                    0,
+                    nullptr,
+                    nullptr);
+            if (required < 0)
+            {
+                return std::unexpected(DeviceCommError{
+                    .context = L"WideCharToMultiByte size query failed for console title",
+                    .win32_error = ::GetLastError(),
+                });
+            }
+
+            const size_t required_bytes = static_cast<size_t>(required);
+            if (!output->empty())
+            {
+                output->front() = std::byte{ 0 };
+            }
+
+            if (required_bytes == 0)
+            {
+                message.set_reply_status(core::status_success);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                if (capacity < record_count)
+            if (output->size() < required_bytes)
+            {
+                if (!output->empty())
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    message.set_reply_information(1);
                 }
-
-                auto* records = reinterpret_cast<CHAR_INFO*>(output->data());
-                const size_t copied = screen_buffer->read_output_char_info_rect(region, std::span<CHAR_INFO>(records, record_count), body.Unicode != FALSE);
-                if (copied != record_count)
+                else
                 {
-                    message.set_reply_status(core::status_no_memory);
                     message.set_reply_information(0);
-                    return outcome;
                 }
-
+                body.TitleLength = 0;
                 message.set_reply_status(core::status_success);
-                message.set_reply_information(static_cast<ULONG_PTR>(copied * sizeof(CHAR_INFO)));
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetTitle))
+            std::vector<char> converted;
+            try
+            {
+                converted.resize(required_bytes);
+            }
+            catch (...)
+            {
+                message.set_reply_status(core::status_no_memory);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            const int converted_bytes = ::WideCharToMultiByte(
+                cp,
+                0,
+                stored_title.data(),
+                static_cast<int>(stored_title.size()),
+                converted.data(),
+                static_cast<int>(converted.size()),
+                nullptr,
+                nullptr);
+            if (converted_bytes <= 0 || static_cast<size_t>(converted_bytes) != required_bytes)
+            {
+                return std::unexpected(DeviceCommError{
+                    .context = L"WideCharToMultiByte failed for console title",
+                    .win32_error = ::GetLastError(),
+                });
+            }
+
+            std::memcpy(output->data(), converted.data(), required_bytes);
+            const size_t written = output->size() > required_bytes ? required_bytes + 1 : required_bytes;
+            if (output->size() > required_bytes)
+            {
+                output->data()[required_bytes] = std::byte{ 0 };
+            }
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(static_cast<ULONG_PTR>(written));
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_title(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
+            }
+
+            const auto& body = packet.payload.user_defined.u.console_msg_l2.SetConsoleTitle;
+            std::wstring title;
+            if (body.Unicode)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
+                if ((input->size() % sizeof(wchar_t)) != 0)
                 {
-                    message.set_reply_status(core::status_invalid_handle);
+                    message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                auto output = message.get_output_buffer();
-                if (!output)
+                const size_t wchar_count = input->size() / sizeof(wchar_t);
+                try
                 {
-                    return std::unexpected(output.error());
+                    title.resize(wchar_count);
+                    std::memcpy(title.data(), input->data(), input->size());
                 }
-
-                auto& body = packet.payload.user_defined.u.console_msg_l2.GetConsoleTitle;
-                const std::wstring_view stored_title = state.title(body.Original != FALSE);
-
-                const size_t needed = stored_title.size();
-                body.TitleLength = needed > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                    ? std::numeric_limits<ULONG>::max()
-                    : static_cast<ULONG>(needed);
-
-                if (body.Unicode)
+                catch (...)
                 {
-                    const size_t capacity = output->size() / sizeof(wchar_t);
-                    const size_t copy_count = capacity == 0 ? 0 : (stored_title.size() >= capacity ? capacity - 1 : stored_title.size());
-                    const size_t written = capacity == 0 ? 0 : std::min(capacity, stored_title.size());
+                    message.set_reply_status(core::status_no_memory);
+                    message.set_reply_information(0);
+                    return outcome;
+                }
 
-                    auto* out_chars = reinterpret_cast<wchar_t*>(output->data());
-                    if (capacity != 0)
-                    {
-                        out_chars[0] = L'\0';
-                    }
-                    if (copy_count != 0)
-                    {
-                        std::memcpy(out_chars, stored_title.data(), copy_count * sizeof(wchar_t));
-                    }
-                    if (capacity != 0)
+                if (!title.empty() && title.back() == L'\0')
+                {
+                    while (!title.empty() && title.back() == L'\0')
                     {
-                        out_chars[copy_count < capacity ? copy_count : (capacity - 1)] = L'\0';
+                        title.pop_back();
                     }
-
-                    message.set_reply_status(core::status_success);
-                    message.set_reply_information(static_cast<ULONG_PTR>(written * sizeof(wchar_t)));
-                    return outcome;
                 }
-
-                // A variant: legacy behavior is "all or nothing" when the buffer
-                // can't hold the non-null-terminated string.
+            }
+            else
+            {
                 const UINT cp = state.output_code_page() == 0 ? ::GetOEMCP() : static_cast<UINT>(state.output_code_page());
-                const int required = stored_title.empty()
+                const int required = input->empty()
                     ? 0
-                    : ::WideCharToMultiByte(
+                    : ::MultiByteToWideChar(
                         cp,
                         0,
-                        stored_title.data(),
-                        static_cast<int>(stored_title.size()),
+                        reinterpret_cast<const char*>(input->data()),
+                        static_cast<int>(input->size()),
                         nullptr,
-                        0,
-                        nullptr,
-                        nullptr);
+                        0);
                 if (required < 0)
                 {
                     return std::unexpected(DeviceCommError{
-                        .context = L"WideCharToMultiByte size query failed for console title",
+                        .context = L"MultiByteToWideChar size query failed for console title",
                         .win32_error = ::GetLastError(),
                     });
                 }
 
-                const size_t required_bytes = static_cast<size_t>(required);
-                if (!output->empty())
+                try
                 {
-                    output->front() = std::byte{ 0 };
+                    title.resize(static_cast<size_t>(required));
                 }
-
-                if (required_bytes == 0)
+                catch (...)
                 {
-                    message.set_reply_status(core::status_success);
+                    message.set_reply_status(core::status_no_memory);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                if (output->size() < required_bytes)
+                if (required != 0)
                 {
-                    if (!output->empty())
-                    {
-                        message.set_reply_information(1);
-                    }
-                    else
+                    const int converted = ::MultiByteToWideChar(
+                        cp,
+                        0,
+                        reinterpret_cast<const char*>(input->data()),
+                        static_cast<int>(input->size()),
+                        title.data(),
+                        required);
+                    if (converted != required)
                     {
-                        message.set_reply_information(0);
+                        return std::unexpected(DeviceCommError{
+                            .context = L"MultiByteToWideChar failed for console title",
+                            .win32_error = ::GetLastError(),
+                        });
                     }
-                    body.TitleLength = 0;
-                    message.set_reply_status(core::status_success);
-                    return outcome;
                 }
+            }
 
-                std::vector<char> converted;
-                try
-                {
-                    converted.resize(required_bytes);
-                }
-                catch (...)
-                {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            if (!state.set_title(std::move(title)))
+            {
+                message.set_reply_status(core::status_no_memory);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                const int converted_bytes = ::WideCharToMultiByte(
-                    cp,
-                    0,
-                    stored_title.data(),
-                    static_cast<int>(stored_title.size()),
-                    converted.data(),
-                    static_cast<int>(converted.size()),
-                    nullptr,
-                    nullptr);
-                if (converted_bytes <= 0 || static_cast<size_t>(converted_bytes) != required_bytes)
-                {
-                    return std::unexpected(DeviceCommError{
-                        .context = L"WideCharToMultiByte failed for console title",
-                        .win32_error = ::GetLastError(),
-                    });
-                }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                std::memcpy(output->data(), converted.data(), required_bytes);
-                const size_t written = output->size() > required_bytes ? required_bytes + 1 : required_bytes;
-                if (output->size() > required_bytes)
-                {
-                    output->data()[required_bytes] = std::byte{ 0 };
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_number_of_input_events(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& host_io = context.host_io;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(static_cast<ULONG_PTR>(written));
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::input)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetTitle))
+            const size_t ready_bytes = host_io.input_bytes_available();
+            size_t ready_events = ready_bytes;
+            if (ready_bytes != 0 || !handle->pending_input_bytes.empty())
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
+                // ConDrv reports input events, not raw bytes. The replacement is byte-stream-backed,
+                // so we approximate the visible event count by scanning a bounded prefix using the
+                // VT/code-page token decoder.
+                constexpr size_t peek_limit = 64 * 1024;
+
+                const size_t pending_byte_count = handle->pending_input_bytes.size();
+                const size_t queue_budget = peek_limit > pending_byte_count ? peek_limit - pending_byte_count : 0;
+                const size_t to_peek = std::min(ready_bytes, queue_budget);
+
+                std::vector<std::byte> peeked;
+                try
                 {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
+                    peeked.resize(pending_byte_count + to_peek);
                 }
-
-                auto input = message.get_input_buffer();
-                if (!input)
+                catch (...)
                 {
-                    return std::unexpected(input.error());
+                    peeked.clear();
                 }
 
-                const auto& body = packet.payload.user_defined.u.console_msg_l2.SetConsoleTitle;
-                std::wstring title;
-                if (body.Unicode)
+                if (!peeked.empty())
                 {
-                    if ((input->size() % sizeof(wchar_t)) != 0)
+                    if (pending_byte_count != 0)
                     {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
+                        const auto prefix = handle->pending_input_bytes.bytes();
+                        std::memcpy(peeked.data(), prefix.data(), pending_byte_count);
                     }
 
-                    const size_t wchar_count = input->size() / sizeof(wchar_t);
-                    try
-                    {
-                        title.resize(wchar_count);
-                        std::memcpy(title.data(), input->data(), input->size());
-                    }
-                    catch (...)
+                    size_t peeked_count = pending_byte_count;
+                    if (to_peek != 0)
                     {
-                        message.set_reply_status(core::status_no_memory);
-                        message.set_reply_information(0);
-                        return outcome;
+                        auto read = host_io.peek_input_bytes(std::span<std::byte>(peeked.data() + pending_byte_count, to_peek));
+                        if (!read)
+                        {
+                            return std::unexpected(read.error());
+                        }
+                        peeked_count += read.value();
                     }
 
-                    if (!title.empty() && title.back() == L'\0')
+                    ready_events = 0;
+                    const UINT code_page = static_cast<UINT>(state.input_code_page());
+                    const bool processed_input = (state.input_mode() & ENABLE_PROCESSED_INPUT) != 0;
+
+                    size_t offset = 0;
+                    const auto bytes = std::span<const std::byte>(peeked.data(), peeked_count);
+                    while (offset < bytes.size())
                     {
-                        while (!title.empty() && title.back() == L'\0')
+                        vt_input::DecodedToken token{};
+                        const auto decode_outcome = decode_one_input_token(code_page, bytes.subspan(offset), token);
+                        if (decode_outcome == InputDecodeOutcome::need_more_data)
                         {
-                            title.pop_back();
+                            break;
                         }
-                    }
-                }
-                else
-                {
-                    const UINT cp = state.output_code_page() == 0 ? ::GetOEMCP() : static_cast<UINT>(state.output_code_page());
-                    const int required = input->empty()
-                        ? 0
-                        : ::MultiByteToWideChar(
-                            cp,
-                            0,
-                            reinterpret_cast<const char*>(input->data()),
-                            static_cast<int>(input->size()),
-                            nullptr,
-                            0);
-                    if (required < 0)
-                    {
-                        return std::unexpected(DeviceCommError{
-                            .context = L"MultiByteToWideChar size query failed for console title",
-                            .win32_error = ::GetLastError(),
-                        });
-                    }
 
-                    try
-                    {
-                        title.resize(static_cast<size_t>(required));
-                    }
-                    catch (...)
-                    {
-                        message.set_reply_status(core::status_no_memory);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
+                        if (token.bytes_consumed == 0)
+                        {
+                            break;
+                        }
 
-                    if (required != 0)
-                    {
-                        const int converted = ::MultiByteToWideChar(
-                            cp,
-                            0,
-                            reinterpret_cast<const char*>(input->data()),
-                            static_cast<int>(input->size()),
-                            title.data(),
-                            required);
-                        if (converted != required)
+                        offset += token.bytes_consumed;
+
+                        if (token.kind == vt_input::TokenKind::ignored_sequence)
                         {
-                            return std::unexpected(DeviceCommError{
-                                .context = L"MultiByteToWideChar failed for console title",
-                                .win32_error = ::GetLastError(),
-                            });
+                            continue;
+                        }
+
+                        if (token.kind == vt_input::TokenKind::key_event)
+                        {
+                            if (processed_input &&
+                                token.key.bKeyDown &&
+                                (key_event_matches_ctrl_c(token.key) || key_event_matches_ctrl_break(token.key)))
+                            {
+                                continue;
+                            }
+
+                            if (ready_events != std::numeric_limits<size_t>::max())
+                            {
+                                ++ready_events;
+                            }
+                            continue;
+                        }
+
+                        const auto& text = token.text;
+                        if (text.char_count == 0)
+                        {
+                            continue;
+                        }
+
+                        if (processed_input && text.char_count == 1 && text.chars[0] == static_cast<wchar_t>(0x0003))
+                        {
+                            continue;
+                        }
+
+                        if (ready_events == std::numeric_limits<size_t>::max())
+                        {
+                            continue;
                         }
+
+                        const size_t remaining = std::numeric_limits<size_t>::max() - ready_events;
+                        ready_events = text.char_count > remaining ? std::numeric_limits<size_t>::max() : ready_events + text.char_count;
                     }
                 }
+            }
 
-                if (!state.set_title(std::move(title)))
-                {
-                    message.set_reply_status(core::status_no_memory);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            if (handle->decoded_input_pending && ready_events != std::numeric_limits<size_t>::max())
+            {
+                ++ready_events;
+            }
 
-                message.set_reply_status(core::status_success);
+            packet.payload.user_defined.u.console_msg_l1.GetNumberOfConsoleInputEvents.ReadyEvents =
+                ready_events > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                ? std::numeric_limits<ULONG>::max()
+                : static_cast<ULONG>(ready_events);
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_lang_id(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            packet.payload.user_defined.u.console_msg_l1.GetConsoleLangId.LangId = ::GetUserDefaultLangID();
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_notify_last_close(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& message = context.message;
+            DispatchOutcome outcome{};
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_number_of_fonts(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            packet.payload.user_defined.u.console_msg_l3.GetNumberOfConsoleFonts.NumberOfFonts = 1;
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_font_info(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-                if (api_number == static_cast<ULONG>(ConsolepGetNumberOfInputEvents))
-                {
-                    const auto handle_id = descriptor.object;
-                    auto* handle = state.find_object(handle_id);
-                    if (handle == nullptr || handle->kind != ObjectKind::input)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                const size_t ready_bytes = host_io.input_bytes_available();
-                size_t ready_events = ready_bytes;
-                if (ready_bytes != 0 || !handle->pending_input_bytes.empty())
-                {
-                    // ConDrv reports input events, not raw bytes. The replacement is byte-stream-backed,
-                    // so we approximate the visible event count by scanning a bounded prefix using the
-                    // VT/code-page token decoder.
-                    constexpr size_t peek_limit = 64 * 1024;
+            auto output = message.get_output_buffer();
+            if (!output)
+            {
+                return std::unexpected(output.error());
+            }
 
-                    const size_t pending_byte_count = handle->pending_input_bytes.size();
-                    const size_t queue_budget = peek_limit > pending_byte_count ? peek_limit - pending_byte_count : 0;
-                    const size_t to_peek = std::min(ready_bytes, queue_budget);
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleFontInfo;
+            body.NumFonts = 1;
 
-                    std::vector<std::byte> peeked;
-                    try
-                    {
-                        peeked.resize(pending_byte_count + to_peek);
-                    }
-                    catch (...)
-                    {
-                        peeked.clear();
-                    }
+            if (output->size() < sizeof(CONSOLE_FONT_INFO))
+            {
+                message.set_reply_status(core::status_buffer_too_small);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                    if (!peeked.empty())
-                    {
-                        if (pending_byte_count != 0)
-                        {
-                            const auto prefix = handle->pending_input_bytes.bytes();
-                            std::memcpy(peeked.data(), prefix.data(), pending_byte_count);
-                        }
+            CONSOLE_FONT_INFO info{};
+            info.nFont = state.font_index();
+            info.dwFontSize = state.font_size();
+            std::memcpy(output->data(), &info, sizeof(info));
 
-                        size_t peeked_count = pending_byte_count;
-                        if (to_peek != 0)
-                        {
-                            auto read = host_io.peek_input_bytes(std::span<std::byte>(peeked.data() + pending_byte_count, to_peek));
-                            if (!read)
-                            {
-                                return std::unexpected(read.error());
-                            }
-                            peeked_count += read.value();
-                        }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(sizeof(info));
+            return outcome;
+        }
 
-                        ready_events = 0;
-                        const UINT code_page = static_cast<UINT>(state.input_code_page());
-                        const bool processed_input = (state.input_mode() & ENABLE_PROCESSED_INPUT) != 0;
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_font_size(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                        size_t offset = 0;
-                        const auto bytes = std::span<const std::byte>(peeked.data(), peeked_count);
-                        while (offset < bytes.size())
-                        {
-                            vt_input::DecodedToken token{};
-                            const auto decode_outcome = decode_one_input_token(code_page, bytes.subspan(offset), token);
-                            if (decode_outcome == InputDecodeOutcome::need_more_data)
-                            {
-                                break;
-                            }
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                            if (token.bytes_consumed == 0)
-                            {
-                                break;
-                            }
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                            offset += token.bytes_consumed;
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleFontSize;
+            if (body.FontIndex != state.font_index())
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                            if (token.kind == vt_input::TokenKind::ignored_sequence)
-                            {
-                                continue;
-                            }
+            body.FontSize = state.font_size();
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                            if (token.kind == vt_input::TokenKind::key_event)
-                            {
-                                if (processed_input &&
-                                    token.key.bKeyDown &&
-                                    (key_event_matches_ctrl_c(token.key) || key_event_matches_ctrl_break(token.key)))
-                                {
-                                    continue;
-                                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_current_font(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                                if (ready_events != std::numeric_limits<size_t>::max())
-                                {
-                                    ++ready_events;
-                                }
-                                continue;
-                            }
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                            const auto& text = token.text;
-                            if (text.char_count == 0)
-                            {
-                                continue;
-                            }
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                            if (processed_input && text.char_count == 1 && text.chars[0] == static_cast<wchar_t>(0x0003))
-                            {
-                                continue;
-                            }
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetCurrentConsoleFont;
+            state.fill_current_font(body);
 
-                            if (ready_events == std::numeric_limits<size_t>::max())
-                            {
-                                continue;
-                            }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                            const size_t remaining = std::numeric_limits<size_t>::max() - ready_events;
-                            ready_events = text.char_count > remaining ? std::numeric_limits<size_t>::max() : ready_events + text.char_count;
-                        }
-                    }
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_font(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& message = context.message;
+            DispatchOutcome outcome{};
 
-                if (handle->decoded_input_pending && ready_events != std::numeric_limits<size_t>::max())
-                {
-                    ++ready_events;
-                }
+            // Deprecated in the inbox host, but accept and succeed for compatibility.
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                packet.payload.user_defined.u.console_msg_l1.GetNumberOfConsoleInputEvents.ReadyEvents =
-                    ready_events > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                    ? std::numeric_limits<ULONG>::max()
-                    : static_cast<ULONG>(ready_events);
+        // Legacy UI/VDM APIs (upstream `ServerDeprecatedApi`).
+        // See `new/docs/design/condrv_deprecated_user_defined_apis.md`.
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_deprecated_api(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            DispatchOutcome outcome{};
 
-                message.set_reply_status(core::status_success);
+            reject_user_defined_not_implemented(context);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_display_mode(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetLangId))
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
             {
-                packet.payload.user_defined.u.console_msg_l1.GetConsoleLangId.LangId = ::GetUserDefaultLangID();
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleDisplayMode;
+            body.ScreenBufferDimensions = screen_buffer->screen_buffer_size();
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_key_shortcuts(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            const auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleKeyShortcuts;
+            state.set_key_shortcuts(body.Set != FALSE, body.ReserveKeys);
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_menu_close(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            const auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleMenuClose;
+            state.set_menu_close(body.Enable != FALSE);
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_char_type(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleCharType;
+            const auto size = screen_buffer->screen_buffer_size();
+            if (body.coordCheck.X < 0 || body.coordCheck.Y < 0 ||
+                body.coordCheck.X >= size.X || body.coordCheck.Y >= size.Y)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepNotifyLastClose))
+            // The classic attribute view carries the cell-half flags of double-width glyphs.
+            USHORT cell_attributes = 0;
+            (void)screen_buffer->read_output_attributes(body.coordCheck, std::span<USHORT>(&cell_attributes, 1));
+            if ((cell_attributes & COMMON_LVB_LEADING_BYTE) != 0)
+            {
+                body.dwType = CHAR_TYPE_LEADING;
+            }
+            else if ((cell_attributes & COMMON_LVB_TRAILING_BYTE) != 0)
+            {
+                body.dwType = CHAR_TYPE_TRAILING;
+            }
+            else
+            {
+                body.dwType = CHAR_TYPE_SBCS;
+            }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_local_eudc(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& message = context.message;
+            DispatchOutcome outcome{};
+
+            // Legacy API used by older clients for local EUDC configuration. The
+            // inbox host treats this as deprecated; we accept and ignore it.
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_cursor_mode(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleCursorMode;
+            state.set_cursor_mode(body.Blink != FALSE, body.DBEnable != FALSE);
+            body.Blink = state.cursor_blink() ? TRUE : FALSE;
+            body.DBEnable = state.cursor_db_enable() ? TRUE : FALSE;
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_cursor_mode(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleCursorMode;
+            body.Blink = state.cursor_blink() ? TRUE : FALSE;
+            body.DBEnable = state.cursor_db_enable() ? TRUE : FALSE;
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_register_os2(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            const auto& body = packet.payload.user_defined.u.console_msg_l3.RegisterConsoleOS2;
+            state.set_os2_registered(body.fOs2Register != FALSE);
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_os2_oem_format(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            const auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleOS2OemFormat;
+            state.set_os2_oem_format(body.fOs2OemFormat != FALSE);
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_nls_mode(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleNlsMode;
+            body.Ready = TRUE;
+            body.NlsMode = state.nls_mode();
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_nls_mode(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleNlsMode;
+            state.set_nls_mode(body.NlsMode);
+            body.Ready = TRUE;
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_current_font(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.SetCurrentConsoleFont;
+            state.apply_current_font(body);
+            state.fill_current_font(body);
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_console_window(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleWindow;
+            body.hwnd = decltype(body.hwnd){};
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_display_mode(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            packet.payload.user_defined.u.console_msg_l3.GetConsoleDisplayMode.ModeFlags = 0;
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_keyboard_layout_name(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetKeyboardLayoutName;
+
+            WCHAR layout[KL_NAMELENGTH]{};
+            if (::GetKeyboardLayoutNameW(layout) == FALSE)
+            {
+                static constexpr wchar_t fallback[] = L"00000409";
+                static_assert(sizeof(fallback) == sizeof(layout), "Fallback keyboard layout name must match KL_NAMELENGTH");
+                std::memcpy(layout, fallback, sizeof(layout));
+            }
+
+            if (body.bAnsi != FALSE)
+            {
+                for (size_t i = 0; i < static_cast<size_t>(KL_NAMELENGTH); ++i)
+                {
+                    const WCHAR ch = layout[i];
+                    body.achLayout[i] = ch <= 0x7F ? static_cast<char>(ch) : '?';
+                }
+            }
+            else
+            {
+                std::memcpy(body.awchLayout, layout, sizeof(body.awchLayout));
+            }
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_mouse_info(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleMouseInfo;
+            const int buttons = ::GetSystemMetrics(SM_CMOUSEBUTTONS);
+            body.NumButtons = buttons > 0 ? static_cast<ULONG>(buttons) : 0;
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_selection_info(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleSelectionInfo;
+            body.SelectionInfo = CONSOLE_SELECTION_INFO{};
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_console_process_list(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto output = message.get_output_buffer();
+            if (!output)
             {
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(0);
-                return outcome;
+                return std::unexpected(output.error());
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepMapBitmap))
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleProcessList;
+            const size_t capacity = output->size() / sizeof(DWORD);
+
+            std::vector<const ProcessState*> processes;
+            try
             {
-                reject_user_defined_not_implemented();
-                return outcome;
+                processes.reserve(state.process_count());
             }
-
-            if (api_number == static_cast<ULONG>(ConsolepGetNumberOfFonts))
+            catch (...)
             {
-                packet.payload.user_defined.u.console_msg_l3.GetNumberOfConsoleFonts.NumberOfFonts = 1;
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(core::status_no_memory);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetFontInfo))
-            {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto output = message.get_output_buffer();
-                if (!output)
+            state.for_each_process([&](const ProcessState& process) noexcept { processes.push_back(&process); });
+            std::sort(processes.begin(), processes.end(), [](const ProcessState* left, const ProcessState* right) noexcept {
+                if (left == right)
                 {
-                    return std::unexpected(output.error());
+                    return false;
                 }
-
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleFontInfo;
-                body.NumFonts = 1;
-
-                if (output->size() < sizeof(CONSOLE_FONT_INFO))
+                if (left == nullptr || right == nullptr)
                 {
-                    message.set_reply_status(core::status_buffer_too_small);
-                    message.set_reply_information(0);
-                    return outcome;
+                    return left != nullptr;
                 }
+                return left->connect_sequence > right->connect_sequence;
+            });
 
-                CONSOLE_FONT_INFO info{};
-                info.nFont = state.font_index();
-                info.dwFontSize = state.font_size();
-                std::memcpy(output->data(), &info, sizeof(info));
+            const size_t total = processes.size();
+            const ULONG total_clamped =
+                total > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                ? std::numeric_limits<ULONG>::max()
+                : static_cast<ULONG>(total);
 
+            if (capacity < total)
+            {
+                body.dwProcessCount = total_clamped;
                 message.set_reply_status(core::status_success);
-                message.set_reply_information(sizeof(info));
+                message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetFontSize))
+            for (size_t i = 0; i < total; ++i)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                const DWORD pid = processes[i] == nullptr ? 0 : processes[i]->pid;
+                const size_t offset = i * sizeof(DWORD);
+                std::memcpy(output->data() + offset, &pid, sizeof(pid));
+            }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            body.dwProcessCount = total_clamped;
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(total * sizeof(DWORD));
+            return outcome;
+        }
 
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleFontSize;
-                if (body.FontIndex != state.font_index())
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_add_alias(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
 
-                body.FontSize = state.font_size();
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(0);
-                return outcome;
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetCurrentFont))
+            const auto& body = packet.payload.user_defined.u.console_msg_l3.AddConsoleAliasW;
+            const bool unicode = body.Unicode != FALSE;
+            const size_t exe_length = body.ExeLength;
+            const size_t source_length = body.SourceLength;
+            const size_t target_length = body.TargetLength;
+
+            const size_t alignment = unicode ? alignof(wchar_t) : size_t{ 1 };
+            const bool bad_length = exe_length + source_length + target_length > input->size();
+            const bool bad_alignment = ((exe_length | source_length | target_length) & (alignment - 1)) != 0;
+            if (bad_length || bad_alignment)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            const auto bytes = std::span<const std::byte>(input->data(), input->size());
+            const auto exe_bytes = bytes.subspan(0, exe_length);
+            const auto source_bytes = bytes.subspan(exe_length, source_length);
+            const auto target_bytes = bytes.subspan(exe_length + source_length, target_length);
 
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetCurrentConsoleFont;
-                state.fill_current_font(body);
+            const UINT code_page = static_cast<UINT>(state.output_code_page());
 
-                message.set_reply_status(core::status_success);
+            auto exe_decoded = decode_console_string(unicode, exe_bytes, code_page, L"ConsolepAddAlias exe name decode failed");
+            if (!exe_decoded)
+            {
+                message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetFont))
+            auto source_decoded = decode_console_string(unicode, source_bytes, code_page, L"ConsolepAddAlias source decode failed");
+            if (!source_decoded)
             {
-                // Deprecated in the inbox host, but accept and succeed for compatibility.
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(source_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetIcon) ||
-                api_number == static_cast<ULONG>(ConsolepInvalidateBitmapRect) ||
-                api_number == static_cast<ULONG>(ConsolepVDMOperation) ||
-                api_number == static_cast<ULONG>(ConsolepSetCursor) ||
-                api_number == static_cast<ULONG>(ConsolepShowCursor) ||
-                api_number == static_cast<ULONG>(ConsolepMenuControl) ||
-                api_number == static_cast<ULONG>(ConsolepSetPalette) ||
-                api_number == static_cast<ULONG>(ConsolepRegisterVDM) ||
-                api_number == static_cast<ULONG>(ConsolepGetHardwareState) ||
-                api_number == static_cast<ULONG>(ConsolepSetHardwareState))
+            auto target_decoded = decode_console_string(unicode, target_bytes, code_page, L"ConsolepAddAlias target decode failed");
+            if (!target_decoded)
             {
-                reject_user_defined_not_implemented();
+                message.set_reply_status(target_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
+                message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetDisplayMode))
+            if (source_decoded->empty())
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleDisplayMode;
-                body.ScreenBufferDimensions = screen_buffer->screen_buffer_size();
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetKeyShortcuts))
+            auto exe_norm = fold_to_lower_invariant(*exe_decoded, L"ConsolepAddAlias exe name fold failed");
+            if (!exe_norm)
             {
-                const auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleKeyShortcuts;
-                state.set_key_shortcuts(body.Set != FALSE, body.ReserveKeys);
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(exe_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetMenuClose))
+            auto source_norm = fold_to_lower_invariant(*source_decoded, L"ConsolepAddAlias source fold failed");
+            if (!source_norm)
             {
-                const auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleMenuClose;
-                state.set_menu_close(body.Enable != FALSE);
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(source_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepCharType))
+            auto stored = state.set_alias(std::move(exe_norm.value()), std::move(source_norm.value()), std::move(target_decoded.value()));
+            if (!stored)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                message.set_reply_status(stored.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleCharType;
-                const auto size = screen_buffer->screen_buffer_size();
-                if (body.coordCheck.X < 0 || body.coordCheck.Y < 0 ||
-                    body.coordCheck.X >= size.X || body.coordCheck.Y >= size.Y)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_alias(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
 
-                body.dwType = CHAR_TYPE_SBCS;
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(0);
-                return outcome;
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetLocalEUDC))
+            auto output = message.get_output_buffer();
+            if (!output)
             {
-                // Legacy API used by older clients for local EUDC configuration. The
-                // inbox host treats this as deprecated; we accept and ignore it.
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(0);
-                return outcome;
+                return std::unexpected(output.error());
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetCursorMode))
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleAliasW;
+            body.TargetLength = 0;
+
+            const bool unicode = body.Unicode != FALSE;
+            const size_t exe_length = body.ExeLength;
+            const size_t source_length = body.SourceLength;
+
+            const size_t alignment = unicode ? alignof(wchar_t) : size_t{ 1 };
+            const bool bad_length = exe_length + source_length > input->size();
+            const bool bad_alignment = ((exe_length | source_length) & (alignment - 1)) != 0;
+            if (bad_length || bad_alignment)
             {
-                auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleCursorMode;
-                state.set_cursor_mode(body.Blink != FALSE, body.DBEnable != FALSE);
-                body.Blink = state.cursor_blink() ? TRUE : FALSE;
-                body.DBEnable = state.cursor_db_enable() ? TRUE : FALSE;
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetCursorMode))
+            const auto bytes = std::span<const std::byte>(input->data(), input->size());
+            const auto exe_bytes = bytes.subspan(0, exe_length);
+            const auto source_bytes = bytes.subspan(exe_length, source_length);
+
+            const UINT code_page = static_cast<UINT>(state.output_code_page());
+
+            auto exe_decoded = decode_console_string(unicode, exe_bytes, code_page, L"ConsolepGetAlias exe name decode failed");
+            if (!exe_decoded)
             {
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleCursorMode;
-                body.Blink = state.cursor_blink() ? TRUE : FALSE;
-                body.DBEnable = state.cursor_db_enable() ? TRUE : FALSE;
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepRegisterOS2))
+            auto source_decoded = decode_console_string(unicode, source_bytes, code_page, L"ConsolepGetAlias source decode failed");
+            if (!source_decoded)
             {
-                const auto& body = packet.payload.user_defined.u.console_msg_l3.RegisterConsoleOS2;
-                state.set_os2_registered(body.fOs2Register != FALSE);
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(source_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetOS2OemFormat))
+            auto exe_norm = fold_to_lower_invariant(*exe_decoded, L"ConsolepGetAlias exe name fold failed");
+            if (!exe_norm)
             {
-                const auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleOS2OemFormat;
-                state.set_os2_oem_format(body.fOs2OemFormat != FALSE);
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(exe_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetNlsMode))
+            auto source_norm = fold_to_lower_invariant(*source_decoded, L"ConsolepGetAlias source fold failed");
+            if (!source_norm)
             {
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleNlsMode;
-                body.Ready = TRUE;
-                body.NlsMode = state.nls_mode();
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(source_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetNlsMode))
+            const auto target = state.try_get_alias(exe_norm.value(), source_norm.value());
+            if (!target)
             {
-                auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleNlsMode;
-                state.set_nls_mode(body.NlsMode);
-                body.Ready = TRUE;
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(core::status_unsuccessful);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetCurrentFont))
+            const std::wstring_view target_view = target.value();
+            if (unicode)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
+                const size_t required_bytes = (target_view.size() + 1) * sizeof(wchar_t);
+                if (required_bytes > static_cast<size_t>(std::numeric_limits<USHORT>::max()))
                 {
-                    message.set_reply_status(core::status_invalid_handle);
+                    message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
+                body.TargetLength = static_cast<USHORT>(required_bytes);
+                if (output->size() < required_bytes)
                 {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
+                    message.set_reply_status(core::status_buffer_too_small);
+                    message.set_reply_information(body.TargetLength);
                     return outcome;
                 }
 
-                auto& body = packet.payload.user_defined.u.console_msg_l3.SetCurrentConsoleFont;
-                state.apply_current_font(body);
-                state.fill_current_font(body);
-
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(0);
-                return outcome;
-            }
+                if (!target_view.empty())
+                {
+                    std::memcpy(output->data(), target_view.data(), target_view.size() * sizeof(wchar_t));
+                }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetConsoleWindow))
-            {
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleWindow;
-                body.hwnd = decltype(body.hwnd){};
+                const wchar_t terminator = L'\0';
+                std::memcpy(output->data() + (target_view.size() * sizeof(wchar_t)), &terminator, sizeof(terminator));
 
                 message.set_reply_status(core::status_success);
-                message.set_reply_information(0);
+                message.set_reply_information(body.TargetLength);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetDisplayMode))
+            if (target_view.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
             {
-                packet.payload.user_defined.u.console_msg_l3.GetConsoleDisplayMode.ModeFlags = 0;
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetKeyboardLayoutName))
+            const int required_narrow = ::WideCharToMultiByte(
+                code_page,
+                0,
+                target_view.data(),
+                static_cast<int>(target_view.size()),
+                nullptr,
+                0,
+                nullptr,
+                nullptr);
+            if (required_narrow <= 0)
             {
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetKeyboardLayoutName;
-
-                WCHAR layout[KL_NAMELENGTH]{};
-                if (::GetKeyboardLayoutNameW(layout) == FALSE)
-                {
-                    static constexpr wchar_t fallback[] = L"00000409";
-                    static_assert(sizeof(fallback) == sizeof(layout), "Fallback keyboard layout name must match KL_NAMELENGTH");
-                    std::memcpy(layout, fallback, sizeof(layout));
-                }
-
-                if (body.bAnsi != FALSE)
-                {
-                    for (size_t i = 0; i < static_cast<size_t>(KL_NAMELENGTH); ++i)
-                    {
-                        const WCHAR ch = layout[i];
-                        body.achLayout[i] = ch <= 0x7F ? static_cast<char>(ch) : '?';
-                    }
-                }
-                else
-                {
-                    std::memcpy(body.awchLayout, layout, sizeof(body.awchLayout));
-                }
-
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetMouseInfo))
+            const size_t required_bytes = static_cast<size_t>(required_narrow) + 1;
+            if (required_bytes > static_cast<size_t>(std::numeric_limits<USHORT>::max()))
             {
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleMouseInfo;
-                const int buttons = ::GetSystemMetrics(SM_CMOUSEBUTTONS);
-                body.NumButtons = buttons > 0 ? static_cast<ULONG>(buttons) : 0;
-
-                message.set_reply_status(core::status_success);
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetSelectionInfo))
+            body.TargetLength = static_cast<USHORT>(required_bytes);
+            if (output->size() < required_bytes)
             {
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleSelectionInfo;
-                body.SelectionInfo = CONSOLE_SELECTION_INFO{};
-
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(0);
+                message.set_reply_status(core::status_buffer_too_small);
+                message.set_reply_information(body.TargetLength);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetConsoleProcessList))
+            if (required_narrow != 0)
             {
-                auto output = message.get_output_buffer();
-                if (!output)
-                {
-                    return std::unexpected(output.error());
-                }
-
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleProcessList;
-                const size_t capacity = output->size() / sizeof(DWORD);
-
-                std::vector<const ProcessState*> processes;
-                try
-                {
-                    processes.reserve(state.process_count());
-                }
-                catch (...)
+                const int converted = ::WideCharToMultiByte(
+                    code_page,
+                    0,
+                    target_view.data(),
+                    static_cast<int>(target_view.size()),
+                    reinterpret_cast<char*>(output->data()),
+                    required_narrow,
+                    nullptr,
+                    nullptr);
+                if (converted != required_narrow)
                 {
-                    message.set_reply_status(core::status_no_memory);
+                    message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
+            }
 
-                state.for_each_process([&](const ProcessState& process) noexcept { processes.push_back(&process); });
-                std::sort(processes.begin(), processes.end(), [](const ProcessState* left, const ProcessState* right) noexcept {
-                    if (left == right)
-                    {
-                        return false;
-                    }
-                    if (left == nullptr || right == nullptr)
-                    {
-                        return left != nullptr;
-                    }
-                    return left->connect_sequence > right->connect_sequence;
-                });
+            reinterpret_cast<char*>(output->data())[required_narrow] = '\0';
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(body.TargetLength);
+            return outcome;
+        }
 
-                const size_t total = processes.size();
-                const ULONG total_clamped =
-                    total > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                    ? std::numeric_limits<ULONG>::max()
-                    : static_cast<ULONG>(total);
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_aliases_length(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
 
-                if (capacity < total)
-                {
-                    body.dwProcessCount = total_clamped;
-                    message.set_reply_status(core::status_success);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
+            }
 
-                for (size_t i = 0; i < total; ++i)
-                {
-                    const DWORD pid = processes[i] == nullptr ? 0 : processes[i]->pid;
-                    const size_t offset = i * sizeof(DWORD);
-                    std::memcpy(output->data() + offset, &pid, sizeof(pid));
-                }
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleAliasesLengthW;
+            body.AliasesLength = 0;
 
-                body.dwProcessCount = total_clamped;
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(total * sizeof(DWORD));
+            const bool unicode = body.Unicode != FALSE;
+            if (unicode && ((input->size() % sizeof(wchar_t)) != 0))
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepAddAlias))
+            const UINT code_page = static_cast<UINT>(state.output_code_page());
+            auto exe_decoded = decode_console_string(
+                unicode,
+                std::span<const std::byte>(input->data(), input->size()),
+                code_page,
+                L"ConsolepGetAliasesLength exe name decode failed");
+            if (!exe_decoded)
             {
-                auto input = message.get_input_buffer();
-                if (!input)
-                {
-                    return std::unexpected(input.error());
-                }
-
-                const auto& body = packet.payload.user_defined.u.console_msg_l3.AddConsoleAliasW;
-                const bool unicode = body.Unicode != FALSE;
-                const size_t exe_length = body.ExeLength;
-                const size_t source_length = body.SourceLength;
-                const size_t target_length = body.TargetLength;
-
-                const size_t alignment = unicode ? alignof(wchar_t) : size_t{ 1 };
-                const bool bad_length = exe_length + source_length + target_length > input->size();
-                const bool bad_alignment = ((exe_length | source_length | target_length) & (alignment - 1)) != 0;
-                if (bad_length || bad_alignment)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
-
-                const auto bytes = std::span<const std::byte>(input->data(), input->size());
-                const auto exe_bytes = bytes.subspan(0, exe_length);
-                const auto source_bytes = bytes.subspan(exe_length, source_length);
-                const auto target_bytes = bytes.subspan(exe_length + source_length, target_length);
-
-                const UINT code_page = static_cast<UINT>(state.output_code_page());
+                message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto exe_decoded = decode_console_string(unicode, exe_bytes, code_page, L"ConsolepAddAlias exe name decode failed");
-                if (!exe_decoded)
-                {
-                    message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto exe_norm = fold_to_lower_invariant(*exe_decoded, L"ConsolepGetAliasesLength exe name fold failed");
+            if (!exe_norm)
+            {
+                message.set_reply_status(exe_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto source_decoded = decode_console_string(unicode, source_bytes, code_page, L"ConsolepAddAlias source decode failed");
-                if (!source_decoded)
-                {
-                    message.set_reply_status(source_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            size_t total_bytes = 0;
+            bool conversion_failed = false;
 
-                auto target_decoded = decode_console_string(unicode, target_bytes, code_page, L"ConsolepAddAlias target decode failed");
-                if (!target_decoded)
+            state.for_each_alias(exe_norm.value(), [&](const std::wstring_view source, const std::wstring_view target) noexcept {
+                if (conversion_failed)
                 {
-                    message.set_reply_status(target_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    return;
                 }
 
-                if (source_decoded->empty())
+                if (unicode)
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    const size_t required = (source.size() + 1 + target.size() + 1) * sizeof(wchar_t);
+                    total_bytes += required;
+                    return;
                 }
 
-                auto exe_norm = fold_to_lower_invariant(*exe_decoded, L"ConsolepAddAlias exe name fold failed");
-                if (!exe_norm)
+                if (source.size() > static_cast<size_t>(std::numeric_limits<int>::max()) ||
+                    target.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
                 {
-                    message.set_reply_status(exe_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
-                    message.set_reply_information(0);
-                    return outcome;
+                    conversion_failed = true;
+                    return;
                 }
 
-                auto source_norm = fold_to_lower_invariant(*source_decoded, L"ConsolepAddAlias source fold failed");
-                if (!source_norm)
+                const int source_bytes = ::WideCharToMultiByte(
+                    code_page,
+                    0,
+                    source.data(),
+                    static_cast<int>(source.size()),
+                    nullptr,
+                    0,
+                    nullptr,
+                    nullptr);
+                if (source_bytes <= 0)
                 {
-                    message.set_reply_status(source_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
-                    message.set_reply_information(0);
-                    return outcome;
+                    conversion_failed = true;
+                    return;
                 }
 
-                auto stored = state.set_alias(std::move(exe_norm.value()), std::move(source_norm.value()), std::move(target_decoded.value()));
-                if (!stored)
+                const int target_bytes = ::WideCharToMultiByte(
+                    code_page,
+                    0,
+                    target.data(),
+                    static_cast<int>(target.size()),
+                    nullptr,
+                    0,
+                    nullptr,
+                    nullptr);
+                if (target_bytes <= 0)
                 {
-                    message.set_reply_status(stored.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
-                    message.set_reply_information(0);
-                    return outcome;
+                    conversion_failed = true;
+                    return;
                 }
 
-                message.set_reply_status(core::status_success);
+                total_bytes += static_cast<size_t>(source_bytes);
+                total_bytes += 1; // '='
+                total_bytes += static_cast<size_t>(target_bytes);
+                total_bytes += 1; // null terminator
+            });
+
+            if (conversion_failed)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetAlias))
-            {
-                auto input = message.get_input_buffer();
-                if (!input)
-                {
-                    return std::unexpected(input.error());
-                }
-
-                auto output = message.get_output_buffer();
-                if (!output)
-                {
-                    return std::unexpected(output.error());
-                }
+            body.AliasesLength =
+                total_bytes > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                ? std::numeric_limits<ULONG>::max()
+                : static_cast<ULONG>(total_bytes);
 
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleAliasW;
-                body.TargetLength = 0;
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                const bool unicode = body.Unicode != FALSE;
-                const size_t exe_length = body.ExeLength;
-                const size_t source_length = body.SourceLength;
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_aliases(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
 
-                const size_t alignment = unicode ? alignof(wchar_t) : size_t{ 1 };
-                const bool bad_length = exe_length + source_length > input->size();
-                const bool bad_alignment = ((exe_length | source_length) & (alignment - 1)) != 0;
-                if (bad_length || bad_alignment)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
+            }
 
-                const auto bytes = std::span<const std::byte>(input->data(), input->size());
-                const auto exe_bytes = bytes.subspan(0, exe_length);
-                const auto source_bytes = bytes.subspan(exe_length, source_length);
+            auto output = message.get_output_buffer();
+            if (!output)
+            {
+                return std::unexpected(output.error());
+            }
 
-                const UINT code_page = static_cast<UINT>(state.output_code_page());
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleAliasesW;
+            body.AliasesBufferLength = 0;
 
-                auto exe_decoded = decode_console_string(unicode, exe_bytes, code_page, L"ConsolepGetAlias exe name decode failed");
-                if (!exe_decoded)
-                {
-                    message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            const bool unicode = body.Unicode != FALSE;
+            if (unicode && ((input->size() % sizeof(wchar_t)) != 0))
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto source_decoded = decode_console_string(unicode, source_bytes, code_page, L"ConsolepGetAlias source decode failed");
-                if (!source_decoded)
-                {
-                    message.set_reply_status(source_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            const UINT code_page = static_cast<UINT>(state.output_code_page());
+            auto exe_decoded = decode_console_string(
+                unicode,
+                std::span<const std::byte>(input->data(), input->size()),
+                code_page,
+                L"ConsolepGetAliases exe name decode failed");
+            if (!exe_decoded)
+            {
+                message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto exe_norm = fold_to_lower_invariant(*exe_decoded, L"ConsolepGetAlias exe name fold failed");
-                if (!exe_norm)
-                {
-                    message.set_reply_status(exe_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto exe_norm = fold_to_lower_invariant(*exe_decoded, L"ConsolepGetAliases exe name fold failed");
+            if (!exe_norm)
+            {
+                message.set_reply_status(exe_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                auto source_norm = fold_to_lower_invariant(*source_decoded, L"ConsolepGetAlias source fold failed");
-                if (!source_norm)
-                {
-                    message.set_reply_status(source_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            size_t written = 0;
+            bool overflow = false;
+            bool conversion_failed = false;
 
-                const auto target = state.try_get_alias(exe_norm.value(), source_norm.value());
-                if (!target)
+            state.for_each_alias(exe_norm.value(), [&](const std::wstring_view source, const std::wstring_view target) noexcept {
+                if (overflow || conversion_failed)
                 {
-                    message.set_reply_status(core::status_unsuccessful);
-                    message.set_reply_information(0);
-                    return outcome;
+                    return;
                 }
 
-                const std::wstring_view target_view = target.value();
                 if (unicode)
                 {
-                    const size_t required_bytes = (target_view.size() + 1) * sizeof(wchar_t);
-                    if (required_bytes > static_cast<size_t>(std::numeric_limits<USHORT>::max()))
+                    const size_t bytes_required = (source.size() + 1 + target.size() + 1) * sizeof(wchar_t);
+                    if (output->size() - written < bytes_required)
                     {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
+                        overflow = true;
+                        return;
                     }
 
-                    body.TargetLength = static_cast<USHORT>(required_bytes);
-                    if (output->size() < required_bytes)
+                    auto* dest = reinterpret_cast<wchar_t*>(output->data() + written);
+                    if (!source.empty())
                     {
-                        message.set_reply_status(core::status_buffer_too_small);
-                        message.set_reply_information(body.TargetLength);
-                        return outcome;
+                        std::memcpy(dest, source.data(), source.size() * sizeof(wchar_t));
                     }
-
-                    if (!target_view.empty())
+                    dest += source.size();
+                    *dest++ = L'=';
+                    if (!target.empty())
                     {
-                        std::memcpy(output->data(), target_view.data(), target_view.size() * sizeof(wchar_t));
+                        std::memcpy(dest, target.data(), target.size() * sizeof(wchar_t));
                     }
+                    dest += target.size();
+                    *dest++ = L'\0';
 
-                    const wchar_t terminator = L'\0';
-                    std::memcpy(output->data() + (target_view.size() * sizeof(wchar_t)), &terminator, sizeof(terminator));
-
-                    message.set_reply_status(core::status_success);
-                    message.set_reply_information(body.TargetLength);
-                    return outcome;
+                    written += bytes_required;
+                    return;
                 }
 
-                if (target_view.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
+                if (source.size() > static_cast<size_t>(std::numeric_limits<int>::max()) ||
+                    target.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    conversion_failed = true;
+                    return;
                 }
 
-                const int required_narrow = ::WideCharToMultiByte(
+                const int source_bytes = ::WideCharToMultiByte(
                     code_page,
                     0,
-                    target_view.data(),
-                    static_cast<int>(target_view.size()),
+                    source.data(),
+                    static_cast<int>(source.size()),
                     nullptr,
                     0,
                     nullptr,
                     nullptr);
-                if (required_narrow <= 0)
+                if (source_bytes <= 0)
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    conversion_failed = true;
+                    return;
                 }
 
-                const size_t required_bytes = static_cast<size_t>(required_narrow) + 1;
-                if (required_bytes > static_cast<size_t>(std::numeric_limits<USHORT>::max()))
+                const int target_bytes = ::WideCharToMultiByte(
+                    code_page,
+                    0,
+                    target.data(),
+                    static_cast<int>(target.size()),
+                    nullptr,
+                    0,
+                    nullptr,
+                    nullptr);
+                if (target_bytes <= 0)
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    conversion_failed = true;
+                    return;
                 }
 
-                body.TargetLength = static_cast<USHORT>(required_bytes);
-                if (output->size() < required_bytes)
+                const size_t bytes_required = static_cast<size_t>(source_bytes) + 1 + static_cast<size_t>(target_bytes) + 1;
+                if (output->size() - written < bytes_required)
                 {
-                    message.set_reply_status(core::status_buffer_too_small);
-                    message.set_reply_information(body.TargetLength);
-                    return outcome;
+                    overflow = true;
+                    return;
                 }
 
-                if (required_narrow != 0)
+                auto* dest = reinterpret_cast<char*>(output->data() + written);
+                if (source_bytes != 0)
                 {
-                    const int converted = ::WideCharToMultiByte(
+                    const int converted_source = ::WideCharToMultiByte(
                         code_page,
                         0,
-                        target_view.data(),
-                        static_cast<int>(target_view.size()),
-                        reinterpret_cast<char*>(output->data()),
-                        required_narrow,
+                        source.data(),
+                        static_cast<int>(source.size()),
+                        dest,
+                        source_bytes,
                         nullptr,
                         nullptr);
-                    if (converted != required_narrow)
+                    if (converted_source != source_bytes)
                     {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
+                        conversion_failed = true;
+                        return;
+                    }
+                }
+                dest += source_bytes;
+                *dest++ = '=';
+                if (target_bytes != 0)
+                {
+                    const int converted_target = ::WideCharToMultiByte(
+                        code_page,
+                        0,
+                        target.data(),
+                        static_cast<int>(target.size()),
+                        dest,
+                        target_bytes,
+                        nullptr,
+                        nullptr);
+                    if (converted_target != target_bytes)
+                    {
+                        conversion_failed = true;
+                        return;
                     }
                 }
+                dest += target_bytes;
+                *dest++ = '\0';
 
-                reinterpret_cast<char*>(output->data())[required_narrow] = '\0';
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(body.TargetLength);
+                written += bytes_required;
+            });
+
+            if (conversion_failed)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetAliasesLength))
+            if (overflow)
             {
-                auto input = message.get_input_buffer();
-                if (!input)
+                message.set_reply_status(core::status_buffer_too_small);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            body.AliasesBufferLength =
+                written > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                ? std::numeric_limits<ULONG>::max()
+                : static_cast<ULONG>(written);
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(body.AliasesBufferLength);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_alias_exes_length(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleAliasExesLengthW;
+            body.AliasExesLength = 0;
+
+            const bool unicode = body.Unicode != FALSE;
+            const UINT code_page = static_cast<UINT>(state.output_code_page());
+
+            size_t total_bytes = 0;
+            bool conversion_failed = false;
+
+            state.for_each_alias_exe([&](const std::wstring_view exe_name) noexcept {
+                if (conversion_failed)
                 {
-                    return std::unexpected(input.error());
+                    return;
                 }
 
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleAliasesLengthW;
-                body.AliasesLength = 0;
+                if (unicode)
+                {
+                    total_bytes += (exe_name.size() + 1) * sizeof(wchar_t);
+                    return;
+                }
 
-                const bool unicode = body.Unicode != FALSE;
-                if (unicode && ((input->size() % sizeof(wchar_t)) != 0))
+                if (exe_name.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    conversion_failed = true;
+                    return;
                 }
 
-                const UINT code_page = static_cast<UINT>(state.output_code_page());
-                auto exe_decoded = decode_console_string(
-                    unicode,
-                    std::span<const std::byte>(input->data(), input->size()),
+                const int bytes_required = ::WideCharToMultiByte(
                     code_page,
-                    L"ConsolepGetAliasesLength exe name decode failed");
-                if (!exe_decoded)
+                    0,
+                    exe_name.data(),
+                    static_cast<int>(exe_name.size()),
+                    nullptr,
+                    0,
+                    nullptr,
+                    nullptr);
+                if (bytes_required <= 0)
                 {
-                    message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    conversion_failed = true;
+                    return;
                 }
 
-                auto exe_norm = fold_to_lower_invariant(*exe_decoded, L"ConsolepGetAliasesLength exe name fold failed");
-                if (!exe_norm)
+                total_bytes += static_cast<size_t>(bytes_required) + 1;
+            });
+
+            if (conversion_failed)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            body.AliasExesLength =
+                total_bytes > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                ? std::numeric_limits<ULONG>::max()
+                : static_cast<ULONG>(total_bytes);
+
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_alias_exes(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
+
+            auto output = message.get_output_buffer();
+            if (!output)
+            {
+                return std::unexpected(output.error());
+            }
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleAliasExesW;
+            body.AliasExesBufferLength = 0;
+
+            const bool unicode = body.Unicode != FALSE;
+            const UINT code_page = static_cast<UINT>(state.output_code_page());
+
+            size_t written = 0;
+            bool overflow = false;
+            bool conversion_failed = false;
+
+            state.for_each_alias_exe([&](const std::wstring_view exe_name) noexcept {
+                if (overflow || conversion_failed)
                 {
-                    message.set_reply_status(exe_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
-                    message.set_reply_information(0);
-                    return outcome;
+                    return;
                 }
 
-                size_t total_bytes = 0;
-                bool conversion_failed = false;
-
-                state.for_each_alias(exe_norm.value(), [&](const std::wstring_view source, const std::wstring_view target) noexcept {
-                    if (conversion_failed)
+                if (unicode)
+                {
+                    const size_t bytes_required = (exe_name.size() + 1) * sizeof(wchar_t);
+                    if (output->size() - written < bytes_required)
                     {
+                        overflow = true;
                         return;
                     }
 
-                    if (unicode)
+                    auto* dest = reinterpret_cast<wchar_t*>(output->data() + written);
+                    if (!exe_name.empty())
                     {
-                        const size_t required = (source.size() + 1 + target.size() + 1) * sizeof(wchar_t);
-                        total_bytes += required;
-                        return;
+                        std::memcpy(dest, exe_name.data(), exe_name.size() * sizeof(wchar_t));
                     }
+                    dest += exe_name.size();
+                    *dest++ = L'\0';
 
-                    if (source.size() > static_cast<size_t>(std::numeric_limits<int>::max()) ||
-                        target.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
-                    {
-                        conversion_failed = true;
-                        return;
-                    }
+                    written += bytes_required;
+                    return;
+                }
 
-                    const int source_bytes = ::WideCharToMultiByte(
-                        code_page,
-                        0,
-                        source.data(),
-                        static_cast<int>(source.size()),
-                        nullptr,
-                        0,
-                        nullptr,
-                        nullptr);
-                    if (source_bytes <= 0)
-                    {
-                        conversion_failed = true;
-                        return;
-                    }
+                if (exe_name.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
+                {
+                    conversion_failed = true;
+                    return;
+                }
+
+                const int name_bytes = ::WideCharToMultiByte(
+                    code_page,
+                    0,
+                    exe_name.data(),
+                    static_cast<int>(exe_name.size()),
+                    nullptr,
+                    0,
+                    nullptr,
+                    nullptr);
+                if (name_bytes <= 0)
+                {
+                    conversion_failed = true;
+                    return;
+                }
+
+                const size_t bytes_required = static_cast<size_t>(name_bytes) + 1;
+                if (output->size() - written < bytes_required)
+                {
+                    overflow = true;
+                    return;
+                }
 
-                    const int target_bytes = ::WideCharToMultiByte(
+                auto* dest = reinterpret_cast<char*>(output->data() + written);
+                if (name_bytes != 0)
+                {
+                    const int converted = ::WideCharToMultiByte(
                         code_page,
                         0,
-                        target.data(),
-                        static_cast<int>(target.size()),
-                        nullptr,
-                        0,
+                        exe_name.data(),
+                        static_cast<int>(exe_name.size()),
+                        dest,
+                        name_bytes,
                         nullptr,
                         nullptr);
-                    if (target_bytes <= 0)
+                    if (converted != name_bytes)
                     {
                         conversion_failed = true;
                         return;
                     }
-
-                    total_bytes += static_cast<size_t>(source_bytes);
-                    total_bytes += 1; // '='
-                    total_bytes += static_cast<size_t>(target_bytes);
-                    total_bytes += 1; // null terminator
-                });
-
-                if (conversion_failed)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
                 }
+                dest += name_bytes;
+                *dest++ = '\0';
 
-                body.AliasesLength =
-                    total_bytes > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                    ? std::numeric_limits<ULONG>::max()
-                    : static_cast<ULONG>(total_bytes);
+                written += bytes_required;
+            });
 
-                message.set_reply_status(core::status_success);
+            if (conversion_failed)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetAliases))
+            if (overflow)
             {
-                auto input = message.get_input_buffer();
-                if (!input)
-                {
-                    return std::unexpected(input.error());
-                }
-
-                auto output = message.get_output_buffer();
-                if (!output)
-                {
-                    return std::unexpected(output.error());
-                }
-
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleAliasesW;
-                body.AliasesBufferLength = 0;
+                message.set_reply_status(core::status_buffer_too_small);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                const bool unicode = body.Unicode != FALSE;
-                if (unicode && ((input->size() % sizeof(wchar_t)) != 0))
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            body.AliasExesBufferLength =
+                written > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                ? std::numeric_limits<ULONG>::max()
+                : static_cast<ULONG>(written);
 
-                const UINT code_page = static_cast<UINT>(state.output_code_page());
-                auto exe_decoded = decode_console_string(
-                    unicode,
-                    std::span<const std::byte>(input->data(), input->size()),
-                    code_page,
-                    L"ConsolepGetAliases exe name decode failed");
-                if (!exe_decoded)
-                {
-                    message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(body.AliasExesBufferLength);
+            return outcome;
+        }
 
-                auto exe_norm = fold_to_lower_invariant(*exe_decoded, L"ConsolepGetAliases exe name fold failed");
-                if (!exe_norm)
-                {
-                    message.set_reply_status(exe_norm.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_unsuccessful);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_history(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
 
-                size_t written = 0;
-                bool overflow = false;
-                bool conversion_failed = false;
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleHistory;
+            body.HistoryBufferSize = state.history_buffer_size();
+            body.NumberOfHistoryBuffers = state.history_buffer_count();
+            body.dwFlags = state.history_flags();
 
-                state.for_each_alias(exe_norm.value(), [&](const std::wstring_view source, const std::wstring_view target) noexcept {
-                    if (overflow || conversion_failed)
-                    {
-                        return;
-                    }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                    if (unicode)
-                    {
-                        const size_t bytes_required = (source.size() + 1 + target.size() + 1) * sizeof(wchar_t);
-                        if (output->size() - written < bytes_required)
-                        {
-                            overflow = true;
-                            return;
-                        }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_history(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
 
-                        auto* dest = reinterpret_cast<wchar_t*>(output->data() + written);
-                        if (!source.empty())
-                        {
-                            std::memcpy(dest, source.data(), source.size() * sizeof(wchar_t));
-                        }
-                        dest += source.size();
-                        *dest++ = L'=';
-                        if (!target.empty())
-                        {
-                            std::memcpy(dest, target.data(), target.size() * sizeof(wchar_t));
-                        }
-                        dest += target.size();
-                        *dest++ = L'\0';
+            const auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleHistory;
+            state.set_history_info(body.HistoryBufferSize, body.NumberOfHistoryBuffers, body.dwFlags);
 
-                        written += bytes_required;
-                        return;
-                    }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                    if (source.size() > static_cast<size_t>(std::numeric_limits<int>::max()) ||
-                        target.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
-                    {
-                        conversion_failed = true;
-                        return;
-                    }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_expunge_command_history(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
 
-                    const int source_bytes = ::WideCharToMultiByte(
-                        code_page,
-                        0,
-                        source.data(),
-                        static_cast<int>(source.size()),
-                        nullptr,
-                        0,
-                        nullptr,
-                        nullptr);
-                    if (source_bytes <= 0)
-                    {
-                        conversion_failed = true;
-                        return;
-                    }
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
+            }
 
-                    const int target_bytes = ::WideCharToMultiByte(
-                        code_page,
-                        0,
-                        target.data(),
-                        static_cast<int>(target.size()),
-                        nullptr,
-                        0,
-                        nullptr,
-                        nullptr);
-                    if (target_bytes <= 0)
-                    {
-                        conversion_failed = true;
-                        return;
-                    }
+            const auto& body = packet.payload.user_defined.u.console_msg_l3.ExpungeConsoleCommandHistoryW;
+            const bool unicode = body.Unicode != FALSE;
+            const UINT code_page = static_cast<UINT>(state.output_code_page());
 
-                    const size_t bytes_required = static_cast<size_t>(source_bytes) + 1 + static_cast<size_t>(target_bytes) + 1;
-                    if (output->size() - written < bytes_required)
-                    {
-                        overflow = true;
-                        return;
-                    }
+            auto exe_decoded = decode_console_string(
+                unicode,
+                std::span<const std::byte>(input->data(), input->size()),
+                code_page,
+                L"ConsolepExpungeCommandHistory exe name decode failed");
+            if (!exe_decoded)
+            {
+                message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                    auto* dest = reinterpret_cast<char*>(output->data() + written);
-                    if (source_bytes != 0)
-                    {
-                        const int converted_source = ::WideCharToMultiByte(
-                            code_page,
-                            0,
-                            source.data(),
-                            static_cast<int>(source.size()),
-                            dest,
-                            source_bytes,
-                            nullptr,
-                            nullptr);
-                        if (converted_source != source_bytes)
-                        {
-                            conversion_failed = true;
-                            return;
-                        }
-                    }
-                    dest += source_bytes;
-                    *dest++ = '=';
-                    if (target_bytes != 0)
-                    {
-                        const int converted_target = ::WideCharToMultiByte(
-                            code_page,
-                            0,
-                            target.data(),
-                            static_cast<int>(target.size()),
-                            dest,
-                            target_bytes,
-                            nullptr,
-                            nullptr);
-                        if (converted_target != target_bytes)
-                        {
-                            conversion_failed = true;
-                            return;
-                        }
-                    }
-                    dest += target_bytes;
-                    *dest++ = '\0';
+            while (!exe_decoded->empty() && exe_decoded->back() == L'\0')
+            {
+                exe_decoded->pop_back();
+            }
 
-                    written += bytes_required;
-                });
+            state.expunge_command_history(*exe_decoded);
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                if (conversion_failed)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_set_number_of_commands(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
 
-                if (overflow)
-                {
-                    message.set_reply_status(core::status_buffer_too_small);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
+            }
 
-                body.AliasesBufferLength =
-                    written > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                    ? std::numeric_limits<ULONG>::max()
-                    : static_cast<ULONG>(written);
+            const auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleNumberOfCommandsW;
+            const bool unicode = body.Unicode != FALSE;
+            const UINT code_page = static_cast<UINT>(state.output_code_page());
 
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(body.AliasesBufferLength);
+            auto exe_decoded = decode_console_string(
+                unicode,
+                std::span<const std::byte>(input->data(), input->size()),
+                code_page,
+                L"ConsolepSetNumberOfCommands exe name decode failed");
+            if (!exe_decoded)
+            {
+                message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
+                message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetAliasExesLength))
+            while (!exe_decoded->empty() && exe_decoded->back() == L'\0')
             {
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleAliasExesLengthW;
-                body.AliasExesLength = 0;
+                exe_decoded->pop_back();
+            }
 
-                const bool unicode = body.Unicode != FALSE;
-                const UINT code_page = static_cast<UINT>(state.output_code_page());
+            state.set_command_history_number_of_commands(*exe_decoded, static_cast<size_t>(body.NumCommands));
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                size_t total_bytes = 0;
-                bool conversion_failed = false;
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_command_history_length(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
 
-                state.for_each_alias_exe([&](const std::wstring_view exe_name) noexcept {
-                    if (conversion_failed)
-                    {
-                        return;
-                    }
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
+            }
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleCommandHistoryLengthW;
+            const bool unicode = body.Unicode != FALSE;
+            const UINT code_page = static_cast<UINT>(state.output_code_page());
+
+            auto exe_decoded = decode_console_string(
+                unicode,
+                std::span<const std::byte>(input->data(), input->size()),
+                code_page,
+                L"ConsolepGetCommandHistoryLength exe name decode failed");
+            if (!exe_decoded)
+            {
+                message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            while (!exe_decoded->empty() && exe_decoded->back() == L'\0')
+            {
+                exe_decoded->pop_back();
+            }
 
+            size_t length_bytes = 0;
+            if (const auto* history = state.try_command_history_for_exe(*exe_decoded))
+            {
+                for (const auto& command : history->commands())
+                {
+                    size_t entry_bytes = 0;
                     if (unicode)
                     {
-                        total_bytes += (exe_name.size() + 1) * sizeof(wchar_t);
-                        return;
+                        const size_t units = command.size() + 1;
+                        if (units > (std::numeric_limits<size_t>::max() / sizeof(wchar_t)))
+                        {
+                            message.set_reply_status(core::status_invalid_parameter);
+                            message.set_reply_information(0);
+                            return outcome;
+                        }
+                        entry_bytes = units * sizeof(wchar_t);
                     }
-
-                    if (exe_name.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
+                    else
                     {
-                        conversion_failed = true;
-                        return;
+                        const int required = ::WideCharToMultiByte(
+                            code_page,
+                            0,
+                            command.data(),
+                            static_cast<int>(command.size()),
+                            nullptr,
+                            0,
+                            nullptr,
+                            nullptr);
+                        if (required <= 0)
+                        {
+                            message.set_reply_status(core::status_invalid_parameter);
+                            message.set_reply_information(0);
+                            return outcome;
+                        }
+
+                        entry_bytes = static_cast<size_t>(required) + 1;
                     }
 
-                    const int bytes_required = ::WideCharToMultiByte(
-                        code_page,
-                        0,
-                        exe_name.data(),
-                        static_cast<int>(exe_name.size()),
-                        nullptr,
-                        0,
-                        nullptr,
-                        nullptr);
-                    if (bytes_required <= 0)
+                    if (length_bytes > std::numeric_limits<size_t>::max() - entry_bytes)
                     {
-                        conversion_failed = true;
-                        return;
+                        message.set_reply_status(core::status_invalid_parameter);
+                        message.set_reply_information(0);
+                        return outcome;
                     }
+                    length_bytes += entry_bytes;
+                }
+            }
 
-                    total_bytes += static_cast<size_t>(bytes_required) + 1;
-                });
+            if (length_bytes > static_cast<size_t>(std::numeric_limits<ULONG>::max()))
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                if (conversion_failed)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+            body.CommandHistoryLength = static_cast<ULONG>(length_bytes);
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(0);
+            return outcome;
+        }
 
-                body.AliasExesLength =
-                    total_bytes > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                    ? std::numeric_limits<ULONG>::max()
-                    : static_cast<ULONG>(total_bytes);
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_command_history(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& packet = context.packet;
+            DispatchOutcome outcome{};
 
-                message.set_reply_status(core::status_success);
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
+            }
+
+            auto output = message.get_output_buffer();
+            if (!output)
+            {
+                return std::unexpected(output.error());
+            }
+
+            auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleCommandHistoryW;
+            const bool unicode = body.Unicode != FALSE;
+            const UINT code_page = static_cast<UINT>(state.output_code_page());
+
+            auto exe_decoded = decode_console_string(
+                unicode,
+                std::span<const std::byte>(input->data(), input->size()),
+                code_page,
+                L"ConsolepGetCommandHistory exe name decode failed");
+            if (!exe_decoded)
+            {
+                message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetAliasExes))
+            while (!exe_decoded->empty() && exe_decoded->back() == L'\0')
             {
-                auto output = message.get_output_buffer();
-                if (!output)
-                {
-                    return std::unexpected(output.error());
-                }
-
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleAliasExesW;
-                body.AliasExesBufferLength = 0;
+                exe_decoded->pop_back();
+            }
 
-                const bool unicode = body.Unicode != FALSE;
-                const UINT code_page = static_cast<UINT>(state.output_code_page());
+            const auto* history = state.try_command_history_for_exe(*exe_decoded);
 
-                size_t written = 0;
-                bool overflow = false;
-                bool conversion_failed = false;
+            size_t bytes_written = 0;
+            if (unicode)
+            {
+                if ((output->size() % sizeof(wchar_t)) != 0)
+                {
+                    message.set_reply_status(core::status_invalid_parameter);
+                    message.set_reply_information(0);
+                    return outcome;
+                }
 
-                state.for_each_alias_exe([&](const std::wstring_view exe_name) noexcept {
-                    if (overflow || conversion_failed)
-                    {
-                        return;
-                    }
+                auto* dest = reinterpret_cast<wchar_t*>(output->data());
+                const size_t capacity_units = output->size() / sizeof(wchar_t);
+                size_t written_units = 0;
 
-                    if (unicode)
+                if (history != nullptr)
+                {
+                    for (const auto& command : history->commands())
                     {
-                        const size_t bytes_required = (exe_name.size() + 1) * sizeof(wchar_t);
-                        if (output->size() - written < bytes_required)
+                        const size_t needed = command.size() + 1;
+                        if (written_units + needed > capacity_units)
                         {
-                            overflow = true;
-                            return;
+                            message.set_reply_status(core::status_buffer_too_small);
+                            message.set_reply_information(0);
+                            return outcome;
                         }
 
-                        auto* dest = reinterpret_cast<wchar_t*>(output->data() + written);
-                        if (!exe_name.empty())
+                        if (!command.empty())
                         {
-                            std::memcpy(dest, exe_name.data(), exe_name.size() * sizeof(wchar_t));
+                            std::memcpy(dest + written_units, command.data(), command.size() * sizeof(wchar_t));
                         }
-                        dest += exe_name.size();
-                        *dest++ = L'\0';
-
-                        written += bytes_required;
-                        return;
-                    }
-
-                    if (exe_name.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
-                    {
-                        conversion_failed = true;
-                        return;
-                    }
-
-                    const int name_bytes = ::WideCharToMultiByte(
-                        code_page,
-                        0,
-                        exe_name.data(),
-                        static_cast<int>(exe_name.size()),
-                        nullptr,
-                        0,
-                        nullptr,
-                        nullptr);
-                    if (name_bytes <= 0)
-                    {
-                        conversion_failed = true;
-                        return;
+                        dest[written_units + command.size()] = L'\0';
+                        written_units += needed;
                     }
+                }
 
-                    const size_t bytes_required = static_cast<size_t>(name_bytes) + 1;
-                    if (output->size() - written < bytes_required)
-                    {
-                        overflow = true;
-                        return;
-                    }
+                bytes_written = written_units * sizeof(wchar_t);
+            }
+            else
+            {
+                auto* dest = reinterpret_cast<char*>(output->data());
+                const size_t capacity = output->size();
 
-                    auto* dest = reinterpret_cast<char*>(output->data() + written);
-                    if (name_bytes != 0)
+                if (history != nullptr)
+                {
+                    for (const auto& command : history->commands())
                     {
-                        const int converted = ::WideCharToMultiByte(
+                        const int required = ::WideCharToMultiByte(
                             code_page,
                             0,
-                            exe_name.data(),
-                            static_cast<int>(exe_name.size()),
-                            dest,
-                            name_bytes,
+                            command.data(),
+                            static_cast<int>(command.size()),
+                            nullptr,
+                            0,
                             nullptr,
                             nullptr);
-                        if (converted != name_bytes)
+                        if (required <= 0)
                         {
-                            conversion_failed = true;
-                            return;
+                            message.set_reply_status(core::status_invalid_parameter);
+                            message.set_reply_information(0);
+                            return outcome;
                         }
-                    }
-                    dest += name_bytes;
-                    *dest++ = '\0';
 
-                    written += bytes_required;
-                });
+                        const size_t bytes_required = static_cast<size_t>(required);
+                        const size_t needed = bytes_required + 1;
+                        if (bytes_written + needed > capacity)
+                        {
+                            message.set_reply_status(core::status_buffer_too_small);
+                            message.set_reply_information(0);
+                            return outcome;
+                        }
 
-                if (conversion_failed)
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                        if (bytes_required != 0)
+                        {
+                            const int converted = ::WideCharToMultiByte(
+                                code_page,
+                                0,
+                                command.data(),
+                                static_cast<int>(command.size()),
+                                dest + bytes_written,
+                                required,
+                                nullptr,
+                                nullptr);
+                            if (converted != required)
+                            {
+                                message.set_reply_status(core::status_invalid_parameter);
+                                message.set_reply_information(0);
+                                return outcome;
+                            }
+                        }
 
-                if (overflow)
-                {
-                    message.set_reply_status(core::status_buffer_too_small);
-                    message.set_reply_information(0);
-                    return outcome;
+                        dest[bytes_written + bytes_required] = '\0';
+                        bytes_written += needed;
+                    }
                 }
+            }
 
-                body.AliasExesBufferLength =
-                    written > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                    ? std::numeric_limits<ULONG>::max()
-                    : static_cast<ULONG>(written);
+            if (bytes_written > static_cast<size_t>(std::numeric_limits<ULONG>::max()))
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(body.AliasExesBufferLength);
+            body.CommandBufferLength = static_cast<ULONG>(bytes_written);
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(body.CommandBufferLength);
+            return outcome;
+        }
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_get_console_input(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& host_io = context.host_io;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::input)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetHistory))
+            auto output = message.get_output_buffer();
+            if (!output)
             {
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleHistory;
-                body.HistoryBufferSize = state.history_buffer_size();
-                body.NumberOfHistoryBuffers = state.history_buffer_count();
-                body.dwFlags = state.history_flags();
+                return std::unexpected(output.error());
+            }
 
-                message.set_reply_status(core::status_success);
+            auto& body = packet.payload.user_defined.u.console_msg_l1.GetConsoleInput;
+            body.NumRecords = 0;
+
+            if ((body.Flags & static_cast<USHORT>(~CONSOLE_READ_VALID)) != 0)
+            {
+                message.set_reply_status(core::status_invalid_parameter);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetHistory))
+            const size_t capacity = output->size() / sizeof(INPUT_RECORD);
+            if (capacity == 0)
             {
-                const auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleHistory;
-                state.set_history_info(body.HistoryBufferSize, body.NumberOfHistoryBuffers, body.dwFlags);
-
                 message.set_reply_status(core::status_success);
                 message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepExpungeCommandHistory))
+            const bool is_peek = (body.Flags & CONSOLE_READ_NOREMOVE) != 0;
+            const bool wait_allowed = (body.Flags & CONSOLE_READ_NOWAIT) == 0;
+            const bool processed_input = (state.input_mode() & ENABLE_PROCESSED_INPUT) != 0;
+
+            // `ConsolepGetConsoleInput` models input as a byte stream. UTF-8/DBCS sequences can be split
+            // across reads, so the queue can temporarily contain bytes that cannot be decoded into an
+            // `INPUT_RECORD` yet. We drain such prefixes into a per-handle buffer so reply-pending reads
+            // can resume once more bytes arrive without leaving an undecodable prefix in the shared queue.
+            auto& pending_prefix = handle->pending_input_bytes;
+
+            const auto forward_ctrl_c = [&]() noexcept {
+                state.for_each_process([&](const ProcessState& process) noexcept {
+                    (void)host_io.send_end_task(
+                        process.pid,
+                        CTRL_C_EVENT,
+                        static_cast<DWORD>(core::console_ctrl_c_flag));
+                });
+            };
+
+            const auto forward_ctrl_break = [&]() noexcept {
+                state.for_each_process([&](const ProcessState& process) noexcept {
+                    (void)host_io.send_end_task(
+                        process.pid,
+                        CTRL_BREAK_EVENT,
+                        static_cast<DWORD>(core::console_ctrl_break_flag));
+                });
+            };
+
+            // In processed input mode Ctrl+C is a control event, not an input record.
+            // If it is at the front of the byte queue, consume it immediately so
+            // it never appears in peek/remove reads.
+            if (processed_input)
+            {
+                for (;;)
+                {
+                    if (host_io.input_bytes_available() == 0)
+                    {
+                        break;
+                    }
+
+                    std::array<std::byte, 1> first{};
+                    auto peeked = host_io.peek_input_bytes(first);
+                    if (!peeked)
+                    {
+                        return std::unexpected(peeked.error());
+                    }
+
+                    if (peeked.value() != 1 || first[0] != static_cast<std::byte>(0x03))
+                    {
+                        break;
+                    }
+
+                    auto removed = host_io.read_input_bytes(first);
+                    if (!removed)
+                    {
+                        return std::unexpected(removed.error());
+                    }
+
+                    if (removed.value() != 1)
+                    {
+                        break;
+                    }
+
+                    // Ctrl+C is processed at input time in the inbox host. Our
+                    // byte-stream model forwards it when we observe it to avoid
+                    // leaving stale control bytes in the queue.
+                    forward_ctrl_c();
+                }
+            }
+
+            std::vector<std::byte> input_bytes;
+
+            auto* records = reinterpret_cast<INPUT_RECORD*>(output->data());
+            const UINT code_page = static_cast<UINT>(state.input_code_page());
+
+            size_t records_written = 0;
+            size_t bytes_consumed = 0;
+            size_t ctrl_c_count = 0;
+            size_t ctrl_break_count = 0;
+
+            for (;;)
             {
-                auto input = message.get_input_buffer();
-                if (!input)
+                records_written = 0;
+                bytes_consumed = 0;
+                ctrl_c_count = 0;
+                ctrl_break_count = 0;
+
+                if (wait_allowed &&
+                    !handle->decoded_input_pending &&
+                    pending_prefix.empty() &&
+                    host_io.input_bytes_available() == 0)
                 {
-                    return std::unexpected(input.error());
+                    if (host_io.input_disconnected())
+                    {
+                        message.set_reply_status(core::status_unsuccessful);
+                        message.set_reply_information(0);
+                        return outcome;
+                    }
+
+                    outcome.reply_pending = true;
+                    return outcome;
                 }
 
-                const auto& body = packet.payload.user_defined.u.console_msg_l3.ExpungeConsoleCommandHistoryW;
-                const bool unicode = body.Unicode != FALSE;
-                const UINT code_page = static_cast<UINT>(state.output_code_page());
+                const size_t available_bytes = host_io.input_bytes_available();
+                constexpr size_t peek_limit = 64 * 1024;
+                constexpr size_t max_bytes_per_token = 64;
+                const size_t max_needed = capacity > (std::numeric_limits<size_t>::max() / max_bytes_per_token)
+                    ? std::numeric_limits<size_t>::max()
+                    : capacity * max_bytes_per_token;
+                const size_t to_peek = std::min(available_bytes, std::min(max_needed, peek_limit));
 
-                auto exe_decoded = decode_console_string(
-                    unicode,
-                    std::span<const std::byte>(input->data(), input->size()),
-                    code_page,
-                    L"ConsolepExpungeCommandHistory exe name decode failed");
-                if (!exe_decoded)
+                const size_t pending_byte_count = pending_prefix.size();
+
+                try
+                {
+                    input_bytes.resize(pending_byte_count + to_peek);
+                }
+                catch (...)
                 {
-                    message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
+                    message.set_reply_status(core::status_no_memory);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                while (!exe_decoded->empty() && exe_decoded->back() == L'\0')
+                if (pending_byte_count != 0)
                 {
-                    exe_decoded->pop_back();
+                    const auto prefix = pending_prefix.bytes();
+                    std::memcpy(input_bytes.data(), prefix.data(), pending_byte_count);
                 }
 
-                state.expunge_command_history(*exe_decoded);
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(0);
-                return outcome;
-            }
+                size_t queue_byte_count = 0;
+                if (to_peek != 0)
+                {
+                    auto read = host_io.peek_input_bytes(std::span<std::byte>(input_bytes.data() + pending_byte_count, to_peek));
+                    if (!read)
+                    {
+                        return std::unexpected(read.error());
+                    }
+                    queue_byte_count = read.value();
+                }
 
-            if (api_number == static_cast<ULONG>(ConsolepSetNumberOfCommands))
-            {
-                auto input = message.get_input_buffer();
-                if (!input)
+                const size_t byte_count = pending_byte_count + queue_byte_count;
+
+                size_t offset = 0;
+
+                if (handle->decoded_input_pending)
                 {
-                    return std::unexpected(input.error());
+                    const wchar_t value = *handle->decoded_input_pending;
+                    const auto key = make_simple_character_key_event(value);
+                    records[records_written] = make_input_record_from_key(key, body.Unicode != FALSE);
+                    ++records_written;
+
+                    if (!is_peek)
+                    {
+                        handle->decoded_input_pending.reset();
+                    }
                 }
 
-                const auto& body = packet.payload.user_defined.u.console_msg_l3.SetConsoleNumberOfCommandsW;
-                const bool unicode = body.Unicode != FALSE;
-                const UINT code_page = static_cast<UINT>(state.output_code_page());
+                while (records_written < capacity && offset < byte_count)
+                {
+                    vt_input::DecodedToken token{};
+                    const auto decode_outcome = decode_one_input_token(
+                        code_page,
+                        std::span<const std::byte>(input_bytes.data() + offset, byte_count - offset),
+                        token);
+                    if (decode_outcome == InputDecodeOutcome::need_more_data)
+                    {
+                        break;
+                    }
+
+                    if (token.bytes_consumed == 0)
+                    {
+                        break;
+                    }
+
+                    if (token.kind == vt_input::TokenKind::ignored_sequence)
+                    {
+                        offset += token.bytes_consumed;
+                        bytes_consumed = offset;
+                        continue;
+                    }
+
+                    if (token.kind == vt_input::TokenKind::key_event)
+                    {
+                        if (processed_input && key_event_matches_ctrl_break(token.key))
+                        {
+                            offset += token.bytes_consumed;
+                            bytes_consumed = offset;
+
+                            if (token.key.bKeyDown)
+                            {
+                                // Ctrl+Break flushes the input buffer and is not delivered as an input record.
+                                ++ctrl_break_count;
+                                records_written = 0;
+                                break;
+                            }
+
+                            continue;
+                        }
+
+                        if (processed_input && key_event_matches_ctrl_c(token.key))
+                        {
+                            if (token.key.bKeyDown)
+                            {
+                                ++ctrl_c_count;
+                            }
+                            offset += token.bytes_consumed;
+                            bytes_consumed = offset;
+                            continue;
+                        }
+
+                        records[records_written] = make_input_record_from_key(token.key, body.Unicode != FALSE);
+                        ++records_written;
+                        offset += token.bytes_consumed;
+                        bytes_consumed = offset;
+                        continue;
+                    }
+
+                    const auto& text = token.text;
+                    if (text.bytes_consumed == 0 || text.char_count == 0)
+                    {
+                        break;
+                    }
 
-                auto exe_decoded = decode_console_string(
-                    unicode,
-                    std::span<const std::byte>(input->data(), input->size()),
-                    code_page,
-                    L"ConsolepSetNumberOfCommands exe name decode failed");
-                if (!exe_decoded)
-                {
-                    message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                    if (processed_input && text.char_count == 1 && text.chars[0] == static_cast<wchar_t>(0x0003))
+                    {
+                        ++ctrl_c_count;
+                        offset += token.bytes_consumed;
+                        bytes_consumed = offset;
+                        continue;
+                    }
 
-                while (!exe_decoded->empty() && exe_decoded->back() == L'\0')
-                {
-                    exe_decoded->pop_back();
-                }
+                    const size_t remaining_capacity = capacity - records_written;
+                    if (text.char_count > remaining_capacity)
+                    {
+                        if (text.char_count == 2 && remaining_capacity == 1)
+                        {
+                            const auto key = make_simple_character_key_event(text.chars[0]);
+                            records[records_written] = make_input_record_from_key(key, body.Unicode != FALSE);
+                            ++records_written;
 
-                state.set_command_history_number_of_commands(*exe_decoded, static_cast<size_t>(body.NumCommands));
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(0);
-                return outcome;
-            }
+                            if (!is_peek)
+                            {
+                                handle->decoded_input_pending = text.chars[1];
+                                offset += token.bytes_consumed;
+                                bytes_consumed = offset;
+                            }
+                        }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetCommandHistoryLength))
-            {
-                auto input = message.get_input_buffer();
-                if (!input)
-                {
-                    return std::unexpected(input.error());
-                }
+                        break;
+                    }
 
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleCommandHistoryLengthW;
-                const bool unicode = body.Unicode != FALSE;
-                const UINT code_page = static_cast<UINT>(state.output_code_page());
+                    for (size_t i = 0; i < text.char_count; ++i)
+                    {
+                        const auto key = make_simple_character_key_event(text.chars[i]);
+                        records[records_written + i] = make_input_record_from_key(key, body.Unicode != FALSE);
+                    }
 
-                auto exe_decoded = decode_console_string(
-                    unicode,
-                    std::span<const std::byte>(input->data(), input->size()),
-                    code_page,
-                    L"ConsolepGetCommandHistoryLength exe name decode failed");
-                if (!exe_decoded)
-                {
-                    message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    records_written += text.char_count;
+                    offset += token.bytes_consumed;
+                    bytes_consumed = offset;
                 }
 
-                while (!exe_decoded->empty() && exe_decoded->back() == L'\0')
+                if (!is_peek && wait_allowed && records_written == 0 && bytes_consumed == 0)
                 {
-                    exe_decoded->pop_back();
-                }
+                    if (host_io.input_disconnected())
+                    {
+                        message.set_reply_status(core::status_unsuccessful);
+                        message.set_reply_information(0);
+                        return outcome;
+                    }
 
-                size_t length_bytes = 0;
-                if (const auto* history = state.try_command_history_for_exe(*exe_decoded))
-                {
-                    for (const auto& command : history->commands())
+                    if (byte_count == 0)
                     {
-                        size_t entry_bytes = 0;
-                        if (unicode)
-                        {
-                            const size_t units = command.size() + 1;
-                            if (units > (std::numeric_limits<size_t>::max() / sizeof(wchar_t)))
-                            {
-                                message.set_reply_status(core::status_invalid_parameter);
-                                message.set_reply_information(0);
-                                return outcome;
-                            }
-                            entry_bytes = units * sizeof(wchar_t);
-                        }
-                        else
+                        outcome.reply_pending = true;
+                        return outcome;
+                    }
+
+                    vt_input::DecodedToken head{};
+                    const auto head_outcome = decode_one_input_token(
+                        code_page,
+                        std::span<const std::byte>(input_bytes.data(), byte_count),
+                        head);
+                    if (head_outcome == InputDecodeOutcome::need_more_data)
+                    {
+                        if (queue_byte_count != 0)
                         {
-                            const int required = ::WideCharToMultiByte(
-                                code_page,
-                                0,
-                                command.data(),
-                                static_cast<int>(command.size()),
-                                nullptr,
-                                0,
-                                nullptr,
-                                nullptr);
-                            if (required <= 0)
+                            const size_t pending_before = pending_prefix.size();
+                            const auto drained = std::span<const std::byte>(
+                                input_bytes.data() + pending_before,
+                                queue_byte_count);
+                            if (pending_prefix.append(drained))
                             {
-                                message.set_reply_status(core::status_invalid_parameter);
-                                message.set_reply_information(0);
-                                return outcome;
-                            }
+                                size_t remaining_to_discard = queue_byte_count;
+                                std::array<std::byte, 16> discard{};
+                                while (remaining_to_discard != 0)
+                                {
+                                    const size_t discard_count = std::min(remaining_to_discard, discard.size());
+                                    auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
+                                    if (!removed)
+                                    {
+                                        return std::unexpected(removed.error());
+                                    }
 
-                            entry_bytes = static_cast<size_t>(required) + 1;
-                        }
+                                    if (removed.value() == 0)
+                                    {
+                                        break;
+                                    }
 
-                        if (length_bytes > std::numeric_limits<size_t>::max() - entry_bytes)
-                        {
-                            message.set_reply_status(core::status_invalid_parameter);
-                            message.set_reply_information(0);
-                            return outcome;
+                                    remaining_to_discard -= removed.value();
+                                }
+                            }
                         }
-                        length_bytes += entry_bytes;
+
+                        outcome.reply_pending = true;
+                        return outcome;
                     }
                 }
 
-                if (length_bytes > static_cast<size_t>(std::numeric_limits<ULONG>::max()))
+                if (!is_peek && bytes_consumed != 0)
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                    const size_t pending_before = pending_prefix.size();
+                    const size_t pending_consumed = std::min(bytes_consumed, pending_before);
+                    pending_prefix.consume_prefix(pending_consumed);
 
-                body.CommandHistoryLength = static_cast<ULONG>(length_bytes);
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(0);
-                return outcome;
-            }
+                    size_t remaining_to_discard = bytes_consumed - pending_consumed;
+                    std::array<std::byte, 256> discard{};
+                    while (remaining_to_discard != 0)
+                    {
+                        const size_t chunk = std::min(remaining_to_discard, discard.size());
+                        auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), chunk));
+                        if (!removed)
+                        {
+                            return std::unexpected(removed.error());
+                        }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetCommandHistory))
-            {
-                auto input = message.get_input_buffer();
-                if (!input)
-                {
-                    return std::unexpected(input.error());
+                        if (removed.value() == 0)
+                        {
+                            break;
+                        }
+
+                        remaining_to_discard -= removed.value();
+                    }
                 }
 
-                auto output = message.get_output_buffer();
-                if (!output)
+                if (processed_input && ctrl_break_count != 0)
                 {
-                    return std::unexpected(output.error());
-                }
+                    if (auto flushed = host_io.flush_input_buffer(); !flushed)
+                    {
+                        return std::unexpected(flushed.error());
+                    }
 
-                auto& body = packet.payload.user_defined.u.console_msg_l3.GetConsoleCommandHistoryW;
-                const bool unicode = body.Unicode != FALSE;
-                const UINT code_page = static_cast<UINT>(state.output_code_page());
+                    handle->decoded_input_pending.reset();
+                    pending_prefix.clear();
+                    handle->cooked_read_pending.clear();
+                    handle->cooked_line_in_progress.clear();
 
-                auto exe_decoded = decode_console_string(
-                    unicode,
-                    std::span<const std::byte>(input->data(), input->size()),
-                    code_page,
-                    L"ConsolepGetCommandHistory exe name decode failed");
-                if (!exe_decoded)
-                {
-                    message.set_reply_status(exe_decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+                    for (size_t i = 0; i < ctrl_break_count; ++i)
+                    {
+                        forward_ctrl_break();
+                    }
                 }
 
-                while (!exe_decoded->empty() && exe_decoded->back() == L'\0')
+                if (!is_peek && ctrl_c_count != 0)
                 {
-                    exe_decoded->pop_back();
+                    for (size_t i = 0; i < ctrl_c_count; ++i)
+                    {
+                        forward_ctrl_c();
+                    }
                 }
 
-                const auto* history = state.try_command_history_for_exe(*exe_decoded);
-
-                size_t bytes_written = 0;
-                if (unicode)
+                if (!is_peek && wait_allowed && records_written == 0)
                 {
-                    if ((output->size() % sizeof(wchar_t)) != 0)
+                    if (host_io.input_disconnected())
                     {
-                        message.set_reply_status(core::status_invalid_parameter);
+                        message.set_reply_status(core::status_unsuccessful);
                         message.set_reply_information(0);
                         return outcome;
                     }
 
-                    auto* dest = reinterpret_cast<wchar_t*>(output->data());
-                    const size_t capacity_units = output->size() / sizeof(wchar_t);
-                    size_t written_units = 0;
-
-                    if (history != nullptr)
+                    if (host_io.input_bytes_available() == 0 &&
+                        pending_prefix.empty() &&
+                        !handle->decoded_input_pending)
                     {
-                        for (const auto& command : history->commands())
-                        {
-                            const size_t needed = command.size() + 1;
-                            if (written_units + needed > capacity_units)
-                            {
-                                message.set_reply_status(core::status_buffer_too_small);
-                                message.set_reply_information(0);
-                                return outcome;
-                            }
-
-                            if (!command.empty())
-                            {
-                                std::memcpy(dest + written_units, command.data(), command.size() * sizeof(wchar_t));
-                            }
-                            dest[written_units + command.size()] = L'\0';
-                            written_units += needed;
-                        }
+                        outcome.reply_pending = true;
+                        return outcome;
                     }
 
-                    bytes_written = written_units * sizeof(wchar_t);
+                    if (bytes_consumed != 0)
+                    {
+                        // We consumed only ignored sequences/processed Ctrl+C markers. Retry now that the head changed.
+                        continue;
+                    }
                 }
-                else
-                {
-                    auto* dest = reinterpret_cast<char*>(output->data());
-                    const size_t capacity = output->size();
 
-                    if (history != nullptr)
-                    {
-                        for (const auto& command : history->commands())
-                        {
-                            const int required = ::WideCharToMultiByte(
-                                code_page,
-                                0,
-                                command.data(),
-                                static_cast<int>(command.size()),
-                                nullptr,
-                                0,
-                                nullptr,
-                                nullptr);
-                            if (required <= 0)
-                            {
-                                message.set_reply_status(core::status_invalid_parameter);
-                                message.set_reply_information(0);
-                                return outcome;
-                            }
+                break;
+            }
 
-                            const size_t bytes_required = static_cast<size_t>(required);
-                            const size_t needed = bytes_required + 1;
-                            if (bytes_written + needed > capacity)
-                            {
-                                message.set_reply_status(core::status_buffer_too_small);
-                                message.set_reply_information(0);
-                                return outcome;
-                            }
+            body.NumRecords = records_written > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                ? std::numeric_limits<ULONG>::max()
+                : static_cast<ULONG>(records_written);
 
-                            if (bytes_required != 0)
-                            {
-                                const int converted = ::WideCharToMultiByte(
-                                    code_page,
-                                    0,
-                                    command.data(),
-                                    static_cast<int>(command.size()),
-                                    dest + bytes_written,
-                                    required,
-                                    nullptr,
-                                    nullptr);
-                                if (converted != required)
-                                {
-                                    message.set_reply_status(core::status_invalid_parameter);
-                                    message.set_reply_information(0);
-                                    return outcome;
-                                }
-                            }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(static_cast<ULONG_PTR>(records_written * sizeof(INPUT_RECORD)));
+            return outcome;
+        }
 
-                            dest[bytes_written + bytes_required] = '\0';
-                            bytes_written += needed;
-                        }
-                    }
+        // Brings `screen_buffer` up to date with output the host has already forwarded. When the
+        // host passes output through to a terminal, which then answers queries too, nothing reads
+        // the model until a later request, so the write is only logged (see
+        // `ServerState::defer_output`). Otherwise, or when the log cannot grow, it is applied now.
+        template<typename HostIo>
+        void mirror_console_output(
+            ServerState& state,
+            const std::shared_ptr<ScreenBuffer>& screen_buffer,
+            const std::wstring_view text,
+            HostIo& host_io) noexcept
+        {
+            if (!host_io.vt_should_answer_queries() && state.defer_output(screen_buffer, text, state.output_mode()))
+            {
+                if (state.deferred_output_full())
+                {
+                    state.flush_deferred_output(host_io);
                 }
+                return;
+            }
 
-                if (bytes_written > static_cast<size_t>(std::numeric_limits<ULONG>::max()))
-                {
-                    message.set_reply_status(core::status_invalid_parameter);
-                    message.set_reply_information(0);
-                    return outcome;
+            state.flush_deferred_output(host_io);
+            apply_text_to_screen_buffer(*screen_buffer, text, state.output_mode(), &state, &host_io);
+        }
+
+        // Whether a request can run with output still in the deferred log: writes append to it, and
+        // the others here neither read nor change a screen buffer. Every other request applies the
+        // log first, so it sees the same model as if each write had been applied when it arrived.
+        template<typename Comm>
+        [[nodiscard]] bool keeps_deferred_output(BasicApiMessage<Comm>& message) noexcept
+        {
+            switch (message.descriptor().function)
+            {
+            case console_io_raw_write:
+            case console_io_raw_flush:
+                return true;
+            case console_io_user_defined:
+                switch (message.packet().payload.user_defined.msg_header.ApiNumber)
+                {
+                case ConsolepWriteConsole:
+                case ConsolepGetMode:
+                case ConsolepSetMode:
+                case ConsolepGetCP:
+                case ConsolepSetCP:
+                case ConsolepGetNumberOfInputEvents:
+                case ConsolepGetConsoleInput:
+                case ConsolepWriteConsoleInput:
+                case ConsolepFlushInputBuffer:
+                case ConsolepGetLangId:
+                case ConsolepGetConsoleProcessList:
+                    return true;
+                default:
+                    return false;
                 }
+            default:
+                return false;
+            }
+        }
 
-                body.CommandBufferLength = static_cast<ULONG>(bytes_written);
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(body.CommandBufferLength);
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_write_console(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& host_io = context.host_io;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
+
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::output)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            auto* screen_buffer = handle->screen_buffer.get();
+            if (screen_buffer == nullptr)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
                 return outcome;
             }
 
-            if (api_number == static_cast<ULONG>(ConsolepGetConsoleInput))
+            auto input = message.get_input_buffer();
+            if (!input)
+            {
+                return std::unexpected(input.error());
+            }
+
+            auto& body = packet.payload.user_defined.u.console_msg_l1.WriteConsole;
+            body.NumBytes = 0;
+
+            // ConDrv's `WriteConsole` message is the primary path used by classic clients
+            // (WriteConsoleW/A) to render text. We keep a minimal implementation that:
+            // - forwards bytes to `host_io` as a best-effort "headless sink"
+            // - updates the in-memory `ScreenBuffer` so subsequent read/output APIs can
+            //   observe consistent state (cursor advancement, wrapping, basic control chars).
+            //
+            // The full inbox host implements extensive processing (tabs, backspace,
+            // scrolling regions, fullwidth, output modes, etc.). This replacement
+            // intentionally starts small and is expanded incrementally.
+
+            // The text is parsed straight out of the message's input buffer (Unicode) or out of a
+            // reusable decode buffer (ANSI); UTF-8 for the host sink is produced in one pass into a
+            // reusable scratch buffer. Steady-state writes therefore do not allocate.
+            std::wstring_view text_to_write;
+            if (body.Unicode)
             {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::input)
+                if ((input->size() % sizeof(wchar_t)) != 0)
                 {
-                    message.set_reply_status(core::status_invalid_handle);
+                    message.set_reply_status(core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
 
-                auto output = message.get_output_buffer();
-                if (!output)
+                // Message buffers are heap allocations and therefore suitably aligned for `wchar_t`.
+                text_to_write = std::wstring_view(
+                    reinterpret_cast<const wchar_t*>(input->data()),
+                    input->size() / sizeof(wchar_t));
+
+                auto utf8 = encode_console_output_utf8(text_to_write, state.output_utf8_scratch(), L"WideCharToMultiByte failed for console output");
+                if (!utf8)
                 {
-                    return std::unexpected(output.error());
+                    if (utf8.error().win32_error == ERROR_OUTOFMEMORY)
+                    {
+                        message.set_reply_status(core::status_no_memory);
+                        message.set_reply_information(0);
+                        return outcome;
+                    }
+
+                    return std::unexpected(utf8.error());
                 }
 
-                auto& body = packet.payload.user_defined.u.console_msg_l1.GetConsoleInput;
-                body.NumRecords = 0;
+                if (!utf8->empty())
+                {
+                    auto written = host_io.write_output_bytes(*utf8);
+                    if (!written)
+                    {
+                        return std::unexpected(written.error());
+                    }
+                }
 
-                if ((body.Flags & static_cast<USHORT>(~CONSOLE_READ_VALID)) != 0)
+                // Mirror the internal conhost contract: NumBytes is the amount of
+                // UTF-16 bytes consumed/written, not the number of UTF-8 bytes emitted.
+                body.NumBytes = static_cast<ULONG>(input->size());
+            }
+            else
+            {
+                const UINT code_page = static_cast<UINT>(state.output_code_page());
+                auto decoded = decode_console_output_bytes(*input, code_page, state.output_text_scratch(), L"ConsolepWriteConsole ANSI decode failed");
+                if (!decoded)
                 {
-                    message.set_reply_status(core::status_invalid_parameter);
+                    message.set_reply_status(decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
+                text_to_write = decoded.value();
 
-                const size_t capacity = output->size() / sizeof(INPUT_RECORD);
-                if (capacity == 0)
+                auto written = host_io.write_output_bytes(*input);
+                if (!written)
                 {
-                    message.set_reply_status(core::status_success);
-                    message.set_reply_information(0);
-                    return outcome;
+                    return std::unexpected(written.error());
                 }
 
-                const bool is_peek = (body.Flags & CONSOLE_READ_NOREMOVE) != 0;
-                const bool wait_allowed = (body.Flags & CONSOLE_READ_NOWAIT) == 0;
-                const bool processed_input = (state.input_mode() & ENABLE_PROCESSED_INPUT) != 0;
-
-                // `ConsolepGetConsoleInput` models input as a byte stream. UTF-8/DBCS sequences can be split
-                // across reads, so the queue can temporarily contain bytes that cannot be decoded into an
-                // `INPUT_RECORD` yet. We drain such prefixes into a per-handle buffer so reply-pending reads
-                // can resume once more bytes arrive without leaving an undecodable prefix in the shared queue.
-                auto& pending_prefix = handle->pending_input_bytes;
-
-                const auto forward_ctrl_c = [&]() noexcept {
-                    state.for_each_process([&](const ProcessState& process) noexcept {
-                        (void)host_io.send_end_task(
-                            process.pid,
-                            CTRL_C_EVENT,
-                            static_cast<DWORD>(core::console_ctrl_c_flag));
-                    });
-                };
+                body.NumBytes = static_cast<ULONG>(written.value());
+            }
 
-                const auto forward_ctrl_break = [&]() noexcept {
-                    state.for_each_process([&](const ProcessState& process) noexcept {
-                        (void)host_io.send_end_task(
-                            process.pid,
-                            CTRL_BREAK_EVENT,
-                            static_cast<DWORD>(core::console_ctrl_break_flag));
-                    });
-                };
+            mirror_console_output(state, handle->screen_buffer, text_to_write, host_io);
+            state.trim_output_scratch();
 
-                // In processed input mode Ctrl+C is a control event, not an input record.
-                // If it is at the front of the byte queue, consume it immediately so
-                // it never appears in peek/remove reads.
-                if (processed_input)
-                {
-                    for (;;)
-                    {
-                        if (host_io.input_bytes_available() == 0)
-                        {
-                            break;
-                        }
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(body.NumBytes);
+            return outcome;
+        }
 
-                        std::array<std::byte, 1> first{};
-                        auto peeked = host_io.peek_input_bytes(first);
-                        if (!peeked)
-                        {
-                            return std::unexpected(peeked.error());
-                        }
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> handle_read_console(
+            UserDefinedDispatchContext<Comm, HostIo>& context) noexcept
+        {
+            auto& state = context.state;
+            auto& message = context.message;
+            auto& host_io = context.host_io;
+            auto& packet = context.packet;
+            const auto& descriptor = context.descriptor;
+            DispatchOutcome outcome{};
 
-                        if (peeked.value() != 1 || first[0] != static_cast<std::byte>(0x03))
-                        {
-                            break;
-                        }
+            const auto handle_id = descriptor.object;
+            auto* handle = state.find_object(handle_id);
+            if (handle == nullptr || handle->kind != ObjectKind::input)
+            {
+                message.set_reply_status(core::status_invalid_handle);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                        auto removed = host_io.read_input_bytes(first);
-                        if (!removed)
-                        {
-                            return std::unexpected(removed.error());
-                        }
+            auto output = message.get_output_buffer();
+            if (!output)
+            {
+                return std::unexpected(output.error());
+            }
 
-                        if (removed.value() != 1)
-                        {
-                            break;
-                        }
+            auto& body = packet.payload.user_defined.u.console_msg_l1.ReadConsole;
+            body.ControlKeyState = 0;
+            body.NumBytes = 0;
 
-                        // Ctrl+C is processed at input time in the inbox host. Our
-                        // byte-stream model forwards it when we observe it to avoid
-                        // leaving stale control bytes in the queue.
-                        forward_ctrl_c();
-                    }
-                }
+            if (output->empty())
+            {
+                message.set_reply_status(core::status_success);
+                message.set_reply_information(0);
+                return outcome;
+            }
 
-                std::vector<std::byte> input_bytes;
+            const ULONG input_mode = state.input_mode();
+            const bool line_input = (input_mode & ENABLE_LINE_INPUT) != 0;
+            const bool echo_input = (input_mode & ENABLE_ECHO_INPUT) != 0;
+            const bool processed_input = (input_mode & ENABLE_PROCESSED_INPUT) != 0;
 
-                auto* records = reinterpret_cast<INPUT_RECORD*>(output->data());
-                const UINT code_page = static_cast<UINT>(state.input_code_page());
+            auto& pending_prefix = handle->pending_input_bytes;
 
-                size_t records_written = 0;
-                size_t bytes_consumed = 0;
-                size_t ctrl_c_count = 0;
-                size_t ctrl_break_count = 0;
+            if (line_input)
+            {
+                auto& pending = handle->cooked_read_pending;
+                auto& line = handle->cooked_line_in_progress;
+                auto& cursor = handle->cooked_line_cursor;
+                auto& insert_mode = handle->cooked_insert_mode;
 
-                for (;;)
-                {
-                    records_written = 0;
-                    bytes_consumed = 0;
-                    ctrl_c_count = 0;
-                    ctrl_break_count = 0;
+                const auto is_high_surrogate = [](const wchar_t value) noexcept -> bool {
+                    return value >= 0xD800 && value <= 0xDBFF;
+                };
+                const auto is_low_surrogate = [](const wchar_t value) noexcept -> bool {
+                    return value >= 0xDC00 && value <= 0xDFFF;
+                };
 
-                    if (wait_allowed &&
-                        !handle->decoded_input_pending &&
-                        pending_prefix.empty() &&
-                        host_io.input_bytes_available() == 0)
+                const auto normalize_cursor = [&]() noexcept {
+                    if (cursor > line.size())
                     {
-                        if (host_io.input_disconnected())
-                        {
-                            message.set_reply_status(core::status_unsuccessful);
-                            message.set_reply_information(0);
-                            return outcome;
-                        }
-
-                        outcome.reply_pending = true;
-                        return outcome;
+                        cursor = line.size();
                     }
 
-                    const size_t available_bytes = host_io.input_bytes_available();
-                    constexpr size_t peek_limit = 64 * 1024;
-                    constexpr size_t max_bytes_per_token = 64;
-                    const size_t max_needed = capacity > (std::numeric_limits<size_t>::max() / max_bytes_per_token)
-                        ? std::numeric_limits<size_t>::max()
-                        : capacity * max_bytes_per_token;
-                    const size_t to_peek = std::min(available_bytes, std::min(max_needed, peek_limit));
-
-                    const size_t pending_byte_count = pending_prefix.size();
-
-                    try
-                    {
-                        input_bytes.resize(pending_byte_count + to_peek);
-                    }
-                    catch (...)
+                    // Avoid leaving the cursor inside a surrogate pair.
+                    if (cursor != 0 && cursor < line.size() &&
+                        is_low_surrogate(line[cursor]) && is_high_surrogate(line[cursor - 1]))
                     {
-                        message.set_reply_status(core::status_no_memory);
-                        message.set_reply_information(0);
-                        return outcome;
+                        --cursor;
                     }
+                };
+                normalize_cursor();
 
-                    if (pending_byte_count != 0)
+                const auto deliver_pending = [&]() noexcept -> bool {
+                    if (pending.empty())
                     {
-                        const auto prefix = pending_prefix.bytes();
-                        std::memcpy(input_bytes.data(), prefix.data(), pending_byte_count);
+                        body.NumBytes = 0;
+                        message.set_reply_status(core::status_success);
+                        message.set_reply_information(0);
+                        return true;
                     }
 
-                    size_t queue_byte_count = 0;
-                    if (to_peek != 0)
+                    if (body.Unicode)
                     {
-                        auto read = host_io.peek_input_bytes(std::span<std::byte>(input_bytes.data() + pending_byte_count, to_peek));
-                        if (!read)
+                        const size_t max_wchars = output->size() / sizeof(wchar_t);
+                        const size_t to_copy = std::min(pending.size(), max_wchars);
+                        if (to_copy != 0)
                         {
-                            return std::unexpected(read.error());
+                            std::memcpy(output->data(), pending.data(), to_copy * sizeof(wchar_t));
+                            pending.erase(0, to_copy);
                         }
-                        queue_byte_count = read.value();
-                    }
-
-                    const size_t byte_count = pending_byte_count + queue_byte_count;
-
-                    size_t offset = 0;
-
-                    if (handle->decoded_input_pending)
-                    {
-                        const wchar_t value = *handle->decoded_input_pending;
-                        const auto key = make_simple_character_key_event(value);
-                        records[records_written] = make_input_record_from_key(key, body.Unicode != FALSE);
-                        ++records_written;
 
-                        if (!is_peek)
-                        {
-                            handle->decoded_input_pending.reset();
-                        }
+                        const size_t bytes_out = to_copy * sizeof(wchar_t);
+                        body.NumBytes = bytes_out > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                            ? std::numeric_limits<ULONG>::max()
+                            : static_cast<ULONG>(bytes_out);
                     }
-
-                    while (records_written < capacity && offset < byte_count)
+                    else
                     {
-                        vt_input::DecodedToken token{};
-                        const auto decode_outcome = decode_one_input_token(
-                            code_page,
-                            std::span<const std::byte>(input_bytes.data() + offset, byte_count - offset),
-                            token);
-                        if (decode_outcome == InputDecodeOutcome::need_more_data)
-                        {
-                            break;
-                        }
-
-                        if (token.bytes_consumed == 0)
-                        {
-                            break;
-                        }
+                        const UINT code_page = static_cast<UINT>(state.input_code_page());
+                        const auto* data = pending.data();
+                        const size_t unit_count = pending.size();
+                        const size_t capacity = output->size();
 
-                        if (token.kind == vt_input::TokenKind::ignored_sequence)
+                        if (unit_count != 0 && capacity != 0)
                         {
-                            offset += token.bytes_consumed;
-                            bytes_consumed = offset;
-                            continue;
-                        }
+                            const int max_units = unit_count > static_cast<size_t>(std::numeric_limits<int>::max())
+                                ? std::numeric_limits<int>::max()
+                                : static_cast<int>(unit_count);
 
-                        if (token.kind == vt_input::TokenKind::key_event)
-                        {
-                            if (processed_input && key_event_matches_ctrl_break(token.key))
+                            int low = 0;
+                            int high = max_units;
+                            int best = 0;
+                            while (low <= high)
                             {
-                                offset += token.bytes_consumed;
-                                bytes_consumed = offset;
-
-                                if (token.key.bKeyDown)
+                                const int mid = low + ((high - low) / 2);
+                                const int required = ::WideCharToMultiByte(
+                                    code_page,
+                                    0,
+                                    data,
+                                    mid,
+                                    nullptr,
+                                    0,
+                                    nullptr,
+                                    nullptr);
+                                if (required <= 0)
                                 {
-                                    // Ctrl+Break flushes the input buffer and is not delivered as an input record.
-                                    ++ctrl_break_count;
-                                    records_written = 0;
-                                    break;
+                                    high = mid - 1;
+                                    continue;
                                 }
 
-                                continue;
-                            }
-
-                            if (processed_input && key_event_matches_ctrl_c(token.key))
-                            {
-                                if (token.key.bKeyDown)
+                                const size_t required_size = static_cast<size_t>(required);
+                                if (required_size <= capacity)
                                 {
-                                    ++ctrl_c_count;
+                                    best = mid;
+                                    low = mid + 1;
                                 }
-                                offset += token.bytes_consumed;
-                                bytes_consumed = offset;
-                                continue;
-                            }
-
-                            records[records_written] = make_input_record_from_key(token.key, body.Unicode != FALSE);
-                            ++records_written;
-                            offset += token.bytes_consumed;
-                            bytes_consumed = offset;
-                            continue;
-                        }
-
-                        const auto& text = token.text;
-                        if (text.bytes_consumed == 0 || text.char_count == 0)
-                        {
-                            break;
-                        }
-
-                        if (processed_input && text.char_count == 1 && text.chars[0] == static_cast<wchar_t>(0x0003))
-                        {
-                            ++ctrl_c_count;
-                            offset += token.bytes_consumed;
-                            bytes_consumed = offset;
-                            continue;
-                        }
-
-                        const size_t remaining_capacity = capacity - records_written;
-                        if (text.char_count > remaining_capacity)
-                        {
-                            if (text.char_count == 2 && remaining_capacity == 1)
-                            {
-                                const auto key = make_simple_character_key_event(text.chars[0]);
-                                records[records_written] = make_input_record_from_key(key, body.Unicode != FALSE);
-                                ++records_written;
-
-                                if (!is_peek)
+                                else
                                 {
-                                    handle->decoded_input_pending = text.chars[1];
-                                    offset += token.bytes_consumed;
-                                    bytes_consumed = offset;
+                                    high = mid - 1;
                                 }
                             }
 
-                            break;
-                        }
-
-                        for (size_t i = 0; i < text.char_count; ++i)
-                        {
-                            const auto key = make_simple_character_key_event(text.chars[i]);
-                            records[records_written + i] = make_input_record_from_key(key, body.Unicode != FALSE);
-                        }
-
-                        records_written += text.char_count;
-                        offset += token.bytes_consumed;
-                        bytes_consumed = offset;
-                    }
-
-                    if (!is_peek && wait_allowed && records_written == 0 && bytes_consumed == 0)
-                    {
-                        if (host_io.input_disconnected())
-                        {
-                            message.set_reply_status(core::status_unsuccessful);
-                            message.set_reply_information(0);
-                            return outcome;
-                        }
-
-                        if (byte_count == 0)
-                        {
-                            outcome.reply_pending = true;
-                            return outcome;
-                        }
-
-                        vt_input::DecodedToken head{};
-                        const auto head_outcome = decode_one_input_token(
-                            code_page,
-                            std::span<const std::byte>(input_bytes.data(), byte_count),
-                            head);
-                        if (head_outcome == InputDecodeOutcome::need_more_data)
-                        {
-                            if (queue_byte_count != 0)
+                            if (best != 0 && static_cast<size_t>(best) < unit_count)
                             {
-                                const size_t pending_before = pending_prefix.size();
-                                const auto drained = std::span<const std::byte>(
-                                    input_bytes.data() + pending_before,
-                                    queue_byte_count);
-                                if (pending_prefix.append(drained))
+                                if (is_high_surrogate(data[static_cast<size_t>(best) - 1]) &&
+                                    is_low_surrogate(data[static_cast<size_t>(best)]))
                                 {
-                                    size_t remaining_to_discard = queue_byte_count;
-                                    std::array<std::byte, 16> discard{};
-                                    while (remaining_to_discard != 0)
-                                    {
-                                        const size_t discard_count = std::min(remaining_to_discard, discard.size());
-                                        auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
-                                        if (!removed)
-                                        {
-                                            return std::unexpected(removed.error());
-                                        }
-
-                                        if (removed.value() == 0)
-                                        {
-                                            break;
-                                        }
-
-                                        remaining_to_discard -= removed.value();
-                                    }
+                                    --best;
+                                }
+                                else if (is_high_surrogate(data[static_cast<size_t>(best) - 1]))
+                                {
+                                    --best;
                                 }
                             }
 
-                            outcome.reply_pending = true;
-                            return outcome;
-                        }
-                    }
-
-                    if (!is_peek && bytes_consumed != 0)
-                    {
-                        const size_t pending_before = pending_prefix.size();
-                        const size_t pending_consumed = std::min(bytes_consumed, pending_before);
-                        pending_prefix.consume_prefix(pending_consumed);
-
-                        size_t remaining_to_discard = bytes_consumed - pending_consumed;
-                        std::array<std::byte, 256> discard{};
-                        while (remaining_to_discard != 0)
-                        {
-                            const size_t chunk = std::min(remaining_to_discard, discard.size());
-                            auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), chunk));
-                            if (!removed)
-                            {
-                                return std::unexpected(removed.error());
-                            }
-
-                            if (removed.value() == 0)
+                            if (best == 0)
                             {
-                                break;
-                            }
-
-                            remaining_to_discard -= removed.value();
-                        }
-                    }
-
-                    if (processed_input && ctrl_break_count != 0)
-                    {
-                        if (auto flushed = host_io.flush_input_buffer(); !flushed)
-                        {
-                            return std::unexpected(flushed.error());
-                        }
-
-                        handle->decoded_input_pending.reset();
-                        pending_prefix.clear();
-                        handle->cooked_read_pending.clear();
-                        handle->cooked_line_in_progress.clear();
-
-                        for (size_t i = 0; i < ctrl_break_count; ++i)
-                        {
-                            forward_ctrl_break();
-                        }
-                    }
-
-                    if (!is_peek && ctrl_c_count != 0)
-                    {
-                        for (size_t i = 0; i < ctrl_c_count; ++i)
-                        {
-                            forward_ctrl_c();
-                        }
-                    }
-
-                    if (!is_peek && wait_allowed && records_written == 0)
-                    {
-                        if (host_io.input_disconnected())
-                        {
-                            message.set_reply_status(core::status_unsuccessful);
-                            message.set_reply_information(0);
-                            return outcome;
-                        }
-
-                        if (host_io.input_bytes_available() == 0 &&
-                            pending_prefix.empty() &&
-                            !handle->decoded_input_pending)
-                        {
-                            outcome.reply_pending = true;
-                            return outcome;
-                        }
+                                // The caller provided a buffer that cannot hold even one encoded
+                                // character (e.g., UTF-8 multibyte sequences). Treat this as
+                                // a buffer-too-small error to avoid returning success with 0
+                                // bytes while leaving pending data intact. If the code page
+                                // is invalid, report invalid parameter instead.
+                                int minimal_units = 1;
+                                if (unit_count >= 2 &&
+                                    is_high_surrogate(data[0]) &&
+                                    is_low_surrogate(data[1]))
+                                {
+                                    minimal_units = 2;
+                                }
 
-                        if (bytes_consumed != 0)
-                        {
-                            // We consumed only ignored sequences/processed Ctrl+C markers. Retry now that the head changed.
-                            continue;
-                        }
-                    }
+                                const int required = ::WideCharToMultiByte(
+                                    code_page,
+                                    0,
+                                    data,
+                                    minimal_units,
+                                    nullptr,
+                                    0,
+                                    nullptr,
+                                    nullptr);
 
-                    break;
-                }
+                                body.NumBytes = 0;
+                                message.set_reply_status(required <= 0 ? core::status_invalid_parameter : core::status_buffer_too_small);
+                                message.set_reply_information(0);
+                                return false;
+                            }
 
-                body.NumRecords = records_written > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                    ? std::numeric_limits<ULONG>::max()
-                    : static_cast<ULONG>(records_written);
+                            if (best != 0)
+                            {
+                                const int written = ::WideCharToMultiByte(
+                                    code_page,
+                                    0,
+                                    data,
+                                    best,
+                                    reinterpret_cast<char*>(output->data()),
+                                    capacity > static_cast<size_t>(std::numeric_limits<int>::max())
+                                        ? std::numeric_limits<int>::max()
+                                        : static_cast<int>(capacity),
+                                    nullptr,
+                                    nullptr);
+                                if (written <= 0)
+                                {
+                                    message.set_reply_status(core::status_invalid_parameter);
+                                    message.set_reply_information(0);
+                                    return false;
+                                }
 
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(static_cast<ULONG_PTR>(records_written * sizeof(INPUT_RECORD)));
-                return outcome;
-            }
+                                body.NumBytes = static_cast<ULONG>(written);
+                                pending.erase(0, static_cast<size_t>(best));
+                            }
+                        }
+                    }
 
-            if (api_number == static_cast<ULONG>(ConsolepWriteConsole))
-            {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::output)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                    message.set_reply_status(core::status_success);
+                    message.set_reply_information(body.NumBytes);
+                    return true;
+                };
 
-                auto* screen_buffer = handle->screen_buffer.get();
-                if (screen_buffer == nullptr)
+                if (!pending.empty())
                 {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
+                    (void)deliver_pending();
                     return outcome;
                 }
 
-                auto input = message.get_input_buffer();
-                if (!input)
-                {
-                    return std::unexpected(input.error());
-                }
-
-                auto& body = packet.payload.user_defined.u.console_msg_l1.WriteConsole;
-                body.NumBytes = 0;
-
-                // ConDrv's `WriteConsole` message is the primary path used by classic clients
-                // (WriteConsoleW/A) to render text. We keep a minimal implementation that:
-                // - forwards bytes to `host_io` as a best-effort "headless sink"
-                // - updates the in-memory `ScreenBuffer` so subsequent read/output APIs can
-                //   observe consistent state (cursor advancement, wrapping, basic control chars).
-                //
-                // The full inbox host implements extensive processing (tabs, backspace,
-                // scrolling regions, fullwidth, output modes, etc.). This replacement
-                // intentionally starts small and is expanded incrementally.
-
-                std::wstring text_to_write;
-                if (body.Unicode)
-                {
-                    if ((input->size() % sizeof(wchar_t)) != 0)
+                const auto echo_text = [&](const std::wstring_view value) noexcept -> std::expected<void, DeviceCommError> {
+                    if (!echo_input || value.empty())
                     {
-                        message.set_reply_status(core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
+                        return {};
                     }
 
-                    const auto wchar_count = static_cast<int>(input->size() / sizeof(wchar_t));
-                    try
-                    {
-                        text_to_write.resize(static_cast<size_t>(wchar_count));
-                    }
-                    catch (...)
+                    if (auto screen_buffer = state.active_screen_buffer())
                     {
-                        message.set_reply_status(core::status_no_memory);
-                        message.set_reply_information(0);
-                        return outcome;
+                        apply_text_to_screen_buffer(*screen_buffer, value, state.output_mode(), &state, &host_io);
                     }
 
-                    if (!text_to_write.empty())
+                    if (value.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
                     {
-                        std::memcpy(text_to_write.data(), input->data(), input->size());
+                        return std::unexpected(DeviceCommError{
+                            .context = L"ReadConsole echo exceeded WideCharToMultiByte limits",
+                            .win32_error = ERROR_INVALID_DATA,
+                        });
                     }
 
                     const int required = ::WideCharToMultiByte(
                         CP_UTF8,
                         0,
-                        text_to_write.data(),
-                        wchar_count,
+                        value.data(),
+                        static_cast<int>(value.size()),
                         nullptr,
                         0,
                         nullptr,
@@ -6864,7 +8235,7 @@ namespace oc::logging
                     if (required <= 0)
                     {
                         return std::unexpected(DeviceCommError{
-                            .context = L"WideCharToMultiByte failed for console output",
+                            .context = L"WideCharToMultiByte failed for ReadConsole echo",
                             .win32_error = ::GetLastError(),
                         });
                     }
@@ -6876,15 +8247,17 @@ namespace oc::logging
                     }
                     catch (...)
                     {
-                        message.set_reply_status(core::status_no_memory);
-                        message.set_reply_information(0);
-                        return outcome;
+                        return std::unexpected(DeviceCommError{
+                            .context = L"ReadConsole echo allocation failed",
+                            .win32_error = ERROR_OUTOFMEMORY,
+                        });
                     }
+
                     const int converted = ::WideCharToMultiByte(
                         CP_UTF8,
                         0,
-                        text_to_write.data(),
-                        wchar_count,
+                        value.data(),
+                        static_cast<int>(value.size()),
                         reinterpret_cast<char*>(utf8.data()),
                         required,
                         nullptr,
@@ -6892,7 +8265,7 @@ namespace oc::logging
                     if (converted != required)
                     {
                         return std::unexpected(DeviceCommError{
-                            .context = L"WideCharToMultiByte produced unexpected length",
+                            .context = L"WideCharToMultiByte produced unexpected length for ReadConsole echo",
                             .win32_error = ::GetLastError(),
                         });
                     }
@@ -6903,745 +8276,398 @@ namespace oc::logging
                         return std::unexpected(written.error());
                     }
 
-                    // Mirror the internal conhost contract: NumBytes is the amount of
-                    // UTF-16 bytes consumed/written, not the number of UTF-8 bytes emitted.
-                    body.NumBytes = static_cast<ULONG>(input->size());
-                }
-                else
+                    return {};
+                };
+
+                if (line.empty())
                 {
-                    const UINT code_page = static_cast<UINT>(state.output_code_page());
-                    auto decoded = decode_console_string(false, std::span<const std::byte>(input->data(), input->size()), code_page, L"ConsolepWriteConsole ANSI decode failed");
-                    if (!decoded)
+                    try
                     {
-                        message.set_reply_status(decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
-                        message.set_reply_information(0);
-                        return outcome;
+                        line.reserve(64);
                     }
-                    text_to_write = std::move(decoded.value());
-
-                    auto written = host_io.write_output_bytes(*input);
-                    if (!written)
+                    catch (...)
                     {
-                        return std::unexpected(written.error());
+                        // Best-effort: cooked reads can proceed without reserving.
                     }
-
-                    body.NumBytes = static_cast<ULONG>(written.value());
                 }
 
-                apply_text_to_screen_buffer(*screen_buffer, text_to_write, state.output_mode(), &state, &host_io);
+                const UINT code_page = static_cast<UINT>(state.input_code_page());
+                constexpr std::wstring_view suffix_processed = L"\r\n";
+                constexpr std::wstring_view suffix_raw = L"\r";
+                const std::wstring_view newline_suffix = processed_input ? suffix_processed : suffix_raw;
 
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(body.NumBytes);
-                return outcome;
-            }
+                const auto prev_index = [&](const size_t index) noexcept -> size_t {
+                    if (index == 0)
+                    {
+                        return 0;
+                    }
 
-            if (api_number == static_cast<ULONG>(ConsolepReadConsole))
-            {
-                const auto handle_id = descriptor.object;
-                auto* handle = state.find_object(handle_id);
-                if (handle == nullptr || handle->kind != ObjectKind::input)
-                {
-                    message.set_reply_status(core::status_invalid_handle);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                    size_t prev = index - 1;
+                    if (prev != 0 && is_low_surrogate(line[prev]) && is_high_surrogate(line[prev - 1]))
+                    {
+                        --prev;
+                    }
+                    return prev;
+                };
 
-                auto output = message.get_output_buffer();
-                if (!output)
-                {
-                    return std::unexpected(output.error());
-                }
+                const auto next_index = [&](const size_t index) noexcept -> size_t {
+                    if (index >= line.size())
+                    {
+                        return line.size();
+                    }
 
-                auto& body = packet.payload.user_defined.u.console_msg_l1.ReadConsole;
-                body.ControlKeyState = 0;
-                body.NumBytes = 0;
+                    size_t next = index + 1;
+                    if (next < line.size() && is_high_surrogate(line[index]) && is_low_surrogate(line[index + 1]))
+                    {
+                        next = index + 2;
+                    }
+                    return next;
+                };
 
-                if (output->empty())
-                {
-                    message.set_reply_status(core::status_success);
-                    message.set_reply_information(0);
-                    return outcome;
-                }
+                const auto is_word_delimiter = [&](const size_t index) noexcept -> bool {
+                    if (index >= line.size())
+                    {
+                        return false;
+                    }
 
-                const ULONG input_mode = state.input_mode();
-                const bool line_input = (input_mode & ENABLE_LINE_INPUT) != 0;
-                const bool echo_input = (input_mode & ENABLE_ECHO_INPUT) != 0;
-                const bool processed_input = (input_mode & ENABLE_PROCESSED_INPUT) != 0;
+                    const wchar_t ch = line[index];
+                    return ch == L' ' || ch == L'\t';
+                };
 
-                auto& pending_prefix = handle->pending_input_bytes;
+                // VT sequences (for example ConPTY win32-input-mode) and UTF-8/DBCS sequences can be
+                // split across reads. If we see an incomplete sequence at the head of the stream,
+                // drain the bytes from the shared queue into the per-handle prefix buffer and wait
+                // until more input arrives.
 
-                if (line_input)
+                for (;;)
                 {
-                    auto& pending = handle->cooked_read_pending;
-                    auto& line = handle->cooked_line_in_progress;
-                    auto& cursor = handle->cooked_line_cursor;
-                    auto& insert_mode = handle->cooked_insert_mode;
-
-                    const auto is_high_surrogate = [](const wchar_t value) noexcept -> bool {
-                        return value >= 0xD800 && value <= 0xDBFF;
-                    };
-                    const auto is_low_surrogate = [](const wchar_t value) noexcept -> bool {
-                        return value >= 0xDC00 && value <= 0xDFFF;
-                    };
-
-                    const auto normalize_cursor = [&]() noexcept {
-                        if (cursor > line.size())
-                        {
-                            cursor = line.size();
-                        }
+                    if (host_io.input_bytes_available() == 0 && pending_prefix.empty())
+                    {
+                        break;
+                    }
 
-                        // Avoid leaving the cursor inside a surrogate pair.
-                        if (cursor != 0 && cursor < line.size() &&
-                            is_low_surrogate(line[cursor]) && is_high_surrogate(line[cursor - 1]))
-                        {
-                            --cursor;
-                        }
-                    };
-                    normalize_cursor();
+                    std::array<std::byte, 64> peek{};
+                    const size_t pending_before = pending_prefix.size();
+                    OC_ASSERT(pending_before <= peek.size());
+                    if (pending_before != 0)
+                    {
+                        const auto prefix = pending_prefix.bytes();
+                        std::memcpy(peek.data(), prefix.data(), pending_before);
+                    }
 
-                    const auto deliver_pending = [&]() noexcept -> bool {
-                        if (pending.empty())
+                    size_t peeked_bytes = 0;
+                    if (pending_before < peek.size())
+                    {
+                        auto peeked = host_io.peek_input_bytes(std::span<std::byte>(peek.data() + pending_before, peek.size() - pending_before));
+                        if (!peeked)
                         {
-                            body.NumBytes = 0;
-                            message.set_reply_status(core::status_success);
-                            message.set_reply_information(0);
-                            return true;
+                            return std::unexpected(peeked.error());
                         }
+                        peeked_bytes = peeked.value();
+                    }
+                    const size_t total_bytes = pending_before + peeked_bytes;
+                    if (total_bytes == 0)
+                    {
+                        break;
+                    }
 
-                        if (body.Unicode)
-                        {
-                            const size_t max_wchars = output->size() / sizeof(wchar_t);
-                            const size_t to_copy = std::min(pending.size(), max_wchars);
-                            if (to_copy != 0)
-                            {
-                                std::memcpy(output->data(), pending.data(), to_copy * sizeof(wchar_t));
-                                pending.erase(0, to_copy);
-                            }
-
-                            const size_t bytes_out = to_copy * sizeof(wchar_t);
-                            body.NumBytes = bytes_out > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                                ? std::numeric_limits<ULONG>::max()
-                                : static_cast<ULONG>(bytes_out);
-                        }
-                        else
+                    vt_input::DecodedToken token{};
+                    const auto decode_outcome = decode_one_input_token(
+                        code_page,
+                        std::span<const std::byte>(peek.data(), total_bytes),
+                        token);
+                    if (decode_outcome == InputDecodeOutcome::need_more_data)
+                    {
+                        if (peeked_bytes != 0)
                         {
-                            const UINT code_page = static_cast<UINT>(state.input_code_page());
-                            const auto* data = pending.data();
-                            const size_t unit_count = pending.size();
-                            const size_t capacity = output->size();
-
-                            if (unit_count != 0 && capacity != 0)
+                            const auto drained = std::span<const std::byte>(peek.data() + pending_before, peeked_bytes);
+                            if (pending_prefix.append(drained))
                             {
-                                const int max_units = unit_count > static_cast<size_t>(std::numeric_limits<int>::max())
-                                    ? std::numeric_limits<int>::max()
-                                    : static_cast<int>(unit_count);
-
-                                int low = 0;
-                                int high = max_units;
-                                int best = 0;
-                                while (low <= high)
-                                {
-                                    const int mid = low + ((high - low) / 2);
-                                    const int required = ::WideCharToMultiByte(
-                                        code_page,
-                                        0,
-                                        data,
-                                        mid,
-                                        nullptr,
-                                        0,
-                                        nullptr,
-                                        nullptr);
-                                    if (required <= 0)
-                                    {
-                                        high = mid - 1;
-                                        continue;
-                                    }
-
-                                    const size_t required_size = static_cast<size_t>(required);
-                                    if (required_size <= capacity)
-                                    {
-                                        best = mid;
-                                        low = mid + 1;
-                                    }
-                                    else
-                                    {
-                                        high = mid - 1;
-                                    }
-                                }
-
-                                if (best != 0 && static_cast<size_t>(best) < unit_count)
-                                {
-                                    if (is_high_surrogate(data[static_cast<size_t>(best) - 1]) &&
-                                        is_low_surrogate(data[static_cast<size_t>(best)]))
-                                    {
-                                        --best;
-                                    }
-                                    else if (is_high_surrogate(data[static_cast<size_t>(best) - 1]))
-                                    {
-                                        --best;
-                                    }
-                                }
-
-                                if (best == 0)
+                                size_t remaining_to_discard = peeked_bytes;
+                                std::array<std::byte, 16> discard{};
+                                while (remaining_to_discard != 0)
                                 {
-                                    // The caller provided a buffer that cannot hold even one encoded
-                                    // character (e.g., UTF-8 multibyte sequences). Treat this as
-                                    // a buffer-too-small error to avoid returning success with 0
-                                    // bytes while leaving pending data intact. If the code page
-                                    // is invalid, report invalid parameter instead.
-                                    int minimal_units = 1;
-                                    if (unit_count >= 2 &&
-                                        is_high_surrogate(data[0]) &&
-                                        is_low_surrogate(data[1]))
+                                    const size_t discard_count = std::min(remaining_to_discard, discard.size());
+                                    auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
+                                    if (!removed)
                                     {
-                                        minimal_units = 2;
+                                        return std::unexpected(removed.error());
                                     }
 
-                                    const int required = ::WideCharToMultiByte(
-                                        code_page,
-                                        0,
-                                        data,
-                                        minimal_units,
-                                        nullptr,
-                                        0,
-                                        nullptr,
-                                        nullptr);
-
-                                    body.NumBytes = 0;
-                                    message.set_reply_status(required <= 0 ? core::status_invalid_parameter : core::status_buffer_too_small);
-                                    message.set_reply_information(0);
-                                    return false;
-                                }
-
-                                if (best != 0)
-                                {
-                                    const int written = ::WideCharToMultiByte(
-                                        code_page,
-                                        0,
-                                        data,
-                                        best,
-                                        reinterpret_cast<char*>(output->data()),
-                                        capacity > static_cast<size_t>(std::numeric_limits<int>::max())
-                                            ? std::numeric_limits<int>::max()
-                                            : static_cast<int>(capacity),
-                                        nullptr,
-                                        nullptr);
-                                    if (written <= 0)
+                                    if (removed.value() == 0)
                                     {
-                                        message.set_reply_status(core::status_invalid_parameter);
-                                        message.set_reply_information(0);
-                                        return false;
+                                        break;
                                     }
 
-                                    body.NumBytes = static_cast<ULONG>(written);
-                                    pending.erase(0, static_cast<size_t>(best));
+                                    remaining_to_discard -= removed.value();
                                 }
                             }
                         }
 
-                        message.set_reply_status(core::status_success);
-                        message.set_reply_information(body.NumBytes);
-                        return true;
-                    };
-
-                    if (!pending.empty())
-                    {
-                        (void)deliver_pending();
-                        return outcome;
+                        break;
                     }
 
-                    const auto echo_text = [&](const std::wstring_view value) noexcept -> std::expected<void, DeviceCommError> {
-                        if (!echo_input || value.empty())
-                        {
-                            return {};
-                        }
-
-                        if (auto screen_buffer = state.active_screen_buffer())
-                        {
-                            apply_text_to_screen_buffer(*screen_buffer, value, state.output_mode(), &state, &host_io);
-                        }
-
-                        if (value.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
-                        {
-                            return std::unexpected(DeviceCommError{
-                                .context = L"ReadConsole echo exceeded WideCharToMultiByte limits",
-                                .win32_error = ERROR_INVALID_DATA,
-                            });
-                        }
-
-                        const int required = ::WideCharToMultiByte(
-                            CP_UTF8,
-                            0,
-                            value.data(),
-                            static_cast<int>(value.size()),
-                            nullptr,
-                            0,
-                            nullptr,
-                            nullptr);
-                        if (required <= 0)
-                        {
-                            return std::unexpected(DeviceCommError{
-                                .context = L"WideCharToMultiByte failed for ReadConsole echo",
-                                .win32_error = ::GetLastError(),
-                            });
-                        }
-
-                        std::vector<std::byte> utf8;
-                        try
-                        {
-                            utf8.resize(static_cast<size_t>(required));
-                        }
-                        catch (...)
-                        {
-                            return std::unexpected(DeviceCommError{
-                                .context = L"ReadConsole echo allocation failed",
-                                .win32_error = ERROR_OUTOFMEMORY,
-                            });
-                        }
-
-                        const int converted = ::WideCharToMultiByte(
-                            CP_UTF8,
-                            0,
-                            value.data(),
-                            static_cast<int>(value.size()),
-                            reinterpret_cast<char*>(utf8.data()),
-                            required,
-                            nullptr,
-                            nullptr);
-                        if (converted != required)
-                        {
-                            return std::unexpected(DeviceCommError{
-                                .context = L"WideCharToMultiByte produced unexpected length for ReadConsole echo",
-                                .win32_error = ::GetLastError(),
-                            });
-                        }
-
-                        auto written = host_io.write_output_bytes(std::span<const std::byte>(utf8.data(), utf8.size()));
-                        if (!written)
-                        {
-                            return std::unexpected(written.error());
-                        }
-
-                        return {};
-                    };
-
-                    if (line.empty())
+                    if (token.bytes_consumed == 0)
                     {
-                        try
-                        {
-                            line.reserve(64);
-                        }
-                        catch (...)
-                        {
-                            // Best-effort: cooked reads can proceed without reserving.
-                        }
+                        break;
                     }
 
-                    const UINT code_page = static_cast<UINT>(state.input_code_page());
-                    constexpr std::wstring_view suffix_processed = L"\r\n";
-                    constexpr std::wstring_view suffix_raw = L"\r";
-                    const std::wstring_view newline_suffix = processed_input ? suffix_processed : suffix_raw;
-
-                    const auto prev_index = [&](const size_t index) noexcept -> size_t {
-                        if (index == 0)
-                        {
-                            return 0;
-                        }
-
-                        size_t prev = index - 1;
-                        if (prev != 0 && is_low_surrogate(line[prev]) && is_high_surrogate(line[prev - 1]))
-                        {
-                            --prev;
-                        }
-                        return prev;
-                    };
-
-                    const auto next_index = [&](const size_t index) noexcept -> size_t {
-                        if (index >= line.size())
-                        {
-                            return line.size();
-                        }
+                    const size_t pending_consumed = std::min(token.bytes_consumed, pending_before);
+                    pending_prefix.consume_prefix(pending_consumed);
 
-                        size_t next = index + 1;
-                        if (next < line.size() && is_high_surrogate(line[index]) && is_low_surrogate(line[index + 1]))
+                    size_t remaining_to_discard = token.bytes_consumed - pending_consumed;
+                    std::array<std::byte, 16> discard{};
+                    while (remaining_to_discard != 0)
+                    {
+                        const size_t discard_count = std::min(remaining_to_discard, discard.size());
+                        auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
+                        if (!removed)
                         {
-                            next = index + 2;
+                            return std::unexpected(removed.error());
                         }
-                        return next;
-                    };
 
-                    const auto is_word_delimiter = [&](const size_t index) noexcept -> bool {
-                        if (index >= line.size())
+                        if (removed.value() == 0)
                         {
-                            return false;
+                            remaining_to_discard = 0;
+                            break;
                         }
 
-                        const wchar_t ch = line[index];
-                        return ch == L' ' || ch == L'\t';
-                    };
-
-                    // VT sequences (for example ConPTY win32-input-mode) and UTF-8/DBCS sequences can be
-                    // split across reads. If we see an incomplete sequence at the head of the stream,
-                    // drain the bytes from the shared queue into the per-handle prefix buffer and wait
-                    // until more input arrives.
+                        remaining_to_discard -= removed.value();
+                    }
 
-                    for (;;)
-                    {
-                        if (host_io.input_bytes_available() == 0 && pending_prefix.empty())
-                        {
-                            break;
-                        }
+                    if (token.kind == vt_input::TokenKind::ignored_sequence)
+                    {
+                        // Focus/DA1 responses and other non-input control sequences are not
+                        // cooked characters. They are consumed and ignored.
+                        continue;
+                    }
 
-                        std::array<std::byte, 64> peek{};
-                        const size_t pending_before = pending_prefix.size();
-                        OC_ASSERT(pending_before <= peek.size());
-                        if (pending_before != 0)
+                    const auto echo_repeat = [&](const wchar_t ch, size_t count) noexcept -> std::expected<void, DeviceCommError> {
+                        if (!echo_input || count == 0)
                         {
-                            const auto prefix = pending_prefix.bytes();
-                            std::memcpy(peek.data(), prefix.data(), pending_before);
+                            return {};
                         }
 
-                        size_t peeked_bytes = 0;
-                        if (pending_before < peek.size())
+                        std::array<wchar_t, 64> buffer{};
+                        buffer.fill(ch);
+                        while (count != 0)
                         {
-                            auto peeked = host_io.peek_input_bytes(std::span<std::byte>(peek.data() + pending_before, peek.size() - pending_before));
-                            if (!peeked)
+                            const size_t chunk = std::min(count, buffer.size());
+                            if (auto echoed = echo_text(std::wstring_view(buffer.data(), chunk)); !echoed)
                             {
-                                return std::unexpected(peeked.error());
+                                return std::unexpected(echoed.error());
                             }
-                            peeked_bytes = peeked.value();
+                            count -= chunk;
                         }
-                        const size_t total_bytes = pending_before + peeked_bytes;
-                        if (total_bytes == 0)
-                        {
-                            break;
-                        }
-
-                        vt_input::DecodedToken token{};
-                        const auto decode_outcome = decode_one_input_token(
-                            code_page,
-                            std::span<const std::byte>(peek.data(), total_bytes),
-                            token);
-                        if (decode_outcome == InputDecodeOutcome::need_more_data)
-                        {
-                            if (peeked_bytes != 0)
-                            {
-                                const auto drained = std::span<const std::byte>(peek.data() + pending_before, peeked_bytes);
-                                if (pending_prefix.append(drained))
-                                {
-                                    size_t remaining_to_discard = peeked_bytes;
-                                    std::array<std::byte, 16> discard{};
-                                    while (remaining_to_discard != 0)
-                                    {
-                                        const size_t discard_count = std::min(remaining_to_discard, discard.size());
-                                        auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
-                                        if (!removed)
-                                        {
-                                            return std::unexpected(removed.error());
-                                        }
 
-                                        if (removed.value() == 0)
-                                        {
-                                            break;
-                                        }
+                        return {};
+                    };
 
-                                        remaining_to_discard -= removed.value();
-                                    }
-                                }
-                            }
+                    const auto echo_backspaces = [&](const size_t count) noexcept -> std::expected<void, DeviceCommError> {
+                        return echo_repeat(L'\b', count);
+                    };
 
-                            break;
-                        }
+                    const auto echo_spaces = [&](const size_t count) noexcept -> std::expected<void, DeviceCommError> {
+                        return echo_repeat(L' ', count);
+                    };
 
-                        if (token.bytes_consumed == 0)
+                    const auto echo_range = [&](const size_t from, const size_t to) noexcept -> std::expected<void, DeviceCommError> {
+                        if (from >= to || to > line.size())
                         {
-                            break;
+                            return {};
                         }
 
-                        const size_t pending_consumed = std::min(token.bytes_consumed, pending_before);
-                        pending_prefix.consume_prefix(pending_consumed);
+                        return echo_text(std::wstring_view(line.data() + from, to - from));
+                    };
 
-                        size_t remaining_to_discard = token.bytes_consumed - pending_consumed;
-                        std::array<std::byte, 16> discard{};
-                        while (remaining_to_discard != 0)
+                    const auto handle_single_unit = [&](const wchar_t value) noexcept
+                        -> std::expected<bool, DeviceCommError> {
+                        normalize_cursor();
+                        if (body.ProcessControlZ != FALSE && line.empty() && value == static_cast<wchar_t>(0x001A))
                         {
-                            const size_t discard_count = std::min(remaining_to_discard, discard.size());
-                            auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
-                            if (!removed)
-                            {
-                                return std::unexpected(removed.error());
-                            }
-
-                            if (removed.value() == 0)
+                            body.NumBytes = 0;
+                            if (!output->empty())
                             {
-                                remaining_to_discard = 0;
-                                break;
+                                output->front() = std::byte{ 0 };
                             }
-
-                            remaining_to_discard -= removed.value();
+                            message.set_reply_status(core::status_success);
+                            message.set_reply_information(0);
+                            return true;
                         }
 
-                        if (token.kind == vt_input::TokenKind::ignored_sequence)
+                        if (processed_input && value == static_cast<wchar_t>(0x0003))
                         {
-                            // Focus/DA1 responses and other non-input control sequences are not
-                            // cooked characters. They are consumed and ignored.
-                            continue;
+                            // Mirror the inbox host: Ctrl+C terminates cooked reads with STATUS_ALERTED
+                            // and is not delivered as input to the client.
+                            state.for_each_process([&](const ProcessState& process) noexcept {
+                                (void)host_io.send_end_task(
+                                    process.pid,
+                                    CTRL_C_EVENT,
+                                    static_cast<DWORD>(core::console_ctrl_c_flag));
+                            });
+
+                            body.NumBytes = 0;
+                            message.set_reply_status(core::status_alerted);
+                            message.set_reply_information(0);
+                            return true;
                         }
 
-                        const auto echo_repeat = [&](const wchar_t ch, size_t count) noexcept -> std::expected<void, DeviceCommError> {
-                            if (!echo_input || count == 0)
+                        if (value == L'\b')
+                        {
+                            if (cursor == 0)
                             {
-                                return {};
+                                return false;
                             }
 
-                            std::array<wchar_t, 64> buffer{};
-                            buffer.fill(ch);
-                            while (count != 0)
+                            const size_t new_cursor = prev_index(cursor);
+                            const size_t removed_units = cursor - new_cursor;
+                            if (removed_units == 0)
                             {
-                                const size_t chunk = std::min(count, buffer.size());
-                                if (auto echoed = echo_text(std::wstring_view(buffer.data(), chunk)); !echoed)
-                                {
-                                    return std::unexpected(echoed.error());
-                                }
-                                count -= chunk;
+                                return false;
                             }
 
-                            return {};
-                        };
-
-                        const auto echo_backspaces = [&](const size_t count) noexcept -> std::expected<void, DeviceCommError> {
-                            return echo_repeat(L'\b', count);
-                        };
-
-                        const auto echo_spaces = [&](const size_t count) noexcept -> std::expected<void, DeviceCommError> {
-                            return echo_repeat(L' ', count);
-                        };
+                            line.erase(new_cursor, removed_units);
+                            cursor = new_cursor;
+                            normalize_cursor();
 
-                        const auto echo_range = [&](const size_t from, const size_t to) noexcept -> std::expected<void, DeviceCommError> {
-                            if (from >= to || to > line.size())
+                            if (auto echoed = echo_backspaces(removed_units); !echoed)
                             {
-                                return {};
+                                return std::unexpected(echoed.error());
                             }
 
-                            return echo_text(std::wstring_view(line.data() + from, to - from));
-                        };
-
-                        const auto handle_single_unit = [&](const wchar_t value) noexcept
-                            -> std::expected<bool, DeviceCommError> {
-                            normalize_cursor();
-                            if (body.ProcessControlZ != FALSE && line.empty() && value == static_cast<wchar_t>(0x001A))
+                            if (cursor < line.size())
                             {
-                                body.NumBytes = 0;
-                                if (!output->empty())
+                                if (auto echoed = echo_range(cursor, line.size()); !echoed)
                                 {
-                                    output->front() = std::byte{ 0 };
+                                    return std::unexpected(echoed.error());
                                 }
-                                message.set_reply_status(core::status_success);
-                                message.set_reply_information(0);
-                                return true;
-                            }
-
-                            if (processed_input && value == static_cast<wchar_t>(0x0003))
-                            {
-                                // Mirror the inbox host: Ctrl+C terminates cooked reads with STATUS_ALERTED
-                                // and is not delivered as input to the client.
-                                state.for_each_process([&](const ProcessState& process) noexcept {
-                                    (void)host_io.send_end_task(
-                                        process.pid,
-                                        CTRL_C_EVENT,
-                                        static_cast<DWORD>(core::console_ctrl_c_flag));
-                                });
 
-                                body.NumBytes = 0;
-                                message.set_reply_status(core::status_alerted);
-                                message.set_reply_information(0);
-                                return true;
-                            }
-
-                            if (value == L'\b')
-                            {
-                                if (cursor == 0)
+                                if (auto echoed = echo_spaces(removed_units); !echoed)
                                 {
-                                    return false;
+                                    return std::unexpected(echoed.error());
                                 }
 
-                                const size_t new_cursor = prev_index(cursor);
-                                const size_t removed_units = cursor - new_cursor;
-                                if (removed_units == 0)
+                                if (auto echoed = echo_backspaces((line.size() - cursor) + removed_units); !echoed)
                                 {
-                                    return false;
+                                    return std::unexpected(echoed.error());
                                 }
-
-                                line.erase(new_cursor, removed_units);
-                                cursor = new_cursor;
-                                normalize_cursor();
-
-                                if (auto echoed = echo_backspaces(removed_units); !echoed)
+                            }
+                            else
+                            {
+                                if (auto echoed = echo_spaces(removed_units); !echoed)
                                 {
                                     return std::unexpected(echoed.error());
                                 }
 
-                                if (cursor < line.size())
+                                if (auto echoed = echo_backspaces(removed_units); !echoed)
                                 {
-                                    if (auto echoed = echo_range(cursor, line.size()); !echoed)
-                                    {
-                                        return std::unexpected(echoed.error());
-                                    }
+                                    return std::unexpected(echoed.error());
+                                }
+                            }
 
-                                    if (auto echoed = echo_spaces(removed_units); !echoed)
-                                    {
-                                        return std::unexpected(echoed.error());
-                                    }
+                            return false;
+                        }
 
-                                    if (auto echoed = echo_backspaces((line.size() - cursor) + removed_units); !echoed)
-                                    {
-                                        return std::unexpected(echoed.error());
-                                    }
-                                }
-                                else
+                        if (value == L'\r' || value == L'\n')
+                        {
+                            if (cursor < line.size())
+                            {
+                                if (auto echoed = echo_range(cursor, line.size()); !echoed)
                                 {
-                                    if (auto echoed = echo_spaces(removed_units); !echoed)
-                                    {
-                                        return std::unexpected(echoed.error());
-                                    }
-
-                                    if (auto echoed = echo_backspaces(removed_units); !echoed)
-                                    {
-                                        return std::unexpected(echoed.error());
-                                    }
+                                    return std::unexpected(echoed.error());
                                 }
-
-                                return false;
+                                cursor = line.size();
                             }
 
-                            if (value == L'\r' || value == L'\n')
+                            if (value == L'\r' && (host_io.input_bytes_available() != 0 || !pending_prefix.empty()))
                             {
-                                if (cursor < line.size())
+                                std::array<std::byte, 64> lf_peek{};
+                                const size_t lf_pending_before = pending_prefix.size();
+                                OC_ASSERT(lf_pending_before <= lf_peek.size());
+                                if (lf_pending_before != 0)
                                 {
-                                    if (auto echoed = echo_range(cursor, line.size()); !echoed)
-                                    {
-                                        return std::unexpected(echoed.error());
-                                    }
-                                    cursor = line.size();
+                                    const auto prefix = pending_prefix.bytes();
+                                    std::memcpy(lf_peek.data(), prefix.data(), lf_pending_before);
                                 }
 
-                                if (value == L'\r' && (host_io.input_bytes_available() != 0 || !pending_prefix.empty()))
+                                size_t lf_peeked_bytes = 0;
+                                if (lf_pending_before < lf_peek.size())
                                 {
-                                    std::array<std::byte, 64> lf_peek{};
-                                    const size_t lf_pending_before = pending_prefix.size();
-                                    OC_ASSERT(lf_pending_before <= lf_peek.size());
-                                    if (lf_pending_before != 0)
+                                    auto lf_peeked = host_io.peek_input_bytes(
+                                        std::span<std::byte>(lf_peek.data() + lf_pending_before, lf_peek.size() - lf_pending_before));
+                                    if (!lf_peeked)
                                     {
-                                        const auto prefix = pending_prefix.bytes();
-                                        std::memcpy(lf_peek.data(), prefix.data(), lf_pending_before);
+                                        return std::unexpected(lf_peeked.error());
                                     }
+                                    lf_peeked_bytes = lf_peeked.value();
+                                }
 
-                                    size_t lf_peeked_bytes = 0;
-                                    if (lf_pending_before < lf_peek.size())
+                                const size_t lf_total = lf_pending_before + lf_peeked_bytes;
+                                if (lf_total != 0)
+                                {
+                                    vt_input::DecodedToken lf_token{};
+                                    if (decode_one_input_token(
+                                            code_page,
+                                            std::span<const std::byte>(lf_peek.data(), lf_total),
+                                            lf_token) == InputDecodeOutcome::produced &&
+                                        lf_token.bytes_consumed != 0)
                                     {
-                                        auto lf_peeked = host_io.peek_input_bytes(
-                                            std::span<std::byte>(lf_peek.data() + lf_pending_before, lf_peek.size() - lf_pending_before));
-                                        if (!lf_peeked)
+                                        bool is_lf = false;
+                                        if (lf_token.kind == vt_input::TokenKind::text_units &&
+                                            lf_token.text.char_count == 1 &&
+                                            lf_token.text.chars[0] == L'\n')
                                         {
-                                            return std::unexpected(lf_peeked.error());
+                                            is_lf = true;
+                                        }
+                                        else if (lf_token.kind == vt_input::TokenKind::key_event &&
+                                                 lf_token.key.bKeyDown &&
+                                                 lf_token.key.uChar.UnicodeChar == L'\n')
+                                        {
+                                            is_lf = true;
                                         }
-                                        lf_peeked_bytes = lf_peeked.value();
-                                    }
 
-                                    const size_t lf_total = lf_pending_before + lf_peeked_bytes;
-                                    if (lf_total != 0)
-                                    {
-                                        vt_input::DecodedToken lf_token{};
-                                        if (decode_one_input_token(
-                                                code_page,
-                                                std::span<const std::byte>(lf_peek.data(), lf_total),
-                                                lf_token) == InputDecodeOutcome::produced &&
-                                            lf_token.bytes_consumed != 0)
+                                        if (is_lf)
                                         {
-                                            bool is_lf = false;
-                                            if (lf_token.kind == vt_input::TokenKind::text_units &&
-                                                lf_token.text.char_count == 1 &&
-                                                lf_token.text.chars[0] == L'\n')
-                                            {
-                                                is_lf = true;
-                                            }
-                                            else if (lf_token.kind == vt_input::TokenKind::key_event &&
-                                                     lf_token.key.bKeyDown &&
-                                                     lf_token.key.uChar.UnicodeChar == L'\n')
-                                            {
-                                                is_lf = true;
-                                            }
+                                            const size_t lf_pending_consumed = std::min(lf_token.bytes_consumed, lf_pending_before);
+                                            pending_prefix.consume_prefix(lf_pending_consumed);
 
-                                            if (is_lf)
+                                            size_t lf_remaining_to_discard = lf_token.bytes_consumed - lf_pending_consumed;
+                                            std::array<std::byte, 16> lf_discard{};
+                                            while (lf_remaining_to_discard != 0)
                                             {
-                                                const size_t lf_pending_consumed = std::min(lf_token.bytes_consumed, lf_pending_before);
-                                                pending_prefix.consume_prefix(lf_pending_consumed);
+                                                const size_t discard_count = std::min(lf_remaining_to_discard, lf_discard.size());
+                                                auto removed = host_io.read_input_bytes(std::span<std::byte>(lf_discard.data(), discard_count));
+                                                if (!removed)
+                                                {
+                                                    return std::unexpected(removed.error());
+                                                }
 
-                                                size_t lf_remaining_to_discard = lf_token.bytes_consumed - lf_pending_consumed;
-                                                std::array<std::byte, 16> lf_discard{};
-                                                while (lf_remaining_to_discard != 0)
+                                                if (removed.value() == 0)
                                                 {
-                                                    const size_t discard_count = std::min(lf_remaining_to_discard, lf_discard.size());
-                                                    auto removed = host_io.read_input_bytes(std::span<std::byte>(lf_discard.data(), discard_count));
-                                                    if (!removed)
-                                                    {
-                                                        return std::unexpected(removed.error());
-                                                    }
-
-                                                    if (removed.value() == 0)
-                                                    {
-                                                        break;
-                                                    }
-
-                                                    lf_remaining_to_discard -= removed.value();
+                                                    break;
                                                 }
+
+                                                lf_remaining_to_discard -= removed.value();
                                             }
                                         }
                                     }
                                 }
+                            }
 
-                                if (auto echoed = echo_text(newline_suffix); !echoed)
-                                {
-                                    return std::unexpected(echoed.error());
-                                }
-
-                                if (echo_input)
-                                {
-                                    const bool suppress_duplicates = (state.history_flags() & HISTORY_NO_DUP_FLAG) != 0;
-                                    state.add_command_history_for_process(handle->owning_process, std::wstring_view(line), suppress_duplicates);
-                                }
-
-                                try
-                                {
-                                    line.append(newline_suffix);
-                                }
-                                catch (...)
-                                {
-                                    message.set_reply_status(core::status_no_memory);
-                                    message.set_reply_information(0);
-                                    return true;
-                                }
-
-                                pending = std::move(line);
-                                cursor = 0;
-                                (void)deliver_pending();
-                                return true;
+                            if (auto echoed = echo_text(newline_suffix); !echoed)
+                            {
+                                return std::unexpected(echoed.error());
                             }
 
-                            size_t removed_units = 0;
-                            if (!insert_mode && cursor < line.size())
+                            if (echo_input)
                             {
-                                const size_t end = next_index(cursor);
-                                removed_units = end - cursor;
-                                if (removed_units != 0)
-                                {
-                                    line.erase(cursor, removed_units);
-                                }
+                                const bool suppress_duplicates = (state.history_flags() & HISTORY_NO_DUP_FLAG) != 0;
+                                state.add_command_history_for_process(handle->owning_process, std::wstring_view(line), suppress_duplicates);
                             }
 
                             try
                             {
-                                line.insert(cursor, 1, value);
+                                line.append(newline_suffix);
                             }
                             catch (...)
                             {
@@ -7650,374 +8676,367 @@ namespace oc::logging
                                 return true;
                             }
 
-                            ++cursor;
-                            normalize_cursor();
+                            pending = std::move(line);
+                            cursor = 0;
+                            (void)deliver_pending();
+                            return true;
+                        }
+
+                        size_t removed_units = 0;
+                        if (!insert_mode && cursor < line.size())
+                        {
+                            const size_t end = next_index(cursor);
+                            removed_units = end - cursor;
+                            if (removed_units != 0)
+                            {
+                                line.erase(cursor, removed_units);
+                            }
+                        }
+
+                        try
+                        {
+                            line.insert(cursor, 1, value);
+                        }
+                        catch (...)
+                        {
+                            message.set_reply_status(core::status_no_memory);
+                            message.set_reply_information(0);
+                            return true;
+                        }
+
+                        ++cursor;
+                        normalize_cursor();
+
+                        const size_t tail_units = line.size() - cursor;
+                        if (auto echoed = echo_text(std::wstring_view(&value, 1)); !echoed)
+                        {
+                            return std::unexpected(echoed.error());
+                        }
+
+                        if (tail_units != 0)
+                        {
+                            if (auto echoed = echo_text(std::wstring_view(line.data() + cursor, tail_units)); !echoed)
+                            {
+                                return std::unexpected(echoed.error());
+                            }
+                        }
+
+                        const size_t clear_units = removed_units > 1 ? removed_units - 1 : 0;
+                        if (clear_units != 0)
+                        {
+                            if (auto echoed = echo_spaces(clear_units); !echoed)
+                            {
+                                return std::unexpected(echoed.error());
+                            }
+                        }
+
+                        const size_t backspaces = tail_units + clear_units;
+                        if (backspaces != 0)
+                        {
+                            if (auto echoed = echo_backspaces(backspaces); !echoed)
+                            {
+                                return std::unexpected(echoed.error());
+                            }
+                        }
+                        return false;
+                    };
+
+                    if (token.kind == vt_input::TokenKind::key_event)
+                    {
+                        const auto& key = token.key;
+                        if (!key.bKeyDown)
+                        {
+                            continue;
+                        }
+
+                        if (processed_input && key_event_matches_ctrl_break(key))
+                        {
+                            // Mirror the inbox host: Ctrl+Break flushes the input buffer, generates
+                            // a CTRL_BREAK_EVENT, and terminates cooked reads with STATUS_ALERTED.
+                            if (auto flushed = host_io.flush_input_buffer(); !flushed)
+                            {
+                                return std::unexpected(flushed.error());
+                            }
+
+                            handle->decoded_input_pending.reset();
+                            pending_prefix.clear();
+                            pending.clear();
+                            line.clear();
+                            cursor = 0;
+                            insert_mode = true;
+
+                            state.for_each_process([&](const ProcessState& process) noexcept {
+                                (void)host_io.send_end_task(
+                                    process.pid,
+                                    CTRL_BREAK_EVENT,
+                                    static_cast<DWORD>(core::console_ctrl_break_flag));
+                            });
+
+                            body.NumBytes = 0;
+                            message.set_reply_status(core::status_alerted);
+                            message.set_reply_information(0);
+                            return outcome;
+                        }
+
+                        if (processed_input && key_event_matches_ctrl_c(key))
+                        {
+                            state.for_each_process([&](const ProcessState& process) noexcept {
+                                (void)host_io.send_end_task(
+                                    process.pid,
+                                    CTRL_C_EVENT,
+                                    static_cast<DWORD>(core::console_ctrl_c_flag));
+                            });
+
+                            body.NumBytes = 0;
+                            message.set_reply_status(core::status_alerted);
+                            message.set_reply_information(0);
+                            return outcome;
+                        }
+
+                        const size_t repeat = std::max<size_t>(1, static_cast<size_t>(key.wRepeatCount));
+                        const bool ctrl_pressed = (key.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0;
+                        const WORD vkey = key.wVirtualKeyCode;
 
-                            const size_t tail_units = line.size() - cursor;
-                            if (auto echoed = echo_text(std::wstring_view(&value, 1)); !echoed)
+                        const auto word_prev = [&](const size_t index) noexcept -> size_t {
+                            size_t pos = index;
+                            while (pos != 0)
                             {
-                                return std::unexpected(echoed.error());
+                                const size_t prev = prev_index(pos);
+                                if (!is_word_delimiter(prev))
+                                {
+                                    break;
+                                }
+                                pos = prev;
                             }
 
-                            if (tail_units != 0)
+                            while (pos != 0)
                             {
-                                if (auto echoed = echo_text(std::wstring_view(line.data() + cursor, tail_units)); !echoed)
+                                const size_t prev = prev_index(pos);
+                                if (is_word_delimiter(prev))
                                 {
-                                    return std::unexpected(echoed.error());
+                                    break;
                                 }
+                                pos = prev;
                             }
 
-                            const size_t clear_units = removed_units > 1 ? removed_units - 1 : 0;
-                            if (clear_units != 0)
+                            return pos;
+                        };
+
+                        const auto word_next = [&](const size_t index) noexcept -> size_t {
+                            size_t pos = index;
+                            while (pos < line.size())
                             {
-                                if (auto echoed = echo_spaces(clear_units); !echoed)
+                                if (is_word_delimiter(pos))
                                 {
-                                    return std::unexpected(echoed.error());
+                                    break;
                                 }
+                                pos = next_index(pos);
                             }
 
-                            const size_t backspaces = tail_units + clear_units;
-                            if (backspaces != 0)
+                            while (pos < line.size())
                             {
-                                if (auto echoed = echo_backspaces(backspaces); !echoed)
+                                if (!is_word_delimiter(pos))
                                 {
-                                    return std::unexpected(echoed.error());
+                                    break;
                                 }
+                                pos = next_index(pos);
                             }
-                            return false;
+
+                            return pos;
                         };
 
-                        if (token.kind == vt_input::TokenKind::key_event)
+                        bool handled_edit_key = false;
+                        switch (vkey)
                         {
-                            const auto& key = token.key;
-                            if (!key.bKeyDown)
+                        case VK_INSERT:
+                            handled_edit_key = true;
+                            if ((repeat % 2) == 1)
                             {
-                                continue;
+                                insert_mode = !insert_mode;
                             }
-
-                            if (processed_input && key_event_matches_ctrl_break(key))
+                            break;
+                        case VK_ESCAPE:
+                            handled_edit_key = true;
+                            if (!line.empty())
                             {
-                                // Mirror the inbox host: Ctrl+Break flushes the input buffer, generates
-                                // a CTRL_BREAK_EVENT, and terminates cooked reads with STATUS_ALERTED.
-                                if (auto flushed = host_io.flush_input_buffer(); !flushed)
-                                {
-                                    return std::unexpected(flushed.error());
-                                }
-
-                                handle->decoded_input_pending.reset();
-                                pending_prefix.clear();
-                                pending.clear();
+                                const size_t old_size = line.size();
+                                const size_t old_cursor = cursor;
                                 line.clear();
                                 cursor = 0;
-                                insert_mode = true;
-
-                                state.for_each_process([&](const ProcessState& process) noexcept {
-                                    (void)host_io.send_end_task(
-                                        process.pid,
-                                        CTRL_BREAK_EVENT,
-                                        static_cast<DWORD>(core::console_ctrl_break_flag));
-                                });
-
-                                body.NumBytes = 0;
-                                message.set_reply_status(core::status_alerted);
-                                message.set_reply_information(0);
-                                return outcome;
-                            }
-
-                            if (processed_input && key_event_matches_ctrl_c(key))
-                            {
-                                state.for_each_process([&](const ProcessState& process) noexcept {
-                                    (void)host_io.send_end_task(
-                                        process.pid,
-                                        CTRL_C_EVENT,
-                                        static_cast<DWORD>(core::console_ctrl_c_flag));
-                                });
-
-                                body.NumBytes = 0;
-                                message.set_reply_status(core::status_alerted);
-                                message.set_reply_information(0);
-                                return outcome;
-                            }
-
-                            const size_t repeat = std::max<size_t>(1, static_cast<size_t>(key.wRepeatCount));
-                            const bool ctrl_pressed = (key.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0;
-                            const WORD vkey = key.wVirtualKeyCode;
-
-                            const auto word_prev = [&](const size_t index) noexcept -> size_t {
-                                size_t pos = index;
-                                while (pos != 0)
-                                {
-                                    const size_t prev = prev_index(pos);
-                                    if (!is_word_delimiter(prev))
-                                    {
-                                        break;
-                                    }
-                                    pos = prev;
-                                }
+                                normalize_cursor();
 
-                                while (pos != 0)
+                                if (auto echoed = echo_backspaces(old_cursor); !echoed)
                                 {
-                                    const size_t prev = prev_index(pos);
-                                    if (is_word_delimiter(prev))
-                                    {
-                                        break;
-                                    }
-                                    pos = prev;
+                                    return std::unexpected(echoed.error());
                                 }
-
-                                return pos;
-                            };
-
-                            const auto word_next = [&](const size_t index) noexcept -> size_t {
-                                size_t pos = index;
-                                while (pos < line.size())
+                                if (auto echoed = echo_spaces(old_size); !echoed)
                                 {
-                                    if (is_word_delimiter(pos))
-                                    {
-                                        break;
-                                    }
-                                    pos = next_index(pos);
+                                    return std::unexpected(echoed.error());
                                 }
-
-                                while (pos < line.size())
+                                if (auto echoed = echo_backspaces(old_size); !echoed)
                                 {
-                                    if (!is_word_delimiter(pos))
-                                    {
-                                        break;
-                                    }
-                                    pos = next_index(pos);
+                                    return std::unexpected(echoed.error());
                                 }
-
-                                return pos;
-                            };
-
-                            bool handled_edit_key = false;
-                            switch (vkey)
+                            }
+                            break;
+                        case VK_HOME:
+                            handled_edit_key = true;
+                            if (ctrl_pressed)
                             {
-                            case VK_INSERT:
-                                handled_edit_key = true;
-                                if ((repeat % 2) == 1)
-                                {
-                                    insert_mode = !insert_mode;
-                                }
-                                break;
-                            case VK_ESCAPE:
-                                handled_edit_key = true;
-                                if (!line.empty())
+                                const size_t removed_units = cursor;
+                                if (removed_units != 0)
                                 {
-                                    const size_t old_size = line.size();
-                                    const size_t old_cursor = cursor;
-                                    line.clear();
+                                    line.erase(0, removed_units);
                                     cursor = 0;
                                     normalize_cursor();
 
-                                    if (auto echoed = echo_backspaces(old_cursor); !echoed)
-                                    {
-                                        return std::unexpected(echoed.error());
-                                    }
-                                    if (auto echoed = echo_spaces(old_size); !echoed)
-                                    {
-                                        return std::unexpected(echoed.error());
-                                    }
-                                    if (auto echoed = echo_backspaces(old_size); !echoed)
+                                    if (auto echoed = echo_backspaces(removed_units); !echoed)
                                     {
                                         return std::unexpected(echoed.error());
                                     }
-                                }
-                                break;
-                            case VK_HOME:
-                                handled_edit_key = true;
-                                if (ctrl_pressed)
-                                {
-                                    const size_t removed_units = cursor;
-                                    if (removed_units != 0)
-                                    {
-                                        line.erase(0, removed_units);
-                                        cursor = 0;
-                                        normalize_cursor();
-
-                                        if (auto echoed = echo_backspaces(removed_units); !echoed)
-                                        {
-                                            return std::unexpected(echoed.error());
-                                        }
-                                        if (auto echoed = echo_range(0, line.size()); !echoed)
-                                        {
-                                            return std::unexpected(echoed.error());
-                                        }
-                                        if (auto echoed = echo_spaces(removed_units); !echoed)
-                                        {
-                                            return std::unexpected(echoed.error());
-                                        }
-                                        if (auto echoed = echo_backspaces(line.size() + removed_units); !echoed)
-                                        {
-                                            return std::unexpected(echoed.error());
-                                        }
-                                    }
-                                }
-                                else if (cursor != 0)
-                                {
-                                    const size_t moved = cursor;
-                                    cursor = 0;
-                                    normalize_cursor();
-                                    if (auto echoed = echo_backspaces(moved); !echoed)
+                                    if (auto echoed = echo_range(0, line.size()); !echoed)
                                     {
                                         return std::unexpected(echoed.error());
                                     }
-                                }
-                                break;
-                            case VK_END:
-                                handled_edit_key = true;
-                                if (ctrl_pressed)
-                                {
-                                    if (cursor < line.size())
-                                    {
-                                        const size_t removed_units = line.size() - cursor;
-                                        line.erase(cursor, removed_units);
-                                        normalize_cursor();
-
-                                        if (auto echoed = echo_spaces(removed_units); !echoed)
-                                        {
-                                            return std::unexpected(echoed.error());
-                                        }
-                                        if (auto echoed = echo_backspaces(removed_units); !echoed)
-                                        {
-                                            return std::unexpected(echoed.error());
-                                        }
-                                    }
-                                }
-                                else if (cursor < line.size())
-                                {
-                                    if (auto echoed = echo_range(cursor, line.size()); !echoed)
+                                    if (auto echoed = echo_spaces(removed_units); !echoed)
                                     {
                                         return std::unexpected(echoed.error());
                                     }
-                                    cursor = line.size();
-                                    normalize_cursor();
-                                }
-                                break;
-                            case VK_LEFT:
-                                handled_edit_key = true;
-                                for (size_t i = 0; i < repeat; ++i)
-                                {
-                                    if (cursor == 0)
-                                    {
-                                        break;
-                                    }
-
-                                    const size_t new_cursor = ctrl_pressed ? word_prev(cursor) : prev_index(cursor);
-                                    const size_t moved = cursor - new_cursor;
-                                    cursor = new_cursor;
-                                    normalize_cursor();
-                                    if (auto echoed = echo_backspaces(moved); !echoed)
+                                    if (auto echoed = echo_backspaces(line.size() + removed_units); !echoed)
                                     {
                                         return std::unexpected(echoed.error());
                                     }
                                 }
-                                break;
-                            case VK_RIGHT:
-                                handled_edit_key = true;
-                                for (size_t i = 0; i < repeat; ++i)
+                            }
+                            else if (cursor != 0)
+                            {
+                                const size_t moved = cursor;
+                                cursor = 0;
+                                normalize_cursor();
+                                if (auto echoed = echo_backspaces(moved); !echoed)
                                 {
-                                    if (cursor >= line.size())
-                                    {
-                                        break;
-                                    }
-
-                                    const size_t new_cursor = ctrl_pressed ? word_next(cursor) : next_index(cursor);
-                                    if (auto echoed = echo_range(cursor, new_cursor); !echoed)
-                                    {
-                                        return std::unexpected(echoed.error());
-                                    }
-                                    cursor = new_cursor;
-                                    normalize_cursor();
+                                    return std::unexpected(echoed.error());
                                 }
-                                break;
-                            case VK_DELETE:
-                                handled_edit_key = true;
-                                for (size_t i = 0; i < repeat; ++i)
+                            }
+                            break;
+                        case VK_END:
+                            handled_edit_key = true;
+                            if (ctrl_pressed)
+                            {
+                                if (cursor < line.size())
                                 {
-                                    if (cursor >= line.size())
-                                    {
-                                        break;
-                                    }
-
-                                    const size_t end = next_index(cursor);
-                                    const size_t removed_units = end - cursor;
-                                    if (removed_units == 0)
-                                    {
-                                        break;
-                                    }
-
+                                    const size_t removed_units = line.size() - cursor;
                                     line.erase(cursor, removed_units);
                                     normalize_cursor();
 
-                                    if (auto echoed = echo_range(cursor, line.size()); !echoed)
-                                    {
-                                        return std::unexpected(echoed.error());
-                                    }
                                     if (auto echoed = echo_spaces(removed_units); !echoed)
                                     {
                                         return std::unexpected(echoed.error());
                                     }
-                                    if (auto echoed = echo_backspaces((line.size() - cursor) + removed_units); !echoed)
+                                    if (auto echoed = echo_backspaces(removed_units); !echoed)
                                     {
                                         return std::unexpected(echoed.error());
                                     }
                                 }
-                                break;
-                            default:
-                                break;
                             }
-
-                            if (handled_edit_key)
+                            else if (cursor < line.size())
                             {
-                                continue;
+                                if (auto echoed = echo_range(cursor, line.size()); !echoed)
+                                {
+                                    return std::unexpected(echoed.error());
+                                }
+                                cursor = line.size();
+                                normalize_cursor();
                             }
-
-                            const wchar_t value = key.uChar.UnicodeChar;
-                            if (value == L'\0')
+                            break;
+                        case VK_LEFT:
+                            handled_edit_key = true;
+                            for (size_t i = 0; i < repeat; ++i)
                             {
-                                continue;
+                                if (cursor == 0)
+                                {
+                                    break;
+                                }
+
+                                const size_t new_cursor = ctrl_pressed ? word_prev(cursor) : prev_index(cursor);
+                                const size_t moved = cursor - new_cursor;
+                                cursor = new_cursor;
+                                normalize_cursor();
+                                if (auto echoed = echo_backspaces(moved); !echoed)
+                                {
+                                    return std::unexpected(echoed.error());
+                                }
                             }
+                            break;
+                        case VK_RIGHT:
+                            handled_edit_key = true;
+                            for (size_t i = 0; i < repeat; ++i)
+                            {
+                                if (cursor >= line.size())
+                                {
+                                    break;
+                                }
 
+                                const size_t new_cursor = ctrl_pressed ? word_next(cursor) : next_index(cursor);
+                                if (auto echoed = echo_range(cursor, new_cursor); !echoed)
+                                {
+                                    return std::unexpected(echoed.error());
+                                }
+                                cursor = new_cursor;
+                                normalize_cursor();
+                            }
+                            break;
+                        case VK_DELETE:
+                            handled_edit_key = true;
                             for (size_t i = 0; i < repeat; ++i)
                             {
-                                auto handled = handle_single_unit(value);
-                                if (!handled)
+                                if (cursor >= line.size())
+                                {
+                                    break;
+                                }
+
+                                const size_t end = next_index(cursor);
+                                const size_t removed_units = end - cursor;
+                                if (removed_units == 0)
+                                {
+                                    break;
+                                }
+
+                                line.erase(cursor, removed_units);
+                                normalize_cursor();
+
+                                if (auto echoed = echo_range(cursor, line.size()); !echoed)
+                                {
+                                    return std::unexpected(echoed.error());
+                                }
+                                if (auto echoed = echo_spaces(removed_units); !echoed)
                                 {
-                                    return std::unexpected(handled.error());
+                                    return std::unexpected(echoed.error());
                                 }
-                                if (handled.value())
+                                if (auto echoed = echo_backspaces((line.size() - cursor) + removed_units); !echoed)
                                 {
-                                    return outcome;
+                                    return std::unexpected(echoed.error());
                                 }
                             }
-                            continue;
+                            break;
+                        default:
+                            break;
                         }
 
-                        const auto& chunk = token.text;
-                        if (chunk.bytes_consumed == 0 || chunk.char_count == 0)
+                        if (handled_edit_key)
                         {
-                            break;
+                            continue;
                         }
 
-                        if (chunk.char_count == 1)
+                        const wchar_t value = key.uChar.UnicodeChar;
+                        if (value == L'\0')
                         {
-                            auto handled = handle_single_unit(chunk.chars[0]);
-                            if (!handled)
-                            {
-                                return std::unexpected(handled.error());
-                            }
-                            if (handled.value())
-                            {
-                                return outcome;
-                            }
                             continue;
                         }
 
-                        for (size_t i = 0; i < chunk.char_count; ++i)
+                        for (size_t i = 0; i < repeat; ++i)
                         {
-                            auto handled = handle_single_unit(chunk.chars[i]);
+                            auto handled = handle_single_unit(value);
                             if (!handled)
                             {
                                 return std::unexpected(handled.error());
@@ -8027,85 +9046,69 @@ namespace oc::logging
                                 return outcome;
                             }
                         }
-                    }
-
-                    if (host_io.input_disconnected())
-                    {
-                        pending_prefix.clear();
-                        line.clear();
-                        cursor = 0;
-                        message.set_reply_status(core::status_unsuccessful);
-                        message.set_reply_information(0);
-                        return outcome;
-                    }
-
-                    outcome.reply_pending = true;
-                    return outcome;
-                }
+                        continue;
+                    }
 
-                if (processed_input)
-                {
-                    // In processed input mode, Ctrl+C is handled by the host (it generates a CTRL_C_EVENT
-                    // and is not delivered as input to the client). For raw reads this does not terminate
-                    // the read; we simply consume the byte and continue waiting for real data.
-                    for (;;)
+                    const auto& chunk = token.text;
+                    if (chunk.bytes_consumed == 0 || chunk.char_count == 0)
                     {
-                        if (host_io.input_bytes_available() == 0)
-                        {
-                            break;
-                        }
+                        break;
+                    }
 
-                        std::array<std::byte, 1> first{};
-                        auto peeked = host_io.peek_input_bytes(first);
-                        if (!peeked)
+                    if (chunk.char_count == 1)
+                    {
+                        auto handled = handle_single_unit(chunk.chars[0]);
+                        if (!handled)
                         {
-                            return std::unexpected(peeked.error());
+                            return std::unexpected(handled.error());
                         }
-
-                        if (peeked.value() != 1 || first[0] != static_cast<std::byte>(0x03))
+                        if (handled.value())
                         {
-                            break;
+                            return outcome;
                         }
+                        continue;
+                    }
 
-                        auto removed = host_io.read_input_bytes(first);
-                        if (!removed)
+                    for (size_t i = 0; i < chunk.char_count; ++i)
+                    {
+                        auto handled = handle_single_unit(chunk.chars[i]);
+                        if (!handled)
                         {
-                            return std::unexpected(removed.error());
+                            return std::unexpected(handled.error());
                         }
-
-                        if (removed.value() != 1)
+                        if (handled.value())
                         {
-                            break;
+                            return outcome;
                         }
-
-                        state.for_each_process([&](const ProcessState& process) noexcept {
-                            (void)host_io.send_end_task(
-                                process.pid,
-                                CTRL_C_EVENT,
-                                static_cast<DWORD>(core::console_ctrl_c_flag));
-                        });
                     }
                 }
 
-                if (host_io.input_bytes_available() == 0 && pending_prefix.empty())
+                if (host_io.input_disconnected())
                 {
-                    const bool has_pending_unit = (body.Unicode != FALSE) && handle->decoded_input_pending.has_value();
-                    if (!has_pending_unit)
-                    {
-                        if (host_io.input_disconnected())
-                        {
-                            message.set_reply_status(core::status_unsuccessful);
-                            message.set_reply_information(0);
-                            return outcome;
-                        }
-
-                        outcome.reply_pending = true;
-                        return outcome;
-                    }
+                    pending_prefix.clear();
+                    line.clear();
+                    cursor = 0;
+                    message.set_reply_status(core::status_unsuccessful);
+                    message.set_reply_information(0);
+                    return outcome;
                 }
 
-                if (body.ProcessControlZ != FALSE && host_io.input_bytes_available() != 0)
+                outcome.reply_pending = true;
+                return outcome;
+            }
+
+            if (processed_input)
+            {
+                // In processed input mode, Ctrl+C is handled by the host (it generates a CTRL_C_EVENT
+                // and is not delivered as input to the client). For raw reads this does not terminate
+                // the read; we simply consume the byte and continue waiting for real data.
+                for (;;)
                 {
+                    if (host_io.input_bytes_available() == 0)
+                    {
+                        break;
+                    }
+
                     std::array<std::byte, 1> first{};
                     auto peeked = host_io.peek_input_bytes(first);
                     if (!peeked)
@@ -8113,580 +9116,571 @@ namespace oc::logging
                         return std::unexpected(peeked.error());
                     }
 
-                    if (peeked.value() == 1 && first[0] == static_cast<std::byte>(0x1a))
+                    if (peeked.value() != 1 || first[0] != static_cast<std::byte>(0x03))
                     {
-                        auto removed = host_io.read_input_bytes(first);
-                        if (!removed)
-                        {
-                            return std::unexpected(removed.error());
-                        }
+                        break;
+                    }
 
-                        body.NumBytes = 0;
-                        if (!output->empty())
-                        {
-                            output->front() = std::byte{ 0 };
-                        }
-                        message.set_reply_status(core::status_success);
-                        message.set_reply_information(0);
-                        return outcome;
+                    auto removed = host_io.read_input_bytes(first);
+                    if (!removed)
+                    {
+                        return std::unexpected(removed.error());
+                    }
+
+                    if (removed.value() != 1)
+                    {
+                        break;
                     }
+
+                    state.for_each_process([&](const ProcessState& process) noexcept {
+                        (void)host_io.send_end_task(
+                            process.pid,
+                            CTRL_C_EVENT,
+                            static_cast<DWORD>(core::console_ctrl_c_flag));
+                    });
                 }
+            }
 
-                if (body.Unicode)
+            if (host_io.input_bytes_available() == 0 && pending_prefix.empty())
+            {
+                const bool has_pending_unit = (body.Unicode != FALSE) && handle->decoded_input_pending.has_value();
+                if (!has_pending_unit)
                 {
-                    const size_t max_wchars = output->size() / sizeof(wchar_t);
-                    if (max_wchars == 0)
+                    if (host_io.input_disconnected())
                     {
-                        message.set_reply_status(core::status_success);
+                        message.set_reply_status(core::status_unsuccessful);
                         message.set_reply_information(0);
                         return outcome;
                     }
 
-                    const UINT code_page = static_cast<UINT>(state.input_code_page());
-                    auto* out_chars = reinterpret_cast<wchar_t*>(output->data());
-                    size_t written_units = 0;
+                    outcome.reply_pending = true;
+                    return outcome;
+                }
+            }
+
+            if (body.ProcessControlZ != FALSE && host_io.input_bytes_available() != 0)
+            {
+                std::array<std::byte, 1> first{};
+                auto peeked = host_io.peek_input_bytes(first);
+                if (!peeked)
+                {
+                    return std::unexpected(peeked.error());
+                }
 
-                    if (handle->decoded_input_pending && written_units < max_wchars)
+                if (peeked.value() == 1 && first[0] == static_cast<std::byte>(0x1a))
+                {
+                    auto removed = host_io.read_input_bytes(first);
+                    if (!removed)
                     {
-                        out_chars[written_units] = *handle->decoded_input_pending;
-                        handle->decoded_input_pending.reset();
-                        ++written_units;
+                        return std::unexpected(removed.error());
                     }
 
-                    // UTF-8/DBCS sequences can be split across reads. If the head of the stream is an
-                    // incomplete multibyte sequence and this read has not produced any output yet,
-                    // drain it into the per-handle prefix buffer and reply-pend until more input arrives.
-
-                    while (written_units < max_wchars)
+                    body.NumBytes = 0;
+                    if (!output->empty())
                     {
-                        if (host_io.input_bytes_available() == 0 && pending_prefix.empty())
-                        {
-                            if (written_units != 0)
-                            {
-                                break;
-                            }
+                        output->front() = std::byte{ 0 };
+                    }
+                    message.set_reply_status(core::status_success);
+                    message.set_reply_information(0);
+                    return outcome;
+                }
+            }
 
-                            if (host_io.input_disconnected())
-                            {
-                                message.set_reply_status(core::status_unsuccessful);
-                                message.set_reply_information(0);
-                                return outcome;
-                            }
+            if (body.Unicode)
+            {
+                const size_t max_wchars = output->size() / sizeof(wchar_t);
+                if (max_wchars == 0)
+                {
+                    message.set_reply_status(core::status_success);
+                    message.set_reply_information(0);
+                    return outcome;
+                }
 
-                            outcome.reply_pending = true;
-                            return outcome;
-                        }
+                const UINT code_page = static_cast<UINT>(state.input_code_page());
+                auto* out_chars = reinterpret_cast<wchar_t*>(output->data());
+                size_t written_units = 0;
 
-                        std::array<std::byte, 64> peek{};
-                        const size_t pending_before = pending_prefix.size();
-                        OC_ASSERT(pending_before <= peek.size());
-                        if (pending_before != 0)
-                        {
-                            const auto prefix = pending_prefix.bytes();
-                            std::memcpy(peek.data(), prefix.data(), pending_before);
-                        }
+                if (handle->decoded_input_pending && written_units < max_wchars)
+                {
+                    out_chars[written_units] = *handle->decoded_input_pending;
+                    handle->decoded_input_pending.reset();
+                    ++written_units;
+                }
 
-                        size_t peeked_bytes = 0;
-                        if (pending_before < peek.size())
-                        {
-                            auto peeked = host_io.peek_input_bytes(std::span<std::byte>(peek.data() + pending_before, peek.size() - pending_before));
-                            if (!peeked)
-                            {
-                                return std::unexpected(peeked.error());
-                            }
-                            peeked_bytes = peeked.value();
-                        }
+                // UTF-8/DBCS sequences can be split across reads. If the head of the stream is an
+                // incomplete multibyte sequence and this read has not produced any output yet,
+                // drain it into the per-handle prefix buffer and reply-pend until more input arrives.
 
-                        const size_t total_bytes = pending_before + peeked_bytes;
-                        if (total_bytes == 0)
+                while (written_units < max_wchars)
+                {
+                    if (host_io.input_bytes_available() == 0 && pending_prefix.empty())
+                    {
+                        if (written_units != 0)
                         {
-                            continue;
+                            break;
                         }
 
-                        vt_input::DecodedToken token{};
-                        const auto decode_outcome = decode_one_input_token(
-                            code_page,
-                            std::span<const std::byte>(peek.data(), total_bytes),
-                            token);
-                        if (decode_outcome == InputDecodeOutcome::need_more_data)
+                        if (host_io.input_disconnected())
                         {
-                            if (written_units != 0)
-                            {
-                                break;
-                            }
-
-                            if (peeked_bytes != 0)
-                            {
-                                const auto drained = std::span<const std::byte>(peek.data() + pending_before, peeked_bytes);
-                                if (pending_prefix.append(drained))
-                                {
-                                    size_t remaining_to_discard = peeked_bytes;
-                                    std::array<std::byte, 8> discard{};
-                                    while (remaining_to_discard != 0)
-                                    {
-                                        const size_t discard_count = std::min(remaining_to_discard, discard.size());
-                                        auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
-                                        if (!removed)
-                                        {
-                                            return std::unexpected(removed.error());
-                                        }
-
-                                        if (removed.value() == 0)
-                                        {
-                                            break;
-                                        }
-
-                                        remaining_to_discard -= removed.value();
-                                    }
-                                }
-                            }
-
-                            if (host_io.input_disconnected())
-                            {
-                                message.set_reply_status(core::status_unsuccessful);
-                                message.set_reply_information(0);
-                                return outcome;
-                            }
-
-                            outcome.reply_pending = true;
+                            message.set_reply_status(core::status_unsuccessful);
+                            message.set_reply_information(0);
                             return outcome;
                         }
 
-                        if (token.bytes_consumed == 0)
-                        {
-                            break;
-                        }
-
-                        const size_t remaining_units = max_wchars - written_units;
-                        bool split_surrogate = false;
-                        if (token.kind == vt_input::TokenKind::text_units && token.text.char_count > remaining_units)
-                        {
-                            if (token.text.char_count == 2 && remaining_units == 1)
-                            {
-                                split_surrogate = true;
-                            }
-                            else
-                            {
-                                break;
-                            }
-                        }
+                        outcome.reply_pending = true;
+                        return outcome;
+                    }
 
-                        const size_t pending_consumed = std::min(token.bytes_consumed, pending_before);
-                        pending_prefix.consume_prefix(pending_consumed);
+                    std::array<std::byte, 64> peek{};
+                    const size_t pending_before = pending_prefix.size();
+                    OC_ASSERT(pending_before <= peek.size());
+                    if (pending_before != 0)
+                    {
+                        const auto prefix = pending_prefix.bytes();
+                        std::memcpy(peek.data(), prefix.data(), pending_before);
+                    }
 
-                        size_t remaining_to_discard = token.bytes_consumed - pending_consumed;
-                        std::array<std::byte, 16> discard{};
-                        while (remaining_to_discard != 0)
+                    size_t peeked_bytes = 0;
+                    if (pending_before < peek.size())
+                    {
+                        auto peeked = host_io.peek_input_bytes(std::span<std::byte>(peek.data() + pending_before, peek.size() - pending_before));
+                        if (!peeked)
                         {
-                            const size_t discard_count = std::min(remaining_to_discard, discard.size());
-                            auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
-                            if (!removed)
-                            {
-                                return std::unexpected(removed.error());
-                            }
-
-                            if (removed.value() == 0)
-                            {
-                                remaining_to_discard = 0;
-                                break;
-                            }
-
-                            remaining_to_discard -= removed.value();
+                            return std::unexpected(peeked.error());
                         }
+                        peeked_bytes = peeked.value();
+                    }
 
-                        if (token.kind == vt_input::TokenKind::ignored_sequence)
+                    const size_t total_bytes = pending_before + peeked_bytes;
+                    if (total_bytes == 0)
+                    {
+                        continue;
+                    }
+
+                    vt_input::DecodedToken token{};
+                    const auto decode_outcome = decode_one_input_token(
+                        code_page,
+                        std::span<const std::byte>(peek.data(), total_bytes),
+                        token);
+                    if (decode_outcome == InputDecodeOutcome::need_more_data)
+                    {
+                        if (written_units != 0)
                         {
-                            continue;
+                            break;
                         }
 
-                        if (token.kind == vt_input::TokenKind::key_event)
+                        if (peeked_bytes != 0)
                         {
-                            const auto& key = token.key;
-                            if (processed_input && key.bKeyDown && key_event_matches_ctrl_break(key))
+                            const auto drained = std::span<const std::byte>(peek.data() + pending_before, peeked_bytes);
+                            if (pending_prefix.append(drained))
                             {
-                                // Mirror the inbox host: Ctrl+Break flushes the input buffer, generates a
-                                // CTRL_BREAK_EVENT, and terminates raw reads with STATUS_ALERTED.
-                                if (auto flushed = host_io.flush_input_buffer(); !flushed)
+                                size_t remaining_to_discard = peeked_bytes;
+                                std::array<std::byte, 8> discard{};
+                                while (remaining_to_discard != 0)
                                 {
-                                    return std::unexpected(flushed.error());
-                                }
-
-                                handle->decoded_input_pending.reset();
-                                pending_prefix.clear();
-                                handle->cooked_read_pending.clear();
-                                handle->cooked_line_in_progress.clear();
-
-                                state.for_each_process([&](const ProcessState& process) noexcept {
-                                    (void)host_io.send_end_task(
-                                        process.pid,
-                                        CTRL_BREAK_EVENT,
-                                        static_cast<DWORD>(core::console_ctrl_break_flag));
-                                });
-
-                                body.NumBytes = 0;
-                                message.set_reply_status(core::status_alerted);
-                                message.set_reply_information(0);
-                                return outcome;
-                            }
-                            if (processed_input && key.bKeyDown && key_event_matches_ctrl_c(key))
-                            {
-                                state.for_each_process([&](const ProcessState& process) noexcept {
-                                    (void)host_io.send_end_task(
-                                        process.pid,
-                                        CTRL_C_EVENT,
-                                        static_cast<DWORD>(core::console_ctrl_c_flag));
-                                });
-                                continue;
-                            }
-
-                            if (!key.bKeyDown)
-                            {
-                                continue;
-                            }
+                                    const size_t discard_count = std::min(remaining_to_discard, discard.size());
+                                    auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
+                                    if (!removed)
+                                    {
+                                        return std::unexpected(removed.error());
+                                    }
 
-                            const wchar_t value = key.uChar.UnicodeChar;
-                            if (value == L'\0')
-                            {
-                                continue;
-                            }
+                                    if (removed.value() == 0)
+                                    {
+                                        break;
+                                    }
 
-                            const size_t repeat = std::max<size_t>(1, static_cast<size_t>(key.wRepeatCount));
-                            const size_t to_write = std::min(repeat, max_wchars - written_units);
-                            for (size_t i = 0; i < to_write; ++i)
-                            {
-                                out_chars[written_units + i] = value;
+                                    remaining_to_discard -= removed.value();
+                                }
                             }
-                            written_units += to_write;
-                            continue;
                         }
 
-                        const auto& chunk = token.text;
-                        if (chunk.bytes_consumed == 0 || chunk.char_count == 0)
+                        if (host_io.input_disconnected())
                         {
-                            break;
+                            message.set_reply_status(core::status_unsuccessful);
+                            message.set_reply_information(0);
+                            return outcome;
                         }
 
-                        if (processed_input && chunk.char_count == 1 && chunk.chars[0] == static_cast<wchar_t>(0x0003))
+                        outcome.reply_pending = true;
+                        return outcome;
+                    }
+
+                    if (token.bytes_consumed == 0)
+                    {
+                        break;
+                    }
+
+                    const size_t remaining_units = max_wchars - written_units;
+                    bool split_surrogate = false;
+                    if (token.kind == vt_input::TokenKind::text_units && token.text.char_count > remaining_units)
+                    {
+                        if (token.text.char_count == 2 && remaining_units == 1)
                         {
-                            state.for_each_process([&](const ProcessState& process) noexcept {
-                                (void)host_io.send_end_task(
-                                    process.pid,
-                                    CTRL_C_EVENT,
-                                    static_cast<DWORD>(core::console_ctrl_c_flag));
-                            });
-                            continue;
+                            split_surrogate = true;
                         }
-
-                        if (split_surrogate)
+                        else
                         {
-                            out_chars[written_units] = chunk.chars[0];
-                            handle->decoded_input_pending = chunk.chars[1];
-                            ++written_units;
                             break;
                         }
+                    }
+
+                    const size_t pending_consumed = std::min(token.bytes_consumed, pending_before);
+                    pending_prefix.consume_prefix(pending_consumed);
 
-                        for (size_t i = 0; i < chunk.char_count; ++i)
+                    size_t remaining_to_discard = token.bytes_consumed - pending_consumed;
+                    std::array<std::byte, 16> discard{};
+                    while (remaining_to_discard != 0)
+                    {
+                        const size_t discard_count = std::min(remaining_to_discard, discard.size());
+                        auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
+                        if (!removed)
                         {
-                            out_chars[written_units + i] = chunk.chars[i];
+                            return std::unexpected(removed.error());
                         }
-                        written_units += chunk.char_count;
 
-                        if (host_io.input_bytes_available() == 0 && pending_prefix.empty())
+                        if (removed.value() == 0)
                         {
+                            remaining_to_discard = 0;
                             break;
                         }
+
+                        remaining_to_discard -= removed.value();
                     }
 
-                    const size_t bytes_out = written_units * sizeof(wchar_t);
-                    body.NumBytes = bytes_out > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                        ? std::numeric_limits<ULONG>::max()
-                        : static_cast<ULONG>(bytes_out);
-                }
-                else
-                {
-                    // Raw ANSI reads are byte-oriented. We preserve the legacy behavior for non-VT bytes,
-                    // but VT input sequences (win32-input-mode, DA1/focus responses, basic cursor keys)
-                    // are consumed and never leak to the client as literal escape bytes.
-                    //
-                    // For win32-input-mode character keys, we encode the UnicodeChar as the configured
-                    // input code page. Non-character key events (arrows, function keys) are consumed and
-                    // ignored, matching the inbox host's "ReadConsole returns characters" contract.
+                    if (token.kind == vt_input::TokenKind::ignored_sequence)
+                    {
+                        continue;
+                    }
 
-                    const UINT code_page = static_cast<UINT>(state.input_code_page());
-                    size_t bytes_written = 0;
+                    if (token.kind == vt_input::TokenKind::key_event)
+                    {
+                        const auto& key = token.key;
+                        if (processed_input && key.bKeyDown && key_event_matches_ctrl_break(key))
+                        {
+                            // Mirror the inbox host: Ctrl+Break flushes the input buffer, generates a
+                            // CTRL_BREAK_EVENT, and terminates raw reads with STATUS_ALERTED.
+                            if (auto flushed = host_io.flush_input_buffer(); !flushed)
+                            {
+                                return std::unexpected(flushed.error());
+                            }
+
+                            handle->decoded_input_pending.reset();
+                            pending_prefix.clear();
+                            handle->cooked_read_pending.clear();
+                            handle->cooked_line_in_progress.clear();
 
-                    const auto consume_from_stream = [&](const size_t byte_count) noexcept
-                        -> std::expected<void, DeviceCommError> {
-                        if (byte_count == 0)
+                            state.for_each_process([&](const ProcessState& process) noexcept {
+                                (void)host_io.send_end_task(
+                                    process.pid,
+                                    CTRL_BREAK_EVENT,
+                                    static_cast<DWORD>(core::console_ctrl_break_flag));
+                            });
+
+                            body.NumBytes = 0;
+                            message.set_reply_status(core::status_alerted);
+                            message.set_reply_information(0);
+                            return outcome;
+                        }
+                        if (processed_input && key.bKeyDown && key_event_matches_ctrl_c(key))
                         {
-                            return {};
+                            state.for_each_process([&](const ProcessState& process) noexcept {
+                                (void)host_io.send_end_task(
+                                    process.pid,
+                                    CTRL_C_EVENT,
+                                    static_cast<DWORD>(core::console_ctrl_c_flag));
+                            });
+                            continue;
                         }
 
-                        const size_t pending_before = pending_prefix.size();
-                        const size_t pending_consumed = std::min(byte_count, pending_before);
-                        pending_prefix.consume_prefix(pending_consumed);
-
-                        size_t remaining_to_discard = byte_count - pending_consumed;
-                        std::array<std::byte, 16> discard{};
-                        while (remaining_to_discard != 0)
+                        if (!key.bKeyDown)
                         {
-                            const size_t discard_count = std::min(remaining_to_discard, discard.size());
-                            auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
-                            if (!removed)
-                            {
-                                return std::unexpected(removed.error());
-                            }
+                            continue;
+                        }
 
-                            if (removed.value() == 0)
-                            {
-                                break;
-                            }
+                        const wchar_t value = key.uChar.UnicodeChar;
+                        if (value == L'\0')
+                        {
+                            continue;
+                        }
 
-                            remaining_to_discard -= removed.value();
+                        const size_t repeat = std::max<size_t>(1, static_cast<size_t>(key.wRepeatCount));
+                        const size_t to_write = std::min(repeat, max_wchars - written_units);
+                        for (size_t i = 0; i < to_write; ++i)
+                        {
+                            out_chars[written_units + i] = value;
                         }
+                        written_units += to_write;
+                        continue;
+                    }
 
-                        return {};
-                    };
+                    const auto& chunk = token.text;
+                    if (chunk.bytes_consumed == 0 || chunk.char_count == 0)
+                    {
+                        break;
+                    }
 
-                    auto forward_ctrl_c = [&]() noexcept {
+                    if (processed_input && chunk.char_count == 1 && chunk.chars[0] == static_cast<wchar_t>(0x0003))
+                    {
                         state.for_each_process([&](const ProcessState& process) noexcept {
                             (void)host_io.send_end_task(
                                 process.pid,
                                 CTRL_C_EVENT,
                                 static_cast<DWORD>(core::console_ctrl_c_flag));
                         });
-                    };
+                        continue;
+                    }
 
-                    std::array<std::byte, 64> head{};
-                    std::array<char, 16> encoded{};
+                    if (split_surrogate)
+                    {
+                        out_chars[written_units] = chunk.chars[0];
+                        handle->decoded_input_pending = chunk.chars[1];
+                        ++written_units;
+                        break;
+                    }
 
-                    for (;;)
+                    for (size_t i = 0; i < chunk.char_count; ++i)
                     {
-                        if (bytes_written >= output->size())
-                        {
-                            break;
-                        }
+                        out_chars[written_units + i] = chunk.chars[i];
+                    }
+                    written_units += chunk.char_count;
 
-                        if (host_io.input_bytes_available() == 0 && pending_prefix.empty())
-                        {
-                            break;
-                        }
+                    if (host_io.input_bytes_available() == 0 && pending_prefix.empty())
+                    {
+                        break;
+                    }
+                }
 
-                        const size_t pending_before = pending_prefix.size();
-                        OC_ASSERT(pending_before <= head.size());
-                        if (pending_before != 0)
-                        {
-                            const auto prefix = pending_prefix.bytes();
-                            std::memcpy(head.data(), prefix.data(), pending_before);
-                        }
+                const size_t bytes_out = written_units * sizeof(wchar_t);
+                body.NumBytes = bytes_out > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                    ? std::numeric_limits<ULONG>::max()
+                    : static_cast<ULONG>(bytes_out);
+            }
+            else
+            {
+                // Raw ANSI reads are byte-oriented. We preserve the legacy behavior for non-VT bytes,
+                // but VT input sequences (win32-input-mode, DA1/focus responses, basic cursor keys)
+                // are consumed and never leak to the client as literal escape bytes.
+                //
+                // For win32-input-mode character keys, we encode the UnicodeChar as the configured
+                // input code page. Non-character key events (arrows, function keys) are consumed and
+                // ignored, matching the inbox host's "ReadConsole returns characters" contract.
+
+                const UINT code_page = static_cast<UINT>(state.input_code_page());
+                size_t bytes_written = 0;
+
+                const auto consume_from_stream = [&](const size_t byte_count) noexcept
+                    -> std::expected<void, DeviceCommError> {
+                    if (byte_count == 0)
+                    {
+                        return {};
+                    }
 
-                        size_t peeked_bytes = 0;
-                        if (pending_before < head.size())
+                    const size_t pending_before = pending_prefix.size();
+                    const size_t pending_consumed = std::min(byte_count, pending_before);
+                    pending_prefix.consume_prefix(pending_consumed);
+
+                    size_t remaining_to_discard = byte_count - pending_consumed;
+                    std::array<std::byte, 16> discard{};
+                    while (remaining_to_discard != 0)
+                    {
+                        const size_t discard_count = std::min(remaining_to_discard, discard.size());
+                        auto removed = host_io.read_input_bytes(std::span<std::byte>(discard.data(), discard_count));
+                        if (!removed)
                         {
-                            const size_t available = host_io.input_bytes_available();
-                            const size_t to_peek = std::min(available, head.size() - pending_before);
-                            if (to_peek != 0)
-                            {
-                                auto peeked = host_io.peek_input_bytes(std::span<std::byte>(head.data() + pending_before, to_peek));
-                                if (!peeked)
-                                {
-                                    return std::unexpected(peeked.error());
-                                }
-                                peeked_bytes = peeked.value();
-                            }
+                            return std::unexpected(removed.error());
                         }
 
-                        const size_t total_bytes = pending_before + peeked_bytes;
-                        if (total_bytes == 0)
+                        if (removed.value() == 0)
                         {
                             break;
                         }
 
-                        vt_input::DecodedToken token{};
-                        auto vt_outcome = vt_input::try_decode_vt(std::span<const std::byte>(head.data(), total_bytes), token);
-                        if (vt_outcome == vt_input::DecodeResult::need_more_data && total_bytes == head.size())
-                        {
-                            // The token exceeds our supported buffering; fall back to raw byte consumption to
-                            // avoid leaving the input stream in a permanently pending state.
-                            vt_outcome = vt_input::DecodeResult::no_match;
-                        }
+                        remaining_to_discard -= removed.value();
+                    }
 
-                        if (vt_outcome == vt_input::DecodeResult::need_more_data)
-                        {
-                            if (bytes_written != 0)
-                            {
-                                break;
-                            }
+                    return {};
+                };
 
-                            if (peeked_bytes != 0)
-                            {
-                                const auto drained = std::span<const std::byte>(head.data() + pending_before, peeked_bytes);
-                                if (pending_prefix.append(drained))
-                                {
-                                    size_t remaining_to_discard = peeked_bytes;
-                                    std::array<std::byte, 16> drain_discard{};
-                                    while (remaining_to_discard != 0)
-                                    {
-                                        const size_t discard_count = std::min(remaining_to_discard, drain_discard.size());
-                                        auto removed = host_io.read_input_bytes(std::span<std::byte>(drain_discard.data(), discard_count));
-                                        if (!removed)
-                                        {
-                                            return std::unexpected(removed.error());
-                                        }
+                auto forward_ctrl_c = [&]() noexcept {
+                    state.for_each_process([&](const ProcessState& process) noexcept {
+                        (void)host_io.send_end_task(
+                            process.pid,
+                            CTRL_C_EVENT,
+                            static_cast<DWORD>(core::console_ctrl_c_flag));
+                    });
+                };
 
-                                        if (removed.value() == 0)
-                                        {
-                                            break;
-                                        }
+                std::array<std::byte, 64> head{};
+                std::array<char, 16> encoded{};
 
-                                        remaining_to_discard -= removed.value();
-                                    }
-                                }
-                            }
+                for (;;)
+                {
+                    if (bytes_written >= output->size())
+                    {
+                        break;
+                    }
 
-                            if (host_io.input_disconnected())
-                            {
-                                message.set_reply_status(core::status_unsuccessful);
-                                message.set_reply_information(0);
-                                return outcome;
-                            }
+                    if (host_io.input_bytes_available() == 0 && pending_prefix.empty())
+                    {
+                        break;
+                    }
 
-                            outcome.reply_pending = true;
-                            return outcome;
-                        }
+                    const size_t pending_before = pending_prefix.size();
+                    OC_ASSERT(pending_before <= head.size());
+                    if (pending_before != 0)
+                    {
+                        const auto prefix = pending_prefix.bytes();
+                        std::memcpy(head.data(), prefix.data(), pending_before);
+                    }
 
-                        if (vt_outcome == vt_input::DecodeResult::produced)
+                    size_t peeked_bytes = 0;
+                    if (pending_before < head.size())
+                    {
+                        const size_t available = host_io.input_bytes_available();
+                        const size_t to_peek = std::min(available, head.size() - pending_before);
+                        if (to_peek != 0)
                         {
-                            if (token.bytes_consumed == 0)
+                            auto peeked = host_io.peek_input_bytes(std::span<std::byte>(head.data() + pending_before, to_peek));
+                            if (!peeked)
                             {
-                                break;
+                                return std::unexpected(peeked.error());
                             }
+                            peeked_bytes = peeked.value();
+                        }
+                    }
 
-                            if (token.kind == vt_input::TokenKind::ignored_sequence)
-                            {
-                                if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
-                                {
-                                    return std::unexpected(consumed.error());
-                                }
-                                continue;
-                            }
+                    const size_t total_bytes = pending_before + peeked_bytes;
+                    if (total_bytes == 0)
+                    {
+                        break;
+                    }
+
+                    vt_input::DecodedToken token{};
+                    auto vt_outcome = vt_input::try_decode_vt(std::span<const std::byte>(head.data(), total_bytes), token);
+                    if (vt_outcome == vt_input::DecodeResult::need_more_data && total_bytes == head.size())
+                    {
+                        // The token exceeds our supported buffering; fall back to raw byte consumption to
+                        // avoid leaving the input stream in a permanently pending state.
+                        vt_outcome = vt_input::DecodeResult::no_match;
+                    }
+
+                    if (vt_outcome == vt_input::DecodeResult::need_more_data)
+                    {
+                        if (bytes_written != 0)
+                        {
+                            break;
+                        }
 
-                            if (token.kind == vt_input::TokenKind::key_event)
+                        if (peeked_bytes != 0)
+                        {
+                            const auto drained = std::span<const std::byte>(head.data() + pending_before, peeked_bytes);
+                            if (pending_prefix.append(drained))
                             {
-                                const auto& key = token.key;
-                                if (processed_input && key.bKeyDown && key_event_matches_ctrl_break(key))
+                                size_t remaining_to_discard = peeked_bytes;
+                                std::array<std::byte, 16> drain_discard{};
+                                while (remaining_to_discard != 0)
                                 {
-                                    if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
+                                    const size_t discard_count = std::min(remaining_to_discard, drain_discard.size());
+                                    auto removed = host_io.read_input_bytes(std::span<std::byte>(drain_discard.data(), discard_count));
+                                    if (!removed)
                                     {
-                                        return std::unexpected(consumed.error());
+                                        return std::unexpected(removed.error());
                                     }
 
-                                    // Mirror the inbox host: Ctrl+Break flushes the input buffer and terminates
-                                    // raw reads with STATUS_ALERTED.
-                                    if (auto flushed = host_io.flush_input_buffer(); !flushed)
+                                    if (removed.value() == 0)
                                     {
-                                        return std::unexpected(flushed.error());
+                                        break;
                                     }
 
-                                    handle->decoded_input_pending.reset();
-                                    pending_prefix.clear();
-                                    handle->cooked_read_pending.clear();
-                                    handle->cooked_line_in_progress.clear();
-
-                                    state.for_each_process([&](const ProcessState& process) noexcept {
-                                        (void)host_io.send_end_task(
-                                            process.pid,
-                                            CTRL_BREAK_EVENT,
-                                            static_cast<DWORD>(core::console_ctrl_break_flag));
-                                    });
-
-                                    body.NumBytes = 0;
-                                    message.set_reply_status(core::status_alerted);
-                                    message.set_reply_information(0);
-                                    return outcome;
-                                }
-                                if (processed_input && key.bKeyDown && key_event_matches_ctrl_c(key))
-                                {
-                                    if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
-                                    {
-                                        return std::unexpected(consumed.error());
-                                    }
-                                    forward_ctrl_c();
-                                    continue;
+                                    remaining_to_discard -= removed.value();
                                 }
+                            }
+                        }
 
-                                if (!key.bKeyDown)
-                                {
-                                    if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
-                                    {
-                                        return std::unexpected(consumed.error());
-                                    }
-                                    continue;
-                                }
+                        if (host_io.input_disconnected())
+                        {
+                            message.set_reply_status(core::status_unsuccessful);
+                            message.set_reply_information(0);
+                            return outcome;
+                        }
 
-                                const wchar_t value = key.uChar.UnicodeChar;
-                                if (value == L'\0')
-                                {
-                                    if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
-                                    {
-                                        return std::unexpected(consumed.error());
-                                    }
-                                    continue;
-                                }
+                        outcome.reply_pending = true;
+                        return outcome;
+                    }
 
-                                const size_t remaining = output->size() - bytes_written;
-                                const wchar_t src = value;
-                                const int required = ::WideCharToMultiByte(
-                                    code_page,
-                                    0,
-                                    &src,
-                                    1,
-                                    nullptr,
-                                    0,
-                                    nullptr,
-                                    nullptr);
-                                if (required <= 0)
-                                {
-                                    message.set_reply_status(core::status_invalid_parameter);
-                                    message.set_reply_information(0);
-                                    return outcome;
-                                }
+                    if (vt_outcome == vt_input::DecodeResult::produced)
+                    {
+                        if (token.bytes_consumed == 0)
+                        {
+                            break;
+                        }
+
+                        if (token.kind == vt_input::TokenKind::ignored_sequence)
+                        {
+                            if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
+                            {
+                                return std::unexpected(consumed.error());
+                            }
+                            continue;
+                        }
 
-                                if (static_cast<size_t>(required) > remaining)
+                        if (token.kind == vt_input::TokenKind::key_event)
+                        {
+                            const auto& key = token.key;
+                            if (processed_input && key.bKeyDown && key_event_matches_ctrl_break(key))
+                            {
+                                if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
                                 {
-                                    // Not enough space: preserve the VT sequence for the next read.
-                                    break;
+                                    return std::unexpected(consumed.error());
                                 }
 
-                                if (static_cast<size_t>(required) > encoded.size())
+                                // Mirror the inbox host: Ctrl+Break flushes the input buffer and terminates
+                                // raw reads with STATUS_ALERTED.
+                                if (auto flushed = host_io.flush_input_buffer(); !flushed)
                                 {
-                                    message.set_reply_status(core::status_invalid_parameter);
-                                    message.set_reply_information(0);
-                                    return outcome;
+                                    return std::unexpected(flushed.error());
                                 }
 
-                                const int converted = ::WideCharToMultiByte(
-                                    code_page,
-                                    0,
-                                    &src,
-                                    1,
-                                    encoded.data(),
-                                    required,
-                                    nullptr,
-                                    nullptr);
-                                if (converted != required)
+                                handle->decoded_input_pending.reset();
+                                pending_prefix.clear();
+                                handle->cooked_read_pending.clear();
+                                handle->cooked_line_in_progress.clear();
+
+                                state.for_each_process([&](const ProcessState& process) noexcept {
+                                    (void)host_io.send_end_task(
+                                        process.pid,
+                                        CTRL_BREAK_EVENT,
+                                        static_cast<DWORD>(core::console_ctrl_break_flag));
+                                });
+
+                                body.NumBytes = 0;
+                                message.set_reply_status(core::status_alerted);
+                                message.set_reply_information(0);
+                                return outcome;
+                            }
+                            if (processed_input && key.bKeyDown && key_event_matches_ctrl_c(key))
+                            {
+                                if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
                                 {
-                                    message.set_reply_status(core::status_invalid_parameter);
-                                    message.set_reply_information(0);
-                                    return outcome;
+                                    return std::unexpected(consumed.error());
                                 }
+                                forward_ctrl_c();
+                                continue;
+                            }
 
-                                for (int i = 0; i < required; ++i)
+                            if (!key.bKeyDown)
+                            {
+                                if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
                                 {
-                                    (*output)[bytes_written + static_cast<size_t>(i)] = static_cast<std::byte>(encoded[static_cast<size_t>(i)]);
+                                    return std::unexpected(consumed.error());
                                 }
-                                bytes_written += static_cast<size_t>(required);
+                                continue;
+                            }
 
+                            const wchar_t value = key.uChar.UnicodeChar;
+                            if (value == L'\0')
+                            {
                                 if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
                                 {
                                     return std::unexpected(consumed.error());
@@ -8694,60 +9688,306 @@ namespace oc::logging
                                 continue;
                             }
 
-                            if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
+                            const size_t remaining = output->size() - bytes_written;
+                            const wchar_t src = value;
+                            const int required = ::WideCharToMultiByte(
+                                code_page,
+                                0,
+                                &src,
+                                1,
+                                nullptr,
+                                0,
+                                nullptr,
+                                nullptr);
+                            if (required <= 0)
                             {
-                                return std::unexpected(consumed.error());
+                                message.set_reply_status(core::status_invalid_parameter);
+                                message.set_reply_information(0);
+                                return outcome;
                             }
-                            continue;
-                        }
 
-                        // No VT match: preserve the legacy raw-byte behavior (except Ctrl+C filtering in processed mode).
-                        const std::byte value = head[0];
-                        if (processed_input && value == static_cast<std::byte>(0x03))
-                        {
-                            if (auto consumed = consume_from_stream(1); !consumed)
+                            if (static_cast<size_t>(required) > remaining)
+                            {
+                                // Not enough space: preserve the VT sequence for the next read.
+                                break;
+                            }
+
+                            if (static_cast<size_t>(required) > encoded.size())
+                            {
+                                message.set_reply_status(core::status_invalid_parameter);
+                                message.set_reply_information(0);
+                                return outcome;
+                            }
+
+                            const int converted = ::WideCharToMultiByte(
+                                code_page,
+                                0,
+                                &src,
+                                1,
+                                encoded.data(),
+                                required,
+                                nullptr,
+                                nullptr);
+                            if (converted != required)
+                            {
+                                message.set_reply_status(core::status_invalid_parameter);
+                                message.set_reply_information(0);
+                                return outcome;
+                            }
+
+                            for (int i = 0; i < required; ++i)
+                            {
+                                (*output)[bytes_written + static_cast<size_t>(i)] = static_cast<std::byte>(encoded[static_cast<size_t>(i)]);
+                            }
+                            bytes_written += static_cast<size_t>(required);
+
+                            if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
                             {
                                 return std::unexpected(consumed.error());
                             }
-                            forward_ctrl_c();
                             continue;
                         }
 
-                        (*output)[bytes_written] = value;
-                        ++bytes_written;
-
-                        if (auto consumed = consume_from_stream(1); !consumed)
+                        if (auto consumed = consume_from_stream(token.bytes_consumed); !consumed)
                         {
                             return std::unexpected(consumed.error());
                         }
+                        continue;
                     }
 
-                    if (bytes_written == 0 && host_io.input_bytes_available() == 0 && pending_prefix.empty())
+                    // No VT match: preserve the legacy raw-byte behavior (except Ctrl+C filtering in processed mode).
+                    const std::byte value = head[0];
+                    if (processed_input && value == static_cast<std::byte>(0x03))
                     {
-                        if (host_io.input_disconnected())
+                        if (auto consumed = consume_from_stream(1); !consumed)
                         {
-                            message.set_reply_status(core::status_unsuccessful);
-                            message.set_reply_information(0);
-                            return outcome;
+                            return std::unexpected(consumed.error());
                         }
+                        forward_ctrl_c();
+                        continue;
+                    }
 
-                        outcome.reply_pending = true;
+                    (*output)[bytes_written] = value;
+                    ++bytes_written;
+
+                    if (auto consumed = consume_from_stream(1); !consumed)
+                    {
+                        return std::unexpected(consumed.error());
+                    }
+                }
+
+                if (bytes_written == 0 && host_io.input_bytes_available() == 0 && pending_prefix.empty())
+                {
+                    if (host_io.input_disconnected())
+                    {
+                        message.set_reply_status(core::status_unsuccessful);
+                        message.set_reply_information(0);
                         return outcome;
                     }
 
-                    body.NumBytes = bytes_written > static_cast<size_t>(std::numeric_limits<ULONG>::max())
-                        ? std::numeric_limits<ULONG>::max()
-                        : static_cast<ULONG>(bytes_written);
+                    outcome.reply_pending = true;
+                    return outcome;
                 }
 
-                message.set_reply_status(core::status_success);
-                message.set_reply_information(body.NumBytes);
-                return outcome;
+                body.NumBytes = bytes_written > static_cast<size_t>(std::numeric_limits<ULONG>::max())
+                    ? std::numeric_limits<ULONG>::max()
+                    : static_cast<ULONG>(bytes_written);
             }
 
-            reject_user_defined_not_implemented();
+            message.set_reply_status(core::status_success);
+            message.set_reply_information(body.NumBytes);
             return outcome;
         }
+
+        template<typename Comm, typename HostIo>
+        using UserDefinedHandler = std::expected<DispatchOutcome, DeviceCommError> (*)(
+            UserDefinedDispatchContext<Comm, HostIo>&) noexcept;
+
+        // `ApiNumber` is `(layer << 24) | index` (see `CONSOLE_FIRST_API_NUMBER`). Layers 1..3 are
+        // defined; the largest (layer 3) has 45 entries.
+        inline constexpr size_t user_defined_layer_count = 4;
+        inline constexpr size_t user_defined_layer_capacity = 64;
+        inline constexpr ULONG user_defined_index_mask = 0x00FF'FFFF;
+
+        static_assert((static_cast<ULONG>(ConsolepMapBitmap) & user_defined_index_mask) < user_defined_layer_capacity);
+        static_assert((static_cast<ULONG>(ConsolepSetTitle) & user_defined_index_mask) < user_defined_layer_capacity);
+        static_assert((static_cast<ULONG>(ConsolepSetCurrentFont) & user_defined_index_mask) < user_defined_layer_capacity);
+
+        template<typename Comm, typename HostIo>
+        using UserDefinedDispatchTable = std::array<
+            std::array<UserDefinedHandler<Comm, HostIo>, user_defined_layer_capacity>,
+            user_defined_layer_count>;
+
+        // Built at compile time; entries left null are rejected with STATUS_NOT_IMPLEMENTED.
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] consteval UserDefinedDispatchTable<Comm, HostIo> make_user_defined_dispatch_table() noexcept
+        {
+            UserDefinedDispatchTable<Comm, HostIo> table{};
+            const auto bind = [&table](const auto api, const UserDefinedHandler<Comm, HostIo> handler) {
+                const auto api_number = static_cast<ULONG>(api);
+                table[api_number >> 24][api_number & user_defined_index_mask] = handler;
+            };
+
+            // Layer 1.
+            bind(ConsolepGetCP, &handle_get_cp<Comm, HostIo>);
+            bind(ConsolepGetMode, &handle_get_mode<Comm, HostIo>);
+            bind(ConsolepSetMode, &handle_set_mode<Comm, HostIo>);
+            bind(ConsolepGetNumberOfInputEvents, &handle_get_number_of_input_events<Comm, HostIo>);
+            bind(ConsolepGetConsoleInput, &handle_get_console_input<Comm, HostIo>);
+            bind(ConsolepReadConsole, &handle_read_console<Comm, HostIo>);
+            bind(ConsolepWriteConsole, &handle_write_console<Comm, HostIo>);
+            bind(ConsolepNotifyLastClose, &handle_notify_last_close<Comm, HostIo>);
+            bind(ConsolepGetLangId, &handle_get_lang_id<Comm, HostIo>);
+            bind(ConsolepMapBitmap, &handle_deprecated_api<Comm, HostIo>);
+            // Layer 2.
+            bind(ConsolepFillConsoleOutput, &handle_fill_console_output<Comm, HostIo>);
+            bind(ConsolepGenerateCtrlEvent, &handle_generate_ctrl_event<Comm, HostIo>);
+            bind(ConsolepSetActiveScreenBuffer, &handle_set_active_screen_buffer<Comm, HostIo>);
+            bind(ConsolepFlushInputBuffer, &handle_flush_input_buffer<Comm, HostIo>);
+            bind(ConsolepSetCP, &handle_set_cp<Comm, HostIo>);
+            bind(ConsolepGetCursorInfo, &handle_get_cursor_info<Comm, HostIo>);
+            bind(ConsolepSetCursorInfo, &handle_set_cursor_info<Comm, HostIo>);
+            bind(ConsolepGetScreenBufferInfo, &handle_get_screen_buffer_info<Comm, HostIo>);
+            bind(ConsolepSetScreenBufferInfo, &handle_set_screen_buffer_info<Comm, HostIo>);
+            bind(ConsolepSetScreenBufferSize, &handle_set_screen_buffer_size<Comm, HostIo>);
+            bind(ConsolepSetCursorPosition, &handle_set_cursor_position<Comm, HostIo>);
+            bind(ConsolepGetLargestWindowSize, &handle_get_largest_window_size<Comm, HostIo>);
+            bind(ConsolepScrollScreenBuffer, &handle_scroll_screen_buffer<Comm, HostIo>);
+            bind(ConsolepSetTextAttribute, &handle_set_text_attribute<Comm, HostIo>);
+            bind(ConsolepSetWindowInfo, &handle_set_window_info<Comm, HostIo>);
+            bind(ConsolepReadConsoleOutputString, &handle_read_console_output_string<Comm, HostIo>);
+            bind(ConsolepWriteConsoleInput, &handle_write_console_input<Comm, HostIo>);
+            bind(ConsolepWriteConsoleOutput, &handle_write_console_output<Comm, HostIo>);
+            bind(ConsolepWriteConsoleOutputString, &handle_write_console_output_string<Comm, HostIo>);
+            bind(ConsolepReadConsoleOutput, &handle_read_console_output<Comm, HostIo>);
+            bind(ConsolepGetTitle, &handle_get_title<Comm, HostIo>);
+            bind(ConsolepSetTitle, &handle_set_title<Comm, HostIo>);
+            // Layer 3.
+            bind(ConsolepGetNumberOfFonts, &handle_get_number_of_fonts<Comm, HostIo>);
+            bind(ConsolepGetMouseInfo, &handle_get_mouse_info<Comm, HostIo>);
+            bind(ConsolepGetFontInfo, &handle_get_font_info<Comm, HostIo>);
+            bind(ConsolepGetFontSize, &handle_get_font_size<Comm, HostIo>);
+            bind(ConsolepGetCurrentFont, &handle_get_current_font<Comm, HostIo>);
+            bind(ConsolepSetFont, &handle_set_font<Comm, HostIo>);
+            bind(ConsolepSetIcon, &handle_deprecated_api<Comm, HostIo>);
+            bind(ConsolepInvalidateBitmapRect, &handle_deprecated_api<Comm, HostIo>);
+            bind(ConsolepVDMOperation, &handle_deprecated_api<Comm, HostIo>);
+            bind(ConsolepSetCursor, &handle_deprecated_api<Comm, HostIo>);
+            bind(ConsolepShowCursor, &handle_deprecated_api<Comm, HostIo>);
+            bind(ConsolepMenuControl, &handle_deprecated_api<Comm, HostIo>);
+            bind(ConsolepSetPalette, &handle_deprecated_api<Comm, HostIo>);
+            bind(ConsolepSetDisplayMode, &handle_set_display_mode<Comm, HostIo>);
+            bind(ConsolepRegisterVDM, &handle_deprecated_api<Comm, HostIo>);
+            bind(ConsolepGetHardwareState, &handle_deprecated_api<Comm, HostIo>);
+            bind(ConsolepSetHardwareState, &handle_deprecated_api<Comm, HostIo>);
+            bind(ConsolepGetDisplayMode, &handle_get_display_mode<Comm, HostIo>);
+            bind(ConsolepAddAlias, &handle_add_alias<Comm, HostIo>);
+            bind(ConsolepGetAlias, &handle_get_alias<Comm, HostIo>);
+            bind(ConsolepGetAliasesLength, &handle_get_aliases_length<Comm, HostIo>);
+            bind(ConsolepGetAliasExesLength, &handle_get_alias_exes_length<Comm, HostIo>);
+            bind(ConsolepGetAliases, &handle_get_aliases<Comm, HostIo>);
+            bind(ConsolepGetAliasExes, &handle_get_alias_exes<Comm, HostIo>);
+            bind(ConsolepExpungeCommandHistory, &handle_expunge_command_history<Comm, HostIo>);
+            bind(ConsolepSetNumberOfCommands, &handle_set_number_of_commands<Comm, HostIo>);
+            bind(ConsolepGetCommandHistoryLength, &handle_get_command_history_length<Comm, HostIo>);
+            bind(ConsolepGetCommandHistory, &handle_get_command_history<Comm, HostIo>);
+            bind(ConsolepSetKeyShortcuts, &handle_set_key_shortcuts<Comm, HostIo>);
+            bind(ConsolepSetMenuClose, &handle_set_menu_close<Comm, HostIo>);
+            bind(ConsolepGetKeyboardLayoutName, &handle_get_keyboard_layout_name<Comm, HostIo>);
+            bind(ConsolepGetConsoleWindow, &handle_get_console_window<Comm, HostIo>);
+            bind(ConsolepCharType, &handle_char_type<Comm, HostIo>);
+            bind(ConsolepSetLocalEUDC, &handle_set_local_eudc<Comm, HostIo>);
+            bind(ConsolepSetCursorMode, &handle_set_cursor_mode<Comm, HostIo>);
+            bind(ConsolepGetCursorMode, &handle_get_cursor_mode<Comm, HostIo>);
+            bind(ConsolepRegisterOS2, &handle_register_os2<Comm, HostIo>);
+            bind(ConsolepSetOS2OemFormat, &handle_set_os2_oem_format<Comm, HostIo>);
+            bind(ConsolepGetNlsMode, &handle_get_nls_mode<Comm, HostIo>);
+            bind(ConsolepSetNlsMode, &handle_set_nls_mode<Comm, HostIo>);
+            bind(ConsolepGetSelectionInfo, &handle_get_selection_info<Comm, HostIo>);
+            bind(ConsolepGetConsoleProcessList, &handle_get_console_process_list<Comm, HostIo>);
+            bind(ConsolepGetHistory, &handle_get_history<Comm, HostIo>);
+            bind(ConsolepSetHistory, &handle_set_history<Comm, HostIo>);
+            bind(ConsolepSetCurrentFont, &handle_set_current_font<Comm, HostIo>);
+
+            return table;
+        }
+
+        template<typename Comm, typename HostIo>
+        inline constexpr UserDefinedDispatchTable<Comm, HostIo> user_defined_dispatch_table =
+            make_user_defined_dispatch_table<Comm, HostIo>();
+
+        template<typename Comm, typename HostIo>
+        [[nodiscard]] constexpr UserDefinedHandler<Comm, HostIo> find_user_defined_handler(const ULONG api_number) noexcept
+        {
+            const size_t layer = static_cast<size_t>(api_number >> 24);
+            const size_t index = static_cast<size_t>(api_number & user_defined_index_mask);
+            if (layer >= user_defined_layer_count || index >= user_defined_layer_capacity)
+            {
+                return nullptr;
+            }
+
+            return user_defined_dispatch_table<Comm, HostIo>[layer][index];
+        }
+    }
+
+    // Dispatch body without instrumentation; callers use `dispatch_message`.
+    template<typename Comm, typename HostIo = NullHostIo>
+    [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> dispatch_message_uninstrumented(
+        ServerState& state,
+        BasicApiMessage<Comm>& message,
+        HostIo& host_io) noexcept
+    {
+        DispatchOutcome outcome{};
+
+        if (state.has_deferred_output() && !detail::keeps_deferred_output(message))
+        {
+            state.flush_deferred_output(host_io);
+        }
+
+        const auto& descriptor = message.descriptor();
+        switch (descriptor.function)
+        {
+        case console_io_user_defined:
+        {
+            auto& packet = message.packet();
+            const auto api_number = packet.payload.user_defined.msg_header.ApiNumber;
+            const auto api_size = packet.payload.user_defined.msg_header.ApiDescriptorSize;
+
+            if (api_size > sizeof(packet.payload.user_defined.u))
+            {
+                message.set_reply_status(core::status_invalid_parameter);
+                message.set_reply_information(0);
+                return outcome;
+            }
+
+            // Mirror the upstream response behavior: always return the API descriptor bytes.
+            message.completion().write.data = &packet.payload.user_defined.u;
+            message.completion().write.size = api_size;
+            message.completion().write.offset = 0;
+
+            message.set_write_offset(api_size);
+            message.set_read_offset(api_size + sizeof(CONSOLE_MSG_HEADER));
+
+            detail::UserDefinedDispatchContext<Comm, HostIo> context{
+                .state = state,
+                .message = message,
+                .host_io = host_io,
+                .packet = packet,
+                .descriptor = descriptor,
+                .api_number = api_number,
+                .api_size = api_size,
+            };
+
+            // O(1) lookup by (layer, index); unknown and unsupported APIs fall back to the reject path.
+            const auto handler = detail::find_user_defined_handler<Comm, HostIo>(api_number);
+            if (handler == nullptr)
+            {
+                detail::reject_user_defined_not_implemented(context);
+                return outcome;
+            }
+
+            return handler(context);
+        }
         case console_io_connect:
         {
             const auto pid64 = static_cast<unsigned long long>(descriptor.process);
@@ -8939,21 +10179,17 @@ namespace oc::logging
                 return std::unexpected(input.error());
             }
 
-            std::wstring decoded_text;
+            std::wstring_view decoded_text;
             {
                 const UINT code_page = static_cast<UINT>(state.output_code_page());
-                auto decoded = decode_console_string(
-                    false,
-                    std::span<const std::byte>(input->data(), input->size()),
-                    code_page,
-                    L"RAW_WRITE decode failed");
+                auto decoded = decode_console_output_bytes(*input, code_page, state.output_text_scratch(), L"RAW_WRITE decode failed");
                 if (!decoded)
                 {
                     message.set_reply_status(decoded.error().win32_error == ERROR_OUTOFMEMORY ? core::status_no_memory : core::status_invalid_parameter);
                     message.set_reply_information(0);
                     return outcome;
                 }
-                decoded_text = std::move(decoded.value());
+                decoded_text = decoded.value();
             }
 
             auto written = host_io.write_output_bytes(*input);
@@ -8962,7 +10198,8 @@ namespace oc::logging
                 return std::unexpected(written.error());
             }
 
-            apply_text_to_screen_buffer(*screen_buffer, decoded_text, state.output_mode(), &state, &host_io);
+            detail::mirror_console_output(state, handle->screen_buffer, decoded_text, host_io);
+            state.trim_output_scratch();
 
             message.set_reply_status(core::status_success);
             message.set_reply_information(static_cast<ULONG_PTR>(written.value()));
@@ -9355,6 +10592,144 @@ namespace oc::logging
         }
     }
 
+    // Dispatches one request. When `state` has `ApiMetrics` attached, the attempt is timed and
+    // counted under its API; a detached state pays one pointer test.
+    template<typename Comm, typename HostIo = NullHostIo>
+    [[nodiscard]] std::expected<DispatchOutcome, DeviceCommError> dispatch_message(
+        ServerState& state,
+        BasicApiMessage<Comm>& message,
+        HostIo& host_io) noexcept
+    {
+        ApiMetrics* const metrics = state.api_metrics();
+        if (metrics == nullptr)
+        {
+            return dispatch_message_uninstrumented(state, message, host_io);
+        }
+
+        const uint64_t start = ApiMetrics::now_ticks();
+        auto outcome = dispatch_message_uninstrumented(state, message, host_io);
+        const uint64_t elapsed = ApiMetrics::now_ticks() - start;
+        if (!outcome)
+        {
+            return outcome;
+        }
+
+        const ULONG function = message.descriptor().function;
+        const ULONG api_number = function == console_io_user_defined
+            ? message.packet().payload.user_defined.msg_header.ApiNumber
+            : 0;
+        if (outcome->reply_pending)
+        {
+            // Retries reuse the fetched input, so bytes are counted once, when the request completes.
+            metrics->record_reply_pending(function, api_number, elapsed);
+        }
+        else
+        {
+            metrics->record_completed(function, api_number, elapsed, message.input_bytes(), message.output_bytes());
+        }
+
+        return outcome;
+    }
+
+    template<typename Comm>
+    using BasicWaitQueueFor = BasicWaitQueue<BasicApiMessage<Comm>>;
+
+    // Parks a reply-pending message in `queue`, keyed by the handle and process that issued it.
+    template<typename Comm>
+    [[nodiscard]] std::expected<void, DeviceCommError> park_reply_pending(
+        BasicWaitQueueFor<Comm>& queue,
+        BasicApiMessage<Comm>&& message) noexcept
+    {
+        const auto& descriptor = message.descriptor();
+        const WaitKey key{ .object = descriptor.object, .process = descriptor.process };
+        return queue.push(std::move(message), key, input_read_wait_reasons);
+    }
+
+    // Tells `queue` which waiters a just-completed (non-pending) packet may have unblocked.
+    template<typename Comm>
+    void signal_waiters_after_dispatch(BasicWaitQueueFor<Comm>& queue, const IoPacket& packet) noexcept
+    {
+        if (queue.empty())
+        {
+            return;
+        }
+
+        switch (packet.descriptor.function)
+        {
+        case console_io_disconnect:
+            queue.signal_process_disconnected(packet.descriptor.process);
+            return;
+        case console_io_user_defined:
+            if (packet.payload.user_defined.msg_header.ApiNumber == static_cast<ULONG>(ConsolepGenerateCtrlEvent))
+            {
+                queue.signal_ctrl_event();
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+
+        // Close, flush, mode changes and similar requests act on a handle; only waiters on that handle care.
+        queue.signal_object(packet.descriptor.object);
+    }
+
+    // Retries signalled waiters until one completes or nothing is left worth retrying.
+    //
+    // Returns the completed message (buffers not yet released) so the caller can stage its reply,
+    // or `std::nullopt` when every retried waiter is still pending. At most one waiter completes per
+    // call because the server loop can only stage one reply per `IOCTL_CONDRV_READ_IO`.
+    template<typename Comm, typename HostIo>
+    [[nodiscard]] std::expected<std::optional<BasicApiMessage<Comm>>, DeviceCommError> service_wait_queue(
+        ServerState& state,
+        BasicWaitQueueFor<Comm>& queue,
+        HostIo& host_io) noexcept
+    {
+        while (const auto id = queue.next_ready(host_io.input_bytes_available() != 0))
+        {
+            auto outcome = dispatch_message(state, queue.message(*id), host_io);
+            if (!outcome)
+            {
+                return std::unexpected(outcome.error());
+            }
+
+            if (outcome->reply_pending)
+            {
+                continue;
+            }
+
+            // A completed read can leave per-handle state behind (for example the rest of a cooked
+            // line) that another waiter on the same handle can consume without new input.
+            const ULONG_PTR object = queue.key(*id).object;
+            auto completed = queue.take(*id);
+            queue.signal_object(object);
+            return std::optional<BasicApiMessage<Comm>>(std::move(completed));
+        }
+
+        return std::optional<BasicApiMessage<Comm>>{};
+    }
+
+    // Optional server loop behavior, selected from `AppConfig` by the session layer.
+    struct ServerRunOptions final
+    {
+        // Run driver IO on a dedicated thread and dispatch on the calling thread
+        // (see `condrv/condrv_server_pipeline.hpp`).
+        bool pipelined_io{ false };
+
+        // When non-empty, record driver traffic and host input into
+        // `<trace_directory>\condrv_<pid>.octrace` (see `condrv/condrv_packet_trace.hpp`).
+        std::wstring trace_directory;
+
+        // Count calls, bytes and dispatch latency per API and log them as JSON lines when the loop
+        // exits (see `condrv/condrv_api_metrics.hpp`).
+        bool api_metrics{ false };
+
+        // Upper bound on viewport snapshots published to a windowed host per second; changes in
+        // between are coalesced into the next frame. 0 publishes every change
+        // (see `condrv/snapshot_publisher.hpp`).
+        uint32_t snapshot_max_fps{ 60 };
+    };
+
     class ConDrvServer final
     {
     public:
@@ -9364,7 +10739,8 @@ namespace oc::logging
             core::HandleView host_input,
             core::HandleView host_output,
             core::HandleView host_signal_pipe,
-            logging::Logger& logger) noexcept;
+            logging::Logger& logger,
+            ServerRunOptions options = {}) noexcept;
 
         // Windowed host entry point: publishes `ScreenBuffer` viewport snapshots to the UI thread.
         // `paint_target` is the HWND that will receive `WM_APP + 1` invalidation messages.
@@ -9376,7 +10752,8 @@ namespace oc::logging
             core::HandleView host_signal_pipe,
             logging::Logger& logger,
             std::shared_ptr<view::PublishedScreenBuffer> published,
-            HWND paint_target) noexcept;
+            HWND paint_target,
+            ServerRunOptions options = {}) noexcept;
 
         // Handoff entry point used by `-Embedding` scenarios: a pending IO
         // descriptor is provided by the inbox host via a portable attach
@@ -9390,7 +10767,8 @@ namespace oc::logging
             core::HandleView host_output,
             core::HandleView host_signal_pipe,
             const IoPacket& initial_packet,
-            logging::Logger& logger) noexcept;
+            logging::Logger& logger,
+            ServerRunOptions options = {}) noexcept;
 
         // Windowed variant of the handoff entry point. This is used when the
         // inbox host already consumed the first `IOCTL_CONDRV_READ_IO` packet
@@ -9406,6 +10784,7 @@ namespace oc::logging
             const IoPacket& initial_packet,
             logging::Logger& logger,
             std::shared_ptr<view::PublishedScreenBuffer> published,
-            HWND paint_target) noexcept;
+            HWND paint_target,
+            ServerRunOptions options = {}) noexcept;
     };
 }
@@ -0,0 +1,587 @@
+#pragma once
+
+// Optional pipelined mode for the ConDrv server loop.
+//
+// The serial loop in `condrv_server.cpp` alternates between blocking in `IOCTL_CONDRV_READ_IO`,
+// dispatching the packet, and staging its reply into the next read. Driver round-trips and
+// console-model work therefore never overlap.
+//
+// In pipelined mode a dedicated IO thread owns every driver call for a message:
+// - `read_io`, piggybacking one reply per read like the serial loop,
+// - prefetching the message input payload (`read_input`),
+// - writing the output payload (`write_output`), and `complete_io` on the shutdown and
+//   backpressure paths.
+// The dispatch thread only runs `dispatch_message(...)` and the reply-pending wait queue. The two
+// threads exchange messages through two bounded lock-free SPSC rings (packets in, replies out).
+//
+// Ordering: packets are dispatched in exactly the order the driver returned them, on a single
+// dispatch thread, so per-client ordering and reply-pending semantics match the serial loop.
+//
+// Waking the IO thread: the IO thread may be blocked in `read_io` while replies are queued (for
+// example when every client is waiting for its reply). Before the dispatch thread goes idle it
+// cancels that read (`CancelSynchronousIo`, or `Comm::wake_read_io()` when the comm provides one)
+// until the IO thread has picked every queued reply up. As in the serial loop, a canceled `read_io`
+// still counts as having submitted its piggybacked reply.
+//
+// Messages are created without a `MessageBufferPool` in this mode because they are created and
+// released on the IO thread but filled on the dispatch thread, and pools are single-threaded.
+//
+// See `new/docs/design/condrv_pipelined_io.md`.
+
+#include "condrv/condrv_server.hpp"
+#include "core/spsc_ring.hpp"
+
+#include <Windows.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <utility>
+
+namespace oc::condrv
+{
+    // Level-free wake signal for the dispatch thread: producers bump the epoch and notify, the
+    // consumer samples the epoch before checking for work and sleeps only if it is unchanged.
+    class DispatchWakeSignal final
+    {
+    public:
+        [[nodiscard]] uint64_t epoch() const noexcept
+        {
+            return _epoch.load(std::memory_order_acquire);
+        }
+
+        void notify() noexcept
+        {
+            _epoch.fetch_add(1, std::memory_order_acq_rel);
+            _epoch.notify_one();
+        }
+
+        void wait(const uint64_t observed) const noexcept
+        {
+            _epoch.wait(observed, std::memory_order_acquire);
+        }
+
+    private:
+        std::atomic<uint64_t> _epoch{ 0 };
+    };
+
+    enum class PipelineIoExit : uint8_t
+    {
+        running,
+        stopped,
+        pipe_disconnected,
+        failed,
+    };
+
+    // Input payload offset `dispatch_message(...)` will read `packet` from, so the IO thread can fetch
+    // the payload ahead of dispatch. `std::nullopt` when dispatch rejects the packet without reading
+    // its payload. Must stay in sync with the USER_DEFINED prologue in `dispatch_message(...)`.
+    [[nodiscard]] inline std::optional<ULONG> pipelined_read_offset(const IoPacket& packet) noexcept
+    {
+        if (packet.descriptor.function != console_io_user_defined)
+        {
+            return ULONG{ 0 };
+        }
+
+        const ULONG api_size = packet.payload.user_defined.msg_header.ApiDescriptorSize;
+        if (api_size > sizeof(packet.payload.user_defined.u))
+        {
+            return std::nullopt;
+        }
+
+        return api_size + static_cast<ULONG>(sizeof(CONSOLE_MSG_HEADER));
+    }
+
+    template<typename Comm>
+    class BasicIoPipeline final
+    {
+    public:
+        using Message = BasicApiMessage<Comm>;
+
+        static constexpr size_t ring_capacity = 64;
+
+        // Written by the IO thread; read them after `join()`.
+        struct Statistics final
+        {
+            uint64_t packets{};
+            uint64_t piggybacked_replies{};
+            uint64_t direct_replies{};
+            uint64_t canceled_reads{};
+            uint64_t backpressure_waits{};
+        };
+
+        explicit BasicIoPipeline(Comm& comm, const std::atomic_bool* const external_stop = nullptr) noexcept :
+            _comm(&comm),
+            _external_stop(external_stop)
+        {
+        }
+
+        ~BasicIoPipeline() noexcept
+        {
+            request_stop();
+            join();
+        }
+
+        BasicIoPipeline(const BasicIoPipeline&) = delete;
+        BasicIoPipeline& operator=(const BasicIoPipeline&) = delete;
+        BasicIoPipeline(BasicIoPipeline&&) = delete;
+        BasicIoPipeline& operator=(BasicIoPipeline&&) = delete;
+
+        [[nodiscard]] std::expected<void, DeviceCommError> start() noexcept
+        {
+            HANDLE thread = ::CreateThread(nullptr, 0, &io_thread_proc, this, 0, nullptr);
+            if (thread == nullptr)
+            {
+                return std::unexpected(DeviceCommError{
+                    .context = L"CreateThread failed for ConDrv IO thread",
+                    .win32_error = ::GetLastError(),
+                });
+            }
+
+            _thread = thread;
+            return {};
+        }
+
+        // Waits for the IO thread, then completes replies submitted after it stopped reading. Call
+        // from the dispatch thread only.
+        void join() noexcept
+        {
+            if (_thread != nullptr)
+            {
+                ::WaitForSingleObject(_thread, INFINITE);
+                ::CloseHandle(_thread);
+                _thread = nullptr;
+            }
+
+            while (auto reply = _replies.try_pop())
+            {
+                if (release_reply(*reply))
+                {
+                    (void)complete_reply_directly(*reply);
+                }
+            }
+        }
+
+        // Asks the IO thread to finish: it completes every queued reply and exits.
+        void request_stop() noexcept
+        {
+            _stop.store(true, std::memory_order_seq_cst);
+            notify_io();
+            while (_thread != nullptr && _in_read_io.load(std::memory_order_seq_cst) &&
+                   io_exit() == PipelineIoExit::running)
+            {
+                wake_io();
+                (void)::SwitchToThread();
+            }
+        }
+
+        [[nodiscard]] DispatchWakeSignal& dispatch_wake() noexcept
+        {
+            return _dispatch_wake;
+        }
+
+        [[nodiscard]] PipelineIoExit io_exit() const noexcept
+        {
+            return _io_exit.load(std::memory_order_acquire);
+        }
+
+        // Valid once `io_exit() == PipelineIoExit::failed`.
+        [[nodiscard]] const DeviceCommError& io_error() const noexcept
+        {
+            return _io_error;
+        }
+
+        [[nodiscard]] const Statistics& statistics() const noexcept
+        {
+            return _statistics;
+        }
+
+        // Dispatch thread: next packet read by the IO thread, with its input payload prefetched.
+        [[nodiscard]] std::optional<Message> try_take_message() noexcept
+        {
+            auto message = _packets.try_pop();
+            if (message.has_value())
+            {
+                notify_io();
+            }
+
+            return message;
+        }
+
+        // Dispatch thread: hands a finished message to the IO thread, which writes its output
+        // payload and completes it. Blocks (waking the IO thread) only while the reply ring is full.
+        void submit_reply(Message&& message) noexcept
+        {
+            while (!_replies.try_push(std::move(message)))
+            {
+                wake_io();
+                (void)::SwitchToThread();
+            }
+
+            notify_io();
+        }
+
+        // Dispatch thread: call before sleeping. Makes sure queued replies are not stuck behind a
+        // `read_io` that will not return until some client sends another request.
+        void flush_replies() noexcept
+        {
+            while (!_replies.empty() && _in_read_io.load(std::memory_order_seq_cst))
+            {
+                wake_io();
+                (void)::SwitchToThread();
+            }
+        }
+
+    private:
+        static DWORD WINAPI io_thread_proc(void* const param)
+        {
+            static_cast<BasicIoPipeline*>(param)->run_io_thread();
+            return 0;
+        }
+
+        [[nodiscard]] bool stop_requested() const noexcept
+        {
+            return _stop.load(std::memory_order_acquire) ||
+                   (_external_stop != nullptr && _external_stop->load(std::memory_order_acquire));
+        }
+
+        void notify_io() noexcept
+        {
+            _io_epoch.fetch_add(1, std::memory_order_acq_rel);
+            _io_epoch.notify_one();
+        }
+
+        void wake_io() noexcept
+        {
+            if constexpr (requires(Comm& comm) { comm.wake_read_io(); })
+            {
+                _comm->wake_read_io();
+            }
+            else
+            {
+                if (_thread != nullptr)
+                {
+                    (void)::CancelSynchronousIo(_thread);
+                }
+            }
+        }
+
+        // `CancelSynchronousIo` is this pipeline's wake mechanism, so it can also land on the
+        // output/complete IOCTLs. Treat cancellation as transient, like the serial loop does.
+        template<typename Operation>
+        [[nodiscard]] static std::expected<void, DeviceCommError> retry_canceled(Operation&& operation) noexcept
+        {
+            constexpr int max_retries = 8;
+            for (int attempt = 0;; ++attempt)
+            {
+                auto result = operation();
+                if (result)
+                {
+                    return {};
+                }
+
+                const DWORD error = result.error().win32_error;
+                if ((error == ERROR_OPERATION_ABORTED || error == ERROR_CANCELLED) && attempt < max_retries)
+                {
+                    continue;
+                }
+
+                return result;
+            }
+        }
+
+        [[nodiscard]] std::expected<void, DeviceCommError> release_reply(Message& message) noexcept
+        {
+            return retry_canceled([&]() noexcept { return message.release_message_buffers(); });
+        }
+
+        [[nodiscard]] std::expected<void, DeviceCommError> complete_reply_directly(Message& message) noexcept
+        {
+            ++_statistics.direct_replies;
+            return retry_canceled([&]() noexcept { return message.complete_io(); });
+        }
+
+        // Takes the oldest queued reply and writes its output payload, ready to ride along with the
+        // next `read_io`.
+        [[nodiscard]] std::expected<std::optional<Message>, DeviceCommError> take_reply() noexcept
+        {
+            auto reply = _replies.try_pop();
+            if (!reply.has_value())
+            {
+                return std::optional<Message>{};
+            }
+
+            if (auto released = release_reply(*reply); !released)
+            {
+                return std::unexpected(released.error());
+            }
+
+            return reply;
+        }
+
+        void finish(const PipelineIoExit exit, const DeviceCommError& error = {}) noexcept
+        {
+            if (exit == PipelineIoExit::failed)
+            {
+                _io_error = error;
+            }
+
+            // Complete whatever the dispatch thread already produced so no client is left hanging.
+            while (auto reply = _replies.try_pop())
+            {
+                if (release_reply(*reply))
+                {
+                    (void)complete_reply_directly(*reply);
+                }
+            }
+
+            _io_exit.store(exit, std::memory_order_release);
+            _dispatch_wake.notify();
+        }
+
+        void run_io_thread() noexcept
+        {
+            std::optional<Message> staged;
+            for (;;)
+            {
+                if (stop_requested())
+                {
+                    if (staged.has_value())
+                    {
+                        (void)complete_reply_directly(*staged);
+                    }
+
+                    finish(PipelineIoExit::stopped);
+                    return;
+                }
+
+                // One reply per read, like the serial loop. Replies still queued behind it are picked
+                // up by later reads, or by a cancelled read once the dispatch thread goes idle.
+                if (!staged.has_value())
+                {
+                    auto taken = take_reply();
+                    if (!taken)
+                    {
+                        finish(PipelineIoExit::failed, taken.error());
+                        return;
+                    }
+
+                    staged = std::move(*taken);
+                }
+
+                // Backpressure: the dispatch thread is behind. Do not sit on a reply while waiting.
+                if (_packets.size() == _packets.capacity())
+                {
+                    if (staged.has_value())
+                    {
+                        if (auto completed = complete_reply_directly(*staged); !completed)
+                        {
+                            finish(PipelineIoExit::failed, completed.error());
+                            return;
+                        }
+
+                        staged.reset();
+                    }
+
+                    ++_statistics.backpressure_waits;
+                    const uint64_t observed = _io_epoch.load(std::memory_order_acquire);
+                    if (_packets.size() == _packets.capacity() && _replies.empty() && !stop_requested())
+                    {
+                        _io_epoch.wait(observed, std::memory_order_acquire);
+                    }
+
+                    continue;
+                }
+
+                // Publish "about to block" before the final look at the reply ring. Paired with
+                // `flush_replies()`, either we see the reply here or the dispatch thread sees the flag.
+                _in_read_io.store(true, std::memory_order_seq_cst);
+                if ((!staged.has_value() && !_replies.empty()) || stop_requested())
+                {
+                    _in_read_io.store(false, std::memory_order_seq_cst);
+                    continue;
+                }
+
+                IoPacket packet{};
+                const IoComplete* const reply = staged.has_value() ? &staged->completion() : nullptr;
+                auto read = _comm->read_io(reply, packet);
+                _in_read_io.store(false, std::memory_order_seq_cst);
+
+                if (staged.has_value())
+                {
+                    // Submitted with the read, even when the read itself was canceled.
+                    ++_statistics.piggybacked_replies;
+                    staged.reset();
+                }
+
+                if (!read)
+                {
+                    const DWORD error = read.error().win32_error;
+                    if (error == ERROR_OPERATION_ABORTED || error == ERROR_CANCELLED)
+                    {
+                        ++_statistics.canceled_reads;
+                        continue;
+                    }
+
+                    if (error == ERROR_PIPE_NOT_CONNECTED)
+                    {
+                        finish(PipelineIoExit::pipe_disconnected);
+                        return;
+                    }
+
+                    finish(PipelineIoExit::failed, read.error());
+                    return;
+                }
+
+                Message message(*_comm, packet);
+                if (const auto offset = pipelined_read_offset(packet); offset.has_value())
+                {
+                    message.set_read_offset(*offset);
+                    if (!message.get_input_buffer())
+                    {
+                        // A retry from the dispatch thread would queue behind our next `read_io` on
+                        // the synchronous handle, so fail the request here.
+                        message.set_reply_status(core::status_unsuccessful);
+                        message.set_reply_information(0);
+                        if (auto completed = complete_reply_directly(message); !completed)
+                        {
+                            finish(PipelineIoExit::failed, completed.error());
+                            return;
+                        }
+
+                        continue;
+                    }
+                }
+
+                ++_statistics.packets;
+                const bool pushed = _packets.try_push(std::move(message));
+                OC_ASSERT(pushed); // Only this thread pushes, and we checked for space above.
+                (void)pushed;
+                _dispatch_wake.notify();
+            }
+        }
+
+        Comm* _comm{};
+        const std::atomic_bool* _external_stop{};
+        HANDLE _thread{ nullptr };
+
+        core::SpscRing<Message, ring_capacity> _packets;
+        core::SpscRing<Message, ring_capacity> _replies;
+
+        std::atomic_bool _stop{ false };
+        std::atomic_bool _in_read_io{ false };
+        std::atomic<uint64_t> _io_epoch{ 0 };
+        std::atomic<PipelineIoExit> _io_exit{ PipelineIoExit::running };
+        DeviceCommError _io_error{};
+        DispatchWakeSignal _dispatch_wake;
+        Statistics _statistics{};
+    };
+
+    enum class PipelinedDispatchExit : uint8_t
+    {
+        no_clients,
+        stop_requested,
+        io_stopped,
+    };
+
+    // Dispatch-thread half of the pipelined server loop.
+    //
+    // `before_service()` runs before pending waiters are retried (the server uses it to translate
+    // input-queue changes into wait-queue signals); `after_batch()` runs after each pass, including
+    // passes woken with no work, so a snapshot frame timer can wake it to publish. Returns when the last client disconnects, `stop_requested` is set, or
+    // the IO thread exits.
+    template<typename Comm, typename HostIo, typename BeforeService, typename AfterBatch>
+    [[nodiscard]] std::expected<PipelinedDispatchExit, DeviceCommError> run_pipelined_dispatch(
+        BasicIoPipeline<Comm>& pipeline,
+        ServerState& state,
+        HostIo& host_io,
+        BasicWaitQueueFor<Comm>& waiters,
+        const std::atomic_bool& stop_requested,
+        BeforeService&& before_service,
+        AfterBatch&& after_batch) noexcept
+    {
+        for (;;)
+        {
+            const uint64_t observed = pipeline.dispatch_wake().epoch();
+            bool progressed = false;
+            bool exit_requested = false;
+
+            if (!waiters.empty())
+            {
+                before_service();
+                for (;;)
+                {
+                    auto completed = service_wait_queue(state, waiters, host_io);
+                    if (!completed)
+                    {
+                        return std::unexpected(completed.error());
+                    }
+
+                    if (!completed->has_value())
+                    {
+                        break;
+                    }
+
+                    pipeline.submit_reply(std::move(**completed));
+                    progressed = true;
+                }
+            }
+
+            while (auto message = pipeline.try_take_message())
+            {
+                progressed = true;
+
+                auto outcome = dispatch_message(state, *message, host_io);
+                if (!outcome)
+                {
+                    return std::unexpected(outcome.error());
+                }
+
+                if (outcome->reply_pending)
+                {
+                    if (auto parked = park_reply_pending(waiters, std::move(*message)); !parked)
+                    {
+                        message->set_reply_status(core::status_no_memory);
+                        message->set_reply_information(0);
+                        pipeline.submit_reply(std::move(*message));
+                    }
+
+                    continue;
+                }
+
+                signal_waiters_after_dispatch(waiters, message->packet());
+                pipeline.submit_reply(std::move(*message));
+                if (outcome->request_exit)
+                {
+                    exit_requested = true;
+                    break;
+                }
+            }
+
+            after_batch();
+
+            if (exit_requested)
+            {
+                return PipelinedDispatchExit::no_clients;
+            }
+
+            if (stop_requested.load(std::memory_order_acquire))
+            {
+                return PipelinedDispatchExit::stop_requested;
+            }
+
+            if (pipeline.io_exit() != PipelineIoExit::running)
+            {
+                return PipelinedDispatchExit::io_stopped;
+            }
+
+            if (!progressed)
+            {
+                pipeline.flush_replies();
+                pipeline.dispatch_wake().wait(observed);
+            }
+        }
+    }
+}
@@ -0,0 +1,438 @@
+#pragma once
+
+// Reply-pending wait queue for the ConDrv server loop.
+//
+// Input-dependent requests (ReadConsole, GetConsoleInput, RAW_READ) that cannot make progress
+// return `reply_pending=true` and are parked here until something they depend on changes. The
+// queue indexes waiters by the object handle and client process that issued them and by the wait
+// reasons they registered, so a wake only retries the waiters whose condition may have changed:
+//
+// - `input_available`: new bytes arrived. Waiters are retried oldest-first, and the retry round
+//   stops as soon as the input queue runs dry, so one keystroke with 1000 blocked readers costs one
+//   retry instead of 1000.
+// - `input_disconnected` / `ctrl_event`: broadcast to every waiter that registered the reason.
+// - `process_disconnected`: only the waiters owned by that process.
+// - object signals: only the waiters parked on that handle (close, flush, mode change, ...).
+//
+// Waiters live in a slot vector and are threaded through intrusive lists (arrival order, per
+// object, per process, ready), so signalling and removal never allocate.
+//
+// Threading: owned by the server loop and not thread-safe.
+
+#include "condrv/condrv_device_comm.hpp"
+
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace oc::condrv
+{
+    enum class WaitReason : uint8_t
+    {
+        input_available = 1U << 0,
+        input_disconnected = 1U << 1,
+        process_disconnected = 1U << 2,
+        ctrl_event = 1U << 3,
+    };
+
+    using WaitReasonMask = uint8_t;
+
+    [[nodiscard]] constexpr WaitReasonMask wait_reason_bit(const WaitReason reason) noexcept
+    {
+        return static_cast<WaitReasonMask>(reason);
+    }
+
+    // Every reply-pending request today is an input read, which can be unblocked by any of these.
+    inline constexpr WaitReasonMask input_read_wait_reasons =
+        wait_reason_bit(WaitReason::input_available) |
+        wait_reason_bit(WaitReason::input_disconnected) |
+        wait_reason_bit(WaitReason::process_disconnected) |
+        wait_reason_bit(WaitReason::ctrl_event);
+
+    struct WaitKey final
+    {
+        ULONG_PTR object{};
+        ULONG_PTR process{};
+    };
+
+    template<typename Message>
+    class BasicWaitQueue final
+    {
+    public:
+        using WaiterId = uint32_t;
+
+        struct Statistics final
+        {
+            uint64_t waits{};
+            uint64_t retries{};
+            uint64_t completions{};
+            uint64_t peak_waiters{};
+        };
+
+        BasicWaitQueue() noexcept = default;
+        ~BasicWaitQueue() noexcept = default;
+
+        BasicWaitQueue(const BasicWaitQueue&) = delete;
+        BasicWaitQueue& operator=(const BasicWaitQueue&) = delete;
+        BasicWaitQueue(BasicWaitQueue&&) = delete;
+        BasicWaitQueue& operator=(BasicWaitQueue&&) = delete;
+
+        // Parks `message` at the tail of the arrival order. On allocation failure the message is
+        // left untouched in the caller's hands.
+        [[nodiscard]] std::expected<void, DeviceCommError> push(Message&& message, const WaitKey key, const WaitReasonMask reasons) noexcept
+        {
+            const auto allocation_failure = [] {
+                return std::unexpected(DeviceCommError{
+                    .context = L"Failed to queue reply-pending ConDrv message",
+                    .win32_error = ERROR_OUTOFMEMORY,
+                });
+            };
+
+            if (_free.empty() && _waiters.size() >= static_cast<size_t>(npos))
+            {
+                return allocation_failure();
+            }
+
+            try
+            {
+                (void)_by_object.try_emplace(key.object);
+                (void)_by_process.try_emplace(key.process);
+
+                WaiterId id{};
+                if (!_free.empty())
+                {
+                    id = _free.back();
+                    _free.pop_back();
+                }
+                else
+                {
+                    // `take()` returns slots to `_free` and must not allocate, so keep room for every slot.
+                    _free.reserve(_waiters.size() + 1);
+                    _waiters.emplace_back();
+                    id = static_cast<WaiterId>(_waiters.size() - 1);
+                }
+
+                auto& waiter = _waiters[id];
+                waiter.message.emplace(std::move(message));
+                waiter.key = key;
+                waiter.reasons = reasons;
+                waiter.ready = false;
+
+                link_back(_order, &Waiter::order, id);
+                link_back(_by_object.find(key.object)->second, &Waiter::object, id);
+                link_back(_by_process.find(key.process)->second, &Waiter::process, id);
+            }
+            catch (...)
+            {
+                erase_if_empty(_by_object, key.object);
+                erase_if_empty(_by_process, key.process);
+                return allocation_failure();
+            }
+
+            ++_size;
+            ++_statistics.waits;
+            if (_size > _statistics.peak_waiters)
+            {
+                _statistics.peak_waiters = _size;
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return _size == 0;
+        }
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            return _size;
+        }
+
+        [[nodiscard]] const Statistics& statistics() const noexcept
+        {
+            return _statistics;
+        }
+
+        // New input arrived: (re)start an oldest-first retry round over input waiters.
+        void signal_input_available() noexcept
+        {
+            _input_cursor = _order.head;
+            _input_round_active = _input_cursor != npos;
+        }
+
+        void signal_input_disconnected() noexcept
+        {
+            signal_all(WaitReason::input_disconnected);
+        }
+
+        void signal_ctrl_event() noexcept
+        {
+            signal_all(WaitReason::ctrl_event);
+        }
+
+        void signal_process_disconnected(const ULONG_PTR process) noexcept
+        {
+            const auto found = _by_process.find(process);
+            if (found == _by_process.end())
+            {
+                return;
+            }
+
+            for (WaiterId id = found->second.head; id != npos; id = _waiters[id].process.next)
+            {
+                if ((_waiters[id].reasons & wait_reason_bit(WaitReason::process_disconnected)) != 0)
+                {
+                    mark_ready(id);
+                }
+            }
+        }
+
+        // The state behind `object` changed (closed, flushed, mode change, a sibling read completed).
+        void signal_object(const ULONG_PTR object) noexcept
+        {
+            const auto found = _by_object.find(object);
+            if (found == _by_object.end())
+            {
+                return;
+            }
+
+            for (WaiterId id = found->second.head; id != npos; id = _waiters[id].object.next)
+            {
+                mark_ready(id);
+            }
+        }
+
+        // Returns the next waiter worth retrying: explicitly signalled waiters first, then the
+        // current input round while `input_available` is true. The waiter stays queued; call
+        // `take()` once it completes, or do nothing if it is still pending.
+        [[nodiscard]] std::optional<WaiterId> next_ready(const bool input_available) noexcept
+        {
+            if (_ready.head != npos)
+            {
+                const WaiterId id = _ready.head;
+                unlink(_ready, &Waiter::ready_link, id);
+                _waiters[id].ready = false;
+                ++_statistics.retries;
+                return id;
+            }
+
+            if (!_input_round_active)
+            {
+                return std::nullopt;
+            }
+
+            while (_input_cursor != npos &&
+                   (_waiters[_input_cursor].reasons & wait_reason_bit(WaitReason::input_available)) == 0)
+            {
+                _input_cursor = _waiters[_input_cursor].order.next;
+            }
+
+            if (!input_available || _input_cursor == npos)
+            {
+                _input_round_active = false;
+                _input_cursor = npos;
+                return std::nullopt;
+            }
+
+            const WaiterId id = _input_cursor;
+            _input_cursor = _waiters[id].order.next;
+            ++_statistics.retries;
+            return id;
+        }
+
+        [[nodiscard]] Message& message(const WaiterId id) noexcept
+        {
+            return *_waiters[id].message;
+        }
+
+        [[nodiscard]] const WaitKey& key(const WaiterId id) const noexcept
+        {
+            return _waiters[id].key;
+        }
+
+        // Removes a waiter and hands its message back to the caller.
+        [[nodiscard]] Message take(const WaiterId id) noexcept
+        {
+            auto& waiter = _waiters[id];
+            if (_input_cursor == id)
+            {
+                _input_cursor = waiter.order.next;
+            }
+
+            if (waiter.ready)
+            {
+                unlink(_ready, &Waiter::ready_link, id);
+                waiter.ready = false;
+            }
+
+            unlink(_order, &Waiter::order, id);
+            unlink_keyed(_by_object, waiter.key.object, &Waiter::object, id);
+            unlink_keyed(_by_process, waiter.key.process, &Waiter::process, id);
+
+            Message message = std::move(*waiter.message);
+            waiter.message.reset();
+            _free.push_back(id);
+            --_size;
+            ++_statistics.completions;
+            return message;
+        }
+
+        // Visits every waiter in arrival order.
+        template<typename Visitor>
+        void for_each(Visitor&& visitor) noexcept(noexcept(visitor(std::declval<Message&>())))
+        {
+            for (WaiterId id = _order.head; id != npos; id = _waiters[id].order.next)
+            {
+                visitor(*_waiters[id].message);
+            }
+        }
+
+        void clear() noexcept
+        {
+            _waiters.clear();
+            _free.clear();
+            _by_object.clear();
+            _by_process.clear();
+            _order = {};
+            _ready = {};
+            _input_cursor = npos;
+            _input_round_active = false;
+            _size = 0;
+        }
+
+    private:
+        static constexpr WaiterId npos = std::numeric_limits<WaiterId>::max();
+
+        struct Links final
+        {
+            WaiterId prev{ npos };
+            WaiterId next{ npos };
+        };
+
+        struct List final
+        {
+            WaiterId head{ npos };
+            WaiterId tail{ npos };
+        };
+
+        struct Waiter final
+        {
+            std::optional<Message> message;
+            WaitKey key{};
+            WaitReasonMask reasons{};
+            bool ready{ false };
+            Links order{};
+            Links object{};
+            Links process{};
+            Links ready_link{};
+        };
+
+        using KeyedLists = std::unordered_map<ULONG_PTR, List>;
+
+        void link_back(List& list, Links Waiter::* const member, const WaiterId id) noexcept
+        {
+            auto& links = _waiters[id].*member;
+            links.prev = list.tail;
+            links.next = npos;
+            if (list.tail != npos)
+            {
+                (_waiters[list.tail].*member).next = id;
+            }
+            else
+            {
+                list.head = id;
+            }
+
+            list.tail = id;
+        }
+
+        void unlink(List& list, Links Waiter::* const member, const WaiterId id) noexcept
+        {
+            auto& links = _waiters[id].*member;
+            if (links.prev != npos)
+            {
+                (_waiters[links.prev].*member).next = links.next;
+            }
+            else
+            {
+                list.head = links.next;
+            }
+
+            if (links.next != npos)
+            {
+                (_waiters[links.next].*member).prev = links.prev;
+            }
+            else
+            {
+                list.tail = links.prev;
+            }
+
+            links = {};
+        }
+
+        void unlink_keyed(KeyedLists& lists, const ULONG_PTR key, Links Waiter::* const member, const WaiterId id) noexcept
+        {
+            const auto found = lists.find(key);
+            if (found == lists.end())
+            {
+                return;
+            }
+
+            unlink(found->second, member, id);
+            if (found->second.head == npos)
+            {
+                lists.erase(found);
+            }
+        }
+
+        static void erase_if_empty(KeyedLists& lists, const ULONG_PTR key) noexcept
+        {
+            if (const auto found = lists.find(key); found != lists.end() && found->second.head == npos)
+            {
+                lists.erase(found);
+            }
+        }
+
+        void mark_ready(const WaiterId id) noexcept
+        {
+            auto& waiter = _waiters[id];
+            if (waiter.ready)
+            {
+                return;
+            }
+
+            waiter.ready = true;
+            link_back(_ready, &Waiter::ready_link, id);
+        }
+
+        void signal_all(const WaitReason reason) noexcept
+        {
+            for (WaiterId id = _order.head; id != npos; id = _waiters[id].order.next)
+            {
+                if ((_waiters[id].reasons & wait_reason_bit(reason)) != 0)
+                {
+                    mark_ready(id);
+                }
+            }
+        }
+
+        std::vector<Waiter> _waiters;
+        std::vector<WaiterId> _free;
+        KeyedLists _by_object;
+        KeyedLists _by_process;
+        List _order{};
+        List _ready{};
+        WaiterId _input_cursor{ npos };
+        bool _input_round_active{ false };
+        size_t _size{ 0 };
+        Statistics _statistics{};
+    };
+}
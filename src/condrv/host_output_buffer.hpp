@@ -0,0 +1,251 @@
+#pragma once
+
+// Write-combining buffer for host output (the ConPTY output pipe).
+//
+// `WriteConsole`, `RAW_WRITE` and ReadConsole echo each hand their bytes to the host. Writing them
+// straight to the pipe costs one `WriteFile` per message, so a client that prints a line (or a
+// character) at a time pays a syscall, and the terminal a wake, per message.
+//
+// `BasicHostOutputBuffer` appends those bytes to one buffer and hands it to the sink in one write:
+// - when the owner calls `flush()` (the server loop does so when the packet queue drains, when
+//   held output is due, and before a request that reads input; see `condrv_server.cpp`);
+// - when a write would not fit in the remaining capacity. The buffered bytes go first, then the
+//   new bytes are buffered, or written through when they are at least `capacity` long.
+// Bytes reach the sink in the order they were written.
+//
+// The sink is a template parameter so tests and benchmarks can count writes. It must provide
+// `std::expected<void, DeviceCommError> write(std::span<const std::byte>) noexcept`, writing all
+// of the bytes.
+//
+// A sink failure is sticky: the buffered bytes are dropped, and every later `write` and `flush`
+// returns the same error without calling the sink. The host output pipe does not recover from a
+// failed write, and the error reaches the dispatch path through the next write.
+//
+// The serial server loop cannot see its packet queue. `BasicSerialOutputHold` decides, before each
+// `read_io`, whether output may stay buffered across that read.
+//
+// Threading: a buffer is owned by the server loop thread and is not thread-safe.
+//
+// See `new/docs/design/condrv_host_output_write_combining.md`.
+
+#include "condrv/condrv_device_comm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace oc::condrv
+{
+    struct HostOutputBufferStatistics final
+    {
+        uint64_t writes{};            // non-empty `write` calls
+        uint64_t bytes{};             // bytes accepted by `write`
+        uint64_t sink_writes{};       // writes handed to the sink
+        uint64_t capacity_flushes{};  // flushes forced by a write that did not fit
+        uint64_t write_throughs{};    // writes of at least `capacity` bytes, not copied
+    };
+
+    template<typename Sink>
+    class BasicHostOutputBuffer final
+    {
+    public:
+        static constexpr size_t default_capacity = 16 * 1024;
+
+        explicit BasicHostOutputBuffer(Sink sink = {}, const size_t capacity = default_capacity) noexcept :
+            _sink(std::move(sink)),
+            _capacity(capacity == 0 ? 1 : capacity)
+        {
+        }
+
+        BasicHostOutputBuffer(const BasicHostOutputBuffer&) = delete;
+        BasicHostOutputBuffer& operator=(const BasicHostOutputBuffer&) = delete;
+
+        // Accepts `bytes` for output. Returns `bytes.size()`, or the sink error when a write it
+        // forced (or an earlier one) failed.
+        [[nodiscard]] std::expected<size_t, DeviceCommError> write(const std::span<const std::byte> bytes) noexcept
+        {
+            if (_error)
+            {
+                return std::unexpected(*_error);
+            }
+
+            if (bytes.empty())
+            {
+                return size_t{ 0 };
+            }
+
+            ++_statistics.writes;
+            _statistics.bytes += bytes.size();
+
+            if (_pending.size() + bytes.size() > _capacity && !_pending.empty())
+            {
+                ++_statistics.capacity_flushes;
+                if (auto flushed = flush(); !flushed)
+                {
+                    return std::unexpected(flushed.error());
+                }
+            }
+
+            if (bytes.size() >= _capacity || !append(bytes))
+            {
+                ++_statistics.write_throughs;
+                if (auto written = write_to_sink(bytes); !written)
+                {
+                    return std::unexpected(written.error());
+                }
+            }
+
+            return bytes.size();
+        }
+
+        // Hands every buffered byte to the sink. Does nothing when the buffer is empty.
+        [[nodiscard]] std::expected<void, DeviceCommError> flush() noexcept
+        {
+            if (_error)
+            {
+                return std::unexpected(*_error);
+            }
+
+            if (_pending.empty())
+            {
+                return {};
+            }
+
+            auto written = write_to_sink(std::span<const std::byte>(_pending.data(), _pending.size()));
+            _pending.clear();
+            return written;
+        }
+
+        [[nodiscard]] size_t pending_bytes() const noexcept
+        {
+            return _pending.size();
+        }
+
+        [[nodiscard]] size_t capacity() const noexcept
+        {
+            return _capacity;
+        }
+
+        [[nodiscard]] const HostOutputBufferStatistics& statistics() const noexcept
+        {
+            return _statistics;
+        }
+
+        [[nodiscard]] Sink& sink() noexcept
+        {
+            return _sink;
+        }
+
+    private:
+        // False when the storage cannot be allocated; the caller writes through instead.
+        [[nodiscard]] bool append(const std::span<const std::byte> bytes) noexcept
+        {
+            try
+            {
+                if (_pending.capacity() < _capacity)
+                {
+                    _pending.reserve(_capacity);
+                }
+
+                _pending.insert(_pending.end(), bytes.begin(), bytes.end());
+                return true;
+            }
+            catch (...)
+            {
+                return false;
+            }
+        }
+
+        [[nodiscard]] std::expected<void, DeviceCommError> write_to_sink(const std::span<const std::byte> bytes) noexcept
+        {
+            ++_statistics.sink_writes;
+            auto written = _sink.write(bytes);
+            if (!written)
+            {
+                _error = written.error();
+                _pending.clear();
+            }
+
+            return written;
+        }
+
+        Sink _sink;
+        size_t _capacity{};
+        std::vector<std::byte> _pending;
+        std::optional<DeviceCommError> _error;
+        HostOutputBufferStatistics _statistics{};
+    };
+
+    // When the serial server loop writes buffered output.
+    //
+    // The serial loop hands each reply to the driver inside the `read_io` that waits for the next
+    // request, and cannot tell beforehand whether that read returns at once or blocks. Flushing
+    // before every read costs one pipe write per message. Instead, output stays buffered across a
+    // read while the previous read delivered a request (the client is still streaming), for at most
+    // `hold_us`. The loop arms a wake for `deadline()` that cancels a read still blocked then, and
+    // the next `before_read` flushes. After a woken read nothing is held: that output answers input
+    // or a wait and goes out at once.
+    //
+    // The clock is a template parameter, as for `BasicSnapshotPublisher`. `hold_us == 0` flushes
+    // before every read.
+    template<typename Clock>
+    class BasicSerialOutputHold final
+    {
+    public:
+        explicit BasicSerialOutputHold(const uint64_t hold_us, Clock clock = {}) noexcept :
+            _hold_us(hold_us),
+            _clock(std::move(clock))
+        {
+        }
+
+        // Call before each `read_io`. Flushes `host_io` (`flush_output()`) unless its output
+        // (`pending_output_bytes()`) may be held across this read, and returns the flush result.
+        template<typename HostIo>
+        [[nodiscard]] std::expected<void, DeviceCommError> before_read(HostIo& host_io) noexcept
+        {
+            if (host_io.pending_output_bytes() != 0 && _streaming && _hold_us != 0)
+            {
+                const uint64_t now = _clock.now_us();
+                if (!_deadline)
+                {
+                    _deadline = now + _hold_us;
+                }
+
+                if (now < *_deadline)
+                {
+                    return {};
+                }
+            }
+
+            _deadline.reset();
+            return host_io.flush_output();
+        }
+
+        // Call after each `read_io`; `delivered` is false when the read was woken or failed.
+        void after_read(const bool delivered) noexcept
+        {
+            _streaming = delivered;
+        }
+
+        // Clock time by which held output must be flushed; `std::nullopt` when nothing is held.
+        [[nodiscard]] std::optional<uint64_t> deadline() const noexcept
+        {
+            return _deadline;
+        }
+
+        [[nodiscard]] Clock& clock() noexcept
+        {
+            return _clock;
+        }
+
+    private:
+        uint64_t _hold_us{};
+        Clock _clock;
+        bool _streaming{ false };
+        std::optional<uint64_t> _deadline;
+    };
+}
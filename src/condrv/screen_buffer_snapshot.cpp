@@ -6,6 +6,8 @@
 #include <cstddef>
 #include <span>
 #include <limits>
+#include <new>
+#include <vector>
 
 namespace oc::condrv
 {
@@ -42,63 +44,203 @@ namespace oc::condrv
             result.Y = static_cast<SHORT>(std::min(height, max_short));
             return result;
         }
+
+        // Copies viewport row `row` from the buffer, padding anything the buffer cannot supply.
+        void read_viewport_row(const ScreenBuffer& buffer, view::ScreenBufferSnapshot& snapshot, const size_t row) noexcept
+        {
+            const size_t viewport_w = static_cast<size_t>(snapshot.viewport_size.X);
+            const SHORT y = static_cast<SHORT>(static_cast<long>(snapshot.window_rect.Top) + static_cast<long>(row));
+            const COORD origin{ snapshot.window_rect.Left, y };
+
+            const size_t offset = row * viewport_w;
+            auto row_text = std::span<wchar_t>(snapshot.text).subspan(offset, viewport_w);
+            auto row_attr = std::span<USHORT>(snapshot.attributes).subspan(offset, viewport_w);
+
+            const size_t read_text = buffer.read_output_characters(origin, row_text);
+            const size_t read_attr = buffer.read_output_attributes(origin, row_attr);
+
+            if (read_text < row_text.size())
+            {
+                std::fill(row_text.begin() + static_cast<ptrdiff_t>(read_text), row_text.end(), L' ');
+            }
+            if (read_attr < row_attr.size())
+            {
+                std::fill(
+                    row_attr.begin() + static_cast<ptrdiff_t>(read_attr),
+                    row_attr.end(),
+                    snapshot.default_attributes);
+            }
+        }
+
+        // Appends the clusters of viewport row `row`. Throws on allocation failure.
+        void read_viewport_clusters(
+            const ScreenBuffer& buffer,
+            view::ScreenBufferSnapshot& snapshot,
+            const size_t row,
+            std::vector<ScreenBuffer::OutputCluster>& scratch)
+        {
+            const size_t viewport_w = static_cast<size_t>(snapshot.viewport_size.X);
+            const SHORT y = static_cast<SHORT>(static_cast<long>(snapshot.window_rect.Top) + static_cast<long>(row));
+            scratch.clear();
+            if (!buffer.read_output_clusters(COORD{ snapshot.window_rect.Left, y }, viewport_w, scratch))
+            {
+                throw std::bad_alloc();
+            }
+
+            for (const auto& cluster : scratch)
+            {
+                snapshot.clusters.push_back(view::ScreenBufferSnapshot::Cluster{
+                    .cell = row * viewport_w + cluster.offset,
+                    .offset = snapshot.cluster_text.size(),
+                    .length = cluster.text.size(),
+                });
+                snapshot.cluster_text.insert(snapshot.cluster_text.end(), cluster.text.begin(), cluster.text.end());
+            }
+        }
+
+        // Appends the clusters `previous` lists for viewport row `row`, starting the search at `next`
+        // (clusters are sorted, so rows visited in order share one cursor). Throws on allocation
+        // failure.
+        void copy_viewport_clusters(
+            const view::ScreenBufferSnapshot& previous,
+            view::ScreenBufferSnapshot& snapshot,
+            const size_t row,
+            size_t& next)
+        {
+            const size_t viewport_w = static_cast<size_t>(snapshot.viewport_size.X);
+            const size_t row_end = (row + 1) * viewport_w;
+            for (; next < previous.clusters.size() && previous.clusters[next].cell < row_end; ++next)
+            {
+                const auto& cluster = previous.clusters[next];
+                if (cluster.cell < row * viewport_w)
+                {
+                    continue;
+                }
+
+                snapshot.clusters.push_back(view::ScreenBufferSnapshot::Cluster{
+                    .cell = cluster.cell,
+                    .offset = snapshot.cluster_text.size(),
+                    .length = cluster.length,
+                });
+                const auto first = previous.cluster_text.begin() + static_cast<ptrdiff_t>(cluster.offset);
+                snapshot.cluster_text.insert(snapshot.cluster_text.end(), first, first + static_cast<ptrdiff_t>(cluster.length));
+            }
+        }
+
+        // Fills everything except the cell contents. Throws on allocation failure.
+        [[nodiscard]] std::expected<std::shared_ptr<view::ScreenBufferSnapshot>, DeviceCommError> make_snapshot_frame(
+            const ScreenBuffer& buffer)
+        {
+            auto snapshot = std::make_shared<view::ScreenBufferSnapshot>();
+            snapshot->revision = buffer.revision();
+            snapshot->window_rect = buffer.window_rect();
+            snapshot->buffer_size = buffer.screen_buffer_size();
+            snapshot->cursor_position = buffer.cursor_position();
+            snapshot->cursor_visible = buffer.cursor_visible();
+            snapshot->cursor_size = buffer.cursor_size();
+            snapshot->default_attributes = buffer.default_text_attributes();
+            snapshot->color_table = buffer.color_table();
+
+            size_t viewport_w = 0;
+            size_t viewport_h = 0;
+            if (!rect_dimensions(snapshot->window_rect, viewport_w, viewport_h))
+            {
+                return std::unexpected(DeviceCommError{
+                    .context = L"Viewport dimensions overflow",
+                    .win32_error = ERROR_ARITHMETIC_OVERFLOW,
+                });
+            }
+
+            snapshot->viewport_size = to_coord_saturating(viewport_w, viewport_h);
+            return snapshot;
+        }
+
+        [[nodiscard]] bool same_geometry(const ScreenBuffer& buffer, const view::ScreenBufferSnapshot& previous) noexcept
+        {
+            const SMALL_RECT window = buffer.window_rect();
+            const COORD size = buffer.screen_buffer_size();
+            return window.Left == previous.window_rect.Left && window.Top == previous.window_rect.Top &&
+                   window.Right == previous.window_rect.Right && window.Bottom == previous.window_rect.Bottom &&
+                   size.X == previous.buffer_size.X && size.Y == previous.buffer_size.Y;
+        }
     }
 
     std::expected<std::shared_ptr<const view::ScreenBufferSnapshot>, DeviceCommError> make_viewport_snapshot(
         const ScreenBuffer& buffer) noexcept
     try
     {
-        auto snapshot = std::make_shared<view::ScreenBufferSnapshot>();
-        snapshot->revision = buffer.revision();
-        snapshot->window_rect = buffer.window_rect();
-        snapshot->buffer_size = buffer.screen_buffer_size();
-        snapshot->cursor_position = buffer.cursor_position();
-        snapshot->cursor_visible = buffer.cursor_visible();
-        snapshot->cursor_size = buffer.cursor_size();
-        snapshot->default_attributes = buffer.default_text_attributes();
-        snapshot->color_table = buffer.color_table();
-
-        size_t viewport_w = 0;
-        size_t viewport_h = 0;
-        if (!rect_dimensions(snapshot->window_rect, viewport_w, viewport_h))
+        auto frame = make_snapshot_frame(buffer);
+        if (!frame)
         {
-            return std::unexpected(DeviceCommError{
-                .context = L"Viewport dimensions overflow",
-                .win32_error = ERROR_ARITHMETIC_OVERFLOW,
-            });
+            return std::unexpected(std::move(frame.error()));
         }
 
-        snapshot->viewport_size = to_coord_saturating(viewport_w, viewport_h);
-
+        auto& snapshot = frame.value();
+        const size_t viewport_w = static_cast<size_t>(snapshot->viewport_size.X);
+        const size_t viewport_h = static_cast<size_t>(snapshot->viewport_size.Y);
         const size_t cell_count = viewport_w * viewport_h;
         snapshot->text.assign(cell_count, L' ');
         snapshot->attributes.assign(cell_count, snapshot->default_attributes);
 
-        if (viewport_w != 0 && viewport_h != 0)
+        std::vector<ScreenBuffer::OutputCluster> clusters;
+        for (size_t row = 0; row < viewport_h && viewport_w != 0; ++row)
         {
-            for (size_t row = 0; row < viewport_h; ++row)
-            {
-                const SHORT y = static_cast<SHORT>(static_cast<long>(snapshot->window_rect.Top) + static_cast<long>(row));
-                const COORD origin{ snapshot->window_rect.Left, y };
+            read_viewport_row(buffer, *snapshot, row);
+            read_viewport_clusters(buffer, *snapshot, row, clusters);
+        }
+
+        return std::shared_ptr<const view::ScreenBufferSnapshot>(std::move(snapshot));
+    }
+    catch (...)
+    {
+        return std::unexpected(DeviceCommError{
+            .context = L"Failed to allocate ScreenBuffer snapshot",
+            .win32_error = ERROR_OUTOFMEMORY,
+        });
+    }
+
+    std::expected<std::shared_ptr<const view::ScreenBufferSnapshot>, DeviceCommError> make_viewport_snapshot(
+        const ScreenBuffer& buffer,
+        const view::ScreenBufferSnapshot& previous,
+        const ScreenDamage& damage) noexcept
+    try
+    {
+        if (damage.all_rows || !same_geometry(buffer, previous))
+        {
+            return make_viewport_snapshot(buffer);
+        }
 
-                const size_t offset = row * viewport_w;
-                auto row_text = std::span<wchar_t>(snapshot->text).subspan(offset, viewport_w);
-                auto row_attr = std::span<USHORT>(snapshot->attributes).subspan(offset, viewport_w);
+        auto frame = make_snapshot_frame(buffer);
+        if (!frame)
+        {
+            return std::unexpected(std::move(frame.error()));
+        }
 
-                const size_t read_text = buffer.read_output_characters(origin, row_text);
-                const size_t read_attr = buffer.read_output_attributes(origin, row_attr);
+        auto& snapshot = frame.value();
+        const size_t cell_count = static_cast<size_t>(snapshot->viewport_size.X) * static_cast<size_t>(snapshot->viewport_size.Y);
+        if (previous.text.size() != cell_count || previous.attributes.size() != cell_count)
+        {
+            return make_viewport_snapshot(buffer);
+        }
 
-                if (read_text < row_text.size())
-                {
-                    std::fill(row_text.begin() + static_cast<ptrdiff_t>(read_text), row_text.end(), L' ');
-                }
-                if (read_attr < row_attr.size())
-                {
-                    std::fill(
-                        row_attr.begin() + static_cast<ptrdiff_t>(read_attr),
-                        row_attr.end(),
-                        snapshot->default_attributes);
-                }
+        // Clean rows are a bulk copy of the previous frame; only dirty rows walk the buffer.
+        snapshot->text = previous.text;
+        snapshot->attributes = previous.attributes;
+
+        // Clusters are rebuilt in row order: copied from `previous` for clean rows, read for dirty ones.
+        const size_t viewport_h = static_cast<size_t>(snapshot->viewport_size.Y);
+        std::vector<ScreenBuffer::OutputCluster> clusters;
+        size_t next_cluster = 0;
+        for (size_t row = 0; row < viewport_h && snapshot->viewport_size.X != 0; ++row)
+        {
+            if (damage.row_dirty(static_cast<SHORT>(static_cast<long>(snapshot->window_rect.Top) + static_cast<long>(row))))
+            {
+                read_viewport_row(buffer, *snapshot, row);
+                read_viewport_clusters(buffer, *snapshot, row, clusters);
+            }
+            else if (!previous.clusters.empty())
+            {
+                copy_viewport_clusters(previous, *snapshot, row, next_cluster);
             }
         }
 
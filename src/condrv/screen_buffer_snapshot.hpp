@@ -9,6 +9,7 @@
 // The snapshot types live in `view/` to avoid coupling the renderer to the ConDrv implementation.
 
 #include "condrv/condrv_device_comm.hpp"
+#include "condrv/screen_damage.hpp"
 #include "view/screen_buffer_snapshot.hpp"
 
 #include <expected>
@@ -20,5 +21,13 @@ namespace oc::condrv
 
     [[nodiscard]] std::expected<std::shared_ptr<const view::ScreenBufferSnapshot>, DeviceCommError> make_viewport_snapshot(
         const ScreenBuffer& buffer) noexcept;
+
+    // Builds the next snapshot from `previous`, re-reading only the viewport rows that `damage`
+    // (collected since `previous` was built) marks dirty. Falls back to a full build when the
+    // viewport or buffer geometry changed or every row moved.
+    [[nodiscard]] std::expected<std::shared_ptr<const view::ScreenBufferSnapshot>, DeviceCommError> make_viewport_snapshot(
+        const ScreenBuffer& buffer,
+        const view::ScreenBufferSnapshot& previous,
+        const ScreenDamage& damage) noexcept;
 }
 
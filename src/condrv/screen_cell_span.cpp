@@ -0,0 +1,386 @@
+#include "condrv/screen_cell_span.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define OC_CONDRV_CELL_SPAN_SSE2 1
+#endif
+
+namespace oc::condrv
+{
+    namespace
+    {
+        static_assert(std::is_trivially_copyable_v<ScreenCell>);
+
+        [[nodiscard]] wchar_t narrow_character(const wchar_t value) noexcept
+        {
+            return value <= 0xFF ? value : L'?';
+        }
+
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        // A cell is one 32-bit lane: the character in the low half, the attributes in the high half.
+        // `CHAR_INFO` has the same layout, with `Char.AsciiChar` in the lowest byte.
+        static_assert(sizeof(ScreenCell) == sizeof(uint32_t));
+        static_assert(offsetof(ScreenCell, character) == 0 && offsetof(ScreenCell, attributes) == 2);
+        static_assert(sizeof(CHAR_INFO) == sizeof(ScreenCell));
+        static_assert(offsetof(CHAR_INFO, Char) == 0 && offsetof(CHAR_INFO, Attributes) == 2);
+
+        constexpr int character_lanes = 0x0000FFFF;
+        constexpr int attribute_lanes = static_cast<int>(0xFFFF0000u);
+
+        [[nodiscard]] __m128i load(const void* const source) noexcept
+        {
+            return _mm_loadu_si128(static_cast<const __m128i*>(source));
+        }
+
+        void store(void* const dest, const __m128i value) noexcept
+        {
+            _mm_storeu_si128(static_cast<__m128i*>(dest), value);
+        }
+
+        // Writes 8 UTF-16 code units into the characters of `cells[0..8)`.
+        void store_characters_8(ScreenCell* const cells, const __m128i characters) noexcept
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i keep = _mm_set1_epi32(attribute_lanes);
+            store(cells, _mm_or_si128(_mm_and_si128(load(cells), keep), _mm_unpacklo_epi16(characters, zero)));
+            store(cells + 4, _mm_or_si128(_mm_and_si128(load(cells + 4), keep), _mm_unpackhi_epi16(characters, zero)));
+        }
+
+        // Reads the characters of `cells[0..8)` as 8 code units. The sign-extending shift keeps
+        // `_mm_packs_epi32` from saturating, so every 16-bit value survives unchanged.
+        [[nodiscard]] __m128i load_characters_8(const ScreenCell* const cells) noexcept
+        {
+            const __m128i low = _mm_srai_epi32(_mm_slli_epi32(load(cells), 16), 16);
+            const __m128i high = _mm_srai_epi32(_mm_slli_epi32(load(cells + 4), 16), 16);
+            return _mm_packs_epi32(low, high);
+        }
+
+        // Replaces 16-bit lanes above 0xFF with '?'.
+        [[nodiscard]] __m128i narrow_8(const __m128i characters) noexcept
+        {
+            const __m128i fits = _mm_cmpeq_epi16(_mm_srli_epi16(characters, 8), _mm_setzero_si128());
+            return _mm_or_si128(_mm_and_si128(fits, characters), _mm_andnot_si128(fits, _mm_set1_epi16('?')));
+        }
+#endif
+    }
+
+    void fill_cells(ScreenCell* const cells, const size_t count, const ScreenCell value) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        uint32_t packed = 0;
+        std::memcpy(&packed, &value, sizeof(packed));
+        const __m128i lanes = _mm_set1_epi32(static_cast<int>(packed));
+        for (; i + 4 <= count; i += 4)
+        {
+            store(cells + i, lanes);
+        }
+#endif
+        std::fill(cells + i, cells + count, value);
+    }
+
+    void fill_cell_characters(ScreenCell* const cells, const size_t count, const wchar_t value) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        const __m128i keep = _mm_set1_epi32(attribute_lanes);
+        const __m128i insert = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(value)));
+        for (; i + 4 <= count; i += 4)
+        {
+            store(cells + i, _mm_or_si128(_mm_and_si128(load(cells + i), keep), insert));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            cells[i].character = value;
+        }
+    }
+
+    void fill_cell_attributes(ScreenCell* const cells, const size_t count, const USHORT value) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        const __m128i keep = _mm_set1_epi32(character_lanes);
+        const __m128i insert = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(value) << 16));
+        for (; i + 4 <= count; i += 4)
+        {
+            store(cells + i, _mm_or_si128(_mm_and_si128(load(cells + i), keep), insert));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            cells[i].attributes = value;
+        }
+    }
+
+    void clear_cell_attribute_bits(ScreenCell* const cells, const size_t count, const USHORT mask) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        const __m128i keep = _mm_set1_epi32(static_cast<int>(~(static_cast<uint32_t>(mask) << 16)));
+        for (; i + 4 <= count; i += 4)
+        {
+            store(cells + i, _mm_and_si128(load(cells + i), keep));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            cells[i].attributes = static_cast<USHORT>(cells[i].attributes & ~mask);
+        }
+    }
+
+    void store_cell_characters(ScreenCell* const cells, const wchar_t* const source, const size_t count) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        for (; i + 8 <= count; i += 8)
+        {
+            store_characters_8(cells + i, load(source + i));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            cells[i].character = source[i];
+        }
+    }
+
+    void store_cell_attributes(ScreenCell* const cells, const USHORT* const source, const size_t count) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i keep = _mm_set1_epi32(character_lanes);
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m128i attributes = load(source + i);
+            store(cells + i, _mm_or_si128(_mm_and_si128(load(cells + i), keep), _mm_unpacklo_epi16(zero, attributes)));
+            store(cells + i + 4, _mm_or_si128(_mm_and_si128(load(cells + i + 4), keep), _mm_unpackhi_epi16(zero, attributes)));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            cells[i].attributes = source[i];
+        }
+    }
+
+    void store_cell_ascii(ScreenCell* const cells, const std::byte* const source, const size_t count) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m128i bytes = load(source + i);
+            store_characters_8(cells + i, _mm_unpacklo_epi8(bytes, zero));
+            store_characters_8(cells + i + 8, _mm_unpackhi_epi8(bytes, zero));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            cells[i].character = static_cast<wchar_t>(static_cast<unsigned char>(source[i]));
+        }
+    }
+
+    void store_cell_run(ScreenCell* const cells, const wchar_t* const source, const size_t count, const USHORT attributes) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        const __m128i fill = _mm_set1_epi16(static_cast<short>(attributes));
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m128i characters = load(source + i);
+            store(cells + i, _mm_unpacklo_epi16(characters, fill));
+            store(cells + i + 4, _mm_unpackhi_epi16(characters, fill));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            cells[i] = ScreenCell{ .character = source[i], .attributes = attributes };
+        }
+    }
+
+    void load_cell_characters(wchar_t* const dest, const ScreenCell* const cells, const size_t count) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        for (; i + 8 <= count; i += 8)
+        {
+            store(dest + i, load_characters_8(cells + i));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            dest[i] = cells[i].character;
+        }
+    }
+
+    void load_cell_attributes(USHORT* const dest, const ScreenCell* const cells, const size_t count) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m128i low = _mm_srai_epi32(load(cells + i), 16);
+            const __m128i high = _mm_srai_epi32(load(cells + i + 4), 16);
+            store(dest + i, _mm_packs_epi32(low, high));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            dest[i] = cells[i].attributes;
+        }
+    }
+
+    void load_cell_ascii(std::byte* const dest, const ScreenCell* const cells, const size_t count) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m128i low = narrow_8(load_characters_8(cells + i));
+            const __m128i high = narrow_8(load_characters_8(cells + i + 8));
+            store(dest + i, _mm_packus_epi16(low, high));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            dest[i] = static_cast<std::byte>(narrow_character(cells[i].character));
+        }
+    }
+
+    size_t find_surrogate_cell(const ScreenCell* const cells, const size_t count) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        // Masking the character to its top five bits and clearing the attributes leaves 0xD800 in
+        // exactly the lanes holding a surrogate.
+        const __m128i mask = _mm_set1_epi32(0xF800);
+        const __m128i surrogate = _mm_set1_epi32(0xD800);
+        for (; i + 4 <= count; i += 4)
+        {
+            const int hits = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(load(cells + i), mask), surrogate));
+            if (hits != 0)
+            {
+                return i + static_cast<size_t>(std::countr_zero(static_cast<unsigned>(hits))) / sizeof(ScreenCell);
+            }
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            if (cells[i].character >= 0xD800 && cells[i].character <= 0xDFFF)
+            {
+                return i;
+            }
+        }
+        return count;
+    }
+
+    size_t count_plain_characters(const wchar_t* const text, const size_t count) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        // SSE2 only compares signed 16-bit lanes. A unit is in [low, low + span] exactly when
+        // subtracting `low` and then saturating-subtracting `span` leaves zero.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ascii_low = _mm_set1_epi16(0x20);
+        const __m128i ascii_span = _mm_set1_epi16(0x7E - 0x20);
+        const __m128i latin_low = _mm_set1_epi16(0xA0);
+        const __m128i latin_span = _mm_set1_epi16(0x2FF - 0xA0);
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m128i units = load(text + i);
+            const __m128i ascii = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_sub_epi16(units, ascii_low), ascii_span), zero);
+            const __m128i latin = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_sub_epi16(units, latin_low), latin_span), zero);
+            const unsigned plain = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(ascii, latin)));
+            if (plain != 0xFFFF)
+            {
+                return i + static_cast<size_t>(std::countr_one(plain)) / sizeof(wchar_t);
+            }
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            const wchar_t unit = text[i];
+            if (!((unit >= 0x20 && unit <= 0x7E) || (unit >= 0xA0 && unit <= 0x2FF)))
+            {
+                return i;
+            }
+        }
+        return count;
+    }
+
+    void store_cell_char_info(ScreenCell* const cells, const CHAR_INFO* const source, const size_t count, const bool unicode) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        if (unicode)
+        {
+            std::memcpy(cells, source, count * sizeof(ScreenCell));
+            return;
+        }
+
+        // Keep `AsciiChar` and the attributes; drop whatever the client left in the high byte of `Char`.
+        const __m128i keep = _mm_set1_epi32(static_cast<int>(0xFFFF00FFu));
+        for (; i + 4 <= count; i += 4)
+        {
+            store(cells + i, _mm_and_si128(load(source + i), keep));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            const auto& info = source[i];
+            cells[i] = ScreenCell{
+                .character = unicode ? info.Char.UnicodeChar : static_cast<wchar_t>(static_cast<unsigned char>(info.Char.AsciiChar)),
+                .attributes = info.Attributes,
+            };
+        }
+    }
+
+    void load_cell_char_info(CHAR_INFO* const dest, const ScreenCell* const cells, const size_t count, const bool unicode) noexcept
+    {
+        size_t i = 0;
+#if defined(OC_CONDRV_CELL_SPAN_SSE2)
+        if (unicode)
+        {
+            std::memcpy(dest, cells, count * sizeof(ScreenCell));
+            return;
+        }
+
+        // Narrow the character lanes only; the attribute lanes pass through.
+        const __m128i character_mask = _mm_set1_epi32(character_lanes);
+        const __m128i replacement = _mm_set1_epi32('?');
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128i value = load(cells + i);
+            const __m128i fits = _mm_cmpeq_epi16(_mm_srli_epi16(value, 8), _mm_setzero_si128());
+            const __m128i replace = _mm_andnot_si128(fits, character_mask);
+            store(dest + i, _mm_or_si128(_mm_andnot_si128(replace, value), _mm_and_si128(replace, replacement)));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            dest[i] = to_char_info(cells[i], unicode);
+        }
+    }
+
+    CHAR_INFO to_char_info(const ScreenCell cell, const bool unicode) noexcept
+    {
+        CHAR_INFO info{};
+        info.Attributes = cell.attributes;
+        if (unicode)
+        {
+            info.Char.UnicodeChar = cell.character;
+        }
+        else
+        {
+            info.Char.AsciiChar = static_cast<CHAR>(static_cast<unsigned char>(narrow_character(cell.character)));
+        }
+        return info;
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// Row-span primitives over `ScreenCell` storage.
+//
+// `ScreenBuffer` keeps each row as a contiguous array of interleaved (character, attributes) cells.
+// The console APIs move cells in and out in other shapes: separate character and attribute arrays
+// (`WriteConsoleOutputCharacter`, `ReadConsoleOutputAttribute`, ...), 8-bit code units, and
+// `CHAR_INFO` rectangles. These functions convert one contiguous row span at a time. Callers
+// handle row boundaries, blank rows and damage; nothing here allocates or fails.
+//
+// On x86/x64 the conversions use SSE2 (always available on the supported targets); elsewhere they
+// fall back to scalar loops with identical results.
+//
+// See `new/docs/design/condrv_screen_cell_span.md`.
+
+#include <Windows.h>
+
+#include <cstddef>
+
+namespace oc::condrv
+{
+    struct ScreenCell final
+    {
+        wchar_t character{ L' ' };
+        USHORT attributes{ 0x07 };
+
+        friend bool operator==(const ScreenCell&, const ScreenCell&) = default;
+    };
+
+    // Sets every cell in `[cells, cells + count)` to `value`.
+    void fill_cells(ScreenCell* cells, size_t count, ScreenCell value) noexcept;
+
+    // Set one field of every cell, leaving the other field unchanged.
+    void fill_cell_characters(ScreenCell* cells, size_t count, wchar_t value) noexcept;
+    void fill_cell_attributes(ScreenCell* cells, size_t count, USHORT value) noexcept;
+    // Clears the bits of `mask` in every cell's attributes.
+    void clear_cell_attribute_bits(ScreenCell* cells, size_t count, USHORT mask) noexcept;
+
+    // Interleave: copy `count` values into one field of consecutive cells.
+    void store_cell_characters(ScreenCell* cells, const wchar_t* source, size_t count) noexcept;
+    void store_cell_attributes(ScreenCell* cells, const USHORT* source, size_t count) noexcept;
+    // Bytes are zero-extended to UTF-16 code units (the ASCII APIs' existing behavior).
+    void store_cell_ascii(ScreenCell* cells, const std::byte* source, size_t count) noexcept;
+    // Both fields: `count` characters from `source`, each with `attributes`.
+    void store_cell_run(ScreenCell* cells, const wchar_t* source, size_t count, USHORT attributes) noexcept;
+
+    // Deinterleave: copy one field of `count` consecutive cells out.
+    void load_cell_characters(wchar_t* dest, const ScreenCell* cells, size_t count) noexcept;
+    void load_cell_attributes(USHORT* dest, const ScreenCell* cells, size_t count) noexcept;
+    // Characters above U+00FF narrow to '?'.
+    void load_cell_ascii(std::byte* dest, const ScreenCell* cells, size_t count) noexcept;
+
+    // Index of the first cell whose character is a UTF-16 surrogate code unit (U+D800..U+DFFF), or
+    // `count` when there is none. `ScreenBuffer` keeps cluster characters in that range.
+    [[nodiscard]] size_t find_surrogate_cell(const ScreenCell* cells, size_t count) noexcept;
+
+    // Length of the leading run of `text` that the text output path writes as one narrow cell per
+    // code unit with no other effect: U+0020..U+007E and U+00A0..U+02FF. Controls, DEL, C1 and
+    // everything from U+0300 (which may be wide, zero-width or a surrogate) end the run.
+    [[nodiscard]] size_t count_plain_characters(const wchar_t* text, size_t count) noexcept;
+
+    // `CHAR_INFO` rows. In Unicode mode the two layouts are identical. In ASCII mode only
+    // `Char.AsciiChar` is read (zero-extended), and reads narrow like `load_cell_ascii` and clear
+    // the high byte of `Char`.
+    void store_cell_char_info(ScreenCell* cells, const CHAR_INFO* source, size_t count, bool unicode) noexcept;
+    void load_cell_char_info(CHAR_INFO* dest, const ScreenCell* cells, size_t count, bool unicode) noexcept;
+
+    // The `CHAR_INFO` that `load_cell_char_info` produces for `cell`.
+    [[nodiscard]] CHAR_INFO to_char_info(ScreenCell cell, bool unicode) noexcept;
+}
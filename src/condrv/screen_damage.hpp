@@ -0,0 +1,91 @@
+#pragma once
+
+// Row-granular screen buffer damage.
+//
+// `ScreenBuffer::revision()` only says *that* something changed. Consumers that rebuild or repaint
+// the viewport (snapshot publication, the renderer) want to know *which rows* changed so they can
+// reuse everything else.
+//
+// `ScreenBuffer` stamps every logical row with the revision of its last change and keeps a column
+// extent per row. A consumer remembers the `revision` of the last `ScreenDamage` it collected and
+// passes it back as the generation for the next collection, so any number of consumers can observe
+// the same buffer at different rates without resetting each other.
+//
+// Changes that are not tied to cells are reported as separate flags: cursor moves, viewport moves,
+// palette changes, and whole-buffer row movement (full-buffer scroll rotations, resize, alternate
+// screen switches).
+//
+// See `new/docs/design/condrv_screen_buffer_damage.md`.
+
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace oc::condrv
+{
+    // Inclusive column range within one row.
+    struct ColumnExtent final
+    {
+        SHORT left{};
+        SHORT right{};
+    };
+
+    struct ScreenDamage final
+    {
+        uint64_t revision{}; // generation to pass back to `ScreenBuffer::collect_damage`
+        bool all_rows{};     // rows moved or were replaced; every row is in `rows` with a full extent
+        bool viewport{};     // the window rectangle changed
+        bool cursor{};       // cursor position, size or visibility changed
+        bool palette{};      // color table or default attributes changed
+
+        // One bit per logical buffer row.
+        std::vector<uint64_t> rows;                // any cell changed
+        std::vector<uint64_t> attribute_only_rows; // subset of `rows` whose characters did not change
+
+        // Indexed by logical buffer row; meaningful only where `rows` is set. An extent may be wider
+        // than the cells that actually changed, never narrower.
+        std::vector<ColumnExtent> extents;
+
+        [[nodiscard]] bool row_dirty(const SHORT row) const noexcept
+        {
+            return test(rows, row);
+        }
+
+        [[nodiscard]] bool row_attribute_only(const SHORT row) const noexcept
+        {
+            return test(attribute_only_rows, row);
+        }
+
+        [[nodiscard]] bool any_rows() const noexcept
+        {
+            for (const auto word : rows)
+            {
+                if (word != 0)
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return !all_rows && !viewport && !cursor && !palette && !any_rows();
+        }
+
+    private:
+        [[nodiscard]] static bool test(const std::vector<uint64_t>& bits, const SHORT row) noexcept
+        {
+            if (row < 0)
+            {
+                return false;
+            }
+
+            const auto index = static_cast<size_t>(row);
+            return index / 64 < bits.size() && (bits[index / 64] & (uint64_t{ 1 } << (index % 64))) != 0;
+        }
+    };
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+// Frame-coalesced viewport snapshot publication.
+//
+// Both the ConDrv server loop and the windowed ConPTY output worker mutate a `ScreenBuffer` far
+// more often than a window can present it: a build log can bump the revision thousands of times
+// per second, and each publish builds a full viewport snapshot and posts a repaint.
+//
+// `BasicSnapshotPublisher` sits between the producer and `view::PublishedScreenBuffer`:
+// - `update(buffer)` records that the buffer (or the active buffer identity) changed and publishes
+//   only if the frame budget allows it; otherwise the change is left "dirty";
+// - `deadline()` reports when the dirty change becomes publishable, so the owner can arrange a
+//   wake (the server loop arms a threadpool timer; the PTY worker polls anyway);
+// - `flush(buffer)` publishes any dirty change immediately (shutdown, final messages).
+//
+// Consecutive frames of the same buffer are built incrementally: the publisher collects the
+// buffer's row damage since the previous frame and re-reads only the dirty viewport rows.
+//
+// The clock is a template parameter so tests can drive time explicitly. It must provide
+// `uint64_t now_us() const noexcept` returning a monotonic timestamp in microseconds. The snapshot
+// builder is one too, so tests can make a build fail.
+//
+// Threading: a publisher is owned by the single thread that mutates the buffer. Only the published
+// snapshot (via `PublishedScreenBuffer`) and the posted repaint cross threads.
+//
+// See `new/docs/design/renderer_snapshot_publisher.md`.
+
+#include "condrv/condrv_server.hpp"
+#include "condrv/screen_buffer_snapshot.hpp"
+#include "view/screen_buffer_snapshot.hpp"
+
+#include <Windows.h>
+
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace oc::condrv
+{
+    // Monotonic microsecond clock over QPC.
+    class QpcFrameClock final
+    {
+    public:
+        QpcFrameClock() noexcept
+        {
+            LARGE_INTEGER frequency{};
+            (void)::QueryPerformanceFrequency(&frequency);
+            _frequency = frequency.QuadPart > 0 ? static_cast<uint64_t>(frequency.QuadPart) : 1;
+        }
+
+        [[nodiscard]] uint64_t now_us() const noexcept
+        {
+            LARGE_INTEGER counter{};
+            (void)::QueryPerformanceCounter(&counter);
+            const auto ticks = static_cast<uint64_t>(counter.QuadPart);
+            return (ticks / _frequency) * 1'000'000 + ((ticks % _frequency) * 1'000'000) / _frequency;
+        }
+
+    private:
+        uint64_t _frequency{ 1 };
+    };
+
+    // Builds frames with `make_viewport_snapshot`.
+    struct ViewportSnapshotBuilder final
+    {
+        [[nodiscard]] std::expected<std::shared_ptr<const view::ScreenBufferSnapshot>, DeviceCommError> operator()(
+            const ScreenBuffer& buffer) const noexcept
+        {
+            return make_viewport_snapshot(buffer);
+        }
+
+        [[nodiscard]] std::expected<std::shared_ptr<const view::ScreenBufferSnapshot>, DeviceCommError> operator()(
+            const ScreenBuffer& buffer,
+            const view::ScreenBufferSnapshot& previous,
+            const ScreenDamage& damage) const noexcept
+        {
+            return make_viewport_snapshot(buffer, previous, damage);
+        }
+    };
+
+    struct SnapshotPublisherStatistics final
+    {
+        uint64_t changes{};            // observed revision or active-buffer changes
+        uint64_t frames{};             // snapshots published
+        uint64_t incremental_frames{}; // frames built from the previous frame plus row damage
+        uint64_t coalesced{};          // changes absorbed into a later frame
+        uint64_t snapshot_failures{};  // snapshot build failures (left dirty for a retry next frame)
+    };
+
+    template<typename Clock, typename SnapshotBuilder = ViewportSnapshotBuilder>
+    class BasicSnapshotPublisher final
+    {
+    public:
+        // `max_frames_per_second == 0` disables coalescing: every observed change is published.
+        // A null `target` turns the publisher into a no-op; a null `paint_target` publishes without
+        // posting a repaint.
+        BasicSnapshotPublisher(
+            std::shared_ptr<view::PublishedScreenBuffer> target,
+            const HWND paint_target,
+            const uint32_t max_frames_per_second,
+            Clock clock = {},
+            SnapshotBuilder builder = {}) noexcept :
+            _target(std::move(target)),
+            _paint_target(paint_target),
+            _frame_interval_us(max_frames_per_second == 0 ? 0 : 1'000'000 / max_frames_per_second),
+            _clock(std::move(clock)),
+            _builder(std::move(builder))
+        {
+        }
+
+        BasicSnapshotPublisher(const BasicSnapshotPublisher&) = delete;
+        BasicSnapshotPublisher& operator=(const BasicSnapshotPublisher&) = delete;
+
+        // The windowed PTY host publishes its first frame before the window exists.
+        void set_paint_target(const HWND paint_target) noexcept
+        {
+            _paint_target = paint_target;
+        }
+
+        // Observes `buffer` and publishes when it changed and a frame is due. Returns true when a
+        // snapshot was published by this call.
+        bool update(const std::shared_ptr<ScreenBuffer>& buffer) noexcept
+        {
+            if (!observe(buffer))
+            {
+                return false;
+            }
+
+            const uint64_t now = _clock.now_us();
+            if (now < _next_frame_us)
+            {
+                return false;
+            }
+
+            return publish(buffer, now);
+        }
+
+        // Observes `buffer` and publishes any unpublished change regardless of the frame budget.
+        bool flush(const std::shared_ptr<ScreenBuffer>& buffer) noexcept
+        {
+            if (!observe(buffer))
+            {
+                return false;
+            }
+
+            return publish(buffer, _clock.now_us());
+        }
+
+        // True when a change has been observed but not yet published.
+        [[nodiscard]] bool dirty() const noexcept
+        {
+            return _dirty;
+        }
+
+        // Clock time at which the dirty change may be published; `std::nullopt` when clean.
+        [[nodiscard]] std::optional<uint64_t> deadline() const noexcept
+        {
+            if (!_dirty)
+            {
+                return std::nullopt;
+            }
+
+            return _next_frame_us;
+        }
+
+        [[nodiscard]] const SnapshotPublisherStatistics& statistics() const noexcept
+        {
+            return _statistics;
+        }
+
+        [[nodiscard]] Clock& clock() noexcept
+        {
+            return _clock;
+        }
+
+        [[nodiscard]] SnapshotBuilder& builder() noexcept
+        {
+            return _builder;
+        }
+
+    private:
+        // Marks the publisher dirty when `buffer` differs from the last observed identity/revision.
+        // Returns whether there is a change to publish.
+        [[nodiscard]] bool observe(const std::shared_ptr<ScreenBuffer>& buffer) noexcept
+        {
+            if (!_target || !buffer)
+            {
+                return false;
+            }
+
+            const uint64_t revision = buffer->revision();
+            const bool same_buffer = !_observed_buffer.owner_before(buffer) && !buffer.owner_before(_observed_buffer);
+            if (!same_buffer || revision != _observed_revision)
+            {
+                _observed_buffer = buffer;
+                _observed_revision = revision;
+                ++_statistics.changes;
+                if (_dirty)
+                {
+                    ++_statistics.coalesced;
+                }
+                _dirty = true;
+            }
+
+            return _dirty;
+        }
+
+        bool publish(const std::shared_ptr<ScreenBuffer>& buffer, const uint64_t now) noexcept
+        {
+            // Damage generations are per buffer, so a different buffer starts over from generation 0.
+            const bool same_buffer = _previous_frame && !_previous_buffer.owner_before(buffer) && !buffer.owner_before(_previous_buffer);
+            const bool collected = buffer->collect_damage(same_buffer ? _damage_generation : 0, _damage);
+            const bool incremental = same_buffer && collected;
+
+            auto snapshot = incremental ? _builder(*buffer, *_previous_frame, _damage) : _builder(*buffer);
+            if (!snapshot)
+            {
+                // Retry one frame later. Moving the deadline is also what makes the server loop re-arm
+                // its frame timer; an unchanged deadline would leave the change stranded.
+                ++_statistics.snapshot_failures;
+                _next_frame_us = now + _frame_interval_us;
+                return false;
+            }
+
+            _previous_frame = snapshot.value();
+            _previous_buffer = buffer;
+            _damage_generation = collected ? _damage.revision : 0;
+            if (incremental)
+            {
+                ++_statistics.incremental_frames;
+            }
+
+            _target->publish(std::move(snapshot.value()));
+            if (_paint_target != nullptr)
+            {
+                (void)::PostMessageW(_paint_target, WM_APP + 1, 0, 0);
+            }
+
+            ++_statistics.frames;
+            _dirty = false;
+            _next_frame_us = now + _frame_interval_us;
+            return true;
+        }
+
+        std::shared_ptr<view::PublishedScreenBuffer> _target;
+        HWND _paint_target{};
+        uint64_t _frame_interval_us{};
+        Clock _clock;
+        SnapshotBuilder _builder;
+
+        // Identity only (compared by owner, so a new buffer reusing a freed address still differs).
+        std::weak_ptr<ScreenBuffer> _observed_buffer;
+        uint64_t _observed_revision{};
+        bool _dirty{ false };
+        uint64_t _next_frame_us{};
+        SnapshotPublisherStatistics _statistics{};
+
+        // Incremental build state: the last published frame, its buffer, and the damage generation
+        // it corresponds to. `_damage` is reused so steady-state collection does not allocate.
+        std::shared_ptr<const view::ScreenBufferSnapshot> _previous_frame;
+        std::weak_ptr<ScreenBuffer> _previous_buffer;
+        uint64_t _damage_generation{};
+        ScreenDamage _damage{};
+    };
+
+    using SnapshotPublisher = BasicSnapshotPublisher<QpcFrameClock>;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+// Display width of Unicode code points in console cells.
+//
+// Code points with East Asian Width `W` or `F`, and emoji with default emoji presentation, take two
+// cells. Combining marks, ZWJ / ZWNJ, variation selectors, emoji modifiers and tags take none: they
+// extend the glyph before them (see `ClusterTable`). Everything else takes one; ambiguous-width
+// characters are narrow, as in upstream conhost. The answer comes from a two-level table built at
+// compile time from the range lists in `unicode_width.cpp`: `code_point >> 8` selects a block of
+// 2-bit widths indexed by the low byte. Code points below U+0300 (the first combining mark) never
+// reach it, and the few extenders above plane 3 are range checks.
+//
+// See `new/docs/design/condrv_double_width_cells.md` and `new/docs/design/condrv_cluster_table.md`.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace oc::condrv
+{
+    // Everything below this is one cell wide.
+    inline constexpr char32_t first_non_narrow_code_point = 0x0300;
+
+    struct CodePointWidthTable final
+    {
+        // Planes 0-3. Above them only the tags and variation selectors of plane 14 are not narrow.
+        static constexpr char32_t limit = 0x40000;
+        static constexpr size_t max_blocks = 128;
+
+        // Block 0 is all narrow and block 1 all wide; the rest are the mixed blocks.
+        std::array<uint8_t, (limit >> 8)> block_index{};
+        std::array<std::array<uint8_t, 64>, max_blocks> blocks{};
+    };
+
+    extern const CodePointWidthTable code_point_width_table;
+
+    // 0, 1 or 2. Two loads for code points in the table, none below U+0300. One unsigned compare
+    // sends everything outside the table, which is mostly ASCII, down the same branch.
+    [[nodiscard]] inline int code_point_width(const char32_t code_point) noexcept
+    {
+        if (code_point - first_non_narrow_code_point >= CodePointWidthTable::limit - first_non_narrow_code_point)
+        {
+            // Tags U+E0020..U+E007F and variation selectors U+E0100..U+E01EF.
+            return code_point - 0xE0020 < 0x60 || code_point - 0xE0100 < 0xF0 ? 0 : 1;
+        }
+
+        const auto& block = code_point_width_table.blocks[code_point_width_table.block_index[code_point >> 8]];
+        return (block[(code_point & 0xFF) >> 2] >> ((code_point & 3) * 2)) & 3;
+    }
+}
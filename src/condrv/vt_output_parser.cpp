@@ -0,0 +1,656 @@
+#include "condrv/vt_output_parser.hpp"
+
+#include <algorithm>
+#include <initializer_list>
+
+namespace oc::condrv
+{
+    namespace
+    {
+        using State = VtOutputParser::State;
+
+        // Code units below 0x100 fall into one of these classes. Everything from 0x100 is
+        // `printable`, so the class table stays one byte per Latin-1 unit.
+        enum class InputClass : uint8_t
+        {
+            c0,
+            bel,
+            // CAN and SUB cancel a sequence.
+            can_sub,
+            esc,
+            // 0x20..0x2F
+            intermediate,
+            digit,
+            colon,
+            semicolon,
+            // '<' '=' '>' '?'
+            leader,
+            // The finals that introduce a sequence after ESC: '[', ']', 'P', and 'X' '^' '_'.
+            esc_csi,
+            esc_osc,
+            esc_dcs,
+            esc_string,
+            // The rest of 0x40..0x7E.
+            final,
+            del,
+            // The rest of 0x80..0x9F.
+            c1,
+            c1_dcs,
+            c1_string,
+            c1_csi,
+            c1_st,
+            c1_osc,
+            // 0xA0 and up.
+            printable,
+            count,
+        };
+
+        constexpr size_t state_count = static_cast<size_t>(State::string) + 1;
+        constexpr size_t class_count = static_cast<size_t>(InputClass::count);
+
+        constexpr std::array<InputClass, 0x100> input_classes = [] {
+            std::array<InputClass, 0x100> classes{};
+            for (size_t unit = 0; unit < classes.size(); ++unit)
+            {
+                auto& value = classes[unit];
+                if (unit < 0x20)
+                {
+                    value = unit == 0x07 ? InputClass::bel
+                        : unit == 0x18 || unit == 0x1A ? InputClass::can_sub
+                        : unit == 0x1B ? InputClass::esc
+                        : InputClass::c0;
+                }
+                else if (unit < 0x30)
+                {
+                    value = InputClass::intermediate;
+                }
+                else if (unit < 0x3A)
+                {
+                    value = InputClass::digit;
+                }
+                else if (unit < 0x40)
+                {
+                    value = unit == 0x3A ? InputClass::colon : unit == 0x3B ? InputClass::semicolon : InputClass::leader;
+                }
+                else if (unit < 0x7F)
+                {
+                    value = unit == L'[' ? InputClass::esc_csi
+                        : unit == L']' ? InputClass::esc_osc
+                        : unit == L'P' ? InputClass::esc_dcs
+                        : unit == L'X' || unit == L'^' || unit == L'_' ? InputClass::esc_string
+                        : InputClass::final;
+                }
+                else if (unit == 0x7F)
+                {
+                    value = InputClass::del;
+                }
+                else if (unit < 0xA0)
+                {
+                    value = unit == 0x90 ? InputClass::c1_dcs
+                        : unit == 0x98 || unit == 0x9E || unit == 0x9F ? InputClass::c1_string
+                        : unit == 0x9B ? InputClass::c1_csi
+                        : unit == 0x9C ? InputClass::c1_st
+                        : unit == 0x9D ? InputClass::c1_osc
+                        : InputClass::c1;
+                }
+                else
+                {
+                    value = InputClass::printable;
+                }
+            }
+            return classes;
+        }();
+
+        [[nodiscard]] constexpr InputClass classify(const wchar_t unit) noexcept
+        {
+            return static_cast<uint32_t>(unit) < input_classes.size() ? input_classes[static_cast<uint32_t>(unit)] : InputClass::printable;
+        }
+
+        enum class Action : uint8_t
+        {
+            // Consume the unit and do nothing else.
+            none,
+            print,
+            execute,
+            esc_collect,
+            esc_dispatch,
+            csi_leader,
+            csi_collect,
+            csi_param,
+            csi_dispatch,
+            osc_put,
+            osc_dispatch,
+        };
+
+        // A transition packs the next state (bits 0-3), the action (bits 4-7) and what to reset
+        // on the way in.
+        using Transition = uint16_t;
+        constexpr Transition clear_flag = 0x100;
+        constexpr Transition osc_start_flag = 0x200;
+
+        static_assert(state_count <= 16);
+        static_assert(static_cast<size_t>(Action::osc_dispatch) < 16);
+
+        [[nodiscard]] constexpr Transition make_transition(const State next, const Action action, const Transition flags = 0) noexcept
+        {
+            return static_cast<Transition>(static_cast<unsigned>(next) | (static_cast<unsigned>(action) << 4) | flags);
+        }
+
+        [[nodiscard]] constexpr State next_state(const Transition transition) noexcept
+        {
+            return static_cast<State>(transition & 0x0F);
+        }
+
+        [[nodiscard]] constexpr Action transition_action(const Transition transition) noexcept
+        {
+            return static_cast<Action>((transition >> 4) & 0x0F);
+        }
+
+        using TransitionTable = std::array<std::array<Transition, class_count>, state_count>;
+
+        constexpr TransitionTable transitions = [] {
+            TransitionTable table{};
+            const auto on = [&](const State state, const InputClass input, const State next, const Action action, const Transition flags = 0) {
+                table[static_cast<size_t>(state)][static_cast<size_t>(input)] = make_transition(next, action, flags);
+            };
+            const auto on_range = [&](const State state, const InputClass first, const InputClass last, const State next, const Action action) {
+                for (auto input = static_cast<size_t>(first); input <= static_cast<size_t>(last); ++input)
+                {
+                    on(state, static_cast<InputClass>(input), next, action);
+                }
+            };
+
+            // Units the table does not mention are consumed without effect.
+            for (size_t state = 0; state < state_count; ++state)
+            {
+                for (size_t input = 0; input < class_count; ++input)
+                {
+                    table[state][input] = make_transition(static_cast<State>(state), Action::none);
+                }
+            }
+
+            // Outside strings, ESC and the C1 introducers start a new sequence from any state,
+            // CAN and SUB cancel one, and C0 controls run without ending it.
+            for (const State state : { State::ground, State::escape, State::escape_intermediate, State::csi_entry, State::csi_param, State::csi_intermediate, State::csi_ignore })
+            {
+                on(state, InputClass::c0, state, Action::execute);
+                on(state, InputClass::bel, state, Action::execute);
+                on(state, InputClass::can_sub, State::ground, Action::none);
+                on(state, InputClass::esc, State::escape, Action::none, clear_flag);
+                on(state, InputClass::c1, State::ground, Action::none);
+                on(state, InputClass::c1_dcs, State::string, Action::none);
+                on(state, InputClass::c1_string, State::string, Action::none);
+                on(state, InputClass::c1_csi, State::csi_entry, Action::none, clear_flag);
+                on(state, InputClass::c1_st, State::ground, Action::none);
+                on(state, InputClass::c1_osc, State::osc_string, Action::none, osc_start_flag);
+            }
+
+            // Ground: text is printed. Controls that start nothing (including CAN, SUB, DEL and
+            // the other C1 codes) are handed to the caller, which may draw them as glyphs.
+            on_range(State::ground, InputClass::intermediate, InputClass::final, State::ground, Action::print);
+            on(State::ground, InputClass::printable, State::ground, Action::print);
+            on(State::ground, InputClass::can_sub, State::ground, Action::execute);
+            on(State::ground, InputClass::del, State::ground, Action::execute);
+            on(State::ground, InputClass::c1, State::ground, Action::execute);
+
+            // ESC.
+            on(State::escape, InputClass::intermediate, State::escape_intermediate, Action::esc_collect);
+            on_range(State::escape, InputClass::digit, InputClass::final, State::ground, Action::esc_dispatch);
+            on(State::escape, InputClass::esc_csi, State::csi_entry, Action::none, clear_flag);
+            on(State::escape, InputClass::esc_osc, State::osc_string, Action::none, osc_start_flag);
+            on(State::escape, InputClass::esc_dcs, State::string, Action::none);
+            on(State::escape, InputClass::esc_string, State::string, Action::none);
+            on(State::escape, InputClass::printable, State::ground, Action::none);
+
+            on(State::escape_intermediate, InputClass::intermediate, State::escape_intermediate, Action::esc_collect);
+            on_range(State::escape_intermediate, InputClass::digit, InputClass::final, State::ground, Action::esc_dispatch);
+            on(State::escape_intermediate, InputClass::printable, State::ground, Action::none);
+
+            // CSI. Parameters may start with one leader; a colon (sub-parameters) or a parameter
+            // byte in the wrong place makes the sequence malformed, and it is consumed up to its
+            // final without dispatch.
+            for (const State state : { State::csi_entry, State::csi_param, State::csi_intermediate })
+            {
+                on(state, InputClass::intermediate, State::csi_intermediate, Action::csi_collect);
+                on_range(state, InputClass::esc_csi, InputClass::final, State::ground, Action::csi_dispatch);
+                on_range(state, InputClass::digit, InputClass::leader, State::csi_ignore, Action::none);
+                on(state, InputClass::printable, State::csi_ignore, Action::none);
+            }
+            on(State::csi_entry, InputClass::digit, State::csi_param, Action::csi_param);
+            on(State::csi_entry, InputClass::semicolon, State::csi_param, Action::csi_param);
+            on(State::csi_entry, InputClass::leader, State::csi_param, Action::csi_leader);
+            on(State::csi_param, InputClass::digit, State::csi_param, Action::csi_param);
+            on(State::csi_param, InputClass::semicolon, State::csi_param, Action::csi_param);
+            on_range(State::csi_ignore, InputClass::esc_csi, InputClass::final, State::ground, Action::none);
+
+            // OSC Ps ; Pt, ended by BEL, ST or ESC (the ESC of ESC \). CAN and SUB drop it.
+            on_range(State::osc_string, InputClass::intermediate, InputClass::final, State::osc_string, Action::osc_put);
+            on_range(State::osc_string, InputClass::c1, InputClass::c1_csi, State::osc_string, Action::osc_put);
+            on(State::osc_string, InputClass::c1_osc, State::osc_string, Action::osc_put);
+            on(State::osc_string, InputClass::printable, State::osc_string, Action::osc_put);
+            on(State::osc_string, InputClass::bel, State::ground, Action::osc_dispatch);
+            on(State::osc_string, InputClass::c1_st, State::ground, Action::osc_dispatch);
+            on(State::osc_string, InputClass::esc, State::escape, Action::osc_dispatch, clear_flag);
+            on(State::osc_string, InputClass::can_sub, State::ground, Action::none);
+
+            // DCS, SOS, PM and APC.
+            on(State::string, InputClass::c1_st, State::ground, Action::none);
+            on(State::string, InputClass::esc, State::escape, Action::none, clear_flag);
+            on(State::string, InputClass::can_sub, State::ground, Action::none);
+
+            return table;
+        }();
+
+        [[nodiscard]] constexpr Transition transition(const State state, const wchar_t unit) noexcept
+        {
+            return transitions[static_cast<size_t>(state)][static_cast<size_t>(classify(unit))];
+        }
+
+        [[nodiscard]] constexpr bool is_csi_state(const State state) noexcept
+        {
+            return state >= State::csi_entry && state <= State::csi_ignore;
+        }
+
+        constexpr wchar_t replacement_character = 0xFFFD;
+
+        [[nodiscard]] constexpr wchar_t to_unit(const wchar_t unit) noexcept
+        {
+            return unit;
+        }
+
+        [[nodiscard]] constexpr wchar_t to_unit(const char byte) noexcept
+        {
+            return static_cast<wchar_t>(static_cast<unsigned char>(byte));
+        }
+
+        [[nodiscard]] constexpr bool is_utf8_continuation(const unsigned char byte) noexcept
+        {
+            return (byte & 0xC0) == 0x80;
+        }
+
+        // The length of the sequence a UTF-8 lead byte starts, or 0 when it cannot start one
+        // (continuation bytes, the overlong C0 and C1 leads, and leads past U+10FFFF).
+        [[nodiscard]] constexpr size_t utf8_sequence_length(const unsigned char lead) noexcept
+        {
+            if (lead >= 0xC2 && lead <= 0xDF)
+            {
+                return 2;
+            }
+            if (lead >= 0xE0 && lead <= 0xEF)
+            {
+                return 3;
+            }
+            if (lead >= 0xF0 && lead <= 0xF4)
+            {
+                return 4;
+            }
+            return 0;
+        }
+
+        // Whether `byte` may follow `lead` as the first continuation byte. The narrower ranges
+        // after E0, ED, F0 and F4 rule out overlong forms, surrogates and code points past U+10FFFF.
+        [[nodiscard]] constexpr bool is_utf8_second_byte(const unsigned char lead, const unsigned char byte) noexcept
+        {
+            switch (lead)
+            {
+            case 0xE0:
+                return byte >= 0xA0 && byte <= 0xBF;
+            case 0xED:
+                return byte >= 0x80 && byte <= 0x9F;
+            case 0xF0:
+                return byte >= 0x90 && byte <= 0xBF;
+            case 0xF4:
+                return byte >= 0x80 && byte <= 0x8F;
+            default:
+                return is_utf8_continuation(byte);
+            }
+        }
+
+        // Writes `code_point` as one or two UTF-16 units; returns how many.
+        size_t put_utf16(const char32_t code_point, wchar_t* const out) noexcept
+        {
+            if (code_point < 0x10000)
+            {
+                out[0] = static_cast<wchar_t>(code_point);
+                return 1;
+            }
+            out[0] = static_cast<wchar_t>(0xD800 + ((code_point - 0x10000) >> 10));
+            out[1] = static_cast<wchar_t>(0xDC00 + ((code_point - 0x10000) & 0x3FF));
+            return 2;
+        }
+
+        // Spot checks of the generated table.
+        static_assert(transition(State::ground, L'a') == make_transition(State::ground, Action::print));
+        static_assert(transition(State::ground, 0x4E00) == make_transition(State::ground, Action::print));
+        static_assert(transition(State::ground, L'\n') == make_transition(State::ground, Action::execute));
+        static_assert(transition(State::escape, L'[') == make_transition(State::csi_entry, Action::none, clear_flag));
+        static_assert(transition(State::escape, L'7') == make_transition(State::ground, Action::esc_dispatch));
+        static_assert(transition(State::csi_entry, L'?') == make_transition(State::csi_param, Action::csi_leader));
+        static_assert(transition(State::csi_param, L'?') == make_transition(State::csi_ignore, Action::none));
+        static_assert(transition(State::csi_param, L'm') == make_transition(State::ground, Action::csi_dispatch));
+        static_assert(transition(State::csi_intermediate, L'[') == make_transition(State::ground, Action::csi_dispatch));
+        static_assert(transition(State::osc_string, 0x1B) == make_transition(State::escape, Action::osc_dispatch, clear_flag));
+        static_assert(transition(State::string, L'a') == make_transition(State::string, Action::none));
+    }
+
+    void VtOutputParser::clear_sequence() noexcept
+    {
+        _esc.intermediate_count = 0;
+        _csi.leader = 0;
+        _csi.private_marker = false;
+        _csi.exclamation_marker = false;
+        _csi.intermediate_count = 0;
+        _csi.param_count = 0;
+        _csi_current = 0;
+        _csi_have_digits = false;
+        _csi_last_was_separator = false;
+    }
+
+    void VtOutputParser::start_osc() noexcept
+    {
+        _osc_command = 0;
+        _osc_in_payload = false;
+        _osc_invalid = false;
+        _osc_length = 0;
+    }
+
+    void VtOutputParser::put_csi_parameter(const wchar_t unit) noexcept
+    {
+        if (unit == L';')
+        {
+            if (_csi.param_count < _csi.params.size())
+            {
+                _csi.params[_csi.param_count++] = _csi_have_digits ? _csi_current : 0U;
+            }
+            _csi_current = 0;
+            _csi_have_digits = false;
+            _csi_last_was_separator = true;
+            return;
+        }
+
+        _csi_have_digits = true;
+        _csi_last_was_separator = false;
+        if (_csi_current <= 1'000'000U)
+        {
+            _csi_current = _csi_current * 10U + static_cast<unsigned>(unit - L'0');
+        }
+    }
+
+    void VtOutputParser::put_osc(const wchar_t unit) noexcept
+    {
+        if (_osc_in_payload)
+        {
+            if (_osc_length < _osc_payload.size())
+            {
+                _osc_payload[_osc_length++] = unit;
+            }
+            return;
+        }
+
+        if (unit >= L'0' && unit <= L'9')
+        {
+            if (_osc_command <= 1'000'000U)
+            {
+                _osc_command = _osc_command * 10U + static_cast<unsigned>(unit - L'0');
+            }
+        }
+        else if (unit == L';')
+        {
+            _osc_in_payload = true;
+        }
+        else
+        {
+            // Not a command number. The string is still consumed up to its terminator.
+            _osc_invalid = true;
+        }
+    }
+
+    template<typename Unit>
+    VtAction VtOutputParser::advance_units(const std::basic_string_view<Unit> input, size_t& offset) noexcept
+    {
+        // The loop works on locals and stores them back when it returns, so the state and the
+        // length cap stay in registers across a sequence.
+        const Unit* const units = input.data();
+        const size_t size = input.size();
+        size_t position = offset;
+        State state = _state;
+        size_t length = _length;
+        const auto leave = [&](const VtAction result) noexcept {
+            offset = position;
+            _state = state;
+            _length = length;
+            return result;
+        };
+
+        while (position < size)
+        {
+            const wchar_t unit = to_unit(units[position]);
+            if constexpr (sizeof(Unit) == 1)
+            {
+                // A UTF-8 lead or continuation byte, in any state: the caller decodes it and feeds
+                // the UTF-16 result back through the other overload.
+                if (unit >= 0x80)
+                {
+                    return leave(VtAction::print);
+                }
+            }
+            if (is_csi_state(state) && length++ >= max_csi_length)
+            {
+                state = State::ground;
+                ++position;
+                continue;
+            }
+
+            const Transition next = transition(state, unit);
+            const Action action = transition_action(next);
+            if (action == Action::print)
+            {
+                return leave(VtAction::print);
+            }
+
+            ++position;
+            state = next_state(next);
+            if ((next & clear_flag) != 0)
+            {
+                clear_sequence();
+                length = 0;
+            }
+            if ((next & osc_start_flag) != 0)
+            {
+                start_osc();
+            }
+
+            switch (action)
+            {
+            case Action::execute:
+                _control = unit;
+                return leave(VtAction::execute);
+            case Action::esc_collect:
+                if (_esc.intermediate_count < _esc.intermediates.size())
+                {
+                    _esc.intermediates[_esc.intermediate_count++] = unit;
+                }
+                if (++length >= max_escape_length)
+                {
+                    state = State::ground;
+                }
+                break;
+            case Action::esc_dispatch:
+                _esc.final = unit;
+                return leave(VtAction::esc_dispatch);
+            case Action::csi_leader:
+                _csi.leader = unit;
+                _csi.private_marker = unit == L'?';
+                break;
+            case Action::csi_collect:
+                if (_csi.intermediate_count < _csi.intermediates.size())
+                {
+                    _csi.intermediates[_csi.intermediate_count++] = unit;
+                }
+                else
+                {
+                    state = State::csi_ignore;
+                }
+                break;
+            case Action::csi_param:
+                put_csi_parameter(unit);
+                // The rest of the parameter string stays in `csi_param`; take it without going
+                // back through the table.
+                while (position < size && length < max_csi_length)
+                {
+                    const wchar_t parameter = to_unit(units[position]);
+                    if ((parameter < L'0' || parameter > L'9') && parameter != L';')
+                    {
+                        break;
+                    }
+                    put_csi_parameter(parameter);
+                    ++position;
+                    ++length;
+                }
+                break;
+            case Action::csi_dispatch:
+                if ((_csi_have_digits || _csi_last_was_separator) && _csi.param_count < _csi.params.size())
+                {
+                    _csi.params[_csi.param_count++] = _csi_have_digits ? _csi_current : 0U;
+                }
+                _csi.final = unit;
+                _csi.exclamation_marker = _csi.intermediate_count == 1 && _csi.intermediates[0] == L'!';
+                return leave(VtAction::csi_dispatch);
+            case Action::osc_put:
+                put_osc(unit);
+                break;
+            case Action::osc_dispatch:
+                if (_osc_in_payload && !_osc_invalid)
+                {
+                    return leave(VtAction::osc_dispatch);
+                }
+                break;
+            case Action::none:
+            case Action::print:
+                break;
+            }
+        }
+
+        return leave(VtAction::none);
+    }
+
+    VtAction VtOutputParser::advance_table(const std::wstring_view text, size_t& offset) noexcept
+    {
+        return advance_units(text, offset);
+    }
+
+    VtAction VtOutputParser::advance_table(const std::string_view bytes, size_t& offset) noexcept
+    {
+        return advance_units(bytes, offset);
+    }
+
+    size_t VtOutputParser::decode_utf8(const std::string_view bytes, size_t& offset, const std::span<wchar_t> out) noexcept
+    {
+        const auto* const input = reinterpret_cast<const unsigned char*>(bytes.data());
+        const size_t size = bytes.size();
+        size_t position = offset;
+        size_t count = 0;
+
+        // Finish a sequence the previous write cut off. A byte that cannot continue it ends it as
+        // U+FFFD and is decoded on its own.
+        while (_utf8_length != 0 && count + 2 <= out.size())
+        {
+            if (position == size)
+            {
+                offset = position;
+                return count;
+            }
+
+            const unsigned char byte = input[position];
+            const bool fits = _utf8_length == 1 ? is_utf8_second_byte(_utf8_pending[0], byte) : is_utf8_continuation(byte);
+            if (!fits)
+            {
+                out[count++] = replacement_character;
+                _utf8_length = 0;
+                break;
+            }
+
+            _utf8_pending[_utf8_length++] = byte;
+            ++position;
+            const size_t needed = utf8_sequence_length(_utf8_pending[0]);
+            if (_utf8_length == needed)
+            {
+                char32_t code_point = static_cast<char32_t>(_utf8_pending[0] & (0x7F >> needed));
+                for (size_t i = 1; i < needed; ++i)
+                {
+                    code_point = (code_point << 6) | (_utf8_pending[i] & 0x3F);
+                }
+                count += put_utf16(code_point, out.data() + count);
+                _utf8_length = 0;
+            }
+        }
+
+        while (position < size)
+        {
+            const unsigned char lead = input[position];
+            if (lead < 0x80)
+            {
+                // ASCII is widened a run at a time. A control goes back to the parser.
+                if (lead < 0x20 || lead == 0x7F)
+                {
+                    break;
+                }
+                const size_t end = position + std::min(size - position, out.size() - count);
+                while (position < end && input[position] >= 0x20 && input[position] < 0x7F)
+                {
+                    out[count++] = static_cast<wchar_t>(input[position++]);
+                }
+                if (count == out.size())
+                {
+                    break;
+                }
+                continue;
+            }
+
+            if (count + 2 > out.size())
+            {
+                break;
+            }
+
+            const size_t needed = utf8_sequence_length(lead);
+            if (needed == 0)
+            {
+                out[count++] = replacement_character;
+                ++position;
+                continue;
+            }
+
+            // Take the continuation bytes that fit. Running out of input keeps them for the next
+            // call; a byte that does not fit ends the sequence as U+FFFD.
+            size_t taken = 1;
+            while (taken < needed && position + taken < size &&
+                   (taken == 1 ? is_utf8_second_byte(lead, input[position + 1]) : is_utf8_continuation(input[position + taken])))
+            {
+                ++taken;
+            }
+
+            if (taken == needed)
+            {
+                char32_t code_point = static_cast<char32_t>(lead & (0x7F >> needed));
+                for (size_t i = 1; i < needed; ++i)
+                {
+                    code_point = (code_point << 6) | (input[position + i] & 0x3F);
+                }
+                count += put_utf16(code_point, out.data() + count);
+            }
+            else if (position + taken == size)
+            {
+                std::copy_n(input + position, taken, _utf8_pending.begin());
+                _utf8_length = taken;
+            }
+            else
+            {
+                out[count++] = replacement_character;
+            }
+            position += taken;
+        }
+
+        offset = position;
+        return count;
+    }
+}
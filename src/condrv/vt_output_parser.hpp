@@ -0,0 +1,201 @@
+#pragma once
+
+// DEC-compatible parser for the VT sequences in console output text.
+//
+// The states and transitions follow Paul Williams' model of the VT500 parser. They live in one
+// constexpr table indexed by state and input class, built at compile time, so each code unit costs
+// a class lookup and a table load instead of a chain of per-phase comparisons.
+//
+// The parser only recognizes sequences. It collects escape intermediates, CSI parameters and OSC
+// payloads and hands each complete sequence to its caller, which decides what it does to a screen
+// buffer. `apply_text_to_screen_buffer` is one such caller; anything else that needs to walk VT
+// output (recording, passthrough, benchmarks) can use the same parser without a screen.
+//
+// The parser reads UTF-16 text, or UTF-8 bytes straight from a pseudoconsole pipe: controls and
+// sequences are recognized on the bytes, and only text is decoded.
+//
+// See `new/docs/design/condrv_vt_output_parser.md`.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace oc::condrv
+{
+    // ESC I..I F: intermediates 0x20..0x2F and a final 0x30..0x7E.
+    struct VtEscSequence final
+    {
+        wchar_t final{};
+        std::array<wchar_t, 8> intermediates{};
+        size_t intermediate_count{};
+    };
+
+    // CSI P..P I..I F.
+    struct VtCsiSequence final
+    {
+        wchar_t final{};
+        // '<', '=', '>' or '?' before the parameters; 0 when there is none.
+        wchar_t leader{};
+        // The leader is '?' (DEC private modes).
+        bool private_marker{};
+        // The only intermediate is '!' (DECSTR).
+        bool exclamation_marker{};
+        std::array<wchar_t, 2> intermediates{};
+        size_t intermediate_count{};
+        // Omitted parameters are 0. Parameters past the 16th are dropped.
+        std::array<unsigned, 16> params{};
+        size_t param_count{};
+    };
+
+    enum class VtAction : uint8_t
+    {
+        // The text ran out inside a sequence, or only consumed units that need no handling.
+        none,
+        // The unit at `offset` starts printable text. It is not consumed: the caller takes one or
+        // more printable units and moves `offset` past them.
+        print,
+        // A C0 or C1 control outside a string was consumed; see `control()`.
+        execute,
+        esc_dispatch,
+        csi_dispatch,
+        osc_dispatch,
+    };
+
+    class VtOutputParser final
+    {
+    public:
+        // An ESC sequence with this many intermediates, or a CSI sequence with this many units
+        // after the introducer, is abandoned and the parser returns to ground.
+        static constexpr size_t max_escape_length = 16;
+        static constexpr size_t max_csi_length = 128;
+        // OSC payload units past this are dropped.
+        static constexpr size_t max_osc_payload = 4096;
+
+        // Consume code units from `text` starting at `offset` until something needs the caller,
+        // and say what. `offset` must be inside `text`. State carries over between calls, so a
+        // sequence may be split across writes.
+        [[nodiscard]] VtAction advance(const std::wstring_view text, size_t& offset) noexcept
+        {
+            if (_state == State::ground && is_ground_printable(text[offset])) [[likely]]
+            {
+                return VtAction::print;
+            }
+            return advance_table(text, offset);
+        }
+
+        // The same for UTF-8 bytes, so a byte stream needs no UTF-16 copy first. ASCII is parsed on
+        // the bytes. A byte from 0x80 up returns `print` without being consumed, in any state: the
+        // caller decodes the run with `decode_utf8` and passes the UTF-16 result to the overload
+        // above, which reads a decoded C1 control as a control and keeps OSC text in the payload.
+        [[nodiscard]] VtAction advance(const std::string_view bytes, size_t& offset) noexcept
+        {
+            const auto byte = static_cast<unsigned char>(bytes[offset]);
+            if ((_state == State::ground && byte >= 0x20 && byte != 0x7F) || _utf8_length != 0) [[likely]]
+            {
+                return VtAction::print;
+            }
+            return advance_table(bytes, offset);
+        }
+
+        // Decodes UTF-8 from `offset` into `out` up to the next ASCII control, or until `out` is
+        // full, and moves `offset` past the bytes it took; returns the units written. A sequence
+        // cut off by the end of `bytes` is kept and finished by the next call. Malformed bytes
+        // become U+FFFD. `out` must hold at least two units.
+        [[nodiscard]] size_t decode_utf8(std::string_view bytes, size_t& offset, std::span<wchar_t> out) noexcept;
+
+        // The control consumed by the last `execute`.
+        [[nodiscard]] wchar_t control() const noexcept
+        {
+            return _control;
+        }
+
+        // The sequence just dispatched. Valid until the next `advance`.
+        [[nodiscard]] const VtEscSequence& esc() const noexcept
+        {
+            return _esc;
+        }
+
+        [[nodiscard]] const VtCsiSequence& csi() const noexcept
+        {
+            return _csi;
+        }
+
+        // OSC Ps ; Pt: the command number (0 when omitted) and the text.
+        [[nodiscard]] unsigned osc_command() const noexcept
+        {
+            return _osc_command;
+        }
+
+        [[nodiscard]] std::wstring_view osc_payload() const noexcept
+        {
+            return std::wstring_view(_osc_payload.data(), _osc_length);
+        }
+
+        [[nodiscard]] bool in_ground() const noexcept
+        {
+            return _state == State::ground;
+        }
+
+        // Returns to ground. A UTF-8 sequence cut off by the last write is kept: it belongs to the
+        // text, not to the sequence being dropped.
+        void reset() noexcept
+        {
+            _state = State::ground;
+        }
+
+        // Units the ground state hands to the caller as text: everything but C0, DEL and C1.
+        [[nodiscard]] static constexpr bool is_ground_printable(const wchar_t unit) noexcept
+        {
+            return (unit >= 0x20 && unit < 0x7F) || unit >= 0xA0;
+        }
+
+        enum class State : uint8_t
+        {
+            ground,
+            escape,
+            escape_intermediate,
+            csi_entry,
+            csi_param,
+            csi_intermediate,
+            csi_ignore,
+            osc_string,
+            // DCS, SOS, PM and APC: consumed up to ST and ignored.
+            string,
+        };
+
+    private:
+        [[nodiscard]] VtAction advance_table(std::wstring_view text, size_t& offset) noexcept;
+        [[nodiscard]] VtAction advance_table(std::string_view bytes, size_t& offset) noexcept;
+        template<typename Unit>
+        [[nodiscard]] VtAction advance_units(std::basic_string_view<Unit> input, size_t& offset) noexcept;
+
+        void clear_sequence() noexcept;
+        void start_osc() noexcept;
+        void put_csi_parameter(wchar_t unit) noexcept;
+        void put_osc(wchar_t unit) noexcept;
+
+        State _state{ State::ground };
+        wchar_t _control{};
+        // Units consumed by the current ESC or CSI sequence, for the length caps.
+        size_t _length{};
+
+        VtEscSequence _esc{};
+
+        VtCsiSequence _csi{};
+        unsigned _csi_current{};
+        bool _csi_have_digits{};
+        bool _csi_last_was_separator{};
+
+        unsigned _osc_command{};
+        bool _osc_in_payload{};
+        bool _osc_invalid{};
+        size_t _osc_length{};
+        std::array<wchar_t, max_osc_payload> _osc_payload{};
+
+        // The start of a UTF-8 sequence the last write cut off.
+        std::array<unsigned char, 4> _utf8_pending{};
+        size_t _utf8_length{};
+    };
+}
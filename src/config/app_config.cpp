@@ -33,6 +33,10 @@ namespace oc::config
         constexpr std::wstring_view kEmbeddingPassthroughEnv = L"OPENCONSOLE_NEW_ALLOW_EMBEDDING_PASSTHROUGH";
         constexpr std::wstring_view kLegacyPathEnv = L"OPENCONSOLE_NEW_ENABLE_LEGACY_PATH";
         constexpr std::wstring_view kEmbeddingWaitEnv = L"OPENCONSOLE_NEW_EMBEDDING_WAIT_MS";
+        constexpr std::wstring_view kCondrvPipelinedIoEnv = L"OPENCONSOLE_NEW_CONDRV_PIPELINED_IO";
+        constexpr std::wstring_view kCondrvTraceDirEnv = L"OPENCONSOLE_NEW_CONDRV_TRACE_DIR";
+        constexpr std::wstring_view kCondrvApiMetricsEnv = L"OPENCONSOLE_NEW_CONDRV_API_METRICS";
+        constexpr std::wstring_view kSnapshotMaxFpsEnv = L"OPENCONSOLE_NEW_SNAPSHOT_MAX_FPS";
 
         [[nodiscard]] std::wstring trim(std::wstring value)
         {
@@ -372,6 +376,26 @@ namespace oc::config
             if (key == L"embedding_wait_timeout_ms")
             {
                 config.embedding_wait_timeout_ms = parse_dword_or_default(value, config.embedding_wait_timeout_ms);
+                return;
+            }
+            if (key == L"condrv_pipelined_io")
+            {
+                config.condrv_pipelined_io = parse_bool(value);
+                return;
+            }
+            if (key == L"condrv_trace_dir")
+            {
+                config.condrv_trace_directory = std::move(value);
+                return;
+            }
+            if (key == L"condrv_api_metrics")
+            {
+                config.condrv_api_metrics = parse_bool(value);
+                return;
+            }
+            if (key == L"snapshot_max_fps")
+            {
+                config.snapshot_max_fps = parse_dword_or_default(value, config.snapshot_max_fps);
             }
         }
 
@@ -431,6 +455,22 @@ namespace oc::config
             {
                 config.embedding_wait_timeout_ms = parse_dword_or_default(*value, config.embedding_wait_timeout_ms);
             }
+            if (const auto value = read_environment(kCondrvPipelinedIoEnv))
+            {
+                config.condrv_pipelined_io = parse_bool(*value);
+            }
+            if (const auto value = read_environment(kCondrvTraceDirEnv))
+            {
+                config.condrv_trace_directory = trim(*value);
+            }
+            if (const auto value = read_environment(kCondrvApiMetricsEnv))
+            {
+                config.condrv_api_metrics = parse_bool(*value);
+            }
+            if (const auto value = read_environment(kSnapshotMaxFpsEnv))
+            {
+                config.snapshot_max_fps = parse_dword_or_default(*value, config.snapshot_max_fps);
+            }
         }
     }
 
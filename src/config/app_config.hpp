@@ -30,6 +30,10 @@ namespace oc::config
         bool allow_embedding_passthrough{ true };
         bool enable_legacy_conhost_path{ true };
         DWORD embedding_wait_timeout_ms{ 0 };
+        bool condrv_pipelined_io{ false };
+        std::wstring condrv_trace_directory;
+        bool condrv_api_metrics{ false };
+        DWORD snapshot_max_fps{ 60 };
     };
 
     class ConfigLoader final
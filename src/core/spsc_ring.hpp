@@ -0,0 +1,117 @@
+#pragma once
+
+// Bounded single-producer / single-consumer ring buffer.
+//
+// Rationale:
+// - The pipelined ConDrv server hands packets from its IO thread to its dispatch thread (and
+//   completed messages back) at driver-message rates. A mutex per hand-off would put both
+//   threads on the same lock for every request.
+// - With exactly one producer and one consumer, two monotonically increasing indices are enough:
+//   the producer owns `_tail`, the consumer owns `_head`, and each publishes with a release store
+//   that the other side observes with an acquire load.
+//
+// Contract:
+// - Exactly one thread may call `try_push`, and exactly one (possibly different) thread may call
+//   `try_pop`. `empty()` / `size()` are approximate when called from a third thread.
+// - `Capacity` must be a power of two. Elements are constructed in place and destroyed on pop.
+// - Blocking is left to the caller; the ring never waits.
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace oc::core
+{
+    template<typename T, size_t Capacity>
+    class SpscRing final
+    {
+        static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+        static_assert(std::is_nothrow_move_constructible_v<T>, "SpscRing elements must be nothrow move constructible");
+
+    public:
+        SpscRing() noexcept = default;
+
+        ~SpscRing() noexcept
+        {
+            while (try_pop().has_value())
+            {
+            }
+        }
+
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+        SpscRing(SpscRing&&) = delete;
+        SpscRing& operator=(SpscRing&&) = delete;
+
+        [[nodiscard]] static constexpr size_t capacity() noexcept
+        {
+            return Capacity;
+        }
+
+        // Producer side. Returns false (leaving `value` untouched) when the ring is full.
+        [[nodiscard]] bool try_push(T&& value) noexcept
+        {
+            const size_t tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _head.load(std::memory_order_acquire) == Capacity)
+            {
+                return false;
+            }
+
+            ::new (static_cast<void*>(slot(tail))) T(std::move(value));
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side. Returns `std::nullopt` when the ring is empty.
+        [[nodiscard]] std::optional<T> try_pop() noexcept
+        {
+            const size_t head = _head.load(std::memory_order_relaxed);
+            if (head == _tail.load(std::memory_order_acquire))
+            {
+                return std::nullopt;
+            }
+
+            T* const element = std::launder(slot(head));
+            std::optional<T> value(std::move(*element));
+            element->~T();
+            _head.store(head + 1, std::memory_order_release);
+            return value;
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+        }
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            const size_t head = _head.load(std::memory_order_acquire);
+            return _tail.load(std::memory_order_acquire) - head;
+        }
+
+    private:
+        // Padding (rather than `alignas`) keeps the producer and consumer indices on separate cache
+        // lines without over-aligning the ring itself.
+        static constexpr size_t cache_line_bytes = 64;
+
+        struct alignas(T) Storage final
+        {
+            std::byte bytes[sizeof(T)];
+        };
+
+        [[nodiscard]] T* slot(const size_t index) noexcept
+        {
+            return reinterpret_cast<T*>(_slots[index & (Capacity - 1)].bytes);
+        }
+
+        std::atomic<size_t> _head{ 0 };
+        std::byte _head_padding[cache_line_bytes]{};
+        std::atomic<size_t> _tail{ 0 };
+        std::byte _tail_padding[cache_line_bytes]{};
+        std::array<Storage, Capacity> _slots{};
+    };
+}
@@ -527,6 +527,7 @@ namespace oc::renderer
                 const float margin_y = 0.0f;
                 const float row_height = static_cast<float>(cell_h);
 
+                size_t next_cluster = 0;
                 for (int row = 0; row < viewport_h; ++row)
                 {
                     const size_t offset = static_cast<size_t>(row) * static_cast<size_t>(viewport_w);
@@ -543,17 +544,59 @@ namespace oc::renderer
                     }
                     const float top = margin_y + static_cast<float>(row) * row_height;
 
+                    // A run also ends after the trailing half of a double-width glyph, so every glyph
+                    // starts at its own cell. The glyph is drawn once, from its leading cell; a
+                    // trailing half holding a low surrogate completes the pair instead. A cluster
+                    // (a glyph of more than one code unit) is a run of its own, drawn from its text
+                    // in `cluster_text`.
+                    constexpr USHORT cell_width_bits = COMMON_LVB_LEADING_BYTE | COMMON_LVB_TRAILING_BYTE;
+                    const auto attributes_at = [&](const int column) noexcept {
+                        return static_cast<USHORT>((attr_ptr ? attr_ptr[column] : snapshot->default_attributes) & ~cell_width_bits);
+                    };
+                    const auto cluster_at = [&](const int column) noexcept {
+                        const size_t cell = offset + static_cast<size_t>(column);
+                        while (next_cluster < snapshot->clusters.size() && snapshot->clusters[next_cluster].cell < cell)
+                        {
+                            ++next_cluster;
+                        }
+                        return next_cluster < snapshot->clusters.size() && snapshot->clusters[next_cluster].cell == cell &&
+                               snapshot->clusters[next_cluster].offset + snapshot->clusters[next_cluster].length <= snapshot->cluster_text.size();
+                    };
+
                     int col = 0;
                     while (col < viewport_w)
                     {
-                        const USHORT attributes = attr_ptr ? attr_ptr[col] : snapshot->default_attributes;
+                        const USHORT attributes = attributes_at(col);
                         int run_start = col;
-                        for (; col < viewport_w; ++col)
+                        int text_len = 0;
+                        const wchar_t* run_text = row_ptr + run_start;
+                        if (cluster_at(col))
                         {
-                            const USHORT current = attr_ptr ? attr_ptr[col] : snapshot->default_attributes;
-                            if (current != attributes)
+                            const auto& cluster = snapshot->clusters[next_cluster];
+                            run_text = snapshot->cluster_text.data() + cluster.offset;
+                            text_len = static_cast<int>(cluster.length);
+                            ++col;
+                            if (col < viewport_w && attr_ptr && (attr_ptr[col - 1] & COMMON_LVB_LEADING_BYTE) != 0 &&
+                                (attr_ptr[col] & COMMON_LVB_TRAILING_BYTE) != 0)
                             {
-                                break;
+                                ++col;
+                            }
+                        }
+                        else
+                        {
+                            for (; col < viewport_w; ++col)
+                            {
+                                if (attributes_at(col) != attributes || (col > run_start && cluster_at(col)))
+                                {
+                                    break;
+                                }
+                                if (attr_ptr && (attr_ptr[col] & COMMON_LVB_TRAILING_BYTE) != 0 && col > run_start &&
+                                    (row_ptr[col] < 0xDC00 || row_ptr[col] > 0xDFFF))
+                                {
+                                    ++col;
+                                    break;
+                                }
+                                ++text_len;
                             }
                         }
 
@@ -580,9 +623,9 @@ namespace oc::renderer
                         }
 
                         bool has_text = false;
-                        for (int i = 0; i < run_len; ++i)
+                        for (int i = 0; i < text_len; ++i)
                         {
-                            if (row_ptr[run_start + i] != L' ')
+                            if (run_text[i] != L' ')
                             {
                                 has_text = true;
                                 break;
@@ -600,8 +643,8 @@ namespace oc::renderer
                             };
 
                             _resources->render_target->DrawTextW(
-                                row_ptr + run_start,
-                                static_cast<UINT32>(run_len),
+                                run_text,
+                                static_cast<UINT32>(text_len),
                                 _resources->text_format.get(),
                                 layout,
                                 _resources->text_brush.get());
@@ -2,10 +2,10 @@
 
 #include "condrv/condrv_device_comm.hpp"
 #include "condrv/condrv_server.hpp"
+#include "condrv/snapshot_publisher.hpp"
 #include "core/assert.hpp"
 #include "core/handle_view.hpp"
 #include "core/host_signals.hpp"
-#include "core/utf8_stream_decoder.hpp"
 #include "core/unique_handle.hpp"
 #include "core/win32_handle.hpp"
 #include "core/win32_wait.hpp"
@@ -778,6 +778,16 @@ namespace oc::runtime
             return process;
         }
 
+        [[nodiscard]] condrv::ServerRunOptions make_server_run_options(const SessionOptions& options)
+        {
+            return condrv::ServerRunOptions{
+                .pipelined_io = options.condrv_pipelined_io,
+                .trace_directory = options.condrv_trace_directory,
+                .api_metrics = options.condrv_api_metrics,
+                .snapshot_max_fps = options.snapshot_max_fps,
+            };
+        }
+
         struct WindowedServerContext final
         {
             core::HandleView server_handle{};
@@ -788,6 +798,7 @@ namespace oc::runtime
             core::UniqueHandle input_available_event;
             core::UniqueHandle host_input;
             std::optional<condrv::IoPacket> initial_packet;
+            condrv::ServerRunOptions server_options{};
 
             DWORD exit_code{ 0 };
             SessionError error{};
@@ -815,7 +826,8 @@ namespace oc::runtime
                     context->initial_packet.value(),
                     *context->logger,
                     context->published_screen,
-                    context->window);
+                    context->window,
+                    context->server_options);
             }
             else
             {
@@ -827,7 +839,8 @@ namespace oc::runtime
                     core::HandleView{},
                     *context->logger,
                     context->published_screen,
-                    context->window);
+                    context->window,
+                    context->server_options);
             }
 
             if (result)
@@ -1008,6 +1021,7 @@ namespace oc::runtime
             server_context->input_available_event = std::move(input_available_event);
             server_context->host_input = std::move(host_input_read);
             server_context->initial_packet = std::move(initial_packet);
+            server_context->server_options = make_server_run_options(options);
 
             core::UniqueHandle server_thread(::CreateThread(
                 nullptr,
@@ -1944,7 +1958,7 @@ namespace oc::runtime
             core::HandleView stop_event{};
             logging::Logger* logger{};
             HWND window{};
-            std::shared_ptr<view::PublishedScreenBuffer> published_screen;
+            std::optional<condrv::SnapshotPublisher> snapshot_publisher;
             std::shared_ptr<condrv::ScreenBuffer> screen_buffer;
 
             core::UniqueHandle process;
@@ -1956,23 +1970,23 @@ namespace oc::runtime
             bool hold_window_on_exit{ false };
         };
 
-        void publish_terminal_snapshot_best_effort(WindowedPtyContext& context) noexcept
+        // Publishes the terminal model when a frame is due (or unconditionally with `flush`). The
+        // output worker calls this on every poll iteration, so a coalesced change lands within one
+        // frame interval even when the client goes quiet.
+        void publish_terminal_snapshot_best_effort(WindowedPtyContext& context, const bool flush) noexcept
         {
-            if (!context.published_screen || !context.screen_buffer)
+            if (!context.snapshot_publisher || !context.screen_buffer)
             {
                 return;
             }
 
-            const auto snapshot = condrv::make_viewport_snapshot(*context.screen_buffer);
-            if (!snapshot)
+            if (flush)
             {
-                return;
+                (void)context.snapshot_publisher->flush(context.screen_buffer);
             }
-
-            context.published_screen->publish(snapshot.value());
-            if (context.window != nullptr)
+            else
             {
-                (void)::PostMessageW(context.window, WM_APP + 1, 0, 0);
+                (void)context.snapshot_publisher->update(context.screen_buffer);
             }
         }
 
@@ -1980,7 +1994,7 @@ namespace oc::runtime
         {
             auto* context = static_cast<WindowedPtyContext*>(param);
             if (context == nullptr || context->logger == nullptr || !context->process.valid() || !context->pty_output_read.valid() ||
-                !context->screen_buffer || !context->published_screen)
+                !context->screen_buffer || !context->snapshot_publisher)
             {
                 return 0;
             }
@@ -1988,8 +2002,6 @@ namespace oc::runtime
             bool canceled = false;
             try
             {
-                core::Utf8StreamDecoder decoder;
-
                 bool process_exited = false;
                 bool draining_after_exit = false;
                 ULONGLONG drain_start_tick = 0;
@@ -2076,18 +2088,13 @@ namespace oc::runtime
                         if (read != 0)
                         {
                             had_output = true;
-                            const auto chunk = std::span<const std::byte>(buffer.data(), static_cast<size_t>(read));
-                            std::wstring decoded = decoder.decode_append(chunk);
-                            if (!decoded.empty())
-                            {
-                                condrv::apply_text_to_screen_buffer<condrv::NullHostIo>(
-                                    *context->screen_buffer,
-                                    decoded,
-                                    k_terminal_output_mode,
-                                    nullptr,
-                                    nullptr);
-                                publish_terminal_snapshot_best_effort(*context);
-                            }
+                            const auto bytes = std::string_view(reinterpret_cast<const char*>(buffer.data()), static_cast<size_t>(read));
+                            condrv::apply_utf8_to_screen_buffer<condrv::NullHostIo>(
+                                *context->screen_buffer,
+                                bytes,
+                                k_terminal_output_mode,
+                                nullptr,
+                                nullptr);
                         }
 
                         if (had_output)
@@ -2096,6 +2103,8 @@ namespace oc::runtime
                         }
                     }
 
+                    publish_terminal_snapshot_best_effort(*context, false);
+
                     if (process_exited)
                     {
                         if (!had_output)
@@ -2118,6 +2127,8 @@ namespace oc::runtime
                     }
                 }
 
+                publish_terminal_snapshot_best_effort(*context, true);
+
                 DWORD exit_code = 0;
                 if (::GetExitCodeProcess(context->process.get(), &exit_code) == FALSE)
                 {
@@ -2149,7 +2160,7 @@ namespace oc::runtime
                             k_terminal_output_mode,
                             nullptr,
                             nullptr);
-                        publish_terminal_snapshot_best_effort(*context);
+                        publish_terminal_snapshot_best_effort(*context, true);
                     }
                     else if (context->window != nullptr)
                     {
@@ -2220,11 +2231,11 @@ namespace oc::runtime
             WindowedPtyContext context{};
             context.stop_event = stop_event->view();
             context.logger = &logger;
-            context.published_screen = published_screen;
+            context.snapshot_publisher.emplace(published_screen, nullptr, options.snapshot_max_fps);
             context.screen_buffer = screen_buffer;
             context.hold_window_on_exit = options.hold_window_on_exit;
 
-            publish_terminal_snapshot_best_effort(context);
+            publish_terminal_snapshot_best_effort(context, true);
 
             core::UniqueHandle pty_input_read;
             core::UniqueHandle pty_input_write;
@@ -2317,6 +2328,7 @@ namespace oc::runtime
             }
 
             context.window = (*window)->hwnd();
+            context.snapshot_publisher->set_paint_target(context.window);
 
             core::UniqueHandle output_thread(::CreateThread(
                 nullptr,
@@ -2533,7 +2545,8 @@ namespace oc::runtime
                             core::HandleView{},
                             core::HandleView{},
                             initial_packet.value(),
-                            logger);
+                            logger,
+                            make_server_run_options(options));
                         if (!server_result)
                         {
                             return std::unexpected(SessionError{
@@ -2550,7 +2563,8 @@ namespace oc::runtime
                         core::HandleView{},
                         core::HandleView{},
                         core::HandleView{},
-                        logger);
+                        logger,
+                        make_server_run_options(options));
                     if (!server_result)
                     {
                         return std::unexpected(SessionError{
@@ -3140,7 +3154,8 @@ namespace oc::runtime
                 options.host_input,
                 options.host_output,
                 host_signal_pipe,
-                logger);
+                logger,
+                make_server_run_options(options));
             if (!server_result)
             {
                 return std::unexpected(SessionError{
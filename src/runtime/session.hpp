@@ -91,6 +91,22 @@ namespace oc::runtime
         // When true (create-server windowed terminal mode), keep the window open
         // after the hosted client exits and append an exit-code message.
         bool hold_window_on_exit{ false };
+
+        // When true, ConDrv server loops run driver IO on a dedicated thread
+        // (`condrv::ServerRunOptions::pipelined_io`).
+        bool condrv_pipelined_io{ false };
+
+        // When non-empty, ConDrv server loops capture a packet trace into this directory
+        // (`condrv::ServerRunOptions::trace_directory`).
+        std::wstring condrv_trace_directory;
+
+        // When true, ConDrv server loops log per-API counters and latency histograms on exit
+        // (`condrv::ServerRunOptions::api_metrics`).
+        bool condrv_api_metrics{ false };
+
+        // Maximum viewport snapshots per second published to a window (ConDrv server loops and the
+        // windowed ConPTY worker). 0 publishes every change (`condrv::ServerRunOptions::snapshot_max_fps`).
+        DWORD snapshot_max_fps{ 60 };
     };
 
     struct SessionError final
@@ -1,7 +1,7 @@
 #include "runtime/terminal_handoff_host.hpp"
 
 #include "condrv/condrv_server.hpp"
-#include "core/utf8_stream_decoder.hpp"
+#include "condrv/snapshot_publisher.hpp"
 #include "core/win32_handle.hpp"
 #include "renderer/window_host.hpp"
 #include "runtime/window_input_sink.hpp"
@@ -10,6 +10,7 @@
 
 #include <array>
 #include <memory>
+#include <optional>
 #include <string_view>
 
 namespace oc::runtime
@@ -27,7 +28,7 @@ namespace oc::runtime
             core::HandleView stop_event{};
             logging::Logger* logger{};
             HWND window{};
-            std::shared_ptr<view::PublishedScreenBuffer> published_screen;
+            std::optional<condrv::SnapshotPublisher> snapshot_publisher;
             std::shared_ptr<condrv::ScreenBuffer> screen_buffer;
 
             core::UniqueHandle terminal_output_read;
@@ -39,23 +40,23 @@ namespace oc::runtime
             bool hold_window_on_exit{ false };
         };
 
-        void publish_snapshot_best_effort(WindowedTerminalContext& context) noexcept
+        // Publishes the terminal model when a frame is due (or unconditionally with `flush`). The
+        // output worker calls this on every poll iteration, so a coalesced change lands within one
+        // frame interval even when the client goes quiet.
+        void publish_snapshot_best_effort(WindowedTerminalContext& context, const bool flush) noexcept
         {
-            if (!context.published_screen || !context.screen_buffer)
+            if (!context.snapshot_publisher || !context.screen_buffer)
             {
                 return;
             }
 
-            const auto snapshot = condrv::make_viewport_snapshot(*context.screen_buffer);
-            if (!snapshot)
+            if (flush)
             {
-                return;
+                (void)context.snapshot_publisher->flush(context.screen_buffer);
             }
-
-            context.published_screen->publish(snapshot.value());
-            if (context.window != nullptr)
+            else
             {
-                (void)::PostMessageW(context.window, WM_APP + 1, 0, 0);
+                (void)context.snapshot_publisher->update(context.screen_buffer);
             }
         }
 
@@ -63,7 +64,7 @@ namespace oc::runtime
         {
             auto* context = static_cast<WindowedTerminalContext*>(param);
             if (context == nullptr || context->logger == nullptr || !context->terminal_output_read.valid() || !context->screen_buffer ||
-                !context->published_screen)
+                !context->snapshot_publisher)
             {
                 return 0;
             }
@@ -71,8 +72,6 @@ namespace oc::runtime
             bool canceled = false;
             try
             {
-                core::Utf8StreamDecoder decoder;
-
                 bool client_exited = false;
                 bool draining_after_exit = false;
                 ULONGLONG drain_start_tick = 0;
@@ -173,18 +172,13 @@ namespace oc::runtime
                         if (read != 0)
                         {
                             had_output = true;
-                            const auto chunk = std::span<const std::byte>(buffer.data(), static_cast<size_t>(read));
-                            std::wstring decoded = decoder.decode_append(chunk);
-                            if (!decoded.empty())
-                            {
-                                condrv::apply_text_to_screen_buffer<condrv::NullHostIo>(
-                                    *context->screen_buffer,
-                                    decoded,
-                                    k_terminal_output_mode,
-                                    nullptr,
-                                    nullptr);
-                                publish_snapshot_best_effort(*context);
-                            }
+                            const auto bytes = std::string_view(reinterpret_cast<const char*>(buffer.data()), static_cast<size_t>(read));
+                            condrv::apply_utf8_to_screen_buffer<condrv::NullHostIo>(
+                                *context->screen_buffer,
+                                bytes,
+                                k_terminal_output_mode,
+                                nullptr,
+                                nullptr);
                         }
 
                         if (had_output)
@@ -193,6 +187,8 @@ namespace oc::runtime
                         }
                     }
 
+                    publish_snapshot_best_effort(*context, false);
+
                     if (client_exited)
                     {
                         if (!had_output)
@@ -215,6 +211,8 @@ namespace oc::runtime
                     }
                 }
 
+                publish_snapshot_best_effort(*context, true);
+
                 DWORD exit_code = 0;
                 if (context->client_process.valid())
                 {
@@ -251,7 +249,7 @@ namespace oc::runtime
                             k_terminal_output_mode,
                             nullptr,
                             nullptr);
-                        publish_snapshot_best_effort(*context);
+                        publish_snapshot_best_effort(*context, true);
                     }
                     else if (context->window != nullptr)
                     {
@@ -371,13 +369,14 @@ namespace oc::runtime
             context.stop_event = stop_event->view();
             context.logger = &logger;
             context.window = (*window)->hwnd();
-            context.published_screen = published_screen;
             context.screen_buffer = screen_buffer;
             context.terminal_output_read = std::move(payload.terminal_output);
             context.client_process = std::move(payload.client_process);
             context.hold_window_on_exit = hold_window_on_exit;
 
-            publish_snapshot_best_effort(context);
+            // The handoff runner receives no configuration, so frames use the default budget.
+            context.snapshot_publisher.emplace(published_screen, context.window, condrv::ServerRunOptions{}.snapshot_max_fps);
+            publish_snapshot_best_effort(context, true);
 
             logger.log(logging::LogLevel::info, L"Terminal-handoff output worker starting");
             core::UniqueHandle output_thread(::CreateThread(
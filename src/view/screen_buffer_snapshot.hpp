@@ -17,6 +17,7 @@
 
 #include <array>
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <vector>
@@ -48,6 +49,20 @@ namespace oc::view
         // `text.size() == attributes.size() == viewport_size.X * viewport_size.Y`.
         std::vector<wchar_t> text;
         std::vector<USHORT> attributes;
+
+        // Cells whose glyph is more than the one code unit `text` holds for it (surrogate pairs,
+        // combining sequences, emoji ZWJ sequences), sorted by `cell` (an index into `text`). Only
+        // the leading half of a double-width glyph is listed. The glyph's full text is
+        // `cluster_text[offset, offset + length)`.
+        struct Cluster final
+        {
+            size_t cell{};
+            size_t offset{};
+            size_t length{};
+        };
+
+        std::vector<Cluster> clusters;
+        std::vector<wchar_t> cluster_text;
     };
 
     class PublishedScreenBuffer final
@@ -2,6 +2,8 @@
 
 #include <cstddef>
 #include <cstring>
+#include <optional>
+#include <utility>
 #include <vector>
 
 namespace
@@ -256,6 +258,86 @@ namespace
                round_trip.input == info.input &&
                round_trip.output == info.output;
     }
+
+    bool test_moved_message_rebases_completion_write()
+    {
+        FakeComm comm{};
+
+        // Completion data stored inside the message must follow the message when it is moved into
+        // a staging slot (the server keeps the last reply alive until the next READ_IO submits it).
+        std::optional<oc::condrv::BasicApiMessage<FakeComm>> staged;
+        {
+            oc::condrv::BasicApiMessage<FakeComm> message(comm, make_packet(0, 0));
+            oc::condrv::ConnectionInformation info{};
+            info.process = 0x4444;
+            message.set_completion_write_data(info);
+            staged.emplace(std::move(message));
+        }
+
+        oc::condrv::ConnectionInformation staged_info{};
+        std::memcpy(&staged_info, staged->completion().write.data, sizeof(staged_info));
+        if (staged_info.process != 0x4444)
+        {
+            return false;
+        }
+
+        // USER_DEFINED replies point the completion at the API descriptor inside the packet.
+        auto packet = make_packet(0, 0);
+        packet.payload.user_defined.u.console_msg_l1.GetConsoleMode.Mode = 0x1234;
+        oc::condrv::BasicApiMessage<FakeComm> source(comm, packet);
+        source.completion().write.data = &source.packet().payload.user_defined.u;
+        source.completion().write.size = sizeof(CONSOLE_MODE_MSG);
+
+        oc::condrv::BasicApiMessage<FakeComm> moved(std::move(source));
+        if (moved.completion().write.data != &moved.packet().payload.user_defined.u)
+        {
+            return false;
+        }
+
+        CONSOLE_MODE_MSG body{};
+        std::memcpy(&body, moved.completion().write.data, sizeof(body));
+        return body.Mode == 0x1234;
+    }
+
+    bool test_pooled_buffers_return_on_release()
+    {
+        FakeComm comm{};
+        oc::condrv::MessageBufferPool pool;
+
+        {
+            oc::condrv::BasicApiMessage<FakeComm> message(comm, make_packet(16, 8), &pool);
+            if (!message.get_input_buffer() || !message.get_output_buffer())
+            {
+                return false;
+            }
+
+            message.set_reply_status(static_cast<NTSTATUS>(0));
+            message.set_reply_information(0);
+            if (!message.release_message_buffers())
+            {
+                return false;
+            }
+        }
+
+        oc::condrv::BasicApiMessage<FakeComm> again(comm, make_packet(16, 8), &pool);
+        auto output = again.get_output_buffer();
+        if (!output)
+        {
+            return false;
+        }
+
+        // Recycled output storage must still be handed out zero-filled.
+        for (const auto value : *output)
+        {
+            if (value != std::byte{})
+            {
+                return false;
+            }
+        }
+
+        const auto& stats = pool.statistics();
+        return stats.heap_allocations == 2 && stats.pool_hits == 1;
+    }
 }
 
 bool run_condrv_api_message_tests()
@@ -265,5 +347,7 @@ bool run_condrv_api_message_tests()
            test_release_skips_write_on_failure_status() &&
            test_invalid_offsets_fail() &&
            test_complete_io_forwards_completion() &&
-           test_completion_write_data_copies_payload();
+           test_completion_write_data_copies_payload() &&
+           test_moved_message_rebases_completion_write() &&
+           test_pooled_buffers_return_on_release();
 }
@@ -0,0 +1,489 @@
+#include "condrv/condrv_api_metrics.hpp"
+#include "condrv/condrv_server.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    struct MemoryComm final
+    {
+        std::vector<std::byte> input;
+        std::vector<std::byte> output;
+        size_t bytes_written{};
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_input(oc::condrv::IoOperation& operation) noexcept
+        {
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset + size > input.size())
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"read_input out of range",
+                    .win32_error = ERROR_INVALID_DATA,
+                });
+            }
+
+            if (size != 0)
+            {
+                std::memcpy(operation.buffer.data, input.data() + offset, size);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write_output(oc::condrv::IoOperation& operation) noexcept
+        {
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset + size > output.size())
+            {
+                output.resize(offset + size);
+            }
+
+            if (size != 0)
+            {
+                std::memcpy(output.data() + offset, operation.buffer.data, size);
+            }
+            bytes_written += size;
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> complete_io(const oc::condrv::IoComplete& /*completion*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    // Endless input source: every read returns the same byte so ReadConsole/GetConsoleInput
+    // always complete immediately without growing any container.
+    struct RepeatingHostIo final
+    {
+        std::byte value{ static_cast<std::byte>('a') };
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> write_output_bytes(const std::span<const std::byte> bytes) noexcept
+        {
+            return bytes.size();
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> read_input_bytes(const std::span<std::byte> dest) noexcept
+        {
+            std::fill(dest.begin(), dest.end(), value);
+            return dest.size();
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> peek_input_bytes(const std::span<std::byte> dest) noexcept
+        {
+            std::fill(dest.begin(), dest.end(), value);
+            return dest.size();
+        }
+
+        [[nodiscard]] size_t input_bytes_available() const noexcept
+        {
+            return 4096;
+        }
+
+        [[nodiscard]] bool inject_input_bytes(const std::span<const std::byte> /*bytes*/) noexcept
+        {
+            return true;
+        }
+
+        [[nodiscard]] bool vt_should_answer_queries() const noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> flush_input_buffer() noexcept
+        {
+            return {};
+        }
+
+        [[nodiscard]] std::expected<bool, oc::condrv::DeviceCommError> wait_for_input(const DWORD /*timeout_ms*/) noexcept
+        {
+            return true;
+        }
+
+        [[nodiscard]] bool input_disconnected() const noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> send_end_task(
+            const DWORD /*process_id*/,
+            const DWORD /*event_type*/,
+            const DWORD /*ctrl_flags*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    // Host that never has input, so input-dependent requests go reply-pending.
+    struct EmptyHostIo final
+    {
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> write_output_bytes(const std::span<const std::byte> bytes) noexcept
+        {
+            return bytes.size();
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> read_input_bytes(const std::span<std::byte> /*dest*/) noexcept
+        {
+            return size_t{ 0 };
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> peek_input_bytes(const std::span<std::byte> /*dest*/) noexcept
+        {
+            return size_t{ 0 };
+        }
+
+        [[nodiscard]] size_t input_bytes_available() const noexcept
+        {
+            return 0;
+        }
+
+        [[nodiscard]] bool inject_input_bytes(const std::span<const std::byte> /*bytes*/) noexcept
+        {
+            return true;
+        }
+
+        [[nodiscard]] bool vt_should_answer_queries() const noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> flush_input_buffer() noexcept
+        {
+            return {};
+        }
+
+        [[nodiscard]] std::expected<bool, oc::condrv::DeviceCommError> wait_for_input(const DWORD /*timeout_ms*/) noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] bool input_disconnected() const noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> send_end_task(
+            const DWORD /*process_id*/,
+            const DWORD /*event_type*/,
+            const DWORD /*ctrl_flags*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    [[nodiscard]] oc::condrv::IoPacket make_connect_packet(const DWORD pid, const DWORD tid) noexcept
+    {
+        oc::condrv::IoPacket packet{};
+        packet.descriptor.identifier.LowPart = 1;
+        packet.descriptor.function = oc::condrv::console_io_connect;
+        packet.descriptor.process = pid;
+        packet.descriptor.object = tid;
+        return packet;
+    }
+
+    template<typename HostIo>
+    [[nodiscard]] bool connect(
+        MemoryComm& comm,
+        oc::condrv::ServerState& state,
+        HostIo& host_io,
+        oc::condrv::ConnectionInformation& info) noexcept
+    {
+        oc::condrv::BasicApiMessage<MemoryComm> message(comm, make_connect_packet(4242, 4243));
+        auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+        if (!outcome || message.completion().io_status.Status != oc::core::status_success)
+        {
+            return false;
+        }
+
+        std::memcpy(&info, message.completion().write.data, sizeof(info));
+        return true;
+    }
+
+    [[nodiscard]] oc::condrv::IoPacket make_write_console_packet(
+        const oc::condrv::ConnectionInformation& info,
+        const ULONG payload_size) noexcept
+    {
+        constexpr ULONG api_size = sizeof(CONSOLE_WRITECONSOLE_MSG);
+        constexpr ULONG read_offset = api_size + sizeof(CONSOLE_MSG_HEADER);
+
+        oc::condrv::IoPacket packet{};
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = 10;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = info.process;
+        packet.descriptor.object = info.output;
+        packet.descriptor.input_size = read_offset + payload_size;
+        packet.descriptor.output_size = api_size;
+        packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepWriteConsole);
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+        packet.payload.user_defined.u.console_msg_l1.WriteConsole.Unicode = FALSE;
+        return packet;
+    }
+
+    [[nodiscard]] oc::condrv::IoPacket make_read_console_packet(
+        const oc::condrv::ConnectionInformation& info,
+        const ULONG buffer_bytes) noexcept
+    {
+        constexpr ULONG api_size = sizeof(CONSOLE_READCONSOLE_MSG);
+        constexpr ULONG read_offset = api_size + sizeof(CONSOLE_MSG_HEADER);
+
+        oc::condrv::IoPacket packet{};
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = 11;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = info.process;
+        packet.descriptor.object = info.input;
+        packet.descriptor.input_size = read_offset;
+        packet.descriptor.output_size = api_size + buffer_bytes;
+        packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepReadConsole);
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+        packet.payload.user_defined.u.console_msg_l1.ReadConsole.Unicode = FALSE;
+        return packet;
+    }
+
+    template<typename HostIo>
+    [[nodiscard]] bool dispatch_and_complete(
+        MemoryComm& comm,
+        oc::condrv::ServerState& state,
+        HostIo& host_io,
+        const oc::condrv::IoPacket& packet) noexcept
+    {
+        oc::condrv::BasicApiMessage<MemoryComm> message(comm, packet);
+        auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+        if (!outcome || outcome->reply_pending || message.completion().io_status.Status != oc::core::status_success)
+        {
+            return false;
+        }
+
+        return message.release_message_buffers().has_value();
+    }
+
+    [[nodiscard]] uint64_t bucket_total(const oc::condrv::ApiMetrics::Counters& counters) noexcept
+    {
+        uint64_t total = 0;
+        for (const auto count : counters.latency_buckets)
+        {
+            total += count;
+        }
+        return total;
+    }
+
+    bool test_latency_buckets_are_log2()
+    {
+        using Metrics = oc::condrv::ApiMetrics;
+        static_assert(Metrics::latency_bucket_for(0) == 0);
+        static_assert(Metrics::latency_bucket_for(1) == 1);
+        static_assert(Metrics::latency_bucket_for(3) == 2);
+        static_assert(Metrics::latency_bucket_for(4) == 3);
+
+        return Metrics::latency_bucket_for(UINT64_MAX) == Metrics::latency_bucket_count - 1 &&
+               Metrics::latency_bucket_limit(0) == 1 &&
+               Metrics::latency_bucket_limit(3) == 8 &&
+               Metrics::latency_bucket_limit(Metrics::latency_bucket_count - 1) == UINT64_MAX;
+    }
+
+    bool test_samples_are_keyed_by_function_and_api()
+    {
+        auto created = oc::condrv::ApiMetrics::create();
+        if (!created)
+        {
+            return false;
+        }
+        auto& metrics = **created;
+
+        const auto write_console = static_cast<ULONG>(ConsolepWriteConsole);
+        metrics.record_completed(oc::condrv::console_io_user_defined, write_console, 5, 100, 0);
+        metrics.record_completed(oc::condrv::console_io_user_defined, write_console, 9, 50, 0);
+        metrics.record_reply_pending(oc::condrv::console_io_user_defined, static_cast<ULONG>(ConsolepReadConsole), 2);
+        metrics.record_completed(oc::condrv::console_io_create_object, 0, 1, 0, 0);
+        metrics.record_completed(oc::condrv::console_io_user_defined, 0x7F00'0001, 1, 0, 0);
+
+        const auto& write = metrics.find(oc::condrv::console_io_user_defined, write_console);
+        const auto& read = metrics.find(oc::condrv::console_io_user_defined, static_cast<ULONG>(ConsolepReadConsole));
+        const auto& unknown = metrics.find(oc::condrv::console_io_user_defined, 0x7F00'0001);
+        if (write.calls != 2 || write.bytes_in != 150 || write.total_ticks != 14 || write.max_ticks != 9 ||
+            write.latency_buckets[3] != 1 || write.latency_buckets[4] != 1 ||
+            read.calls != 0 || read.reply_pending != 1 ||
+            unknown.calls != 1 ||
+            metrics.find(oc::condrv::console_io_create_object, 0).calls != 1)
+        {
+            return false;
+        }
+
+        size_t visited = 0;
+        bool saw_unknown = false;
+        metrics.for_each([&](const ULONG /*function*/, const ULONG api_number, const oc::condrv::ApiMetrics::Counters&) {
+            ++visited;
+            saw_unknown = saw_unknown || api_number == oc::condrv::ApiMetrics::unknown_api_number;
+        });
+
+        metrics.reset();
+        size_t visited_after_reset = 0;
+        metrics.for_each([&](ULONG, ULONG, const oc::condrv::ApiMetrics::Counters&) { ++visited_after_reset; });
+
+        return visited == 4 && saw_unknown && visited_after_reset == 0;
+    }
+
+    bool test_dispatch_records_calls_bytes_and_reply_pending()
+    {
+        auto created = oc::condrv::ApiMetrics::create();
+        if (!created)
+        {
+            return false;
+        }
+        auto& metrics = **created;
+
+        MemoryComm comm{};
+        oc::condrv::ServerState state{};
+        state.set_api_metrics(&metrics);
+        RepeatingHostIo host_io{};
+
+        oc::condrv::ConnectionInformation info{};
+        if (!connect(comm, state, host_io, info))
+        {
+            return false;
+        }
+        state.set_input_mode(0); // raw ReadConsole: complete with whatever bytes are available
+
+        constexpr std::string_view line = "metrics line\r\n";
+        const auto write_packet = make_write_console_packet(info, static_cast<ULONG>(line.size()));
+        comm.input.assign(write_packet.descriptor.input_size, std::byte{});
+        std::memcpy(
+            comm.input.data() + sizeof(CONSOLE_WRITECONSOLE_MSG) + sizeof(CONSOLE_MSG_HEADER),
+            line.data(),
+            line.size());
+
+        for (int i = 0; i < 3; ++i)
+        {
+            if (!dispatch_and_complete(comm, state, host_io, write_packet))
+            {
+                return false;
+            }
+        }
+
+        comm.bytes_written = 0;
+        if (!dispatch_and_complete(comm, state, host_io, make_read_console_packet(info, 16)))
+        {
+            return false;
+        }
+
+        // The same read parks when the host has no input.
+        EmptyHostIo empty_host{};
+        oc::condrv::BasicApiMessage<MemoryComm> pending(comm, make_read_console_packet(info, 16));
+        auto outcome = oc::condrv::dispatch_message(state, pending, empty_host);
+        if (!outcome || !outcome->reply_pending)
+        {
+            return false;
+        }
+
+        const auto& connect_counters = metrics.find(oc::condrv::console_io_connect, 0);
+        const auto& write = metrics.find(oc::condrv::console_io_user_defined, static_cast<ULONG>(ConsolepWriteConsole));
+        const auto& read = metrics.find(oc::condrv::console_io_user_defined, static_cast<ULONG>(ConsolepReadConsole));
+        return connect_counters.calls == 1 &&
+               write.calls == 3 &&
+               write.reply_pending == 0 &&
+               write.bytes_in == 3 * line.size() &&
+               bucket_total(write) == 3 &&
+               read.calls == 1 &&
+               read.reply_pending == 1 &&
+               read.bytes_out == comm.bytes_written &&
+               read.bytes_out != 0 &&
+               bucket_total(read) == 2;
+    }
+
+    bool test_detached_state_is_not_instrumented()
+    {
+        auto created = oc::condrv::ApiMetrics::create();
+        if (!created)
+        {
+            return false;
+        }
+
+        MemoryComm comm{};
+        oc::condrv::ServerState state{};
+        RepeatingHostIo host_io{};
+        oc::condrv::ConnectionInformation info{};
+        if (!connect(comm, state, host_io, info))
+        {
+            return false;
+        }
+
+        state.set_api_metrics(created->get());
+        state.set_api_metrics(nullptr);
+        if (!connect(comm, state, host_io, info))
+        {
+            return false;
+        }
+
+        size_t visited = 0;
+        (*created)->for_each([&](ULONG, ULONG, const oc::condrv::ApiMetrics::Counters&) { ++visited; });
+        return visited == 0;
+    }
+
+    bool test_json_dump_has_one_line_per_api()
+    {
+        auto created = oc::condrv::ApiMetrics::create();
+        if (!created)
+        {
+            return false;
+        }
+        auto& metrics = **created;
+
+        metrics.record_completed(oc::condrv::console_io_user_defined, static_cast<ULONG>(ConsolepWriteConsole), 10, 64, 0);
+        metrics.record_completed(oc::condrv::console_io_user_defined, static_cast<ULONG>(ConsolepWriteConsole), 30, 64, 0);
+        metrics.record_completed(oc::condrv::console_io_connect, 0, 1'000, 0, 0);
+
+        std::wstring text;
+        if (!oc::condrv::format_api_metrics_json(metrics, 1'000'000'000, text))
+        {
+            return false;
+        }
+
+        // 1 tick == 1 ns; samples land in buckets [8,16) and [16,32) for WriteConsole.
+        const std::wstring_view expected_write =
+            L"{\"api\":\"WriteConsole\",\"function\":7,\"api_number\":16777222,\"calls\":2,\"reply_pending\":0,"
+            L"\"bytes_in\":128,\"bytes_out\":0,\"mean_ns\":20.0,\"max_ns\":30.0,\"p50_ns\":16.0,\"p90_ns\":32.0,"
+            L"\"p99_ns\":32.0,\"buckets\":[[16.0,1],[32.0,1]]}\n";
+
+        return std::count(text.begin(), text.end(), L'\n') == 2 &&
+               text.starts_with(L"{\"api\":\"connect\",") &&
+               text.ends_with(expected_write);
+    }
+}
+
+bool run_condrv_api_metrics_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_latency_buckets_are_log2", test_latency_buckets_are_log2 },
+        { L"test_samples_are_keyed_by_function_and_api", test_samples_are_keyed_by_function_and_api },
+        { L"test_dispatch_records_calls_bytes_and_reply_pending", test_dispatch_records_calls_bytes_and_reply_pending },
+        { L"test_detached_state_is_not_instrumented", test_detached_state_is_not_instrumented },
+        { L"test_json_dump_has_one_line_per_api", test_json_dump_has_one_line_per_api },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv api metrics] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
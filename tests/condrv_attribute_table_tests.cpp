@@ -0,0 +1,208 @@
+#include "condrv/attribute_table.hpp"
+
+#include <Windows.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+// Tests for attribute interning: classic words are their own IDs, extended attributes get stable
+// IDs whose classic view is the recorded nearest word, and the palette cache answers exactly like
+// a full scan of the current palette.
+
+namespace
+{
+    using oc::condrv::AttributeTable;
+    using oc::condrv::TextAttribute;
+
+    constexpr std::array<COLORREF, 16> k_palette{
+        0x0C0C0C, 0xDA3700, 0x0EA113, 0xDD963A, 0x1F0FC5, 0x981788, 0x009CC1, 0xCCCCCC,
+        0x767676, 0xFF783B, 0x0CC616, 0xD6D661, 0x5648E7, 0x9E00B4, 0xA5F1F9, 0xF2F2F2,
+    };
+
+    [[nodiscard]] TextAttribute rgb_foreground(const COLORREF color, const USHORT legacy) noexcept
+    {
+        return TextAttribute{ .legacy = legacy, .flags = TextAttribute::foreground_rgb, .foreground = color };
+    }
+
+    [[nodiscard]] uint8_t scan_nearest(const COLORREF color, const std::array<COLORREF, 16>& palette) noexcept
+    {
+        uint8_t best = 0;
+        uint32_t best_distance = std::numeric_limits<uint32_t>::max();
+        for (size_t i = 0; i < palette.size(); ++i)
+        {
+            const int dr = static_cast<int>(palette[i] & 0xFF) - static_cast<int>(color & 0xFF);
+            const int dg = static_cast<int>((palette[i] >> 8) & 0xFF) - static_cast<int>((color >> 8) & 0xFF);
+            const int db = static_cast<int>((palette[i] >> 16) & 0xFF) - static_cast<int>((color >> 16) & 0xFF);
+            const auto distance = static_cast<uint32_t>(dr * dr + dg * dg + db * db);
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best = static_cast<uint8_t>(i);
+            }
+        }
+        return best;
+    }
+
+    bool test_legacy_words_are_their_own_ids()
+    {
+        AttributeTable table;
+        const USHORT word = 0x1E | COMMON_LVB_UNDERSCORE;
+        return table.intern(TextAttribute{ .legacy = word }) == word && table.size() == 0 && table.legacy(word) == word &&
+               table.lookup(word) == TextAttribute{ .legacy = word } &&
+               oc::condrv::attribute_id_from_legacy(static_cast<USHORT>(word | oc::condrv::extended_attribute_bit)) == word;
+    }
+
+    bool test_extended_attributes_intern_once()
+    {
+        AttributeTable table;
+        const auto red = rgb_foreground(0x0000FF, 0x0C);
+        const USHORT first = table.intern(red);
+        const USHORT again = table.intern(red);
+        const USHORT italic = table.intern(TextAttribute{ .legacy = 0x0C, .flags = TextAttribute::italic });
+        if (first != again || first == italic || (first & oc::condrv::extended_attribute_bit) == 0 || table.size() != 2)
+        {
+            return false;
+        }
+
+        // A color the flags do not select does not make a new entry.
+        auto stale = TextAttribute{ .legacy = 0x0C, .flags = TextAttribute::italic };
+        stale.background = 0x123456;
+        if (table.intern(stale) != italic || table.size() != 2)
+        {
+            return false;
+        }
+
+        return table.lookup(first) == red && table.legacy(first) == 0x0C && table.legacy(italic) == 0x0C;
+    }
+
+    bool test_full_table_falls_back_to_legacy()
+    {
+        AttributeTable table;
+        std::vector<bool> seen(0x10000);
+        for (size_t i = 0; i < AttributeTable::max_entries; ++i)
+        {
+            // Every entry gets its own ID, and no ID uses the cell-half flags.
+            const USHORT id = table.intern(rgb_foreground(static_cast<COLORREF>(i), static_cast<USHORT>(i & 0xFF)));
+            if ((id & oc::condrv::extended_attribute_bit) == 0 || (id & oc::condrv::cell_width_bits) != 0 || seen[id] ||
+                table.legacy(id) != (i & 0xFF))
+            {
+                return false;
+            }
+            seen[id] = true;
+        }
+
+        // Existing entries still resolve; new ones degrade to their classic word.
+        return table.intern(rgb_foreground(0, 0x00)) == oc::condrv::extended_attribute_bit &&
+               table.intern(rgb_foreground(0xFFFFFF, 0x4F)) == 0x4F && table.size() == AttributeTable::max_entries;
+    }
+
+    bool test_sweep_frees_unmarked_entries_for_reuse()
+    {
+        AttributeTable table;
+        const USHORT kept = table.intern(rgb_foreground(0x010203, 0x07));
+        const USHORT dropped = table.intern(rgb_foreground(0x040506, 0x07));
+
+        // Half flags and classic words do not get in the way of marking.
+        table.begin_collection();
+        table.mark(static_cast<USHORT>(kept | COMMON_LVB_LEADING_BYTE));
+        table.mark(0x1F);
+        if (table.sweep() != 1 || table.size() != 1 || table.collections() != 1 || table.lookup(kept) != rgb_foreground(0x010203, 0x07))
+        {
+            return false;
+        }
+
+        // The freed ID is handed out again; the kept entry is still found by value.
+        return table.intern(rgb_foreground(0x070809, 0x07)) == dropped && table.intern(rgb_foreground(0x010203, 0x07)) == kept &&
+               table.size() == 2;
+    }
+
+    bool test_cell_width_bits_survive_legacy_view()
+    {
+        AttributeTable table;
+        const USHORT id = table.intern(rgb_foreground(0x00FF00, 0x0A));
+        const USHORT leading = static_cast<USHORT>(id | COMMON_LVB_LEADING_BYTE);
+        const USHORT trailing = static_cast<USHORT>(id | COMMON_LVB_TRAILING_BYTE);
+        return table.legacy(leading) == (0x0A | COMMON_LVB_LEADING_BYTE) &&
+               table.legacy(trailing) == (0x0A | COMMON_LVB_TRAILING_BYTE) && table.lookup(leading) == table.lookup(id) &&
+               table.legacy(0x1E | COMMON_LVB_TRAILING_BYTE) == (0x1E | COMMON_LVB_TRAILING_BYTE);
+    }
+
+    bool test_to_legacy_maps_words_and_records()
+    {
+        AttributeTable table;
+        const USHORT id = table.intern(rgb_foreground(0x00FF00, 0x0A | COMMON_LVB_REVERSE_VIDEO));
+
+        std::array<USHORT, 3> words{ 0x07, id, 0x1F };
+        table.to_legacy(words.data(), words.size());
+        if (words != std::array<USHORT, 3>{ 0x07, static_cast<USHORT>(0x0A | COMMON_LVB_REVERSE_VIDEO), 0x1F })
+        {
+            return false;
+        }
+
+        CHAR_INFO records[2]{};
+        records[0].Attributes = id;
+        records[1].Attributes = 0x70;
+        table.to_legacy(records, 2);
+        return records[0].Attributes == (0x0A | COMMON_LVB_REVERSE_VIDEO) && records[1].Attributes == 0x70;
+    }
+
+    bool test_palette_cache_matches_scan()
+    {
+        AttributeTable table;
+        std::uint64_t state = 0x5041'4C45'5454'45ULL;
+        for (size_t i = 0; i < 4'000; ++i)
+        {
+            // A small color set so most lookups hit the cache, some collide in it.
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            const auto color = static_cast<COLORREF>((state >> 40) % 200 * 0x010305);
+            if (table.nearest_palette_index(color, k_palette) != scan_nearest(color, k_palette))
+            {
+                return false;
+            }
+        }
+
+        // After a palette change the cache must not answer from the old palette.
+        auto inverted = k_palette;
+        for (auto& entry : inverted)
+        {
+            entry = ~entry & 0xFFFFFF;
+        }
+        table.palette_changed();
+        return table.nearest_palette_index(0x0000FF, inverted) == scan_nearest(0x0000FF, inverted) &&
+               table.nearest_palette_index(0x000000, inverted) == scan_nearest(0x000000, inverted);
+    }
+}
+
+bool run_condrv_attribute_table_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_legacy_words_are_their_own_ids", test_legacy_words_are_their_own_ids },
+        { L"test_extended_attributes_intern_once", test_extended_attributes_intern_once },
+        { L"test_full_table_falls_back_to_legacy", test_full_table_falls_back_to_legacy },
+        { L"test_sweep_frees_unmarked_entries_for_reuse", test_sweep_frees_unmarked_entries_for_reuse },
+        { L"test_cell_width_bits_survive_legacy_view", test_cell_width_bits_survive_legacy_view },
+        { L"test_to_legacy_maps_words_and_records", test_to_legacy_maps_words_and_records },
+        { L"test_palette_cache_matches_scan", test_palette_cache_matches_scan },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv attribute table] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,166 @@
+#include "condrv/cluster_table.hpp"
+
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Tests for the cluster side table: equal text shares one cluster character, classic reads see
+// the original units, and a collection frees exactly the unmarked entries while the survivors keep
+// their characters and text.
+
+namespace
+{
+    using oc::condrv::ClusterTable;
+    using oc::condrv::ScreenCell;
+
+    // Distinct two-unit clusters: a letter and a combining mark.
+    [[nodiscard]] std::wstring combined(const size_t index)
+    {
+        return std::wstring{ static_cast<wchar_t>(L'A' + index / 0x70), static_cast<wchar_t>(0x0300 + index % 0x70) };
+    }
+
+    bool test_equal_text_shares_one_character()
+    {
+        ClusterTable table;
+        const auto family = table.intern(L"\xD83D\xDC68\x200D\xD83D\xDC67");
+        const auto accent = table.intern(L"e\x0301");
+        const auto again = table.intern(L"\xD83D\xDC68\x200D\xD83D\xDC67");
+        return family && accent && again && *family == *again && *family != *accent && oc::condrv::is_cluster_character(*family) &&
+               table.size() == 2 && table.text(*family) == L"\xD83D\xDC68\x200D\xD83D\xDC67" && table.text(*accent) == L"e\x0301" &&
+               table.text(L'e').empty() && !table.intern(std::wstring_view{});
+    }
+
+    bool test_classic_unit_reports_original_units()
+    {
+        ClusterTable table;
+        const auto pair = table.intern(L"\xD83D\xDE00");
+        const auto accent = table.intern(L"e\x0301");
+        if (!pair || !accent)
+        {
+            return false;
+        }
+
+        // The trailing half of a pair reads its low surrogate; other cells read the first unit.
+        const ScreenCell cells[] = {
+            { .character = *pair, .attributes = COMMON_LVB_LEADING_BYTE },
+            { .character = *pair, .attributes = COMMON_LVB_TRAILING_BYTE },
+            { .character = *accent, .attributes = COMMON_LVB_TRAILING_BYTE },
+            { .character = L'x', .attributes = 0 },
+            { .character = static_cast<wchar_t>(0xDFFF), .attributes = 0 },
+        };
+        wchar_t characters[] = { *pair, *pair, *accent, L'x', static_cast<wchar_t>(0xDFFF) };
+        table.to_classic(characters, cells, 5);
+        return characters[0] == 0xD83D && characters[1] == 0xDE00 && characters[2] == L'e' && characters[3] == L'x' &&
+               characters[4] == 0xFFFD;
+    }
+
+    bool test_long_text_is_truncated()
+    {
+        ClusterTable table;
+        const std::wstring stacked = L"a" + std::wstring(ClusterTable::max_length * 2, static_cast<wchar_t>(0x0301));
+        const auto first = table.intern(stacked);
+        const auto prefix = table.intern(std::wstring_view(stacked).substr(0, ClusterTable::max_length));
+        return first && prefix && *first == *prefix && table.text(*first).size() == ClusterTable::max_length;
+    }
+
+    bool test_full_table_refuses_new_text()
+    {
+        ClusterTable table;
+        for (size_t i = 0; i < ClusterTable::max_entries; ++i)
+        {
+            if (!table.intern(combined(i)))
+            {
+                return false;
+            }
+        }
+
+        // Existing text still resolves; new text does not.
+        return table.full() && table.intern(combined(7)) && !table.intern(L"\xD83D\xDE00");
+    }
+
+    bool test_sweep_frees_unmarked_entries_and_compacts()
+    {
+        ClusterTable table;
+        std::vector<wchar_t> characters;
+        for (size_t i = 0; i < ClusterTable::max_entries; ++i)
+        {
+            const auto character = table.intern(combined(i));
+            if (!character)
+            {
+                return false;
+            }
+            characters.push_back(*character);
+        }
+
+        // Keep every third entry: one through a cell span, the rest one by one.
+        table.begin_collection();
+        std::vector<ScreenCell> cells;
+        for (size_t i = 0; i < characters.size(); i += 3)
+        {
+            if (i % 2 == 0)
+            {
+                cells.push_back(ScreenCell{ .character = characters[i], .attributes = 0 });
+                cells.push_back(ScreenCell{ .character = L' ', .attributes = 0 });
+            }
+            else
+            {
+                table.mark(characters[i]);
+            }
+        }
+        table.mark(cells.data(), cells.size());
+        table.mark(L'q');
+
+        const size_t kept = (characters.size() + 2) / 3;
+        const size_t pool_before = table.storage_bytes();
+        if (table.sweep() != characters.size() - kept || table.size() != kept || table.collections() != 1)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < characters.size(); ++i)
+        {
+            if ((i % 3 == 0) != (table.text(characters[i]) == combined(i)))
+            {
+                return false;
+            }
+        }
+
+        // Freed characters are reused, and text that survived still dedupes to its old character.
+        const auto reused = table.intern(L"\xD83D\xDE00");
+        const auto survivor = table.intern(combined(3));
+        return reused && table.text(*reused) == L"\xD83D\xDE00" && survivor && *survivor == characters[3] &&
+               table.storage_bytes() <= pool_before && table.size() == kept + 1;
+    }
+}
+
+bool run_condrv_cluster_table_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_equal_text_shares_one_character", test_equal_text_shares_one_character },
+        { L"test_classic_unit_reports_original_units", test_classic_unit_reports_original_units },
+        { L"test_long_text_is_truncated", test_long_text_is_truncated },
+        { L"test_full_table_refuses_new_text", test_full_table_refuses_new_text },
+        { L"test_sweep_frees_unmarked_entries_and_compacts", test_sweep_frees_unmarked_entries_and_compacts },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv cluster table] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
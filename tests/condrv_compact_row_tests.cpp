@@ -0,0 +1,175 @@
+#include "condrv/compact_row.hpp"
+
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Round-trip tests for the compact row encoding. Random rows are encoded and every decode path is
+// compared with the original cells. Rows with a character above U+00FF or more than
+// `CompactRow::max_runs` attribute runs must be rejected.
+
+namespace
+{
+    using oc::condrv::CompactRow;
+    using oc::condrv::ScreenCell;
+
+    constexpr std::uint64_t k_base_seed = 0x434F4D5041435452ULL;
+    constexpr size_t k_iterations = 4'000;
+    constexpr size_t k_max_length = 200;
+
+    class SplitMix64 final
+    {
+    public:
+        explicit SplitMix64(const std::uint64_t seed) noexcept :
+            _state(seed)
+        {
+        }
+
+        [[nodiscard]] std::uint64_t next_u64() noexcept
+        {
+            std::uint64_t z = (_state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        [[nodiscard]] size_t next_size(const size_t max_inclusive) noexcept
+        {
+            return static_cast<size_t>(next_u64() % (static_cast<std::uint64_t>(max_inclusive) + 1ULL));
+        }
+
+    private:
+        std::uint64_t _state{};
+    };
+
+    struct RandomRow final
+    {
+        std::vector<ScreenCell> cells;
+        bool encodable{};
+    };
+
+    // Mostly Latin-1 text in a handful of attribute runs; occasionally a wide character or too many runs.
+    [[nodiscard]] RandomRow random_row(SplitMix64& rng)
+    {
+        RandomRow row{};
+        row.cells.resize(1 + rng.next_size(k_max_length - 1));
+        const size_t run_limit = 1 + rng.next_size(CompactRow::max_runs + 2);
+        const bool wide = rng.next_size(9) == 0;
+
+        size_t runs = 0;
+        USHORT attributes = 0;
+        for (size_t i = 0; i < row.cells.size(); ++i)
+        {
+            if (i == 0 || (runs < run_limit && rng.next_size(15) == 0))
+            {
+                attributes = static_cast<USHORT>(attributes + 1 + rng.next_size(0xFFFE));
+                ++runs;
+            }
+            row.cells[i] = ScreenCell{ .character = static_cast<wchar_t>(rng.next_size(0xFF)), .attributes = attributes };
+        }
+
+        if (wide)
+        {
+            row.cells[rng.next_size(row.cells.size() - 1)].character = static_cast<wchar_t>(0x100 + rng.next_size(0xFEFF));
+        }
+
+        row.encodable = !wide && runs <= CompactRow::max_runs;
+        return row;
+    }
+
+    [[nodiscard]] bool report(const wchar_t* const check, const size_t iteration)
+    {
+        fwprintf(stderr, L"[DETAIL] %ls (iteration=%zu)\n", check, iteration);
+        return false;
+    }
+
+    bool test_encode_round_trips()
+    {
+        SplitMix64 rng(k_base_seed);
+        CompactRow compact;
+        for (size_t iteration = 0; iteration < k_iterations; ++iteration)
+        {
+            const auto row = random_row(rng);
+            const size_t length = row.cells.size();
+            if (compact.encode(row.cells.data(), length) != row.encodable)
+            {
+                return report(L"encode accepted the wrong rows", iteration);
+            }
+            if (!row.encodable)
+            {
+                if (compact.length() != 0)
+                {
+                    return report(L"a rejected row left an encoding", iteration);
+                }
+                continue;
+            }
+
+            if (compact.length() != length || (length >= 32 && compact.storage_bytes() >= length * sizeof(ScreenCell)))
+            {
+                return report(L"encoding is not smaller than the cells", iteration);
+            }
+
+            // One sentinel past the decoded range catches overruns.
+            const size_t column = rng.next_size(length - 1);
+            const size_t count = rng.next_size(length - column);
+            std::vector<ScreenCell> decoded(count + 1, ScreenCell{ .character = L'#', .attributes = 0xBEEF });
+            compact.decode(column, count, decoded.data());
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (decoded[i] != row.cells[column + i] || compact.cell(column + i) != row.cells[column + i])
+                {
+                    return report(L"decode diverged from the original cells", iteration);
+                }
+            }
+            if (decoded[count] != ScreenCell{ .character = L'#', .attributes = 0xBEEF })
+            {
+                return report(L"decode overran its range", iteration);
+            }
+        }
+
+        return true;
+    }
+
+    bool test_storage_is_reused()
+    {
+        std::vector<ScreenCell> cells(120, ScreenCell{ .character = L'a', .attributes = 0x07 });
+        CompactRow compact;
+        if (!compact.encode(cells.data(), cells.size()))
+        {
+            return false;
+        }
+
+        // Shorter rows fit in the same storage; an empty encoding is valid too.
+        const size_t bytes = compact.storage_bytes();
+        return compact.encode(cells.data(), 60) && compact.storage_bytes() == bytes && compact.length() == 60 &&
+               compact.encode(cells.data(), 0) && compact.length() == 0 && compact.storage_bytes() == bytes;
+    }
+}
+
+bool run_condrv_compact_row_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_encode_round_trips", test_encode_round_trips },
+        { L"test_storage_is_reused", test_storage_is_reused },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv compact row] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,480 @@
+#include "condrv/host_output_buffer.hpp"
+
+#include "condrv/condrv_server.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <expected>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    // Records each write it is handed, as one pipe write would be.
+    struct RecordingSink final
+    {
+        std::vector<std::string> writes;
+        bool fail{ false };
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write(const std::span<const std::byte> bytes) noexcept
+        {
+            if (fail)
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"RecordingSink write failed",
+                    .win32_error = ERROR_NO_DATA,
+                });
+            }
+
+            writes.emplace_back(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            return {};
+        }
+    };
+
+    using Buffer = oc::condrv::BasicHostOutputBuffer<RecordingSink>;
+
+    [[nodiscard]] std::span<const std::byte> bytes_of(const std::string_view text) noexcept
+    {
+        return std::as_bytes(std::span(text.data(), text.size()));
+    }
+
+    [[nodiscard]] bool write_text(Buffer& buffer, const std::string_view text) noexcept
+    {
+        const auto written = buffer.write(bytes_of(text));
+        return written.has_value() && *written == text.size();
+    }
+
+    struct FakeClock final
+    {
+        uint64_t now{ 1'000 };
+
+        [[nodiscard]] uint64_t now_us() const noexcept
+        {
+            return now;
+        }
+    };
+
+    using Hold = oc::condrv::BasicSerialOutputHold<FakeClock>;
+
+    constexpr uint64_t test_hold_us = 1'000;
+
+    // A ConPTY-style host: output goes to a `RecordingSink` through the buffer, as `HostIo` sends it
+    // to `HostOutputPipe`.
+    struct RecordingHostIo final
+    {
+        oc::condrv::NullHostIo sink;
+        Buffer output;
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> write_output_bytes(const std::span<const std::byte> bytes) noexcept
+        {
+            return output.write(bytes);
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> flush_output() noexcept
+        {
+            return output.flush();
+        }
+
+        [[nodiscard]] size_t pending_output_bytes() const noexcept
+        {
+            return output.pending_bytes();
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> read_input_bytes(const std::span<std::byte> dest) noexcept
+        {
+            return sink.read_input_bytes(dest);
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> peek_input_bytes(const std::span<std::byte> dest) noexcept
+        {
+            return sink.peek_input_bytes(dest);
+        }
+
+        [[nodiscard]] size_t input_bytes_available() const noexcept
+        {
+            return sink.input_bytes_available();
+        }
+
+        [[nodiscard]] bool input_disconnected() const noexcept
+        {
+            return sink.input_disconnected();
+        }
+
+        [[nodiscard]] bool inject_input_bytes(const std::span<const std::byte> bytes) noexcept
+        {
+            return sink.inject_input_bytes(bytes);
+        }
+
+        [[nodiscard]] bool vt_should_answer_queries() const noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> flush_input_buffer() noexcept
+        {
+            return sink.flush_input_buffer();
+        }
+
+        [[nodiscard]] std::expected<bool, oc::condrv::DeviceCommError> wait_for_input(const DWORD timeout_ms) noexcept
+        {
+            return sink.wait_for_input(timeout_ms);
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> send_end_task(
+            const DWORD process_id,
+            const DWORD event_type,
+            const DWORD ctrl_flags) noexcept
+        {
+            return sink.send_end_task(process_id, event_type, ctrl_flags);
+        }
+    };
+
+    // Serves the input of the message being dispatched.
+    struct MessageComm final
+    {
+        std::vector<std::byte> input;
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_input(oc::condrv::IoOperation& operation) noexcept
+        {
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset + size > input.size())
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"MessageComm read_input out of range",
+                    .win32_error = ERROR_INVALID_DATA,
+                });
+            }
+
+            if (size != 0)
+            {
+                std::memcpy(operation.buffer.data, input.data() + offset, size);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write_output(oc::condrv::IoOperation& /*operation*/) noexcept
+        {
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> complete_io(const oc::condrv::IoComplete& /*completion*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    [[nodiscard]] bool connect(
+        MessageComm& comm,
+        oc::condrv::ServerState& state,
+        RecordingHostIo& host_io,
+        oc::condrv::ConnectionInformation& info) noexcept
+    {
+        oc::condrv::IoPacket packet{};
+        packet.descriptor.identifier.LowPart = 1;
+        packet.descriptor.function = oc::condrv::console_io_connect;
+        packet.descriptor.process = 4242;
+        packet.descriptor.object = 4243;
+
+        oc::condrv::BasicApiMessage<MessageComm> message(comm, packet);
+        auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+        if (!outcome || message.completion().io_status.Status != oc::core::status_success)
+        {
+            return false;
+        }
+
+        std::memcpy(&info, message.completion().write.data, sizeof(info));
+        return true;
+    }
+
+    // Dispatches an ANSI `WriteConsole` of `text` and releases its buffers.
+    [[nodiscard]] bool write_console(
+        MessageComm& comm,
+        oc::condrv::ServerState& state,
+        RecordingHostIo& host_io,
+        const oc::condrv::ConnectionInformation& info,
+        const std::string_view text) noexcept
+    {
+        constexpr ULONG api_size = sizeof(CONSOLE_WRITECONSOLE_MSG);
+        constexpr ULONG read_offset = api_size + sizeof(CONSOLE_MSG_HEADER);
+
+        oc::condrv::IoPacket packet{};
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = 10;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = info.process;
+        packet.descriptor.object = info.output;
+        packet.descriptor.input_size = read_offset + static_cast<ULONG>(text.size());
+        packet.descriptor.output_size = api_size;
+        packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepWriteConsole);
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+        packet.payload.user_defined.u.console_msg_l1.WriteConsole.Unicode = FALSE;
+
+        comm.input.assign(packet.descriptor.input_size, std::byte{});
+        std::memcpy(comm.input.data() + read_offset, text.data(), text.size());
+
+        oc::condrv::BasicApiMessage<MessageComm> message(comm, packet);
+        auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+        if (!outcome || outcome->reply_pending || message.completion().io_status.Status != oc::core::status_success)
+        {
+            return false;
+        }
+
+        return message.release_message_buffers().has_value();
+    }
+
+    struct SerialSession final
+    {
+        // Pipe writes made by the time the loop entered a read with no wake armed.
+        std::vector<std::string> writes_before_block;
+        size_t woken_reads{};
+    };
+
+    // Mirrors the serial `run_loop` cycle (hold or flush, read, dispatch) against a driver that has
+    // one client's `WriteConsole` requests ready back to back, each taking `us_per_request`. Once the
+    // requests run out a read would block: with output held, the output timer's wake is played by
+    // moving the clock to the deadline and failing the read as canceled. The session ends at the
+    // first read that would block with no wake armed.
+    [[nodiscard]] std::optional<SerialSession> run_serial_session(
+        const std::vector<std::string_view>& lines,
+        const uint64_t us_per_request)
+    {
+        MessageComm comm{};
+        oc::condrv::ServerState state{};
+        RecordingHostIo host_io{};
+        oc::condrv::ConnectionInformation info{};
+        if (!connect(comm, state, host_io, info) || !host_io.flush_output())
+        {
+            return std::nullopt;
+        }
+
+        Hold hold(test_hold_us);
+        SerialSession session{};
+        size_t next = 0;
+        for (;;)
+        {
+            if (!hold.before_read(host_io))
+            {
+                return std::nullopt;
+            }
+
+            if (next == lines.size())
+            {
+                const auto deadline = hold.deadline();
+                if (!deadline)
+                {
+                    session.writes_before_block = host_io.output.sink().writes;
+                    return session;
+                }
+
+                hold.clock().now = std::max(hold.clock().now, *deadline);
+                hold.after_read(false);
+                ++session.woken_reads;
+                continue;
+            }
+
+            hold.after_read(true);
+            if (!write_console(comm, state, host_io, info, lines[next]))
+            {
+                return std::nullopt;
+            }
+
+            ++next;
+            hold.clock().now += us_per_request;
+        }
+    }
+
+    bool test_small_writes_are_combined_until_flush()
+    {
+        Buffer buffer({}, 64);
+        for (const std::string_view line : { "a\r\n", "bc\r\n", "def\r\n" })
+        {
+            if (!write_text(buffer, line))
+            {
+                return false;
+            }
+        }
+
+        if (!buffer.sink().writes.empty() || buffer.pending_bytes() != 12)
+        {
+            return false;
+        }
+
+        if (!buffer.flush() || buffer.pending_bytes() != 0)
+        {
+            return false;
+        }
+
+        // A second flush has nothing to write.
+        if (!buffer.flush())
+        {
+            return false;
+        }
+
+        const auto& stats = buffer.statistics();
+        return buffer.sink().writes == std::vector<std::string>{ "a\r\nbc\r\ndef\r\n" } && stats.writes == 3 && stats.bytes == 12 &&
+               stats.sink_writes == 1;
+    }
+
+    bool test_write_that_does_not_fit_flushes_first()
+    {
+        Buffer buffer({}, 8);
+        if (!write_text(buffer, "12345") || !write_text(buffer, "678"))
+        {
+            return false;
+        }
+
+        // Exactly full: nothing written yet.
+        if (!buffer.sink().writes.empty())
+        {
+            return false;
+        }
+
+        if (!write_text(buffer, "9") || buffer.sink().writes != std::vector<std::string>{ "12345678" } || buffer.pending_bytes() != 1)
+        {
+            return false;
+        }
+
+        return buffer.flush() && buffer.sink().writes == std::vector<std::string>{ "12345678", "9" } &&
+               buffer.statistics().capacity_flushes == 1;
+    }
+
+    bool test_large_write_goes_through_after_pending_bytes()
+    {
+        Buffer buffer({}, 8);
+        if (!write_text(buffer, "ab") || !write_text(buffer, "0123456789"))
+        {
+            return false;
+        }
+
+        // The buffered prefix is written first, then the large write as is.
+        if (buffer.sink().writes != std::vector<std::string>{ "ab", "0123456789" } || buffer.pending_bytes() != 0)
+        {
+            return false;
+        }
+
+        const auto& stats = buffer.statistics();
+        return stats.write_throughs == 1 && stats.capacity_flushes == 1 && stats.sink_writes == 2;
+    }
+
+    bool test_empty_write_is_a_no_op()
+    {
+        Buffer buffer({}, 8);
+        const auto written = buffer.write({});
+        return written.has_value() && *written == 0 && buffer.flush() && buffer.sink().writes.empty() &&
+               buffer.statistics().writes == 0;
+    }
+
+    bool test_sink_failure_is_sticky()
+    {
+        Buffer buffer({}, 8);
+        if (!write_text(buffer, "abc"))
+        {
+            return false;
+        }
+
+        buffer.sink().fail = true;
+        const auto flushed = buffer.flush();
+        if (flushed || flushed.error().win32_error != ERROR_NO_DATA || buffer.pending_bytes() != 0)
+        {
+            return false;
+        }
+
+        // The pipe is not retried, even once the sink would accept writes again.
+        buffer.sink().fail = false;
+        const auto written = buffer.write(bytes_of("def"));
+        if (written || written.error().win32_error != ERROR_NO_DATA)
+        {
+            return false;
+        }
+
+        return !buffer.flush() && buffer.sink().writes.empty() && buffer.statistics().sink_writes == 1;
+    }
+
+    bool test_serial_back_to_back_writes_reach_the_pipe_as_one_write()
+    {
+        const auto session = run_serial_session({ "one\r\n", "two\r\n", "three\r\n", "four\r\n" }, 10);
+        return session && session->writes_before_block == std::vector<std::string>{ "one\r\ntwo\r\nthree\r\nfour\r\n" } &&
+               session->woken_reads == 1;
+    }
+
+    bool test_serial_hold_is_bounded_while_requests_keep_arriving()
+    {
+        // The first four lines span the hold; the fifth is held until the wake.
+        const auto session = run_serial_session({ "1", "2", "3", "4", "5" }, 400);
+        return session && session->writes_before_block == std::vector<std::string>{ "1234", "5" } && session->woken_reads == 1;
+    }
+
+    bool test_serial_output_is_flushed_before_a_read_that_may_block()
+    {
+        RecordingHostIo host_io{};
+        Hold hold(test_hold_us);
+
+        // Nothing was delivered yet: the next read may block, so nothing is held.
+        if (!write_text(host_io.output, "prompt> ") || !hold.before_read(host_io) || hold.deadline().has_value() ||
+            host_io.output.sink().writes != std::vector<std::string>{ "prompt> " })
+        {
+            return false;
+        }
+
+        // Output of a delivered request is held until the deadline.
+        hold.after_read(true);
+        if (!write_text(host_io.output, "a") || !hold.before_read(host_io) || hold.deadline() != hold.clock().now + test_hold_us ||
+            host_io.output.sink().writes.size() != 1)
+        {
+            return false;
+        }
+
+        // A woken read (input, a wait, or the output timer) ends the stream: flush before reading again.
+        hold.after_read(false);
+        if (!hold.before_read(host_io) || hold.deadline().has_value() ||
+            host_io.output.sink().writes != std::vector<std::string>{ "prompt> ", "a" })
+        {
+            return false;
+        }
+
+        // Without a wake (`hold_us == 0`) output goes out before every read.
+        Hold unheld(0);
+        unheld.after_read(true);
+        return write_text(host_io.output, "b") && unheld.before_read(host_io) && !unheld.deadline().has_value() &&
+               host_io.output.sink().writes.back() == "b";
+    }
+}
+
+bool run_condrv_host_output_buffer_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_small_writes_are_combined_until_flush", test_small_writes_are_combined_until_flush },
+        { L"test_write_that_does_not_fit_flushes_first", test_write_that_does_not_fit_flushes_first },
+        { L"test_large_write_goes_through_after_pending_bytes", test_large_write_goes_through_after_pending_bytes },
+        { L"test_empty_write_is_a_no_op", test_empty_write_is_a_no_op },
+        { L"test_sink_failure_is_sticky", test_sink_failure_is_sticky },
+        { L"test_serial_back_to_back_writes_reach_the_pipe_as_one_write", test_serial_back_to_back_writes_reach_the_pipe_as_one_write },
+        { L"test_serial_hold_is_bounded_while_requests_keep_arriving", test_serial_hold_is_bounded_while_requests_keep_arriving },
+        { L"test_serial_output_is_flushed_before_a_read_that_may_block", test_serial_output_is_flushed_before_a_read_that_may_block },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv host output buffer] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
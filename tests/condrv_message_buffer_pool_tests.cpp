@@ -0,0 +1,543 @@
+#include "condrv/condrv_server.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    struct MemoryComm final
+    {
+        std::vector<std::byte> input;
+        std::vector<std::byte> output;
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_input(oc::condrv::IoOperation& operation) noexcept
+        {
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset + size > input.size())
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"read_input out of range",
+                    .win32_error = ERROR_INVALID_DATA,
+                });
+            }
+
+            if (size != 0)
+            {
+                std::memcpy(operation.buffer.data, input.data() + offset, size);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write_output(oc::condrv::IoOperation& operation) noexcept
+        {
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset + size > output.size())
+            {
+                output.resize(offset + size);
+            }
+
+            if (size != 0)
+            {
+                std::memcpy(output.data() + offset, operation.buffer.data, size);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> complete_io(const oc::condrv::IoComplete& /*completion*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    // Endless input source: every read returns the same byte so ReadConsole/GetConsoleInput
+    // always complete immediately without growing any container.
+    struct RepeatingHostIo final
+    {
+        std::byte value{ static_cast<std::byte>('a') };
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> write_output_bytes(const std::span<const std::byte> bytes) noexcept
+        {
+            return bytes.size();
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> read_input_bytes(const std::span<std::byte> dest) noexcept
+        {
+            std::fill(dest.begin(), dest.end(), value);
+            return dest.size();
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> peek_input_bytes(const std::span<std::byte> dest) noexcept
+        {
+            std::fill(dest.begin(), dest.end(), value);
+            return dest.size();
+        }
+
+        [[nodiscard]] size_t input_bytes_available() const noexcept
+        {
+            return 4096;
+        }
+
+        [[nodiscard]] bool inject_input_bytes(const std::span<const std::byte> /*bytes*/) noexcept
+        {
+            return true;
+        }
+
+        [[nodiscard]] bool vt_should_answer_queries() const noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> flush_input_buffer() noexcept
+        {
+            return {};
+        }
+
+        [[nodiscard]] std::expected<bool, oc::condrv::DeviceCommError> wait_for_input(const DWORD /*timeout_ms*/) noexcept
+        {
+            return true;
+        }
+
+        [[nodiscard]] bool input_disconnected() const noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> send_end_task(
+            const DWORD /*process_id*/,
+            const DWORD /*event_type*/,
+            const DWORD /*ctrl_flags*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    // Host that never has input, so input-dependent requests go reply-pending.
+    struct EmptyHostIo final
+    {
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> write_output_bytes(const std::span<const std::byte> bytes) noexcept
+        {
+            return bytes.size();
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> read_input_bytes(const std::span<std::byte> /*dest*/) noexcept
+        {
+            return size_t{ 0 };
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> peek_input_bytes(const std::span<std::byte> /*dest*/) noexcept
+        {
+            return size_t{ 0 };
+        }
+
+        [[nodiscard]] size_t input_bytes_available() const noexcept
+        {
+            return 0;
+        }
+
+        [[nodiscard]] bool inject_input_bytes(const std::span<const std::byte> /*bytes*/) noexcept
+        {
+            return true;
+        }
+
+        [[nodiscard]] bool vt_should_answer_queries() const noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> flush_input_buffer() noexcept
+        {
+            return {};
+        }
+
+        [[nodiscard]] std::expected<bool, oc::condrv::DeviceCommError> wait_for_input(const DWORD /*timeout_ms*/) noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] bool input_disconnected() const noexcept
+        {
+            return false;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> send_end_task(
+            const DWORD /*process_id*/,
+            const DWORD /*event_type*/,
+            const DWORD /*ctrl_flags*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    [[nodiscard]] oc::condrv::IoPacket make_connect_packet(const DWORD pid, const DWORD tid) noexcept
+    {
+        oc::condrv::IoPacket packet{};
+        packet.descriptor.identifier.LowPart = 1;
+        packet.descriptor.function = oc::condrv::console_io_connect;
+        packet.descriptor.process = pid;
+        packet.descriptor.object = tid;
+        return packet;
+    }
+
+    template<typename HostIo>
+    [[nodiscard]] bool connect(
+        MemoryComm& comm,
+        oc::condrv::ServerState& state,
+        HostIo& host_io,
+        oc::condrv::ConnectionInformation& info) noexcept
+    {
+        oc::condrv::BasicApiMessage<MemoryComm> message(comm, make_connect_packet(4242, 4243));
+        auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+        if (!outcome || message.completion().io_status.Status != oc::core::status_success)
+        {
+            return false;
+        }
+
+        std::memcpy(&info, message.completion().write.data, sizeof(info));
+        return true;
+    }
+
+    [[nodiscard]] oc::condrv::IoPacket make_write_console_packet(
+        const oc::condrv::ConnectionInformation& info,
+        const ULONG payload_size) noexcept
+    {
+        constexpr ULONG api_size = sizeof(CONSOLE_WRITECONSOLE_MSG);
+        constexpr ULONG read_offset = api_size + sizeof(CONSOLE_MSG_HEADER);
+
+        oc::condrv::IoPacket packet{};
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = 10;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = info.process;
+        packet.descriptor.object = info.output;
+        packet.descriptor.input_size = read_offset + payload_size;
+        packet.descriptor.output_size = api_size;
+        packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepWriteConsole);
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+        packet.payload.user_defined.u.console_msg_l1.WriteConsole.Unicode = FALSE;
+        return packet;
+    }
+
+    [[nodiscard]] oc::condrv::IoPacket make_read_console_packet(
+        const oc::condrv::ConnectionInformation& info,
+        const ULONG buffer_bytes) noexcept
+    {
+        constexpr ULONG api_size = sizeof(CONSOLE_READCONSOLE_MSG);
+        constexpr ULONG read_offset = api_size + sizeof(CONSOLE_MSG_HEADER);
+
+        oc::condrv::IoPacket packet{};
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = 11;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = info.process;
+        packet.descriptor.object = info.input;
+        packet.descriptor.input_size = read_offset;
+        packet.descriptor.output_size = api_size + buffer_bytes;
+        packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepReadConsole);
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+        packet.payload.user_defined.u.console_msg_l1.ReadConsole.Unicode = FALSE;
+        return packet;
+    }
+
+    [[nodiscard]] oc::condrv::IoPacket make_get_console_input_packet(
+        const oc::condrv::ConnectionInformation& info,
+        const ULONG record_count) noexcept
+    {
+        constexpr ULONG api_size = sizeof(CONSOLE_GETCONSOLEINPUT_MSG);
+        constexpr ULONG read_offset = api_size + sizeof(CONSOLE_MSG_HEADER);
+
+        oc::condrv::IoPacket packet{};
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = 12;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = info.process;
+        packet.descriptor.object = info.input;
+        packet.descriptor.input_size = read_offset;
+        packet.descriptor.output_size = api_size + record_count * static_cast<ULONG>(sizeof(INPUT_RECORD));
+        packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepGetConsoleInput);
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+        packet.payload.user_defined.u.console_msg_l1.GetConsoleInput.Unicode = TRUE;
+        return packet;
+    }
+
+    template<typename HostIo>
+    [[nodiscard]] bool dispatch_and_complete(
+        MemoryComm& comm,
+        oc::condrv::ServerState& state,
+        HostIo& host_io,
+        oc::condrv::MessageBufferPool& pool,
+        const oc::condrv::IoPacket& packet) noexcept
+    {
+        oc::condrv::BasicApiMessage<MemoryComm> message(comm, packet, &pool);
+        auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+        if (!outcome || outcome->reply_pending || message.completion().io_status.Status != oc::core::status_success)
+        {
+            return false;
+        }
+
+        return message.release_message_buffers().has_value();
+    }
+
+    bool test_size_classes_round_up_to_powers_of_two()
+    {
+        using Pool = oc::condrv::MessageBufferPool;
+        return Pool::size_class_for(1) == 0 &&
+               Pool::size_class_for(Pool::min_class_bytes) == 0 &&
+               Pool::size_class_for(Pool::min_class_bytes + 1) == 1 &&
+               Pool::size_class_for(Pool::max_class_bytes) == Pool::class_count - 1 &&
+               Pool::size_class_for(Pool::max_class_bytes + 1) == Pool::class_count;
+    }
+
+    bool test_released_buffers_are_reused()
+    {
+        oc::condrv::MessageBufferPool pool;
+
+        const std::byte* first_data = nullptr;
+        {
+            auto first = pool.acquire(300);
+            if (!first || first->size() != 300 || first->capacity() != 512)
+            {
+                return false;
+            }
+            first_data = first->data();
+        }
+
+        auto second = pool.acquire(400);
+        if (!second || second->data() != first_data || second->size() != 400)
+        {
+            return false;
+        }
+
+        const auto& stats = pool.statistics();
+        return stats.acquires == 2 && stats.pool_hits == 1 && stats.heap_allocations == 1;
+    }
+
+    bool test_zero_size_does_not_allocate()
+    {
+        oc::condrv::MessageBufferPool pool;
+        auto empty = pool.acquire(0);
+        return empty && empty->data() == nullptr && empty->size() == 0 && pool.statistics().heap_allocations == 0;
+    }
+
+    bool test_oversize_buffers_are_not_cached()
+    {
+        oc::condrv::MessageBufferPool pool;
+        for (int i = 0; i < 3; ++i)
+        {
+            auto big = pool.acquire(oc::condrv::MessageBufferPool::max_class_bytes + 1);
+            if (!big)
+            {
+                return false;
+            }
+        }
+
+        const auto& stats = pool.statistics();
+        return stats.oversize_allocations == 3 && stats.heap_frees == 3 && pool.cached_buffer_count() == 0;
+    }
+
+    bool test_free_list_is_bounded()
+    {
+        oc::condrv::MessageBufferPool pool;
+        constexpr size_t outstanding = oc::condrv::MessageBufferPool::max_cached_per_class + 4;
+        {
+            std::vector<oc::condrv::PooledBuffer> buffers;
+            buffers.reserve(outstanding);
+            for (size_t i = 0; i < outstanding; ++i)
+            {
+                auto buffer = pool.acquire(64);
+                if (!buffer)
+                {
+                    return false;
+                }
+                buffers.push_back(std::move(buffer.value()));
+            }
+        }
+
+        return pool.cached_buffer_count() == oc::condrv::MessageBufferPool::max_cached_per_class &&
+               pool.statistics().heap_frees == 4;
+    }
+
+    bool test_moved_buffer_returns_once()
+    {
+        oc::condrv::MessageBufferPool pool;
+        {
+            auto acquired = pool.acquire(128);
+            if (!acquired)
+            {
+                return false;
+            }
+
+            oc::condrv::PooledBuffer moved = std::move(acquired.value());
+            oc::condrv::PooledBuffer target;
+            target = std::move(moved);
+            if (moved.data() != nullptr || target.data() == nullptr)
+            {
+                return false;
+            }
+        }
+
+        return pool.cached_buffer_count() == 1 && pool.statistics().heap_frees == 0;
+    }
+
+    bool test_steady_state_console_traffic_does_not_allocate()
+    {
+        MemoryComm comm{};
+        oc::condrv::ServerState state{};
+        RepeatingHostIo host_io{};
+        oc::condrv::MessageBufferPool pool;
+
+        oc::condrv::ConnectionInformation info{};
+        if (!connect(comm, state, host_io, info))
+        {
+            return false;
+        }
+        state.set_input_mode(0); // raw ReadConsole: complete with whatever bytes are available
+
+        constexpr std::string_view line = "steady state output line\r\n";
+        const auto write_packet = make_write_console_packet(info, static_cast<ULONG>(line.size()));
+        comm.input.assign(write_packet.descriptor.input_size, std::byte{});
+        std::memcpy(
+            comm.input.data() + sizeof(CONSOLE_WRITECONSOLE_MSG) + sizeof(CONSOLE_MSG_HEADER),
+            line.data(),
+            line.size());
+
+        const auto read_packet = make_read_console_packet(info, 64);
+        const auto input_packet = make_get_console_input_packet(info, 4);
+
+        const auto run_round = [&]() noexcept {
+            return dispatch_and_complete(comm, state, host_io, pool, write_packet) &&
+                   dispatch_and_complete(comm, state, host_io, pool, read_packet) &&
+                   dispatch_and_complete(comm, state, host_io, pool, input_packet);
+        };
+
+        // Warm up: the first round populates the free lists.
+        for (int i = 0; i < 4; ++i)
+        {
+            if (!run_round())
+            {
+                return false;
+            }
+        }
+
+        const auto warm = pool.statistics();
+        for (int i = 0; i < 256; ++i)
+        {
+            if (!run_round())
+            {
+                return false;
+            }
+        }
+
+        const auto& steady = pool.statistics();
+        if (steady.heap_allocations != warm.heap_allocations || steady.heap_frees != warm.heap_frees)
+        {
+            fwprintf(
+                stderr,
+                L"[condrv buffer pool] steady state allocated: %llu -> %llu\n",
+                static_cast<unsigned long long>(warm.heap_allocations),
+                static_cast<unsigned long long>(steady.heap_allocations));
+            return false;
+        }
+
+        // Every round acquires one input (WriteConsole) and two output buffers.
+        return steady.acquires - warm.acquires == 256 * 3 && steady.pool_hits - warm.pool_hits == 256 * 3;
+    }
+
+    bool test_reply_pending_message_returns_buffers_on_completion()
+    {
+        MemoryComm comm{};
+        oc::condrv::ServerState state{};
+        EmptyHostIo host_io{};
+        oc::condrv::MessageBufferPool pool;
+
+        oc::condrv::ConnectionInformation info{};
+        if (!connect(comm, state, host_io, info))
+        {
+            return false;
+        }
+        state.set_input_mode(0);
+
+        std::vector<oc::condrv::BasicApiMessage<MemoryComm>> pending;
+        pending.reserve(4);
+        for (int i = 0; i < 4; ++i)
+        {
+            oc::condrv::BasicApiMessage<MemoryComm> message(comm, make_read_console_packet(info, 64), &pool);
+            auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+            if (!outcome || !outcome->reply_pending)
+            {
+                return false;
+            }
+
+            pending.push_back(std::move(message));
+        }
+
+        const size_t cached_while_pending = pool.cached_buffer_count();
+        for (auto& message : pending)
+        {
+            message.set_reply_status(oc::core::status_unsuccessful);
+            message.set_reply_information(0);
+            if (!message.release_message_buffers())
+            {
+                return false;
+            }
+        }
+        pending.clear();
+
+        // Nothing may leak: every acquired buffer is either cached or was freed.
+        const auto& stats = pool.statistics();
+        return pool.cached_buffer_count() >= cached_while_pending &&
+               stats.heap_allocations == pool.cached_buffer_count() + stats.heap_frees;
+    }
+
+    bool test_unpooled_messages_still_work()
+    {
+        auto buffer = oc::condrv::MessageBufferPool::acquire_unpooled(32);
+        if (!buffer || buffer->size() != 32)
+        {
+            return false;
+        }
+
+        std::memset(buffer->data(), 0x5A, buffer->size());
+        buffer->reset();
+        return buffer->data() == nullptr;
+    }
+}
+
+bool run_condrv_message_buffer_pool_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_size_classes_round_up_to_powers_of_two", test_size_classes_round_up_to_powers_of_two },
+        { L"test_released_buffers_are_reused", test_released_buffers_are_reused },
+        { L"test_zero_size_does_not_allocate", test_zero_size_does_not_allocate },
+        { L"test_oversize_buffers_are_not_cached", test_oversize_buffers_are_not_cached },
+        { L"test_free_list_is_bounded", test_free_list_is_bounded },
+        { L"test_moved_buffer_returns_once", test_moved_buffer_returns_once },
+        { L"test_steady_state_console_traffic_does_not_allocate", test_steady_state_console_traffic_does_not_allocate },
+        { L"test_reply_pending_message_returns_buffers_on_completion", test_reply_pending_message_returns_buffers_on_completion },
+        { L"test_unpooled_messages_still_work", test_unpooled_messages_still_work },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv buffer pool] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,380 @@
+#include "condrv/condrv_packet_replay.hpp"
+#include "condrv/condrv_packet_trace.hpp"
+#include "core/ntstatus.hpp"
+
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    constexpr wchar_t trace_file_name[] = L"condrv_packet_trace_test.octrace";
+
+    template<typename T>
+    [[nodiscard]] std::vector<std::byte> bytes_of(const T& value)
+    {
+        const auto* const begin = reinterpret_cast<const std::byte*>(&value);
+        return std::vector<std::byte>(begin, begin + sizeof(T));
+    }
+
+    [[nodiscard]] std::vector<std::byte> bytes_of_text(const std::wstring_view text)
+    {
+        const auto bytes = std::as_bytes(std::span(text.data(), text.size()));
+        return std::vector<std::byte>(bytes.begin(), bytes.end());
+    }
+
+    void append_bytes(std::vector<std::byte>& target, const std::span<const std::byte> bytes)
+    {
+        target.insert(target.end(), bytes.begin(), bytes.end());
+    }
+
+    [[nodiscard]] oc::condrv::IoPacket make_user_defined_packet(
+        const ULONG id,
+        const ULONG_PTR process,
+        const ULONG_PTR object,
+        const ULONG api_number,
+        const ULONG api_size,
+        const ULONG payload_size,
+        const ULONG output_size)
+    {
+        oc::condrv::IoPacket packet{};
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = id;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = process;
+        packet.descriptor.object = object;
+        packet.descriptor.input_size = api_size + static_cast<ULONG>(sizeof(CONSOLE_MSG_HEADER)) + payload_size;
+        packet.descriptor.output_size = output_size;
+        packet.payload.user_defined.msg_header.ApiNumber = api_number;
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+        return packet;
+    }
+
+    [[nodiscard]] oc::condrv::PacketTraceRecord make_packet_record(const oc::condrv::IoPacket& packet)
+    {
+        oc::condrv::PacketTraceRecord record{};
+        record.kind = oc::condrv::PacketTraceRecordKind::packet;
+        record.packet = packet;
+        return record;
+    }
+
+    [[nodiscard]] oc::condrv::PacketTraceRecord make_completion_record(
+        const ULONG id,
+        const uint64_t information,
+        std::vector<std::byte> write = {})
+    {
+        oc::condrv::PacketTraceRecord record{};
+        record.kind = oc::condrv::PacketTraceRecordKind::completion;
+        record.identifier.LowPart = id;
+        record.status = oc::core::status_success;
+        record.information = information;
+        record.bytes = std::move(write);
+        return record;
+    }
+
+    [[nodiscard]] std::vector<std::byte> make_trace_header(const uint16_t packet_size = sizeof(oc::condrv::IoPacket))
+    {
+        oc::condrv::PacketTraceFileHeader header{};
+        header.packet_size = packet_size;
+        header.ticks_per_second = 10'000'000;
+        return bytes_of(header);
+    }
+
+    bool test_packet_trace_round_trips_through_file()
+    {
+        auto packet = make_user_defined_packet(
+            42,
+            0x1000,
+            0x2000,
+            static_cast<ULONG>(ConsolepWriteConsole),
+            sizeof(CONSOLE_WRITECONSOLE_MSG),
+            6,
+            sizeof(CONSOLE_WRITECONSOLE_MSG));
+        packet.payload.user_defined.u.console_msg_l1.WriteConsole.Unicode = TRUE;
+
+        const auto text = bytes_of_text(L"abc");
+        std::vector<std::byte> payload = text;
+
+        oc::condrv::IoOperation read{};
+        read.identifier = packet.descriptor.identifier;
+        read.buffer.offset = 40;
+        read.buffer.data = payload.data();
+        read.buffer.size = static_cast<ULONG>(payload.size());
+
+        ULONG written_count = 3;
+        oc::condrv::IoComplete completion{};
+        completion.identifier = packet.descriptor.identifier;
+        completion.io_status.Status = oc::core::status_success;
+        completion.io_status.Information = 7;
+        completion.write.data = &written_count;
+        completion.write.size = sizeof(written_count);
+
+        const std::vector<std::byte> host_input{ std::byte{ 0x1b }, std::byte{ '[' }, std::byte{ 'A' } };
+
+        {
+            auto writer = oc::condrv::PacketTraceWriter::create(trace_file_name, oc::condrv::packet_trace_flag_host_output);
+            if (!writer)
+            {
+                return false;
+            }
+
+            (*writer)->record_packet(packet);
+            (*writer)->record_input_payload(read);
+            (*writer)->record_completion(completion);
+            (*writer)->record_host_input(host_input);
+            (*writer)->record_host_input({});
+            if (!(*writer)->flush() || (*writer)->statistics().records != 4 || (*writer)->statistics().dropped_records != 0)
+            {
+                (void)::DeleteFileW(trace_file_name);
+                return false;
+            }
+        }
+
+        const auto trace = oc::condrv::load_packet_trace(trace_file_name);
+        (void)::DeleteFileW(trace_file_name);
+        if (!trace || trace->flags != oc::condrv::packet_trace_flag_host_output || trace->records.size() != 4)
+        {
+            return false;
+        }
+
+        const auto& records = trace->records;
+        const auto& replayed_packet = records[0].packet;
+        if (records[0].kind != oc::condrv::PacketTraceRecordKind::packet ||
+            std::memcmp(&replayed_packet.descriptor, &packet.descriptor, sizeof(packet.descriptor)) != 0 ||
+            replayed_packet.payload.user_defined.msg_header.ApiNumber != static_cast<ULONG>(ConsolepWriteConsole) ||
+            replayed_packet.payload.user_defined.u.console_msg_l1.WriteConsole.Unicode != TRUE)
+        {
+            return false;
+        }
+
+        if (records[1].kind != oc::condrv::PacketTraceRecordKind::input_payload ||
+            records[1].identifier.LowPart != 42 ||
+            records[1].offset != 40 ||
+            records[1].bytes != text)
+        {
+            return false;
+        }
+
+        if (records[2].kind != oc::condrv::PacketTraceRecordKind::completion ||
+            records[2].status != oc::core::status_success ||
+            records[2].information != 7 ||
+            records[2].bytes != bytes_of(written_count))
+        {
+            return false;
+        }
+
+        return records[3].kind == oc::condrv::PacketTraceRecordKind::host_input && records[3].bytes == host_input;
+    }
+
+    bool test_packet_trace_stores_only_used_packet_bytes()
+    {
+        oc::condrv::IoPacket connect{};
+        connect.descriptor.function = oc::condrv::console_io_connect;
+        if (oc::condrv::packet_trace_packet_size(connect) != sizeof(oc::condrv::IoDescriptor))
+        {
+            return false;
+        }
+
+        const auto packet = make_user_defined_packet(1, 1, 1, static_cast<ULONG>(ConsolepGetMode), sizeof(CONSOLE_MODE_MSG), 0, 0);
+        const size_t expected = offsetof(oc::condrv::IoPacket, payload) +
+                                offsetof(oc::condrv::UserDefinedPacket, u) +
+                                sizeof(CONSOLE_MODE_MSG);
+        if (oc::condrv::packet_trace_packet_size(packet) != expected)
+        {
+            return false;
+        }
+
+        // A hostile descriptor size must never make the writer read past the packet.
+        auto oversized = packet;
+        oversized.payload.user_defined.msg_header.ApiDescriptorSize = 0xFFFF'FFFF;
+        return oc::condrv::packet_trace_packet_size(oversized) <= sizeof(oc::condrv::IoPacket);
+    }
+
+    bool test_packet_trace_rejects_malformed_files()
+    {
+        if (oc::condrv::parse_packet_trace({}))
+        {
+            return false;
+        }
+
+        auto bad_magic = make_trace_header();
+        bad_magic[0] = std::byte{ 'X' };
+        if (oc::condrv::parse_packet_trace(bad_magic))
+        {
+            return false;
+        }
+
+        const auto other_layout = make_trace_header(static_cast<uint16_t>(sizeof(oc::condrv::IoPacket) + 8));
+        const auto mismatch = oc::condrv::parse_packet_trace(other_layout);
+        if (mismatch || mismatch.error().win32_error != ERROR_NOT_SUPPORTED)
+        {
+            return false;
+        }
+
+        auto truncated = make_trace_header();
+        oc::condrv::PacketTraceRecordHeader record{};
+        record.kind = oc::condrv::PacketTraceRecordKind::host_input;
+        record.size = 100;
+        append_bytes(truncated, bytes_of(record));
+        append_bytes(truncated, bytes_of_text(L"short"));
+        if (oc::condrv::parse_packet_trace(truncated))
+        {
+            return false;
+        }
+
+        auto short_packet = make_trace_header();
+        record.kind = oc::condrv::PacketTraceRecordKind::packet;
+        record.size = 4;
+        append_bytes(short_packet, bytes_of(record));
+        append_bytes(short_packet, bytes_of(ULONG{ 1 }));
+        if (oc::condrv::parse_packet_trace(short_packet))
+        {
+            return false;
+        }
+
+        // Unknown record kinds are skipped so older replayers can read newer traces.
+        auto unknown = make_trace_header();
+        record.kind = static_cast<oc::condrv::PacketTraceRecordKind>(0x7F);
+        record.size = 2;
+        append_bytes(unknown, bytes_of(record));
+        append_bytes(unknown, bytes_of(uint16_t{ 0 }));
+        const auto parsed = oc::condrv::parse_packet_trace(unknown);
+        return parsed && parsed->records.empty();
+    }
+
+    bool test_packet_replay_maps_handles_and_serves_captured_input()
+    {
+        // Handles as the captured server reported them; the replay creates different ones.
+        constexpr ULONG_PTR captured_process = 0x1110;
+        constexpr ULONG_PTR captured_input = 0x2220;
+        constexpr ULONG_PTR captured_output = 0x3330;
+
+        constexpr ULONG header_size = sizeof(CONSOLE_MSG_HEADER);
+        const auto text = bytes_of_text(L"hello\r\n");
+
+        oc::condrv::PacketTrace trace{};
+        trace.ticks_per_second = 10'000'000;
+        auto& records = trace.records;
+
+        oc::condrv::IoPacket connect{};
+        connect.descriptor.identifier.LowPart = 1;
+        connect.descriptor.function = oc::condrv::console_io_connect;
+        connect.descriptor.process = 4242;
+        connect.descriptor.object = 4243;
+        records.push_back(make_packet_record(connect));
+        const oc::condrv::ConnectionInformation captured_info{
+            .process = captured_process,
+            .input = captured_input,
+            .output = captured_output,
+        };
+        records.push_back(make_completion_record(1, sizeof(captured_info), bytes_of(captured_info)));
+
+        // Raw input mode so the pending read completes on a single byte.
+        auto set_mode = make_user_defined_packet(
+            2, captured_process, captured_input, static_cast<ULONG>(ConsolepSetMode), sizeof(CONSOLE_MODE_MSG), 0, 0);
+        set_mode.payload.user_defined.u.console_msg_l1.SetConsoleMode.Mode = 0;
+        records.push_back(make_packet_record(set_mode));
+        records.push_back(make_completion_record(2, 0));
+
+        auto write = make_user_defined_packet(
+            3,
+            captured_process,
+            captured_output,
+            static_cast<ULONG>(ConsolepWriteConsole),
+            sizeof(CONSOLE_WRITECONSOLE_MSG),
+            static_cast<ULONG>(text.size()),
+            sizeof(CONSOLE_WRITECONSOLE_MSG));
+        write.payload.user_defined.u.console_msg_l1.WriteConsole.Unicode = TRUE;
+        records.push_back(make_packet_record(write));
+        oc::condrv::PacketTraceRecord payload{};
+        payload.kind = oc::condrv::PacketTraceRecordKind::input_payload;
+        payload.identifier.LowPart = 3;
+        payload.offset = sizeof(CONSOLE_WRITECONSOLE_MSG) + header_size;
+        payload.bytes = text;
+        records.push_back(payload);
+        records.push_back(make_completion_record(3, 0));
+
+        auto read = make_user_defined_packet(
+            4,
+            captured_process,
+            captured_input,
+            static_cast<ULONG>(ConsolepReadConsole),
+            sizeof(CONSOLE_READCONSOLE_MSG),
+            0,
+            sizeof(CONSOLE_READCONSOLE_MSG) + sizeof(wchar_t));
+        read.payload.user_defined.u.console_msg_l1.ReadConsole.Unicode = TRUE;
+        records.push_back(make_packet_record(read));
+
+        oc::condrv::PacketTraceRecord host_input{};
+        host_input.kind = oc::condrv::PacketTraceRecordKind::host_input;
+        host_input.bytes = { std::byte{ 'x' } };
+        records.push_back(host_input);
+        records.push_back(make_completion_record(4, 0));
+
+        const auto result = oc::condrv::replay_packet_trace(trace);
+        if (!result)
+        {
+            return false;
+        }
+
+        if (result->packets != 4 ||
+            result->reply_pending != 1 ||
+            result->missing_input_payloads != 0 ||
+            result->host_input_bytes != 1 ||
+            result->samples.size() != 4)
+        {
+            return false;
+        }
+
+        // Without the handle mapping every request after connect would fail with an invalid handle.
+        const ULONG expected_apis[] = {
+            0,
+            static_cast<ULONG>(ConsolepSetMode),
+            static_cast<ULONG>(ConsolepWriteConsole),
+            static_cast<ULONG>(ConsolepReadConsole),
+        };
+        for (size_t i = 0; i < result->samples.size(); ++i)
+        {
+            const auto& sample = result->samples[i];
+            if (sample.status != oc::core::status_success || sample.api_number != expected_apis[i])
+            {
+                return false;
+            }
+        }
+
+        return result->samples[0].function == oc::condrv::console_io_connect;
+    }
+}
+
+bool run_condrv_packet_trace_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_packet_trace_round_trips_through_file", test_packet_trace_round_trips_through_file },
+        { L"test_packet_trace_stores_only_used_packet_bytes", test_packet_trace_stores_only_used_packet_bytes },
+        { L"test_packet_trace_rejects_malformed_files", test_packet_trace_rejects_malformed_files },
+        { L"test_packet_replay_maps_handles_and_serves_captured_input", test_packet_replay_maps_handles_and_serves_captured_input },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv packet trace] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -6,6 +6,8 @@
 #include <cstring>
 #include <iterator>
 #include <optional>
+#include <span>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -1269,6 +1271,81 @@ namespace
                std::memcmp(host_io.written.data(), "hi", 2) == 0;
     }
 
+    bool test_user_defined_write_console_w_empty_payload_succeeds()
+    {
+        MemoryComm comm{};
+        oc::condrv::ServerState state{};
+        TestHostIo host_io{};
+
+        auto connect_packet = make_connect_packet(7781, 7782);
+        oc::condrv::BasicApiMessage<MemoryComm> connect_message(comm, connect_packet);
+        if (!oc::condrv::dispatch_message(state, connect_message, host_io))
+        {
+            return false;
+        }
+
+        const auto info = unpack_connection_information(connect_message.completion());
+        return write_console_user_defined_w(comm, state, host_io, info, L"", 11) && host_io.written.empty();
+    }
+
+    bool test_user_defined_write_console_w_transcodes_non_ascii_into_reused_scratch()
+    {
+        MemoryComm comm{};
+        oc::condrv::ServerState state{};
+        TestHostIo host_io{};
+
+        auto connect_packet = make_connect_packet(7783, 7784);
+        oc::condrv::BasicApiMessage<MemoryComm> connect_message(comm, connect_packet);
+        if (!oc::condrv::dispatch_message(state, connect_message, host_io))
+        {
+            return false;
+        }
+
+        const auto info = unpack_connection_information(connect_message.completion());
+
+        // U+00E9, U+4E2D, U+1F600 (surrogate pair): 2-, 3- and 4-byte UTF-8 sequences.
+        constexpr wchar_t text[] = { L'a', 0x00E9, 0x4E2D, 0xD83D, 0xDE00, L'z' };
+        constexpr unsigned char expected[] = {
+            'a', 0xC3, 0xA9, 0xE4, 0xB8, 0xAD, 0xF0, 0x9F, 0x98, 0x80, 'z',
+        };
+
+        const std::wstring_view view(text, std::size(text));
+        if (!write_console_user_defined_w(comm, state, host_io, info, view, 12))
+        {
+            return false;
+        }
+
+        const auto* const scratch = state.output_utf8_scratch().data();
+        for (ULONG i = 0; i < 8; ++i)
+        {
+            if (!write_console_user_defined_w(comm, state, host_io, info, view, 13 + i))
+            {
+                return false;
+            }
+        }
+
+        // Same-sized writes must reuse the scratch buffer instead of reallocating it.
+        if (state.output_utf8_scratch().data() != scratch)
+        {
+            return false;
+        }
+
+        if (host_io.written.size() != sizeof(expected) * 9)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < 9; ++i)
+        {
+            if (std::memcmp(host_io.written.data() + i * sizeof(expected), expected, sizeof(expected)) != 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
     bool test_user_defined_write_console_a_updates_screen_buffer_model()
     {
         MemoryComm comm{};
@@ -3412,6 +3489,131 @@ namespace
         return comm.output.empty();
     }
 
+    bool test_passthrough_write_console_defers_mirroring_until_read_back()
+    {
+        MemoryComm comm{};
+        oc::condrv::ServerState state{};
+        TestHostIo host_io{};
+        host_io.answer_vt_queries = false;
+
+        auto connect_packet = make_connect_packet(20047, 20048);
+        oc::condrv::BasicApiMessage<MemoryComm> connect_message(comm, connect_packet);
+        auto connect_outcome = oc::condrv::dispatch_message(state, connect_message, host_io);
+        if (!connect_outcome)
+        {
+            return false;
+        }
+
+        state.set_output_mode(
+            ENABLE_PROCESSED_OUTPUT |
+            ENABLE_WRAP_AT_EOL_OUTPUT |
+            ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+
+        auto info = unpack_connection_information(connect_message.completion());
+        if (!write_console_user_defined_w(comm, state, host_io, info, L"ab\x1b[3", 614) ||
+            !write_console_user_defined_a(comm, state, host_io, info, "1mcd", 615))
+        {
+            return false;
+        }
+
+        // The bytes reach the terminal, but the model is untouched until something reads it.
+        const auto screen_buffer = state.active_screen_buffer();
+        if (screen_buffer == nullptr || host_io.written.size() != 9 || !state.has_deferred_output() ||
+            screen_buffer->cursor_position().X != 0)
+        {
+            return false;
+        }
+
+        const auto value = read_console_output_char(comm, state, host_io, info, COORD{ 2, 0 }, 616);
+        if (!value || *value != L'c' || state.has_deferred_output())
+        {
+            return false;
+        }
+
+        USHORT attributes = 0;
+        (void)screen_buffer->read_output_attributes(COORD{ 2, 0 }, std::span<USHORT>(&attributes, 1));
+        return screen_buffer->cursor_position().X == 4 && (attributes & 0x0F) == FOREGROUND_RED;
+    }
+
+    bool test_passthrough_deferred_mirroring_matches_immediate_mirroring()
+    {
+        // The same writes, applied as they arrive and applied from the log: sequences and a combining
+        // mark split across writes, a mode change between writes, and more output than the log holds.
+        const auto run = [](const bool passthrough, std::wstring& cells, COORD& cursor) -> bool {
+            MemoryComm comm{};
+            oc::condrv::ServerState state{};
+            TestHostIo host_io{};
+            host_io.answer_vt_queries = !passthrough;
+
+            auto connect_packet = make_connect_packet(20049, 20050);
+            oc::condrv::BasicApiMessage<MemoryComm> connect_message(comm, connect_packet);
+            if (!oc::condrv::dispatch_message(state, connect_message, host_io))
+            {
+                return false;
+            }
+
+            const auto info = unpack_connection_information(connect_message.completion());
+            constexpr ULONG vt_mode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+            constexpr ULONG classic_mode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT;
+            const struct
+            {
+                ULONG mode;
+                std::wstring_view text;
+            } writes[] = {
+                { vt_mode, L"\x1b[2;3Hx\x1b[4" },
+                { vt_mode, L"4mye" },
+                { vt_mode, L"\x0301z\r\n" },
+                { classic_mode, L"\x1b[31m\tq" },
+                { vt_mode, L"\x1b]2;t\x07w" },
+            };
+
+            ULONG id = 620;
+            for (const auto& write : writes)
+            {
+                state.set_output_mode(write.mode);
+                if (!write_console_user_defined_w(comm, state, host_io, info, write.text, id++))
+                {
+                    return false;
+                }
+            }
+
+            const std::wstring line(200, L'.');
+            for (size_t i = 0; i < oc::condrv::ServerState::deferred_output_limit / line.size() + 10; ++i)
+            {
+                if (!write_console_user_defined_w(comm, state, host_io, info, i % 97 == 0 ? L"\x1b[7m" + line + L"\x1b[0m" : line, id++))
+                {
+                    return false;
+                }
+            }
+
+            state.flush_deferred_output(host_io);
+            const auto screen_buffer = state.active_screen_buffer();
+            if (screen_buffer == nullptr)
+            {
+                return false;
+            }
+
+            const COORD size = screen_buffer->screen_buffer_size();
+            cells.assign(static_cast<size_t>(size.X) * static_cast<size_t>(size.Y), L'\0');
+            for (SHORT y = 0; y < size.Y; ++y)
+            {
+                (void)screen_buffer->read_output_characters(
+                    COORD{ 0, y },
+                    std::span<wchar_t>(cells.data() + static_cast<size_t>(y) * static_cast<size_t>(size.X), static_cast<size_t>(size.X)));
+            }
+            cells += state.title(false);
+            cursor = screen_buffer->cursor_position();
+            return true;
+        };
+
+        std::wstring immediate_cells;
+        std::wstring deferred_cells;
+        COORD immediate_cursor{};
+        COORD deferred_cursor{};
+        return run(false, immediate_cells, immediate_cursor) && run(true, deferred_cells, deferred_cursor) &&
+               immediate_cells == deferred_cells && immediate_cursor.X == deferred_cursor.X && immediate_cursor.Y == deferred_cursor.Y;
+    }
+
     bool test_write_console_vt_csi_save_restore_cursor_state()
     {
         MemoryComm comm{};
@@ -9921,6 +10123,8 @@ bool run_condrv_raw_io_tests()
         { L"test_raw_write_rejects_input_handle", test_raw_write_rejects_input_handle },
         { L"test_user_defined_write_console_a_forwards_bytes", test_user_defined_write_console_a_forwards_bytes },
         { L"test_user_defined_write_console_w_utf8_encodes", test_user_defined_write_console_w_utf8_encodes },
+        { L"test_user_defined_write_console_w_empty_payload_succeeds", test_user_defined_write_console_w_empty_payload_succeeds },
+        { L"test_user_defined_write_console_w_transcodes_non_ascii_into_reused_scratch", test_user_defined_write_console_w_transcodes_non_ascii_into_reused_scratch },
         { L"test_user_defined_write_console_a_updates_screen_buffer_model", test_user_defined_write_console_a_updates_screen_buffer_model },
         { L"test_user_defined_write_console_w_updates_screen_buffer_model", test_user_defined_write_console_w_updates_screen_buffer_model },
         { L"test_write_console_newline_auto_return_resets_column", test_write_console_newline_auto_return_resets_column },
@@ -9949,6 +10153,8 @@ bool run_condrv_raw_io_tests()
         { L"test_write_console_vt_split_dcs_string_is_consumed", test_write_console_vt_split_dcs_string_is_consumed },
         { L"test_write_console_vt_dsr_cpr_injects_response_into_input_queue", test_write_console_vt_dsr_cpr_injects_response_into_input_queue },
         { L"test_write_console_vt_dsr_cpr_respects_host_query_policy", test_write_console_vt_dsr_cpr_respects_host_query_policy },
+        { L"test_passthrough_write_console_defers_mirroring_until_read_back", test_passthrough_write_console_defers_mirroring_until_read_back },
+        { L"test_passthrough_deferred_mirroring_matches_immediate_mirroring", test_passthrough_deferred_mirroring_matches_immediate_mirroring },
         { L"test_write_console_vt_csi_save_restore_cursor_state", test_write_console_vt_csi_save_restore_cursor_state },
         { L"test_write_console_vt_decsc_decrc_save_restore_cursor_state", test_write_console_vt_decsc_decrc_save_restore_cursor_state },
         { L"test_write_console_vt_dectcem_toggles_cursor_visibility", test_write_console_vt_dectcem_toggles_cursor_visibility },
@@ -2,6 +2,8 @@
 
 #include "condrv/condrv_server.hpp"
 
+#include <string_view>
+
 namespace
 {
     [[nodiscard]] std::shared_ptr<oc::condrv::ScreenBuffer> make_buffer(const COORD size)
@@ -172,12 +174,109 @@ namespace
         const auto rev2 = buffer->revision();
         return rev2 > rev1;
     }
+
+    bool test_incremental_snapshot_matches_full_rebuild()
+    {
+        auto buffer = make_buffer(COORD{ 10, 5 });
+        if (!buffer || !buffer->set_window_rect(SMALL_RECT{ 2, 1, 6, 3 }))
+        {
+            return false;
+        }
+
+        auto previous = oc::condrv::make_viewport_snapshot(*buffer);
+        oc::condrv::ScreenDamage damage;
+        if (!previous || !buffer->collect_damage(0, damage))
+        {
+            return false;
+        }
+
+        // One change inside the viewport, one beside it on a viewport row, one outside it entirely.
+        const uint64_t since = damage.revision;
+        if (!buffer->write_cell(COORD{ 3, 2 }, L'Q', 0x1E) || !buffer->write_cell(COORD{ 9, 1 }, L'R', 0x07) ||
+            buffer->fill_output_attributes(COORD{ 0, 4 }, 0x4F, 10) != 10 || !buffer->collect_damage(since, damage))
+        {
+            return false;
+        }
+
+        auto incremental = oc::condrv::make_viewport_snapshot(*buffer, *previous.value(), damage);
+        auto full = oc::condrv::make_viewport_snapshot(*buffer);
+        if (!incremental || !full)
+        {
+            return false;
+        }
+
+        const auto& inc = *incremental.value();
+        const auto& ref = *full.value();
+        return inc.revision == ref.revision && inc.text == ref.text && inc.attributes == ref.attributes &&
+               inc.text[1 * 5 + 1] == L'Q' && inc.attributes[1 * 5 + 1] == 0x1E;
+    }
+
+    bool test_snapshot_carries_clusters()
+    {
+        auto buffer = make_buffer(COORD{ 10, 5 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        // Clusters on two rows; the second row is then rewritten after the first snapshot.
+        oc::condrv::NullHostIo host_io{};
+        constexpr ULONG mode = ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+        oc::condrv::apply_text_to_screen_buffer(*buffer, L"a\xD83D\xDC4D\xD83C\xDFFD\r\n\r\ne\x0301", mode, nullptr, &host_io);
+
+        auto previous = oc::condrv::make_viewport_snapshot(*buffer);
+        oc::condrv::ScreenDamage damage;
+        if (!previous || !buffer->collect_damage(0, damage))
+        {
+            return false;
+        }
+
+        const auto& first = *previous.value();
+        if (first.clusters.size() != 2 || first.clusters[0].cell != 1 || first.clusters[1].cell != 2 * 10 ||
+            std::wstring_view(first.cluster_text.data(), first.cluster_text.size()) != L"\xD83D\xDC4D\xD83C\xDFFD" L"e\x0301")
+        {
+            return false;
+        }
+
+        const uint64_t since = damage.revision;
+        oc::condrv::apply_text_to_screen_buffer(*buffer, L"\x1b[3;1Hxo\x0308", mode, nullptr, &host_io);
+        if (!buffer->collect_damage(since, damage))
+        {
+            return false;
+        }
+
+        auto incremental = oc::condrv::make_viewport_snapshot(*buffer, first, damage);
+        auto full = oc::condrv::make_viewport_snapshot(*buffer);
+        if (!incremental || !full)
+        {
+            return false;
+        }
+
+        const auto& inc = *incremental.value();
+        const auto& ref = *full.value();
+        if (inc.clusters.size() != ref.clusters.size() || inc.cluster_text != ref.cluster_text || inc.text != ref.text)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < inc.clusters.size(); ++i)
+        {
+            if (inc.clusters[i].cell != ref.clusters[i].cell || inc.clusters[i].offset != ref.clusters[i].offset ||
+                inc.clusters[i].length != ref.clusters[i].length)
+            {
+                return false;
+            }
+        }
+
+        return inc.clusters.size() == 2 && inc.clusters[1].cell == 2 * 10 + 1 &&
+               std::wstring_view(inc.cluster_text.data(), inc.cluster_text.size()) == L"\xD83D\xDC4D\xD83C\xDFFDo\x0308";
+    }
 }
 
 bool run_condrv_screen_buffer_snapshot_tests()
 {
     return test_viewport_snapshot_reads_correct_subrect() &&
            test_snapshot_includes_attributes_and_color_table() &&
-           test_revision_increments_on_mutation();
+           test_revision_increments_on_mutation() &&
+           test_incremental_snapshot_matches_full_rebuild() &&
+           test_snapshot_carries_clusters();
 }
-
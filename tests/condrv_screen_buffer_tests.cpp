@@ -0,0 +1,1674 @@
+#include "condrv/condrv_server.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    [[nodiscard]] std::shared_ptr<oc::condrv::ScreenBuffer> make_buffer(const COORD size)
+    {
+        auto settings = oc::condrv::ScreenBuffer::default_settings();
+        settings.buffer_size = size;
+        settings.window_size = size;
+        settings.maximum_window_size = size;
+
+        auto created = oc::condrv::ScreenBuffer::create(settings);
+        if (!created)
+        {
+            return {};
+        }
+
+        return std::move(created.value());
+    }
+
+    [[nodiscard]] std::wstring read_row(const oc::condrv::ScreenBuffer& buffer, const SHORT row)
+    {
+        std::wstring text(static_cast<size_t>(buffer.screen_buffer_size().X), L'\0');
+        const size_t read = buffer.read_output_characters(COORD{ 0, row }, text);
+        text.resize(read);
+        return text;
+    }
+
+    // Fills row `y` with the letter `'a' + y`, so every row is recognizable after it moves.
+    [[nodiscard]] bool seed_rows(oc::condrv::ScreenBuffer& buffer)
+    {
+        const COORD size = buffer.screen_buffer_size();
+        for (SHORT y = 0; y < size.Y; ++y)
+        {
+            if (buffer.fill_output_characters(COORD{ 0, y }, static_cast<wchar_t>(L'a' + y), static_cast<size_t>(size.X)) !=
+                static_cast<size_t>(size.X))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    [[nodiscard]] bool rows_equal(const oc::condrv::ScreenBuffer& buffer, const std::wstring_view expected_letters)
+    {
+        const auto width = static_cast<size_t>(buffer.screen_buffer_size().X);
+        for (size_t y = 0; y < expected_letters.size(); ++y)
+        {
+            if (read_row(buffer, static_cast<SHORT>(y)) != std::wstring(width, expected_letters[y]))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    [[nodiscard]] bool scroll_full_buffer(oc::condrv::ScreenBuffer& buffer, const SHORT lines)
+    {
+        const COORD size = buffer.screen_buffer_size();
+        const SMALL_RECT full{ 0, 0, static_cast<SHORT>(size.X - 1), static_cast<SHORT>(size.Y - 1) };
+        const SMALL_RECT source = lines > 0
+            ? SMALL_RECT{ 0, lines, full.Right, full.Bottom }
+            : SMALL_RECT{ 0, 0, full.Right, static_cast<SHORT>(full.Bottom + lines) };
+        const COORD destination{ 0, lines > 0 ? SHORT{ 0 } : static_cast<SHORT>(-lines) };
+        return buffer.scroll_screen_buffer(source, full, destination, L'.', 0x07);
+    }
+
+    bool test_full_buffer_scroll_up_rotates_rows()
+    {
+        auto buffer = make_buffer(COORD{ 4, 5 });
+        if (!buffer || !seed_rows(*buffer))
+        {
+            return false;
+        }
+
+        if (!scroll_full_buffer(*buffer, 2) || !rows_equal(*buffer, L"cde.."))
+        {
+            return false;
+        }
+
+        // A second scroll wraps the ring past its physical end.
+        return scroll_full_buffer(*buffer, 2) && rows_equal(*buffer, L"e....");
+    }
+
+    bool test_full_buffer_scroll_down_rotates_rows()
+    {
+        auto buffer = make_buffer(COORD{ 4, 5 });
+        if (!buffer || !seed_rows(*buffer))
+        {
+            return false;
+        }
+
+        return scroll_full_buffer(*buffer, -1) && rows_equal(*buffer, L".abcd") &&
+               scroll_full_buffer(*buffer, 2) && rows_equal(*buffer, L"bcd..");
+    }
+
+    bool test_linear_access_spans_the_ring_wrap()
+    {
+        auto buffer = make_buffer(COORD{ 3, 3 });
+        if (!buffer || !seed_rows(*buffer) || !scroll_full_buffer(*buffer, 1))
+        {
+            return false;
+        }
+
+        // Logical rows are now b, c, '.'; physically the blank row sits at the front.
+        const std::wstring_view text = L"1234567";
+        if (buffer->write_output_characters(COORD{ 2, 0 }, text) != text.size())
+        {
+            return false;
+        }
+
+        std::wstring all(9, L'\0');
+        if (buffer->read_output_characters(COORD{ 0, 0 }, all) != 9 || all != L"bb1234567")
+        {
+            return false;
+        }
+
+        // Linear runs stop at the logical end of the buffer.
+        return buffer->fill_output_characters(COORD{ 1, 2 }, L'z', 100) == 2 && read_row(*buffer, 2) == L"5zz";
+    }
+
+    bool test_partial_region_scroll_keeps_other_rows()
+    {
+        auto buffer = make_buffer(COORD{ 4, 5 });
+        if (!buffer || !seed_rows(*buffer))
+        {
+            return false;
+        }
+
+        // Rows 1..3 scroll up by one; rows 0 and 4 are outside the clip.
+        const SMALL_RECT clip{ 0, 1, 3, 3 };
+        return buffer->scroll_screen_buffer(SMALL_RECT{ 0, 2, 3, 3 }, clip, COORD{ 0, 1 }, L'.', 0x07) &&
+               rows_equal(*buffer, L"acd.e");
+    }
+
+    bool test_resize_and_alternate_screen_preserve_rotated_rows()
+    {
+        auto buffer = make_buffer(COORD{ 4, 5 });
+        if (!buffer || !seed_rows(*buffer) || !scroll_full_buffer(*buffer, 2))
+        {
+            return false;
+        }
+
+        if (!buffer->set_vt_using_alternate_screen_buffer(true, L' ', 0x07) || !seed_rows(*buffer) || !scroll_full_buffer(*buffer, 1))
+        {
+            return false;
+        }
+
+        // Resizing while the alternate screen is active resizes only the alternate screen.
+        if (!buffer->set_screen_buffer_size(COORD{ 2, 4 }) || read_row(*buffer, 0) != L"bb" || read_row(*buffer, 3) != L"ee")
+        {
+            return false;
+        }
+
+        if (!buffer->set_vt_using_alternate_screen_buffer(false, L' ', 0x07))
+        {
+            return false;
+        }
+
+        const COORD size = buffer->screen_buffer_size();
+        return size.X == 4 && size.Y == 5 && rows_equal(*buffer, L"cde..");
+    }
+
+    bool test_alternate_screen_is_viewport_sized_and_reuses_storage()
+    {
+        auto settings = oc::condrv::ScreenBuffer::default_settings();
+        settings.buffer_size = COORD{ 10, 50 };
+        settings.window_size = COORD{ 10, 4 };
+        settings.maximum_window_size = COORD{ 10, 50 };
+        auto created = oc::condrv::ScreenBuffer::create(settings);
+        if (!created)
+        {
+            return false;
+        }
+
+        auto& buffer = *created.value();
+        const SMALL_RECT main_window{ 0, 20, 9, 23 };
+        if (!buffer.set_window_rect(main_window) || !buffer.write_cell(COORD{ 2, 30 }, L'm', 0x07))
+        {
+            return false;
+        }
+
+        const auto same_rect = [](const SMALL_RECT a, const SMALL_RECT b) noexcept {
+            return a.Left == b.Left && a.Top == b.Top && a.Right == b.Right && a.Bottom == b.Bottom;
+        };
+
+        // The alternate screen covers the viewport, with its own window at the origin.
+        if (!buffer.set_vt_using_alternate_screen_buffer(true, L' ', 0x07) || buffer.screen_buffer_size().X != 10 ||
+            buffer.screen_buffer_size().Y != 4 || !same_rect(buffer.window_rect(), SMALL_RECT{ 0, 0, 9, 3 }) ||
+            !buffer.write_cell(COORD{ 0, 1 }, L'x', 0x07) || buffer.materialized_row_count() != 1)
+        {
+            return false;
+        }
+
+        if (!buffer.set_vt_using_alternate_screen_buffer(false, L' ', 0x07) || buffer.screen_buffer_size().Y != 50 ||
+            !same_rect(buffer.window_rect(), main_window) || read_row(buffer, 30) != L"  m       ")
+        {
+            return false;
+        }
+
+        // Re-entering at the same size reuses the alternate rows, which read blank again.
+        return buffer.set_vt_using_alternate_screen_buffer(true, L'-', 0x07) && buffer.materialized_row_count() == 1 &&
+               rows_equal(buffer, L"----");
+    }
+
+    // Collects the damage since `since` and checks that exactly the rows in `expected_rows` are dirty.
+    [[nodiscard]] bool collect_rows(
+        oc::condrv::ScreenBuffer& buffer,
+        const uint64_t since,
+        oc::condrv::ScreenDamage& damage,
+        const std::initializer_list<SHORT> expected_rows)
+    {
+        if (!buffer.collect_damage(since, damage))
+        {
+            return false;
+        }
+
+        for (SHORT row = 0; row < buffer.screen_buffer_size().Y; ++row)
+        {
+            if (damage.row_dirty(row) != (std::find(expected_rows.begin(), expected_rows.end(), row) != expected_rows.end()))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    [[nodiscard]] bool extent_is(const oc::condrv::ScreenDamage& damage, const SHORT row, const SHORT left, const SHORT right) noexcept
+    {
+        return damage.extents[static_cast<size_t>(row)].left == left && damage.extents[static_cast<size_t>(row)].right == right;
+    }
+
+    bool test_initial_collection_reports_everything()
+    {
+        auto buffer = make_buffer(COORD{ 4, 3 });
+        oc::condrv::ScreenDamage damage;
+        if (!buffer || !collect_rows(*buffer, 0, damage, { 0, 1, 2 }))
+        {
+            return false;
+        }
+
+        if (!damage.all_rows || !damage.viewport || !damage.cursor || !damage.palette || !extent_is(damage, 1, 0, 3))
+        {
+            return false;
+        }
+
+        // Nothing changed since.
+        return buffer->collect_damage(damage.revision, damage) && damage.empty();
+    }
+
+    bool test_cell_writes_damage_touched_columns()
+    {
+        auto buffer = make_buffer(COORD{ 8, 4 });
+        oc::condrv::ScreenDamage damage;
+        if (!buffer || !buffer->collect_damage(0, damage))
+        {
+            return false;
+        }
+
+        const uint64_t since = damage.revision;
+        const CHAR_INFO records[2]{};
+        if (!buffer->write_cell(COORD{ 5, 0 }, L'a', 0x07) || !buffer->write_cell(COORD{ 2, 0 }, L'b', 0x07) ||
+            buffer->write_output_characters(COORD{ 6, 1 }, std::wstring_view(L"wxyz")) != 4 ||
+            buffer->write_output_char_info_rect(SMALL_RECT{ 3, 3, 4, 3 }, records, true) != 2)
+        {
+            return false;
+        }
+
+        // The linear write wraps from row 1 into row 2.
+        if (!collect_rows(*buffer, since, damage, { 0, 1, 2, 3 }) || damage.all_rows || damage.cursor || damage.viewport)
+        {
+            return false;
+        }
+
+        if (!extent_is(damage, 0, 2, 5) || !extent_is(damage, 1, 6, 7) || !extent_is(damage, 2, 0, 1) || !extent_is(damage, 3, 3, 4))
+        {
+            return false;
+        }
+
+        // Inserting shifts the rest of the row.
+        const uint64_t after_writes = damage.revision;
+        return buffer->insert_cell(COORD{ 1, 2 }, L'i', 0x07) && collect_rows(*buffer, after_writes, damage, { 2 }) &&
+               extent_is(damage, 2, 1, 7);
+    }
+
+    bool test_attribute_writes_are_attribute_only()
+    {
+        auto buffer = make_buffer(COORD{ 6, 3 });
+        oc::condrv::ScreenDamage damage;
+        if (!buffer || !buffer->collect_damage(0, damage))
+        {
+            return false;
+        }
+
+        const uint64_t since = damage.revision;
+        const USHORT attributes[2]{ 0x1F, 0x2F };
+        if (buffer->fill_output_attributes(COORD{ 0, 0 }, 0x4F, 3) != 3 ||
+            buffer->write_output_attributes(COORD{ 4, 1 }, attributes) != 2 ||
+            buffer->fill_output_characters(COORD{ 0, 2 }, L'c', 1) != 1)
+        {
+            return false;
+        }
+
+        if (!collect_rows(*buffer, since, damage, { 0, 1, 2 }) || !damage.row_attribute_only(0) || !damage.row_attribute_only(1) ||
+            damage.row_attribute_only(2))
+        {
+            return false;
+        }
+
+        // A later text change in the same row clears the attribute-only classification.
+        const uint64_t after_attributes = damage.revision;
+        return buffer->write_cell(COORD{ 5, 0 }, L'x', 0x4F) && collect_rows(*buffer, since, damage, { 0, 1, 2 }) &&
+               !damage.row_attribute_only(0) && collect_rows(*buffer, after_attributes, damage, { 0 }) && !damage.row_attribute_only(0);
+    }
+
+    bool test_state_changes_do_not_damage_rows()
+    {
+        auto buffer = make_buffer(COORD{ 6, 4 });
+        oc::condrv::ScreenDamage damage;
+        if (!buffer || !buffer->collect_damage(0, damage))
+        {
+            return false;
+        }
+
+        uint64_t since = damage.revision;
+        buffer->set_cursor_position(COORD{ 3, 2 });
+        buffer->set_cursor_info(50, false);
+        if (!collect_rows(*buffer, since, damage, {}) || !damage.cursor || damage.viewport || damage.palette || damage.all_rows)
+        {
+            return false;
+        }
+
+        since = damage.revision;
+        if (!buffer->set_window_size(COORD{ 3, 2 }) || !buffer->set_window_rect(SMALL_RECT{ 1, 1, 3, 2 }))
+        {
+            return false;
+        }
+        if (!collect_rows(*buffer, since, damage, {}) || !damage.viewport || damage.cursor)
+        {
+            return false;
+        }
+
+        since = damage.revision;
+        const COLORREF table[16]{};
+        buffer->set_color_table(table);
+        buffer->set_text_attributes(0x1E);
+        return collect_rows(*buffer, since, damage, {}) && damage.palette && !damage.viewport && !damage.cursor;
+    }
+
+    bool test_scroll_damage()
+    {
+        auto buffer = make_buffer(COORD{ 4, 5 });
+        oc::condrv::ScreenDamage damage;
+        if (!buffer || !seed_rows(*buffer) || !buffer->collect_damage(0, damage))
+        {
+            return false;
+        }
+
+        // A rotation moves every row.
+        uint64_t since = damage.revision;
+        if (!scroll_full_buffer(*buffer, 1) || !collect_rows(*buffer, since, damage, { 0, 1, 2, 3, 4 }) || !damage.all_rows ||
+            !extent_is(damage, 2, 0, 3))
+        {
+            return false;
+        }
+
+        // A clipped region scroll only damages the vacated and destination cells inside the clip.
+        since = damage.revision;
+        const SMALL_RECT clip{ 1, 1, 2, 3 };
+        return buffer->scroll_screen_buffer(SMALL_RECT{ 0, 2, 3, 3 }, clip, COORD{ 0, 1 }, L'.', 0x07) &&
+               collect_rows(*buffer, since, damage, { 1, 2, 3 }) && !damage.all_rows && extent_is(damage, 1, 1, 2) &&
+               extent_is(damage, 3, 1, 2);
+    }
+
+    bool test_resize_and_alternate_screen_damage_all_rows()
+    {
+        auto buffer = make_buffer(COORD{ 4, 3 });
+        oc::condrv::ScreenDamage damage;
+        if (!buffer || !buffer->collect_damage(0, damage))
+        {
+            return false;
+        }
+
+        uint64_t since = damage.revision;
+        if (!buffer->set_vt_using_alternate_screen_buffer(true, L' ', 0x07) || !collect_rows(*buffer, since, damage, { 0, 1, 2 }) ||
+            !damage.all_rows || !damage.cursor)
+        {
+            return false;
+        }
+
+        since = damage.revision;
+        if (!buffer->set_vt_using_alternate_screen_buffer(false, L' ', 0x07) || !buffer->collect_damage(since, damage) ||
+            !damage.all_rows || !damage.palette)
+        {
+            return false;
+        }
+
+        since = damage.revision;
+        return buffer->set_screen_buffer_size(COORD{ 6, 5 }) && collect_rows(*buffer, since, damage, { 0, 1, 2, 3, 4 }) &&
+               damage.all_rows && damage.viewport && extent_is(damage, 4, 0, 5);
+    }
+
+    bool test_consumers_at_different_generations()
+    {
+        auto buffer = make_buffer(COORD{ 8, 2 });
+        oc::condrv::ScreenDamage fast;
+        oc::condrv::ScreenDamage slow;
+        if (!buffer || !buffer->collect_damage(0, fast))
+        {
+            return false;
+        }
+
+        const uint64_t slow_since = fast.revision;
+        if (!buffer->write_cell(COORD{ 1, 0 }, L'a', 0x07) || !buffer->collect_damage(fast.revision, fast) || !extent_is(fast, 0, 1, 1))
+        {
+            return false;
+        }
+
+        // The fast consumer sees only the new column; the slow one must still cover column 1.
+        const uint64_t fast_since = fast.revision;
+        if (!buffer->write_cell(COORD{ 5, 0 }, L'b', 0x07) || !collect_rows(*buffer, fast_since, fast, { 0 }) ||
+            !extent_is(fast, 0, 5, 5) || !collect_rows(*buffer, slow_since, slow, { 0 }))
+        {
+            return false;
+        }
+
+        const auto extent = slow.extents[0];
+        return extent.left <= 1 && extent.right >= 5;
+    }
+
+    // Reads the whole buffer as CHAR_INFO records.
+    [[nodiscard]] std::vector<CHAR_INFO> read_all(const oc::condrv::ScreenBuffer& buffer)
+    {
+        const COORD size = buffer.screen_buffer_size();
+        std::vector<CHAR_INFO> records(static_cast<size_t>(size.X) * static_cast<size_t>(size.Y));
+        const SMALL_RECT region{ 0, 0, static_cast<SHORT>(size.X - 1), static_cast<SHORT>(size.Y - 1) };
+        if (buffer.read_output_char_info_rect(region, records, true) != records.size())
+        {
+            records.clear();
+        }
+        return records;
+    }
+
+    [[nodiscard]] bool same_contents(const oc::condrv::ScreenBuffer& left, const oc::condrv::ScreenBuffer& right)
+    {
+        const auto left_records = read_all(left);
+        const auto right_records = read_all(right);
+        if (left_records.empty() || left_records.size() != right_records.size())
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < left_records.size(); ++i)
+        {
+            if (left_records[i].Char.UnicodeChar != right_records[i].Char.UnicodeChar ||
+                left_records[i].Attributes != right_records[i].Attributes)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool test_untouched_rows_are_not_materialized()
+    {
+        auto buffer = make_buffer(COORD{ 120, 9001 });
+        if (!buffer || buffer->materialized_row_count() != 0)
+        {
+            return false;
+        }
+
+        std::wstring text(4, L'\0');
+        std::array<USHORT, 4> attributes{};
+        if (buffer->read_output_characters(COORD{ 118, 500 }, text) != 4 || text != L"    " ||
+            buffer->read_output_attributes(COORD{ 0, 9000 }, attributes) != 4 || attributes[3] != 0x07)
+        {
+            return false;
+        }
+
+        // Whole-row fills, rotations and alternate-screen switches keep rows blank.
+        if (buffer->fill_output_characters(COORD{ 0, 10 }, L'=', 240) != 240 || read_row(*buffer, 11) != std::wstring(120, L'=') ||
+            !scroll_full_buffer(*buffer, 1) || !buffer->set_vt_using_alternate_screen_buffer(true, L' ', 0x07) ||
+            !buffer->set_vt_using_alternate_screen_buffer(false, L' ', 0x07) || buffer->materialized_row_count() != 0)
+        {
+            return false;
+        }
+
+        // A partial write materializes only its row.
+        return buffer->write_cell(COORD{ 3, 9 }, L'x', 0x1E) && buffer->materialized_row_count() == 1 &&
+               read_row(*buffer, 9) == std::wstring(3, L'=') + L"x" + std::wstring(116, L'=');
+    }
+
+    bool test_blank_rows_read_like_materialized_rows()
+    {
+        auto lazy = make_buffer(COORD{ 6, 5 });
+        auto eager = make_buffer(COORD{ 6, 5 });
+        if (!lazy || !eager)
+        {
+            return false;
+        }
+
+        // Rewriting each cell with its own value materializes every row without changing contents.
+        for (SHORT y = 0; y < 5; ++y)
+        {
+            if (!eager->write_cell(COORD{ 0, y }, L' ', 0x07))
+            {
+                return false;
+            }
+        }
+
+        const auto apply = [](oc::condrv::ScreenBuffer& buffer) {
+            buffer.set_text_attributes(0x1E);
+            return buffer.fill_output_attributes(COORD{ 0, 1 }, 0x2F, 6) == 6 &&
+                   buffer.fill_output_characters(COORD{ 4, 2 }, L'-', 5) == 5 &&
+                   scroll_full_buffer(buffer, 2) &&
+                   buffer.scroll_screen_buffer(SMALL_RECT{ 0, 0, 5, 1 }, SMALL_RECT{ 1, 0, 4, 4 }, COORD{ 0, 2 }, L'#', 0x30) &&
+                   buffer.set_screen_buffer_size(COORD{ 9, 6 }) &&
+                   buffer.set_screen_buffer_size(COORD{ 4, 6 });
+        };
+
+        if (eager->materialized_row_count() != 5 || !apply(*lazy) || !apply(*eager) || !same_contents(*lazy, *eager))
+        {
+            return false;
+        }
+
+        // Growing added a row with the new text attributes. Reflow keeps spare cell storage on blank
+        // rows, so the lazy buffer never holds more than the eager one.
+        const auto records = read_all(*lazy);
+        return records.size() == 24 && records[23].Attributes == 0x1E &&
+               lazy->materialized_row_count() <= eager->materialized_row_count();
+    }
+
+    [[nodiscard]] bool cursor_at(const oc::condrv::ScreenBuffer& buffer, const SHORT x, const SHORT y) noexcept
+    {
+        const COORD cursor = buffer.cursor_position();
+        return cursor.X == x && cursor.Y == y;
+    }
+
+    bool test_reflow_round_trips_wrapped_lines()
+    {
+        auto buffer = make_buffer(COORD{ 8, 6 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        // Without VT processing the ninth character wraps immediately; the line feed ends the line.
+        oc::condrv::NullHostIo host_io{};
+        oc::condrv::apply_text_to_screen_buffer(
+            *buffer, L"abcdefghijkl\r\nxy", ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT, nullptr, &host_io);
+        if (!buffer->row_wrapped(0) || buffer->row_wrapped(1) || !cursor_at(*buffer, 2, 2))
+        {
+            return false;
+        }
+
+        if (!buffer->set_screen_buffer_size(COORD{ 5, 6 }) ||
+            read_row(*buffer, 0) != L"abcde" || read_row(*buffer, 1) != L"fghij" || read_row(*buffer, 2) != L"kl   " ||
+            read_row(*buffer, 3) != L"xy   " || !buffer->row_wrapped(0) || !buffer->row_wrapped(1) || buffer->row_wrapped(2) ||
+            !cursor_at(*buffer, 2, 3))
+        {
+            return false;
+        }
+
+        if (!buffer->set_screen_buffer_size(COORD{ 12, 6 }) ||
+            read_row(*buffer, 0) != L"abcdefghijkl" || read_row(*buffer, 1) != L"xy          " || buffer->row_wrapped(0) ||
+            !cursor_at(*buffer, 2, 1))
+        {
+            return false;
+        }
+
+        return buffer->set_screen_buffer_size(COORD{ 8, 6 }) &&
+               read_row(*buffer, 0) == L"abcdefgh" && read_row(*buffer, 1) == L"ijkl    " && read_row(*buffer, 2) == L"xy      " &&
+               buffer->row_wrapped(0) && !buffer->row_wrapped(1) && cursor_at(*buffer, 2, 2);
+    }
+
+    bool test_reflow_wraps_long_rows_and_scrolls_off_the_top()
+    {
+        auto buffer = make_buffer(COORD{ 6, 3 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        // Rows written through the cell APIs never wrap, so each is its own line. The cursor sits
+        // just past the second line's text.
+        if (buffer->write_output_characters(COORD{ 0, 0 }, std::wstring_view{ L"abcdef" }) != 6 ||
+            buffer->write_output_characters(COORD{ 0, 1 }, std::wstring_view{ L"ghi" }) != 3)
+        {
+            return false;
+        }
+        buffer->set_cursor_position(COORD{ 3, 1 });
+
+        // Four rows at width 3 ("abc", "def", "ghi", and the cursor's) in a buffer of three.
+        if (!buffer->set_screen_buffer_size(COORD{ 3, 3 }) ||
+            read_row(*buffer, 0) != L"def" || read_row(*buffer, 1) != L"ghi" || read_row(*buffer, 2) != L"   " ||
+            buffer->row_wrapped(0) || !buffer->row_wrapped(1) || !cursor_at(*buffer, 0, 2))
+        {
+            return false;
+        }
+
+        const SMALL_RECT window = buffer->window_rect();
+        return window.Top == 0 && window.Bottom == 2;
+    }
+
+    bool test_reflow_extends_trailing_background()
+    {
+        auto buffer = make_buffer(COORD{ 4, 2 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        if (buffer->fill_output_attributes(COORD{ 0, 0 }, 0x2F, 4) != 4 ||
+            buffer->write_output_characters(COORD{ 0, 0 }, std::wstring_view{ L"ab" }) != 2 ||
+            !buffer->set_screen_buffer_size(COORD{ 6, 2 }))
+        {
+            return false;
+        }
+
+        const auto records = read_all(*buffer);
+        return records.size() == 12 && records[1].Char.UnicodeChar == L'b' && records[5].Attributes == 0x2F &&
+               records[11].Attributes == 0x07 && !buffer->row_wrapped(0);
+    }
+
+    [[nodiscard]] bool same_linear_reads(const oc::condrv::ScreenBuffer& left, const oc::condrv::ScreenBuffer& right)
+    {
+        const COORD size = left.screen_buffer_size();
+        const size_t cells = static_cast<size_t>(size.X) * static_cast<size_t>(size.Y);
+        std::wstring left_text(cells, L'\0');
+        std::wstring right_text(cells, L'\0');
+        std::vector<USHORT> left_attributes(cells);
+        std::vector<USHORT> right_attributes(cells);
+        std::vector<std::byte> left_bytes(cells);
+        std::vector<std::byte> right_bytes(cells);
+        return left.read_output_characters(COORD{ 0, 0 }, left_text) == cells &&
+               right.read_output_characters(COORD{ 0, 0 }, right_text) == cells && left_text == right_text &&
+               left.read_output_attributes(COORD{ 0, 0 }, left_attributes) == cells &&
+               right.read_output_attributes(COORD{ 0, 0 }, right_attributes) == cells && left_attributes == right_attributes &&
+               left.read_output_ascii(COORD{ 0, 0 }, left_bytes) == cells &&
+               right.read_output_ascii(COORD{ 0, 0 }, right_bytes) == cells && left_bytes == right_bytes;
+    }
+
+    bool test_scrollback_rows_compact_and_read_identically()
+    {
+        // Same buffer, but only `compact` has a window that scrollback can leave.
+        auto settings = oc::condrv::ScreenBuffer::default_settings();
+        settings.buffer_size = COORD{ 20, 40 };
+        settings.window_size = COORD{ 20, 5 };
+        settings.maximum_window_size = settings.buffer_size;
+        auto compact_created = oc::condrv::ScreenBuffer::create(settings);
+        settings.window_size = settings.buffer_size;
+        auto eager_created = oc::condrv::ScreenBuffer::create(settings);
+        if (!compact_created || !eager_created)
+        {
+            return false;
+        }
+
+        auto& compact = *compact_created.value();
+        auto& eager = *eager_created.value();
+        oc::condrv::NullHostIo host_io{};
+        const auto write = [&](const std::wstring_view text, const USHORT attributes) {
+            for (auto* const buffer : { &compact, &eager })
+            {
+                buffer->set_text_attributes(attributes);
+                oc::condrv::apply_text_to_screen_buffer(*buffer, text, ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT, nullptr, &host_io);
+            }
+        };
+
+        // 60 lines overflow the 40-row buffer, so rows both leave the window and rotate. Lines mix
+        // attribute runs, Latin-1, a CJK character and a line too colorful to encode.
+        for (int line = 0; line < 60; ++line)
+        {
+            write(L"build step ", 0x07);
+            write(std::to_wstring(line), static_cast<USHORT>(0x0A + line % 3));
+            if (line % 7 == 0)
+            {
+                write(L" caf\u00E9", 0x1F);
+            }
+            if (line % 11 == 0)
+            {
+                write(L" \u4E2D", 0x07);
+            }
+            if (line % 13 == 0)
+            {
+                for (USHORT run = 0; run < 9; ++run)
+                {
+                    write(L"x", static_cast<USHORT>(0x01 + run));
+                }
+            }
+            write(L"\r\n", 0x07);
+        }
+
+        if (compact.compact_row_count() == 0 || eager.compact_row_count() != 0 ||
+            compact.materialized_row_count() >= eager.materialized_row_count() ||
+            !same_contents(compact, eager) || !same_linear_reads(compact, eager))
+        {
+            return false;
+        }
+
+        // Writes promote compact rows; scrolls read them as sources; resizes reflow them.
+        for (auto* const buffer : { &compact, &eager })
+        {
+            if (!buffer->write_cell(COORD{ 3, 0 }, L'#', 0x4E) ||
+                !buffer->scroll_screen_buffer(SMALL_RECT{ 2, 1, 17, 6 }, SMALL_RECT{ 0, 0, 19, 39 }, COORD{ 4, 20 }, L'.', 0x03))
+            {
+                return false;
+            }
+        }
+        if (!same_contents(compact, eager) || !same_linear_reads(compact, eager))
+        {
+            return false;
+        }
+
+        for (const COORD size : { COORD{ 13, 40 }, COORD{ 31, 40 }, COORD{ 20, 40 } })
+        {
+            if (!compact.set_screen_buffer_size(size) || !eager.set_screen_buffer_size(size) ||
+                !same_contents(compact, eager) || !same_linear_reads(compact, eager) ||
+                compact.cursor_position().X != eager.cursor_position().X || compact.cursor_position().Y != eager.cursor_position().Y)
+            {
+                return false;
+            }
+        }
+
+        return compact.compact_row_count() != 0;
+    }
+
+    bool test_materialized_compact_row_releases_its_encoding()
+    {
+        auto settings = oc::condrv::ScreenBuffer::default_settings();
+        settings.buffer_size = COORD{ 20, 40 };
+        settings.window_size = COORD{ 20, 5 };
+        settings.maximum_window_size = settings.buffer_size;
+        auto created = oc::condrv::ScreenBuffer::create(settings);
+        if (!created)
+        {
+            return false;
+        }
+
+        auto& buffer = *created.value();
+        oc::condrv::NullHostIo host_io{};
+        for (int line = 0; line < 10; ++line)
+        {
+            const std::wstring text = L"line " + std::to_wstring(line) + L"\r\n";
+            oc::condrv::apply_text_to_screen_buffer(buffer, text, ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT, nullptr, &host_io);
+        }
+
+        const size_t compact_rows = buffer.compact_row_count();
+        if (compact_rows == 0 || buffer.compact_storage_row_count() != compact_rows)
+        {
+            return false;
+        }
+
+        // Row 0 scrolled out first; writing to it brings back its cells and frees the encoding.
+        if (!buffer.write_cell(COORD{ 0, 0 }, L'#', 0x07) || buffer.compact_row_count() != compact_rows - 1 ||
+            buffer.compact_storage_row_count() != compact_rows - 1)
+        {
+            return false;
+        }
+
+        const auto records = read_all(buffer);
+        return records.size() > 1 && records[0].Char.UnicodeChar == L'#' && records[1].Char.UnicodeChar == L'i';
+    }
+
+    bool test_sgr_interns_extended_attributes()
+    {
+        auto buffer = make_buffer(COORD{ 8, 2 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        oc::condrv::NullHostIo host_io{};
+        const auto apply = [&](const std::wstring_view text) {
+            oc::condrv::apply_text_to_screen_buffer(
+                *buffer, text, ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING, nullptr, &host_io);
+        };
+
+        // Truecolor red plus italic is interned; the classic word is the nearest palette entry.
+        apply(L"\x1b[38;2;255;0;0;3mAB");
+        const USHORT id = buffer->text_attributes();
+        const auto interned = buffer->attribute(id);
+        if ((id & oc::condrv::extended_attribute_bit) == 0 ||
+            interned.flags != (oc::condrv::TextAttribute::foreground_rgb | oc::condrv::TextAttribute::italic) ||
+            interned.foreground != 0x0000FF || interned.legacy != buffer->legacy_attributes(id))
+        {
+            return false;
+        }
+
+        // Resetting both properties returns to a classic word; repeating the sequence reuses the entry.
+        apply(L"\x1b[23;39mC\x1b[38;2;255;0;0;3mD");
+        const USHORT legacy = interned.legacy;
+        std::array<USHORT, 4> attributes{};
+        if (buffer->interned_attribute_count() != 1 || buffer->text_attributes() != id ||
+            buffer->read_output_attributes(COORD{ 0, 0 }, attributes) != 4 ||
+            attributes != std::array<USHORT, 4>{ legacy, legacy, 0x07, legacy })
+        {
+            return false;
+        }
+
+        // ICH moves cells with their IDs, and the classic reads still flatten them.
+        apply(L"\r\x1b[@");
+        if (read_row(*buffer, 0) != L" ABCD   " || buffer->read_output_attributes(COORD{ 0, 0 }, attributes) != 4 ||
+            attributes != std::array<USHORT, 4>{ legacy, legacy, legacy, 0x07 })
+        {
+            return false;
+        }
+
+        // A client word with the ID bit set is not mistaken for the interned entry.
+        const USHORT client[1]{ oc::condrv::extended_attribute_bit };
+        USHORT read_back{ 0xFFFF };
+        return buffer->write_output_attributes(COORD{ 0, 1 }, client) == 1 &&
+               buffer->read_output_attributes(COORD{ 0, 1 }, std::span<USHORT>(&read_back, 1)) == 1 && read_back == 0;
+    }
+
+    [[nodiscard]] std::vector<USHORT> read_attributes(const oc::condrv::ScreenBuffer& buffer, const SHORT row)
+    {
+        std::vector<USHORT> attributes(static_cast<size_t>(buffer.screen_buffer_size().X));
+        attributes.resize(buffer.read_output_attributes(COORD{ 0, row }, attributes));
+        return attributes;
+    }
+
+    bool test_wide_glyphs_take_two_cells_and_wrap()
+    {
+        auto buffer = make_buffer(COORD{ 6, 3 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        oc::condrv::NullHostIo host_io{};
+        constexpr USHORT lead = 0x07 | COMMON_LVB_LEADING_BYTE;
+        constexpr USHORT trail = 0x07 | COMMON_LVB_TRAILING_BYTE;
+
+        // Classic wrapping: the row fills exactly, and the next glyph starts a new line.
+        oc::condrv::apply_text_to_screen_buffer(*buffer, L"a中文b", ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT, nullptr, &host_io);
+        if (read_row(*buffer, 0) != L"a中中文文b" ||
+            read_attributes(*buffer, 0) != std::vector<USHORT>{ 0x07, lead, trail, lead, trail, 0x07 } ||
+            buffer->cursor_position().X != 0 || buffer->cursor_position().Y != 1 || !buffer->row_wrapped(0))
+        {
+            return false;
+        }
+
+        // A glyph that does not fit in the last column moves to the next line whole.
+        oc::condrv::apply_text_to_screen_buffer(*buffer, L"abcde字", ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT, nullptr, &host_io);
+        if (read_row(*buffer, 1) != L"abcde " || read_row(*buffer, 2) != L"字字    " || !buffer->row_wrapped(1) ||
+            buffer->cursor_position().X != 2 || buffer->cursor_position().Y != 2)
+        {
+            return false;
+        }
+
+        // VT: a glyph ending in the last column sets the delayed wrap like any other.
+        auto vt = make_buffer(COORD{ 4, 2 });
+        if (!vt)
+        {
+            return false;
+        }
+        constexpr ULONG vt_mode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+        oc::condrv::apply_text_to_screen_buffer(*vt, L"ab中", vt_mode, nullptr, &host_io);
+        if (read_row(*vt, 0) != L"ab中中" || vt->cursor_position().X != 3 || vt->cursor_position().Y != 0)
+        {
+            return false;
+        }
+        oc::condrv::apply_text_to_screen_buffer(*vt, L"c", vt_mode, nullptr, &host_io);
+        return read_row(*vt, 1) == L"c   " && vt->cursor_position().X == 1 && vt->cursor_position().Y == 1;
+    }
+
+    bool test_overwriting_half_of_a_wide_glyph_blanks_the_other()
+    {
+        auto buffer = make_buffer(COORD{ 6, 1 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        oc::condrv::NullHostIo host_io{};
+        const auto apply = [&](const std::wstring_view text) {
+            oc::condrv::apply_text_to_screen_buffer(*buffer, text, ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING, nullptr, &host_io);
+        };
+
+        constexpr USHORT lead = 0x07 | COMMON_LVB_LEADING_BYTE;
+        constexpr USHORT trail = 0x07 | COMMON_LVB_TRAILING_BYTE;
+        const std::vector<USHORT> plain(6, 0x07);
+
+        // Over the trailing half, then over the leading half.
+        apply(L"中文\x1b[1;2Hx\x1b[1;3Hy");
+        if (read_row(*buffer, 0) != L" xy   " || read_attributes(*buffer, 0) != plain)
+        {
+            return false;
+        }
+
+        // A wide glyph straddling two others breaks both.
+        apply(L"\r中文\x1b[1;2H字");
+        if (read_row(*buffer, 0) != L" 字字   " || read_attributes(*buffer, 0) != std::vector<USHORT>{ 0x07, lead, trail, 0x07, 0x07, 0x07 })
+        {
+            return false;
+        }
+
+        // ICH inside a glyph splits it, and a glyph pushed half off the end loses its leading half.
+        apply(L"\r中文ab\x1b[1;2H\x1b[@");
+        if (read_row(*buffer, 0) != L"   文文a" || read_attributes(*buffer, 0) != std::vector<USHORT>{ 0x07, 0x07, 0x07, lead, trail, 0x07 })
+        {
+            return false;
+        }
+        apply(L"\x1b[2@");
+        if (read_row(*buffer, 0) != L"      " || read_attributes(*buffer, 0) != plain)
+        {
+            return false;
+        }
+
+        // DCH inside a glyph removes the half left behind.
+        apply(L"\r中文ab\x1b[1;2H\x1b[P");
+        return read_row(*buffer, 0) == L" 文文ab " && read_attributes(*buffer, 0) == std::vector<USHORT>{ 0x07, lead, trail, 0x07, 0x07, 0x07 };
+    }
+
+    bool test_character_writes_break_wide_glyphs()
+    {
+        auto buffer = make_buffer(COORD{ 6, 1 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        oc::condrv::NullHostIo host_io{};
+        const auto apply = [&](const std::wstring_view text) {
+            oc::condrv::apply_text_to_screen_buffer(*buffer, text, ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING, nullptr, &host_io);
+        };
+
+        constexpr USHORT lead = 0x07 | COMMON_LVB_LEADING_BYTE;
+        constexpr USHORT trail = 0x07 | COMMON_LVB_TRAILING_BYTE;
+        const std::vector<USHORT> plain(6, 0x07);
+
+        // Over a trailing half, a leading half, then a trailing half again, one API each.
+        apply(L"中文字");
+        if (buffer->write_output_characters(COORD{ 1, 0 }, std::wstring_view{ L"b" }) != 1 || read_row(*buffer, 0) != L" b文文字字" ||
+            read_attributes(*buffer, 0) != std::vector<USHORT>{ 0x07, 0x07, lead, trail, lead, trail })
+        {
+            return false;
+        }
+        if (buffer->fill_output_characters(COORD{ 2, 0 }, L'c', 1) != 1 || read_row(*buffer, 0) != L" bc 字字" ||
+            read_attributes(*buffer, 0) != std::vector<USHORT>{ 0x07, 0x07, 0x07, 0x07, lead, trail })
+        {
+            return false;
+        }
+        const std::byte d[1]{ std::byte{ 'd' } };
+        if (buffer->write_output_ascii(COORD{ 5, 0 }, d) != 1 || read_row(*buffer, 0) != L" bc  d" || read_attributes(*buffer, 0) != plain)
+        {
+            return false;
+        }
+
+        // A span covering whole glyphs leaves no width flags behind, and one splitting two breaks both.
+        apply(L"\r中文字");
+        return buffer->write_output_characters(COORD{ 1, 0 }, std::wstring_view{ L"wxyz" }) == 4 && read_row(*buffer, 0) == L" wxyz " &&
+               read_attributes(*buffer, 0) == plain;
+    }
+
+    bool test_read_console_output_characters_skips_trailing_halves()
+    {
+        auto buffer = make_buffer(COORD{ 6, 2 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        oc::condrv::NullHostIo host_io{};
+        oc::condrv::apply_text_to_screen_buffer(
+            *buffer, L"a中b\xD83D\xDE00", ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING, nullptr, &host_io);
+
+        // Six cells read back as five units: the BMP glyph once, the pair as its two units.
+        std::wstring text(6, L'\0');
+        text.resize(buffer->read_console_output_characters(COORD{ 0, 0 }, text));
+        if (text != L"a中b\xD83D\xDE00")
+        {
+            return false;
+        }
+
+        // A read starting on a trailing half skips it, and cells past the first row count as read.
+        text.assign(8, L'\0');
+        text.resize(buffer->read_console_output_characters(COORD{ 2, 0 }, text));
+        return text == L"b\xD83D\xDE00    ";
+    }
+
+    bool test_reflow_keeps_wide_glyphs_whole()
+    {
+        auto buffer = make_buffer(COORD{ 6, 3 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        // With VT the cursor waits at the last column, so the row does not wrap.
+        oc::condrv::NullHostIo host_io{};
+        oc::condrv::apply_text_to_screen_buffer(
+            *buffer, L"a中文b", ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING, nullptr, &host_io);
+
+        // Width 4 would end the first row between the halves of 文: the row ends a cell early,
+        // padded with the fill cell, and the glyph starts the next one.
+        constexpr USHORT lead = 0x07 | COMMON_LVB_LEADING_BYTE;
+        constexpr USHORT trail = 0x07 | COMMON_LVB_TRAILING_BYTE;
+        return buffer->set_screen_buffer_size(COORD{ 4, 3 }) && read_row(*buffer, 0) == L"a中中 " && read_row(*buffer, 1) == L"文文b " &&
+               read_attributes(*buffer, 0) == std::vector<USHORT>{ 0x07, lead, trail, 0x07 } &&
+               read_attributes(*buffer, 1) == std::vector<USHORT>{ lead, trail, 0x07, 0x07 } && buffer->row_wrapped(0) &&
+               !buffer->row_wrapped(1) && cursor_at(*buffer, 2, 1);
+    }
+
+    bool test_clipping_a_wide_glyph_blanks_its_leading_half()
+    {
+        auto buffer = make_buffer(COORD{ 6, 2 });
+        if (!buffer || !buffer->set_vt_using_alternate_screen_buffer(true, L' ', 0x07))
+        {
+            return false;
+        }
+
+        // The alternate screen is clipped rather than reflowed; cutting 中 in two leaves neither half.
+        oc::condrv::NullHostIo host_io{};
+        oc::condrv::apply_text_to_screen_buffer(*buffer, L"ab中", ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING, nullptr, &host_io);
+        return buffer->set_screen_buffer_size(COORD{ 3, 2 }) && read_row(*buffer, 0) == L"ab " &&
+               read_attributes(*buffer, 0) == std::vector<USHORT>{ 0x07, 0x07, 0x07 };
+    }
+
+    bool test_wide_surrogate_pairs_and_classic_reads()
+    {
+        auto buffer = make_buffer(COORD{ 6, 1 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        oc::condrv::NullHostIo host_io{};
+        // U+1F600 reads back one unit from each half; the narrow U+1D400 takes one cell, which
+        // reads as its first unit.
+        oc::condrv::apply_text_to_screen_buffer(
+            *buffer, L"\x1b[38;2;255;0;0m\xD83D\xDE00\x1b[0m\xD835\xDC00", ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING, nullptr, &host_io);
+        if (read_row(*buffer, 0) != L"\xD83D\xDE00\xD835   " || buffer->cursor_position().X != 3)
+        {
+            return false;
+        }
+
+        std::vector<oc::condrv::ScreenBuffer::OutputCluster> clusters;
+        if (!buffer->read_output_clusters(COORD{ 0, 0 }, 6, clusters) || clusters.size() != 2 || clusters[0].offset != 0 ||
+            clusters[0].text != L"\xD83D\xDE00" || clusters[1].offset != 2 || clusters[1].text != L"\xD835\xDC00")
+        {
+            return false;
+        }
+
+        // `ReadConsoleOutput` reports the half flags next to the classic view of the interned color.
+        CHAR_INFO records[4]{};
+        if (buffer->read_output_char_info_rect(SMALL_RECT{ 0, 0, 3, 0 }, records, true) != 4)
+        {
+            return false;
+        }
+        const USHORT red = buffer->legacy_attributes(buffer->intern_attribute(oc::condrv::TextAttribute{
+            .legacy = 0x0C, .flags = oc::condrv::TextAttribute::foreground_rgb, .foreground = 0x0000FF }));
+        return records[0].Char.UnicodeChar == 0xD83D && records[0].Attributes == (red | COMMON_LVB_LEADING_BYTE) &&
+               records[1].Char.UnicodeChar == 0xDE00 && records[1].Attributes == (red | COMMON_LVB_TRAILING_BYTE) &&
+               records[2].Attributes == 0x07 && records[3].Attributes == 0x07;
+    }
+
+    // The text of the glyph in cell `column` of row 0.
+    [[nodiscard]] std::wstring glyph_text(const oc::condrv::ScreenBuffer& buffer, const SHORT column)
+    {
+        std::vector<oc::condrv::ScreenBuffer::OutputCluster> clusters;
+        if (buffer.read_output_clusters(COORD{ column, 0 }, 1, clusters) && clusters.size() == 1)
+        {
+            return std::wstring(clusters[0].text);
+        }
+
+        wchar_t character{};
+        return buffer.read_output_characters(COORD{ column, 0 }, std::span<wchar_t>(&character, 1)) == 1 ? std::wstring(1, character) : std::wstring{};
+    }
+
+    bool test_clusters_hold_combining_and_emoji_sequences()
+    {
+        auto buffer = make_buffer(COORD{ 12, 2 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        oc::condrv::NullHostIo host_io{};
+        constexpr ULONG mode = ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+        // e + acute, a ZWJ family, thumbs up + skin tone, the US flag, then x.
+        oc::condrv::apply_text_to_screen_buffer(
+            *buffer,
+            L"e\x0301"
+            L"\xD83D\xDC68\x200D\xD83D\xDC69\x200D\xD83D\xDC67"
+            L"\xD83D\xDC4D\xD83C\xDFFD"
+            L"\xD83C\xDDFA\xD83C\xDDF8"
+            L"x",
+            mode,
+            nullptr,
+            &host_io);
+
+        if (read_row(*buffer, 0) != L"e\xD83D\xDC68\xD83D\xDC4D\xD83C\xDDFAx    " || buffer->cursor_position().X != 8 ||
+            glyph_text(*buffer, 0) != L"e\x0301" ||
+            glyph_text(*buffer, 1) != L"\xD83D\xDC68\x200D\xD83D\xDC69\x200D\xD83D\xDC67" ||
+            glyph_text(*buffer, 3) != L"\xD83D\xDC4D\xD83C\xDFFD" || glyph_text(*buffer, 5) != L"\xD83C\xDDFA\xD83C\xDDF8" ||
+            glyph_text(*buffer, 7) != L"x")
+        {
+            return false;
+        }
+
+        // Equal glyphs share an entry: e + acute, the two-unit family members and flags so far.
+        const size_t interned = buffer->interned_cluster_count();
+        oc::condrv::apply_text_to_screen_buffer(*buffer, L"\r\ne\x0301", mode, nullptr, &host_io);
+        if (buffer->interned_cluster_count() != interned || glyph_text(*buffer, 0) != L"e\x0301")
+        {
+            return false;
+        }
+
+        // A mark after the cursor moved, or at the start of a write, takes a cell of its own.
+        oc::condrv::apply_text_to_screen_buffer(*buffer, L"\x1b[1;1Ha\x1b[C\x0301", mode, nullptr, &host_io);
+        if (glyph_text(*buffer, 0) != L"a" || glyph_text(*buffer, 2) != L"\x0301")
+        {
+            return false;
+        }
+
+        // Overwriting a cluster with a plain character leaves a plain cell.
+        oc::condrv::apply_text_to_screen_buffer(*buffer, L"\x1b[1;4Hzz", mode, nullptr, &host_io);
+        std::vector<oc::condrv::ScreenBuffer::OutputCluster> clusters;
+        return buffer->read_output_clusters(COORD{ 3, 0 }, 2, clusters) && clusters.empty() && read_row(*buffer, 0).substr(3, 2) == L"zz";
+    }
+
+    bool test_mark_after_wrapped_glyph_joins_it()
+    {
+        auto buffer = make_buffer(COORD{ 4, 2 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        // Without VT processing the cursor wraps right after the last column, before the mark.
+        oc::condrv::NullHostIo host_io{};
+        oc::condrv::apply_text_to_screen_buffer(*buffer, L"abce\x0301z", ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT, nullptr, &host_io);
+        return glyph_text(*buffer, 3) == L"e\x0301" && read_row(*buffer, 1) == L"z   " && buffer->cursor_position().X == 1;
+    }
+
+    bool test_client_surrogates_read_back_unchanged()
+    {
+        auto buffer = make_buffer(COORD{ 8, 2 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        // Surrogate units written through the classic APIs, paired or not, round-trip unit by unit.
+        const std::wstring units = L"a\xD83D\xDE00\xDC00" L"b\xD800";
+        if (buffer->write_output_characters(COORD{ 0, 0 }, units) != units.size() || read_row(*buffer, 0) != units + L"  ")
+        {
+            return false;
+        }
+
+        if (buffer->fill_output_characters(COORD{ 0, 1 }, static_cast<wchar_t>(0xDBFF), 8) != 8 ||
+            read_row(*buffer, 1) != std::wstring(8, static_cast<wchar_t>(0xDBFF)))
+        {
+            return false;
+        }
+
+        CHAR_INFO records[2]{};
+        records[0].Char.UnicodeChar = static_cast<wchar_t>(0xDC01);
+        records[0].Attributes = 0x07;
+        records[1].Char.UnicodeChar = L'q';
+        records[1].Attributes = 0x07;
+        if (buffer->write_output_char_info_rect(SMALL_RECT{ 6, 0, 7, 0 }, records, true) != 2)
+        {
+            return false;
+        }
+
+        return read_row(*buffer, 0) == L"a\xD83D\xDE00\xDC00" L"b\xD800\xDC01q" && buffer->interned_cluster_count() == 6;
+    }
+
+    bool test_full_cluster_table_reclaims_unreferenced_entries()
+    {
+        auto buffer = make_buffer(COORD{ 4, 2 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        // More distinct clusters than the table holds, each overwriting the last in one cell. Only
+        // the one on screen stays referenced.
+        oc::condrv::NullHostIo host_io{};
+        std::wstring text;
+        std::wstring last;
+        for (wchar_t base = L'A'; base <= L'Z'; ++base)
+        {
+            for (wchar_t mark = 0x0300; mark < 0x0370; ++mark)
+            {
+                last = std::wstring{ base, mark };
+                text = L"\r" + last;
+                oc::condrv::apply_text_to_screen_buffer(*buffer, text, ENABLE_PROCESSED_OUTPUT, nullptr, &host_io);
+                if (glyph_text(*buffer, 0) != last)
+                {
+                    return false;
+                }
+            }
+        }
+
+        return 26 * 0x70 > oc::condrv::ClusterTable::max_entries && buffer->cluster_collections() != 0 &&
+               buffer->interned_cluster_count() <= oc::condrv::ClusterTable::max_entries &&
+               buffer->cluster_storage_bytes() < 64 * 1024;
+    }
+
+    bool test_full_attribute_table_reclaims_unreferenced_entries()
+    {
+        auto buffer = make_buffer(COORD{ 4, 2 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        oc::condrv::NullHostIo host_io{};
+        const auto apply = [&](const std::wstring_view text) {
+            oc::condrv::apply_text_to_screen_buffer(*buffer, text, ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING, nullptr, &host_io);
+        };
+
+        // One cell keeps its color throughout.
+        apply(L"\x1b[2;1H\x1b[38;2;1;2;3mK");
+
+        // More distinct colors than the table holds, each overwriting the last in one cell. The
+        // foreground and background are set by separate sequences; only the state the text is
+        // written with is interned.
+        constexpr size_t colors = 2 * oc::condrv::AttributeTable::max_entries;
+        for (size_t i = 0; i < colors; ++i)
+        {
+            const auto red = static_cast<unsigned>(i & 0xFF);
+            const auto green = static_cast<unsigned>(i >> 8);
+            apply(L"\x1b[1;1H\x1b[38;2;" + std::to_wstring(red) + L";" + std::to_wstring(green) + L";9m\x1b[48;2;4;5;6mX");
+            const auto written = buffer->attribute(buffer->cell_attribute_id(COORD{ 0, 0 }));
+            if (written.foreground != (red | (green << 8) | (9u << 16)) || written.background != 0x060504)
+            {
+                return false;
+            }
+        }
+
+        const auto kept = buffer->attribute(buffer->cell_attribute_id(COORD{ 0, 1 }));
+        return (kept.flags & oc::condrv::TextAttribute::foreground_rgb) != 0 && kept.foreground == 0x030201 &&
+               (kept.flags & oc::condrv::TextAttribute::background_rgb) == 0 && buffer->attribute_collections() != 0 &&
+               buffer->interned_attribute_count() <= oc::condrv::AttributeTable::max_entries;
+    }
+
+    // Plain runs are stored a row at a time. Text written one code unit per call never forms a run,
+    // so it is the per-character reference: both must leave identical cells, cursor and wrap flags
+    // under every output mode, IRM, DECAWM and cursor moves between runs.
+    bool test_plain_runs_match_per_character_writes()
+    {
+        constexpr COORD size{ 11, 4 };
+        auto batched = make_buffer(size);
+        auto single = make_buffer(size);
+        if (!batched || !single)
+        {
+            return false;
+        }
+
+        oc::condrv::NullHostIo host_io{};
+        uint64_t state = 0x2A11ULL;
+        const auto next = [&](const size_t bound) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            return static_cast<size_t>((state >> 33) % bound);
+        };
+
+        constexpr std::wstring_view pieces[] = {
+            L"\r\n", L"\r", L"\t", L"\b", L"\x7F", L"\x85", L"中", L"\x1b[4h", L"\x1b[4l", L"\x1b[?7l", L"\x1b[?7h",
+            L"\x1b[2;5H", L"\x1b[1;10H", L"\x1b[31m", L"\x1b[38;2;1;2;3m", L"\x1b[0m", L"\x1b[2P", L"\x1b[3@",
+        };
+        constexpr ULONG modes[] = {
+            ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING,
+            ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT,
+            ENABLE_PROCESSED_OUTPUT,
+            ENABLE_WRAP_AT_EOL_OUTPUT,
+        };
+
+        for (int iteration = 0; iteration < 400; ++iteration)
+        {
+            const ULONG mode = modes[next(std::size(modes))];
+            std::wstring text;
+            for (size_t piece = 0; piece < 6; ++piece)
+            {
+                if (next(2) == 0)
+                {
+                    text += pieces[next(std::size(pieces))];
+                    continue;
+                }
+                for (size_t length = 1 + next(30); length > 0; --length)
+                {
+                    text.push_back(next(4) == 0 ? static_cast<wchar_t>(0xA0 + next(0x260)) : static_cast<wchar_t>(L' ' + next(0x5F)));
+                }
+            }
+
+            oc::condrv::apply_text_to_screen_buffer(*batched, text, mode, nullptr, &host_io);
+            for (const wchar_t unit : text)
+            {
+                oc::condrv::apply_text_to_screen_buffer(*single, std::wstring_view(&unit, 1), mode, nullptr, &host_io);
+            }
+
+            const COORD batched_cursor = batched->cursor_position();
+            const COORD single_cursor = single->cursor_position();
+            if (batched_cursor.X != single_cursor.X || batched_cursor.Y != single_cursor.Y ||
+                batched->vt_delayed_wrap_position().has_value() != single->vt_delayed_wrap_position().has_value())
+            {
+                fwprintf(stderr, L"[DETAIL] cursor diverged (iteration=%d)\n", iteration);
+                return false;
+            }
+            for (SHORT y = 0; y < size.Y; ++y)
+            {
+                if (read_row(*batched, y) != read_row(*single, y) || read_attributes(*batched, y) != read_attributes(*single, y) ||
+                    batched->row_wrapped(y) != single->row_wrapped(y))
+                {
+                    fwprintf(stderr, L"[DETAIL] row %d diverged (iteration=%d)\n", static_cast<int>(y), iteration);
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // Reference for `scroll_screen_buffer`: the original copy-everything algorithm. It saves the
+    // source rectangle, fills its clipped part, then writes each saved cell to its clipped
+    // destination.
+    void reference_scroll(
+        std::vector<CHAR_INFO>& cells,
+        const COORD size,
+        const SMALL_RECT scroll,
+        const SMALL_RECT clip,
+        const COORD destination,
+        const wchar_t fill_character,
+        const USHORT fill_attributes)
+    {
+        const auto index = [&](const long x, const long y) {
+            return static_cast<size_t>(y) * static_cast<size_t>(size.X) + static_cast<size_t>(x);
+        };
+        const auto clip_contains = [&](const long x, const long y) {
+            return x >= clip.Left && x <= clip.Right && y >= clip.Top && y <= clip.Bottom;
+        };
+
+        std::vector<CHAR_INFO> saved;
+        for (long y = scroll.Top; y <= scroll.Bottom; ++y)
+        {
+            for (long x = scroll.Left; x <= scroll.Right; ++x)
+            {
+                saved.push_back(cells[index(x, y)]);
+                if (clip_contains(x, y))
+                {
+                    cells[index(x, y)].Char.UnicodeChar = fill_character;
+                    cells[index(x, y)].Attributes = fill_attributes;
+                }
+            }
+        }
+
+        size_t next = 0;
+        for (long y = scroll.Top; y <= scroll.Bottom; ++y)
+        {
+            for (long x = scroll.Left; x <= scroll.Right; ++x)
+            {
+                const long dx = x + destination.X - scroll.Left;
+                const long dy = y + destination.Y - scroll.Top;
+                if (dx >= 0 && dy >= 0 && dx < size.X && dy < size.Y && clip_contains(dx, dy))
+                {
+                    cells[index(dx, dy)] = saved[next];
+                }
+                ++next;
+            }
+        }
+    }
+
+    bool test_csi_forms_without_handlers_are_ignored()
+    {
+        auto buffer = make_buffer(COORD{ 8, 2 });
+        if (!buffer)
+        {
+            return false;
+        }
+
+        // xterm's `CSI > Ps ; Ps m` (key modifiers) is not SGR, `CSI Ps ; Ps $ r` is not DECSTBM
+        // and `CSI 38 : ...` sub-parameters are malformed here; none of them may touch the buffer.
+        // A control inside a sequence still runs.
+        oc::condrv::NullHostIo host_io{};
+        oc::condrv::apply_text_to_screen_buffer(
+            *buffer,
+            L"A\x1b[>4;1mB\x1b[1;2$rC\x1b[38:2:255:0:0mD\x1b[2\r;6HE",
+            ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING,
+            nullptr,
+            &host_io);
+        const auto attributes = read_attributes(*buffer, 0);
+        return read_row(*buffer, 0) == L"ABCD    " && read_row(*buffer, 1) == L"     E  " &&
+               std::ranges::all_of(attributes, [](const USHORT value) { return value == 0x07; }) &&
+               !buffer->vt_vertical_margins().has_value();
+    }
+
+    // UTF-8 output is parsed on the bytes and decoded a run at a time. Cut at random bytes, it must
+    // leave the same cells, attributes and cursor as the same output written as UTF-16 in one call:
+    // sequences, C1 controls and code points split across writes, and marks after a run longer than
+    // the decode buffer.
+    bool test_utf8_output_matches_utf16_output()
+    {
+        constexpr COORD size{ 23, 6 };
+        auto wide = make_buffer(size);
+        auto utf8 = make_buffer(size);
+        if (!wide || !utf8)
+        {
+            return false;
+        }
+
+        // The row's cells, with each cluster's text after them.
+        const auto row_text = [&](const oc::condrv::ScreenBuffer& buffer, const SHORT y) {
+            std::wstring text = read_row(buffer, y);
+            std::vector<oc::condrv::ScreenBuffer::OutputCluster> clusters;
+            if (buffer.read_output_clusters(COORD{ 0, y }, static_cast<size_t>(size.X), clusters))
+            {
+                for (const auto& cluster : clusters)
+                {
+                    text += L"|" + std::to_wstring(cluster.offset) + L":";
+                    text += cluster.text;
+                }
+            }
+            return text;
+        };
+
+        oc::condrv::NullHostIo host_io{};
+        uint64_t state = 0x7F8ULL;
+        const auto next = [&](const size_t bound) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            return static_cast<size_t>((state >> 33) % bound);
+        };
+
+        const struct
+        {
+            std::wstring_view wide;
+            std::string_view utf8;
+        } pieces[] = {
+            { L"\r\n", "\r\n" },
+            { L"\t", "\t" },
+            { L"\x7F", "\x7F" },
+            { L"\x1b[31m", "\x1b[31m" },
+            { L"\x1b[38;2;1;2;3m", "\x1b[38;2;1;2;3m" },
+            { L"\x1b[0m", "\x1b[0m" },
+            { L"\x1b[2;5H", "\x1b[2;5H" },
+            { L"\x9b" L"1;9H", "\xC2\x9B" "1;9H" },
+            { L"\x85", "\xC2\x85" },
+            { L"\x1b]2;t\x00E9\x07", "\x1b]2;t\xC3\xA9\x07" },
+            { L"\x4E2D", "\xE4\xB8\xAD" },
+            { L"\xD83D\xDE00", "\xF0\x9F\x98\x80" },
+            { L"\x00E9t\x00E9", "\xC3\xA9t\xC3\xA9" },
+        };
+        constexpr ULONG modes[] = {
+            ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING,
+            ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT,
+        };
+
+        for (int iteration = 0; iteration < 300; ++iteration)
+        {
+            const ULONG mode = modes[next(std::size(modes))];
+            std::wstring text;
+            std::string bytes;
+            if (iteration % 50 == 0)
+            {
+                // Longer than one decoded run, with marks right around where it is cut.
+                const size_t length = 2040 + next(10);
+                text.assign(length, L'x');
+                bytes.assign(length, 'x');
+                text += L"e\x0301\x0302\x4E2D\x0301";
+                bytes += "e\xCC\x81\xCC\x82\xE4\xB8\xAD\xCC\x81";
+            }
+            for (size_t piece = 0; piece < 8; ++piece)
+            {
+                const auto& chosen = pieces[next(std::size(pieces))];
+                text += chosen.wide;
+                bytes += chosen.utf8;
+                if (next(2) == 0)
+                {
+                    const auto letter = static_cast<char>('a' + next(26));
+                    text.push_back(static_cast<wchar_t>(letter));
+                    bytes.push_back(letter);
+                }
+            }
+
+            oc::condrv::apply_text_to_screen_buffer(*wide, text, mode, nullptr, &host_io);
+            for (size_t offset = 0; offset < bytes.size();)
+            {
+                // Glyphs are not extended across writes, so marks are only written in one piece.
+                const size_t length = iteration % 50 == 0 ? bytes.size() : std::min(bytes.size() - offset, 1 + next(7));
+                oc::condrv::apply_utf8_to_screen_buffer(*utf8, std::string_view(bytes).substr(offset, length), mode, nullptr, &host_io);
+                offset += length;
+            }
+
+            const COORD wide_cursor = wide->cursor_position();
+            const COORD utf8_cursor = utf8->cursor_position();
+            if (wide_cursor.X != utf8_cursor.X || wide_cursor.Y != utf8_cursor.Y)
+            {
+                fwprintf(stderr, L"[DETAIL] cursor diverged (iteration=%d)\n", iteration);
+                return false;
+            }
+            for (SHORT y = 0; y < size.Y; ++y)
+            {
+                if (row_text(*wide, y) != row_text(*utf8, y) || read_attributes(*wide, y) != read_attributes(*utf8, y))
+                {
+                    fwprintf(stderr, L"[DETAIL] row %d diverged (iteration=%d)\n", static_cast<int>(y), iteration);
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool test_scroll_matches_reference_implementation()
+    {
+        constexpr COORD size{ 13, 11 };
+        auto buffer = make_buffer(size);
+        if (!buffer)
+        {
+            return false;
+        }
+
+        auto model = read_all(*buffer);
+        uint64_t state = 0x5C4011ULL;
+        const auto next = [&](const long bound) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            return static_cast<long>((state >> 33) % static_cast<uint64_t>(bound));
+        };
+
+        for (int iteration = 0; iteration < 2000; ++iteration)
+        {
+            // Mix in writes so the scrolls see partially written, materialized and blank rows.
+            const auto y = static_cast<SHORT>(next(size.Y));
+            if (next(3) == 0)
+            {
+                const auto value = static_cast<wchar_t>(L'a' + next(26));
+                if (buffer->fill_output_characters(COORD{ 0, y }, value, static_cast<size_t>(size.X)) != static_cast<size_t>(size.X))
+                {
+                    return false;
+                }
+                for (size_t x = 0; x < static_cast<size_t>(size.X); ++x)
+                {
+                    model[static_cast<size_t>(y) * static_cast<size_t>(size.X) + x].Char.UnicodeChar = value;
+                }
+            }
+            else
+            {
+                const auto x = static_cast<SHORT>(next(size.X));
+                const auto value = static_cast<wchar_t>(L'A' + next(26));
+                const auto attributes = static_cast<USHORT>(next(0x100));
+                if (!buffer->write_cell(COORD{ x, y }, value, attributes))
+                {
+                    return false;
+                }
+                auto& cell = model[static_cast<size_t>(y) * static_cast<size_t>(size.X) + static_cast<size_t>(x)];
+                cell.Char.UnicodeChar = value;
+                cell.Attributes = attributes;
+            }
+
+            // Rectangles are inside the buffer; the clip and destination may reach past it.
+            const auto left = static_cast<SHORT>(next(size.X));
+            const auto top = static_cast<SHORT>(next(size.Y));
+            const SMALL_RECT scroll{
+                left,
+                top,
+                static_cast<SHORT>(left + next(size.X - left)),
+                static_cast<SHORT>(top + next(size.Y - top)),
+            };
+            const SMALL_RECT clip = next(4) == 0
+                ? SMALL_RECT{ 0, 0, static_cast<SHORT>(size.X - 1), static_cast<SHORT>(size.Y - 1) }
+                : SMALL_RECT{
+                      static_cast<SHORT>(next(size.X + 4) - 2),
+                      static_cast<SHORT>(next(size.Y + 4) - 2),
+                      static_cast<SHORT>(next(size.X + 4) - 2),
+                      static_cast<SHORT>(next(size.Y + 4) - 2),
+                  };
+            const COORD destination{
+                static_cast<SHORT>(next(size.X + 8) - 4),
+                static_cast<SHORT>(next(size.Y + 8) - 4),
+            };
+            const auto fill = static_cast<wchar_t>(L'0' + next(10));
+            const auto fill_attributes = static_cast<USHORT>(next(0x100));
+
+            if (!buffer->scroll_screen_buffer(scroll, clip, destination, fill, fill_attributes))
+            {
+                return false;
+            }
+            reference_scroll(model, size, scroll, clip, destination, fill, fill_attributes);
+
+            const auto actual = read_all(*buffer);
+            if (actual.size() != model.size())
+            {
+                return false;
+            }
+            for (size_t i = 0; i < model.size(); ++i)
+            {
+                if (actual[i].Char.UnicodeChar != model[i].Char.UnicodeChar || actual[i].Attributes != model[i].Attributes)
+                {
+                    fwprintf(stderr, L"[DETAIL] scroll diverged (iteration=%d cell=%zu)\n", iteration, i);
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+}
+
+bool run_condrv_screen_buffer_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_full_buffer_scroll_up_rotates_rows", test_full_buffer_scroll_up_rotates_rows },
+        { L"test_full_buffer_scroll_down_rotates_rows", test_full_buffer_scroll_down_rotates_rows },
+        { L"test_linear_access_spans_the_ring_wrap", test_linear_access_spans_the_ring_wrap },
+        { L"test_partial_region_scroll_keeps_other_rows", test_partial_region_scroll_keeps_other_rows },
+        { L"test_resize_and_alternate_screen_preserve_rotated_rows", test_resize_and_alternate_screen_preserve_rotated_rows },
+        { L"test_alternate_screen_is_viewport_sized_and_reuses_storage", test_alternate_screen_is_viewport_sized_and_reuses_storage },
+        { L"test_initial_collection_reports_everything", test_initial_collection_reports_everything },
+        { L"test_cell_writes_damage_touched_columns", test_cell_writes_damage_touched_columns },
+        { L"test_attribute_writes_are_attribute_only", test_attribute_writes_are_attribute_only },
+        { L"test_state_changes_do_not_damage_rows", test_state_changes_do_not_damage_rows },
+        { L"test_scroll_damage", test_scroll_damage },
+        { L"test_resize_and_alternate_screen_damage_all_rows", test_resize_and_alternate_screen_damage_all_rows },
+        { L"test_consumers_at_different_generations", test_consumers_at_different_generations },
+        { L"test_untouched_rows_are_not_materialized", test_untouched_rows_are_not_materialized },
+        { L"test_blank_rows_read_like_materialized_rows", test_blank_rows_read_like_materialized_rows },
+        { L"test_scroll_matches_reference_implementation", test_scroll_matches_reference_implementation },
+        { L"test_reflow_round_trips_wrapped_lines", test_reflow_round_trips_wrapped_lines },
+        { L"test_reflow_wraps_long_rows_and_scrolls_off_the_top", test_reflow_wraps_long_rows_and_scrolls_off_the_top },
+        { L"test_reflow_extends_trailing_background", test_reflow_extends_trailing_background },
+        { L"test_scrollback_rows_compact_and_read_identically", test_scrollback_rows_compact_and_read_identically },
+        { L"test_materialized_compact_row_releases_its_encoding", test_materialized_compact_row_releases_its_encoding },
+        { L"test_sgr_interns_extended_attributes", test_sgr_interns_extended_attributes },
+        { L"test_wide_glyphs_take_two_cells_and_wrap", test_wide_glyphs_take_two_cells_and_wrap },
+        { L"test_overwriting_half_of_a_wide_glyph_blanks_the_other", test_overwriting_half_of_a_wide_glyph_blanks_the_other },
+        { L"test_character_writes_break_wide_glyphs", test_character_writes_break_wide_glyphs },
+        { L"test_read_console_output_characters_skips_trailing_halves", test_read_console_output_characters_skips_trailing_halves },
+        { L"test_reflow_keeps_wide_glyphs_whole", test_reflow_keeps_wide_glyphs_whole },
+        { L"test_clipping_a_wide_glyph_blanks_its_leading_half", test_clipping_a_wide_glyph_blanks_its_leading_half },
+        { L"test_wide_surrogate_pairs_and_classic_reads", test_wide_surrogate_pairs_and_classic_reads },
+        { L"test_clusters_hold_combining_and_emoji_sequences", test_clusters_hold_combining_and_emoji_sequences },
+        { L"test_mark_after_wrapped_glyph_joins_it", test_mark_after_wrapped_glyph_joins_it },
+        { L"test_client_surrogates_read_back_unchanged", test_client_surrogates_read_back_unchanged },
+        { L"test_full_cluster_table_reclaims_unreferenced_entries", test_full_cluster_table_reclaims_unreferenced_entries },
+        { L"test_full_attribute_table_reclaims_unreferenced_entries", test_full_attribute_table_reclaims_unreferenced_entries },
+        { L"test_plain_runs_match_per_character_writes", test_plain_runs_match_per_character_writes },
+        { L"test_csi_forms_without_handlers_are_ignored", test_csi_forms_without_handlers_are_ignored },
+        { L"test_utf8_output_matches_utf16_output", test_utf8_output_matches_utf16_output },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv screen buffer] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,453 @@
+#include "condrv/screen_cell_span.hpp"
+
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Equivalence tests for the row-span primitives. Each primitive is run on random spans at random
+// offsets (so vector bodies, scalar tails and unaligned starts are all covered) and compared with
+// the per-cell loops `ScreenBuffer` used before the primitives existed. Cells outside the span
+// must be left untouched.
+
+namespace
+{
+    using oc::condrv::ScreenCell;
+
+    constexpr std::uint64_t k_base_seed = 0x43454C4C5350414EULL;
+    constexpr size_t k_iterations = 4'000;
+    constexpr size_t k_capacity = 80;
+
+    class SplitMix64 final
+    {
+    public:
+        explicit SplitMix64(const std::uint64_t seed) noexcept :
+            _state(seed)
+        {
+        }
+
+        [[nodiscard]] std::uint64_t next_u64() noexcept
+        {
+            std::uint64_t z = (_state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        [[nodiscard]] size_t next_size(const size_t max_inclusive) noexcept
+        {
+            return static_cast<size_t>(next_u64() % (static_cast<std::uint64_t>(max_inclusive) + 1ULL));
+        }
+
+        // Mostly ASCII and Latin-1, with code units above 0xFF often enough to hit narrowing.
+        [[nodiscard]] wchar_t next_character() noexcept
+        {
+            const auto value = next_u64();
+            switch (value % 4)
+            {
+            case 0:
+                return static_cast<wchar_t>(0x20 + (value >> 8) % 0x5F);
+            case 1:
+                return static_cast<wchar_t>((value >> 8) % 0x100);
+            default:
+                return static_cast<wchar_t>((value >> 8) & 0xFFFF);
+            }
+        }
+
+        [[nodiscard]] USHORT next_attributes() noexcept
+        {
+            return static_cast<USHORT>(next_u64() & 0xFFFF);
+        }
+
+    private:
+        std::uint64_t _state{};
+    };
+
+    struct Span final
+    {
+        size_t offset{};
+        size_t count{};
+    };
+
+    [[nodiscard]] Span next_span(SplitMix64& rng) noexcept
+    {
+        const size_t offset = rng.next_size(7);
+        return Span{ .offset = offset, .count = rng.next_size(k_capacity - offset) };
+    }
+
+    [[nodiscard]] std::vector<ScreenCell> random_cells(SplitMix64& rng)
+    {
+        std::vector<ScreenCell> cells(k_capacity);
+        for (auto& cell : cells)
+        {
+            cell = ScreenCell{ .character = rng.next_character(), .attributes = rng.next_attributes() };
+        }
+        return cells;
+    }
+
+    [[nodiscard]] bool same_char_info(const CHAR_INFO& left, const CHAR_INFO& right) noexcept
+    {
+        return left.Char.UnicodeChar == right.Char.UnicodeChar && left.Attributes == right.Attributes;
+    }
+
+    [[nodiscard]] wchar_t reference_narrow(const wchar_t value) noexcept
+    {
+        return value <= 0xFF ? value : L'?';
+    }
+
+    [[nodiscard]] bool report(const wchar_t* const primitive, const size_t iteration)
+    {
+        fwprintf(stderr, L"[DETAIL] %ls diverged from the scalar reference (iteration=%zu)\n", primitive, iteration);
+        return false;
+    }
+
+    bool test_fills_match_reference()
+    {
+        SplitMix64 rng(k_base_seed);
+        for (size_t iteration = 0; iteration < k_iterations; ++iteration)
+        {
+            const auto [offset, count] = next_span(rng);
+            const auto original = random_cells(rng);
+            const ScreenCell value{ .character = rng.next_character(), .attributes = rng.next_attributes() };
+
+            auto actual = original;
+            auto expected = original;
+            oc::condrv::fill_cells(actual.data() + offset, count, value);
+            for (size_t i = 0; i < count; ++i)
+            {
+                expected[offset + i] = value;
+            }
+            if (actual != expected)
+            {
+                return report(L"fill_cells", iteration);
+            }
+
+            actual = original;
+            expected = original;
+            oc::condrv::fill_cell_characters(actual.data() + offset, count, value.character);
+            for (size_t i = 0; i < count; ++i)
+            {
+                expected[offset + i].character = value.character;
+            }
+            if (actual != expected)
+            {
+                return report(L"fill_cell_characters", iteration);
+            }
+
+            actual = original;
+            expected = original;
+            oc::condrv::fill_cell_attributes(actual.data() + offset, count, value.attributes);
+            for (size_t i = 0; i < count; ++i)
+            {
+                expected[offset + i].attributes = value.attributes;
+            }
+            if (actual != expected)
+            {
+                return report(L"fill_cell_attributes", iteration);
+            }
+
+            actual = original;
+            expected = original;
+            oc::condrv::clear_cell_attribute_bits(actual.data() + offset, count, value.attributes);
+            for (size_t i = 0; i < count; ++i)
+            {
+                expected[offset + i].attributes = static_cast<USHORT>(expected[offset + i].attributes & ~value.attributes);
+            }
+            if (actual != expected)
+            {
+                return report(L"clear_cell_attribute_bits", iteration);
+            }
+        }
+
+        return true;
+    }
+
+    bool test_stores_match_reference()
+    {
+        SplitMix64 rng(k_base_seed ^ 1);
+        for (size_t iteration = 0; iteration < k_iterations; ++iteration)
+        {
+            const auto [offset, count] = next_span(rng);
+            const auto original = random_cells(rng);
+
+            std::vector<wchar_t> characters(count);
+            std::vector<USHORT> attributes(count);
+            std::vector<std::byte> bytes(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                characters[i] = rng.next_character();
+                attributes[i] = rng.next_attributes();
+                bytes[i] = static_cast<std::byte>(rng.next_u64() & 0xFF);
+            }
+
+            auto actual = original;
+            auto expected = original;
+            oc::condrv::store_cell_characters(actual.data() + offset, characters.data(), count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                expected[offset + i].character = characters[i];
+            }
+            if (actual != expected)
+            {
+                return report(L"store_cell_characters", iteration);
+            }
+
+            actual = original;
+            expected = original;
+            oc::condrv::store_cell_attributes(actual.data() + offset, attributes.data(), count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                expected[offset + i].attributes = attributes[i];
+            }
+            if (actual != expected)
+            {
+                return report(L"store_cell_attributes", iteration);
+            }
+
+            actual = original;
+            expected = original;
+            oc::condrv::store_cell_ascii(actual.data() + offset, bytes.data(), count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                expected[offset + i].character = static_cast<wchar_t>(static_cast<unsigned char>(bytes[i]));
+            }
+            if (actual != expected)
+            {
+                return report(L"store_cell_ascii", iteration);
+            }
+
+            actual = original;
+            expected = original;
+            const USHORT fill = rng.next_attributes();
+            oc::condrv::store_cell_run(actual.data() + offset, characters.data(), count, fill);
+            for (size_t i = 0; i < count; ++i)
+            {
+                expected[offset + i] = ScreenCell{ .character = characters[i], .attributes = fill };
+            }
+            if (actual != expected)
+            {
+                return report(L"store_cell_run", iteration);
+            }
+        }
+
+        return true;
+    }
+
+    bool test_loads_match_reference()
+    {
+        SplitMix64 rng(k_base_seed ^ 2);
+        for (size_t iteration = 0; iteration < k_iterations; ++iteration)
+        {
+            const auto [offset, count] = next_span(rng);
+            const auto cells = random_cells(rng);
+
+            // One sentinel past the span catches overruns.
+            std::vector<wchar_t> characters(count + 1, L'#');
+            oc::condrv::load_cell_characters(characters.data(), cells.data() + offset, count);
+            std::vector<USHORT> attributes(count + 1, 0xBEEF);
+            oc::condrv::load_cell_attributes(attributes.data(), cells.data() + offset, count);
+            std::vector<std::byte> bytes(count + 1, std::byte{ 0xA5 });
+            oc::condrv::load_cell_ascii(bytes.data(), cells.data() + offset, count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                const auto& cell = cells[offset + i];
+                if (characters[i] != cell.character)
+                {
+                    return report(L"load_cell_characters", iteration);
+                }
+                if (attributes[i] != cell.attributes)
+                {
+                    return report(L"load_cell_attributes", iteration);
+                }
+                if (bytes[i] != static_cast<std::byte>(reference_narrow(cell.character)))
+                {
+                    return report(L"load_cell_ascii", iteration);
+                }
+            }
+
+            if (characters[count] != L'#' || attributes[count] != 0xBEEF || bytes[count] != std::byte{ 0xA5 })
+            {
+                return report(L"load_cell_* overrun", iteration);
+            }
+        }
+
+        return true;
+    }
+
+    bool test_find_surrogate_cell_matches_reference()
+    {
+        SplitMix64 rng(k_base_seed ^ 4);
+        for (size_t iteration = 0; iteration < k_iterations; ++iteration)
+        {
+            const auto [offset, count] = next_span(rng);
+            auto cells = random_cells(rng);
+
+            // Random characters hold a surrogate about once per span. Every other span also gets
+            // one planted at a random cell, and attribute words in the surrogate range, which must
+            // not count.
+            if ((iteration & 1) != 0 && count != 0)
+            {
+                cells[offset + rng.next_size(count - 1)].character = static_cast<wchar_t>(0xD800 + rng.next_size(0x7FF));
+            }
+            for (auto& cell : cells)
+            {
+                if ((rng.next_u64() & 3) == 0)
+                {
+                    cell.attributes = static_cast<USHORT>(0xD800 + rng.next_size(0x7FF));
+                }
+            }
+
+            size_t expected = count;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (cells[offset + i].character >= 0xD800 && cells[offset + i].character <= 0xDFFF)
+                {
+                    expected = i;
+                    break;
+                }
+            }
+
+            if (oc::condrv::find_surrogate_cell(cells.data() + offset, count) != expected)
+            {
+                return report(L"find_surrogate_cell", iteration);
+            }
+        }
+
+        return true;
+    }
+
+    bool test_count_plain_characters_matches_reference()
+    {
+        SplitMix64 rng(k_base_seed ^ 5);
+        for (size_t iteration = 0; iteration < k_iterations; ++iteration)
+        {
+            const auto [offset, count] = next_span(rng);
+
+            // Mostly plain units, so runs are long enough to cross vector bodies, and every unit
+            // near the range edges (0x1F/0x20, 0x7E..0xA0, 0x2FF/0x300) often enough to matter.
+            constexpr wchar_t edges[] = { 0x1F, 0x20, 0x7E, 0x7F, 0x9F, 0xA0, 0x2FF, 0x300, 0x00, 0xFFFF };
+            std::vector<wchar_t> text(k_capacity);
+            for (auto& unit : text)
+            {
+                const auto pick = rng.next_u64() % 16;
+                unit = pick == 0 ? edges[rng.next_size(std::size(edges) - 1)]
+                     : pick == 1 ? rng.next_character()
+                                 : static_cast<wchar_t>(0x20 + rng.next_size(0x5E));
+            }
+
+            size_t expected = count;
+            for (size_t i = 0; i < count; ++i)
+            {
+                const wchar_t unit = text[offset + i];
+                if (!((unit >= 0x20 && unit <= 0x7E) || (unit >= 0xA0 && unit <= 0x2FF)))
+                {
+                    expected = i;
+                    break;
+                }
+            }
+
+            if (oc::condrv::count_plain_characters(text.data() + offset, count) != expected)
+            {
+                return report(L"count_plain_characters", iteration);
+            }
+        }
+
+        return true;
+    }
+
+    bool test_char_info_matches_reference()
+    {
+        SplitMix64 rng(k_base_seed ^ 3);
+        for (size_t iteration = 0; iteration < k_iterations; ++iteration)
+        {
+            const auto [offset, count] = next_span(rng);
+            const auto original = random_cells(rng);
+            const bool unicode = (rng.next_u64() & 1) != 0;
+
+            // Records carry a full 16-bit `Char`, so ASCII mode must ignore the high byte.
+            std::vector<CHAR_INFO> records(count + 1);
+            for (auto& record : records)
+            {
+                record.Char.UnicodeChar = rng.next_character();
+                record.Attributes = rng.next_attributes();
+            }
+
+            auto actual = original;
+            auto expected = original;
+            oc::condrv::store_cell_char_info(actual.data() + offset, records.data(), count, unicode);
+            for (size_t i = 0; i < count; ++i)
+            {
+                const auto& info = records[i];
+                expected[offset + i] = ScreenCell{
+                    .character = unicode ? info.Char.UnicodeChar : static_cast<wchar_t>(static_cast<unsigned char>(info.Char.AsciiChar)),
+                    .attributes = info.Attributes,
+                };
+            }
+            if (actual != expected)
+            {
+                return report(L"store_cell_char_info", iteration);
+            }
+
+            const CHAR_INFO sentinel = records[count];
+            oc::condrv::load_cell_char_info(records.data(), original.data() + offset, count, unicode);
+            for (size_t i = 0; i < count; ++i)
+            {
+                const auto& cell = original[offset + i];
+                CHAR_INFO reference{};
+                reference.Attributes = cell.attributes;
+                if (unicode)
+                {
+                    reference.Char.UnicodeChar = cell.character;
+                }
+                else
+                {
+                    reference.Char.AsciiChar = static_cast<CHAR>(static_cast<unsigned char>(reference_narrow(cell.character)));
+                }
+
+                if (!same_char_info(records[i], reference) || !same_char_info(oc::condrv::to_char_info(cell, unicode), reference))
+                {
+                    return report(L"load_cell_char_info", iteration);
+                }
+            }
+
+            if (!same_char_info(records[count], sentinel))
+            {
+                return report(L"load_cell_char_info overrun", iteration);
+            }
+        }
+
+        return true;
+    }
+}
+
+bool run_condrv_screen_cell_span_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_fills_match_reference", test_fills_match_reference },
+        { L"test_stores_match_reference", test_stores_match_reference },
+        { L"test_loads_match_reference", test_loads_match_reference },
+        { L"test_char_info_matches_reference", test_char_info_matches_reference },
+        { L"test_find_surrogate_cell_matches_reference", test_find_surrogate_cell_matches_reference },
+        { L"test_count_plain_characters_matches_reference", test_count_plain_characters_matches_reference },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv cell span] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
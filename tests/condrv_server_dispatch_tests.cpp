@@ -1695,6 +1695,54 @@ namespace
         return bad_outcome && bad_message.completion().io_status.Status == oc::core::status_invalid_parameter;
     }
 
+    bool test_user_defined_char_type_reports_double_width_halves()
+    {
+        DummyComm comm{};
+        oc::condrv::ServerState state{};
+        oc::condrv::NullHostIo host_io{};
+
+        auto connect_packet = make_connect_packet(5017, 5018);
+        oc::condrv::BasicApiMessage<DummyComm> connect_message(comm, connect_packet);
+        auto connect_outcome = oc::condrv::dispatch_message(state, connect_message, host_io);
+        if (!connect_outcome || connect_message.completion().io_status.Status != oc::core::status_success)
+        {
+            return false;
+        }
+
+        oc::condrv::ConnectionInformation info{};
+        std::memcpy(&info, connect_message.completion().write.data, sizeof(info));
+
+        const auto active = state.active_screen_buffer();
+        if (!active)
+        {
+            return false;
+        }
+        oc::condrv::apply_text_to_screen_buffer(*active, L"a\u4E2D", state.output_mode(), &state, &host_io);
+
+        const auto char_type = [&](const SHORT x) noexcept -> DWORD {
+            oc::condrv::IoPacket packet{};
+            packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+            packet.descriptor.identifier.LowPart = 111;
+            packet.descriptor.function = oc::condrv::console_io_user_defined;
+            packet.descriptor.process = info.process;
+            packet.descriptor.object = info.output;
+            packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepCharType);
+            packet.payload.user_defined.msg_header.ApiDescriptorSize = sizeof(CONSOLE_CHAR_TYPE_MSG);
+            packet.payload.user_defined.u.console_msg_l3.GetConsoleCharType.coordCheck = COORD{ x, 0 };
+
+            oc::condrv::BasicApiMessage<DummyComm> message(comm, packet);
+            auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+            if (!outcome || message.completion().io_status.Status != oc::core::status_success)
+            {
+                return 0xFFFF'FFFF;
+            }
+            return message.packet().payload.user_defined.u.console_msg_l3.GetConsoleCharType.dwType;
+        };
+
+        return char_type(0) == CHAR_TYPE_SBCS && char_type(1) == CHAR_TYPE_LEADING && char_type(2) == CHAR_TYPE_TRAILING &&
+               char_type(3) == CHAR_TYPE_SBCS;
+    }
+
     bool test_user_defined_compat_misc_stubs_succeed()
     {
         DummyComm comm{};
@@ -2753,6 +2801,11 @@ bool run_condrv_server_dispatch_tests()
         fwprintf(stderr, L"[condrv dispatch] test_user_defined_char_type_returns_sbcs_and_validates_coords failed\n");
         return false;
     }
+    if (!test_user_defined_char_type_reports_double_width_halves())
+    {
+        fwprintf(stderr, L"[condrv dispatch] test_user_defined_char_type_reports_double_width_halves failed\n");
+        return false;
+    }
     if (!test_user_defined_compat_misc_stubs_succeed())
     {
         fwprintf(stderr, L"[condrv dispatch] test_user_defined_compat_misc_stubs_succeed failed\n");
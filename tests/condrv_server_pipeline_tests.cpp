@@ -0,0 +1,892 @@
+#include "condrv/condrv_server.hpp"
+#include "condrv/condrv_server_pipeline.hpp"
+#include "core/spsc_ring.hpp"
+#include "core/unique_handle.hpp"
+
+#include <Windows.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <expected>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // Single-threaded comm used to connect clients before the pipeline starts.
+    struct ConnectComm final
+    {
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_input(oc::condrv::IoOperation& /*operation*/) noexcept
+        {
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write_output(oc::condrv::IoOperation& /*operation*/) noexcept
+        {
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> complete_io(const oc::condrv::IoComplete& /*completion*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    // Simulated driver with per-call latency.
+    //
+    // Each client owns a script of requests. Up to `depth` requests per client are outstanding at a
+    // time; the next one becomes readable only after an earlier one is completed, like a client
+    // thread blocked in a synchronous console API. `read_io` blocks until a request is readable and
+    // returns `ERROR_PIPE_NOT_CONNECTED` once every script has been completed (unless
+    // `disconnect_when_idle` is cleared). `wake_read_io()` cancels one blocked (or the next) read.
+    class LatencyComm final
+    {
+    public:
+        struct Request final
+        {
+            oc::condrv::IoPacket packet{};
+            std::vector<std::byte> input;
+        };
+
+        LatencyComm(std::vector<std::vector<Request>> scripts, const size_t depth, const std::chrono::nanoseconds latency) :
+            _latency(latency)
+        {
+            _clients.resize(scripts.size());
+            for (size_t client = 0; client < scripts.size(); ++client)
+            {
+                _clients[client].script = std::move(scripts[client]);
+                for (const auto& request : _clients[client].script)
+                {
+                    _owner.emplace(request.packet.descriptor.identifier.LowPart, client);
+                }
+
+                for (size_t i = 0; i < depth; ++i)
+                {
+                    issue_next_locked(client);
+                }
+            }
+        }
+
+        void set_disconnect_when_idle(const bool value) noexcept
+        {
+            std::lock_guard lock(_lock);
+            _disconnect_when_idle = value;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_io(
+            const oc::condrv::IoComplete* const reply,
+            oc::condrv::IoPacket& packet) noexcept
+        {
+            simulate_latency();
+
+            std::unique_lock lock(_lock);
+            if (reply != nullptr)
+            {
+                complete_locked(*reply);
+            }
+
+            for (;;)
+            {
+                if (_wake_pending)
+                {
+                    _wake_pending = false;
+                    return std::unexpected(oc::condrv::DeviceCommError{
+                        .context = L"LatencyComm read_io canceled",
+                        .win32_error = ERROR_OPERATION_ABORTED,
+                    });
+                }
+
+                if (!_ready.empty())
+                {
+                    const auto [client, index] = _ready.front();
+                    _ready.pop_front();
+                    packet = _clients[client].script[index].packet;
+                    ++_delivered;
+                    return {};
+                }
+
+                if (_disconnect_when_idle && _finished_clients == _clients.size())
+                {
+                    return std::unexpected(oc::condrv::DeviceCommError{
+                        .context = L"LatencyComm has no clients left",
+                        .win32_error = ERROR_PIPE_NOT_CONNECTED,
+                    });
+                }
+
+                _changed.wait(lock);
+            }
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> complete_io(const oc::condrv::IoComplete& completion) noexcept
+        {
+            simulate_latency();
+
+            std::lock_guard lock(_lock);
+            complete_locked(completion);
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_input(oc::condrv::IoOperation& operation) noexcept
+        {
+            simulate_latency();
+
+            const Request* const request = find_request(operation.identifier.LowPart);
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (request == nullptr || offset + size > request->input.size())
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"LatencyComm read_input out of range",
+                    .win32_error = ERROR_INVALID_DATA,
+                });
+            }
+
+            if (size != 0)
+            {
+                std::memcpy(operation.buffer.data, request->input.data() + offset, size);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write_output(oc::condrv::IoOperation& operation) noexcept
+        {
+            simulate_latency();
+
+            std::lock_guard lock(_lock);
+            const auto* const bytes = static_cast<const std::byte*>(operation.buffer.data);
+            auto& output = _outputs[operation.identifier.LowPart];
+            output.assign(bytes, bytes + operation.buffer.size);
+            return {};
+        }
+
+        void wake_read_io() noexcept
+        {
+            std::lock_guard lock(_lock);
+            _wake_pending = true;
+            _changed.notify_all();
+        }
+
+        [[nodiscard]] std::vector<ULONG> completed_ids(const size_t client) const
+        {
+            std::lock_guard lock(_lock);
+            return _clients[client].completed;
+        }
+
+        [[nodiscard]] std::vector<NTSTATUS> completed_statuses(const size_t client) const
+        {
+            std::lock_guard lock(_lock);
+            return _clients[client].statuses;
+        }
+
+        [[nodiscard]] std::vector<std::byte> output(const ULONG id) const
+        {
+            std::lock_guard lock(_lock);
+            const auto found = _outputs.find(id);
+            return found != _outputs.end() ? found->second : std::vector<std::byte>{};
+        }
+
+        [[nodiscard]] size_t delivered() const
+        {
+            std::lock_guard lock(_lock);
+            return _delivered;
+        }
+
+        [[nodiscard]] size_t duplicate_completions() const
+        {
+            std::lock_guard lock(_lock);
+            return _duplicate_completions;
+        }
+
+    private:
+        struct Client final
+        {
+            std::vector<Request> script;
+            size_t next_issue{ 0 };
+            size_t completed_count{ 0 };
+            std::vector<ULONG> completed;
+            std::vector<NTSTATUS> statuses;
+        };
+
+        void simulate_latency() const noexcept
+        {
+            if (_latency.count() == 0)
+            {
+                return;
+            }
+
+            const auto deadline = std::chrono::steady_clock::now() + _latency;
+            while (std::chrono::steady_clock::now() < deadline)
+            {
+            }
+        }
+
+        [[nodiscard]] const Request* find_request(const ULONG id) const noexcept
+        {
+            const auto found = _owner.find(id);
+            if (found == _owner.end())
+            {
+                return nullptr;
+            }
+
+            for (const auto& request : _clients[found->second].script)
+            {
+                if (request.packet.descriptor.identifier.LowPart == id)
+                {
+                    return &request;
+                }
+            }
+
+            return nullptr;
+        }
+
+        void issue_next_locked(const size_t client)
+        {
+            auto& state = _clients[client];
+            if (state.next_issue < state.script.size())
+            {
+                _ready.emplace_back(client, state.next_issue);
+                ++state.next_issue;
+            }
+        }
+
+        void complete_locked(const oc::condrv::IoComplete& completion)
+        {
+            const ULONG id = completion.identifier.LowPart;
+            const auto found = _owner.find(id);
+            if (found == _owner.end())
+            {
+                ++_duplicate_completions;
+                return;
+            }
+
+            auto& client = _clients[found->second];
+            for (const ULONG completed : client.completed)
+            {
+                if (completed == id)
+                {
+                    ++_duplicate_completions;
+                    return;
+                }
+            }
+
+            client.completed.push_back(id);
+            client.statuses.push_back(completion.io_status.Status);
+            ++client.completed_count;
+            if (client.completed_count == client.script.size())
+            {
+                ++_finished_clients;
+            }
+
+            issue_next_locked(found->second);
+            _changed.notify_all();
+        }
+
+        std::chrono::nanoseconds _latency{};
+        mutable std::mutex _lock;
+        std::condition_variable _changed;
+        std::vector<Client> _clients;
+        std::unordered_map<ULONG, size_t> _owner;
+        std::deque<std::pair<size_t, size_t>> _ready;
+        std::unordered_map<ULONG, std::vector<std::byte>> _outputs;
+        size_t _finished_clients{ 0 };
+        size_t _delivered{ 0 };
+        size_t _duplicate_completions{ 0 };
+        bool _wake_pending{ false };
+        bool _disconnect_when_idle{ true };
+    };
+
+    struct QueueHostIo final
+    {
+        std::vector<std::byte> queue;
+        size_t queue_offset{ 0 };
+        bool disconnected{ false };
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> write_output_bytes(std::span<const std::byte> bytes) noexcept
+        {
+            return bytes.size();
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> read_input_bytes(std::span<std::byte> dest) noexcept
+        {
+            const size_t remaining = input_bytes_available();
+            const size_t to_copy = remaining < dest.size() ? remaining : dest.size();
+            if (to_copy != 0)
+            {
+                std::memcpy(dest.data(), queue.data() + queue_offset, to_copy);
+                queue_offset += to_copy;
+            }
+            return to_copy;
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> peek_input_bytes(std::span<std::byte> dest) noexcept
+        {
+            const size_t remaining = input_bytes_available();
+            const size_t to_copy = remaining < dest.size() ? remaining : dest.size();
+            if (to_copy != 0)
+            {
+                std::memcpy(dest.data(), queue.data() + queue_offset, to_copy);
+            }
+            return to_copy;
+        }
+
+        [[nodiscard]] size_t input_bytes_available() const noexcept
+        {
+            if (queue_offset >= queue.size())
+            {
+                return 0;
+            }
+            return queue.size() - queue_offset;
+        }
+
+        [[nodiscard]] bool inject_input_bytes(std::span<const std::byte> bytes) noexcept
+        {
+            try
+            {
+                queue.insert(queue.end(), bytes.begin(), bytes.end());
+                return true;
+            }
+            catch (...)
+            {
+                return false;
+            }
+        }
+
+        [[nodiscard]] bool vt_should_answer_queries() const noexcept
+        {
+            return true;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> flush_input_buffer() noexcept
+        {
+            queue.clear();
+            queue_offset = 0;
+            return {};
+        }
+
+        [[nodiscard]] std::expected<bool, oc::condrv::DeviceCommError> wait_for_input(const DWORD /*timeout_ms*/) noexcept
+        {
+            return input_bytes_available() != 0;
+        }
+
+        [[nodiscard]] bool input_disconnected() const noexcept
+        {
+            return disconnected;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> send_end_task(
+            const DWORD /*process_id*/,
+            const DWORD /*event_type*/,
+            const DWORD /*ctrl_flags*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    using Pipeline = oc::condrv::BasicIoPipeline<LatencyComm>;
+    using PipelineWaitQueue = oc::condrv::BasicWaitQueueFor<LatencyComm>;
+
+    template<typename HostIo>
+    [[nodiscard]] bool connect_client(
+        oc::condrv::ServerState& state,
+        HostIo& host_io,
+        const DWORD pid,
+        const DWORD tid,
+        oc::condrv::ConnectionInformation& out_info) noexcept
+    {
+        ConnectComm comm{};
+        oc::condrv::IoPacket packet{};
+        packet.descriptor.identifier.LowPart = 1;
+        packet.descriptor.function = oc::condrv::console_io_connect;
+        packet.descriptor.process = pid;
+        packet.descriptor.object = tid;
+
+        oc::condrv::BasicApiMessage<ConnectComm> message(comm, packet);
+        auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+        if (!outcome || message.completion().io_status.Status != oc::core::status_success)
+        {
+            return false;
+        }
+
+        std::memcpy(&out_info, message.completion().write.data, sizeof(out_info));
+        return true;
+    }
+
+    [[nodiscard]] LatencyComm::Request make_write_console_request(
+        const oc::condrv::ConnectionInformation& info,
+        const ULONG id,
+        const std::wstring_view text)
+    {
+        constexpr ULONG api_size = sizeof(CONSOLE_WRITECONSOLE_MSG);
+        constexpr ULONG read_offset = api_size + sizeof(CONSOLE_MSG_HEADER);
+        const auto payload = std::as_bytes(std::span(text.data(), text.size()));
+
+        LatencyComm::Request request{};
+        auto& packet = request.packet;
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = id;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = info.process;
+        packet.descriptor.object = info.output;
+        packet.descriptor.input_size = read_offset + static_cast<ULONG>(payload.size());
+        packet.descriptor.output_size = api_size;
+        packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepWriteConsole);
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+        packet.payload.user_defined.u.console_msg_l1.WriteConsole.Unicode = TRUE;
+
+        request.input.assign(packet.descriptor.input_size, std::byte{});
+        std::memcpy(request.input.data() + read_offset, payload.data(), payload.size());
+        return request;
+    }
+
+    [[nodiscard]] LatencyComm::Request make_read_console_request(const oc::condrv::ConnectionInformation& info, const ULONG id)
+    {
+        constexpr ULONG api_size = sizeof(CONSOLE_READCONSOLE_MSG);
+        constexpr ULONG read_offset = api_size + sizeof(CONSOLE_MSG_HEADER);
+
+        LatencyComm::Request request{};
+        auto& packet = request.packet;
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = id;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = info.process;
+        packet.descriptor.object = info.input;
+        packet.descriptor.input_size = read_offset;
+        packet.descriptor.output_size = api_size + static_cast<ULONG>(sizeof(wchar_t));
+        packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepReadConsole);
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+        packet.payload.user_defined.u.console_msg_l1.ReadConsole.Unicode = TRUE;
+        request.input.assign(read_offset, std::byte{});
+        return request;
+    }
+
+    template<typename Context>
+    DWORD WINAPI helper_thread_proc(void* param)
+    {
+        static_cast<Context*>(param)->run();
+        return 0;
+    }
+
+    // Runs `context.run()` on a Win32 thread; the caller joins the returned handle.
+    template<typename Context>
+    [[nodiscard]] oc::core::UniqueHandle start_helper_thread(Context& context) noexcept
+    {
+        return oc::core::UniqueHandle(::CreateThread(
+            nullptr,
+            0,
+            &helper_thread_proc<Context>,
+            &context,
+            0,
+            nullptr));
+    }
+
+    [[nodiscard]] bool test_spsc_ring_is_fifo_and_bounded()
+    {
+        oc::core::SpscRing<int, 4> ring;
+        if (!ring.empty() || ring.try_pop().has_value())
+        {
+            return false;
+        }
+
+        // Wrap the indices a few times to cover slot reuse.
+        int next_push = 0;
+        int next_pop = 0;
+        for (int round = 0; round < 5; ++round)
+        {
+            while (ring.try_push(int{ next_push }))
+            {
+                ++next_push;
+            }
+
+            if (ring.size() != ring.capacity())
+            {
+                return false;
+            }
+
+            for (int i = 0; i < 3; ++i)
+            {
+                const auto value = ring.try_pop();
+                if (!value || *value != next_pop)
+                {
+                    return false;
+                }
+                ++next_pop;
+            }
+        }
+
+        while (const auto value = ring.try_pop())
+        {
+            if (*value != next_pop)
+            {
+                return false;
+            }
+            ++next_pop;
+        }
+
+        return ring.empty() && next_pop == next_push;
+    }
+
+    [[nodiscard]] bool test_spsc_ring_cross_thread_transfer_preserves_order()
+    {
+        constexpr uint32_t count = 200'000;
+
+        struct Producer final
+        {
+            oc::core::SpscRing<uint32_t, 64>* ring{};
+
+            void run() noexcept
+            {
+                for (uint32_t value = 0; value < count;)
+                {
+                    if (ring->try_push(uint32_t{ value }))
+                    {
+                        ++value;
+                    }
+                    else
+                    {
+                        (void)::SwitchToThread();
+                    }
+                }
+            }
+        };
+
+        oc::core::SpscRing<uint32_t, 64> ring;
+        Producer producer{ .ring = &ring };
+        auto thread = start_helper_thread(producer);
+        if (!thread.valid())
+        {
+            return false;
+        }
+
+        bool ordered = true;
+        for (uint32_t expected = 0; expected < count;)
+        {
+            const auto value = ring.try_pop();
+            if (!value)
+            {
+                (void)::SwitchToThread();
+                continue;
+            }
+
+            ordered = ordered && *value == expected;
+            ++expected;
+        }
+
+        ::WaitForSingleObject(thread.get(), INFINITE);
+        return ordered && ring.empty();
+    }
+
+    // Four clients with several requests in flight each. Every request must be completed exactly
+    // once, successfully, and in the order the client issued it.
+    [[nodiscard]] bool test_pipelined_dispatch_preserves_per_client_order()
+    {
+        constexpr size_t client_count = 4;
+        constexpr size_t requests_per_client = 64;
+
+        oc::condrv::ServerState state{};
+        oc::condrv::NullHostIo host_io{};
+
+        std::vector<std::vector<LatencyComm::Request>> scripts(client_count);
+        std::vector<std::vector<ULONG>> expected_ids(client_count);
+        for (size_t client = 0; client < client_count; ++client)
+        {
+            oc::condrv::ConnectionInformation info{};
+            if (!connect_client(state, host_io, static_cast<DWORD>(7000 + client), static_cast<DWORD>(8000 + client), info))
+            {
+                return false;
+            }
+
+            for (size_t i = 0; i < requests_per_client; ++i)
+            {
+                const auto id = static_cast<ULONG>(100 + client * 1000 + i);
+                const std::wstring text = L"client " + std::to_wstring(client) + L" line " + std::to_wstring(i) + L"\r\n";
+                scripts[client].push_back(make_write_console_request(info, id, text));
+                expected_ids[client].push_back(id);
+            }
+        }
+
+        LatencyComm comm(std::move(scripts), 4, std::chrono::microseconds(5));
+        const std::atomic_bool stop_requested{ false };
+        PipelineWaitQueue waiters;
+
+        Pipeline pipeline(comm);
+        if (!pipeline.start())
+        {
+            return false;
+        }
+
+        size_t batches = 0;
+        auto exit = oc::condrv::run_pipelined_dispatch(
+            pipeline,
+            state,
+            host_io,
+            waiters,
+            stop_requested,
+            []() noexcept {},
+            [&]() noexcept { ++batches; });
+
+        pipeline.request_stop();
+        pipeline.join();
+
+        if (!exit || *exit != oc::condrv::PipelinedDispatchExit::io_stopped ||
+            pipeline.io_exit() != oc::condrv::PipelineIoExit::pipe_disconnected)
+        {
+            return false;
+        }
+
+        for (size_t client = 0; client < client_count; ++client)
+        {
+            if (comm.completed_ids(client) != expected_ids[client])
+            {
+                return false;
+            }
+
+            for (const NTSTATUS status : comm.completed_statuses(client))
+            {
+                if (status != oc::core::status_success)
+                {
+                    return false;
+                }
+            }
+        }
+
+        const auto& stats = pipeline.statistics();
+        return comm.duplicate_completions() == 0 &&
+               stats.packets == client_count * requests_per_client &&
+               stats.piggybacked_replies + stats.direct_replies == client_count * requests_per_client &&
+               batches != 0 &&
+               waiters.empty();
+    }
+
+    // A reply-pending read parks on the dispatch thread while the IO thread blocks in `read_io` (the
+    // client has nothing else to send). Input arriving later must wake dispatch, complete the read,
+    // and get the reply past the blocked read.
+    [[nodiscard]] bool test_pipelined_reply_pending_read_completes_after_input()
+    {
+        oc::condrv::ServerState state{};
+        QueueHostIo host_io{};
+
+        oc::condrv::ConnectionInformation reader{};
+        oc::condrv::ConnectionInformation writer{};
+        if (!connect_client(state, host_io, 7100, 8100, reader) ||
+            !connect_client(state, host_io, 7101, 8101, writer))
+        {
+            return false;
+        }
+
+        state.set_input_code_page(CP_UTF8);
+        state.set_input_mode(0); // raw ReadConsole behavior
+
+        constexpr ULONG read_id = 500;
+        std::vector<std::vector<LatencyComm::Request>> scripts(2);
+        scripts[0].push_back(make_read_console_request(reader, read_id));
+        for (ULONG i = 0; i < 16; ++i)
+        {
+            scripts[1].push_back(make_write_console_request(writer, 600 + i, L"busy\r\n"));
+        }
+
+        LatencyComm comm(std::move(scripts), 1, std::chrono::microseconds(2));
+        const std::atomic_bool stop_requested{ false };
+        PipelineWaitQueue waiters;
+        Pipeline pipeline(comm);
+
+        // Delivers a key once the writer is done and the reader's request has been read, i.e. once
+        // the IO thread can only be sitting in `read_io`.
+        struct InputInjector final
+        {
+            LatencyComm* comm{};
+            Pipeline* pipeline{};
+            std::atomic_bool input_ready{ false };
+
+            void run() noexcept
+            {
+                while (comm->delivered() < 17 || comm->completed_ids(1).size() < 16)
+                {
+                    (void)::SwitchToThread();
+                }
+
+                ::Sleep(20);
+                input_ready.store(true, std::memory_order_release);
+                pipeline->dispatch_wake().notify();
+            }
+        };
+
+        InputInjector injector{ .comm = &comm, .pipeline = &pipeline };
+        if (!pipeline.start())
+        {
+            return false;
+        }
+
+        auto injector_thread = start_helper_thread(injector);
+        if (!injector_thread.valid())
+        {
+            pipeline.request_stop();
+            return false;
+        }
+
+        bool injected = false;
+        bool inject_failed = false;
+        auto exit = oc::condrv::run_pipelined_dispatch(
+            pipeline,
+            state,
+            host_io,
+            waiters,
+            stop_requested,
+            [&]() noexcept {
+                if (!injected && injector.input_ready.load(std::memory_order_acquire))
+                {
+                    injected = true;
+                    const std::array<std::byte, 1> key{ static_cast<std::byte>('k') };
+                    inject_failed = !host_io.inject_input_bytes(key);
+                    waiters.signal_input_available();
+                }
+            },
+            []() noexcept {});
+
+        ::WaitForSingleObject(injector_thread.get(), INFINITE);
+        pipeline.request_stop();
+        pipeline.join();
+
+        if (!exit || *exit != oc::condrv::PipelinedDispatchExit::io_stopped || !injected || inject_failed)
+        {
+            return false;
+        }
+
+        const auto read_completions = comm.completed_ids(0);
+        const auto read_statuses = comm.completed_statuses(0);
+        if (read_completions.size() != 1 || read_completions[0] != read_id || read_statuses[0] != oc::core::status_success)
+        {
+            return false;
+        }
+
+        // The read's output payload (after the API descriptor) carries the injected key.
+        const auto output = comm.output(read_id);
+        wchar_t ch{};
+        if (output.size() < sizeof(ch))
+        {
+            return false;
+        }
+
+        std::memcpy(&ch, output.data(), sizeof(ch));
+        return ch == L'k' && waiters.empty() && comm.duplicate_completions() == 0;
+    }
+
+    // An external stop request (the signal monitor's job in production) must unblock an idle IO
+    // thread and end the dispatch loop after the in-flight reply has been delivered.
+    [[nodiscard]] bool test_pipelined_stop_request_unblocks_idle_io_thread()
+    {
+        oc::condrv::ServerState state{};
+        oc::condrv::NullHostIo host_io{};
+
+        oc::condrv::ConnectionInformation info{};
+        if (!connect_client(state, host_io, 7200, 8200, info))
+        {
+            return false;
+        }
+
+        std::vector<std::vector<LatencyComm::Request>> scripts(1);
+        scripts[0].push_back(make_write_console_request(info, 900, L"only request\r\n"));
+
+        LatencyComm comm(std::move(scripts), 1, std::chrono::nanoseconds(0));
+        comm.set_disconnect_when_idle(false);
+
+        std::atomic_bool stop_requested{ false };
+        PipelineWaitQueue waiters;
+        Pipeline pipeline(comm, &stop_requested);
+
+        struct Stopper final
+        {
+            LatencyComm* comm{};
+            std::atomic_bool* stop_requested{};
+
+            void run() noexcept
+            {
+                while (comm->completed_ids(0).empty())
+                {
+                    (void)::SwitchToThread();
+                }
+
+                ::Sleep(10);
+                stop_requested->store(true, std::memory_order_release);
+                comm->wake_read_io(); // stands in for the signal monitor's CancelIoEx
+            }
+        };
+
+        Stopper stopper{ .comm = &comm, .stop_requested = &stop_requested };
+        if (!pipeline.start())
+        {
+            return false;
+        }
+
+        auto stopper_thread = start_helper_thread(stopper);
+        if (!stopper_thread.valid())
+        {
+            pipeline.request_stop();
+            return false;
+        }
+
+        auto exit = oc::condrv::run_pipelined_dispatch(
+            pipeline,
+            state,
+            host_io,
+            waiters,
+            stop_requested,
+            []() noexcept {},
+            []() noexcept {});
+
+        ::WaitForSingleObject(stopper_thread.get(), INFINITE);
+        pipeline.request_stop();
+        pipeline.join();
+
+        if (!exit ||
+            (*exit != oc::condrv::PipelinedDispatchExit::stop_requested && *exit != oc::condrv::PipelinedDispatchExit::io_stopped))
+        {
+            return false;
+        }
+
+        const auto completed = comm.completed_ids(0);
+        return pipeline.io_exit() == oc::condrv::PipelineIoExit::stopped &&
+               completed.size() == 1 && completed[0] == 900 &&
+               comm.duplicate_completions() == 0;
+    }
+}
+
+bool run_condrv_server_pipeline_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_spsc_ring_is_fifo_and_bounded", test_spsc_ring_is_fifo_and_bounded },
+        { L"test_spsc_ring_cross_thread_transfer_preserves_order", test_spsc_ring_cross_thread_transfer_preserves_order },
+        { L"test_pipelined_dispatch_preserves_per_client_order", test_pipelined_dispatch_preserves_per_client_order },
+        { L"test_pipelined_reply_pending_read_completes_after_input", test_pipelined_reply_pending_read_completes_after_input },
+        { L"test_pipelined_stop_request_unblocks_idle_io_thread", test_pipelined_stop_request_unblocks_idle_io_thread },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv pipeline] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
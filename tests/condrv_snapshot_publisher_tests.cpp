@@ -0,0 +1,351 @@
+#include "condrv/snapshot_publisher.hpp"
+
+#include "condrv/condrv_server.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <expected>
+#include <memory>
+
+namespace
+{
+    struct FakeClock final
+    {
+        uint64_t now{ 1'000 };
+
+        [[nodiscard]] uint64_t now_us() const noexcept
+        {
+            return now;
+        }
+    };
+
+    using Publisher = oc::condrv::BasicSnapshotPublisher<FakeClock>;
+
+    // Builds real frames unless told to fail.
+    struct FailingBuilder final
+    {
+        bool fail{ false };
+
+        [[nodiscard]] std::expected<std::shared_ptr<const oc::view::ScreenBufferSnapshot>, oc::condrv::DeviceCommError> operator()(
+            const auto&... args) const noexcept
+        {
+            if (fail)
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"FailingBuilder",
+                    .win32_error = ERROR_OUTOFMEMORY,
+                });
+            }
+
+            return oc::condrv::ViewportSnapshotBuilder{}(args...);
+        }
+    };
+
+    // 50 fps -> one frame every 20ms.
+    constexpr uint32_t test_fps = 50;
+    constexpr uint64_t test_frame_us = 20'000;
+
+    [[nodiscard]] std::shared_ptr<oc::condrv::ScreenBuffer> make_buffer()
+    {
+        auto settings = oc::condrv::ScreenBuffer::default_settings();
+        settings.buffer_size = COORD{ 8, 2 };
+        settings.window_size = COORD{ 8, 2 };
+        settings.maximum_window_size = COORD{ 8, 2 };
+
+        auto created = oc::condrv::ScreenBuffer::create(settings);
+        if (!created)
+        {
+            return {};
+        }
+
+        return std::move(created.value());
+    }
+
+    [[nodiscard]] wchar_t published_first_cell(const oc::view::PublishedScreenBuffer& published) noexcept
+    {
+        const auto latest = published.latest();
+        return latest && !latest->text.empty() ? latest->text.front() : L'\0';
+    }
+
+    bool test_changes_within_a_frame_are_coalesced()
+    {
+        auto published = std::make_shared<oc::view::PublishedScreenBuffer>();
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        Publisher publisher(published, nullptr, test_fps);
+        const uint64_t start = publisher.clock().now;
+
+        // The first change is published immediately.
+        if (!buffer->write_cell(COORD{ 0, 0 }, L'a', 0x07) || !publisher.update(buffer) ||
+            published_first_cell(*published) != L'a' || publisher.dirty())
+        {
+            return false;
+        }
+
+        // Further changes inside the frame interval stay dirty.
+        for (const wchar_t ch : { L'b', L'c', L'd' })
+        {
+            publisher.clock().now += 1'000;
+            if (!buffer->write_cell(COORD{ 0, 0 }, ch, 0x07) || publisher.update(buffer))
+            {
+                return false;
+            }
+        }
+
+        if (!publisher.dirty() || publisher.deadline() != start + test_frame_us || published_first_cell(*published) != L'a')
+        {
+            return false;
+        }
+
+        // An update without new changes does nothing before the deadline.
+        publisher.clock().now = start + test_frame_us - 1;
+        if (publisher.update(buffer))
+        {
+            return false;
+        }
+
+        // Once the deadline passes, the latest state lands even though nothing changed since.
+        publisher.clock().now = start + test_frame_us;
+        if (!publisher.update(buffer) || published_first_cell(*published) != L'd' || publisher.dirty() || publisher.deadline().has_value())
+        {
+            return false;
+        }
+
+        const auto& stats = publisher.statistics();
+        return stats.changes == 4 && stats.frames == 2 && stats.coalesced == 2;
+    }
+
+    bool test_unchanged_buffer_is_not_republished()
+    {
+        auto published = std::make_shared<oc::view::PublishedScreenBuffer>();
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        Publisher publisher(published, nullptr, test_fps);
+        if (!publisher.update(buffer))
+        {
+            return false;
+        }
+
+        const auto first = published->latest();
+        publisher.clock().now += 10 * test_frame_us;
+        return !publisher.update(buffer) && !publisher.flush(buffer) && published->latest() == first &&
+               publisher.statistics().frames == 1;
+    }
+
+    bool test_flush_ignores_the_frame_budget()
+    {
+        auto published = std::make_shared<oc::view::PublishedScreenBuffer>();
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        Publisher publisher(published, nullptr, test_fps);
+        if (!publisher.update(buffer))
+        {
+            return false;
+        }
+
+        if (!buffer->write_cell(COORD{ 0, 0 }, L'x', 0x07) || publisher.update(buffer) || !publisher.dirty())
+        {
+            return false;
+        }
+
+        // Flushing restarts the frame interval from the flush time.
+        publisher.clock().now += 5'000;
+        const uint64_t flushed_at = publisher.clock().now;
+        if (!publisher.flush(buffer) || published_first_cell(*published) != L'x' || publisher.dirty())
+        {
+            return false;
+        }
+
+        if (!buffer->write_cell(COORD{ 0, 0 }, L'y', 0x07) || publisher.update(buffer))
+        {
+            return false;
+        }
+
+        return publisher.deadline() == flushed_at + test_frame_us;
+    }
+
+    bool test_active_buffer_switch_is_a_change()
+    {
+        auto published = std::make_shared<oc::view::PublishedScreenBuffer>();
+        auto main_buffer = make_buffer();
+        auto alternate_buffer = make_buffer();
+        if (!main_buffer || !alternate_buffer)
+        {
+            return false;
+        }
+
+        // Same content and revision in both buffers: only the identity differs.
+        if (!main_buffer->write_cell(COORD{ 0, 0 }, L'm', 0x07) || !alternate_buffer->write_cell(COORD{ 0, 0 }, L'n', 0x07) ||
+            main_buffer->revision() != alternate_buffer->revision())
+        {
+            return false;
+        }
+
+        Publisher publisher(published, nullptr, test_fps);
+        if (!publisher.update(main_buffer) || published_first_cell(*published) != L'm')
+        {
+            return false;
+        }
+
+        if (publisher.update(alternate_buffer) || !publisher.dirty())
+        {
+            return false;
+        }
+
+        publisher.clock().now += test_frame_us;
+        return publisher.update(alternate_buffer) && published_first_cell(*published) == L'n';
+    }
+
+    bool test_zero_fps_publishes_every_change()
+    {
+        auto published = std::make_shared<oc::view::PublishedScreenBuffer>();
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        Publisher publisher(published, nullptr, 0);
+        for (const wchar_t ch : { L'1', L'2', L'3' })
+        {
+            if (!buffer->write_cell(COORD{ 0, 0 }, ch, 0x07) || !publisher.update(buffer) ||
+                published_first_cell(*published) != ch || publisher.dirty())
+            {
+                return false;
+            }
+        }
+
+        return publisher.statistics().frames == 3 && publisher.statistics().coalesced == 0;
+    }
+
+    bool test_missing_target_is_a_no_op()
+    {
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        Publisher publisher(nullptr, nullptr, test_fps);
+        return !publisher.update(buffer) && !publisher.flush(buffer) && !publisher.dirty() &&
+               !publisher.update(nullptr) && publisher.statistics().changes == 0;
+    }
+
+    bool test_consecutive_frames_are_incremental()
+    {
+        auto published = std::make_shared<oc::view::PublishedScreenBuffer>();
+        auto buffer = make_buffer();
+        auto other_buffer = make_buffer();
+        if (!buffer || !other_buffer)
+        {
+            return false;
+        }
+
+        Publisher publisher(published, nullptr, 0);
+        if (!publisher.update(buffer) || publisher.statistics().incremental_frames != 0)
+        {
+            return false;
+        }
+
+        // The second frame of the same buffer reuses the first one plus the damaged row.
+        if (!buffer->write_cell(COORD{ 0, 0 }, L'i', 0x07) || !publisher.update(buffer) ||
+            published_first_cell(*published) != L'i' || publisher.statistics().incremental_frames != 1)
+        {
+            return false;
+        }
+
+        // A different buffer has its own damage generations and is built from scratch.
+        if (!other_buffer->write_cell(COORD{ 0, 0 }, L'o', 0x07) || !publisher.update(other_buffer) ||
+            published_first_cell(*published) != L'o' || publisher.statistics().incremental_frames != 1)
+        {
+            return false;
+        }
+
+        return buffer->write_cell(COORD{ 0, 0 }, L'j', 0x07) && publisher.update(buffer) && published_first_cell(*published) == L'j' &&
+               publisher.statistics().incremental_frames == 1;
+    }
+
+    bool test_failed_frame_is_retried_next_frame()
+    {
+        auto published = std::make_shared<oc::view::PublishedScreenBuffer>();
+        auto buffer = make_buffer();
+        if (!buffer)
+        {
+            return false;
+        }
+
+        oc::condrv::BasicSnapshotPublisher<FakeClock, FailingBuilder> publisher(published, nullptr, test_fps);
+        if (!publisher.update(buffer))
+        {
+            return false;
+        }
+
+        publisher.clock().now += test_frame_us;
+        const uint64_t failed_at = publisher.clock().now;
+        publisher.builder().fail = true;
+        if (!buffer->write_cell(COORD{ 0, 0 }, L'f', 0x07) || publisher.update(buffer) || !publisher.dirty())
+        {
+            return false;
+        }
+
+        // The deadline moves past the failure, so a frame timer armed for it gets re-armed.
+        if (publisher.deadline() != failed_at + test_frame_us || publisher.statistics().snapshot_failures != 1)
+        {
+            return false;
+        }
+
+        publisher.builder().fail = false;
+        publisher.clock().now = failed_at + test_frame_us - 1;
+        if (publisher.update(buffer))
+        {
+            return false;
+        }
+
+        publisher.clock().now = failed_at + test_frame_us;
+        return publisher.update(buffer) && published_first_cell(*published) == L'f' && !publisher.dirty() &&
+               publisher.statistics().frames == 2;
+    }
+}
+
+bool run_condrv_snapshot_publisher_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_changes_within_a_frame_are_coalesced", test_changes_within_a_frame_are_coalesced },
+        { L"test_unchanged_buffer_is_not_republished", test_unchanged_buffer_is_not_republished },
+        { L"test_flush_ignores_the_frame_budget", test_flush_ignores_the_frame_budget },
+        { L"test_active_buffer_switch_is_a_change", test_active_buffer_switch_is_a_change },
+        { L"test_zero_fps_publishes_every_change", test_zero_fps_publishes_every_change },
+        { L"test_missing_target_is_a_no_op", test_missing_target_is_a_no_op },
+        { L"test_consecutive_frames_are_incremental", test_consecutive_frames_are_incremental },
+        { L"test_failed_frame_is_retried_next_frame", test_failed_frame_is_retried_next_frame },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv snapshot publisher] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
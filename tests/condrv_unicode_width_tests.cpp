@@ -0,0 +1,158 @@
+#include "condrv/unicode_width.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cwchar>
+
+// Tests for the code point width table: range boundaries from `EastAsianWidth.txt`, emoji
+// presentation, extenders, and per-plane counts of wide and zero-width code points as a checksum
+// against the source data.
+
+namespace
+{
+    using oc::condrv::code_point_width;
+
+    struct Expected final
+    {
+        char32_t code_point;
+        int width;
+    };
+
+    bool test_known_code_points()
+    {
+        static constexpr Expected cases[] = {
+            { U'A', 1 },
+            { 0x00A1, 1 },   // ambiguous
+            { 0x02FF, 1 },
+            { 0x0300, 0 },   // combining grave accent
+            { 0x036F, 0 },
+            { 0x0370, 1 },
+            { 0x0301, 0 },
+            { 0x10FF, 1 },
+            { 0x1100, 2 },   // first Hangul Jamo leading consonant
+            { 0x115F, 2 },
+            { 0x1160, 1 },
+            { 0x200C, 0 },   // ZWNJ
+            { 0x200D, 0 },   // ZWJ
+            { 0x20E3, 0 },   // combining enclosing keycap (Me)
+            { 0x2603, 1 },   // snowman: text presentation
+            { 0x26A1, 2 },   // high voltage: emoji presentation
+            { 0x3000, 2 },   // ideographic space (F)
+            { 0x302A, 0 },   // ideographic tone mark inside a wide range
+            { 0x303E, 2 },
+            { 0x3099, 0 },   // combining kana voiced sound mark
+            { 0x309B, 2 },
+            { 0x303F, 1 },
+            { 0x4E00, 2 },
+            { 0xAC00, 2 },
+            { 0xD7A3, 2 },
+            { 0xD7A4, 1 },
+            { 0xFE0E, 0 },   // text presentation selector
+            { 0xFE0F, 0 },   // emoji presentation selector
+            { 0xFF01, 2 },   // fullwidth exclamation mark
+            { 0xFF61, 1 },   // halfwidth ideographic full stop
+            { 0xFFE0, 2 },
+            { 0x1F1E6, 2 },  // regional indicator A
+            { 0x1F3FA, 2 },
+            { 0x1F3FB, 0 },  // skin tone modifiers
+            { 0x1F3FF, 0 },
+            { 0x1F400, 2 },
+            { 0x1F600, 2 },
+            { 0x1F6FC, 2 },
+            { 0x1F6FD, 1 },
+            { 0x20000, 2 },
+            { 0x2FFFD, 2 },
+            { 0x2FFFE, 1 },
+            { 0x3FFFD, 2 },
+            { 0x40000, 1 },
+            { 0xE0001, 1 },  // language tag
+            { 0xE001F, 1 },
+            { 0xE0020, 0 },  // tag space
+            { 0xE007F, 0 },  // cancel tag
+            { 0xE0080, 1 },
+            { 0xE0100, 0 },  // variation selector 17
+            { 0xE01EF, 0 },
+            { 0xE01F0, 1 },
+            { 0x10FFFF, 1 },
+        };
+
+        for (const auto& expected : cases)
+        {
+            if (code_point_width(expected.code_point) != expected.width)
+            {
+                fwprintf(stderr, L"[condrv unicode width] U+%04X expected width %d\n", static_cast<unsigned>(expected.code_point), expected.width);
+                return false;
+            }
+        }
+
+        for (char32_t code_point = 0; code_point < oc::condrv::first_non_narrow_code_point; ++code_point)
+        {
+            if (code_point_width(code_point) != 1)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool test_width_counts_per_plane()
+    {
+        // Unicode 14.0: assigned `W`/`F` code points plus the wide defaults of the CJK blocks and
+        // planes 2 and 3, plus the regional indicators, less the extenders among them. Extenders are
+        // `Mn`, `Me`, ZWNJ, ZWJ and the skin tone modifiers, plus the tags and variation selectors
+        // of plane 14.
+        static constexpr size_t expected_wide[4] = { 42'173, 9'267, 65'534, 65'534 };
+        static constexpr size_t expected_zero[4] = { 1'079, 651, 0, 0 };
+        for (char32_t plane = 0; plane <= 0x10; ++plane)
+        {
+            size_t wide = 0;
+            size_t zero = 0;
+            for (char32_t code_point = plane << 16; code_point < ((plane + 1) << 16); ++code_point)
+            {
+                const int width = code_point_width(code_point);
+                if (width < 0 || width > 2)
+                {
+                    return false;
+                }
+                wide += width == 2 ? 1 : 0;
+                zero += width == 0 ? 1 : 0;
+            }
+
+            const size_t want_wide = plane < 4 ? expected_wide[plane] : 0;
+            const size_t want_zero = plane < 4 ? expected_zero[plane] : plane == 14 ? 336 : 0;
+            if (wide != want_wide || zero != want_zero)
+            {
+                fwprintf(stderr, L"[condrv unicode width] plane %u has %zu wide and %zu zero-width code points\n", static_cast<unsigned>(plane), wide, zero);
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+bool run_condrv_unicode_width_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_known_code_points", test_known_code_points },
+        { L"test_width_counts_per_plane", test_width_counts_per_plane },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv unicode width] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,297 @@
+#include "condrv/vt_output_parser.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+// Tests for the table-driven VT output parser on its own, without a screen buffer: what each
+// sequence dispatches, what malformed and overlong sequences leave behind, and that a stream split
+// at any unit parses the same as the whole, as UTF-16 or as UTF-8 bytes.
+
+namespace
+{
+    using oc::condrv::VtAction;
+    using oc::condrv::VtOutputParser;
+
+    // Records an event other than `print` as text: controls and sequences in brackets.
+    void record(const VtOutputParser& parser, const VtAction action, std::wstring& events)
+    {
+        switch (action)
+        {
+        case VtAction::execute:
+            events += L"<X" + std::to_wstring(static_cast<unsigned>(parser.control())) + L">";
+            break;
+        case VtAction::esc_dispatch:
+        {
+            const auto& esc = parser.esc();
+            events += L"<E";
+            events.append(esc.intermediates.data(), esc.intermediate_count);
+            events += esc.final;
+            events += L">";
+            break;
+        }
+        case VtAction::csi_dispatch:
+        {
+            const auto& csi = parser.csi();
+            events += L"<C";
+            if (csi.leader != 0)
+            {
+                events += csi.leader;
+            }
+            for (size_t i = 0; i < csi.param_count; ++i)
+            {
+                events += (i == 0 ? L"" : L";") + std::to_wstring(csi.params[i]);
+            }
+            events.append(csi.intermediates.data(), csi.intermediate_count);
+            events += csi.final;
+            events += L">";
+            break;
+        }
+        case VtAction::osc_dispatch:
+            events += L"<O" + std::to_wstring(parser.osc_command()) + L";";
+            events += parser.osc_payload();
+            events += L">";
+            break;
+        case VtAction::print:
+        case VtAction::none:
+            break;
+        }
+    }
+
+    // Runs `text` through `parser` and records each event: printed units as themselves, and
+    // controls and sequences as `record` writes them.
+    void describe(VtOutputParser& parser, const std::wstring_view text, std::wstring& events)
+    {
+        for (size_t offset = 0; offset < text.size();)
+        {
+            const VtAction action = parser.advance(text, offset);
+            if (action == VtAction::print)
+            {
+                events.push_back(text[offset++]);
+                continue;
+            }
+            record(parser, action, events);
+        }
+    }
+
+    // The same for UTF-8 bytes, driven the way `apply_utf8_to_screen_buffer` drives the parser:
+    // text is decoded a few units at a time and passed back as UTF-16.
+    void describe_utf8(VtOutputParser& parser, const std::string_view bytes, std::wstring& events)
+    {
+        for (size_t offset = 0; offset < bytes.size();)
+        {
+            const VtAction action = parser.advance(bytes, offset);
+            if (action != VtAction::print)
+            {
+                record(parser, action, events);
+                continue;
+            }
+
+            std::array<wchar_t, 3> decoded{};
+            const size_t count = parser.decode_utf8(bytes, offset, decoded);
+            describe(parser, std::wstring_view(decoded.data(), count), events);
+        }
+    }
+
+    [[nodiscard]] bool parses_as(const std::wstring_view text, const std::wstring_view expected)
+    {
+        VtOutputParser parser;
+        std::wstring events;
+        describe(parser, text, events);
+        if (events != expected)
+        {
+            fwprintf(stderr, L"[DETAIL] got %ls, expected %ls\n", events.c_str(), std::wstring(expected).c_str());
+            return false;
+        }
+        return parser.in_ground();
+    }
+
+    bool test_csi_parameters_leaders_and_intermediates()
+    {
+        VtOutputParser parser;
+        std::wstring events;
+        describe(parser, L"\x1b[?25;;7h", events);
+        const auto& csi = parser.csi();
+        return events == L"<C?25;0;7h>" && csi.private_marker && !csi.exclamation_marker &&
+               parses_as(L"a\x1b[mb\x1b[;m\x1b[1;m", L"a<Cm>b<C0;0m><C1;0m>") &&
+               parses_as(L"\x1b[!p\x1b[2 q\x1b[>4;1m", L"<C!p><C2 q><C>4;1m>") &&
+               parses_as(L"\x1b[99999999999A", L"<C9999999A>") &&
+               parses_as(L"\x1b[1;2;3;4;5;6;7;8;9;10;11;12;13;14;15;16;17;18m", L"<C1;2;3;4;5;6;7;8;9;10;11;12;13;14;15;16m>");
+    }
+
+    bool test_malformed_csi_is_consumed_without_dispatch()
+    {
+        // Sub-parameters, a misplaced leader, a parameter after an intermediate and a third
+        // intermediate each spoil the sequence up to its final.
+        return parses_as(L"\x1b[38:2:1:2:3mA\x1b[1?hB\x1b[1 2qC\x1b[1 !!pD\x1b[1\x4E00zE", L"ABCDE");
+    }
+
+    bool test_controls_inside_sequences()
+    {
+        // C0 controls run without ending the sequence; CAN, SUB and ESC end it.
+        VtOutputParser parser;
+        std::wstring events;
+        describe(parser, L"\x1b[1\n2H\x1b[3\x18H\x1b[4\x1b[5H\x1b(\rB\x1b\x1a", events);
+        return events == L"<X10><C12H>H<C5H><X13><E(B>" && parser.in_ground();
+    }
+
+    bool test_ground_controls_execute()
+    {
+        // Controls that start nothing go to the caller, C1 introducers start sequences, and a lone
+        // ST is dropped.
+        return parses_as(L"a\x07\x7f\x85\x18\x9b" L"2J\x9c\x9d" L"2;t\x9c" L"b", L"a<X7><X127><X133><X24><C2J><O2;t>b");
+    }
+
+    bool test_osc_terminators()
+    {
+        // BEL, ST and ESC \ end an OSC; the ESC \ form also dispatches the ESC \ itself. An omitted
+        // command is 0. A command that is not a number, or no `;`, is consumed without dispatch.
+        return parses_as(L"\x1b]0;one\x07\x1b]2;two\x9c\x1b]21;three\x1b\\\x1b];four\x07", L"<O0;one><O2;two><O21;three><E\\><O0;four>") &&
+               parses_as(L"\x1b]x;bad\x07" L"a\x1b]2\x07" L"b\x1b]2;cancel\x18" L"c", L"abc") &&
+               parses_as(L"\x1b]8;;\x9b\x4E00\x7f\n\x07", L"<O8;;\x9b\x4E00>") &&
+               parses_as(L"\x1bP1$r\x9c" L"a\x1b_apc\x1b\\b\x1bXsos\x9c" L"c", L"a<E\\>bc");
+    }
+
+    bool test_overlong_sequences_are_abandoned()
+    {
+        const std::wstring long_csi = L"\x1b[" + std::wstring(VtOutputParser::max_csi_length, L'1') + L"2A";
+        const std::wstring capped_csi = L"\x1b[" + std::wstring(VtOutputParser::max_csi_length - 1, L';') + L"m";
+        const std::wstring long_esc = L"\x1b" + std::wstring(VtOutputParser::max_escape_length, L'#') + L"A";
+        const std::wstring long_osc = L"\x1b]2;" + std::wstring(VtOutputParser::max_osc_payload + 10, L'x') + L"\x07";
+
+        VtOutputParser parser;
+        std::wstring events;
+        describe(parser, capped_csi, events);
+        const bool capped = parser.csi().param_count == 16 && parser.csi().final == L'm';
+        events.clear();
+        describe(parser, long_osc, events);
+        return capped && parser.osc_payload() == std::wstring(VtOutputParser::max_osc_payload, L'x') &&
+               parses_as(long_csi, L"A") && parses_as(long_esc, L"A");
+    }
+
+    bool test_split_input_parses_like_whole()
+    {
+        const std::wstring_view text =
+            L"ab\x1b[1;31mred\x1b[0m\r\n\x1b]2;title\x1b\\\x1b#8\x9b?1049h\x1b]0;t\x07\x1bP$q\x1b\\z\x1b[38:5mq\x1b(B\x4E00";
+
+        std::wstring whole;
+        VtOutputParser whole_parser;
+        describe(whole_parser, text, whole);
+
+        for (size_t split = 1; split < text.size(); ++split)
+        {
+            VtOutputParser parser;
+            std::wstring events;
+            describe(parser, text.substr(0, split), events);
+            describe(parser, text.substr(split), events);
+            if (events != whole)
+            {
+                fwprintf(stderr, L"[DETAIL] split at %zu: %ls\n", split, events.c_str());
+                return false;
+            }
+        }
+
+        VtOutputParser parser;
+        std::wstring events;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            describe(parser, text.substr(i, 1), events);
+        }
+        return events == whole;
+    }
+
+    bool test_utf8_bytes_parse_like_utf16()
+    {
+        // C1 controls written as UTF-8 (C2 9B, C2 9C), OSC text past ASCII, a character outside
+        // the BMP, and printable text inside a CSI sequence.
+        const std::string_view bytes =
+            "a\xC3\xA9\x1b[1;31m\xE4\xB8\x80\xC2\x9B" "2J\x1b]2;t\xC3\xAAte\x07\xF0\x9F\x98\x80\x1b[1\xC3\xA9mz\r\n";
+        const std::wstring expected =
+            L"a\x00E9<C1;31m>\x4E00<C2J><O2;t\x00EAte>\xD83D\xDE00z<X13><X10>";
+
+        for (size_t split = 0; split < bytes.size(); ++split)
+        {
+            VtOutputParser parser;
+            std::wstring events;
+            describe_utf8(parser, bytes.substr(0, split), events);
+            describe_utf8(parser, bytes.substr(split), events);
+            if (events != expected || !parser.in_ground())
+            {
+                fwprintf(stderr, L"[DETAIL] split at %zu: %ls\n", split, events.c_str());
+                return false;
+            }
+        }
+
+        VtOutputParser parser;
+        std::wstring events;
+        for (size_t i = 0; i < bytes.size(); ++i)
+        {
+            describe_utf8(parser, bytes.substr(i, 1), events);
+        }
+        return events == expected;
+    }
+
+    bool test_malformed_utf8_becomes_replacement_characters()
+    {
+        // A stray continuation byte, an invalid lead, an overlong form, an encoded surrogate, and
+        // sequences cut short by ASCII, by a control and by a new lead.
+        VtOutputParser parser;
+        std::wstring events;
+        describe_utf8(parser, "\x80" "a\xFF" "b\xC0\xAF" "c\xED\xA0\x80" "d\xE4\xB8" "e\xE4\r\xC3\xC3\xA9", events);
+        const bool malformed =
+            events == L"\xFFFD" L"a\xFFFD" L"b\xFFFD\xFFFD" L"c\xFFFD\xFFFD\xFFFD" L"d\xFFFD" L"e\xFFFD<X13>\xFFFD\x00E9";
+
+        // A sequence cut off at the end of a write survives a reset and is finished by the next.
+        events.clear();
+        describe_utf8(parser, "\x1b]2;\xE4\xB8", events);
+        parser.reset();
+        describe_utf8(parser, "\x80", events);
+        return malformed && events == L"\x4E00" && parser.in_ground();
+    }
+
+    bool test_reset_returns_to_ground()
+    {
+        VtOutputParser parser;
+        std::wstring events;
+        describe(parser, L"\x1b]2;unterminated", events);
+        const bool pending = !parser.in_ground();
+        parser.reset();
+        describe(parser, L"a", events);
+        return pending && events == L"a";
+    }
+}
+
+bool run_condrv_vt_output_parser_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_csi_parameters_leaders_and_intermediates", test_csi_parameters_leaders_and_intermediates },
+        { L"test_malformed_csi_is_consumed_without_dispatch", test_malformed_csi_is_consumed_without_dispatch },
+        { L"test_controls_inside_sequences", test_controls_inside_sequences },
+        { L"test_ground_controls_execute", test_ground_controls_execute },
+        { L"test_osc_terminators", test_osc_terminators },
+        { L"test_overlong_sequences_are_abandoned", test_overlong_sequences_are_abandoned },
+        { L"test_split_input_parses_like_whole", test_split_input_parses_like_whole },
+        { L"test_utf8_bytes_parse_like_utf16", test_utf8_bytes_parse_like_utf16 },
+        { L"test_malformed_utf8_becomes_replacement_characters", test_malformed_utf8_becomes_replacement_characters },
+        { L"test_reset_returns_to_ground", test_reset_returns_to_ground },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv vt output parser] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
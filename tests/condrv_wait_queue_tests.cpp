@@ -0,0 +1,590 @@
+#include "condrv/condrv_server.hpp"
+#include "condrv/condrv_wait_queue.hpp"
+
+#include <Windows.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <expected>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace
+{
+    struct MemoryComm final
+    {
+        std::vector<std::byte> input;
+        std::vector<std::byte> output;
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> read_input(oc::condrv::IoOperation& operation) noexcept
+        {
+            if (operation.buffer.data == nullptr)
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"read_input received null buffer",
+                    .win32_error = ERROR_INVALID_PARAMETER,
+                });
+            }
+
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset > input.size())
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"read_input offset exceeded input size",
+                    .win32_error = ERROR_INVALID_DATA,
+                });
+            }
+
+            const size_t remaining = input.size() - offset;
+            const size_t to_copy = remaining < size ? remaining : size;
+            if (to_copy != 0)
+            {
+                std::memcpy(operation.buffer.data, input.data() + offset, to_copy);
+            }
+            if (to_copy < size)
+            {
+                std::memset(static_cast<std::byte*>(operation.buffer.data) + to_copy, 0, size - to_copy);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> write_output(oc::condrv::IoOperation& operation) noexcept
+        {
+            if (operation.buffer.data == nullptr)
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"write_output received null buffer",
+                    .win32_error = ERROR_INVALID_PARAMETER,
+                });
+            }
+
+            const auto offset = static_cast<size_t>(operation.buffer.offset);
+            const auto size = static_cast<size_t>(operation.buffer.size);
+            if (offset > output.size())
+            {
+                output.resize(offset);
+            }
+            output.resize(offset + size);
+            if (size != 0)
+            {
+                std::memcpy(output.data() + offset, operation.buffer.data, size);
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> complete_io(const oc::condrv::IoComplete& /*completion*/) noexcept
+        {
+            return {};
+        }
+    };
+
+    struct QueueHostIo final
+    {
+        std::vector<std::byte> written;
+        std::vector<std::byte> queue;
+        size_t queue_offset{ 0 };
+        bool disconnected{ false };
+        std::vector<DWORD> end_task_pids;
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> write_output_bytes(std::span<const std::byte> bytes) noexcept
+        {
+            try
+            {
+                written.insert(written.end(), bytes.begin(), bytes.end());
+                return bytes.size();
+            }
+            catch (...)
+            {
+                return std::unexpected(oc::condrv::DeviceCommError{
+                    .context = L"write_output_bytes failed",
+                    .win32_error = ERROR_OUTOFMEMORY,
+                });
+            }
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> read_input_bytes(std::span<std::byte> dest) noexcept
+        {
+            const size_t remaining = input_bytes_available();
+            const size_t to_copy = remaining < dest.size() ? remaining : dest.size();
+            if (to_copy != 0)
+            {
+                std::memcpy(dest.data(), queue.data() + queue_offset, to_copy);
+                queue_offset += to_copy;
+            }
+            return to_copy;
+        }
+
+        [[nodiscard]] std::expected<size_t, oc::condrv::DeviceCommError> peek_input_bytes(std::span<std::byte> dest) noexcept
+        {
+            const size_t remaining = input_bytes_available();
+            const size_t to_copy = remaining < dest.size() ? remaining : dest.size();
+            if (to_copy != 0)
+            {
+                std::memcpy(dest.data(), queue.data() + queue_offset, to_copy);
+            }
+            return to_copy;
+        }
+
+        [[nodiscard]] size_t input_bytes_available() const noexcept
+        {
+            if (queue_offset >= queue.size())
+            {
+                return 0;
+            }
+            return queue.size() - queue_offset;
+        }
+
+        [[nodiscard]] bool inject_input_bytes(std::span<const std::byte> bytes) noexcept
+        {
+            if (bytes.empty())
+            {
+                return true;
+            }
+
+            try
+            {
+                queue.insert(queue.end(), bytes.begin(), bytes.end());
+                return true;
+            }
+            catch (...)
+            {
+                return false;
+            }
+        }
+
+        [[nodiscard]] bool vt_should_answer_queries() const noexcept
+        {
+            return true;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> flush_input_buffer() noexcept
+        {
+            queue.clear();
+            queue_offset = 0;
+            return {};
+        }
+
+        [[nodiscard]] std::expected<bool, oc::condrv::DeviceCommError> wait_for_input(const DWORD /*timeout_ms*/) noexcept
+        {
+            return input_bytes_available() != 0;
+        }
+
+        [[nodiscard]] bool input_disconnected() const noexcept
+        {
+            return disconnected;
+        }
+
+        [[nodiscard]] std::expected<void, oc::condrv::DeviceCommError> send_end_task(
+            const DWORD process_id,
+            const DWORD /*event_type*/,
+            const DWORD /*ctrl_flags*/) noexcept
+        {
+            end_task_pids.push_back(process_id);
+            return {};
+        }
+    };
+
+    struct TestMessage final
+    {
+        int value{};
+    };
+
+    using TestWaitQueue = oc::condrv::BasicWaitQueue<TestMessage>;
+    using MessageWaitQueue = oc::condrv::BasicWaitQueueFor<MemoryComm>;
+
+    [[nodiscard]] bool push_test_message(TestWaitQueue& queue, const int value, const ULONG_PTR object, const ULONG_PTR process) noexcept
+    {
+        return queue.push(TestMessage{ value }, oc::condrv::WaitKey{ .object = object, .process = process }, oc::condrv::input_read_wait_reasons).has_value();
+    }
+
+    [[nodiscard]] bool test_object_signal_readies_only_that_object()
+    {
+        TestWaitQueue queue{};
+        if (!push_test_message(queue, 1, 10, 100) ||
+            !push_test_message(queue, 2, 20, 100) ||
+            !push_test_message(queue, 3, 10, 200))
+        {
+            return false;
+        }
+
+        if (queue.next_ready(true).has_value())
+        {
+            return false;
+        }
+
+        queue.signal_object(10);
+        const auto first = queue.next_ready(false);
+        const auto second = queue.next_ready(false);
+        if (!first || !second || queue.next_ready(false).has_value())
+        {
+            return false;
+        }
+
+        return queue.message(*first).value == 1 && queue.message(*second).value == 3 && queue.size() == 3;
+    }
+
+    [[nodiscard]] bool test_process_disconnect_readies_only_owned_waiters()
+    {
+        TestWaitQueue queue{};
+        if (!push_test_message(queue, 1, 10, 100) ||
+            !push_test_message(queue, 2, 20, 200) ||
+            !push_test_message(queue, 3, 30, 100))
+        {
+            return false;
+        }
+
+        queue.signal_process_disconnected(200);
+        const auto ready = queue.next_ready(false);
+        if (!ready || queue.message(*ready).value != 2 || queue.next_ready(false).has_value())
+        {
+            return false;
+        }
+
+        const auto taken = queue.take(*ready);
+        return taken.value == 2 && queue.size() == 2;
+    }
+
+    [[nodiscard]] bool test_input_round_is_oldest_first_and_stops_when_input_runs_dry()
+    {
+        TestWaitQueue queue{};
+        for (int i = 0; i < 4; ++i)
+        {
+            if (!push_test_message(queue, i, 10 + static_cast<ULONG_PTR>(i), 100))
+            {
+                return false;
+            }
+        }
+
+        queue.signal_input_available();
+        const auto first = queue.next_ready(true);
+        const auto second = queue.next_ready(true);
+        if (!first || !second || queue.message(*first).value != 0 || queue.message(*second).value != 1)
+        {
+            return false;
+        }
+
+        // Input ran dry: the round ends and later waiters are not retried.
+        if (queue.next_ready(false).has_value() || queue.next_ready(true).has_value())
+        {
+            return false;
+        }
+
+        // New input restarts from the oldest waiter.
+        queue.signal_input_available();
+        const auto restarted = queue.next_ready(true);
+        return restarted && queue.message(*restarted).value == 0 && queue.statistics().retries == 3;
+    }
+
+    [[nodiscard]] bool test_take_during_round_advances_cursor()
+    {
+        TestWaitQueue queue{};
+        for (int i = 0; i < 3; ++i)
+        {
+            if (!push_test_message(queue, i, 10, 100))
+            {
+                return false;
+            }
+        }
+
+        queue.signal_input_available();
+        const auto first = queue.next_ready(true);
+        if (!first)
+        {
+            return false;
+        }
+
+        (void)queue.take(*first);
+
+        // The round cursor already points at the second waiter; taking the first must not disturb it.
+        const auto second = queue.next_ready(true);
+        if (!second || queue.message(*second).value != 1)
+        {
+            return false;
+        }
+
+        (void)queue.take(*second);
+        const auto third = queue.next_ready(true);
+        return third && queue.message(*third).value == 2 && !queue.next_ready(true).has_value();
+    }
+
+    [[nodiscard]] bool test_slots_are_reused_after_take()
+    {
+        TestWaitQueue queue{};
+        for (int round = 0; round < 3; ++round)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                if (!push_test_message(queue, i, 10, 100))
+                {
+                    return false;
+                }
+            }
+
+            queue.signal_object(10);
+            while (const auto id = queue.next_ready(false))
+            {
+                (void)queue.take(*id);
+            }
+
+            if (!queue.empty())
+            {
+                return false;
+            }
+        }
+
+        return queue.statistics().peak_waiters == 8 && queue.statistics().completions == 24;
+    }
+
+    [[nodiscard]] bool test_broadcast_reasons_respect_registration()
+    {
+        TestWaitQueue queue{};
+        const auto disconnect_only = oc::condrv::wait_reason_bit(oc::condrv::WaitReason::input_disconnected);
+        if (!queue.push(TestMessage{ 1 }, oc::condrv::WaitKey{ .object = 10, .process = 100 }, disconnect_only) ||
+            !push_test_message(queue, 2, 20, 100))
+        {
+            return false;
+        }
+
+        queue.signal_ctrl_event();
+        const auto ctrl = queue.next_ready(false);
+        if (!ctrl || queue.message(*ctrl).value != 2 || queue.next_ready(false).has_value())
+        {
+            return false;
+        }
+
+        queue.signal_input_available();
+        const auto input = queue.next_ready(true);
+        if (!input || queue.message(*input).value != 2 || queue.next_ready(true).has_value())
+        {
+            return false;
+        }
+
+        queue.signal_input_disconnected();
+        const auto a = queue.next_ready(false);
+        const auto b = queue.next_ready(false);
+        return a && b && queue.message(*a).value == 1 && queue.message(*b).value == 2;
+    }
+
+    [[nodiscard]] oc::condrv::IoPacket make_connect_packet(const DWORD pid, const DWORD tid) noexcept
+    {
+        oc::condrv::IoPacket packet{};
+        packet.descriptor.identifier.LowPart = 1;
+        packet.descriptor.function = oc::condrv::console_io_connect;
+        packet.descriptor.process = pid;
+        packet.descriptor.object = tid;
+        return packet;
+    }
+
+    [[nodiscard]] bool connect_to_server(
+        MemoryComm& comm,
+        oc::condrv::ServerState& state,
+        QueueHostIo& host_io,
+        const DWORD pid,
+        const DWORD tid,
+        oc::condrv::ConnectionInformation& out_info) noexcept
+    {
+        auto connect_packet = make_connect_packet(pid, tid);
+        oc::condrv::BasicApiMessage<MemoryComm> connect_message(comm, connect_packet);
+        auto outcome = oc::condrv::dispatch_message(state, connect_message, host_io);
+        if (!outcome || connect_message.completion().io_status.Status != oc::core::status_success)
+        {
+            return false;
+        }
+
+        std::memcpy(&out_info, connect_message.completion().write.data, sizeof(out_info));
+        return true;
+    }
+
+    [[nodiscard]] oc::condrv::IoPacket make_read_console_packet(const oc::condrv::ConnectionInformation& info, const ULONG id) noexcept
+    {
+        constexpr ULONG api_size = sizeof(CONSOLE_READCONSOLE_MSG);
+        constexpr ULONG read_offset = api_size + sizeof(CONSOLE_MSG_HEADER);
+
+        oc::condrv::IoPacket packet{};
+        packet.payload.user_defined = oc::condrv::UserDefinedPacket{};
+        packet.descriptor.identifier.LowPart = id;
+        packet.descriptor.function = oc::condrv::console_io_user_defined;
+        packet.descriptor.process = info.process;
+        packet.descriptor.object = info.input;
+        packet.descriptor.input_size = read_offset;
+        packet.descriptor.output_size = api_size + static_cast<ULONG>(sizeof(wchar_t));
+        packet.payload.user_defined.msg_header.ApiNumber = static_cast<ULONG>(ConsolepReadConsole);
+        packet.payload.user_defined.msg_header.ApiDescriptorSize = api_size;
+        packet.payload.user_defined.u.console_msg_l1.ReadConsole.Unicode = TRUE;
+        return packet;
+    }
+
+    // 1000 blocked ReadConsoleW calls spread over 50 clients. Each wake must only retry the waiters
+    // it can unblock: one byte of input retries (and completes) only the oldest reader, a client
+    // disconnect retries only that client's readers, and an input disconnect fails all of them.
+    [[nodiscard]] bool test_thousand_pending_reads_wake_only_ready_waiters()
+    {
+        constexpr size_t client_count = 50;
+        constexpr size_t reads_per_client = 20;
+        constexpr size_t total_reads = client_count * reads_per_client;
+
+        oc::condrv::ServerState state{};
+        QueueHostIo host_io{};
+        MemoryComm comm{};
+        comm.input.assign(sizeof(CONSOLE_READCONSOLE_MSG) + sizeof(CONSOLE_MSG_HEADER), std::byte{});
+
+        std::vector<oc::condrv::ConnectionInformation> clients(client_count);
+        for (size_t i = 0; i < client_count; ++i)
+        {
+            if (!connect_to_server(comm, state, host_io, static_cast<DWORD>(5000 + i), static_cast<DWORD>(6000 + i), clients[i]))
+            {
+                return false;
+            }
+        }
+
+        state.set_input_code_page(CP_UTF8);
+        state.set_input_mode(0); // raw ReadConsole behavior
+
+        MessageWaitQueue queue{};
+        for (size_t read = 0; read < reads_per_client; ++read)
+        {
+            for (size_t client = 0; client < client_count; ++client)
+            {
+                auto packet = make_read_console_packet(clients[client], static_cast<ULONG>(100 + read * client_count + client));
+                oc::condrv::BasicApiMessage<MemoryComm> message(comm, packet);
+                auto outcome = oc::condrv::dispatch_message(state, message, host_io);
+                if (!outcome || !outcome->reply_pending)
+                {
+                    return false;
+                }
+
+                if (!oc::condrv::park_reply_pending(queue, std::move(message)))
+                {
+                    return false;
+                }
+            }
+        }
+
+        if (queue.size() != total_reads)
+        {
+            return false;
+        }
+
+        // A wake with nothing signalled retries nobody.
+        auto idle = oc::condrv::service_wait_queue(state, queue, host_io);
+        if (!idle || idle->has_value() || queue.statistics().retries != 0)
+        {
+            return false;
+        }
+
+        // One byte of input: only the oldest reader is retried and completes.
+        const std::array<std::byte, 1> key{ static_cast<std::byte>('k') };
+        if (!host_io.inject_input_bytes(key))
+        {
+            return false;
+        }
+
+        queue.signal_input_available();
+        auto completed = oc::condrv::service_wait_queue(state, queue, host_io);
+        if (!completed || !completed->has_value())
+        {
+            return false;
+        }
+
+        auto& first = **completed;
+        if (first.completion().io_status.Status != oc::core::status_success ||
+            first.descriptor().process != clients[0].process ||
+            first.descriptor().identifier.LowPart != 100)
+        {
+            return false;
+        }
+
+        // The completion signals its own handle, so only client 0's other readers get a (pending) retry.
+        auto drained = oc::condrv::service_wait_queue(state, queue, host_io);
+        if (!drained || drained->has_value() || queue.size() != total_reads - 1 || queue.statistics().retries != reads_per_client)
+        {
+            return false;
+        }
+
+        // Disconnecting a client wakes and fails only its own readers.
+        const auto& victim = clients[7];
+        oc::condrv::IoPacket disconnect{};
+        disconnect.descriptor.function = oc::condrv::console_io_disconnect;
+        disconnect.descriptor.process = victim.process;
+        oc::condrv::BasicApiMessage<MemoryComm> disconnect_message(comm, disconnect);
+        if (auto outcome = oc::condrv::dispatch_message(state, disconnect_message, host_io); !outcome || outcome->reply_pending)
+        {
+            return false;
+        }
+
+        oc::condrv::signal_waiters_after_dispatch(queue, disconnect);
+
+        const uint64_t retries_before_disconnect = queue.statistics().retries;
+        for (size_t i = 0; i < reads_per_client; ++i)
+        {
+            auto failed = oc::condrv::service_wait_queue(state, queue, host_io);
+            if (!failed || !failed->has_value() ||
+                (*failed)->descriptor().process != victim.process ||
+                (*failed)->completion().io_status.Status == oc::core::status_success)
+            {
+                return false;
+            }
+        }
+
+        if (queue.statistics().retries - retries_before_disconnect != reads_per_client)
+        {
+            return false;
+        }
+
+        // Input disconnect: every remaining reader completes with failure, one retry each.
+        host_io.disconnected = true;
+        queue.signal_input_disconnected();
+
+        const size_t remaining = queue.size();
+        const uint64_t retries_before_input_disconnect = queue.statistics().retries;
+        for (size_t i = 0; i < remaining; ++i)
+        {
+            auto failed = oc::condrv::service_wait_queue(state, queue, host_io);
+            if (!failed || !failed->has_value() ||
+                (*failed)->completion().io_status.Status != oc::core::status_unsuccessful)
+            {
+                return false;
+            }
+        }
+
+        return queue.empty() &&
+               queue.statistics().retries - retries_before_input_disconnect == remaining &&
+               queue.statistics().peak_waiters == total_reads;
+    }
+}
+
+bool run_condrv_wait_queue_tests()
+{
+    struct NamedTest final
+    {
+        const wchar_t* name;
+        bool (*run)();
+    };
+
+    static constexpr NamedTest tests[] = {
+        { L"test_object_signal_readies_only_that_object", test_object_signal_readies_only_that_object },
+        { L"test_process_disconnect_readies_only_owned_waiters", test_process_disconnect_readies_only_owned_waiters },
+        { L"test_input_round_is_oldest_first_and_stops_when_input_runs_dry", test_input_round_is_oldest_first_and_stops_when_input_runs_dry },
+        { L"test_take_during_round_advances_cursor", test_take_during_round_advances_cursor },
+        { L"test_slots_are_reused_after_take", test_slots_are_reused_after_take },
+        { L"test_broadcast_reasons_respect_registration", test_broadcast_reasons_respect_registration },
+        { L"test_thousand_pending_reads_wake_only_ready_waiters", test_thousand_pending_reads_wake_only_ready_waiters },
+    };
+
+    for (const auto& test : tests)
+    {
+        if (!test.run())
+        {
+            fwprintf(stderr, L"[condrv wait queue] %ls failed\n", test.name);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -236,7 +236,11 @@ namespace
             L"hold_on_exit=1\n"
             L"allow_embedding_passthrough=0\n"
             L"enable_legacy_conhost_path=0\n"
-            L"embedding_wait_timeout_ms=1500\n");
+            L"embedding_wait_timeout_ms=1500\n"
+            L"condrv_pipelined_io=1\n"
+            L"condrv_trace_dir=C:\\temp\\traces\n"
+            L"condrv_api_metrics=1\n"
+            L"snapshot_max_fps=30\n");
         if (!parsed)
         {
             return false;
@@ -253,7 +257,11 @@ namespace
                parsed->hold_window_on_exit &&
                !parsed->allow_embedding_passthrough &&
                !parsed->enable_legacy_conhost_path &&
-               parsed->embedding_wait_timeout_ms == 1500;
+               parsed->embedding_wait_timeout_ms == 1500 &&
+               parsed->condrv_pipelined_io &&
+               parsed->condrv_trace_directory == L"C:\\temp\\traces" &&
+               parsed->condrv_api_metrics &&
+               parsed->snapshot_max_fps == 30;
     }
 
     bool test_environment_overrides()
@@ -276,6 +284,10 @@ namespace
         const ScopedEnvironmentVariable embedding_passthrough(L"OPENCONSOLE_NEW_ALLOW_EMBEDDING_PASSTHROUGH", std::optional<std::wstring>(L"0"));
         const ScopedEnvironmentVariable legacy_path(L"OPENCONSOLE_NEW_ENABLE_LEGACY_PATH", std::optional<std::wstring>(L"0"));
         const ScopedEnvironmentVariable embedding_wait(L"OPENCONSOLE_NEW_EMBEDDING_WAIT_MS", std::optional<std::wstring>(L"220"));
+        const ScopedEnvironmentVariable pipelined_io(L"OPENCONSOLE_NEW_CONDRV_PIPELINED_IO", std::optional<std::wstring>(L"1"));
+        const ScopedEnvironmentVariable trace_dir(L"OPENCONSOLE_NEW_CONDRV_TRACE_DIR", std::optional<std::wstring>(L"C:\\temp\\traces"));
+        const ScopedEnvironmentVariable api_metrics(L"OPENCONSOLE_NEW_CONDRV_API_METRICS", std::optional<std::wstring>(L"1"));
+        const ScopedEnvironmentVariable snapshot_max_fps(L"OPENCONSOLE_NEW_SNAPSHOT_MAX_FPS", std::optional<std::wstring>(L"0"));
 
         const auto loaded = oc::config::ConfigLoader::load();
 
@@ -295,7 +307,11 @@ namespace
                loaded->hold_window_on_exit &&
                !loaded->allow_embedding_passthrough &&
                !loaded->enable_legacy_conhost_path &&
-               loaded->embedding_wait_timeout_ms == 220;
+               loaded->embedding_wait_timeout_ms == 220 &&
+               loaded->condrv_pipelined_io &&
+               loaded->condrv_trace_directory == L"C:\\temp\\traces" &&
+               loaded->condrv_api_metrics &&
+               loaded->snapshot_max_fps == 0;
     }
 
     bool test_parse_text_invalid_line_fails()
@@ -19,11 +19,25 @@ bool run_com_embedding_integration_tests();
 bool run_host_signals_tests();
 bool run_condrv_protocol_tests();
 bool run_condrv_api_message_tests();
+bool run_condrv_api_metrics_tests();
+bool run_condrv_message_buffer_pool_tests();
 bool run_condrv_server_dispatch_tests();
 bool run_condrv_input_wait_tests();
+bool run_condrv_wait_queue_tests();
+bool run_condrv_server_pipeline_tests();
+bool run_condrv_host_output_buffer_tests();
+bool run_condrv_packet_trace_tests();
 bool run_condrv_raw_io_tests();
+bool run_condrv_screen_buffer_tests();
+bool run_condrv_screen_cell_span_tests();
+bool run_condrv_compact_row_tests();
+bool run_condrv_attribute_table_tests();
+bool run_condrv_cluster_table_tests();
+bool run_condrv_unicode_width_tests();
 bool run_condrv_screen_buffer_snapshot_tests();
+bool run_condrv_snapshot_publisher_tests();
 bool run_condrv_vt_fuzz_tests();
+bool run_condrv_vt_output_parser_tests();
 bool run_dwrite_text_measurer_tests();
 bool run_process_integration_tests();
 
@@ -165,6 +179,20 @@ int main()
         ++failed;
     }
 
+    trace(L"condrv api metrics");
+    if (!run_condrv_api_metrics_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv api metrics tests\n");
+        ++failed;
+    }
+
+    trace(L"condrv message buffer pool");
+    if (!run_condrv_message_buffer_pool_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv message buffer pool tests\n");
+        ++failed;
+    }
+
     trace(L"condrv server dispatch");
     if (!run_condrv_server_dispatch_tests())
     {
@@ -179,6 +207,34 @@ int main()
         ++failed;
     }
 
+    trace(L"condrv wait queue");
+    if (!run_condrv_wait_queue_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv wait queue tests\n");
+        ++failed;
+    }
+
+    trace(L"condrv server pipeline");
+    if (!run_condrv_server_pipeline_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv server pipeline tests\n");
+        ++failed;
+    }
+
+    trace(L"condrv host output buffer");
+    if (!run_condrv_host_output_buffer_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv host output buffer tests\n");
+        ++failed;
+    }
+
+    trace(L"condrv packet trace");
+    if (!run_condrv_packet_trace_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv packet trace tests\n");
+        ++failed;
+    }
+
     trace(L"condrv raw io");
     if (!run_condrv_raw_io_tests())
     {
@@ -186,6 +242,48 @@ int main()
         ++failed;
     }
 
+    trace(L"condrv screen buffer");
+    if (!run_condrv_screen_buffer_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv screen buffer tests\n");
+        ++failed;
+    }
+
+    trace(L"condrv screen cell span");
+    if (!run_condrv_screen_cell_span_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv screen cell span tests\n");
+        ++failed;
+    }
+
+    trace(L"condrv compact row");
+    if (!run_condrv_compact_row_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv compact row tests\n");
+        ++failed;
+    }
+
+    trace(L"condrv attribute table");
+    if (!run_condrv_attribute_table_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv attribute table tests\n");
+        ++failed;
+    }
+
+    trace(L"condrv cluster table");
+    if (!run_condrv_cluster_table_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv cluster table tests\n");
+        ++failed;
+    }
+
+    trace(L"condrv unicode width");
+    if (!run_condrv_unicode_width_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv unicode width tests\n");
+        ++failed;
+    }
+
     trace(L"condrv screen buffer snapshot");
     if (!run_condrv_screen_buffer_snapshot_tests())
     {
@@ -193,6 +291,13 @@ int main()
         ++failed;
     }
 
+    trace(L"condrv snapshot publisher");
+    if (!run_condrv_snapshot_publisher_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv snapshot publisher tests\n");
+        ++failed;
+    }
+
     trace(L"condrv vt fuzz");
     if (!run_condrv_vt_fuzz_tests())
     {
@@ -200,6 +305,13 @@ int main()
         ++failed;
     }
 
+    trace(L"condrv vt output parser");
+    if (!run_condrv_vt_output_parser_tests())
+    {
+        fwprintf(stderr, L"[FAIL] condrv vt output parser tests\n");
+        ++failed;
+    }
+
     trace(L"dwrite text measurer");
     if (!run_dwrite_text_measurer_tests())
     {